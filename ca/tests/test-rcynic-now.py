@@ -0,0 +1,190 @@
+#!/usr/bin/env python
+# $Id$
+#
+# Copyright (C) 2016  Parsons Government Services ("PARSONS")
+#
+# Permission to use, copy, modify, and distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notices and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND PARSONS DISCLAIMS ALL
+# WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS.  IN NO EVENT SHALL
+# PARSONS BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+# CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+# OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+# NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION
+# WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+"""
+Test driver for rcynic's --now option.
+
+Always checks which time values --now accepts and what time rcynic
+says it's validating as of, which exercises rcynic's time string
+parser: leap years, UTCTime's two-digit years, out of range fields.
+
+With --replay, also replays validation of the unauthenticated data
+left behind by a previous yamltest or smoketest run, without running
+rsync, at several different times, and checks that what rcynic
+accepts depends on the time as it should.
+"""
+
+import os
+import re
+import sys
+import time
+import shutil
+import tempfile
+import textwrap
+import unittest
+import argparse
+import subprocess
+
+top = os.path.abspath(os.path.join(os.path.dirname(sys.argv[0]), "..", ".."))
+
+# Anything we don't recognize is for unittest.
+
+parser = argparse.ArgumentParser(description = __doc__, add_help = False)
+parser.add_argument("--rcynic", default = os.path.join(top, "rp/rcynic/rcynic"))
+parser.add_argument("--replay", action = "store_true")
+parser.add_argument("--unauthenticated", default = "rcynic-data/unauthenticated")
+parser.add_argument("--trust-anchor", default = "yamltest.dir/RIR/publication/RIR-root/root.cer")
+args, unittest_argv = parser.parse_known_args()
+
+tempdir = None
+
+def rcynic(now, trust_anchor = None, unauthenticated = None):
+    """
+    Run one rcynic cycle with a scratch configuration and a fresh
+    authenticated tree.  Returns rcynic's exit status, the time rcynic
+    said it was validating as of (if any), and the authenticated tree.
+    """
+
+    rcynic.runs += 1
+    authenticated = os.path.join(tempdir, "authenticated.%d" % rcynic.runs)
+    conf = os.path.join(tempdir, "rcynic.conf")
+
+    with open(conf, "w") as f:
+        f.write(textwrap.dedent('''\
+          # Automatically generated for --now tests, do not edit.
+          [rcynic]
+          jitter          = 0
+          use-syslog      = no
+          use-stderr      = yes
+          log-level       = log_telemetry
+          run-rsync       = no
+          host-database   = %s
+          ''' % os.path.join(tempdir, "hosts")))
+        if trust_anchor is not None:
+            f.write("trust-anchor    = %s\n" % trust_anchor)
+
+    argv = [args.rcynic, "-c", conf, "-a", authenticated,
+            "-u", unauthenticated or os.path.join(tempdir, "unauthenticated")]
+    if now is not None:
+        argv.extend(("-n", now))
+
+    p = subprocess.Popen(argv, stdout = subprocess.PIPE, stderr = subprocess.STDOUT)
+    output = p.communicate()[0]
+    m = re.search(r"Validating as of (\S+)", output)
+    return p.returncode, m and m.group(1), authenticated
+
+rcynic.runs = 0
+
+def count_objects(authenticated):
+    return sum(len(files) for root, dirs, files in os.walk(authenticated))
+
+# Time values --now must accept, and what they mean.
+
+accept = (
+    ("1456747200",              "2016-02-29T12:00:00Z"),        # Seconds since the epoch
+    ("20160229120000Z",         "2016-02-29T12:00:00Z"),        # Leap year
+    ("20000229000000Z",         "2000-02-29T00:00:00Z"),        # Leap year divisible by 400
+    ("20161231235959Z",         "2016-12-31T23:59:59Z"),
+    ("19700101000001Z",         "1970-01-01T00:00:01Z"),
+    ("160229120000Z",           "2016-02-29T12:00:00Z"),        # UTCTime
+    ("491231235959Z",           "2049-12-31T23:59:59Z"),        # UTCTime, last year in 2000s
+    ("700101000001Z",           "1970-01-01T00:00:01Z"),        # UTCTime, year in 1900s
+    ("991231235959Z",           "1999-12-31T23:59:59Z"),
+)
+
+# Time values --now must reject.
+
+reject = (
+    "20150229120000Z",          # Not a leap year
+    "19000229000000Z",          # Century, not a leap year
+    "20160101000060Z",          # Leap seconds aren't allowed
+    "20160101006000Z",
+    "20160101240000Z",
+    "20160100000000Z",
+    "20160132000000Z",
+    "20160431000000Z",
+    "20160001000000Z",
+    "20161301000000Z",
+    "500101000000Z",            # UTCTime, first year in 1900s, before the epoch
+    "19691231235959Z",          # Before the epoch
+    "0",
+    "-1",
+    "",
+    "2016022912000Z",           # Too short
+    "201602291200000Z",         # Too long
+    "20160229120000",           # Missing Z
+    "20160229120000+0000",      # Time zone offsets aren't allowed
+    "20160229120000.5Z",        # Fractional seconds aren't allowed
+    "2016-02-29T12:00:00Z",
+    "2O160229120000Z",
+    "now",
+)
+
+class NowTest(unittest.TestCase):
+
+    @classmethod
+    def setUpClass(cls):
+        global tempdir
+        tempdir = tempfile.mkdtemp(prefix = "test-rcynic-now.")
+
+    @classmethod
+    def tearDownClass(cls):
+        shutil.rmtree(tempdir)
+
+    def test_accept(self):
+        for now, expected in accept:
+            status, validating_as_of, authenticated = rcynic(now)
+            self.assertEqual(status, 0, "--now %s rejected" % now)
+            self.assertEqual(validating_as_of, expected, "--now %s" % now)
+
+    def test_reject(self):
+        for now in reject:
+            status, validating_as_of, authenticated = rcynic(now)
+            self.assertNotEqual(status, 0, "--now %r accepted" % now)
+            self.assertIsNone(validating_as_of, "--now %r" % now)
+
+    def test_without_now(self):
+        status, validating_as_of, authenticated = rcynic(None)
+        self.assertEqual(status, 0)
+        self.assertIsNone(validating_as_of)
+
+    @unittest.skipUnless(args.replay, "needs --replay")
+    def test_replay(self):
+        """
+        Run once at the current time to see what there is to find,
+        then replay the same data at other times.  The current time as
+        seconds since the epoch should find exactly the same things;
+        long before or long after everything was issued there should
+        be nothing at all, not even the trust anchor.
+        """
+
+        def replay(now):
+            status, validating_as_of, authenticated = rcynic(now, args.trust_anchor, args.unauthenticated)
+            self.assertEqual(status, 0, "Replay with --now %s failed" % now)
+            return count_objects(authenticated)
+
+        baseline = replay(None)
+        self.assertNotEqual(baseline, 0, "Nothing validated from %s, nothing to replay" % args.unauthenticated)
+
+        for now, expected in ((str(int(time.time())), baseline),
+                              ("19800101000000Z",     0),
+                              ("20991231235959Z",     0)):
+            self.assertEqual(replay(now), expected, "Replay with --now %s" % now)
+
+if __name__ == "__main__":
+    unittest.main(argv = sys.argv[:1] + unittest_argv)
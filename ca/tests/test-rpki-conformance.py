@@ -0,0 +1,253 @@
+#!/usr/bin/env python
+# $Id$
+#
+# Copyright (C) 2016  Parsons Government Services ("PARSONS")
+#
+# Permission to use, copy, modify, and distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notices and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND PARSONS DISCLAIMS ALL
+# WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS.  IN NO EVENT SHALL
+# PARSONS BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+# CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+# OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+# NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION
+# WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+"""
+Test driver for the RPKI profile extension checks in rpki.POW.
+
+Builds conforming certificates and CRLs, then variants with one thing
+wrong with their extensions, and checks that .checkRPKIConformance()
+reports exactly the expected status codes for each.  POW won't build
+some of the broken variants (unknown or duplicate extensions, say), so
+we splice those into the DER by hand and re-sign.
+"""
+
+import datetime
+import unittest
+
+import rpki.POW
+import rpki.oids
+
+# Just enough DER to find and rewrite extension lists.
+
+def der_length(n):
+    if n < 0x80:
+        return chr(n)
+    s = ""
+    while n > 0:
+        s = chr(n & 0xFF) + s
+        n >>= 8
+    return chr(0x80 | len(s)) + s
+
+def der(tag, content):
+    return chr(tag) + der_length(len(content)) + content
+
+def der_children(content):
+    """
+    Split the contents of a constructed type into (tag, tlv, contents)
+    triples.
+    """
+
+    result = []
+    i = 0
+    while i < len(content):
+        tag = ord(content[i])
+        n = ord(content[i + 1])
+        j = i + 2
+        if n & 0x80:
+            k = n & 0x7F
+            n = 0
+            for c in content[j : j + k]:
+                n = (n << 8) | ord(c)
+            j += k
+        result.append((tag, content[i : j + n], content[j : j + n]))
+        i = j + n
+    return result
+
+def der_oid(dotted):
+    arcs = [int(a) for a in dotted.split(".")]
+    s = ""
+    for arc in [arcs[0] * 40 + arcs[1]] + arcs[2:]:
+        t = chr(arc & 0x7F)
+        arc >>= 7
+        while arc > 0:
+            t = chr(0x80 | (arc & 0x7F)) + t
+            arc >>= 7
+        s += t
+    return der(0x06, s)
+
+def extension(oid, value, critical = False):
+    return der(0x30, der_oid(oid) + (der(0x01, "\xff") if critical else "") + der(0x04, value))
+
+def extension_oid(tlv):
+    return der_children(der_children(tlv)[0][2])[0][1]
+
+def extension_value(tlv):
+    return der_children(der_children(tlv)[0][2])[-1][2]
+
+def edit_extensions(obj, tag, edit):
+    """
+    Rewrite the extension list of a DER certificate or CRL.  tag is
+    the context tag wrapping the extension list in the TBS structure;
+    edit is a function from a list of extension TLVs to a new list.
+    The result is unsigned garbage until the caller re-signs it.
+    """
+
+    outer = der_children(obj)[0][2]
+    fields = []
+    for t, tlv, content in der_children(der_children(outer)[0][2]):
+        if t == tag:
+            exts = der_children(der_children(content)[0][2])
+            tlv = der(tag, der(0x30, "".join(edit([x[1] for x in exts]))))
+        fields.append(tlv)
+    return der(0x30, der(0x30, "".join(fields)) + "".join(x[1] for x in der_children(outer)[1:]))
+
+oid_basic_constraints   = "2.5.29.19"
+oid_ski                 = "2.5.29.14"
+oid_aki                 = "2.5.29.35"
+oid_crl_number          = "2.5.29.20"
+oid_name_constraints    = "2.5.29.30"
+oid_private             = "1.3.6.1.4.1.32473.1"         # RFC 5612 documentation PEN
+
+def add(tlv):
+    return lambda exts: exts + [tlv]
+
+def duplicate(oid):
+    return lambda exts: exts + [x for x in exts if extension_oid(x) == der_oid(oid)]
+
+def remove(oid):
+    return lambda exts: [x for x in exts if extension_oid(x) != der_oid(oid)]
+
+def make_critical(oid):
+    return lambda exts: [extension(oid, extension_value(x), True) if extension_oid(x) == der_oid(oid) else x
+                         for x in exts]
+
+def replace_value(oid, value):
+    return lambda exts: [extension(oid, value) if extension_oid(x) == der_oid(oid) else x
+                         for x in exts]
+
+# Test objects.  One key does for everything: it's the profile checks
+# we're testing, not the signatures.
+
+key = rpki.POW.Asymmetric.generateRSA(2048)
+ski = key.calculateSKI()
+dn  = (((rpki.oids.commonName, "".join("%02X" % ord(i) for i in ski)),),)
+now = datetime.datetime.utcnow().replace(microsecond = 0)
+
+ca_key_usage = ("keyCertSign", "cRLSign")
+ee_key_usage = ("digitalSignature",)
+
+def make_cert(is_ca = True, basic_constraints = (True,), key_usage = None, resources = True, edit = None):
+    cert = rpki.POW.X509()
+    cert.setVersion(2)
+    cert.setSerial(1)
+    cert.setIssuer(dn)
+    cert.setSubject(dn)
+    cert.setNotBefore(now - datetime.timedelta(days = 1))
+    cert.setNotAfter(now + datetime.timedelta(days = 30))
+    cert.setPublicKey(key)
+    cert.setSKI(ski)
+    cert.setAKI(ski)
+    cert.setCertificatePolicies((rpki.oids.id_cp_ipAddr_asNumber,))
+    if is_ca:
+        cert.setSIA(caRepository = ("rsync://example.org/rpki/",),
+                    rpkiManifest = ("rsync://example.org/rpki/ca.mft",))
+    else:
+        cert.setAIA(("rsync://example.org/rpki/ca.cer",))
+        cert.setCRLDP(("rsync://example.org/rpki/ca.crl",))
+        cert.setSIA(signedObject = ("rsync://example.org/rpki/ee.roa",))
+    if basic_constraints is not None and is_ca:
+        cert.setBasicConstraints(*basic_constraints)
+    if key_usage is None:
+        key_usage = ca_key_usage if is_ca else ee_key_usage
+    if key_usage:
+        cert.setKeyUsage(frozenset(key_usage))
+    if resources:
+        cert.setRFC3779(asn  = ((64496, 64511),),
+                        ipv4 = ((rpki.POW.IPAddress("192.0.2.0"), rpki.POW.IPAddress("192.0.2.255")),))
+    cert.sign(key, rpki.POW.SHA256_DIGEST)
+    if edit is not None:
+        cert = rpki.POW.X509.derRead(edit_extensions(cert.derWrite(), 0xA3, edit))
+        cert.sign(key, rpki.POW.SHA256_DIGEST)
+    return cert
+
+def make_crl(aki = True, edit = None):
+    crl = rpki.POW.CRL()
+    crl.setVersion(1)
+    crl.setIssuer(dn)
+    crl.setThisUpdate(now - datetime.timedelta(days = 1))
+    crl.setNextUpdate(now + datetime.timedelta(days = 1))
+    if aki:
+        crl.setAKI(ski)
+    crl.setCRLNumber(1)
+    crl.sign(key, rpki.POW.SHA256_DIGEST)
+    if edit is not None:
+        crl = rpki.POW.CRL.derRead(edit_extensions(crl.derWrite(), 0xA0, edit))
+        crl.sign(key, rpki.POW.SHA256_DIGEST)
+    return crl
+
+issuer = make_cert()
+
+cert_tests = (
+    ("conforming CA certificate",       make_cert(),                                            ()),
+    ("conforming EE certificate",       make_cert(is_ca = False),                               ()),
+    ("non-critical basicConstraints",   make_cert(basic_constraints = (True, None, False)),     ("MALFORMED_BASIC_CONSTRAINTS",)),
+    ("basicConstraints with pathLen",   make_cert(basic_constraints = (True, 0)),               ("MALFORMED_BASIC_CONSTRAINTS",)),
+    ("basicConstraints with cA false",  make_cert(basic_constraints = (False,)),                ("MALFORMED_BASIC_CONSTRAINTS",)),
+    ("CA key usage without cA",         make_cert(basic_constraints = None),                    ("BAD_KEY_USAGE",)),
+    ("missing keyUsage",                make_cert(key_usage = ()),                              ("KEY_USAGE_MISSING",)),
+    ("missing resources",               make_cert(resources = False),                           ("MISSING_RESOURCES",)),
+    ("unknown extension",               make_cert(edit = add(extension(oid_private, "\x05\x00"))),
+                                                                                                ("DISALLOWED_X509V3_EXTENSION",)),
+    ("CRL extension in certificate",    make_cert(edit = add(extension(oid_crl_number, "\x02\x01\x01"))),
+                                                                                                ("DISALLOWED_X509V3_EXTENSION",)),
+    ("nameConstraints",                 make_cert(edit = add(extension(oid_name_constraints, "\x30\x00"))),
+                                                                                                ("DISALLOWED_X509V3_EXTENSION",)),
+    ("duplicate SKI",                   make_cert(edit = duplicate(oid_ski)),                   ("DISALLOWED_X509V3_EXTENSION",)),
+    ("duplicate basicConstraints",      make_cert(edit = duplicate(oid_basic_constraints)),     ("DISALLOWED_X509V3_EXTENSION",)),
+    ("undecodable SKI",                 make_cert(edit = replace_value(oid_ski, "\x02\x01\x01")),
+                                                                                                ("DISALLOWED_X509V3_EXTENSION", "SKI_EXTENSION_MISSING")),
+    ("critical SKI",                    make_cert(edit = make_critical(oid_ski)),               ("GRATUITOUSLY_CRITICAL_EXTENSION",)),
+    ("missing SKI",                     make_cert(edit = remove(oid_ski)),                      ("SKI_EXTENSION_MISSING",)),
+)
+
+crl_tests = (
+    ("conforming CRL",                  make_crl(),                                             ()),
+    ("missing AKI",                     make_crl(aki = False),                                  ("AKI_EXTENSION_MISSING",)),
+    ("certificate extension in CRL",    make_crl(edit = add(extension(oid_ski, der(0x04, ski)))),
+                                                                                                ("DISALLOWED_X509V3_EXTENSION",)),
+    ("duplicate CRL number",            make_crl(edit = duplicate(oid_crl_number)),            ("DISALLOWED_X509V3_EXTENSION",)),
+    ("unknown extension in CRL",        make_crl(edit = add(extension(oid_private, "\x05\x00"))),
+                                                                                                ("DISALLOWED_X509V3_EXTENSION",)),
+)
+
+class ConformanceTest(unittest.TestCase):
+
+    def check(self, tests, **kwargs):
+        """
+        Run .checkRPKIConformance() on each (name, object, expected)
+        test, and fail listing every object whose status codes were
+        wrong.
+        """
+
+        wrong = []
+        for name, obj, expected in tests:
+            status = set()
+            obj.checkRPKIConformance(status = status, **kwargs)
+            if status != set(expected):
+                wrong.append("%s: got %s, expected %s" % (name, sorted(status), sorted(expected)))
+        if wrong:
+            self.fail("\n".join(wrong))
+
+    def test_certificates(self):
+        self.check(cert_tests, eku = None)
+
+    def test_crls(self):
+        self.check(crl_tests, issuer = issuer)
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,226 @@
+#!/usr/bin/env python
+# $Id$
+#
+# Copyright (C) 2016  Parsons Government Services ("PARSONS")
+#
+# Permission to use, copy, modify, and distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notices and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND PARSONS DISCLAIMS ALL
+# WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS.  IN NO EVENT SHALL
+# PARSONS BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+# CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+# OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+# NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION
+# WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+"""
+Test driver for the streaming RRDP parser in rpki.POW.  Feeds the
+parser a small well-formed snapshot and delta, whole and a byte at a
+time, then a collection of malformed files, each of which must be
+rejected, then checks what directory mode does to the filesystem.
+"""
+
+import os
+import base64
+import shutil
+import hashlib
+import tempfile
+import unittest
+
+import rpki.POW
+
+def parse(text, chunk = None, **kwargs):
+    """
+    Run text through a new parser, in chunks of the specified size
+    (default: all at once), and return the parser and the events.
+    """
+
+    p = rpki.POW.RRDPParser(**kwargs)
+    chunk = chunk or len(text) or 1
+    events = []
+    for i in xrange(0, len(text), chunk):
+        events.extend(p.feed(text[i : i + chunk]))
+    p.close()
+    return p, events
+
+xmlns      = "http://www.ripe.net/rpki/rrdp"
+session_id = "9df4b597-af9e-4dca-bdda-719cce2c4e28"
+obj1       = "".join(chr(i) for i in xrange(256))
+obj2       = "Not really DER, but the parser doesn't care"
+hash1      = hashlib.sha256(obj1).hexdigest()
+hash2      = hashlib.sha256(obj2).hexdigest()
+
+def b64(der):
+    # Split into lines the way real publication servers do.
+    s = base64.b64encode(der)
+    return "\n".join(s[i : i + 64] for i in xrange(0, len(s), 64))
+
+snapshot = '''<?xml version="1.0" encoding="US-ASCII"?>
+<!-- Comments are ignored -->
+<snapshot xmlns="%s" version="1" session_id="%s" serial="42">
+  <publish uri="rsync://example.org/rpki/obj1.cer">
+%s
+  </publish>
+  <publish uri='rsync://example.org/rpki/obj2.roa'>%s</publish>
+</snapshot>
+''' % (xmlns, session_id, b64(obj1), b64(obj2))
+
+delta = '''<delta xmlns="%s" version="1" session_id="%s" serial="43">
+  <publish uri="rsync://example.org/rpki/obj1.cer" hash="%s">%s</publish>
+  <withdraw uri="rsync://example.org/rpki/obj2.roa" hash="%s"/>
+</delta>''' % (xmlns, session_id, hash1.upper(), b64(obj2), hash2)
+
+expected_snapshot = [
+    ("publish", "rsync://example.org/rpki/obj1.cer", None,  hash1, obj1),
+    ("publish", "rsync://example.org/rpki/obj2.roa", None,  hash2, obj2)]
+
+expected_delta = [
+    ("publish",  "rsync://example.org/rpki/obj1.cer", hash1, hash2, obj2),
+    ("withdraw", "rsync://example.org/rpki/obj2.roa", hash2, None,  None)]
+
+def root(body = "", tag = "snapshot", attrs = 'version="1" session_id="%s" serial="1"' % session_id):
+    return '<%s xmlns="%s" %s>%s</%s>' % (tag, xmlns, attrs, body, tag)
+
+def publish(der = obj1, uri = "rsync://example.org/rpki/obj1.cer"):
+    return '<publish uri="%s">%s</publish>' % (uri, b64(der))
+
+withdraw = '<withdraw uri="rsync://example.org/rpki/obj2.roa" hash="%s"/>' % hash2
+
+malformed = (
+    ("empty file",                      "",                                                                     {}),
+    ("empty tag in prolog",             "<>" + root(),                                                          {}),
+    ("empty tag in root",               root("<>"),                                                             {}),
+    ("empty tag in publish",            root('<publish uri="rsync://example.org/rpki/x.cer"><></publish>'),     {}),
+    ("empty tag in epilog",             root() + "<>",                                                          {}),
+    ("blank tag",                       root("< >"),                                                            {}),
+    ("empty end tag",                   root("</>"),                                                            {}),
+    ("unterminated tag",                "<snapshot",                                                            {}),
+    ("unterminated quote",              root()[:40],                                                            {}),
+    ("missing end tag",                 root()[:-len("</snapshot>")],                                           {}),
+    ("garbage",                         "This is not XML at all",                                               {}),
+    ("text before root",                "junk" + root(),                                                        {}),
+    ("text after root",                 root() + "junk",                                                        {}),
+    ("second root",                     root() + root(),                                                        {}),
+    ("missing xmlns",                   '<snapshot version="1" session_id="x" serial="1"></snapshot>',          {}),
+    ("wrong xmlns",                     root().replace(xmlns, xmlns + "/"),                                     {}),
+    ("notification as root",            root(tag = "notification"),                                             {}),
+    ("unknown root",                    root(tag = "bogus"),                                                    {}),
+    ("wrong kind",                      root(tag = "delta"),                                                    {"kind" : "snapshot"}),
+    ("wrong session_id",                root(),                                                                 {"session_id" : "x"}),
+    ("wrong serial",                    root(),                                                                 {"serial" : 2}),
+    ("missing version",                 root(attrs = 'session_id="x" serial="1"'),                              {}),
+    ("bad version",                     root(attrs = 'version="2" session_id="x" serial="1"'),                  {}),
+    ("missing session_id",              root(attrs = 'version="1" serial="1"'),                                 {}),
+    ("empty session_id",                root(attrs = 'version="1" session_id="" serial="1"'),                   {}),
+    ("missing serial",                  root(attrs = 'version="1" session_id="x"'),                             {}),
+    ("non-numeric serial",              root(attrs = 'version="1" session_id="x" serial="1x"'),                 {}),
+    ("negative serial",                 root(attrs = 'version="1" session_id="x" serial="-1"'),                 {}),
+    ("duplicate attribute",             root(attrs = 'version="1" version="1" session_id="x" serial="1"'),      {}),
+    ("unknown attribute",               root(attrs = 'version="1" session_id="x" serial="1" foo="bar"'),        {}),
+    ("unquoted attribute",              root(attrs = 'version=1 session_id="x" serial="1"'),                    {}),
+    ("unknown entity in attribute",     root(attrs = 'version="1" session_id="&nbsp;" serial="1"'),             {}),
+    ("doctype",                         "<!DOCTYPE snapshot>" + root(),                                         {}),
+    ("cdata",                           root("<![CDATA[x]]>"),                                                  {}),
+    ("processing instruction in root",  root('<?foo?>'),                                                        {}),
+    ("withdraw in snapshot",            root(withdraw),                                                         {}),
+    ("unknown child element",           root("<foo/>"),                                                         {}),
+    ("nested element",                  root('<publish uri="rsync://example.org/x.cer"><publish/></publish>'),  {}),
+    ("mismatched end tag",              root('<publish uri="rsync://example.org/x.cer"></withdraw>'),           {}),
+    ("missing uri",                     root("<publish>%s</publish>" % b64(obj1)),                              {}),
+    ("hash in snapshot",                root('<publish uri="rsync://example.org/x.cer" hash="%s"/>' % hash1),   {}),
+    ("withdraw without hash",           root('<withdraw uri="rsync://example.org/x.cer"/>', tag = "delta"),     {}),
+    ("short hash",                      root(withdraw.replace(hash2, hash2[:-2]), tag = "delta"),               {}),
+    ("non-hex hash",                    root(withdraw.replace(hash2, "g" + hash2[1:]), tag = "delta"),          {}),
+    ("bad base64",                      root(publish().replace("A", "!", 1)),                                   {}),
+    ("truncated base64",                root(publish(obj2)[:-len("</publish>") - 2] + "</publish>"),            {}),
+    ("data after padding",              root('<publish uri="rsync://example.org/x.cer">AA==AAAA</publish>'),    {}),
+    ("misplaced padding",               root('<publish uri="rsync://example.org/x.cer">A=AA</publish>'),        {}),
+    ("oversized object",                root(publish()),                                                        {"max_object_size" : 100}),
+)
+
+def contents(filename):
+    try:
+        with open(filename, "rb") as f:
+            return f.read()
+    except IOError:
+        return None
+
+class WellFormedTest(unittest.TestCase):
+
+    def check(self, text, kind, serial, expected):
+        for chunk in (None, 1, 7):
+            p, events = parse(text, chunk, kind = kind, session_id = session_id, serial = serial)
+            self.assertEqual([tuple(e) for e in events], expected, "chunk %s" % chunk)
+            self.assertEqual((p.getKind(), p.getSessionID(), p.getSerial()), (kind, session_id, serial),
+                             "chunk %s" % chunk)
+
+    def test_snapshot(self):
+        self.check(snapshot, "snapshot", 42, expected_snapshot)
+
+    def test_delta(self):
+        self.check(delta, "delta", 43, expected_delta)
+
+class MalformedTest(unittest.TestCase):
+
+    def test_malformed(self):
+        accepted = []
+        for name, text, kwargs in malformed:
+            for chunk in (None, 1):
+                try:
+                    parse(text, chunk, **kwargs)
+                except rpki.POW.Error:
+                    pass
+                else:
+                    accepted.append("%s (chunk %s): %r" % (name, chunk, text))
+        if accepted:
+            self.fail("Malformed input accepted:\n" + "\n".join(accepted))
+
+    def test_failed_parser_stays_failed(self):
+        p = rpki.POW.RRDPParser()
+        self.assertRaises(rpki.POW.Error, p.feed, "<>")
+        self.assertRaises(rpki.POW.Error, p.feed, root())
+        self.assertRaises(rpki.POW.Error, p.close)
+
+class DirectoryTest(unittest.TestCase):
+    """
+    In directory mode, the hash in a publish or withdraw element must
+    match the file it replaces or removes, and a rejected element must
+    leave the file alone.
+    """
+
+    def setUp(self):
+        self.tempdir = tempfile.mkdtemp(prefix = "test-rrdp-parser.")
+        self.filename1 = os.path.join(self.tempdir, "example.org", "rpki", "obj1.cer")
+        self.filename2 = os.path.join(self.tempdir, "example.org", "rpki", "obj2.roa")
+        parse(snapshot, directory = self.tempdir)
+
+    def tearDown(self):
+        shutil.rmtree(self.tempdir)
+
+    def test_snapshot(self):
+        self.assertEqual(contents(self.filename1), obj1)
+        self.assertEqual(contents(self.filename2), obj2)
+        self.assertEqual(os.stat(self.filename1).st_mode & 0o777, 0o644)
+
+    def test_delta(self):
+        parse(delta, directory = self.tempdir)
+        self.assertEqual(contents(self.filename1), obj2)
+        self.assertEqual(os.listdir(os.path.dirname(self.filename1)), ["obj1.cer"])
+
+    def test_bad_hashes(self):
+        for name, text in (
+            ("publish with wrong hash",     root('<publish uri="rsync://example.org/rpki/obj1.cer" hash="%s">%s</publish>' % (
+                                                 hash2, b64(obj2)), tag = "delta")),
+            ("withdraw with wrong hash",    root(withdraw.replace(hash2, hash1), tag = "delta")),
+            ("publish replacing nothing",   root('<publish uri="rsync://example.org/rpki/obj3.cer" hash="%s">%s</publish>' % (
+                                                 hash1, b64(obj2)), tag = "delta")),
+            ("withdraw of nothing",         root(withdraw.replace("obj2.roa", "obj3.roa"), tag = "delta"))):
+            self.assertRaises(rpki.POW.Error, parse, text, directory = self.tempdir)
+            self.assertEqual(contents(self.filename1), obj1, name)
+            self.assertEqual(contents(self.filename2), obj2, name)
+
+if __name__ == "__main__":
+    unittest.main()
@@ -83,14 +83,22 @@
 #include <openssl/err.h>
 #include <openssl/sha.h>
 #include <openssl/cms.h>
+#include <openssl/pkcs12.h>
 
 #include <rpki/roa.h>
 #include <rpki/manifest.h>
+#include <rpki/der_view.h>
+#include <rpki/profile.h>
 
 #include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <string.h>
+#include <unistd.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 
 /*
  * GCC attribute to let us tell GCC not to whine about unused formal
@@ -131,6 +139,12 @@ define	GCC_UNUSED
 /* AsymmetricParam EC curves */
 #define EC_P256_CURVE         NID_X9_62_prime256v1
 
+/* RRDP parser limits and namespace */
+#define RRDP_MAX_TAG_LEN              (64 * 1024)
+#define RRDP_MAX_ATTRIBUTES           8
+#define RRDP_DEFAULT_MAX_OBJECT_LEN   (16 * 1024 * 1024)
+#define RRDP_XMLNS                    "http://www.ripe.net/rpki/rrdp"
+
 /* Object check functions */
 #define POW_X509_Check(op)              PyObject_TypeCheck(op, &POW_X509_Type)
 #define POW_X509StoreCTX_Check(op)      PyObject_TypeCheck(op, &POW_X509StoreCTX_Type)
@@ -142,6 +156,7 @@ define	GCC_UNUSED
 #define POW_IPAddress_Check(op)         PyObject_TypeCheck(op, &POW_IPAddress_Type)
 #define POW_ROA_Check(op)               PyObject_TypeCheck(op, &POW_ROA_Type)
 #define POW_Manifest_Check(op)          PyObject_TypeCheck(op, &POW_Manifest_Type)
+#define POW_ManifestBuilder_Check(op)   PyObject_TypeCheck(op, &POW_ManifestBuilder_Type)
 #define POW_ROA_Check(op)               PyObject_TypeCheck(op, &POW_ROA_Type)
 
 static char pow_module__doc__ [] =
@@ -330,8 +345,12 @@ static PyTypeObject
   POW_IPAddress_Type,
   POW_ROA_Type,
   POW_Manifest_Type,
+  POW_ManifestBuilder_Type,
   POW_ROA_Type,
-  POW_PKCS10_Type;
+  POW_PKCS10_Type,
+  POW_RRDPParser_Type,
+  POW_SigningPool_Type,
+  POW_RSAKeyPool_Type;
 
 /*
  * Object internals.
@@ -343,9 +362,30 @@ typedef struct {
   const struct ipaddress_version *type;
 } ipaddress_object;
 
+/*
+ * Slots in the x509_object cache of decoded extensions.  Getters fill
+ * these in on first use, anything which modifies the certificate's
+ * extensions throws them away.  The order here is also the order of
+ * the tuple returned by X509.getRPKIInfo().
+ */
+
+typedef enum {
+  x509_cache_ski,
+  x509_cache_aki,
+  x509_cache_basic_constraints,
+  x509_cache_sia,
+  x509_cache_aia,
+  x509_cache_crldp,
+  x509_cache_eku,
+  x509_cache_certificate_policies,
+  x509_cache_rfc3779,
+  X509_CACHE_SLOTS
+} x509_cache_slot;
+
 typedef struct {
   PyObject_HEAD
   X509 *x509;
+  PyObject *cache[X509_CACHE_SLOTS];
 } x509_object;
 
 typedef struct {
@@ -380,22 +420,161 @@ typedef struct {
   CMS_ContentInfo *cms;
 } cms_object;
 
+/*
+ * ROA and manifest objects keep their eContent as DER and only
+ * decode it into OpenSSL's ASN.1 structures when something needs
+ * them.  While econtent is non-NULL it is authoritative, the view
+ * points into it, and the decoded structure (if any) matches it.
+ */
+
 typedef struct {
   cms_object cms;               /* Subclass of CMS */
   ROA *roa;
+  unsigned char *econtent;
+  size_t econtent_len;
+  roa_view_t view;
 } roa_object;
 
 typedef struct {
   cms_object cms;               /* Subclass of CMS */
   Manifest *manifest;
+  unsigned char *econtent;
+  size_t econtent_len;
+  manifest_view_t view;
 } manifest_object;
 
+typedef struct {
+  char *name;
+  size_t name_len;
+  unsigned char hash[EVP_MAX_MD_SIZE];
+  size_t hash_len;
+  unsigned char *der;           /* Cached encoding of this FileAndHash */
+  size_t der_len;
+  unsigned long generation;     /* Last sync() which saw this entry */
+} manifest_builder_entry;
+
+typedef struct {
+  PyObject_HEAD
+  manifest_builder_entry *entries; /* Sorted by name */
+  size_t n_entries, max_entries;
+  unsigned char *file_list;     /* Cached encoding of whole fileList */
+  size_t file_list_len;
+  int dirty;
+  unsigned long generation;
+} manifest_builder_object;
+
 typedef struct {
   PyObject_HEAD
   X509_REQ *pkcs10;
   X509_EXTENSIONS *exts;
 } pkcs10_object;
 
+typedef enum {
+  rrdp_state_text,              /* Between tags, or inside element content */
+  rrdp_state_tag,               /* Accumulating a tag */
+  rrdp_state_comment            /* Skipping a comment */
+} rrdp_state;
+
+typedef enum {
+  rrdp_level_prolog,            /* Before root element */
+  rrdp_level_root,              /* Inside root element */
+  rrdp_level_child,             /* Inside publish or withdraw element */
+  rrdp_level_epilog             /* After root element */
+} rrdp_level;
+
+typedef enum {
+  rrdp_kind_unknown,
+  rrdp_kind_snapshot,
+  rrdp_kind_delta
+} rrdp_kind;
+
+typedef enum {
+  rrdp_element_none,
+  rrdp_element_publish,
+  rrdp_element_withdraw
+} rrdp_element;
+
+typedef struct {
+  PyObject_HEAD
+  rrdp_state state;
+  rrdp_level level;
+  rrdp_kind kind, expected_kind;
+  rrdp_element element;
+  int failed, quote, dashes;
+  char *tag;                    /* Current tag, without the angle brackets */
+  size_t tag_len, tag_size;
+  char *uri, *hash;             /* Attributes of current element */
+  unsigned char *der;           /* Decoded content of current element */
+  size_t der_len, der_size, max_object_len;
+  unsigned char b64[4];         /* Partial base64 quantum */
+  int b64_n, b64_pad, b64_done;
+  char *session_id, *expected_session_id;
+  PyObject *serial, *expected_serial;
+  char *directory;
+} rrdp_parser_object;
+
+typedef enum {
+  signing_job_generate_rsa,
+  signing_job_sign_x509,
+  signing_job_sign_crl,
+  signing_job_sign_cms
+} signing_job_type;
+
+#define SIGNING_JOB_MAX_ERRORS        8
+
+typedef struct signing_job {
+  struct signing_job *next;
+  signing_job_type type;
+  long handle;
+  PyObject *target;             /* Object being signed, if any */
+  PyObject *refs;               /* Other objects the job uses */
+  EVP_PKEY *pkey;               /* Signing key, or generated key */
+  X509 *x509;
+  X509_CRL *crl;
+  X509 *signcert;
+  const EVP_MD *digest;
+  int key_size;
+  BIO *bio;
+  STACK_OF(X509) *certs;
+  STACK_OF(X509_CRL) *crls;
+  ASN1_OBJECT *econtent_type;
+  unsigned flags;
+  CMS_ContentInfo *cms;         /* Result of CMS signing */
+  int ok, n_errors;
+  unsigned long errors[SIGNING_JOB_MAX_ERRORS];
+  char error_files[SIGNING_JOB_MAX_ERRORS][64];
+  int error_lines[SIGNING_JOB_MAX_ERRORS];
+} signing_job;
+
+typedef struct {
+  PyObject_HEAD
+  int initialized, shutdown;
+  pthread_mutex_t mutex;
+  pthread_cond_t work_cond;     /* Signalled when a job is queued */
+  pthread_cond_t done_cond;     /* Signalled when a job completes */
+  pthread_t *threads;
+  int n_threads;
+  int pipe_fds[2];              /* Wakeup pipe for event loops */
+  signing_job *queue_head, *queue_tail;
+  signing_job *done_head, *done_tail;
+  long next_handle, n_outstanding;
+} signing_pool_object;
+
+#define RSA_KEY_POOL_MAX_BACKOFF      64  /* Seconds */
+
+typedef struct {
+  PyObject_HEAD
+  int initialized, shutdown;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;          /* Signalled when a key is taken */
+  pthread_t *threads;
+  int n_threads;
+  EVP_PKEY **keys;              /* Ring buffer */
+  int size, head, count;
+  int key_size;
+  unsigned long hits, misses;
+} rsa_key_pool_object;
+
 /*
  * Container for a generic extension, including a destructor.
  */
@@ -770,6 +949,44 @@ x509_helper_iterable_to_stack(PyObject *iterable)
   return NULL;
 }
 
+static STACK_OF(X509_CRL) *
+crl_helper_iterable_to_stack(PyObject *iterable)
+{
+  STACK_OF(X509_CRL) *stack = NULL;
+  PyObject *iterator = NULL;
+  PyObject *item = NULL;
+
+  if ((stack = sk_X509_CRL_new_null()) == NULL)
+    lose_no_memory();
+
+  if (iterable != Py_None) {
+
+    if ((iterator = PyObject_GetIter(iterable)) == NULL)
+      goto error;
+
+    while ((item = PyIter_Next(iterator)) != NULL) {
+
+      if (!POW_CRL_Check(item))
+        lose_type_error("Expected a CRL object");
+
+      if (!sk_X509_CRL_push(stack, ((crl_object *) item)->crl))
+        lose("Couldn't add CRL object to stack");
+
+      Py_XDECREF(item);
+      item = NULL;
+    }
+  }
+
+  Py_XDECREF(iterator);
+  return stack;
+
+ error:
+  Py_XDECREF(iterator);
+  Py_XDECREF(item);
+  sk_X509_CRL_free(stack);
+  return NULL;
+}
+
 /*
  * Pull items off an OpenSSL STACK and put them into a Python tuple.
  * Assumes that handler is stealing the OpenSSL references to the
@@ -1197,66 +1414,6 @@ _record_validation_status(PyObject *status, const char *code)
  * status set object.
  */
 
-/*
- * Check whether a Distinguished Name conforms to the rescert profile.
- * The profile is very restrictive: it only allows one mandatory
- * CommonName field and one optional SerialNumber field, both of which
- * must be of type PrintableString.
- */
-
-static int check_allowed_dn(X509_NAME *dn)
-{
-  X509_NAME_ENTRY *ne;
-  ASN1_STRING *s;
-  int loc;
-
-  if (dn == NULL)
-    return 0;
-
-  switch (X509_NAME_entry_count(dn)) {
-
-  case 2:
-    if ((loc = X509_NAME_get_index_by_NID(dn, NID_serialNumber, -1)) < 0 ||
-	(ne = X509_NAME_get_entry(dn, loc)) == NULL ||
-	(s = X509_NAME_ENTRY_get_data(ne)) == NULL ||
-	ASN1_STRING_type(s) != V_ASN1_PRINTABLESTRING)
-      return 0;
-
-    /* Fall through */
-
-  case 1:
-    if ((loc = X509_NAME_get_index_by_NID(dn, NID_commonName, -1)) < 0 ||
-	(ne = X509_NAME_get_entry(dn, loc)) == NULL ||
-	(s = X509_NAME_ENTRY_get_data(ne)) == NULL ||
-	ASN1_STRING_type(s) != V_ASN1_PRINTABLESTRING)
-      return 0;
-
-    return 1;
-
-  default:
-    return 0;
-  }
-}
-
-/*
- * Check whether an ASN.1 TIME value conforms to RFC 5280 4.1.2.5.
- */
-
-static int check_allowed_time_encoding(ASN1_TIME *t)
-{
-  switch (t->type) {
-
-  case V_ASN1_UTCTIME:
-    return t->length == sizeof("yymmddHHMMSSZ") - 1;
-
-  case  V_ASN1_GENERALIZEDTIME:
-    return (t->length == sizeof("yyyymmddHHMMSSZ") - 1 &&
-	    strcmp("205", (char *) t->data) <= 0);
-
-  }
-  return 0;
-}
-
 /*
  * Compare filename fields of two FileAndHash structures.
  */
@@ -1276,6 +1433,7 @@ static int check_crl(X509_CRL *crl,
 {
   STACK_OF(X509_REVOKED) *revoked;
   AUTHORITY_KEYID *aki = NULL;
+  rpki_extensions_t exts;
   EVP_PKEY *pkey;
   int i, ret = 0;
 
@@ -1288,12 +1446,14 @@ static int check_crl(X509_CRL *crl,
       !check_allowed_time_encoding(X509_CRL_get_nextUpdate(crl)))
     record_validation_status(status, NONCONFORMANT_ASN1_TIME_VALUE);
 
-  if ((aki = X509_CRL_get_ext_d2i(crl, NID_authority_key_identifier, NULL, NULL)) == NULL)
+  rpki_extensions_scan(crl->crl->extensions, RPKI_EXTS_CRL, &exts);
+
+  if ((aki = rpki_extension_d2i(&exts, rpki_ext_authority_key_identifier)) == NULL)
     record_validation_status(status, AKI_EXTENSION_MISSING);
   else if (aki->keyid == NULL || aki->serial != NULL || aki->issuer != NULL)
     record_validation_status(status, AKI_EXTENSION_WRONG_FORMAT);
 
-  if (X509_CRL_get_ext_count(crl) > 2)
+  if (exts.disallowed > 0)
     record_validation_status(status, DISALLOWED_X509V3_EXTENSION);
 
   if (!check_allowed_dn(X509_CRL_get_issuer(crl)))
@@ -1314,35 +1474,6 @@ static int check_crl(X509_CRL *crl,
   return ret;
 }
 
-/*
- * Extract one datum from a CMS_SignerInfo.
- */
-
-static void *extract_si_datum(CMS_SignerInfo *si,
-			      int *n,
-			      const int optional,
-			      const int nid,
-			      const int asn1_type)
-{
-  int i = CMS_signed_get_attr_by_NID(si, nid, -1);
-  void *result = NULL;
-  X509_ATTRIBUTE *a;
-
-  if (i < 0 && optional)
-    return NULL;
-
-  if (i >= 0 &&
-      CMS_signed_get_attr_by_NID(si, nid, i) < 0 &&
-      (a = CMS_signed_get_attr(si, i)) != NULL &&
-      X509_ATTRIBUTE_count(a) == 1 &&
-      (result = X509_ATTRIBUTE_get0_data(a, 0, asn1_type, NULL)) != NULL)
-    --*n;
-  else
-    *n = -1;
-
-  return result;
-}
-
 /*
  * Check a lot of pesky low-level things about RPKI CMS objects.
  *
@@ -2320,401 +2451,752 @@ extension_set_aki(PyObject *args)
   return result;
 }
 
-
-
-/*
- * IPAddress object.
- */
+#define EXTENSION_GET_AIA__DOC__                                                \
+  "If the object has no AIA extension, or has more than one, or the\n"          \
+  "extension won't decode, this method returns None.\n"                         \
+  "\n"                                                                          \
+  "Otherwise, this returns a sequence of caIssuers URIs.\n"                     \
+  "\n"                                                                          \
+  "Any other accessMethods are ignored, as are any non-URI accessLocations.\n"
 
 static PyObject *
-ipaddress_object_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+extension_get_aia(X509_EXTENSION *ext_)
 {
-  static char *kwlist[] = {"initializer", "version", NULL};
-  ipaddress_object *self = NULL;
-  PyObject *init = NULL;
-  PyObject *pylong = NULL;
-  int version = 0;
-  const char *s = NULL;
-  int v;
-
-  ENTERING(ipaddress_object_new);
-
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|i", kwlist, &init, &version) ||
-      (self = (ipaddress_object *) type->tp_alloc(type, 0)) == NULL)
-    goto error;
+  AUTHORITY_INFO_ACCESS *ext = NULL;
+  PyObject *result = NULL;
+  const char *uri;
+  PyObject *obj;
+  int i, n = 0;
 
-  if (POW_IPAddress_Check(init)) {
-    ipaddress_object *src = (ipaddress_object *) init;
-    memcpy(self->address, src->address, sizeof(self->address));
-    self->type = src->type;
-    return (PyObject *) self;
-  }
+  ENTERING(extension_get_aia);
 
-  if ((s = PyString_AsString(init)) == NULL)
-    PyErr_Clear();
-  else if (version == 0)
-    version = strchr(s, ':') ? 6 : 4;
+  if (!ext_)
+    Py_RETURN_NONE;
 
-  self->type = NULL;
+  if ((ext = X509V3_EXT_d2i(ext_)) == NULL)
+    Py_RETURN_NONE;
 
-  for (v = 0; v < (int) (sizeof(ipaddress_versions)/sizeof(*ipaddress_versions)); v++)
-    if ((unsigned) version == ipaddress_versions[v]->version)
-      self->type = ipaddress_versions[v];
+  for (i = 0; i < sk_ACCESS_DESCRIPTION_num(ext); i++) {
+    ACCESS_DESCRIPTION *a = sk_ACCESS_DESCRIPTION_value(ext, i);
+    if (a->location->type == GEN_URI &&
+        OBJ_obj2nid(a->method) == NID_ad_ca_issuers)
+      n++;
+  }
 
-  if (self->type == NULL)
-    lose("Unknown IP version number");
+  if (((result = PyTuple_New(n)) == NULL))
+    goto error;
 
-  if (s != NULL) {
-    if (inet_pton(self->type->af, s, self->address) <= 0)
-      lose("Couldn't parse IP address");
-    return (PyObject *) self;
-  }
+  n = 0;
 
-  if ((pylong = PyNumber_Long(init)) != NULL) {
-    if (_PyLong_AsByteArray((PyLongObject *) pylong, self->address, self->type->length, 0, 0) < 0)
-      goto error;
-    Py_XDECREF(pylong);
-    return (PyObject *) self;
+  for (i = 0; i < sk_ACCESS_DESCRIPTION_num(ext); i++) {
+    ACCESS_DESCRIPTION *a = sk_ACCESS_DESCRIPTION_value(ext, i);
+    if (a->location->type == GEN_URI && OBJ_obj2nid(a->method) == NID_ad_ca_issuers) {
+      uri = (char *) ASN1_STRING_data(a->location->d.uniformResourceIdentifier);
+      if ((obj = PyString_FromString(uri)) == NULL)
+        goto error;
+      PyTuple_SET_ITEM(result, n++, obj);
+    }
   }
 
-  lose_type_error("Couldn't convert initializer to IPAddress");
+  AUTHORITY_INFO_ACCESS_free(ext);
+  return result;
 
  error:
-  Py_XDECREF(self);
-  Py_XDECREF(pylong);
+  AUTHORITY_INFO_ACCESS_free(ext);
+  Py_XDECREF(result);
   return NULL;
 }
 
+#define EXTENSION_GET_CRLDP__DOC__                                              \
+  "If the object has no CRLDP extension, or has more than one, or the\n"        \
+  "extension won't decode, this method returns None.\n"                         \
+  "\n"                                                                          \
+  "Otherwise, it returns a sequence of URIs representing distributionPoint\n"   \
+  "fullName values found in the first Distribution Point.  Other CRLDP\n"       \
+  "fields are ignored, as are subsequent Distribution Points and any non-URI\n" \
+  "fullName values.\n"
+
 static PyObject *
-ipaddress_object_str(ipaddress_object *self)
+extension_get_crldp(X509_EXTENSION *ext_)
 {
-  char addrstr[sizeof("aaaa:bbbb:cccc:dddd:eeee:ffff:255.255.255.255") + 1];
+  CRL_DIST_POINTS *ext = NULL;
+  DIST_POINT *dp = NULL;
+  PyObject *result = NULL;
+  const char *uri;
+  PyObject *obj;
+  int i, n = 0;
 
-  ENTERING(ipaddress_object_str);
+  ENTERING(extension_get_crldp);
 
-  if (!inet_ntop(self->type->af, self->address, addrstr, sizeof(addrstr)))
-    lose("Couldn't convert IP address");
+  if (!ext_)
+    Py_RETURN_NONE;
 
-  return PyString_FromString(addrstr);
+  if ((ext = X509V3_EXT_d2i(ext_)) == NULL)
+    Py_RETURN_NONE;
 
- error:
-  return NULL;
-}
+  if ((dp = sk_DIST_POINT_value(ext, 0)) == NULL ||
+      dp->distpoint == NULL ||
+      dp->distpoint->type != 0) {
+    sk_DIST_POINT_pop_free(ext, DIST_POINT_free);
+    Py_RETURN_NONE;
+  }
 
-static PyObject *
-ipaddress_object_repr(ipaddress_object *self)
-{
-  char addrstr[sizeof("aaaa:bbbb:cccc:dddd:eeee:ffff:255.255.255.255") + 1];
+  for (i = 0; i < sk_GENERAL_NAME_num(dp->distpoint->name.fullname); i++) {
+    GENERAL_NAME *gn = sk_GENERAL_NAME_value(dp->distpoint->name.fullname, i);
+    if (gn->type == GEN_URI)
+      n++;
+  }
 
-  ENTERING(ipaddress_object_repr);
+  if (((result = PyTuple_New(n)) == NULL))
+    goto error;
 
-  if (!inet_ntop(self->type->af, self->address, addrstr, sizeof(addrstr)))
-    lose("Couldn't convert IP address");
+  n = 0;
 
-  return PyString_FromFormat("<%s object %s at %p>",
-                             self->ob_type->tp_name, addrstr, self);
+  for (i = 0; i < sk_GENERAL_NAME_num(dp->distpoint->name.fullname); i++) {
+    GENERAL_NAME *gn = sk_GENERAL_NAME_value(dp->distpoint->name.fullname, i);
+    if (gn->type == GEN_URI) {
+      uri = (char *) ASN1_STRING_data(gn->d.uniformResourceIdentifier);
+      if ((obj = PyString_FromString(uri)) == NULL)
+        goto error;
+      PyTuple_SET_ITEM(result, n++, obj);
+    }
+  }
+
+  sk_DIST_POINT_pop_free(ext, DIST_POINT_free);
+  return result;
 
  error:
+  sk_DIST_POINT_pop_free(ext, DIST_POINT_free);
+  Py_XDECREF(result);
   return NULL;
 }
 
-static int
-ipaddress_object_compare(PyObject *arg1, PyObject *arg2)
-{
-  PyObject *obj1 = PyNumber_Long(arg1);
-  PyObject *obj2 = PyNumber_Long(arg2);
-  int cmp = -1;
+#define EXTENSION_GET_CERTIFICATE_POLICIES__DOC__                               \
+  "If this object has no Certificate Policies extension, or has more than\n"    \
+  "one, or the extension won't decode, this method returns None.\n"             \
+  "\n"                                                                          \
+  "Otherwise, this method returns a sequence of Object Identifiers.\n"          \
+  "\n"                                                                          \
+  "Policy qualifiers, if any, are ignored.\n"
 
-  ENTERING(ipaddress_object_compare);
+static PyObject *
+extension_get_certificate_policies(X509_EXTENSION *ext_)
+{
+  CERTIFICATEPOLICIES *ext = NULL;
+  PyObject *result = NULL;
+  PyObject *obj;
+  int i;
 
-  if (obj1 != NULL && obj2 != NULL)
-    cmp = PyObject_Compare(obj1, obj2);
+  ENTERING(extension_get_certificate_policies);
 
-  Py_XDECREF(obj1);
-  Py_XDECREF(obj2);
-  return cmp;
-}
-
-static PyObject *
-ipaddress_object_richcompare(PyObject *arg1, PyObject *arg2, int op)
-{
-  PyObject *obj1 = PyNumber_Long(arg1);
-  PyObject *obj2 = PyNumber_Long(arg2);
-  PyObject *result = NULL;
+  if (!ext_)
+    Py_RETURN_NONE;
 
-  ENTERING(ipaddress_object_richcompare);
+  if ((ext = X509V3_EXT_d2i(ext_)) == NULL)
+    Py_RETURN_NONE;
 
-  if (obj1 != NULL && obj2 != NULL)
-    result = PyObject_RichCompare(obj1, obj2, op);
+  if (((result = PyTuple_New(sk_POLICYINFO_num(ext))) == NULL))
+    goto error;
 
-  Py_XDECREF(obj1);
-  Py_XDECREF(obj2);
-  return result;
-}
+  for (i = 0; i < sk_POLICYINFO_num(ext); i++) {
+    POLICYINFO *p = sk_POLICYINFO_value(ext, i);
 
-static long
-ipaddress_object_hash(ipaddress_object *self)
-{
-  unsigned long h = 0;
-  int i;
+    if ((obj = ASN1_OBJECT_to_PyString(p->policyid)) == NULL)
+      goto error;
 
-  ENTERING(ipaddress_object_hash);
+    PyTuple_SET_ITEM(result, i, obj);
+  }
 
-  for (i = 0; (unsigned) i < self->type->length; i++)
-    h ^= self->address[i] << ((i & 3) << 3);
+  sk_POLICYINFO_pop_free(ext, POLICYINFO_free);
+  return result;
 
-  return (long) h == -1 ? 0 : (long) h;
+ error:
+  sk_POLICYINFO_pop_free(ext, POLICYINFO_free);
+  Py_XDECREF(result);
+  return NULL;
 }
 
-static char ipaddress_object_from_bytes__doc__[] =
-  "Construct an IPAddress object from a sequence of bytes.\n"
-  "\n"
-  "Argument must be a Python string of exactly 4 or 16 bytes.\n"
-  ;
+#define EXTENSION_GET_RFC3779__DOC__                                            \
+  "Return value is a three-element tuple: the first element is the ASN\n"       \
+  "resources, the second is the IPv4 resources, the third is the IPv6\n"        \
+  "resources.  Each of these elements in turn can be:\n"                        \
+  "\n"                                                                          \
+  "* None, if this object contains no resources of this kind, or if\n"          \
+  "  the extension is repeated or won't decode;\n"                              \
+  "\n"                                                                          \
+  "* the string \"inherit\", if this object inherits this kind\n"              \
+  "  of resources from its  issuer; or\n"                                       \
+  "\n"                                                                          \
+  "* a tuple representing a set of ranges of ASNs or IP addresses.\n"           \
+  "\n"                                                                          \
+  "Each range is a two-element tuple, respectively representing the low\n"     \
+  "and high ends of the range, inclusive.  ASN ranges are represented by\n"     \
+  "pairs of integers, IP address ranges are represented by pairs of\n"          \
+  "IPAddress objects.\n"
+
+/*
+ * Unlike the other extension getters, this one looks at two
+ * extensions, since that's the way RFC 3779 does it.
+ */
 
 static PyObject *
-ipaddress_object_from_bytes(PyTypeObject *type, PyObject *args)
+extension_get_rfc3779(X509_EXTENSION *asid_ext, X509_EXTENSION *addr_ext)
 {
-  ipaddress_object *result = NULL;
-  char *bytes = NULL;
-  Py_ssize_t len;
-  int v;
+  PyObject *result = NULL;
+  PyObject *asn_result = NULL;
+  PyObject *ipv4_result = NULL;
+  PyObject *ipv6_result = NULL;
+  PyObject *range = NULL;
+  PyObject *range_b = NULL;
+  PyObject *range_e = NULL;
+  ASIdentifiers *asid = NULL;
+  IPAddrBlocks *addr = NULL;
+  int i, j;
 
-  ENTERING(ipaddress_object_from_bytes);
+  ENTERING(extension_get_rfc3779);
 
-  if (!PyArg_ParseTuple(args, "s#", &bytes, &len))
-    goto error;
+  /*
+   * As with X509_get_ext_d2i(), an extension which won't decode is
+   * treated as absent.  Callers pass NULL for a repeated extension.
+   */
 
-  if ((result = (ipaddress_object *) type->tp_alloc(type, 0)) == NULL)
-    goto error;
+  if (asid_ext != NULL)
+    asid = X509V3_EXT_d2i(asid_ext);
 
-  result->type = NULL;
+  if (addr_ext != NULL)
+    addr = X509V3_EXT_d2i(addr_ext);
 
-  for (v = 0; v < (int) (sizeof(ipaddress_versions)/sizeof(*ipaddress_versions)); v++)
-    if (len == ipaddress_versions[v]->length)
-      result->type = ipaddress_versions[v];
+  if (asid != NULL && asid->asnum != NULL) {
+    switch (asid->asnum->type) {
 
-  if (result->type == NULL)
-    lose("Unknown IP version number");
+    case ASIdentifierChoice_inherit:
+      if ((asn_result = PyString_FromString("inherit")) == NULL)
+        goto error;
+      break;
 
-  memcpy(result->address, bytes, len);
-  return (PyObject *) result;
+    case ASIdentifierChoice_asIdsOrRanges:
 
- error:
-  Py_XDECREF(result);
-  return NULL;
-}
+      if ((asn_result = PyTuple_New(sk_ASIdOrRange_num(asid->asnum->u.asIdsOrRanges))) == NULL)
+        goto error;
 
-static char ipaddress_object_to_bytes__doc__[] =
-  "Return the binary value of this IPAddress as a Python string\n"
-  "of exactly 4 or 16 bytes.\n"
-  ;
+      for (i = 0; i < sk_ASIdOrRange_num(asid->asnum->u.asIdsOrRanges); i++) {
+        ASIdOrRange *aor = sk_ASIdOrRange_value(asid->asnum->u.asIdsOrRanges, i);
+        ASN1_INTEGER *b = NULL;
+        ASN1_INTEGER *e = NULL;
 
-static PyObject *
-ipaddress_object_to_bytes(ipaddress_object *self)
-{
-  ENTERING(ipaddress_object_from_bytes);
-  return PyString_FromStringAndSize((char *) self->address, self->type->length);
-}
+        switch (aor->type) {
 
-static PyObject *
-ipaddress_object_get_bits(ipaddress_object *self, GCC_UNUSED void *closure)
-{
-  ENTERING(ipaddress_object_get_bits);
-  return PyInt_FromLong(self->type->length * 8);
-}
+        case ASIdOrRange_id:
+          b = e = aor->u.id;
+          break;
 
-static PyObject *
-ipaddress_object_get_version(ipaddress_object *self, GCC_UNUSED void *closure)
-{
-  ENTERING(ipaddress_object_get_version);
-  return PyInt_FromLong(self->type->version);
-}
+        case ASIdOrRange_range:
+          b = aor->u.range->min;
+          e = aor->u.range->max;
+          break;
 
-static PyObject *
-ipaddress_object_number_binary_helper(binaryfunc function, PyObject *arg1, PyObject *arg2)
-{
-  ipaddress_object *addr = NULL;
-  ipaddress_object *addr1 = NULL;
-  ipaddress_object *addr2 = NULL;
-  ipaddress_object *result = NULL;
-  PyObject *obj1 = NULL;
-  PyObject *obj2 = NULL;
-  PyObject *obj3 = NULL;
-  PyObject *obj4 = NULL;
+        default:
+          lose_value_error("Unexpected asIdsOrRanges type");
+        }
 
-  if (POW_IPAddress_Check(arg1))
-    addr1 = (ipaddress_object *) arg1;
+        if (ASN1_STRING_type(b) == V_ASN1_NEG_INTEGER ||
+            ASN1_STRING_type(e) == V_ASN1_NEG_INTEGER)
+          lose_value_error("I don't believe in negative ASNs");
 
-  if (POW_IPAddress_Check(arg2))
-    addr2 = (ipaddress_object *) arg2;
+        if ((range_b = ASN1_INTEGER_to_PyLong(b)) == NULL ||
+            (range_e = ASN1_INTEGER_to_PyLong(e)) == NULL ||
+            (range = Py_BuildValue("(NN)", range_b, range_e)) == NULL)
+          goto error;
 
-  if ((addr1 == NULL && addr2 == NULL) ||
-      (addr1 != NULL && addr2 != NULL && addr1->type != addr2->type) ||
-      (obj1 = PyNumber_Long(arg1)) == NULL ||
-      (obj2 = PyNumber_Long(arg2)) == NULL) {
-    result = (ipaddress_object *) Py_NotImplemented;
-    Py_INCREF(result);
-    goto error;
+        PyTuple_SET_ITEM(asn_result, i, range);
+        range = range_b = range_e = NULL;
+      }
+
+      break;
+
+    default:
+      lose_value_error("Unexpected ASIdentifierChoice type");
+    }
   }
 
-  if ((obj3 = function(obj1, obj2)) == NULL)
-    goto error;
+  if (addr != NULL) {
+    for (i = 0; i < sk_IPAddressFamily_num(addr); i++) {
+      IPAddressFamily *f = sk_IPAddressFamily_value(addr, i);
+      const struct ipaddress_version *ip_type = NULL;
+      const unsigned int afi = v3_addr_get_afi(f);
+      PyObject **result_obj = NULL;
+      int addr_len = 0;
 
-  if ((obj4 = PyNumber_Long(obj3)) == NULL)
-    lose("Couldn't convert result");
+      switch (afi) {
+      case IANA_AFI_IPV4: result_obj = &ipv4_result; ip_type = &ipaddress_version_4; break;
+      case IANA_AFI_IPV6: result_obj = &ipv6_result; ip_type = &ipaddress_version_6; break;
+      default:            lose_value_error("Unknown AFI");
+      }
 
-  addr = addr1 != NULL ? addr1 : addr2;
+      if (*result_obj != NULL)
+        lose_value_error("Duplicate IPAddressFamily");
 
-  if ((result = (ipaddress_object *) addr->ob_type->tp_alloc(addr->ob_type, 0)) == NULL)
-    goto error;
+      if (f->addressFamily->length > 2)
+        lose_value_error("Unsupported SAFI");
 
-  result->type = addr->type;
+      switch (f->ipAddressChoice->type) {
 
-  if (_PyLong_AsByteArray((PyLongObject *) obj4, result->address, result->type->length, 0, 0) < 0) {
-    Py_XDECREF(result);
-    result = NULL;
-  }
+      case IPAddressChoice_inherit:
+        if ((*result_obj = PyString_FromString("inherit")) == NULL)
+          goto error;
+        continue;
 
- error:                         /* Fall through */
-  Py_XDECREF(obj1);
-  Py_XDECREF(obj2);
-  Py_XDECREF(obj3);
-  Py_XDECREF(obj4);
+      case IPAddressChoice_addressesOrRanges:
+        break;
 
-  return (PyObject *) result;
-}
+      default:
+        lose_value_error("Unexpected IPAddressChoice type");
+      }
 
-static PyObject *
-ipaddress_object_number_long(PyObject *arg)
-{
-  ipaddress_object *addr = (ipaddress_object *) arg;
+      if ((*result_obj = PyTuple_New(sk_IPAddressOrRange_num(f->ipAddressChoice->u.addressesOrRanges))) == NULL)
+        goto error;
 
-  ENTERING(ipaddress_object_number_long);
+      for (j = 0; j < sk_IPAddressOrRange_num(f->ipAddressChoice->u.addressesOrRanges); j++) {
+        IPAddressOrRange *aor = sk_IPAddressOrRange_value(f->ipAddressChoice->u.addressesOrRanges, j);
+        ipaddress_object *addr_b = NULL;
+        ipaddress_object *addr_e = NULL;
 
-  if (!POW_IPAddress_Check(arg))
-    return Py_INCREF(Py_NotImplemented), Py_NotImplemented;
+        if ((range_b = POW_IPAddress_Type.tp_alloc(&POW_IPAddress_Type, 0)) == NULL ||
+            (range_e = POW_IPAddress_Type.tp_alloc(&POW_IPAddress_Type, 0)) == NULL)
+          goto error;
 
-  return _PyLong_FromByteArray(addr->address, addr->type->length, 0, 0);
-}
+        addr_b = (ipaddress_object *) range_b;
+        addr_e = (ipaddress_object *) range_e;
 
-static PyObject *
-ipaddress_object_number_int(PyObject *arg)
-{
-  ENTERING(ipaddress_object_number_int);
-  return ipaddress_object_number_long(arg);
-}
+        if ((addr_len = v3_addr_get_range(aor, afi, addr_b->address, addr_e->address,
+                                          sizeof(addr_b->address))) == 0)
+          lose_value_error("Couldn't unpack IP addresses from BIT STRINGs");
 
-static PyObject *
-ipaddress_object_number_add(PyObject *arg1, PyObject *arg2)
-{
-  ENTERING(ipaddress_object_number_add);
-  return ipaddress_object_number_binary_helper(PyNumber_Add, arg1, arg2);
-}
+        addr_b->type = addr_e->type = ip_type;
 
-static PyObject *
-ipaddress_object_number_subtract(PyObject *arg1, PyObject *arg2)
-{
-  ENTERING(ipaddress_object_number_subtract);
-  return ipaddress_object_number_binary_helper(PyNumber_Subtract, arg1, arg2);
+        if ((range = Py_BuildValue("(NN)", range_b, range_e)) == NULL)
+          goto error;
+
+        PyTuple_SET_ITEM(*result_obj, j, range);
+        range = range_b = range_e = NULL;
+      }
+    }
+  }
+
+  result = Py_BuildValue("(OOO)",
+                         (asn_result  == NULL ? Py_None : asn_result),
+                         (ipv4_result == NULL ? Py_None : ipv4_result),
+                         (ipv6_result == NULL ? Py_None : ipv6_result));
+
+ error:                         /* Fall through */
+  ASIdentifiers_free(asid);
+  sk_IPAddressFamily_pop_free(addr, IPAddressFamily_free);
+  Py_XDECREF(range_b);
+  Py_XDECREF(range_e);
+  Py_XDECREF(range);
+  Py_XDECREF(asn_result);
+  Py_XDECREF(ipv4_result);
+  Py_XDECREF(ipv6_result);
+
+  return result;
 }
 
+
+
+
+/*
+ * IPAddress object.
+ */
+
 static PyObject *
-ipaddress_object_number_lshift(PyObject *arg1, PyObject *arg2)
+ipaddress_object_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
 {
-  ENTERING(ipaddress_object_number_lshift);
-  return ipaddress_object_number_binary_helper(PyNumber_Lshift, arg1, arg2);
+  static char *kwlist[] = {"initializer", "version", NULL};
+  ipaddress_object *self = NULL;
+  PyObject *init = NULL;
+  PyObject *pylong = NULL;
+  int version = 0;
+  const char *s = NULL;
+  int v;
+
+  ENTERING(ipaddress_object_new);
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|i", kwlist, &init, &version) ||
+      (self = (ipaddress_object *) type->tp_alloc(type, 0)) == NULL)
+    goto error;
+
+  if (POW_IPAddress_Check(init)) {
+    ipaddress_object *src = (ipaddress_object *) init;
+    memcpy(self->address, src->address, sizeof(self->address));
+    self->type = src->type;
+    return (PyObject *) self;
+  }
+
+  if ((s = PyString_AsString(init)) == NULL)
+    PyErr_Clear();
+  else if (version == 0)
+    version = strchr(s, ':') ? 6 : 4;
+
+  self->type = NULL;
+
+  for (v = 0; v < (int) (sizeof(ipaddress_versions)/sizeof(*ipaddress_versions)); v++)
+    if ((unsigned) version == ipaddress_versions[v]->version)
+      self->type = ipaddress_versions[v];
+
+  if (self->type == NULL)
+    lose("Unknown IP version number");
+
+  if (s != NULL) {
+    if (inet_pton(self->type->af, s, self->address) <= 0)
+      lose("Couldn't parse IP address");
+    return (PyObject *) self;
+  }
+
+  if ((pylong = PyNumber_Long(init)) != NULL) {
+    if (_PyLong_AsByteArray((PyLongObject *) pylong, self->address, self->type->length, 0, 0) < 0)
+      goto error;
+    Py_XDECREF(pylong);
+    return (PyObject *) self;
+  }
+
+  lose_type_error("Couldn't convert initializer to IPAddress");
+
+ error:
+  Py_XDECREF(self);
+  Py_XDECREF(pylong);
+  return NULL;
 }
 
 static PyObject *
-ipaddress_object_number_rshift(PyObject *arg1, PyObject *arg2)
+ipaddress_object_str(ipaddress_object *self)
 {
-  ENTERING(ipaddress_object_number_rshift);
-  return ipaddress_object_number_binary_helper(PyNumber_Rshift, arg1, arg2);
+  char addrstr[sizeof("aaaa:bbbb:cccc:dddd:eeee:ffff:255.255.255.255") + 1];
+
+  ENTERING(ipaddress_object_str);
+
+  if (!inet_ntop(self->type->af, self->address, addrstr, sizeof(addrstr)))
+    lose("Couldn't convert IP address");
+
+  return PyString_FromString(addrstr);
+
+ error:
+  return NULL;
 }
 
 static PyObject *
-ipaddress_object_number_and(PyObject *arg1, PyObject *arg2)
+ipaddress_object_repr(ipaddress_object *self)
 {
-  ENTERING(ipaddress_object_number_and);
-  return ipaddress_object_number_binary_helper(PyNumber_And, arg1, arg2);
+  char addrstr[sizeof("aaaa:bbbb:cccc:dddd:eeee:ffff:255.255.255.255") + 1];
+
+  ENTERING(ipaddress_object_repr);
+
+  if (!inet_ntop(self->type->af, self->address, addrstr, sizeof(addrstr)))
+    lose("Couldn't convert IP address");
+
+  return PyString_FromFormat("<%s object %s at %p>",
+                             self->ob_type->tp_name, addrstr, self);
+
+ error:
+  return NULL;
 }
 
-static PyObject *
-ipaddress_object_number_xor(PyObject *arg1, PyObject *arg2)
+static int
+ipaddress_object_compare(PyObject *arg1, PyObject *arg2)
 {
-  ENTERING(ipaddress_object_number_xor);
-  return ipaddress_object_number_binary_helper(PyNumber_Xor, arg1, arg2);
+  PyObject *obj1 = PyNumber_Long(arg1);
+  PyObject *obj2 = PyNumber_Long(arg2);
+  int cmp = -1;
+
+  ENTERING(ipaddress_object_compare);
+
+  if (obj1 != NULL && obj2 != NULL)
+    cmp = PyObject_Compare(obj1, obj2);
+
+  Py_XDECREF(obj1);
+  Py_XDECREF(obj2);
+  return cmp;
 }
 
 static PyObject *
-ipaddress_object_number_or(PyObject *arg1, PyObject *arg2)
+ipaddress_object_richcompare(PyObject *arg1, PyObject *arg2, int op)
 {
-  ENTERING(ipaddress_object_number_or);
-  return ipaddress_object_number_binary_helper(PyNumber_Or, arg1, arg2);
+  PyObject *obj1 = PyNumber_Long(arg1);
+  PyObject *obj2 = PyNumber_Long(arg2);
+  PyObject *result = NULL;
+
+  ENTERING(ipaddress_object_richcompare);
+
+  if (obj1 != NULL && obj2 != NULL)
+    result = PyObject_RichCompare(obj1, obj2, op);
+
+  Py_XDECREF(obj1);
+  Py_XDECREF(obj2);
+  return result;
 }
 
-static int
-ipaddress_object_number_nonzero(ipaddress_object *self)
+static long
+ipaddress_object_hash(ipaddress_object *self)
 {
+  unsigned long h = 0;
   int i;
 
-  ENTERING(ipaddress_object_number_nonzero);
+  ENTERING(ipaddress_object_hash);
 
   for (i = 0; (unsigned) i < self->type->length; i++)
-    if (self->address[i] != 0)
-      return 1;
-  return 0;
+    h ^= self->address[i] << ((i & 3) << 3);
+
+  return (long) h == -1 ? 0 : (long) h;
 }
 
+static char ipaddress_object_from_bytes__doc__[] =
+  "Construct an IPAddress object from a sequence of bytes.\n"
+  "\n"
+  "Argument must be a Python string of exactly 4 or 16 bytes.\n"
+  ;
+
 static PyObject *
-ipaddress_object_number_invert(ipaddress_object *self)
+ipaddress_object_from_bytes(PyTypeObject *type, PyObject *args)
 {
   ipaddress_object *result = NULL;
-  int i;
+  char *bytes = NULL;
+  Py_ssize_t len;
+  int v;
 
-  ENTERING(ipaddress_object_number_invert);
+  ENTERING(ipaddress_object_from_bytes);
 
-  if ((result = (ipaddress_object *) self->ob_type->tp_alloc(self->ob_type, 0)) == NULL)
+  if (!PyArg_ParseTuple(args, "s#", &bytes, &len))
     goto error;
 
-  result->type = self->type;
+  if ((result = (ipaddress_object *) type->tp_alloc(type, 0)) == NULL)
+    goto error;
 
-  for (i = 0; (unsigned) i < self->type->length; i++)
-    result->address[i] = ~self->address[i];
+  result->type = NULL;
 
- error:                         /* Fall through */
+  for (v = 0; v < (int) (sizeof(ipaddress_versions)/sizeof(*ipaddress_versions)); v++)
+    if (len == ipaddress_versions[v]->length)
+      result->type = ipaddress_versions[v];
+
+  if (result->type == NULL)
+    lose("Unknown IP version number");
+
+  memcpy(result->address, bytes, len);
   return (PyObject *) result;
+
+ error:
+  Py_XDECREF(result);
+  return NULL;
 }
 
-static char ipaddress_object_copy__doc__[] =
-  "Copy an IPAddress object.\n"
+static char ipaddress_object_to_bytes__doc__[] =
+  "Return the binary value of this IPAddress as a Python string\n"
+  "of exactly 4 or 16 bytes.\n"
   ;
 
 static PyObject *
-ipaddress_object_copy(ipaddress_object *self, GCC_UNUSED PyObject *args)
+ipaddress_object_to_bytes(ipaddress_object *self)
 {
-  ipaddress_object *result = NULL;
-
-  ENTERING(ipaddress_object_copy);
-
-  if ((result = (ipaddress_object *) self->ob_type->tp_alloc(self->ob_type, 0)) == NULL)
-    goto error;
+  ENTERING(ipaddress_object_from_bytes);
+  return PyString_FromStringAndSize((char *) self->address, self->type->length);
+}
 
-  memcpy(result->address, self->address, sizeof(result->address));
-  result->type = self->type;
+static PyObject *
+ipaddress_object_get_bits(ipaddress_object *self, GCC_UNUSED void *closure)
+{
+  ENTERING(ipaddress_object_get_bits);
+  return PyInt_FromLong(self->type->length * 8);
+}
 
- error:
-  return (PyObject *) result;
+static PyObject *
+ipaddress_object_get_version(ipaddress_object *self, GCC_UNUSED void *closure)
+{
+  ENTERING(ipaddress_object_get_version);
+  return PyInt_FromLong(self->type->version);
 }
 
-static struct PyMethodDef ipaddress_object_methods[] = {
-  Define_Method(__copy__,		ipaddress_object_copy,		METH_VARARGS),
-  Define_Method(__deepcopy__,		ipaddress_object_copy,		METH_VARARGS),
-  Define_Method(toBytes,                ipaddress_object_to_bytes,      METH_NOARGS),
-  Define_Class_Method(fromBytes,        ipaddress_object_from_bytes,    METH_VARARGS),
-  {NULL}
-};
+static PyObject *
+ipaddress_object_number_binary_helper(binaryfunc function, PyObject *arg1, PyObject *arg2)
+{
+  ipaddress_object *addr = NULL;
+  ipaddress_object *addr1 = NULL;
+  ipaddress_object *addr2 = NULL;
+  ipaddress_object *result = NULL;
+  PyObject *obj1 = NULL;
+  PyObject *obj2 = NULL;
+  PyObject *obj3 = NULL;
+  PyObject *obj4 = NULL;
+
+  if (POW_IPAddress_Check(arg1))
+    addr1 = (ipaddress_object *) arg1;
+
+  if (POW_IPAddress_Check(arg2))
+    addr2 = (ipaddress_object *) arg2;
+
+  if ((addr1 == NULL && addr2 == NULL) ||
+      (addr1 != NULL && addr2 != NULL && addr1->type != addr2->type) ||
+      (obj1 = PyNumber_Long(arg1)) == NULL ||
+      (obj2 = PyNumber_Long(arg2)) == NULL) {
+    result = (ipaddress_object *) Py_NotImplemented;
+    Py_INCREF(result);
+    goto error;
+  }
+
+  if ((obj3 = function(obj1, obj2)) == NULL)
+    goto error;
+
+  if ((obj4 = PyNumber_Long(obj3)) == NULL)
+    lose("Couldn't convert result");
+
+  addr = addr1 != NULL ? addr1 : addr2;
+
+  if ((result = (ipaddress_object *) addr->ob_type->tp_alloc(addr->ob_type, 0)) == NULL)
+    goto error;
+
+  result->type = addr->type;
+
+  if (_PyLong_AsByteArray((PyLongObject *) obj4, result->address, result->type->length, 0, 0) < 0) {
+    Py_XDECREF(result);
+    result = NULL;
+  }
+
+ error:                         /* Fall through */
+  Py_XDECREF(obj1);
+  Py_XDECREF(obj2);
+  Py_XDECREF(obj3);
+  Py_XDECREF(obj4);
+
+  return (PyObject *) result;
+}
+
+static PyObject *
+ipaddress_object_number_long(PyObject *arg)
+{
+  ipaddress_object *addr = (ipaddress_object *) arg;
+
+  ENTERING(ipaddress_object_number_long);
+
+  if (!POW_IPAddress_Check(arg))
+    return Py_INCREF(Py_NotImplemented), Py_NotImplemented;
+
+  return _PyLong_FromByteArray(addr->address, addr->type->length, 0, 0);
+}
+
+static PyObject *
+ipaddress_object_number_int(PyObject *arg)
+{
+  ENTERING(ipaddress_object_number_int);
+  return ipaddress_object_number_long(arg);
+}
+
+static PyObject *
+ipaddress_object_number_add(PyObject *arg1, PyObject *arg2)
+{
+  ENTERING(ipaddress_object_number_add);
+  return ipaddress_object_number_binary_helper(PyNumber_Add, arg1, arg2);
+}
+
+static PyObject *
+ipaddress_object_number_subtract(PyObject *arg1, PyObject *arg2)
+{
+  ENTERING(ipaddress_object_number_subtract);
+  return ipaddress_object_number_binary_helper(PyNumber_Subtract, arg1, arg2);
+}
+
+static PyObject *
+ipaddress_object_number_lshift(PyObject *arg1, PyObject *arg2)
+{
+  ENTERING(ipaddress_object_number_lshift);
+  return ipaddress_object_number_binary_helper(PyNumber_Lshift, arg1, arg2);
+}
+
+static PyObject *
+ipaddress_object_number_rshift(PyObject *arg1, PyObject *arg2)
+{
+  ENTERING(ipaddress_object_number_rshift);
+  return ipaddress_object_number_binary_helper(PyNumber_Rshift, arg1, arg2);
+}
+
+static PyObject *
+ipaddress_object_number_and(PyObject *arg1, PyObject *arg2)
+{
+  ENTERING(ipaddress_object_number_and);
+  return ipaddress_object_number_binary_helper(PyNumber_And, arg1, arg2);
+}
+
+static PyObject *
+ipaddress_object_number_xor(PyObject *arg1, PyObject *arg2)
+{
+  ENTERING(ipaddress_object_number_xor);
+  return ipaddress_object_number_binary_helper(PyNumber_Xor, arg1, arg2);
+}
+
+static PyObject *
+ipaddress_object_number_or(PyObject *arg1, PyObject *arg2)
+{
+  ENTERING(ipaddress_object_number_or);
+  return ipaddress_object_number_binary_helper(PyNumber_Or, arg1, arg2);
+}
+
+static int
+ipaddress_object_number_nonzero(ipaddress_object *self)
+{
+  int i;
+
+  ENTERING(ipaddress_object_number_nonzero);
+
+  for (i = 0; (unsigned) i < self->type->length; i++)
+    if (self->address[i] != 0)
+      return 1;
+  return 0;
+}
+
+static PyObject *
+ipaddress_object_number_invert(ipaddress_object *self)
+{
+  ipaddress_object *result = NULL;
+  int i;
+
+  ENTERING(ipaddress_object_number_invert);
+
+  if ((result = (ipaddress_object *) self->ob_type->tp_alloc(self->ob_type, 0)) == NULL)
+    goto error;
+
+  result->type = self->type;
+
+  for (i = 0; (unsigned) i < self->type->length; i++)
+    result->address[i] = ~self->address[i];
+
+ error:                         /* Fall through */
+  return (PyObject *) result;
+}
+
+static char ipaddress_object_copy__doc__[] =
+  "Copy an IPAddress object.\n"
+  ;
+
+static PyObject *
+ipaddress_object_copy(ipaddress_object *self, GCC_UNUSED PyObject *args)
+{
+  ipaddress_object *result = NULL;
+
+  ENTERING(ipaddress_object_copy);
+
+  if ((result = (ipaddress_object *) self->ob_type->tp_alloc(self->ob_type, 0)) == NULL)
+    goto error;
+
+  memcpy(result->address, self->address, sizeof(result->address));
+  result->type = self->type;
+
+ error:
+  return (PyObject *) result;
+}
+
+static struct PyMethodDef ipaddress_object_methods[] = {
+  Define_Method(__copy__,		ipaddress_object_copy,		METH_VARARGS),
+  Define_Method(__deepcopy__,		ipaddress_object_copy,		METH_VARARGS),
+  Define_Method(toBytes,                ipaddress_object_to_bytes,      METH_NOARGS),
+  Define_Class_Method(fromBytes,        ipaddress_object_from_bytes,    METH_VARARGS),
+  {NULL}
+};
 
 static PyGetSetDef ipaddress_object_getsetters[] = {
   {"bits", 	(getter) ipaddress_object_get_bits},
@@ -2848,10 +3330,13 @@ x509_object_new(PyTypeObject *type, GCC_UNUSED PyObject *args, GCC_UNUSED PyObje
   return NULL;
 }
 
+static void x509_object_cache_clear(x509_object *self);
+
 static void
 x509_object_dealloc(x509_object *self)
 {
   ENTERING(x509_object_dealloc);
+  x509_object_cache_clear(self);
   X509_free(self->x509);
   self->ob_type->tp_free((PyObject*) self);
 }
@@ -3000,11 +3485,151 @@ x509_object_extension_get_helper(x509_object *self, int nid)
     return NULL;
 }
 
+/*
+ * Like x509_object_extension_get_helper(), but treats a repeated
+ * extension as absent, as X509_get_ext_d2i() does.
+ */
+
+static X509_EXTENSION *
+x509_object_extension_get_unique_helper(x509_object *self, int nid)
+{
+  int i;
+
+  if (self == NULL || self->x509 == NULL ||
+      (i = X509_get_ext_by_NID(self->x509, nid, -1)) < 0 ||
+      X509_get_ext_by_NID(self->x509, nid, i) >= 0)
+    return NULL;
+  else
+    return X509_get_ext(self->x509, i);
+}
+
+/*
+ * Cache of decoded extensions.  rcynicng and friends call the
+ * extension getters over and over on the same certificate, so we
+ * decode each extension once and hand out references to the
+ * resulting (immutable) Python objects until something changes the
+ * certificate's extensions.
+ *
+ * The getters which used to call X509_get_ext_d2i() (AIA, CRLDP,
+ * policies, and RFC 3779) still return None for a repeated extension,
+ * the rest still use the first instance, so "unique" says which is
+ * which.
+ */
+
+static const struct {
+  int nid;
+  int unique;
+  PyObject *(*decode)(X509_EXTENSION *);
+} x509_cache_decoders[] = {
+  /* Indexed by x509_cache_slot, RFC 3779 is handled separately */
+  {NID_subject_key_identifier,    0, extension_get_ski},
+  {NID_authority_key_identifier,  0, extension_get_aki},
+  {NID_basic_constraints,         0, extension_get_basic_constraints},
+  {NID_sinfo_access,              0, extension_get_sia},
+  {NID_info_access,               1, extension_get_aia},
+  {NID_crl_distribution_points,   1, extension_get_crldp},
+  {NID_ext_key_usage,             0, extension_get_eku},
+  {NID_certificate_policies,      1, extension_get_certificate_policies},
+};
+
+static void
+x509_object_cache_clear(x509_object *self)
+{
+  int i;
+
+  for (i = 0; i < X509_CACHE_SLOTS; i++)
+    Py_CLEAR(self->cache[i]);
+}
+
+static PyObject *
+x509_object_cache_decode(x509_object *self, const x509_cache_slot slot)
+{
+  if (slot == x509_cache_rfc3779)
+    return extension_get_rfc3779(x509_object_extension_get_unique_helper(self, NID_sbgp_autonomousSysNum),
+                                 x509_object_extension_get_unique_helper(self, NID_sbgp_ipAddrBlock));
+  else if (x509_cache_decoders[slot].unique)
+    return x509_cache_decoders[slot].decode(x509_object_extension_get_unique_helper(self, x509_cache_decoders[slot].nid));
+  else
+    return x509_cache_decoders[slot].decode(x509_object_extension_get_helper(self, x509_cache_decoders[slot].nid));
+}
+
+static PyObject *
+x509_object_cache_get(x509_object *self, const x509_cache_slot slot)
+{
+  if (self->cache[slot] == NULL)
+    self->cache[slot] = x509_object_cache_decode(self, slot);
+
+  Py_XINCREF(self->cache[slot]);
+  return self->cache[slot];
+}
+
+/*
+ * Fill every empty cache slot with a single pass over the extension
+ * list, rather than one X509_get_ext_by_NID() scan per extension,
+ * following the same first-instance and repeated-means-absent rules as
+ * x509_object_cache_decode().
+ */
+
+static int
+x509_object_cache_fill(x509_object *self)
+{
+  X509_EXTENSION *found[x509_cache_rfc3779];
+  int repeated[x509_cache_rfc3779];
+  X509_EXTENSION *asid = NULL, *addr = NULL, *ext;
+  int asid_repeated = 0, addr_repeated = 0;
+  int i, slot, nid;
+
+  memset(found, 0, sizeof(found));
+  memset(repeated, 0, sizeof(repeated));
+
+  for (i = 0; i < X509_get_ext_count(self->x509); i++) {
+    ext = X509_get_ext(self->x509, i);
+    nid = OBJ_obj2nid(X509_EXTENSION_get_object(ext));
+
+    if (nid == NID_sbgp_autonomousSysNum) {
+      asid_repeated |= asid != NULL;
+      asid = ext;
+      continue;
+    }
+
+    if (nid == NID_sbgp_ipAddrBlock) {
+      addr_repeated |= addr != NULL;
+      addr = ext;
+      continue;
+    }
+
+    for (slot = 0; slot < x509_cache_rfc3779; slot++) {
+      if (nid == x509_cache_decoders[slot].nid) {
+        if (found[slot] == NULL)
+          found[slot] = ext;
+        else
+          repeated[slot] = 1;
+        break;
+      }
+    }
+  }
+
+  for (slot = 0; slot < x509_cache_rfc3779; slot++)
+    if (self->cache[slot] == NULL &&
+        (self->cache[slot] = x509_cache_decoders[slot].decode(x509_cache_decoders[slot].unique && repeated[slot]
+                                                               ? NULL : found[slot])) == NULL)
+      return 0;
+
+  if (self->cache[x509_cache_rfc3779] == NULL &&
+      (self->cache[x509_cache_rfc3779] = extension_get_rfc3779(asid_repeated ? NULL : asid,
+                                                               addr_repeated ? NULL : addr)) == NULL)
+    return 0;
+
+  return 1;
+}
+
 static PyObject *
 x509_object_extension_set_helper(x509_object *self, extension_wrapper ext)
 {
   int ok = 0;
 
+  x509_object_cache_clear(self);
+
   if (ext.value == NULL)
     goto error;
 
@@ -3249,7 +3874,8 @@ x509_object_check_rpki_conformance(x509_object *self, PyObject *args, PyObject *
   IPAddrBlocks *addr = NULL;
   unsigned char ski_hashbuf[EVP_MAX_MD_SIZE];
   unsigned ski_hashlen, afi;
-  int i, ok, crit, ex_count, is_ca = 0, ekunid = NID_undef, ret = 0;
+  rpki_extensions_t exts;
+  int i, ok, is_ca = 0, ekunid = NID_undef, ret = 0;
 
   if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!O", kwlist, &PySet_Type, &status, &ekuarg))
     goto error;
@@ -3299,16 +3925,15 @@ x509_object_check_rpki_conformance(x509_object *self, PyObject *args, PyObject *
    */
 
   /*
-   * Keep track of allowed extensions we've seen.  Once we've
-   * processed all the ones we expect, anything left is an error.
+   * Find all the extensions the profile allows in one pass over the
+   * extension list.  Anything else is an error.
    */
 
-  ex_count = X509_get_ext_count(self->x509);
+  rpki_extensions_scan(self->x509->cert_info->extensions, RPKI_EXTS_CERT, &exts);
 
   /* Critical */
-  if ((bc = X509_get_ext_d2i(self->x509, NID_basic_constraints, &crit, NULL)) != NULL) {
-    ex_count--;
-    if (!crit || bc->ca <= 0 || bc->pathlen != NULL)
+  if ((bc = rpki_extension_d2i(&exts, rpki_ext_basic_constraints)) != NULL) {
+    if (!(exts.critical & RPKI_EXT_BIT(basic_constraints)) || bc->ca <= 0 || bc->pathlen != NULL)
       record_validation_status(status, MALFORMED_BASIC_CONSTRAINTS);
   }
 
@@ -3321,9 +3946,8 @@ x509_object_check_rpki_conformance(x509_object *self, PyObject *args, PyObject *
    */
 
   /* Non-criticial */
-  if ((aia = X509_get_ext_d2i(self->x509, NID_info_access, &crit, NULL)) != NULL) {
-    ex_count--;
-    if (crit)
+  if ((aia = rpki_extension_d2i(&exts, rpki_ext_info_access)) != NULL) {
+    if (exts.critical & RPKI_EXT_BIT(info_access))
       record_validation_status(status, GRATUITOUSLY_CRITICAL_EXTENSION);
     ok = sk_ACCESS_DESCRIPTION_num(aia) > 0;
     for (i = 0; ok && i < sk_ACCESS_DESCRIPTION_num(aia); i++) {
@@ -3336,9 +3960,8 @@ x509_object_check_rpki_conformance(x509_object *self, PyObject *args, PyObject *
   }
 
   /* Non-criticial */
-  if ((sia = X509_get_ext_d2i(self->x509, NID_sinfo_access, &crit, NULL)) != NULL) {
-    ex_count--;
-    if (crit)
+  if ((sia = rpki_extension_d2i(&exts, rpki_ext_sinfo_access)) != NULL) {
+    if (exts.critical & RPKI_EXT_BIT(sinfo_access))
       record_validation_status(status, GRATUITOUSLY_CRITICAL_EXTENSION);
     ok = sk_ACCESS_DESCRIPTION_num(sia) > 0;
     for (i = 0; ok && i < sk_ACCESS_DESCRIPTION_num(sia); i++) {
@@ -3353,10 +3976,9 @@ x509_object_check_rpki_conformance(x509_object *self, PyObject *args, PyObject *
   }
 
   /* Non-critical */
-  if ((crldp = X509_get_ext_d2i(self->x509, NID_crl_distribution_points, &crit, NULL)) != NULL) {
+  if ((crldp = rpki_extension_d2i(&exts, rpki_ext_crl_distribution_points)) != NULL) {
     DIST_POINT *dp = sk_DIST_POINT_value(crldp, 0);
-    ex_count--;
-    if (crit)
+    if (exts.critical & RPKI_EXT_BIT(crl_distribution_points))
       record_validation_status(status, GRATUITOUSLY_CRITICAL_EXTENSION);
     ok = (sk_DIST_POINT_num(crldp) == 1 &&
           dp->reasons == NULL   && dp->CRLissuer == NULL &&
@@ -3370,10 +3992,9 @@ x509_object_check_rpki_conformance(x509_object *self, PyObject *args, PyObject *
   }
 
   /* Non-critical */
-  if ((eku = X509_get_ext_d2i(self->x509, NID_ext_key_usage, &crit, NULL)) != NULL) {
-    ex_count--;
+  if ((eku = rpki_extension_d2i(&exts, rpki_ext_ext_key_usage)) != NULL) {
     ok = 0;
-    if (!crit && !is_ca && sk_ASN1_OBJECT_num(eku) > 0 && ekunid != NID_undef)
+    if (!(exts.critical & RPKI_EXT_BIT(ext_key_usage)) && !is_ca && sk_ASN1_OBJECT_num(eku) > 0 && ekunid != NID_undef)
       for (i = 0; !ok && i < sk_ASN1_OBJECT_num(eku); i++)
         ok = OBJ_obj2nid(sk_ASN1_OBJECT_value(eku, i)) == ekunid;
     if (!ok)
@@ -3381,11 +4002,10 @@ x509_object_check_rpki_conformance(x509_object *self, PyObject *args, PyObject *
   }
 
   /* Critical */
-  if ((policies = X509_get_ext_d2i(self->x509, NID_certificate_policies, &crit, NULL)) != NULL) {
+  if ((policies = rpki_extension_d2i(&exts, rpki_ext_certificate_policies)) != NULL) {
     POLICYQUALINFO *qualifier = NULL;
     POLICYINFO *policy = NULL;
-    ex_count--;
-    if (!crit || sk_POLICYINFO_num(policies) != 1 ||
+    if (!(exts.critical & RPKI_EXT_BIT(certificate_policies)) || sk_POLICYINFO_num(policies) != 1 ||
 	(policy = sk_POLICYINFO_value(policies, 0)) == NULL ||
 	OBJ_obj2nid(policy->policyid) != NID_cp_ipAddr_asNumber ||
 	sk_POLICYQUALINFO_num(policy->qualifiers) > 1 ||
@@ -3401,16 +4021,14 @@ x509_object_check_rpki_conformance(x509_object *self, PyObject *args, PyObject *
   if ((self->x509->ex_flags & EXFLAG_KUSAGE) == 0) 
     record_validation_status(status, KEY_USAGE_MISSING);
   else {
-    ex_count--;    
-    if (!X509_EXTENSION_get_critical(X509_get_ext(self->x509, X509_get_ext_by_NID(self->x509, NID_key_usage, -1))) ||
+    if (!(exts.critical & RPKI_EXT_BIT(key_usage)) ||
         self->x509->ex_kusage != (is_ca ? KU_KEY_CERT_SIGN | KU_CRL_SIGN : KU_DIGITAL_SIGNATURE))
       record_validation_status(status, BAD_KEY_USAGE);
   }
 
   /* Critical */
-  if ((addr = X509_get_ext_d2i(self->x509, NID_sbgp_ipAddrBlock, &crit, NULL)) != NULL) {
-    ex_count--;
-    if (!crit || ekunid == NID_id_kp_bgpsec_router ||
+  if ((addr = rpki_extension_d2i(&exts, rpki_ext_sbgp_ipAddrBlock)) != NULL) {
+    if (!(exts.critical & RPKI_EXT_BIT(sbgp_ipAddrBlock)) || ekunid == NID_id_kp_bgpsec_router ||
 	!v3_addr_is_canonical(addr) || sk_IPAddressFamily_num(addr) == 0)
       record_validation_status(status, BAD_IPADDRBLOCKS);
     else
@@ -3425,9 +4043,8 @@ x509_object_check_rpki_conformance(x509_object *self, PyObject *args, PyObject *
   }
 
   /* Critical */
-  if ((asid = X509_get_ext_d2i(self->x509, NID_sbgp_autonomousSysNum, &crit, NULL)) != NULL) {
-    ex_count--;
-    if (!crit || asid->asnum == NULL || asid->rdi != NULL || !v3_asid_is_canonical(asid) ||
+  if ((asid = rpki_extension_d2i(&exts, rpki_ext_sbgp_autonomousSysNum)) != NULL) {
+    if (!(exts.critical & RPKI_EXT_BIT(sbgp_autonomousSysNum)) || asid->asnum == NULL || asid->rdi != NULL || !v3_asid_is_canonical(asid) ||
 	(ekunid == NID_id_kp_bgpsec_router && asid->asnum->type == ASIdentifierChoice_inherit))
       record_validation_status(status, BAD_ASIDENTIFIERS);
   }
@@ -3436,11 +4053,10 @@ x509_object_check_rpki_conformance(x509_object *self, PyObject *args, PyObject *
     record_validation_status(status, MISSING_RESOURCES);
 
   /* Non-critical */
-  if ((ski = X509_get_ext_d2i(self->x509, NID_subject_key_identifier, &crit, NULL)) == NULL)
+  if ((ski = rpki_extension_d2i(&exts, rpki_ext_subject_key_identifier)) == NULL)
     record_validation_status(status, SKI_EXTENSION_MISSING);
   else {
-    ex_count--;
-    if (crit)
+    if (exts.critical & RPKI_EXT_BIT(subject_key_identifier))
       record_validation_status(status, GRATUITOUSLY_CRITICAL_EXTENSION);
     if ((ski_pubkey = X509_get0_pubkey_bitstr(self->x509)) == NULL ||
         !EVP_Digest(ski_pubkey->data, ski_pubkey->length,
@@ -3452,15 +4068,14 @@ x509_object_check_rpki_conformance(x509_object *self, PyObject *args, PyObject *
   }
 
   /* Non-critical */
-  if ((aki = X509_get_ext_d2i(self->x509, NID_authority_key_identifier, &crit, NULL)) != NULL) {
-    ex_count--;
-    if (crit)
+  if ((aki = rpki_extension_d2i(&exts, rpki_ext_authority_key_identifier)) != NULL) {
+    if (exts.critical & RPKI_EXT_BIT(authority_key_identifier))
       record_validation_status(status, GRATUITOUSLY_CRITICAL_EXTENSION);
     if (aki->keyid == NULL || aki->serial != NULL || aki->issuer != NULL)
       record_validation_status(status, AKI_EXTENSION_WRONG_FORMAT);
   }
 
-  if (ex_count > 0)
+  if (exts.disallowed > 0)
     record_validation_status(status, DISALLOWED_X509V3_EXTENSION);
 
   /*
@@ -3858,6 +4473,8 @@ x509_object_clear_extensions(x509_object *self)
 
   ENTERING(x509_object_clear_extensions);
 
+  x509_object_cache_clear(self);
+
   while ((ext = X509_delete_ext(self->x509, 0)) != NULL)
     X509_EXTENSION_free(ext);
 
@@ -3871,7 +4488,7 @@ static char x509_object_get_ski__doc__[] =
 static PyObject *
 x509_object_get_ski(x509_object *self)
 {
-  return extension_get_ski(x509_object_extension_get_helper(self, NID_subject_key_identifier));
+  return x509_object_cache_get(self, x509_cache_ski);
 }
 
 static char x509_object_set_ski__doc__[] =
@@ -3891,7 +4508,7 @@ static char x509_object_get_aki__doc__[] =
 static PyObject *
 x509_object_get_aki(x509_object *self)
 {
-  return extension_get_aki(x509_object_extension_get_helper(self, NID_authority_key_identifier));
+  return x509_object_cache_get(self, x509_cache_aki);
 }
 
 static char x509_object_set_aki__doc__[] =
@@ -3933,7 +4550,7 @@ static char x509_object_get_eku__doc__[] =
 static PyObject *
 x509_object_get_eku(x509_object *self)
 {
-  return extension_get_eku(x509_object_extension_get_helper(self, NID_ext_key_usage));
+  return x509_object_cache_get(self, x509_cache_eku);
 }
 
 static char x509_object_set_eku__doc__[] =
@@ -3951,174 +4568,15 @@ x509_object_set_eku(x509_object *self, PyObject *args)
 static char x509_object_get_rfc3779__doc__[] =
   "Return this certificate's RFC 3779 resources.\n"
   "\n"
-  "Return value is a three-element tuple: the first element is the ASN\n"
-  "resources, the second is the IPv4 resources, the third is the IPv6\n"
-  "resources.  Each of these elements in turn can be:\n"
-  "\n"
-  "* None, if this certificate contains no resources of this kind;\n"
-  "\n"
-  "* the string \"inherit\", if this certificate inherits this kind\n"
-  "  of resources from its  issuer; or\n"
-  "\n"
-  "* a tuple representing a set of ranges of ASNs or IP addresses.\n"
-  "\n"
-  "Each range is a two-element tuple, respectively representing the low\n"
-  "and high ends of the range, inclusive.  ASN ranges are represented by\n"
-  "pairs of integers, IP address ranges are represented by pairs of\n"
-  "IPAddress objects.\n"
+  EXTENSION_GET_RFC3779__DOC__
   ;
 
 static PyObject *
 x509_object_get_rfc3779(x509_object *self)
 {
-  PyObject *result = NULL;
-  PyObject *asn_result = NULL;
-  PyObject *ipv4_result = NULL;
-  PyObject *ipv6_result = NULL;
-  PyObject *range = NULL;
-  PyObject *range_b = NULL;
-  PyObject *range_e = NULL;
-  ASIdentifiers *asid = NULL;
-  IPAddrBlocks *addr = NULL;
-  int i, j;
-
   ENTERING(x509_object_get_rfc3779);
-
-  if ((asid = X509_get_ext_d2i(self->x509, NID_sbgp_autonomousSysNum, NULL, NULL)) != NULL &&
-      asid->asnum != NULL) {
-    switch (asid->asnum->type) {
-
-    case ASIdentifierChoice_inherit:
-      if ((asn_result = PyString_FromString("inherit")) == NULL)
-        goto error;
-      break;
-
-    case ASIdentifierChoice_asIdsOrRanges:
-
-      if ((asn_result = PyTuple_New(sk_ASIdOrRange_num(asid->asnum->u.asIdsOrRanges))) == NULL)
-        goto error;
-
-      for (i = 0; i < sk_ASIdOrRange_num(asid->asnum->u.asIdsOrRanges); i++) {
-        ASIdOrRange *aor = sk_ASIdOrRange_value(asid->asnum->u.asIdsOrRanges, i);
-        ASN1_INTEGER *b = NULL;
-        ASN1_INTEGER *e = NULL;
-
-        switch (aor->type) {
-
-        case ASIdOrRange_id:
-          b = e = aor->u.id;
-          break;
-
-        case ASIdOrRange_range:
-          b = aor->u.range->min;
-          e = aor->u.range->max;
-          break;
-
-        default:
-          lose_value_error("Unexpected asIdsOrRanges type");
-        }
-
-        if (ASN1_STRING_type(b) == V_ASN1_NEG_INTEGER ||
-            ASN1_STRING_type(e) == V_ASN1_NEG_INTEGER)
-          lose_value_error("I don't believe in negative ASNs");
-
-        if ((range_b = ASN1_INTEGER_to_PyLong(b)) == NULL ||
-            (range_e = ASN1_INTEGER_to_PyLong(e)) == NULL ||
-            (range = Py_BuildValue("(NN)", range_b, range_e)) == NULL)
-          goto error;
-
-        PyTuple_SET_ITEM(asn_result, i, range);
-        range = range_b = range_e = NULL;
-      }
-
-      break;
-
-    default:
-      lose_value_error("Unexpected ASIdentifierChoice type");
-    }
-  }
-
-  if ((addr = X509_get_ext_d2i(self->x509, NID_sbgp_ipAddrBlock, NULL, NULL)) != NULL) {
-    for (i = 0; i < sk_IPAddressFamily_num(addr); i++) {
-      IPAddressFamily *f = sk_IPAddressFamily_value(addr, i);
-      const struct ipaddress_version *ip_type = NULL;
-      const unsigned int afi = v3_addr_get_afi(f);
-      PyObject **result_obj = NULL;
-      int addr_len = 0;
-
-      switch (afi) {
-      case IANA_AFI_IPV4: result_obj = &ipv4_result; ip_type = &ipaddress_version_4; break;
-      case IANA_AFI_IPV6: result_obj = &ipv6_result; ip_type = &ipaddress_version_6; break;
-      default:            lose_value_error("Unknown AFI");
-      }
-
-      if (*result_obj != NULL)
-        lose_value_error("Duplicate IPAddressFamily");
-
-      if (f->addressFamily->length > 2)
-        lose_value_error("Unsupported SAFI");
-
-      switch (f->ipAddressChoice->type) {
-
-      case IPAddressChoice_inherit:
-        if ((*result_obj = PyString_FromString("inherit")) == NULL)
-          goto error;
-        continue;
-
-      case IPAddressChoice_addressesOrRanges:
-        break;
-
-      default:
-        lose_value_error("Unexpected IPAddressChoice type");
-      }
-
-      if ((*result_obj = PyTuple_New(sk_IPAddressOrRange_num(f->ipAddressChoice->u.addressesOrRanges))) == NULL)
-        goto error;
-
-      for (j = 0; j < sk_IPAddressOrRange_num(f->ipAddressChoice->u.addressesOrRanges); j++) {
-        IPAddressOrRange *aor = sk_IPAddressOrRange_value(f->ipAddressChoice->u.addressesOrRanges, j);
-        ipaddress_object *addr_b = NULL;
-        ipaddress_object *addr_e = NULL;
-
-        if ((range_b = POW_IPAddress_Type.tp_alloc(&POW_IPAddress_Type, 0)) == NULL ||
-            (range_e = POW_IPAddress_Type.tp_alloc(&POW_IPAddress_Type, 0)) == NULL)
-          goto error;
-
-        addr_b = (ipaddress_object *) range_b;
-        addr_e = (ipaddress_object *) range_e;
-
-        if ((addr_len = v3_addr_get_range(aor, afi, addr_b->address, addr_e->address,
-                                          sizeof(addr_b->address))) == 0)
-          lose_value_error("Couldn't unpack IP addresses from BIT STRINGs");
-
-        addr_b->type = addr_e->type = ip_type;
-
-        if ((range = Py_BuildValue("(NN)", range_b, range_e)) == NULL)
-          goto error;
-
-        PyTuple_SET_ITEM(*result_obj, j, range);
-        range = range_b = range_e = NULL;
-      }
-    }
-  }
-
-  result = Py_BuildValue("(OOO)",
-                         (asn_result  == NULL ? Py_None : asn_result),
-                         (ipv4_result == NULL ? Py_None : ipv4_result),
-                         (ipv6_result == NULL ? Py_None : ipv6_result));
-
- error:                         /* Fall through */
-  ASIdentifiers_free(asid);
-  sk_IPAddressFamily_pop_free(addr, IPAddressFamily_free);
-  Py_XDECREF(range_b);
-  Py_XDECREF(range_e);
-  Py_XDECREF(range);
-  Py_XDECREF(asn_result);
-  Py_XDECREF(ipv4_result);
-  Py_XDECREF(ipv6_result);
-
-  return result;
-}
+  return x509_object_cache_get(self, x509_cache_rfc3779);
+}
 
 static char x509_object_set_rfc3779__doc__[] =
   "Set this certificate's RFC 3779 resources.\n"
@@ -4156,6 +4614,8 @@ x509_object_set_rfc3779(x509_object *self, PyObject *args, PyObject *kwds)
 
   ENTERING(x509_object_set_rfc3779);
 
+  x509_object_cache_clear(self);
+
   if (!PyArg_ParseTupleAndKeywords(args, kwds, "|OOO", kwlist, &asn_arg, &ipv4_arg, &ipv6_arg))
     goto error;
 
@@ -4323,7 +4783,7 @@ static char x509_object_get_basic_constraints__doc__[] =
 static PyObject *
 x509_object_get_basic_constraints(x509_object *self)
 {
-  return extension_get_basic_constraints(x509_object_extension_get_helper(self, NID_basic_constraints));
+  return x509_object_cache_get(self, x509_cache_basic_constraints);
 }
 
 static char x509_object_set_basic_constraints__doc__[] =
@@ -4347,7 +4807,7 @@ static char x509_object_get_sia__doc__[] =
 static PyObject *
 x509_object_get_sia(x509_object *self)
 {
-  return extension_get_sia(x509_object_extension_get_helper(self, NID_sinfo_access));
+  return x509_object_cache_get(self, x509_cache_sia);
 }
 
 static char x509_object_set_sia__doc__[] =
@@ -4365,56 +4825,14 @@ x509_object_set_sia(x509_object *self, PyObject *args, PyObject *kwds)
 static char x509_object_get_aia__doc__[] =
   "Get this certificate's AIA values.\n"
   "\n"
-  "If the certificate has no AIA extension, this method returns None.\n"
-  "\n"  
-  "Otherwise, this returns a sequence of caIssuers URIs.\n"
-  "\n"
-  "Any other accessMethods are ignored, as are any non-URI accessLocations.\n"
+  EXTENSION_GET_AIA__DOC__
   ;
 
 static PyObject *
 x509_object_get_aia(x509_object *self)
 {
-  AUTHORITY_INFO_ACCESS *ext = NULL;
-  PyObject *result = NULL;
-  const char *uri;
-  PyObject *obj;
-  int i, n = 0;
-
   ENTERING(x509_object_get_aia);
-
-  if ((ext = X509_get_ext_d2i(self->x509, NID_info_access, NULL, NULL)) == NULL)
-    Py_RETURN_NONE;
-
-  for (i = 0; i < sk_ACCESS_DESCRIPTION_num(ext); i++) {
-    ACCESS_DESCRIPTION *a = sk_ACCESS_DESCRIPTION_value(ext, i);
-    if (a->location->type == GEN_URI &&
-        OBJ_obj2nid(a->method) == NID_ad_ca_issuers)
-      n++;
-  }
-
-  if (((result = PyTuple_New(n)) == NULL))
-    goto error;
-
-  n = 0;
-
-  for (i = 0; i < sk_ACCESS_DESCRIPTION_num(ext); i++) {
-    ACCESS_DESCRIPTION *a = sk_ACCESS_DESCRIPTION_value(ext, i);
-    if (a->location->type == GEN_URI && OBJ_obj2nid(a->method) == NID_ad_ca_issuers) {
-      uri = (char *) ASN1_STRING_data(a->location->d.uniformResourceIdentifier);
-      if ((obj = PyString_FromString(uri)) == NULL)
-        goto error;
-      PyTuple_SET_ITEM(result, n++, obj);
-    }
-  }
-
-  AUTHORITY_INFO_ACCESS_free(ext);
-  return result;
-
- error:
-  AUTHORITY_INFO_ACCESS_free(ext);
-  Py_XDECREF(result);
-  return NULL;
+  return x509_object_cache_get(self, x509_cache_aia);
 }
 
 static char x509_object_set_aia__doc__[] =
@@ -4438,6 +4856,8 @@ x509_object_set_aia(x509_object *self, PyObject *args)
 
   ENTERING(x509_object_set_aia);
 
+  x509_object_cache_clear(self);
+
   if (!PyArg_ParseTuple(args, "O", &caIssuers))
     goto error;
 
@@ -4494,60 +4914,14 @@ x509_object_set_aia(x509_object *self, PyObject *args)
 static char x509_object_get_crldp__doc__[] =
   "Get CRL Distribution Point (CRLDP) values for this certificate.\n"
   "\n"
-  "If the certificate has no CRLDP extension, this method returns None.\n"
-  "\n"
-  "Otherwise, it returns a sequence of URIs representing distributionPoint\n"
-  "fullName values found in the first Distribution Point.  Other CRLDP\n"
-  "fields are ignored, as are subsequent Distribution Points and any non-URI\n"
-  "fullName values.\n"
+  EXTENSION_GET_CRLDP__DOC__
   ;
 
 static PyObject *
 x509_object_get_crldp(x509_object *self)
 {
-  CRL_DIST_POINTS *ext = NULL;
-  DIST_POINT *dp = NULL;
-  PyObject *result = NULL;
-  const char *uri;
-  PyObject *obj;
-  int i, n = 0;
-
   ENTERING(x509_object_get_crldp);
-
-  if ((ext = X509_get_ext_d2i(self->x509, NID_crl_distribution_points, NULL, NULL)) == NULL ||
-      (dp = sk_DIST_POINT_value(ext, 0)) == NULL ||
-      dp->distpoint == NULL ||
-      dp->distpoint->type != 0)
-    Py_RETURN_NONE;
-
-  for (i = 0; i < sk_GENERAL_NAME_num(dp->distpoint->name.fullname); i++) {
-    GENERAL_NAME *gn = sk_GENERAL_NAME_value(dp->distpoint->name.fullname, i);
-    if (gn->type == GEN_URI)
-      n++;
-  }
-
-  if (((result = PyTuple_New(n)) == NULL))
-    goto error;
-
-  n = 0;
-
-  for (i = 0; i < sk_GENERAL_NAME_num(dp->distpoint->name.fullname); i++) {
-    GENERAL_NAME *gn = sk_GENERAL_NAME_value(dp->distpoint->name.fullname, i);
-    if (gn->type == GEN_URI) {
-      uri = (char *) ASN1_STRING_data(gn->d.uniformResourceIdentifier);
-      if ((obj = PyString_FromString(uri)) == NULL)
-        goto error;
-      PyTuple_SET_ITEM(result, n++, obj);
-    }
-  }
-
-  sk_DIST_POINT_pop_free(ext, DIST_POINT_free);
-  return result;
-
- error:
-  sk_DIST_POINT_pop_free(ext, DIST_POINT_free);
-  Py_XDECREF(result);
-  return NULL;
+  return x509_object_cache_get(self, x509_cache_crldp);
 }
 
 static char x509_object_set_crldp__doc__[] =
@@ -4571,6 +4945,8 @@ x509_object_set_crldp(x509_object *self, PyObject *args)
 
   ENTERING(x509_object_set_crldp);
 
+  x509_object_cache_clear(self);
+
   if (!PyArg_ParseTuple(args, "O", &fullNames))
     goto error;
 
@@ -4634,46 +5010,14 @@ x509_object_set_crldp(x509_object *self, PyObject *args)
 static char x509_object_get_certificate_policies__doc__[] =
   "Get Certificate Policies values for this certificate.\n"
   "\n"
-  "If this certificate has no Certificate Policies extension, this method\n"
-  "returns None.\n"
-  "\n"
-  "Otherwise, this method returns a sequence of Object Identifiers.\n"
-  "\n"
-  "Policy qualifiers, if any, are ignored.\n"
+  EXTENSION_GET_CERTIFICATE_POLICIES__DOC__
   ;
 
 static PyObject *
 x509_object_get_certificate_policies(x509_object *self)
 {
-  CERTIFICATEPOLICIES *ext = NULL;
-  PyObject *result = NULL;
-  PyObject *obj;
-  int i;
-
   ENTERING(x509_object_get_certificate_policies);
-
-  if ((ext = X509_get_ext_d2i(self->x509, NID_certificate_policies, NULL, NULL)) == NULL)
-    Py_RETURN_NONE;
-
-  if (((result = PyTuple_New(sk_POLICYINFO_num(ext))) == NULL))
-    goto error;
-
-  for (i = 0; i < sk_POLICYINFO_num(ext); i++) {
-    POLICYINFO *p = sk_POLICYINFO_value(ext, i);
-
-    if ((obj = ASN1_OBJECT_to_PyString(p->policyid)) == NULL)
-      goto error;
-
-    PyTuple_SET_ITEM(result, i, obj);
-  }
-
-  sk_POLICYINFO_pop_free(ext, POLICYINFO_free);
-  return result;
-
- error:
-  sk_POLICYINFO_pop_free(ext, POLICYINFO_free);
-  Py_XDECREF(result);
-  return NULL;
+  return x509_object_cache_get(self, x509_cache_certificate_policies);
 }
 
 static char x509_object_set_certificate_policies__doc__[] =
@@ -4700,6 +5044,8 @@ x509_object_set_certificate_policies(x509_object *self, PyObject *args)
 
   ENTERING(x509_object_set_certificate_policies);
 
+  x509_object_cache_clear(self);
+
   if (!PyArg_ParseTuple(args, "O", &policies))
     goto error;
 
@@ -4748,19 +5094,53 @@ x509_object_set_certificate_policies(x509_object *self, PyObject *args)
     return NULL;
 }
 
-static char x509_object_pprint__doc__[] =
-  "Return a pretty-printed rendition of this certificate.\n"
+static char x509_object_get_rpki_info__doc__[] =
+  "Return all the extension values the RPKI validator cares about, in one\n"
+  "pass over the certificate's extensions.\n"
+  "\n"
+  "Return value is a tuple: (SKI, AKI, BasicConstraints, SIA, AIA, CRLDP,\n"
+  "EKU, CertificatePolicies, RFC3779).  Each element has the same value the\n"
+  "corresponding single-extension getter method would have returned.\n"
+  "\n"
+  "Decoded values are cached, so calling this (or any of the individual\n"
+  "getter methods) repeatedly on the same certificate is cheap.\n"
   ;
 
 static PyObject *
-x509_object_pprint(x509_object *self)
+x509_object_get_rpki_info(x509_object *self)
 {
   PyObject *result = NULL;
-  BIO *bio = NULL;
+  int i;
 
-  ENTERING(x509_object_pprint);
+  ENTERING(x509_object_get_rpki_info);
 
-  if ((bio = BIO_new(BIO_s_mem())) == NULL)
+  if (!x509_object_cache_fill(self))
+    return NULL;
+
+  if ((result = PyTuple_New(X509_CACHE_SLOTS)) == NULL)
+    return NULL;
+
+  for (i = 0; i < X509_CACHE_SLOTS; i++) {
+    Py_INCREF(self->cache[i]);
+    PyTuple_SET_ITEM(result, i, self->cache[i]);
+  }
+
+  return result;
+}
+
+static char x509_object_pprint__doc__[] =
+  "Return a pretty-printed rendition of this certificate.\n"
+  ;
+
+static PyObject *
+x509_object_pprint(x509_object *self)
+{
+  PyObject *result = NULL;
+  BIO *bio = NULL;
+
+  ENTERING(x509_object_pprint);
+
+  if ((bio = BIO_new(BIO_s_mem())) == NULL)
     lose_no_memory();
 
   if (!X509_print(bio, self->x509))
@@ -4815,6 +5195,7 @@ static struct PyMethodDef x509_object_methods[] = {
   Define_Method(setCRLDP,               x509_object_set_crldp,                  METH_VARARGS),
   Define_Method(getCertificatePolicies, x509_object_get_certificate_policies,   METH_NOARGS),
   Define_Method(setCertificatePolicies, x509_object_set_certificate_policies,   METH_VARARGS),
+  Define_Method(getRPKIInfo,            x509_object_get_rpki_info,              METH_NOARGS),
   Define_Method(getIssuerHash,          x509_object_get_issuer_hash,            METH_NOARGS),
   Define_Method(getSubjectHash,         x509_object_get_subject_hash,           METH_NOARGS),
   Define_Class_Method(pemRead,          x509_object_pem_read,                   METH_VARARGS),
@@ -4904,3792 +5285,6806 @@ x509_store_ctx_object_new(PyTypeObject *type, GCC_UNUSED PyObject *args, GCC_UNU
 
   ENTERING(x509_store_ctx_object_new);
 
-  if ((self = (x509_store_ctx_object *) type->tp_alloc(type, 0)) == NULL)
-    goto error;
+  if ((self = (x509_store_ctx_object *) type->tp_alloc(type, 0)) == NULL)
+    goto error;
+
+  self->ctx = NULL;
+  self->store = NULL;
+  return (PyObject *) self;    
+
+ error:
+  Py_XDECREF(self);
+  return NULL;
+}
+
+static int
+x509_store_ctx_object_init(x509_store_ctx_object *self, PyObject *args, GCC_UNUSED PyObject *kwds)
+{
+  ENTERING(x509_store_ctx_object_init);
+
+  if ((self->store = X509_STORE_new()) == NULL ||
+      (self->ctx = X509_STORE_CTX_new()) == NULL)
+    lose_no_memory();
+
+  if (!X509_STORE_CTX_init(self->ctx, self->store, NULL, NULL))
+    lose_openssl_error("Couldn't initialize X509_STORE_CTX");
+
+  if (!X509_STORE_CTX_set_ex_data(self->ctx, x509_store_ctx_ex_data_idx, self))
+    lose_openssl_error("Couldn't set X509_STORE_CTX ex_data");
+
+  X509_VERIFY_PARAM_set_flags(self->ctx->param, X509_V_FLAG_X509_STRICT);
+  return 0;
+
+ error:
+  return -1;
+}
+
+static void
+x509_store_ctx_object_dealloc(x509_store_ctx_object *self)
+{
+  ENTERING(x509_store_ctx_object_dealloc);
+  X509_STORE_CTX_free(self->ctx);
+  X509_STORE_free(self->store);
+  self->ob_type->tp_free((PyObject*) self);
+}
+
+static char x509_store_ctx_object_get_error__doc__[] =
+  "Extract verification error code from this X509StoreCTX.\n"
+  ;
+
+static PyObject*
+x509_store_ctx_object_get_error (x509_store_ctx_object *self)
+{
+  return Py_BuildValue("i", X509_STORE_CTX_get_error(self->ctx));
+}
+
+static char x509_store_ctx_object_get_error_string__doc__[] =
+  "Extract verification error string from this X509StoreCTX.\n"
+  ;
+
+static PyObject*
+x509_store_ctx_object_get_error_string (x509_store_ctx_object *self)
+{
+  return Py_BuildValue("s", X509_verify_cert_error_string(X509_STORE_CTX_get_error(self->ctx)));
+}
+
+static char x509_store_ctx_object_get_error_depth__doc__[] =
+  "Extract verification error depth from this X509StoreCTX.\n"
+  ;
+
+static PyObject*
+x509_store_ctx_object_get_error_depth (x509_store_ctx_object *self)
+{
+  return Py_BuildValue("i", X509_STORE_CTX_get_error_depth(self->ctx));
+}
+
+static char x509_store_ctx_object_get_current_certificate__doc__[] =
+  "Extract the certificate which caused the current validation error,\n"
+  "or None if no certificate is relevant.\n"
+  ;
+
+static PyObject *
+x509_store_ctx_object_get_current_certificate (x509_store_ctx_object *self)
+{
+  X509 *x = X509_STORE_CTX_get_current_cert(self->ctx);
+  x509_object *obj = NULL;
+
+  if (x == NULL)
+    Py_RETURN_NONE;
+
+  if ((x = X509_dup(x)) == NULL)
+    lose_no_memory();
+
+  if ((obj = x509_object_new_helper(NULL, x)) == NULL)
+    goto error;
+
+  return (PyObject *) obj;
+
+ error:
+  Py_XDECREF(obj);
+  X509_free(x);
+  return NULL;
+}
+
+static char x509_store_ctx_object_get_chain__doc__[] =
+  "Extract certificate chain from X509StoreCTX.  If validation\n"
+  "completed succesfully, this is the complete validation chain;\n"
+  "otherwise, the returned chain may be invalid or incomplete.\n"
+  ;
+
+static PyObject *
+x509_store_ctx_object_get_chain (x509_store_ctx_object *self)
+{
+  STACK_OF(X509) *chain = NULL;
+  PyObject *result = NULL;
+
+  if ((chain = X509_STORE_CTX_get1_chain(self->ctx)) == NULL)
+    lose_openssl_error("X509_STORE_CTX_get1_chain() failed");
+  
+  result = stack_to_tuple_helper(CHECKED_PTR_OF(STACK_OF(X509), chain),
+                                 stack_to_tuple_helper_get_x509);
+
+ error:                         /* fall through */
+  sk_X509_pop_free(chain, X509_free);
+  return result;
+}
+
+/*
+ * See (omnibus) man page for X509_STORE_CTX_get_error() for other
+ * query methods we might want to expose.  Someday we might want to
+ * support X509_V_FLAG_USE_CHECK_TIME too.
+ */
+
+static struct PyMethodDef x509_store_ctx_object_methods[] = {
+  Define_Method(getError,               x509_store_ctx_object_get_error,                METH_NOARGS),
+  Define_Method(getErrorString,         x509_store_ctx_object_get_error_string,         METH_NOARGS),
+  Define_Method(getErrorDepth,          x509_store_ctx_object_get_error_depth,          METH_NOARGS),
+  Define_Method(getCurrentCertificate,  x509_store_ctx_object_get_current_certificate,  METH_NOARGS),
+  Define_Method(getChain,               x509_store_ctx_object_get_chain,                METH_NOARGS),
+ {NULL}
+};
+
+static char POW_X509StoreCTX_Type__doc__[] =
+  "This class holds the state of an OpenSSL certificate verification\n"
+  "operation.  Ordinarily, the user will never have cause to instantiate\n"
+  "this class directly, instead, an object of this class will be returned\n"
+  "by X509.verify().\n"
+  "\n"
+  "If you need to see OpenSSL's verification callbacks, you can do so\n"
+  "by subclassing X509StoreCTX and passing your subclass as an argument\n"
+  "to X509.verify.  Your subclass should provide a .verify_callback()\n"
+  "method, which should expect to receive one argument: the integer \"ok\"\n"
+  "value passed by OpenSSL's verification callbacks.\n"
+  "\n"
+  "The return value from your .verify_callback() method will be is interpreted\n"
+  "as a boolean value: anything which evaluates to True will be result in a\n"
+  "return value of 1 to OpenSSL, while anything which evaluates to False will\n"
+  "result in a return value of 0 to OpenSSL.\n"
+  ;
+
+static PyTypeObject POW_X509StoreCTX_Type = {
+  PyObject_HEAD_INIT(0)
+  0,                                        /* ob_size */
+  "rpki.POW.X509StoreCTX",                  /* tp_name */
+  sizeof(x509_store_ctx_object),            /* tp_basicsize */
+  0,                                        /* tp_itemsize */
+  (destructor)x509_store_ctx_object_dealloc,/* tp_dealloc */
+  0,                                        /* tp_print */
+  0,                                        /* tp_getattr */
+  0,                                        /* tp_setattr */
+  0,                                        /* tp_compare */
+  0,                                        /* tp_repr */
+  0,                                        /* tp_as_number */
+  0,                                        /* tp_as_sequence */
+  0,                                        /* tp_as_mapping */
+  0,                                        /* tp_hash */
+  0,                                        /* tp_call */
+  0,                                        /* tp_str */
+  0,                                        /* tp_getattro */
+  0,                                        /* tp_setattro */
+  0,                                        /* tp_as_buffer */
+  Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, /* tp_flags */
+  POW_X509StoreCTX_Type__doc__,             /* tp_doc */
+  0,                                        /* tp_traverse */
+  0,                                        /* tp_clear */
+  0,                                        /* tp_richcompare */
+  0,                                        /* tp_weaklistoffset */
+  0,                                        /* tp_iter */
+  0,                                        /* tp_iternext */
+  x509_store_ctx_object_methods,            /* tp_methods */
+  0,                                        /* tp_members */
+  0,                                        /* tp_getset */
+  0,                                        /* tp_base */
+  0,                                        /* tp_dict */
+  0,                                        /* tp_descr_get */
+  0,                                        /* tp_descr_set */
+  0,                                        /* tp_dictoffset */
+  (initproc) x509_store_ctx_object_init,    /* tp_init */
+  0,                                        /* tp_alloc */
+  x509_store_ctx_object_new,                /* tp_new */
+};
+
+
+
+/*
+ * CRL object.
+ */
+
+static crl_object *
+crl_object_new_helper(PyTypeObject *type, X509_CRL *crl)
+{
+  crl_object *self = NULL;
+
+  if (type == NULL)
+    type = &POW_CRL_Type;
+
+  if ((self = (crl_object *) type->tp_alloc(type, 0)) == NULL)
+    return NULL;
+
+  self->crl = crl;
+  return self;
+}
+
+static PyObject *
+crl_object_new(PyTypeObject *type, GCC_UNUSED PyObject *args, GCC_UNUSED PyObject *kwds)
+{
+  crl_object *self = NULL;
+  X509_CRL *crl = NULL;
+
+  ENTERING(crl_object_new);
+
+  if ((crl = X509_CRL_new()) == NULL)
+    lose_no_memory();
+
+  if ((self = crl_object_new_helper(type, crl)) == NULL)
+    goto error;
+
+  return (PyObject *) self;
+
+ error:
+  X509_CRL_free(crl);
+  return NULL;
+}
+
+static void
+crl_object_dealloc(crl_object *self)
+{
+  ENTERING(crl_object_dealloc);
+  X509_CRL_free(self->crl);
+  self->ob_type->tp_free((PyObject*) self);
+}
+
+static PyObject *
+crl_object_pem_read_helper(PyTypeObject *type, BIO *bio)
+{
+  crl_object *self;
+
+  ENTERING(crl_object_pem_read_helper);
+
+  if ((self = (crl_object *) crl_object_new(type, NULL, NULL)) == NULL)
+    goto error;
+
+  if (!PEM_read_bio_X509_CRL(bio, &self->crl, NULL, NULL))
+    lose_openssl_error("Couldn't PEM encoded load CRL");
+
+  return (PyObject *) self;
+
+ error:
+  Py_XDECREF(self);
+  return NULL;
+}
+
+static PyObject *
+crl_object_der_read_helper(PyTypeObject *type, BIO *bio)
+{
+  crl_object *self;
+
+  ENTERING(crl_object_der_read_helper);
+
+  if ((self = (crl_object *) crl_object_new(type, NULL, NULL)) == NULL)
+    goto error;
+
+  if (!d2i_X509_CRL_bio(bio, &self->crl))
+    lose_openssl_error("Couldn't load DER encoded CRL");
+
+  return (PyObject *) self;
+
+ error:
+  Py_XDECREF(self);
+  return NULL;
+}
+
+static char crl_object_pem_read__doc__[] =
+  "Read a PEM-encoded CRL object from a string.\n"
+  ;
+
+static PyObject *
+crl_object_pem_read(PyTypeObject *type, PyObject *args)
+{
+  ENTERING(crl_object_pem_read);
+  return read_from_string_helper(crl_object_pem_read_helper, type, args);
+}
+
+static char crl_object_pem_read_file__doc__[] =
+  "Read a PEM-encoded CRL object from a file.\n"
+  ;
+
+static PyObject *
+crl_object_pem_read_file(PyTypeObject *type, PyObject *args)
+{
+  ENTERING(crl_object_pem_read_file);
+  return read_from_file_helper(crl_object_pem_read_helper, type, args);
+}
+
+static char crl_object_der_read__doc__[] =
+  "Read a DER-encoded CRL object from a string.\n"
+  ;
+
+static PyObject *
+crl_object_der_read(PyTypeObject *type, PyObject *args)
+{
+  ENTERING(crl_object_der_read);
+  return read_from_string_helper(crl_object_der_read_helper, type, args);
+}
+
+static char crl_object_der_read_file__doc__[] =
+  "Read a DER-encoded CRL object from a file.\n"
+  ;
+
+static PyObject *
+crl_object_der_read_file(PyTypeObject *type, PyObject *args)
+{
+  ENTERING(crl_object_der_read_file);
+  return read_from_file_helper(crl_object_der_read_helper, type, args);
+}
+
+static X509_EXTENSION *
+crl_object_extension_get_helper(crl_object *self, int nid)
+{
+  if (self != NULL && self->crl != NULL)
+    return X509_CRL_get_ext(self->crl, X509_CRL_get_ext_by_NID(self->crl, nid, -1));
+  else
+    return NULL;
+}
+
+static PyObject *
+crl_object_extension_set_helper(crl_object *self, extension_wrapper ext)
+{
+  int ok = 0;
+
+  if (ext.value == NULL)
+    goto error;
+
+  if (!X509_CRL_add1_ext_i2d(self->crl, ext.nid, ext.value, ext.critical, X509V3_ADD_REPLACE))
+    lose_openssl_error("Couldn't add extension to CRL");
+
+  ok = 1;
+
+ error:
+  ext.destructor(ext.value);
+  if (ok)
+    Py_RETURN_NONE;
+  else
+    return NULL;
+}
+
+
+
+static char crl_object_get_version__doc__[] =
+  "Return the version number of this CRL.\n"
+  ;
+
+static PyObject *
+crl_object_get_version(crl_object *self)
+{
+  ENTERING(crl_object_get_version);
+  return Py_BuildValue("l", X509_CRL_get_version(self->crl));
+}
+
+static char crl_object_set_version__doc__[] =
+  "Set the version number of this CRL.\n"
+  "\n"
+  "The \"version\" parameter should be a positive integer.\n"
+  ;
+
+static PyObject *
+crl_object_set_version(crl_object *self, PyObject *args)
+{
+  long version = 0;
+
+  ENTERING(crl_object_set_version);
+
+  if (!PyArg_ParseTuple(args, "i", &version))
+    goto error;
+
+  if (!X509_CRL_set_version(self->crl, version))
+    lose_no_memory();
+
+  Py_RETURN_NONE;
+
+ error:
+  return NULL;
+}
+
+static char crl_object_get_issuer__doc__[] =
+  "Return issuer name of this CRL.\n"
+  "\n"
+  "See the \"getIssuer()\" method of the X509 class for more details.\n"
+  ;
+
+static PyObject *
+crl_object_get_issuer(crl_object *self, PyObject *args)
+{
+  PyObject *result = NULL;
+  int format = OIDNAME_FORMAT;
+
+  ENTERING(crl_object_get_issuer);
+
+  if (!PyArg_ParseTuple(args, "|i", &format))
+    goto error;
+
+  result = x509_object_helper_get_name(X509_CRL_get_issuer(self->crl), format);
+
+ error:                         /* Fall through */
+  return result;
+}
+
+static char crl_object_set_issuer__doc__[] =
+  "Set this CRL's issuer name.\n"
+  "\n"
+  "See the \"setIssuer()\" method of the X509 class for details.\n"
+  ;
+
+static PyObject *
+crl_object_set_issuer(crl_object *self, PyObject *args)
+{
+  PyObject *name_sequence = NULL;
+  X509_NAME *name = NULL;
+
+  ENTERING(crl_object_set_issuer);
+
+  if (!PyArg_ParseTuple(args, "O", &name_sequence))
+    goto error;
+
+  if (!PySequence_Check(name_sequence))
+    lose_type_error("Expected a sequence object");
+
+  if ((name = x509_object_helper_set_name(name_sequence)) == NULL)
+    goto error;
+
+  if (!X509_CRL_set_issuer_name(self->crl, name))
+    lose_openssl_error("Unable to set issuer name");
+
+  X509_NAME_free(name);
+
+  Py_RETURN_NONE;
+
+ error:
+  X509_NAME_free(name);
+  return NULL;
+}
+
+static char crl_object_get_issuer_hash__doc__[] =
+  "Return the OpenSSL \"name hash\" for this CRL's issuer name.\n"
+  ;
+
+static PyObject *
+crl_object_get_issuer_hash(crl_object *self)
+{
+  ENTERING(crl_object_get_issuer_hash);
+  return Py_BuildValue("k", X509_NAME_hash(X509_CRL_get_issuer(self->crl)));
+}
+
+/*
+ * NB: OpenSSL is confused about the name of this field, probably for
+ * backwards compatability with some ancient mistake.  What RFC 5280
+ * calls "thisUpdate", OpenSSL calls "lastUpdate".
+ */
+
+static char crl_object_set_this_update__doc__[] =
+  "Set this CRL's \"thisUpdate\" value.\n"
+  "\n"
+  "The \"time\" parameter should be a datetime object.\n"
+  ;
+
+static PyObject *
+crl_object_set_this_update (crl_object *self, PyObject *args)
+{
+  PyObject *o = NULL;
+  ASN1_TIME *t = NULL;
+
+  ENTERING(crl_object_set_this_update);
+
+  if (!PyArg_ParseTuple(args, "O", &o))
+    goto error;
+
+  if ((t = Python_to_ASN1_TIME(o, 1)) == NULL)
+    lose("Couldn't convert thisUpdate string");
+
+  if (!X509_CRL_set_lastUpdate(self->crl, t)) /* sic */
+    lose("Couldn't set thisUpdate");
+
+  ASN1_TIME_free(t);
+  Py_RETURN_NONE;
+
+ error:
+  ASN1_TIME_free(t);
+  return NULL;
+}
+
+static char crl_object_get_this_update__doc__[] =
+  "Return this CRL's \"thisUpdate\" value as a datetime.\n"
+  ;
+
+static PyObject *
+crl_object_get_this_update (crl_object *self)
+{
+  ENTERING(crl_object_get_this_update);
+  return ASN1_TIME_to_Python(X509_CRL_get_lastUpdate(self->crl)); /* sic */
+}
+
+static char crl_object_set_next_update__doc__[] =
+  "Set this CRL's \"nextUpdate\" value.\n"
+  "\n"
+  "The \"time\" parameter should be a datetime object.\n"
+  ;
+
+static PyObject *
+crl_object_set_next_update (crl_object *self, PyObject *args)
+{
+  PyObject *o = NULL;
+  ASN1_TIME *t = NULL;
+
+  ENTERING(crl_object_set_next_update);
+
+  if (!PyArg_ParseTuple(args, "O", &o))
+    goto error;
+
+  if ((t = Python_to_ASN1_TIME(o, 1)) == NULL)
+    lose("Couldn't parse nextUpdate string");
+
+  if (!X509_CRL_set_nextUpdate(self->crl, t))
+    lose("Couldn't set nextUpdate");
+
+  ASN1_TIME_free(t);
+  Py_RETURN_NONE;
+
+ error:
+  ASN1_TIME_free(t);
+  return NULL;
+}
+
+static char crl_object_get_next_update__doc__[] =
+  "Returns this CRL's \"nextUpdate\" value as a datetime.\n"
+  ;
+
+static PyObject *
+crl_object_get_next_update (crl_object *self)
+{
+  ENTERING(crl_object_get_next_update);
+  return ASN1_TIME_to_Python(X509_CRL_get_nextUpdate(self->crl));
+}
+
+static char crl_object_add_revocations__doc__[] =
+  "This method adds a collection of revocations to this CRL.\n"
+  "\n"
+  "The \"iterable\" parameter should be an iterable object which returns\n"
+  "two-element sequences.  The first element of each pair should be the\n"
+  "revoked serial number (an integer), the second element should be the\n"
+  "revocation date (a datetime object).\n"
+  ;
+
+static PyObject *
+crl_object_add_revocations(crl_object *self, PyObject *args)
+{
+  PyObject *iterable = NULL;
+  PyObject *iterator = NULL;
+  PyObject *item = NULL;
+  PyObject *fast = NULL;
+  X509_REVOKED *revoked = NULL;
+  ASN1_INTEGER *serial = NULL;
+  ASN1_TIME *date = NULL;
+  int ok = 0;
+
+  ENTERING(crl_object_add_revocations);
+
+  if (!PyArg_ParseTuple(args, "O", &iterable) ||
+      (iterator = PyObject_GetIter(iterable)) == NULL)
+    goto error;
+
+  while ((item = PyIter_Next(iterator)) != NULL) {
+
+    if ((fast = PySequence_Fast(item, "Revocation entry must be a sequence")) == NULL)
+      goto error;
+
+    if (PySequence_Fast_GET_SIZE(fast) != 2)
+      lose_type_error("Revocation entry must be two-element sequence");
+
+    if ((serial = PyLong_to_ASN1_INTEGER(PySequence_Fast_GET_ITEM(fast, 0))) == NULL ||
+        (date = Python_to_ASN1_TIME(PySequence_Fast_GET_ITEM(fast, 1), 1)) == NULL)
+      goto error;
+
+    if ((revoked = X509_REVOKED_new()) == NULL ||
+        !X509_REVOKED_set_serialNumber(revoked, serial) ||
+        !X509_REVOKED_set_revocationDate(revoked, date))
+      lose_no_memory();
+
+    ASN1_INTEGER_free(serial);
+    serial = NULL;
+
+    ASN1_TIME_free(date);
+    date = NULL;
+
+    if (!X509_CRL_add0_revoked(self->crl, revoked))
+      lose_no_memory();
+
+    revoked = NULL;
+    Py_XDECREF(item);
+    Py_XDECREF(fast);
+    item = fast = NULL;
+  }
+
+  if (!X509_CRL_sort(self->crl))
+    lose_openssl_error("Couldn't sort CRL");
+
+  ok = 1;
+
+ error:
+  Py_XDECREF(iterator);
+  Py_XDECREF(item);
+  Py_XDECREF(fast);
+  X509_REVOKED_free(revoked);
+  ASN1_INTEGER_free(serial);
+  ASN1_TIME_free(date);
+
+  if (ok)
+    Py_RETURN_NONE;
+  else
+    return NULL;
+}
+
+static char crl_object_get_revoked__doc__[] =
+  "Return a sequence of two-element tuples representing the sequence of\n"
+  "revoked certificates listed in this CRL.\n"
+  "\n"
+  "The first element of each pair is the serialNumber of the revoked\n"
+  "certificate, the second element is the revocationDate.\n"
+  ;
+
+static PyObject *
+crl_object_get_revoked(crl_object *self)
+{
+  STACK_OF(X509_REVOKED) *revoked = NULL;
+  X509_REVOKED *r = NULL;
+  PyObject *result = NULL;
+  PyObject *item = NULL;
+  PyObject *serial = NULL;
+  PyObject *date = NULL;
+  int i;
+
+  ENTERING(crl_object_get_revoked);
+
+  if ((revoked = X509_CRL_get_REVOKED(self->crl)) == NULL)
+    lose("Inexplicable NULL revocation list pointer");
+
+  if ((result = PyTuple_New(sk_X509_REVOKED_num(revoked))) == NULL)
+    goto error;
+
+  for (i = 0; i < sk_X509_REVOKED_num(revoked); i++) {
+    r = sk_X509_REVOKED_value(revoked, i);
+
+    if ((serial = ASN1_INTEGER_to_PyLong(r->serialNumber)) == NULL ||
+        (date = ASN1_TIME_to_Python(r->revocationDate)) == NULL ||
+        (item = Py_BuildValue("(NN)", serial, date)) == NULL)
+      goto error;
+
+    PyTuple_SET_ITEM(result, i, item);
+    item = serial = date = NULL;
+  }
+
+  return result;
+
+ error:
+  Py_XDECREF(result);
+  Py_XDECREF(item);
+  Py_XDECREF(serial);
+  Py_XDECREF(date);
+  return NULL;
+}
+
+static char crl_object_is_revoked__doc__[] =
+  "Check whether a particular certificate has been revoked.\n"
+  ;
+
+static PyObject *
+crl_object_is_revoked(crl_object *self, PyObject *args)
+{
+  x509_object *x = NULL;
+
+  if (!PyArg_ParseTuple(args, "O!", &POW_X509_Type, &x))
+    return NULL;
+
+  return PyBool_FromLong(X509_CRL_get0_by_cert(self->crl, NULL, x->x509));
+}
+
+static char crl_object_clear_extensions__doc__[] =
+  "Clear all extensions attached to this CRL.\n"
+  ;
+
+static PyObject *
+crl_object_clear_extensions(crl_object *self)
+{
+  X509_EXTENSION *ext;
+
+  ENTERING(crl_object_clear_extensions);
+
+  while ((ext = X509_CRL_delete_ext(self->crl, 0)) != NULL)
+    X509_EXTENSION_free(ext);
+
+  Py_RETURN_NONE;
+}
+
+static char crl_object_sign__doc__[] =
+  "Sign this CRL with a private key.\n"
+  "\n"
+  "The \"key\" parameter should be an instance of the Asymmetric class,\n"
+  "containing a private key.\n"
+  "\n"
+  "The optional \"digest\" parameter indicates which digest to compute and\n"
+  "sign, and should be one of the following:\n"
+  "\n"
+  "* SHA1_DIGEST\n"
+  "* SHA256_DIGEST\n"
+  "* SHA384_DIGEST\n"
+  "* SHA512_DIGEST\n"
+  "\n"
+  "The default digest algorithm is SHA-256.\n"
+  ;
+
+static PyObject *
+crl_object_sign(crl_object *self, PyObject *args)
+{
+  asymmetric_object *asym;
+  int digest_type = SHA256_DIGEST;
+  const EVP_MD *digest_method = NULL;
+
+  ENTERING(crl_object_sign);
+
+  if (!PyArg_ParseTuple(args, "O!|i", &POW_Asymmetric_Type, &asym, &digest_type))
+    goto error;
+
+  if ((digest_method = evp_digest_factory(digest_type)) == NULL)
+    lose("Unsupported digest algorithm");
+
+  if (!X509_CRL_sign(self->crl, asym->pkey, digest_method))
+    lose_openssl_error("Couldn't sign CRL");
+
+  Py_RETURN_NONE;
+
+ error:
+  return NULL;
+}
+
+static char crl_object_verify__doc__[] =
+  "Verify this CRL's signature against its issuer.\n"
+  ;
+
+static PyObject *
+crl_object_verify(crl_object *self, PyObject *args)
+{
+  x509_object *issuer;
+
+  ENTERING(crl_object_verify);
+
+  if (!PyArg_ParseTuple(args, "O!", &POW_X509_Type, &issuer))
+    goto error;
+
+  if (!X509_CRL_verify(self->crl, X509_get_pubkey(issuer->x509)))
+    lose_validation_error("X509_CRL_verify() raised an exception");
+
+  Py_RETURN_NONE;
+
+ error:
+  return NULL;
+}
+
+static char crl_object_check_rpki_conformance__doc__[] =
+  "Check this CRL for conformance to the RPKI profile.\n"
+  ;
+
+static PyObject *
+crl_object_check_rpki_conformance(crl_object *self, PyObject *args, PyObject *kwds)
+{
+  static char *kwlist[] = {"issuer", "status", NULL};
+  x509_object *issuer = NULL;
+  PyObject *status = Py_None;
+
+  ENTERING(crl_object_check_rpki_conformance);
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!O!", kwlist, &POW_X509_Type, &issuer, &PySet_Type, &status))
+    goto error;
+
+  if (!check_crl(self->crl, issuer->x509, status))
+    goto error;
+
+  Py_RETURN_NONE;
+
+ error:
+  return NULL;
+}
+
+static char crl_object_pem_write__doc__[] =
+  "Return the PEM encoding of this CRL, as a string.\n"
+  ;
+
+static PyObject *
+crl_object_pem_write(crl_object *self)
+{
+  PyObject *result = NULL;
+  BIO *bio = NULL;
+
+  ENTERING(crl_object_pem_write);
+
+  if ((bio = BIO_new(BIO_s_mem())) == NULL)
+    lose_no_memory();
+
+  if (!PEM_write_bio_X509_CRL(bio, self->crl))
+    lose_openssl_error("Unable to write CRL");
+
+  result = BIO_to_PyString_helper(bio);
+
+ error:                         /* Fall through */
+  BIO_free(bio);
+  return result;
+}
+
+static char crl_object_der_write__doc__[] =
+  "Return the DER encoding of this CRL, as a string.\n"
+  ;
+
+static PyObject *
+crl_object_der_write(crl_object *self)
+{
+  PyObject *result = NULL;
+  BIO *bio = NULL;
+
+  ENTERING(crl_object_der_write);
+
+  if ((bio = BIO_new(BIO_s_mem())) == NULL)
+    lose_no_memory();
+
+  if (!i2d_X509_CRL_bio(bio, self->crl))
+    lose_openssl_error("Unable to write CRL");
+
+  result = BIO_to_PyString_helper(bio);
+
+ error:                         /* Fall through */
+  BIO_free(bio);
+  return result;
+}
+
+static char crl_object_get_aki__doc__[] =
+  EXTENSION_GET_AKI__DOC__
+  ;
+
+static PyObject *
+crl_object_get_aki(crl_object *self)
+{
+  return extension_get_aki(crl_object_extension_get_helper(self, NID_authority_key_identifier));
+}
+
+static char crl_object_set_aki__doc__[] =
+  EXTENSION_SET_AKI__DOC__
+  ;
+
+static PyObject *
+crl_object_set_aki(crl_object *self, PyObject *args)
+{
+  return crl_object_extension_set_helper(self, extension_set_aki(args));
+}
+
+static char crl_object_get_crl_number__doc__[] =
+  "Return the CRL Number extension value from this CRL, an integer.\n"
+  ;
+
+static PyObject *
+crl_object_get_crl_number(crl_object *self)
+{
+  ASN1_INTEGER *ext = X509_CRL_get_ext_d2i(self->crl, NID_crl_number, NULL, NULL);
+  PyObject *result = NULL;
+
+  ENTERING(crl_object_get_crl_number);
+
+  if (ext == NULL)
+    Py_RETURN_NONE;
+
+  result = Py_BuildValue("N", ASN1_INTEGER_to_PyLong(ext));
+  ASN1_INTEGER_free(ext);
+  return result;
+}
+
+static char crl_object_set_crl_number__doc__[] =
+  "Set the CRL Number extension value in this CRL.\n"
+  "\n"
+  "The \"number\" parameter should be an integer.\n"
+  ;
+
+static PyObject *
+crl_object_set_crl_number(crl_object *self, PyObject *args)
+{
+  ASN1_INTEGER *ext = NULL;
+  PyObject *crl_number = NULL;
+
+  ENTERING(crl_object_set_crl_number);
+
+  if (!PyArg_ParseTuple(args, "O", &crl_number) ||
+      (ext = PyLong_to_ASN1_INTEGER(crl_number)) == NULL)
+    goto error;
+
+  if (!X509_CRL_add1_ext_i2d(self->crl, NID_crl_number, ext, 0, X509V3_ADD_REPLACE))
+    lose_openssl_error("Couldn't add CRL Number extension to CRL");
+
+  ASN1_INTEGER_free(ext);
+  Py_RETURN_NONE;
+
+ error:
+  ASN1_INTEGER_free(ext);
+  return NULL;
+}
+
+static char crl_object_pprint__doc__[] =
+  "Return a pretty-printed rendition of this CRL.\n"
+  ;
+
+static PyObject *
+crl_object_pprint(crl_object *self)
+{
+  PyObject *result = NULL;
+  BIO *bio = NULL;
+
+  ENTERING(crl_object_pprint);
+
+  if ((bio = BIO_new(BIO_s_mem())) == NULL)
+    lose_no_memory();
+
+  if (!X509_CRL_print(bio, self->crl))
+    lose_openssl_error("Unable to pretty-print CRL");
+
+  result = BIO_to_PyString_helper(bio);
+
+ error:                         /* Fall through */
+  BIO_free(bio);
+  return result;
+}
+
+static struct PyMethodDef crl_object_methods[] = {
+  Define_Method(sign,                   crl_object_sign,                        METH_VARARGS),
+  Define_Method(verify,                 crl_object_verify,                      METH_VARARGS),
+  Define_Method(checkRPKIConformance,   crl_object_check_rpki_conformance,      METH_KEYWORDS),
+  Define_Method(getVersion,             crl_object_get_version,                 METH_NOARGS),
+  Define_Method(setVersion,             crl_object_set_version,                 METH_VARARGS),
+  Define_Method(getIssuer,              crl_object_get_issuer,                  METH_VARARGS),
+  Define_Method(setIssuer,              crl_object_set_issuer,                  METH_VARARGS),
+  Define_Method(getThisUpdate,          crl_object_get_this_update,     	METH_NOARGS),
+  Define_Method(setThisUpdate,          crl_object_set_this_update,             METH_VARARGS),
+  Define_Method(getNextUpdate,          crl_object_get_next_update,             METH_NOARGS),
+  Define_Method(setNextUpdate,          crl_object_set_next_update,             METH_VARARGS),
+  Define_Method(getRevoked,             crl_object_get_revoked,                 METH_NOARGS),
+  Define_Method(isRevoked,              crl_object_is_revoked,                  METH_VARARGS),
+  Define_Method(addRevocations,         crl_object_add_revocations,             METH_VARARGS),
+  Define_Method(clearExtensions,        crl_object_clear_extensions,            METH_NOARGS),
+  Define_Method(pemWrite,               crl_object_pem_write,                   METH_NOARGS),
+  Define_Method(derWrite,               crl_object_der_write,                   METH_NOARGS),
+  Define_Method(pprint,                 crl_object_pprint,                      METH_NOARGS),
+  Define_Method(getAKI,                 crl_object_get_aki,                     METH_NOARGS),
+  Define_Method(setAKI,                 crl_object_set_aki,                     METH_VARARGS),
+  Define_Method(getCRLNumber,           crl_object_get_crl_number,              METH_NOARGS),
+  Define_Method(setCRLNumber,           crl_object_set_crl_number,              METH_VARARGS),
+  Define_Method(getIssuerHash,          crl_object_get_issuer_hash,             METH_NOARGS),
+  Define_Class_Method(pemRead,          crl_object_pem_read,                    METH_VARARGS),
+  Define_Class_Method(pemReadFile,      crl_object_pem_read_file,               METH_VARARGS),
+  Define_Class_Method(derRead,          crl_object_der_read,                    METH_VARARGS),
+  Define_Class_Method(derReadFile,      crl_object_der_read_file,               METH_VARARGS),
+  {NULL}
+};
+
+static char POW_CRL_Type__doc__[] =
+  "Container for OpenSSL's X509 CRL management facilities.\n"
+  ;
+
+static PyTypeObject POW_CRL_Type = {
+  PyObject_HEAD_INIT(0)
+  0,                                     /* ob_size */
+  "rpki.POW.CRL",                        /* tp_name */
+  sizeof(crl_object),                    /* tp_basicsize */
+  0,                                     /* tp_itemsize */
+  (destructor)crl_object_dealloc,        /* tp_dealloc */
+  0,                                     /* tp_print */
+  0,                                     /* tp_getattr */
+  0,                                     /* tp_setattr */
+  0,                                     /* tp_compare */
+  0,                                     /* tp_repr */
+  0,                                     /* tp_as_number */
+  0,                                     /* tp_as_sequence */
+  0,                                     /* tp_as_mapping */
+  0,                                     /* tp_hash */
+  0,                                     /* tp_call */
+  0,                                     /* tp_str */
+  0,                                     /* tp_getattro */
+  0,                                     /* tp_setattro */
+  0,                                     /* tp_as_buffer */
+  Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, /* tp_flags */
+  POW_CRL_Type__doc__,                   /* tp_doc */
+  0,                                     /* tp_traverse */
+  0,                                     /* tp_clear */
+  0,                                     /* tp_richcompare */
+  0,                                     /* tp_weaklistoffset */
+  0,                                     /* tp_iter */
+  0,                                     /* tp_iternext */
+  crl_object_methods,                    /* tp_methods */
+  0,                                     /* tp_members */
+  0,                                     /* tp_getset */
+  0,                                     /* tp_base */
+  0,                                     /* tp_dict */
+  0,                                     /* tp_descr_get */
+  0,                                     /* tp_descr_set */
+  0,                                     /* tp_dictoffset */
+  0,                                     /* tp_init */
+  0,                                     /* tp_alloc */
+  crl_object_new,                        /* tp_new */
+};
+
+
+
+/*
+ * Asymmetric object.
+ */
+
+static PyObject *
+asymmetric_object_new(PyTypeObject *type, GCC_UNUSED PyObject *args, GCC_UNUSED PyObject *kwds)
+{
+  asymmetric_object *self = NULL;
+
+  ENTERING(asymmetric_object_new);
+
+  if ((self = (asymmetric_object *) type->tp_alloc(type, 0)) == NULL)
+    goto error;
+
+  self->pkey = NULL;
+
+  return (PyObject *) self;
+
+ error:
+
+  Py_XDECREF(self);
+  return NULL;
+}
+
+static int
+asymmetric_object_init(asymmetric_object *self, PyObject *args, PyObject *kwds)
+{
+  static char *kwlist[] = {NULL};
+
+  ENTERING(asymmetric_object_init);
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "", kwlist))
+    goto error;
+
+  /*
+   * We used to take arguments to generate an RSA key, but that's
+   * now in the .generateRSA() class method.
+   */
+
+  return 0;
+
+ error:
+  return -1;
+}
+
+static void
+asymmetric_object_dealloc(asymmetric_object *self)
+{
+  ENTERING(asymmetric_object_dealloc);
+  EVP_PKEY_free(self->pkey);
+  self->ob_type->tp_free((PyObject*) self);
+}
+
+static PyObject *
+asymmetric_object_pem_read_private_helper(PyTypeObject *type, BIO *bio, char *pass)
+{
+  asymmetric_object *self = NULL;
+
+  ENTERING(asymmetric_object_pem_read_private_helper);
+
+  if ((self = (asymmetric_object *) asymmetric_object_new(type, NULL, NULL)) == NULL)
+    goto error;
+
+  if (!PEM_read_bio_PrivateKey(bio, &self->pkey, NULL, pass))
+    lose_openssl_error("Couldn't load private key");
+
+  whack_ec_key_to_namedCurve(self->pkey);
+
+  return (PyObject *) self;
+
+ error:
+  Py_XDECREF(self);
+  return NULL;
+}
+
+/*
+ * We can't use the generic read_from_*_helper() functions here
+ * because of optional the PEM password, so we just code the two PEM
+ * read cases for private keys directly.  Other than the passphrase,
+ * code is pretty much the same as the generic functions.
+ *
+ * It turns out that OpenSSL is moving away from its old raw PKCS #1.5
+ * private key format in favor of PKCS #8.  This makes sense, but it
+ * leaves us with a minor mess to track.  Many OpenSSL functions that
+ * originally expected PKCS #1.5 now also accept PKCS #8, so there's
+ * no tearing hurry about this, but at some point we might want to
+ * switch to writing PKCS #8.  It looks like this would be relatively
+ * straightforward: see functions i2d_PKCS8PrivateKey_bio() and
+ * PEM_write_bio_PKCS8PrivateKey(), and note that PKCS #8 supports
+ * encrypted private keys in DER format, so the DER methods should
+ * take a passphrase argument as the PEM methods do.
+ */
+
+static char asymmetric_object_pem_read_private__doc__[] =
+  "Read a PEM-encoded private key from a string.\n"
+  "\n"
+  "Optional second argument is a passphrase for the key.\n"
+  ;
+
+static PyObject *
+asymmetric_object_pem_read_private(PyTypeObject *type, PyObject *args)
+{
+  PyObject *result = NULL;
+  char *pass = NULL;
+  char *src = NULL;
+  BIO *bio = NULL;
+  Py_ssize_t len = 0;
+
+  ENTERING(asymmetric_object_pem_read_private);
+
+  if (!PyArg_ParseTuple(args, "s#|s", &src, &len, &pass))
+    goto error;
+
+  if ((bio = BIO_new_mem_buf(src, len)) == NULL)
+    lose_no_memory();
+
+  result = asymmetric_object_pem_read_private_helper(type, bio, pass);
+
+ error:
+  BIO_free(bio);
+  return result;
+}
+
+static char asymmetric_object_pem_read_private_file__doc__[] =
+  "Read a PEM-encoded private key from a file.\n"
+  "\n"
+  "Optional second argument is a passphrase for the key.\n"
+  ;
+
+static PyObject *
+asymmetric_object_pem_read_private_file(PyTypeObject *type, PyObject *args)
+{
+  const char *filename = NULL;
+  PyObject *result = NULL;
+  char *pass = NULL;
+  BIO *bio = NULL;
+
+  ENTERING(asymmetric_object_pem_read_private_file);
+
+  if (!PyArg_ParseTuple(args, "s|s", &filename, &pass))
+    goto error;
+
+  if ((bio = BIO_new_file(filename, "rb")) == NULL)
+    lose_openssl_error("Could not open file");
+
+  result = asymmetric_object_pem_read_private_helper(type, bio, pass);
+
+ error:
+  BIO_free(bio);
+  return result;
+}
+
+/*
+ * Used to be only PEM format private keys had passphrases, but with PKCS #8
+ * that's not really true anymore.  We may need to extend the API here to allow
+ * passphrases for DER private keys as well.
+ */
+
+static PyObject *
+asymmetric_object_der_read_private_helper(PyTypeObject *type, BIO *bio)
+{
+  asymmetric_object *self = NULL;
+
+  ENTERING(asymmetric_object_der_read_private_helper);
+
+  if ((self = (asymmetric_object *) asymmetric_object_new(type, NULL, NULL)) == NULL)
+    goto error;
+
+  if (!d2i_PrivateKey_bio(bio, &self->pkey))
+    lose_openssl_error("Couldn't load private key");
+
+  whack_ec_key_to_namedCurve(self->pkey);
+
+  return (PyObject *) self;
+
+ error:
+
+  Py_XDECREF(self);
+  return NULL;
+}
+
+static char asymmetric_object_der_read_private__doc__[] =
+  "Read a DER-encoded private key from a string.\n"
+  ;
+
+static PyObject *
+asymmetric_object_der_read_private(PyTypeObject *type, PyObject *args)
+{
+  ENTERING(asymmetric_object_der_read_private);
+  return read_from_string_helper(asymmetric_object_der_read_private_helper, type, args);
+}
+
+static char asymmetric_object_der_read_private_file__doc__[] =
+  "Read a DER-encoded private key from a file.\n"
+  ;
+
+static PyObject *
+asymmetric_object_der_read_private_file(PyTypeObject *type, PyObject *args)
+{
+  ENTERING(asymmetric_object_der_read_private_file);
+  return read_from_file_helper(asymmetric_object_der_read_private_helper, type, args);
+}
+
+static PyObject *
+asymmetric_object_pem_read_public_helper(PyTypeObject *type, BIO *bio)
+{
+  asymmetric_object *self = NULL;
+
+  ENTERING(asymmetric_object_pem_read_public_helper);
+
+  if ((self = (asymmetric_object *) asymmetric_object_new(type, NULL, NULL)) == NULL)
+    goto error;
+
+  if (!PEM_read_bio_PUBKEY(bio, &self->pkey, NULL, NULL))
+    lose_openssl_error("Couldn't load public key");
+
+  whack_ec_key_to_namedCurve(self->pkey);
+
+  return (PyObject *) self;
+
+ error:
+  Py_XDECREF(self);
+  return NULL;
+}
+
+static PyObject *
+asymmetric_object_der_read_public_helper(PyTypeObject *type, BIO *bio)
+{
+  asymmetric_object *self = NULL;
+
+  ENTERING(asymmetric_object_der_read_public_helper);
+
+  if ((self = (asymmetric_object *) asymmetric_object_new(type, NULL, NULL)) == NULL)
+    goto error;
+
+  if (!d2i_PUBKEY_bio(bio, &self->pkey))
+    lose_openssl_error("Couldn't load public key");
+
+  whack_ec_key_to_namedCurve(self->pkey);
+
+  return (PyObject *) self;
+
+ error:
+
+  Py_XDECREF(self);
+  return NULL;
+}
+
+static char asymmetric_object_pem_read_public__doc__[] =
+  "Read a PEM-encoded public key from a string.\n"
+  ;
+
+static PyObject *
+asymmetric_object_pem_read_public(PyTypeObject *type, PyObject *args)
+{
+  ENTERING(asymmetric_object_pem_read_public);
+  return read_from_string_helper(asymmetric_object_pem_read_public_helper, type, args);
+}
+
+static char asymmetric_object_pem_read_public_file__doc__[] =
+  "Read a PEM-encoded public key from a file.\n"
+  ;
+
+static PyObject *
+asymmetric_object_pem_read_public_file(PyTypeObject *type, PyObject *args)
+{
+  ENTERING(asymmetric_object_pem_read_public_file);
+  return read_from_file_helper(asymmetric_object_pem_read_public_helper, type, args);
+}
+
+static char asymmetric_object_der_read_public__doc__[] =
+  "Read a DER-encoded public key from a string.\n"
+  ;
+
+static PyObject *
+asymmetric_object_der_read_public(PyTypeObject *type, PyObject *args)
+{
+  ENTERING(asymmetric_object_der_read_public);
+  return read_from_string_helper(asymmetric_object_der_read_public_helper, type, args);
+}
+
+static char asymmetric_object_der_read_public_file__doc__[] =
+  "Read a DER-encoded public key from a file.\n"
+  ;
+
+static PyObject *
+asymmetric_object_der_read_public_file(PyTypeObject *type, PyObject *args)
+{
+  ENTERING(asymmetric_object_der_read_public_file);
+  return read_from_file_helper(asymmetric_object_der_read_public_helper, type, args);
+}
+
+static char asymmetric_object_pem_write_private__doc__[] =
+  "Return the PEM encoding of an \"Asymmetric\" private key.\n"
+  "\n"
+  "This method takes an optional parameter \"passphrase\" which, if\n"
+  "specified, will be used to encrypt the private key with AES-256-CBC.\n"
+  "\n"
+  "If you don't specify a passphrase, the key will not be encrypted.\n"
+  ;
+
+static PyObject *
+asymmetric_object_pem_write_private(asymmetric_object *self, PyObject *args)
+{
+  PyObject *result = NULL;
+  char *passphrase = NULL;
+  const EVP_CIPHER *evp_method = NULL;
+  BIO *bio = NULL;
+
+  ENTERING(asymmetric_object_pem_write_private);
+
+  if (!PyArg_ParseTuple(args, "|s", &passphrase))
+    goto error;
+
+  if ((bio = BIO_new(BIO_s_mem())) == NULL)
+    lose_no_memory();
+
+  if (passphrase)
+    evp_method = EVP_aes_256_cbc();
+
+  if (!PEM_write_bio_PrivateKey(bio, self->pkey, evp_method, NULL, 0, NULL, passphrase))
+    lose_openssl_error("Unable to write key");
+
+  result = BIO_to_PyString_helper(bio);
+
+ error:                         /* Fall through */
+  BIO_free(bio);
+  return result;
+}
+
+static char asymmetric_object_pem_write_public__doc__[] =
+  "Return the PEM encoding of an \"Asymmetric\" public key.\n"
+  ;
+
+static PyObject *
+asymmetric_object_pem_write_public(asymmetric_object *self)
+{
+  PyObject *result = NULL;
+  BIO *bio = NULL;
+
+  ENTERING(asymmetric_object_pem_write_public);
+
+  if ((bio = BIO_new(BIO_s_mem())) == NULL)
+    lose_no_memory();
+
+  if (!PEM_write_bio_PUBKEY(bio, self->pkey))
+    lose_openssl_error("Unable to write key");
+
+  result = BIO_to_PyString_helper(bio);
+
+ error:                         /* Fall through */
+  BIO_free(bio);
+  return result;
+}
+
+static char asymmetric_object_der_write_private__doc__[] =
+  "Return the DER encoding of an \"Asymmetric\" private key.\n"
+  ;
+
+static PyObject *
+asymmetric_object_der_write_private(asymmetric_object *self)
+{
+  PyObject *result = NULL;
+  BIO *bio = NULL;
+
+  ENTERING(asymmetric_object_der_write_private);
+
+  if ((bio = BIO_new(BIO_s_mem())) == NULL)
+    lose_no_memory();
+
+  if (!i2d_PrivateKey_bio(bio, self->pkey))
+    lose_openssl_error("Unable to write private key");
+
+  result = BIO_to_PyString_helper(bio);
+
+ error:                         /* Fall through */
+  BIO_free(bio);
+  return result;
+}
+
+static char asymmetric_object_der_write_public__doc__[] =
+  "Return the DER encoding of an \"Asymmetric\" public key.\n"
+  ;
+
+static PyObject *
+asymmetric_object_der_write_public(asymmetric_object *self)
+{
+  PyObject *result = NULL;
+  BIO *bio = NULL;
+
+  ENTERING(asymmetric_object_der_write_public);
+
+  if ((bio = BIO_new(BIO_s_mem())) == NULL)
+    lose_no_memory();
+
+  if (!i2d_PUBKEY_bio(bio, self->pkey))
+    lose_openssl_error("Unable to write public key");
+
+  result = BIO_to_PyString_helper(bio);
+
+ error:                         /* Fall through */
+  BIO_free(bio);
+  return result;
+}
+
+/*
+ * Generate an RSA key without touching the Python API, so that
+ * SigningPool worker threads can use this too.
+ */
+
+static EVP_PKEY *
+asymmetric_object_generate_rsa_key(int key_size)
+{
+  EVP_PKEY_CTX *ctx = NULL;
+  EVP_PKEY *pkey = NULL;
+
+  /*
+   * Explictly setting RSA_F4 would be tedious, as it requires messing
+   * about with bignums, and F4 is the default, so we leave it alone.
+   * In case this ever changes, the required sequence would be:
+   * BN_new(), BN_set_word(), EVP_PKEY_CTX_set_rsa_keygen_pubexp(),
+   * BN_free().
+   */
+
+  if ((ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, NULL)) == NULL ||
+      EVP_PKEY_keygen_init(ctx) <= 0 ||
+      EVP_PKEY_CTX_set_rsa_keygen_bits(ctx, key_size) <= 0 ||
+      EVP_PKEY_keygen(ctx, &pkey) <= 0) {
+    EVP_PKEY_free(pkey);
+    pkey = NULL;
+  }
+
+  EVP_PKEY_CTX_free(ctx);
+  return pkey;
+}
+
+static EVP_PKEY *rsa_key_pool_take(rsa_key_pool_object *);
+
+/*
+ * Pool installed by setRSAKeyPool(), if any.
+ */
+
+static rsa_key_pool_object *default_rsa_key_pool;
+
+static char asymmetric_object_generate_rsa__doc__[] =
+  "Generate a new RSA keypair.\n"
+  "\n"
+  "Optional argument key_size is the desired key size, in bits;\n"
+  "if not specified, the default is 2048.\n"
+  "\n"
+  "If an RSAKeyPool of the right key size has been installed with\n"
+  "setRSAKeyPool(), the key comes from that pool when one is available."
+  ;
+
+static PyObject *
+asymmetric_object_generate_rsa(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+  static char *kwlist[] = {"key_size", NULL};
+  asymmetric_object *self = NULL;
+  int key_size = 2048;
+
+  ENTERING(asymmetric_object_generate_rsa);
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|i", kwlist, &key_size))
+    goto error;
+
+  if ((self = (asymmetric_object *) asymmetric_object_new(type, NULL, NULL)) == NULL)
+    goto error;
+
+  if (default_rsa_key_pool != NULL && key_size == default_rsa_key_pool->key_size) {
+    if ((self->pkey = rsa_key_pool_take(default_rsa_key_pool)) != NULL) {
+      default_rsa_key_pool->hits++;
+      return (PyObject *) self;
+    }
+    default_rsa_key_pool->misses++;
+  }
+
+  if ((self->pkey = asymmetric_object_generate_rsa_key(key_size)) == NULL)
+    lose_openssl_error("Couldn't generate new RSA key");
+
+  return (PyObject *) self;
+
+ error:
+  Py_XDECREF(self);
+  return NULL;
+}
+
+static char asymmetric_object_generate_from_params__doc__[] =
+  "Generate a new keypair using an AsymmetricParams object.\n"
+  ;
+
+static PyObject *
+asymmetric_object_generate_from_params(PyTypeObject *type, PyObject *args)
+{
+  asymmetric_params_object *params = NULL;
+  asymmetric_object *self = NULL;
+  EVP_PKEY_CTX *ctx = NULL;
+  int ok = 0;
+
+  ENTERING(asymmetric_object_generate_from_params);
+
+  if (!PyArg_ParseTuple(args, "O!", &POW_AsymmetricParams_Type, &params))
+    goto error;
+
+  if ((self = (asymmetric_object *) asymmetric_object_new(type, NULL, NULL)) == NULL)
+    goto error;
+
+  if ((ctx = EVP_PKEY_CTX_new(params->pkey, NULL)) == NULL ||
+      EVP_PKEY_keygen_init(ctx) <= 0 ||
+      EVP_PKEY_keygen(ctx, &self->pkey) <= 0)
+    lose_openssl_error("Couldn't generate new key");
+
+  whack_ec_key_to_namedCurve(self->pkey);
+
+  ok = 1;
+
+ error:
+  EVP_PKEY_CTX_free(ctx);
+
+  if (ok)
+    return (PyObject *) self;
+
+  Py_XDECREF(self);
+  return NULL;
+}
+
+static char asymmetric_object_calculate_ski__doc__[] =
+  "Calculate SKI value for this key.\n"
+  "\n"
+  "The SKI is the SHA-1 hash of key's SubjectPublicKey value.\n"
+  ;
+
+static PyObject *
+asymmetric_object_calculate_ski(asymmetric_object *self)
+{
+  PyObject *result = NULL;
+  X509_PUBKEY *pubkey = NULL;
+  unsigned char digest[EVP_MAX_MD_SIZE];
+  unsigned digest_length;
+  const unsigned char *key_data = NULL;
+  int key_length;
+
+  ENTERING(asymmetric_object_calculate_ski);
+
+  if (!X509_PUBKEY_set(&pubkey, self->pkey) ||
+      !X509_PUBKEY_get0_param(NULL, &key_data, &key_length, NULL, pubkey))
+    lose_openssl_error("Couldn't extract public key");
+
+  if (!EVP_Digest(key_data, key_length, digest, &digest_length, EVP_sha1(), NULL))
+    lose_openssl_error("Couldn't calculate SHA-1 digest of public key");
+
+  result = PyString_FromStringAndSize((char *) digest, digest_length);
+
+ error:
+  X509_PUBKEY_free(pubkey);
+  return result;
+}
+
+static struct PyMethodDef asymmetric_object_methods[] = {
+  Define_Method(pemWritePrivate,          asymmetric_object_pem_write_private,          METH_VARARGS),
+  Define_Method(pemWritePublic,           asymmetric_object_pem_write_public,           METH_NOARGS),
+  Define_Method(derWritePrivate,          asymmetric_object_der_write_private,          METH_NOARGS),
+  Define_Method(derWritePublic,           asymmetric_object_der_write_public,           METH_NOARGS),
+  Define_Method(calculateSKI,             asymmetric_object_calculate_ski,              METH_NOARGS),
+  Define_Class_Method(pemReadPublic,      asymmetric_object_pem_read_public,            METH_VARARGS),
+  Define_Class_Method(pemReadPublicFile,  asymmetric_object_pem_read_public_file,       METH_VARARGS),
+  Define_Class_Method(derReadPublic,      asymmetric_object_der_read_public,            METH_VARARGS),
+  Define_Class_Method(derReadPublicFile,  asymmetric_object_der_read_public_file,       METH_VARARGS),
+  Define_Class_Method(pemReadPrivate,     asymmetric_object_pem_read_private,           METH_VARARGS),
+  Define_Class_Method(pemReadPrivateFile, asymmetric_object_pem_read_private_file,      METH_VARARGS),
+  Define_Class_Method(derReadPrivate,     asymmetric_object_der_read_private,           METH_VARARGS),
+  Define_Class_Method(derReadPrivateFile, asymmetric_object_der_read_private_file,      METH_VARARGS),
+  Define_Class_Method(generateRSA,        asymmetric_object_generate_rsa,               METH_KEYWORDS),
+  Define_Class_Method(generateFromParams, asymmetric_object_generate_from_params,       METH_VARARGS),
+  {NULL}
+};
+
+static char POW_Asymmetric_Type__doc__[] =
+  "Container for OpenSSL's EVP_PKEY asymmetric key classes.\n"
+  ;
+
+static PyTypeObject POW_Asymmetric_Type = {
+  PyObject_HEAD_INIT(0)
+  0,                                     /* ob_size */
+  "rpki.POW.Asymmetric",                 /* tp_name */
+  sizeof(asymmetric_object),             /* tp_basicsize */
+  0,                                     /* tp_itemsize */
+  (destructor)asymmetric_object_dealloc, /* tp_dealloc */
+  0,                                     /* tp_print */
+  0,                                     /* tp_getattr */
+  0,                                     /* tp_setattr */
+  0,                                     /* tp_compare */
+  0,                                     /* tp_repr */
+  0,                                     /* tp_as_number */
+  0,                                     /* tp_as_sequence */
+  0,                                     /* tp_as_mapping */
+  0,                                     /* tp_hash */
+  0,                                     /* tp_call */
+  0,                                     /* tp_str */
+  0,                                     /* tp_getattro */
+  0,                                     /* tp_setattro */
+  0,                                     /* tp_as_buffer */
+  Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, /* tp_flags */
+  POW_Asymmetric_Type__doc__,            /* tp_doc */
+  0,                                     /* tp_traverse */
+  0,                                     /* tp_clear */
+  0,                                     /* tp_richcompare */
+  0,                                     /* tp_weaklistoffset */
+  0,                                     /* tp_iter */
+  0,                                     /* tp_iternext */
+  asymmetric_object_methods,             /* tp_methods */
+  0,                                     /* tp_members */
+  0,                                     /* tp_getset */
+  0,                                     /* tp_base */
+  0,                                     /* tp_dict */
+  0,                                     /* tp_descr_get */
+  0,                                     /* tp_descr_set */
+  0,                                     /* tp_dictoffset */
+  (initproc) asymmetric_object_init,     /* tp_init */
+  0,                                     /* tp_alloc */
+  asymmetric_object_new,                 /* tp_new */
+};
+
+
+
+/*
+ * AsymmetricParams object.
+ */
+
+static PyObject *
+asymmetric_params_object_new(PyTypeObject *type, GCC_UNUSED PyObject *args, GCC_UNUSED PyObject *kwds)
+{
+  asymmetric_params_object *self = NULL;
+
+  ENTERING(asymmetric_params_object_new);
+
+  if ((self = (asymmetric_params_object *) type->tp_alloc(type, 0)) == NULL)
+    goto error;
+
+  self->pkey = NULL;
+
+  return (PyObject *) self;
+
+ error:
+
+  Py_XDECREF(self);
+  return NULL;
+}
+
+static int
+asymmetric_params_object_init(asymmetric_params_object *self, PyObject *args, PyObject *kwds)
+{
+  static char *kwlist[] = {NULL};
+
+  ENTERING(asymmetric_params_object_init);
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "", kwlist))
+    goto error;
+
+  return 0;
+
+ error:
+  return -1;
+}
+
+static void
+asymmetric_params_object_dealloc(asymmetric_params_object *self)
+{
+  ENTERING(asymmetric_params_object_dealloc);
+  EVP_PKEY_free(self->pkey);
+  self->ob_type->tp_free((PyObject*) self);
+}
+
+static PyObject *
+asymmetric_params_object_pem_read_helper(PyTypeObject *type, BIO *bio)
+{
+  asymmetric_params_object *self = NULL;
+
+  ENTERING(asymmetric_params_object_pem_read_helper);
+
+  if ((self = (asymmetric_params_object *) asymmetric_params_object_new(type, NULL, NULL)) == NULL)
+    goto error;
+
+  if (!PEM_read_bio_Parameters(bio, &self->pkey))
+    lose_openssl_error("Couldn't load PEM encoded key parameters");
+
+  return (PyObject *) self;
+
+ error:
+
+  Py_XDECREF(self);
+  return NULL;
+}
+
+static char asymmetric_params_object_pem_read__doc__[] =
+  "Read PEM-encoded key parameters from a string.\n"
+  ;
+
+static PyObject *
+asymmetric_params_object_pem_read(PyTypeObject *type, PyObject *args)
+{
+  ENTERING(asymmetric_params_object_pem_read);
+  return read_from_string_helper(asymmetric_params_object_pem_read_helper, type, args);
+}
+
+static char asymmetric_params_object_pem_read_file__doc__[] =
+  "Read PEM-encoded key parameters from a file.\n"
+  ;
+
+static PyObject *
+asymmetric_params_object_pem_read_file(PyTypeObject *type, PyObject *args)
+{
+  ENTERING(asymmetric_params_object_pem_read_file);
+  return read_from_file_helper(asymmetric_params_object_pem_read_helper, type, args);
+}
+
+static char asymmetric_params_object_pem_write__doc__[] =
+  "Return the PEM encoding of this set of key parameters, as a string.\n"
+  ;
+
+static PyObject *
+asymmetric_params_object_pem_write(asymmetric_params_object *self)
+{
+  PyObject *result = NULL;
+  BIO *bio = NULL;
+
+  ENTERING(asymmetric_params_object_pem_write);
+
+  if ((bio = BIO_new(BIO_s_mem())) == NULL)
+    lose_no_memory();
+
+  if (PEM_write_bio_Parameters(bio, self->pkey) <= 0)
+    lose_openssl_error("Unable to write key parameters");
+
+  result = BIO_to_PyString_helper(bio);
+
+ error:                         /* Fall through */
+  BIO_free(bio);
+  return result;
+}
+
+static char asymmetric_params_object_generate_ec__doc__[] =
+  "Generate a new set of EC parameters.\n"
+  "\n"
+  "Optional argument curve is a numeric code representing the curve to use;\n"
+  "if not specified, the default is P-256."
+  ;
+
+static PyObject *
+asymmetric_params_object_generate_ec(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+  static char *kwlist[] = {"curve", NULL};
+  asymmetric_params_object *self = NULL;
+  EVP_PKEY_CTX *ctx = NULL;
+  int curve = NID_X9_62_prime256v1;
+  int ok = 0;
+
+  ENTERING(asymmetric_params_object_generate_ec);
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|i", kwlist, &curve))
+    goto error;
+
+  if ((self = (asymmetric_params_object *) asymmetric_params_object_new(type, NULL, NULL)) == NULL)
+    goto error;
+
+  if ((ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL)) == NULL ||
+      EVP_PKEY_paramgen_init(ctx) <= 0 ||
+      EVP_PKEY_CTX_set_ec_paramgen_curve_nid(ctx, curve) <= 0 ||
+      EVP_PKEY_paramgen(ctx, &self->pkey) <= 0)
+    lose_openssl_error("Couldn't generate key parameters");
+
+  ok = 1;
+
+ error:
+  EVP_PKEY_CTX_free(ctx);
+
+  if (ok)
+    return (PyObject *) self;
+
+  Py_XDECREF(self);
+  return NULL;
+}
+
+static char asymmetric_params_object_generate_dh__doc__[] =
+  "Generate a new set of DH parameters.\n"
+  "\n"
+  "Optional argument prime_length is length of the DH prime parameter\n"
+  "to use, in bits; if not specified, the default is 2048 bits.\n"
+  "\n"
+  "Be warned that generating DH parameters with a 2048-bit prime may\n"
+  "take a ridiculously long time.\n"
+  ;
+
+static PyObject *
+asymmetric_params_object_generate_dh(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+  static char *kwlist[] = {"prime_length", NULL};
+  asymmetric_params_object *self = NULL;
+  EVP_PKEY_CTX *ctx = NULL;
+  int prime_length = 2048;
+  int ok = 0;
+
+  ENTERING(asymmetric_params_object_generate_dh);
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|i", kwlist, &prime_length))
+    goto error;
+
+  if ((self = (asymmetric_params_object *) asymmetric_params_object_new(type, NULL, NULL)) == NULL)
+    goto error;
+
+  if ((ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_DH, NULL)) == NULL ||
+      EVP_PKEY_paramgen_init(ctx) <= 0 ||
+      EVP_PKEY_CTX_set_dh_paramgen_prime_len(ctx, prime_length) <= 0 ||
+      EVP_PKEY_paramgen(ctx, &self->pkey) <= 0)
+    lose_openssl_error("Couldn't generate key parameters");
+
+  ok = 1;
+
+ error:
+  EVP_PKEY_CTX_free(ctx);
+
+  if (ok)
+    return (PyObject *) self;
+
+  Py_XDECREF(self);
+  return NULL;
+}
+
+static char asymmetric_params_object_generate_dsa__doc__[] =
+  "Generate a new set of DSA parameters.\n"
+  "\n"
+  "Optional argument key_length is the length of the key to generate, in bits;\n"
+  "if not specified, the default is 2048 bits."
+  ;
+
+static PyObject *
+asymmetric_params_object_generate_dsa(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+  static char *kwlist[] = {"key_length", NULL};
+  asymmetric_params_object *self = NULL;
+  EVP_PKEY_CTX *ctx = NULL;
+  int key_length = 2048;
+  int ok = 0;
+
+  ENTERING(asymmetric_params_object_generate_dsa);
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|i", kwlist, &key_length))
+    goto error;
+
+  if ((self = (asymmetric_params_object *) asymmetric_params_object_new(type, NULL, NULL)) == NULL)
+    goto error;
+
+  if ((ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_DSA, NULL)) == NULL ||
+      EVP_PKEY_paramgen_init(ctx) <= 0 ||
+      EVP_PKEY_CTX_set_dsa_paramgen_bits(ctx, key_length) <= 0 ||
+      EVP_PKEY_paramgen(ctx, &self->pkey) <= 0)
+    lose_openssl_error("Couldn't generate key parameters");
+
+  ok = 1;
+
+ error:
+  EVP_PKEY_CTX_free(ctx);
+
+  if (ok)
+    return (PyObject *) self;
+
+  Py_XDECREF(self);
+  return NULL;
+}
+
+static struct PyMethodDef asymmetric_params_object_methods[] = {
+  Define_Method(pemWrite,               asymmetric_params_object_pem_write,             METH_NOARGS),
+  Define_Class_Method(pemRead,          asymmetric_params_object_pem_read,              METH_VARARGS),
+  Define_Class_Method(pemReadFile,      asymmetric_params_object_pem_read_file,         METH_VARARGS),
+  Define_Class_Method(generateEC,       asymmetric_params_object_generate_ec,		METH_KEYWORDS),
+  Define_Class_Method(generateDH,	asymmetric_params_object_generate_dh,           METH_KEYWORDS),
+  Define_Class_Method(generateDSA,	asymmetric_params_object_generate_dsa,          METH_KEYWORDS),
+  {NULL}
+};
+
+static char POW_AsymmetricParams_Type__doc__[] =
+  "Container for OpenSSL's EVP_PKEY asymmetric key parameter classes.\n"
+  ;
+
+static PyTypeObject POW_AsymmetricParams_Type = {
+  PyObject_HEAD_INIT(0)
+  0,                                     /* ob_size */
+  "rpki.POW.AsymmetricParams",           /* tp_name */
+  sizeof(asymmetric_params_object),      /* tp_basicsize */
+  0,                                     /* tp_itemsize */
+  (destructor)asymmetric_params_object_dealloc, /* tp_dealloc */
+  0,                                     /* tp_print */
+  0,                                     /* tp_getattr */
+  0,                                     /* tp_setattr */
+  0,                                     /* tp_compare */
+  0,                                     /* tp_repr */
+  0,                                     /* tp_as_number */
+  0,                                     /* tp_as_sequence */
+  0,                                     /* tp_as_mapping */
+  0,                                     /* tp_hash */
+  0,                                     /* tp_call */
+  0,                                     /* tp_str */
+  0,                                     /* tp_getattro */
+  0,                                     /* tp_setattro */
+  0,                                     /* tp_as_buffer */
+  Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, /* tp_flags */
+  POW_AsymmetricParams_Type__doc__,      /* tp_doc */
+  0,                                     /* tp_traverse */
+  0,                                     /* tp_clear */
+  0,                                     /* tp_richcompare */
+  0,                                     /* tp_weaklistoffset */
+  0,                                     /* tp_iter */
+  0,                                     /* tp_iternext */
+  asymmetric_params_object_methods,      /* tp_methods */
+  0,                                     /* tp_members */
+  0,                                     /* tp_getset */
+  0,                                     /* tp_base */
+  0,                                     /* tp_dict */
+  0,                                     /* tp_descr_get */
+  0,                                     /* tp_descr_set */
+  0,                                     /* tp_dictoffset */
+  (initproc) asymmetric_params_object_init, /* tp_init */
+  0,                                     /* tp_alloc */
+  asymmetric_params_object_new,          /* tp_new */
+};
+
+
+
+/*
+ * Digest object.
+ */
+
+static PyObject *
+digest_object_new(PyTypeObject *type, GCC_UNUSED PyObject *args, GCC_UNUSED PyObject *kwds)
+{
+  digest_object *self = NULL;
+
+  ENTERING(digest_object_new);
+
+  if ((self = (digest_object *) type->tp_alloc(type, 0)) == NULL)
+    goto error;
+
+  self->digest_type = 0;
+
+  return (PyObject *) self;
+
+ error:
+  return NULL;
+}
+
+static int
+digest_object_init(digest_object *self, PyObject *args, PyObject *kwds)
+{
+  static char *kwlist[] = {"digest_type", NULL};
+  const EVP_MD *digest_method = NULL;
+  int digest_type = 0;
+
+  ENTERING(digest_object_init);
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "i", kwlist, &digest_type))
+    goto error;
+
+  if ((digest_method = evp_digest_factory(digest_type)) == NULL)
+    lose("Unsupported digest algorithm");
+
+  self->digest_type = digest_type;
+  if (!EVP_DigestInit(&self->digest_ctx, digest_method))
+    lose_openssl_error("Couldn't initialize digest");
+
+  return 0;
+
+ error:
+  return -1;
+}
+
+static void
+digest_object_dealloc(digest_object *self)
+{
+  ENTERING(digest_object_dealloc);
+  EVP_MD_CTX_cleanup(&self->digest_ctx);
+  self->ob_type->tp_free((PyObject*) self);
+}
+
+static char digest_object_update__doc__[] =
+  "Add data to this digest.\n"
+  "\n"
+  "the \"data\" parameter should be a string containing the data to be added.\n"
+  ;
+
+static PyObject *
+digest_object_update(digest_object *self, PyObject *args)
+{
+  char *data = NULL;
+  Py_ssize_t len = 0;
+
+  ENTERING(digest_object_update);
+
+  if (!PyArg_ParseTuple(args, "s#", &data, &len))
+    goto error;
+
+  if (!EVP_DigestUpdate(&self->digest_ctx, data, len))
+    lose_openssl_error("EVP_DigestUpdate() failed");
+
+  Py_RETURN_NONE;
+
+ error:
+  return NULL;
+}
+
+static char digest_object_copy__doc__[] =
+  "Return a copy of this Digest object.\n"
+  ;
+
+static PyObject *
+digest_object_copy(digest_object *self)
+{
+  digest_object *new = NULL;
+
+  ENTERING(digest_object_copy);
+
+  if ((new = (digest_object *) digest_object_new(&POW_Digest_Type, NULL, NULL)) == NULL)
+    goto error;
+
+  new->digest_type = self->digest_type;
+  if (!EVP_MD_CTX_copy(&new->digest_ctx, &self->digest_ctx))
+    lose_openssl_error("Couldn't copy digest");
+
+  return (PyObject*) new;
+
+ error:
+
+  Py_XDECREF(new);
+  return NULL;
+}
+
+static char digest_object_digest__doc__[] =
+  "Return the digest of all the data which this Digest object has processed.\n"
+  "\n"
+  "This method can be called at any time and will not effect the internal\n"
+  "state of the Digest object.\n"
+  ;
+
+/*
+ * Do we really need to do this copy?  Nice general operation, but does
+ * anything we're doing for RPKI care?
+ */
+
+static PyObject *
+digest_object_digest(digest_object *self)
+{
+  unsigned char digest_text[EVP_MAX_MD_SIZE];
+  unsigned digest_len = 0;
+  PyObject *result = NULL;
+  EVP_MD_CTX ctx;
+
+  ENTERING(digest_object_digest);
+
+  if (!EVP_MD_CTX_copy(&ctx, &self->digest_ctx))
+    lose_openssl_error("Couldn't copy digest");
+
+  EVP_DigestFinal(&ctx, digest_text, &digest_len);
+
+  result = Py_BuildValue("s#", digest_text, (Py_ssize_t) digest_len);
+
+ error:
+  EVP_MD_CTX_cleanup(&ctx);
+  return result;
+}
+
+static struct PyMethodDef digest_object_methods[] = {
+  Define_Method(update,         digest_object_update,   METH_VARARGS),
+  Define_Method(digest,         digest_object_digest,   METH_NOARGS),
+  Define_Method(copy,           digest_object_copy,     METH_NOARGS),
+  {NULL}
+};
+
+static char POW_Digest_Type__doc__[] =
+  "This class provides access to the digest functionality of OpenSSL.\n"
+  "It emulates the digest modules in the Python Standard Library, but\n"
+  "does not currently support the \"hexdigest\" method.\n"
+  "\n"
+  "The constructor takes one parameter, the kind of Digest object to create.\n"
+  "This should be one of the following:\n"
+  "\n"
+  "  * SHA1_DIGEST\n"
+  "  * SHA256_DIGEST\n"
+  "  * SHA384_DIGEST\n"
+  "  * SHA512_DIGEST\n"
+  ;
+
+static PyTypeObject POW_Digest_Type = {
+  PyObject_HEAD_INIT(0)
+  0,                                  /* ob_size */
+  "rpki.POW.Digest",                  /* tp_name */
+  sizeof(digest_object),              /* tp_basicsize */
+  0,                                  /* tp_itemsize */
+  (destructor)digest_object_dealloc,  /* tp_dealloc */
+  0,                                  /* tp_print */
+  0,                                  /* tp_getattr */
+  0,                                  /* tp_setattr */
+  0,                                  /* tp_compare */
+  0,                                  /* tp_repr */
+  0,                                  /* tp_as_number */
+  0,                                  /* tp_as_sequence */
+  0,                                  /* tp_as_mapping */
+  0,                                  /* tp_hash */
+  0,                                  /* tp_call */
+  0,                                  /* tp_str */
+  0,                                  /* tp_getattro */
+  0,                                  /* tp_setattro */
+  0,                                  /* tp_as_buffer */
+  Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, /* tp_flags */
+  POW_Digest_Type__doc__,             /* tp_doc */
+  0,                                  /* tp_traverse */
+  0,                                  /* tp_clear */
+  0,                                  /* tp_richcompare */
+  0,                                  /* tp_weaklistoffset */
+  0,                                  /* tp_iter */
+  0,                                  /* tp_iternext */
+  digest_object_methods,              /* tp_methods */
+  0,                                  /* tp_members */
+  0,                                  /* tp_getset */
+  0,                                  /* tp_base */
+  0,                                  /* tp_dict */
+  0,                                  /* tp_descr_get */
+  0,                                  /* tp_descr_set */
+  0,                                  /* tp_dictoffset */
+  (initproc) digest_object_init,      /* tp_init */
+  0,                                  /* tp_alloc */
+  digest_object_new,                  /* tp_new */
+};
+
+
+
+/*
+ * CMS object.
+ */
+
+static PyObject *
+cms_object_new(PyTypeObject *type, GCC_UNUSED PyObject *args, GCC_UNUSED PyObject *kwds)
+{
+  cms_object *self;
+
+  ENTERING(cms_object_new);
+
+  if ((self = (cms_object *) type->tp_alloc(type, 0)) != NULL)
+    return (PyObject *) self;
+
+  Py_XDECREF(self);
+  return NULL;
+}
+
+static void
+cms_object_dealloc(cms_object *self)
+{
+  ENTERING(cms_object_dealloc);
+  CMS_ContentInfo_free(self->cms);
+  self->ob_type->tp_free((PyObject*) self);
+}
+
+static PyObject *
+cms_object_pem_read_helper(PyTypeObject *type, BIO *bio)
+{
+  cms_object *self;
+
+  ENTERING(cms_object_pem_read_helper);
+
+  if ((self = (cms_object *) type->tp_new(type, NULL, NULL)) == NULL)
+    goto error;
+
+  if (!PEM_read_bio_CMS(bio, &self->cms, NULL, NULL))
+    lose_openssl_error("Couldn't load PEM encoded CMS message");
+
+  return (PyObject *) self;
+
+ error:
+  Py_XDECREF(self);
+  return NULL;
+}
+
+static PyObject *
+cms_object_der_read_helper(PyTypeObject *type, BIO *bio)
+{
+  cms_object *self;
+
+  ENTERING(cms_object_der_read_helper);
+
+  if ((self = (cms_object *) type->tp_new(type, NULL, NULL)) == NULL)
+    goto error;
+
+  if (!d2i_CMS_bio(bio, &self->cms))
+    lose_openssl_error("Couldn't load DER encoded CMS message");
+
+  return (PyObject *) self;
+
+ error:
+  Py_XDECREF(self);
+  return NULL;
+}
+
+static char cms_object_pem_read__doc__[] =
+  "Read a PEM-encoded CMS object from a string.\n"
+  ;
+
+static PyObject *
+cms_object_pem_read(PyTypeObject *type, PyObject *args)
+{
+  ENTERING(cms_object_pem_read);
+  return read_from_string_helper(cms_object_pem_read_helper, type, args);
+}
+
+static char cms_object_pem_read_file__doc__[] =
+  "Read a PEM-encoded CMS object from a file.\n"
+  ;
+
+static PyObject *
+cms_object_pem_read_file(PyTypeObject *type, PyObject *args)
+{
+  ENTERING(cms_object_pem_read_file);
+  return read_from_file_helper(cms_object_pem_read_helper, type, args);
+}
+
+static char cms_object_der_read__doc__[] =
+  "Read a DER-encoded CMS object from a string.\n"
+  ;
+
+static PyObject *
+cms_object_der_read(PyTypeObject *type, PyObject *args)
+{
+  ENTERING(cms_object_der_read);
+  return read_from_string_helper(cms_object_der_read_helper, type, args);
+}
+
+static char cms_object_der_read_file__doc__[] =
+  "Read a DER-encoded CMS object from a file.\n"
+  ;
+
+static PyObject *
+cms_object_der_read_file(PyTypeObject *type, PyObject *args)
+{
+  ENTERING(cms_object_der_read_file);
+  return read_from_file_helper(cms_object_der_read_helper, type, args);
+}
+
+static char cms_object_pem_write__doc__[] =
+  "Return the DER encoding of this CMS message.\n"
+  ;
+
+static PyObject *
+cms_object_pem_write(cms_object *self)
+{
+  PyObject *result = NULL;
+  BIO *bio = NULL;
+
+  ENTERING(cms_object_pem_write);
+
+  if ((bio = BIO_new(BIO_s_mem())) == NULL)
+    lose_no_memory();
+
+  if (!PEM_write_bio_CMS(bio, self->cms))
+    lose_openssl_error("Unable to write CMS object");
+
+  result = BIO_to_PyString_helper(bio);
+
+ error:                         /* Fall through */
+  BIO_free(bio);
+  return result;
+}
+
+static char cms_object_der_write__doc__[] =
+  "Return the DER encoding of this CMS message.\n"
+  ;
+
+static PyObject *
+cms_object_der_write(cms_object *self)
+{
+  PyObject *result = NULL;
+  BIO *bio = NULL;
+
+  ENTERING(cms_object_der_write);
+
+  if ((bio = BIO_new(BIO_s_mem())) == NULL)
+    lose_no_memory();
+
+  if (!i2d_CMS_bio(bio, self->cms))
+    lose_openssl_error("Unable to write CMS object");
+
+  result = BIO_to_PyString_helper(bio);
+
+ error:                         /* Fall through */
+  BIO_free(bio);
+  return result;
+}
+
+/*
+ * Guts of CMS signing, split out from cms_object_sign_helper() so
+ * that SigningPool worker threads can call it.  No Python API calls
+ * allowed here: on failure, we return NULL and leave the details on
+ * the OpenSSL error queue.
+ */
+
+static CMS_ContentInfo *
+cms_object_sign_core(BIO *bio,
+                     X509 *signcert,
+                     EVP_PKEY *signkey,
+                     STACK_OF(X509) *x509_stack,
+                     STACK_OF(X509_CRL) *crl_stack,
+                     ASN1_OBJECT *econtent_type,
+                     unsigned flags)
+{
+  CMS_ContentInfo *cms = NULL;
+  int i;
+
+  flags &= CMS_NOCERTS | CMS_NOATTR;
+  flags |= CMS_BINARY | CMS_NOSMIMECAP | CMS_PARTIAL | CMS_USE_KEYID;
+
+  if ((cms = CMS_sign(NULL, NULL, x509_stack, bio, flags)) == NULL)
+    goto error;
+
+  if (econtent_type)
+    CMS_set1_eContentType(cms, econtent_type);
+
+  if (!CMS_add1_signer(cms, signcert, signkey, EVP_sha256(), flags))
+    goto error;
+
+  for (i = 0; i < sk_X509_CRL_num(crl_stack); i++)
+    if (!CMS_add1_crl(cms, sk_X509_CRL_value(crl_stack, i)))
+      goto error;
+
+  if (!CMS_final(cms, bio, NULL, flags))
+    goto error;
+
+  return cms;
+
+ error:
+  CMS_ContentInfo_free(cms);
+  return NULL;
+}
+
+static int
+cms_object_sign_helper(cms_object *self,
+                       BIO *bio,
+                       x509_object *signcert,
+                       asymmetric_object *signkey,
+                       PyObject *x509_iterable,
+                       PyObject *crl_iterable,
+                       char *oid,
+                       unsigned flags)                       
+{
+  STACK_OF(X509) *x509_stack = NULL;
+  STACK_OF(X509_CRL) *crl_stack = NULL;
+  ASN1_OBJECT *econtent_type = NULL;
+  CMS_ContentInfo *cms = NULL;
+  int ok = 0;
+
+  ENTERING(cms_object_sign_helper);
+
+  assert_no_unhandled_openssl_errors();
+
+  if ((x509_stack = x509_helper_iterable_to_stack(x509_iterable)) == NULL)
+    goto error;
+
+  if ((crl_stack = crl_helper_iterable_to_stack(crl_iterable)) == NULL)
+    goto error;
+
+  assert_no_unhandled_openssl_errors();
+
+  if (oid && (econtent_type = OBJ_txt2obj(oid, 1)) == NULL)
+    lose_openssl_error("Couldn't parse OID");
+
+  assert_no_unhandled_openssl_errors();
+
+  if ((cms = cms_object_sign_core(bio, signcert->x509, signkey->pkey,
+                                  x509_stack, crl_stack, econtent_type, flags)) == NULL)
+    lose_openssl_error("Couldn't sign CMS message");
+
+  assert_no_unhandled_openssl_errors();
+
+  CMS_ContentInfo_free(self->cms);
+  self->cms = cms;
+  cms = NULL;
+
+  ok = 1;
+
+ error:                          /* fall through */
+  CMS_ContentInfo_free(cms);
+  sk_X509_free(x509_stack);
+  sk_X509_CRL_free(crl_stack);
+  ASN1_OBJECT_free(econtent_type);
+
+  return ok;
+}
+
+static char cms_object_sign__doc__[] =
+  "Sign this CMS message message with a private key.\n"
+  "\n"
+  "The \"signcert\" parameter should be the certificate against which the\n"
+  "message will eventually be verified, an X509 object.\n"
+  "\n"
+  "The \"key\" parameter should be the private key with which to sign the\n"
+  "message, an Asymmetric object.\n"
+  "\n"
+  "The \"data\" parameter should be the message to be signed, a string.\n"
+  "\n"
+  "The optional \"certs\" parameter should be an iterable supplying X509 objects\n"
+  "to be included in the signed message.\n"
+  "\n"
+  "The optional \"crls\" parameter should be an iterable supplying CRL objects\n"
+  "to be included in the signed message.\n"
+  "\n"
+  "The optional \"eContentType\" parameter should be an Object Identifier\n"
+  "to use as the eContentType value in the signed message.\n"
+  "\n"
+  "The optional \"flags\" parameters should be an integer holding a bitmask,\n"
+  "and can include the following flags:\n"
+  "\n"
+  "  * CMS_NOCERTS\n"
+  "  * CMS_NOATTR\n"
+  ;
+
+static PyObject *
+cms_object_sign(cms_object *self, PyObject *args)
+{
+  asymmetric_object *signkey = NULL;
+  x509_object *signcert = NULL;
+  PyObject *x509_iterable = Py_None;
+  PyObject *crl_iterable = Py_None;
+  char *buf = NULL, *oid = NULL;
+  Py_ssize_t len;
+  unsigned flags = 0;
+  BIO *bio = NULL;
+  int ok = 0;
+
+  ENTERING(cms_object_sign);
+
+  if (!PyArg_ParseTuple(args, "O!O!s#|OOsI",
+                        &POW_X509_Type, &signcert,
+                        &POW_Asymmetric_Type, &signkey,
+                        &buf, &len,
+                        &x509_iterable,
+                        &crl_iterable,
+                        &oid,
+                        &flags))
+    goto error;
+
+  assert_no_unhandled_openssl_errors();
+
+  if ((bio = BIO_new_mem_buf(buf, len)) == NULL)
+    lose_no_memory();
+
+  assert_no_unhandled_openssl_errors();
+
+  if (!cms_object_sign_helper(self, bio, signcert, signkey,
+                              x509_iterable, crl_iterable, oid, flags))
+    lose_openssl_error("Couldn't sign CMS object");
+
+  assert_no_unhandled_openssl_errors();
+
+  ok = 1;
+
+ error:
+  BIO_free(bio);
+
+  if (ok)
+    Py_RETURN_NONE;
+  else
+    return NULL;
+}
+
+/*
+ * Return the eContent embedded in a CMS message.  This is a pointer
+ * into the CMS structure, not a copy, so it's only good until the
+ * next time something replaces self->cms.
+ *
+ * Nothing here needs CMS_verify() to copy the content out for us:
+ * without an output BIO it digests the embedded OCTET STRING in
+ * place, and if we're not verifying at all there's nothing to digest.
+ */
+
+static ASN1_OCTET_STRING *
+cms_object_extract_without_verifying_helper(cms_object *self)
+{
+  ASN1_OCTET_STRING **pos;
+
+  ENTERING(cms_object_extract_without_verifying_helper);
+
+  if ((pos = CMS_get0_content(self->cms)) == NULL || *pos == NULL)
+    lose("Couldn't parse CMS message");
+
+  return *pos;
+
+ error:
+  return NULL;
+}
+
+
+#define CMS_OBJECT_VERIFY_HELPER__DOC__                                         \
+  "\n"                                                                          \
+  "The optional \"certs\" parameter is a set of certificates to search\n"       \
+  "for the signer's certificate.\n"                                             \
+  "\n"                                                                          \
+  "The optional \"flags\" parameter is an integer of bit flags,\n"              \
+  "containing zero or more of the following:\n"                                 \
+  "\n"                                                                          \
+  "  * CMS_NOINTERN\n"                                                          \
+  "  * CMS_NOCRL\n"                                                             \
+  "  * CMS_NO_SIGNER_CERT_VERIFY\n"                                             \
+  "  * CMS_NO_ATTR_VERIFY\n"                                                    \
+  "  * CMS_NO_CONTENT_VERIFY\n"                                                 \
+  "\n"                                                                          \
+  "Note that this method does NOT verify X.509 certificates, it just\n"         \
+  "verifies the CMS signature.  Use certificate verification functions\n"       \
+  "to verify certificates."
+
+#warning Should we really allow the full range of flags here, or constrain to just the useful cases?
 
-  self->ctx = NULL;
-  self->store = NULL;
-  return (PyObject *) self;    
+static ASN1_OCTET_STRING *
+cms_object_verify_helper(cms_object *self, PyObject *args, PyObject *kwds)
+{
+  static char *kwlist[] = {"certs", "flags", NULL};
+  PyObject *certs_iterable = Py_None;
+  STACK_OF(X509) *certs_stack = NULL;
+  unsigned flags = 0, ok = 0;
 
- error:
-  Py_XDECREF(self);
-  return NULL;
-}
+  const unsigned flag_mask =
+    CMS_NOINTERN | CMS_NOCRL | CMS_NO_SIGNER_CERT_VERIFY |
+    CMS_NO_ATTR_VERIFY | CMS_NO_CONTENT_VERIFY;
 
-static int
-x509_store_ctx_object_init(x509_store_ctx_object *self, PyObject *args, GCC_UNUSED PyObject *kwds)
-{
-  ENTERING(x509_store_ctx_object_init);
+  ENTERING(cms_object_verify_helper);
 
-  if ((self->store = X509_STORE_new()) == NULL ||
-      (self->ctx = X509_STORE_CTX_new()) == NULL)
-    lose_no_memory();
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|OI", kwlist, &certs_iterable, &flags))
+    goto error;
 
-  if (!X509_STORE_CTX_init(self->ctx, self->store, NULL, NULL))
-    lose_openssl_error("Couldn't initialize X509_STORE_CTX");
+  if ((flags & ~flag_mask) != 0)
+    lose_value_error("Bad CMS_verify() flags");
 
-  if (!X509_STORE_CTX_set_ex_data(self->ctx, x509_store_ctx_ex_data_idx, self))
-    lose_openssl_error("Couldn't set X509_STORE_CTX ex_data");
+  flags |= CMS_NO_SIGNER_CERT_VERIFY;
 
-  X509_VERIFY_PARAM_set_flags(self->ctx->param, X509_V_FLAG_X509_STRICT);
-  return 0;
+  assert_no_unhandled_openssl_errors();
 
- error:
-  return -1;
-}
+  if (certs_iterable != Py_None &&
+      (certs_stack = x509_helper_iterable_to_stack(certs_iterable)) == NULL)
+    goto error;
 
-static void
-x509_store_ctx_object_dealloc(x509_store_ctx_object *self)
-{
-  ENTERING(x509_store_ctx_object_dealloc);
-  X509_STORE_CTX_free(self->ctx);
-  X509_STORE_free(self->store);
-  self->ob_type->tp_free((PyObject*) self);
-}
+  assert_no_unhandled_openssl_errors();
 
-static char x509_store_ctx_object_get_error__doc__[] =
-  "Extract verification error code from this X509StoreCTX.\n"
-  ;
+  if (CMS_verify(self->cms, certs_stack, NULL, NULL, NULL, flags) <= 0)
+    lose_openssl_error("Couldn't verify CMS message");
 
-static PyObject*
-x509_store_ctx_object_get_error (x509_store_ctx_object *self)
-{
-  return Py_BuildValue("i", X509_STORE_CTX_get_error(self->ctx));
-}
+  assert_no_unhandled_openssl_errors();
 
-static char x509_store_ctx_object_get_error_string__doc__[] =
-  "Extract verification error string from this X509StoreCTX.\n"
-  ;
+  ok = 1;
 
-static PyObject*
-x509_store_ctx_object_get_error_string (x509_store_ctx_object *self)
-{
-  return Py_BuildValue("s", X509_verify_cert_error_string(X509_STORE_CTX_get_error(self->ctx)));
-}
+ error:                          /* fall through */
+  sk_X509_free(certs_stack);
 
-static char x509_store_ctx_object_get_error_depth__doc__[] =
-  "Extract verification error depth from this X509StoreCTX.\n"
-  ;
+  if (ok)
+    return cms_object_extract_without_verifying_helper(self);
 
-static PyObject*
-x509_store_ctx_object_get_error_depth (x509_store_ctx_object *self)
-{
-  return Py_BuildValue("i", X509_STORE_CTX_get_error_depth(self->ctx));
+  return NULL;
 }
 
-static char x509_store_ctx_object_get_current_certificate__doc__[] =
-  "Extract the certificate which caused the current validation error,\n"
-  "or None if no certificate is relevant.\n"
+static char cms_object_verify__doc__[] =
+  "Verify this CMS message against a trusted certificate store.\n"
+  "\n"
+  CMS_OBJECT_VERIFY_HELPER__DOC__
+  "\n"
+  "Return value is the decoded CMS content, as a Python string.\n"
   ;
 
 static PyObject *
-x509_store_ctx_object_get_current_certificate (x509_store_ctx_object *self)
+cms_object_verify(cms_object *self, PyObject *args, PyObject *kwds)
 {
-  X509 *x = X509_STORE_CTX_get_current_cert(self->ctx);
-  x509_object *obj = NULL;
-
-  if (x == NULL)
-    Py_RETURN_NONE;
-
-  if ((x = X509_dup(x)) == NULL)
-    lose_no_memory();
+  ASN1_OCTET_STRING *econtent;
 
-  if ((obj = x509_object_new_helper(NULL, x)) == NULL)
-    goto error;
+  ENTERING(cms_object_verify);
 
-  return (PyObject *) obj;
+  if ((econtent = cms_object_verify_helper(self, args, kwds)) == NULL)
+    return NULL;
 
- error:
-  Py_XDECREF(obj);
-  X509_free(x);
-  return NULL;
+  return PyString_FromStringAndSize((char *) econtent->data, econtent->length);
 }
 
-static char x509_store_ctx_object_get_chain__doc__[] =
-  "Extract certificate chain from X509StoreCTX.  If validation\n"
-  "completed succesfully, this is the complete validation chain;\n"
-  "otherwise, the returned chain may be invalid or incomplete.\n"
+static char cms_object_extract_without_verifying__doc__[] =
+  "Extract content from a CMS object without attempting CMS verification.\n"
+  "\n"
+  "NEVER USE THIS METHOD ON AN UNVERIFIED CMS OBJECT!\n"
   ;
 
 static PyObject *
-x509_store_ctx_object_get_chain (x509_store_ctx_object *self)
+cms_object_extract_without_verifying(cms_object *self)
 {
-  STACK_OF(X509) *chain = NULL;
-  PyObject *result = NULL;
-
-  if ((chain = X509_STORE_CTX_get1_chain(self->ctx)) == NULL)
-    lose_openssl_error("X509_STORE_CTX_get1_chain() failed");
-  
-  result = stack_to_tuple_helper(CHECKED_PTR_OF(STACK_OF(X509), chain),
-                                 stack_to_tuple_helper_get_x509);
+  ASN1_OCTET_STRING *econtent;
 
- error:                         /* fall through */
-  sk_X509_pop_free(chain, X509_free);
-  return result;
-}
+  ENTERING(cms_object_extract_without_verifying);
 
-/*
- * See (omnibus) man page for X509_STORE_CTX_get_error() for other
- * query methods we might want to expose.  Someday we might want to
- * support X509_V_FLAG_USE_CHECK_TIME too.
- */
+  if ((econtent = cms_object_extract_without_verifying_helper(self)) == NULL)
+    return NULL;
 
-static struct PyMethodDef x509_store_ctx_object_methods[] = {
-  Define_Method(getError,               x509_store_ctx_object_get_error,                METH_NOARGS),
-  Define_Method(getErrorString,         x509_store_ctx_object_get_error_string,         METH_NOARGS),
-  Define_Method(getErrorDepth,          x509_store_ctx_object_get_error_depth,          METH_NOARGS),
-  Define_Method(getCurrentCertificate,  x509_store_ctx_object_get_current_certificate,  METH_NOARGS),
-  Define_Method(getChain,               x509_store_ctx_object_get_chain,                METH_NOARGS),
- {NULL}
-};
+  return PyString_FromStringAndSize((char *) econtent->data, econtent->length);
+}
 
-static char POW_X509StoreCTX_Type__doc__[] =
-  "This class holds the state of an OpenSSL certificate verification\n"
-  "operation.  Ordinarily, the user will never have cause to instantiate\n"
-  "this class directly, instead, an object of this class will be returned\n"
-  "by X509.verify().\n"
-  "\n"
-  "If you need to see OpenSSL's verification callbacks, you can do so\n"
-  "by subclassing X509StoreCTX and passing your subclass as an argument\n"
-  "to X509.verify.  Your subclass should provide a .verify_callback()\n"
-  "method, which should expect to receive one argument: the integer \"ok\"\n"
-  "value passed by OpenSSL's verification callbacks.\n"
-  "\n"
-  "The return value from your .verify_callback() method will be is interpreted\n"
-  "as a boolean value: anything which evaluates to True will be result in a\n"
-  "return value of 1 to OpenSSL, while anything which evaluates to False will\n"
-  "result in a return value of 0 to OpenSSL.\n"
+static char cms_object_check_rpki_conformance__doc__[] =
+  "Check this CMS message for conformance to the RPKI profile.\n"
   ;
 
-static PyTypeObject POW_X509StoreCTX_Type = {
-  PyObject_HEAD_INIT(0)
-  0,                                        /* ob_size */
-  "rpki.POW.X509StoreCTX",                  /* tp_name */
-  sizeof(x509_store_ctx_object),            /* tp_basicsize */
-  0,                                        /* tp_itemsize */
-  (destructor)x509_store_ctx_object_dealloc,/* tp_dealloc */
-  0,                                        /* tp_print */
-  0,                                        /* tp_getattr */
-  0,                                        /* tp_setattr */
-  0,                                        /* tp_compare */
-  0,                                        /* tp_repr */
-  0,                                        /* tp_as_number */
-  0,                                        /* tp_as_sequence */
-  0,                                        /* tp_as_mapping */
-  0,                                        /* tp_hash */
-  0,                                        /* tp_call */
-  0,                                        /* tp_str */
-  0,                                        /* tp_getattro */
-  0,                                        /* tp_setattro */
-  0,                                        /* tp_as_buffer */
-  Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, /* tp_flags */
-  POW_X509StoreCTX_Type__doc__,             /* tp_doc */
-  0,                                        /* tp_traverse */
-  0,                                        /* tp_clear */
-  0,                                        /* tp_richcompare */
-  0,                                        /* tp_weaklistoffset */
-  0,                                        /* tp_iter */
-  0,                                        /* tp_iternext */
-  x509_store_ctx_object_methods,            /* tp_methods */
-  0,                                        /* tp_members */
-  0,                                        /* tp_getset */
-  0,                                        /* tp_base */
-  0,                                        /* tp_dict */
-  0,                                        /* tp_descr_get */
-  0,                                        /* tp_descr_set */
-  0,                                        /* tp_dictoffset */
-  (initproc) x509_store_ctx_object_init,    /* tp_init */
-  0,                                        /* tp_alloc */
-  x509_store_ctx_object_new,                /* tp_new */
-};
-
-
+static PyObject *
+cms_object_check_rpki_conformance(cms_object *self, PyObject *args, PyObject *kwds)
+{
+  static char *kwlist[] = {"status", NULL};
+  PyObject *status = Py_None;
 
-/*
- * CRL object.
- */
+  ENTERING(cms_object_check_rpki_conformance);
 
-static crl_object *
-crl_object_new_helper(PyTypeObject *type, X509_CRL *crl)
-{
-  crl_object *self = NULL;
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!", kwlist, &PySet_Type, &status))
+    goto error;
 
-  if (type == NULL)
-    type = &POW_CRL_Type;
+  if (!check_cms(self->cms, status))
+    goto error;
 
-  if ((self = (crl_object *) type->tp_alloc(type, 0)) == NULL)
-    return NULL;
+  Py_RETURN_NONE;
 
-  self->crl = crl;
-  return self;
+ error:
+  return NULL;
 }
 
+static char cms_object_eContentType__doc__[] =
+  "Return the eContentType OID of this CMS message.\n"
+  ;
+
 static PyObject *
-crl_object_new(PyTypeObject *type, GCC_UNUSED PyObject *args, GCC_UNUSED PyObject *kwds)
+cms_object_eContentType(cms_object *self)
 {
-  crl_object *self = NULL;
-  X509_CRL *crl = NULL;
+  const ASN1_OBJECT *oid = NULL;
+  PyObject *result = NULL;
 
-  ENTERING(crl_object_new);
+  ENTERING(cms_object_eContentType);
 
-  if ((crl = X509_CRL_new()) == NULL)
-    lose_no_memory();
+  if ((oid = CMS_get0_eContentType(self->cms)) == NULL)
+    lose_openssl_error("Couldn't extract eContentType from CMS message");
 
-  if ((self = crl_object_new_helper(type, crl)) == NULL)
-    goto error;
+  assert_no_unhandled_openssl_errors();
 
-  return (PyObject *) self;
+  result = ASN1_OBJECT_to_PyString(oid);
 
  error:
-  X509_CRL_free(crl);
-  return NULL;
+  return result;
 }
 
-static void
-crl_object_dealloc(crl_object *self)
-{
-  ENTERING(crl_object_dealloc);
-  X509_CRL_free(self->crl);
-  self->ob_type->tp_free((PyObject*) self);
-}
+static char cms_object_signingTime__doc__[] =
+  "Return the signingTime of this CMS message.\n"
+  ;
 
 static PyObject *
-crl_object_pem_read_helper(PyTypeObject *type, BIO *bio)
+cms_object_signingTime(cms_object *self)
 {
-  crl_object *self;
+  PyObject *result = NULL;
+  STACK_OF(CMS_SignerInfo) *sis = NULL;
+  CMS_SignerInfo *si = NULL;
+  X509_ATTRIBUTE *xa = NULL;
+  ASN1_TYPE *so = NULL;
+  int i;
 
-  ENTERING(crl_object_pem_read_helper);
+  ENTERING(cms_object_signingTime);
 
-  if ((self = (crl_object *) crl_object_new(type, NULL, NULL)) == NULL)
-    goto error;
+  if ((sis = CMS_get0_SignerInfos(self->cms)) == NULL)
+    lose_openssl_error("Couldn't extract signerInfos from CMS message[1]");
 
-  if (!PEM_read_bio_X509_CRL(bio, &self->crl, NULL, NULL))
-    lose_openssl_error("Couldn't PEM encoded load CRL");
+  if (sk_CMS_SignerInfo_num(sis) != 1)
+    lose_openssl_error("Couldn't extract signerInfos from CMS message[2]");
 
-  return (PyObject *) self;
+  si = sk_CMS_SignerInfo_value(sis, 0);
 
- error:
-  Py_XDECREF(self);
-  return NULL;
-}
+  if ((i = CMS_signed_get_attr_by_NID(si, NID_pkcs9_signingTime, -1)) < 0)
+    lose_openssl_error("Couldn't extract signerInfos from CMS message[3]");
 
-static PyObject *
-crl_object_der_read_helper(PyTypeObject *type, BIO *bio)
-{
-  crl_object *self;
+  if ((xa = CMS_signed_get_attr(si, i)) == NULL)
+    lose_openssl_error("Couldn't extract signerInfos from CMS message[4]");
 
-  ENTERING(crl_object_der_read_helper);
+  if (xa->single)
+    lose("Couldn't extract signerInfos from CMS message[5]");
 
-  if ((self = (crl_object *) crl_object_new(type, NULL, NULL)) == NULL)
-    goto error;
+  if (X509_ATTRIBUTE_count(xa) != 1)
+    lose("Couldn't extract signerInfos from CMS message[6]");
 
-  if (!d2i_X509_CRL_bio(bio, &self->crl))
-    lose_openssl_error("Couldn't load DER encoded CRL");
+  if ((so = X509_ATTRIBUTE_get0_type(xa, 0)) == NULL)
+    lose("Couldn't extract signerInfos from CMS message[7]");
 
-  return (PyObject *) self;
+  switch (so->type) {
+  case V_ASN1_UTCTIME:
+    result = ASN1_TIME_to_Python(so->value.utctime);
+    break;
+  case V_ASN1_GENERALIZEDTIME:
+    result = ASN1_TIME_to_Python(so->value.generalizedtime);
+    break;
+  default:
+    lose("Couldn't extract signerInfos from CMS message[8]");
+  }
 
  error:
-  Py_XDECREF(self);
-  return NULL;
+  return result;
 }
 
-static char crl_object_pem_read__doc__[] =
-  "Read a PEM-encoded CRL object from a string.\n"
+static char cms_object_pprint__doc__[] =
+  "Return a pretty-printed representation of this CMS message.\n"
   ;
 
 static PyObject *
-crl_object_pem_read(PyTypeObject *type, PyObject *args)
+cms_object_pprint(cms_object *self)
 {
-  ENTERING(crl_object_pem_read);
-  return read_from_string_helper(crl_object_pem_read_helper, type, args);
-}
+  BIO *bio = NULL;
+  PyObject *result = NULL;
 
-static char crl_object_pem_read_file__doc__[] =
-  "Read a PEM-encoded CRL object from a file.\n"
-  ;
+  ENTERING(cms_object_pprint);
 
-static PyObject *
-crl_object_pem_read_file(PyTypeObject *type, PyObject *args)
-{
-  ENTERING(crl_object_pem_read_file);
-  return read_from_file_helper(crl_object_pem_read_helper, type, args);
-}
+  if ((bio = BIO_new(BIO_s_mem())) == NULL)
+    lose_no_memory();
 
-static char crl_object_der_read__doc__[] =
-  "Read a DER-encoded CRL object from a string.\n"
-  ;
+  if (!CMS_ContentInfo_print_ctx(bio, self->cms, 0, NULL))
+    lose_openssl_error("Unable to pretty-print CMS object");
 
-static PyObject *
-crl_object_der_read(PyTypeObject *type, PyObject *args)
-{
-  ENTERING(crl_object_der_read);
-  return read_from_string_helper(crl_object_der_read_helper, type, args);
+  result = BIO_to_PyString_helper(bio);
+
+ error:
+  BIO_free(bio);
+  return result;
 }
 
-static char crl_object_der_read_file__doc__[] =
-  "Read a DER-encoded CRL object from a file.\n"
+static char cms_object_certs__doc__[] =
+  "Return any certificates embedded in this CMS message, as a sequence\n"
+  "of X509 objects.   This sequence will be empty if the message wrapper\n"
+  "contains no certificates.\n"
   ;
 
+/*
+ * Might want to accept an optional subclass argument.
+ */
+
 static PyObject *
-crl_object_der_read_file(PyTypeObject *type, PyObject *args)
+cms_object_certs(cms_object *self)
 {
-  ENTERING(crl_object_der_read_file);
-  return read_from_file_helper(crl_object_der_read_helper, type, args);
-}
+  STACK_OF(X509) *certs = NULL;
+  PyObject *result = NULL;
 
-static X509_EXTENSION *
-crl_object_extension_get_helper(crl_object *self, int nid)
-{
-  if (self != NULL && self->crl != NULL)
-    return X509_CRL_get_ext(self->crl, X509_CRL_get_ext_by_NID(self->crl, nid, -1));
+  ENTERING(cms_object_certs);
+
+  if ((certs = CMS_get1_certs(self->cms)) != NULL)
+    result = stack_to_tuple_helper(CHECKED_PTR_OF(STACK_OF(X509), certs),
+                                   stack_to_tuple_helper_get_x509);
+  else if (!ERR_peek_error())
+    result = Py_BuildValue("()");
   else
-    return NULL;
+    lose_openssl_error("Couldn't extract certs from CMS message");
+
+ error:                          /* fall through */
+  sk_X509_pop_free(certs, X509_free);
+  return result;
 }
 
-static PyObject *
-crl_object_extension_set_helper(crl_object *self, extension_wrapper ext)
-{
-  int ok = 0;
+static char cms_object_crls__doc__[] =
+  "Return any CRLs embedded in this CMS message, as a sequence of CRL objects.\n"
+  "This sequence will be empty if the message contains no CRLs.\n"
+  ;
 
-  if (ext.value == NULL)
-    goto error;
+/*
+ * Might want to accept an optional subclass argument.
+ */
 
-  if (!X509_CRL_add1_ext_i2d(self->crl, ext.nid, ext.value, ext.critical, X509V3_ADD_REPLACE))
-    lose_openssl_error("Couldn't add extension to CRL");
+static PyObject *
+cms_object_crls(cms_object *self)
+{
+  STACK_OF(X509_CRL) *crls = NULL;
+  PyObject *result = NULL;
 
-  ok = 1;
+  ENTERING(cms_object_crls);
 
- error:
-  ext.destructor(ext.value);
-  if (ok)
-    Py_RETURN_NONE;
+  if ((crls = CMS_get1_crls(self->cms)) != NULL)
+    result = stack_to_tuple_helper(CHECKED_PTR_OF(STACK_OF(X509_CRL), crls),
+                                   stack_to_tuple_helper_get_crl);
+  else if (!ERR_peek_error())
+    result = Py_BuildValue("()");
   else
-    return NULL;
-}
+    lose_openssl_error("Couldn't extract CRLs from CMS message");
 
+ error:                          /* fall through */
+  sk_X509_CRL_pop_free(crls, X509_CRL_free);
+  return result;
+}
 
+static struct PyMethodDef cms_object_methods[] = {
+  Define_Method(pemWrite,                       cms_object_pem_write,                   METH_NOARGS),
+  Define_Method(derWrite,                       cms_object_der_write,                   METH_NOARGS),
+  Define_Method(sign,                           cms_object_sign,                        METH_VARARGS),
+  Define_Method(verify,                         cms_object_verify,                      METH_KEYWORDS),
+  Define_Method(extractWithoutVerifying,        cms_object_extract_without_verifying,   METH_NOARGS),
+  Define_Method(checkRPKIConformance,           cms_object_check_rpki_conformance,      METH_KEYWORDS),
+  Define_Method(eContentType,                   cms_object_eContentType,                METH_NOARGS),
+  Define_Method(signingTime,                    cms_object_signingTime,                 METH_NOARGS),
+  Define_Method(pprint,                         cms_object_pprint,                      METH_NOARGS),
+  Define_Method(certs,                          cms_object_certs,                       METH_NOARGS),
+  Define_Method(crls,                           cms_object_crls,                        METH_NOARGS),
+  Define_Class_Method(pemRead,                  cms_object_pem_read,                    METH_VARARGS),
+  Define_Class_Method(pemReadFile,              cms_object_pem_read_file,               METH_VARARGS),
+  Define_Class_Method(derRead,                  cms_object_der_read,                    METH_VARARGS),
+  Define_Class_Method(derReadFile,              cms_object_der_read_file,               METH_VARARGS),
+  {NULL}
+};
 
-static char crl_object_get_version__doc__[] =
-  "Return the version number of this CRL.\n"
+static char POW_CMS_Type__doc__[] =
+  "Wrapper for OpenSSL's CMS class.  At present this only handes signed\n"
+  "objects, as those are the only kind of CMS objects used in RPKI.\n"
   ;
 
-static PyObject *
-crl_object_get_version(crl_object *self)
-{
-  ENTERING(crl_object_get_version);
-  return Py_BuildValue("l", X509_CRL_get_version(self->crl));
-}
+static PyTypeObject POW_CMS_Type = {
+  PyObject_HEAD_INIT(0)
+  0,                                  /* ob_size */
+  "rpki.POW.CMS",                     /* tp_name */
+  sizeof(cms_object),                 /* tp_basicsize */
+  0,                                  /* tp_itemsize */
+  (destructor)cms_object_dealloc,     /* tp_dealloc */
+  0,                                  /* tp_print */
+  0,                                  /* tp_getattr */
+  0,                                  /* tp_setattr */
+  0,                                  /* tp_compare */
+  0,                                  /* tp_repr */
+  0,                                  /* tp_as_number */
+  0,                                  /* tp_as_sequence */
+  0,                                  /* tp_as_mapping */
+  0,                                  /* tp_hash */
+  0,                                  /* tp_call */
+  0,                                  /* tp_str */
+  0,                                  /* tp_getattro */
+  0,                                  /* tp_setattro */
+  0,                                  /* tp_as_buffer */
+  Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, /* tp_flags */
+  POW_CMS_Type__doc__,                /* tp_doc */
+  0,                                  /* tp_traverse */
+  0,                                  /* tp_clear */
+  0,                                  /* tp_richcompare */
+  0,                                  /* tp_weaklistoffset */
+  0,                                  /* tp_iter */
+  0,                                  /* tp_iternext */
+  cms_object_methods,                 /* tp_methods */
+  0,                                  /* tp_members */
+  0,                                  /* tp_getset */
+  0,                                  /* tp_base */
+  0,                                  /* tp_dict */
+  0,                                  /* tp_descr_get */
+  0,                                  /* tp_descr_set */
+  0,                                  /* tp_dictoffset */
+  0,                                  /* tp_init */
+  0,                                  /* tp_alloc */
+  cms_object_new,                     /* tp_new */
+};
+
+
 
-static char crl_object_set_version__doc__[] =
-  "Set the version number of this CRL.\n"
-  "\n"
-  "The \"version\" parameter should be a positive integer.\n"
-  ;
+/*
+ * Manifest object.
+ */
 
 static PyObject *
-crl_object_set_version(crl_object *self, PyObject *args)
+manifest_object_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
 {
-  long version = 0;
-
-  ENTERING(crl_object_set_version);
-
-  if (!PyArg_ParseTuple(args, "i", &version))
-    goto error;
+  manifest_object *self = NULL;
 
-  if (!X509_CRL_set_version(self->crl, version))
-    lose_no_memory();
+  ENTERING(manifest_object_new);
 
-  Py_RETURN_NONE;
+  if ((self = (manifest_object *) cms_object_new(type, args, kwds)) != NULL &&
+      (self->manifest = Manifest_new()) != NULL)
+    return (PyObject *) self;
 
- error:
+  Py_XDECREF(self);
   return NULL;
 }
 
-static char crl_object_get_issuer__doc__[] =
-  "Return issuer name of this CRL.\n"
-  "\n"
-  "See the \"getIssuer()\" method of the X509 class for more details.\n"
-  ;
-
-static PyObject *
-crl_object_get_issuer(crl_object *self, PyObject *args)
+static void
+manifest_object_dealloc(manifest_object *self)
 {
-  PyObject *result = NULL;
-  int format = OIDNAME_FORMAT;
+  ENTERING(manifest_object_dealloc);
+  Manifest_free(self->manifest);
+  OPENSSL_free(self->econtent);
+  cms_object_dealloc(&self->cms);
+}
 
-  ENTERING(crl_object_get_issuer);
+/*
+ * Take ownership of a DER-encoded eContent buffer (allocated with
+ * OPENSSL_malloc()), replacing any DER this object held before.  The
+ * buffer is freed on failure.  Caller is responsible for making sure
+ * the ASN.1 structure, if any, matches.
+ */
 
-  if (!PyArg_ParseTuple(args, "|i", &format))
-    goto error;
+static int
+manifest_object_set_econtent(manifest_object *self, unsigned char *der, size_t len)
+{
+  manifest_view_t view;
 
-  result = x509_object_helper_get_name(X509_CRL_get_issuer(self->crl), format);
+  if (!manifest_view_parse(&view, der, len)) {
+    OPENSSL_free(der);
+    lose("Couldn't decode manifest");
+  }
 
- error:                         /* Fall through */
-  return result;
+  OPENSSL_free(self->econtent);
+  self->econtent = der;
+  self->econtent_len = len;
+  self->view = view;
+  return 1;
+
+ error:
+  return 0;
 }
 
-static char crl_object_set_issuer__doc__[] =
-  "Set this CRL's issuer name.\n"
-  "\n"
-  "See the \"setIssuer()\" method of the X509 class for details.\n"
-  ;
+/*
+ * Replace this object's contents with a copy of a CMS eContent.
+ * We check the structure here, but put off building the ASN.1
+ * structure until something asks for it.
+ */
 
-static PyObject *
-crl_object_set_issuer(crl_object *self, PyObject *args)
+static int
+manifest_object_read_econtent(manifest_object *self, const ASN1_OCTET_STRING *econtent)
 {
-  PyObject *name_sequence = NULL;
-  X509_NAME *name = NULL;
-
-  ENTERING(crl_object_set_issuer);
+  unsigned char *der = NULL;
+  size_t len = econtent->length;
 
-  if (!PyArg_ParseTuple(args, "O", &name_sequence))
-    goto error;
+  if ((der = OPENSSL_malloc(len > 0 ? len : 1)) == NULL)
+    lose_no_memory();
 
-  if (!PySequence_Check(name_sequence))
-    lose_type_error("Expected a sequence object");
+  memcpy(der, econtent->data, len);
 
-  if ((name = x509_object_helper_set_name(name_sequence)) == NULL)
+  if (!manifest_object_set_econtent(self, der, len))
     goto error;
 
-  if (!X509_CRL_set_issuer_name(self->crl, name))
-    lose_openssl_error("Unable to set issuer name");
-
-  X509_NAME_free(name);
-
-  Py_RETURN_NONE;
+  Manifest_free(self->manifest);
+  self->manifest = NULL;
+  return 1;
 
  error:
-  X509_NAME_free(name);
-  return NULL;
+  return 0;
 }
 
-static char crl_object_get_issuer_hash__doc__[] =
-  "Return the OpenSSL \"name hash\" for this CRL's issuer name.\n"
-  ;
+/*
+ * Make sure the ASN.1 structure is current, for methods which read or
+ * modify it.  After this returns, the object no longer holds DER, so
+ * any changes the caller makes are safe.
+ */
 
-static PyObject *
-crl_object_get_issuer_hash(crl_object *self)
+static int
+manifest_object_decode(manifest_object *self)
 {
-  ENTERING(crl_object_get_issuer_hash);
-  return Py_BuildValue("k", X509_NAME_hash(X509_CRL_get_issuer(self->crl)));
+  const unsigned char *p = self->econtent;
+  Manifest *manifest;
+
+  if (self->econtent == NULL)
+    return 1;
+
+  if (self->manifest == NULL) {
+    if ((manifest = (Manifest *) ASN1_item_d2i(NULL, &p, self->econtent_len, ASN1_ITEM_rptr(Manifest))) == NULL)
+      lose_openssl_error("Couldn't decode manifest");
+    self->manifest = manifest;
+  }
+
+  OPENSSL_free(self->econtent);
+  self->econtent = NULL;
+  self->econtent_len = 0;
+  return 1;
+
+ error:
+  return 0;
 }
 
 /*
- * NB: OpenSSL is confused about the name of this field, probably for
- * backwards compatability with some ancient mistake.  What RFC 5280
- * calls "thisUpdate", OpenSSL calls "lastUpdate".
+ * Make sure the DER is current, for methods which read it through the
+ * view.  This is a no-op for objects we got from .verify(); objects
+ * built or modified locally get encoded here.
  */
 
-static char crl_object_set_this_update__doc__[] =
-  "Set this CRL's \"thisUpdate\" value.\n"
-  "\n"
-  "The \"time\" parameter should be a datetime object.\n"
-  ;
-
-static PyObject *
-crl_object_set_this_update (crl_object *self, PyObject *args)
+static int
+manifest_object_encode(manifest_object *self)
 {
-  PyObject *o = NULL;
-  ASN1_TIME *t = NULL;
-
-  ENTERING(crl_object_set_this_update);
+  unsigned char *der = NULL;
+  int len;
 
-  if (!PyArg_ParseTuple(args, "O", &o))
-    goto error;
+  if (self->econtent != NULL)
+    return 1;
 
-  if ((t = Python_to_ASN1_TIME(o, 1)) == NULL)
-    lose("Couldn't convert thisUpdate string");
+  if (self->manifest == NULL)
+    return 1;
 
-  if (!X509_CRL_set_lastUpdate(self->crl, t)) /* sic */
-    lose("Couldn't set thisUpdate");
+  if ((len = ASN1_item_i2d((ASN1_VALUE *) self->manifest, &der, ASN1_ITEM_rptr(Manifest))) <= 0)
+    lose_openssl_error("Couldn't encode manifest");
 
-  ASN1_TIME_free(t);
-  Py_RETURN_NONE;
+  return manifest_object_set_econtent(self, der, len);
 
  error:
-  ASN1_TIME_free(t);
-  return NULL;
+  return 0;
 }
 
-static char crl_object_get_this_update__doc__[] =
-  "Return this CRL's \"thisUpdate\" value as a datetime.\n"
-  ;
+/*
+ * Write this object's eContent to a BIO for signing, using the DER we
+ * already have if we have it.
+ */
 
-static PyObject *
-crl_object_get_this_update (crl_object *self)
+static int
+manifest_object_write_econtent(manifest_object *self, BIO *bio)
 {
-  ENTERING(crl_object_get_this_update);
-  return ASN1_TIME_to_Python(X509_CRL_get_lastUpdate(self->crl)); /* sic */
+  if (self->econtent != NULL)
+    return BIO_write(bio, self->econtent, self->econtent_len) == (int) self->econtent_len;
+  else
+    return ASN1_item_i2d_bio(ASN1_ITEM_rptr(Manifest), bio, self->manifest);
 }
 
-static char crl_object_set_next_update__doc__[] =
-  "Set this CRL's \"nextUpdate\" value.\n"
+static char manifest_object_verify__doc__[] =
+  "Verify this manifest against a trusted certificate store.\n"
   "\n"
-  "The \"time\" parameter should be a datetime object.\n"
+  CMS_OBJECT_VERIFY_HELPER__DOC__
   ;
 
 static PyObject *
-crl_object_set_next_update (crl_object *self, PyObject *args)
+manifest_object_verify(manifest_object *self, PyObject *args, PyObject *kwds)
 {
-  PyObject *o = NULL;
-  ASN1_TIME *t = NULL;
+  ASN1_OCTET_STRING *econtent;
+  int ok = 0;
 
-  ENTERING(crl_object_set_next_update);
+  ENTERING(manifest_object_verify);
 
-  if (!PyArg_ParseTuple(args, "O", &o))
+  if ((econtent = cms_object_verify_helper(&self->cms, args, kwds)) == NULL)
     goto error;
 
-  if ((t = Python_to_ASN1_TIME(o, 1)) == NULL)
-    lose("Couldn't parse nextUpdate string");
-
-  if (!X509_CRL_set_nextUpdate(self->crl, t))
-    lose("Couldn't set nextUpdate");
+  if (!manifest_object_read_econtent(self, econtent))
+    goto error;
 
-  ASN1_TIME_free(t);
-  Py_RETURN_NONE;
+  ok = 1;
 
  error:
-  ASN1_TIME_free(t);
-  return NULL;
-}
-
-static char crl_object_get_next_update__doc__[] =
-  "Returns this CRL's \"nextUpdate\" value as a datetime.\n"
-  ;
-
-static PyObject *
-crl_object_get_next_update (crl_object *self)
-{
-  ENTERING(crl_object_get_next_update);
-  return ASN1_TIME_to_Python(X509_CRL_get_nextUpdate(self->crl));
+  if (ok)
+    Py_RETURN_NONE;
+  else
+    return NULL;
 }
 
-static char crl_object_add_revocations__doc__[] =
-  "This method adds a collection of revocations to this CRL.\n"
+static char manifest_object_extract_without_verifying__doc__[] =
+  "Extract manifest payload from CMS wrapper without attempting CMS verification.\n"
   "\n"
-  "The \"iterable\" parameter should be an iterable object which returns\n"
-  "two-element sequences.  The first element of each pair should be the\n"
-  "revoked serial number (an integer), the second element should be the\n"
-  "revocation date (a datetime object).\n"
+  "NEVER USE THIS METHOD ON AN UNVERIFIED MANIFEST!\n"
   ;
 
 static PyObject *
-crl_object_add_revocations(crl_object *self, PyObject *args)
+manifest_object_extract_without_verifying(manifest_object *self)
 {
-  PyObject *iterable = NULL;
-  PyObject *iterator = NULL;
-  PyObject *item = NULL;
-  PyObject *fast = NULL;
-  X509_REVOKED *revoked = NULL;
-  ASN1_INTEGER *serial = NULL;
-  ASN1_TIME *date = NULL;
+  ASN1_OCTET_STRING *econtent;
   int ok = 0;
 
-  ENTERING(crl_object_add_revocations);
+  ENTERING(manifest_object_extract_without_verifying);
 
-  if (!PyArg_ParseTuple(args, "O", &iterable) ||
-      (iterator = PyObject_GetIter(iterable)) == NULL)
+  if ((econtent = cms_object_extract_without_verifying_helper(&self->cms)) == NULL)
     goto error;
 
-  while ((item = PyIter_Next(iterator)) != NULL) {
-
-    if ((fast = PySequence_Fast(item, "Revocation entry must be a sequence")) == NULL)
-      goto error;
-
-    if (PySequence_Fast_GET_SIZE(fast) != 2)
-      lose_type_error("Revocation entry must be two-element sequence");
-
-    if ((serial = PyLong_to_ASN1_INTEGER(PySequence_Fast_GET_ITEM(fast, 0))) == NULL ||
-        (date = Python_to_ASN1_TIME(PySequence_Fast_GET_ITEM(fast, 1), 1)) == NULL)
-      goto error;
-
-    if ((revoked = X509_REVOKED_new()) == NULL ||
-        !X509_REVOKED_set_serialNumber(revoked, serial) ||
-        !X509_REVOKED_set_revocationDate(revoked, date))
-      lose_no_memory();
-
-    ASN1_INTEGER_free(serial);
-    serial = NULL;
-
-    ASN1_TIME_free(date);
-    date = NULL;
-
-    if (!X509_CRL_add0_revoked(self->crl, revoked))
-      lose_no_memory();
-
-    revoked = NULL;
-    Py_XDECREF(item);
-    Py_XDECREF(fast);
-    item = fast = NULL;
-  }
-
-  if (!X509_CRL_sort(self->crl))
-    lose_openssl_error("Couldn't sort CRL");
+  if (!manifest_object_read_econtent(self, econtent))
+    goto error;
 
   ok = 1;
 
- error:
-  Py_XDECREF(iterator);
-  Py_XDECREF(item);
-  Py_XDECREF(fast);
-  X509_REVOKED_free(revoked);
-  ASN1_INTEGER_free(serial);
-  ASN1_TIME_free(date);
-
+ error:
   if (ok)
     Py_RETURN_NONE;
   else
     return NULL;
 }
 
-static char crl_object_get_revoked__doc__[] =
-  "Return a sequence of two-element tuples representing the sequence of\n"
-  "revoked certificates listed in this CRL.\n"
-  "\n"
-  "The first element of each pair is the serialNumber of the revoked\n"
-  "certificate, the second element is the revocationDate.\n"
+static char manifest_object_check_rpki_conformance__doc__[] =
+  "Check this manifest for conformance to the RPKI profile.\n"
   ;
 
 static PyObject *
-crl_object_get_revoked(crl_object *self)
+manifest_object_check_rpki_conformance(manifest_object *self, PyObject *args, PyObject *kwds)
 {
-  STACK_OF(X509_REVOKED) *revoked = NULL;
-  X509_REVOKED *r = NULL;
-  PyObject *result = NULL;
-  PyObject *item = NULL;
-  PyObject *serial = NULL;
-  PyObject *date = NULL;
-  int i;
-
-  ENTERING(crl_object_get_revoked);
+  static char *kwlist[] = {"status", NULL};
+  PyObject *status = Py_None;
 
-  if ((revoked = X509_CRL_get_REVOKED(self->crl)) == NULL)
-    lose("Inexplicable NULL revocation list pointer");
+  ENTERING(manifest_object_check_rpki_conformance);
 
-  if ((result = PyTuple_New(sk_X509_REVOKED_num(revoked))) == NULL)
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!", kwlist, &PySet_Type, &status))
     goto error;
 
-  for (i = 0; i < sk_X509_REVOKED_num(revoked); i++) {
-    r = sk_X509_REVOKED_value(revoked, i);
-
-    if ((serial = ASN1_INTEGER_to_PyLong(r->serialNumber)) == NULL ||
-        (date = ASN1_TIME_to_Python(r->revocationDate)) == NULL ||
-        (item = Py_BuildValue("(NN)", serial, date)) == NULL)
-      goto error;
+  if (!manifest_object_decode(self))
+    goto error;
 
-    PyTuple_SET_ITEM(result, i, item);
-    item = serial = date = NULL;
-  }
+  if (!check_cms(self->cms.cms, status) || !check_manifest(self->cms.cms, self->manifest, status))
+    goto error;
 
-  return result;
+  Py_RETURN_NONE;
 
  error:
-  Py_XDECREF(result);
-  Py_XDECREF(item);
-  Py_XDECREF(serial);
-  Py_XDECREF(date);
   return NULL;
 }
 
-static char crl_object_is_revoked__doc__[] =
-  "Check whether a particular certificate has been revoked.\n"
-  ;
 
 static PyObject *
-crl_object_is_revoked(crl_object *self, PyObject *args)
+manifest_object_der_read_helper(PyTypeObject *type, BIO *bio)
 {
-  x509_object *x = NULL;
+  manifest_object *self;
 
-  if (!PyArg_ParseTuple(args, "O!", &POW_X509_Type, &x))
-    return NULL;
+  ENTERING(manifest_object_der_read_helper);
 
-  return PyBool_FromLong(X509_CRL_get0_by_cert(self->crl, NULL, x->x509));
+  if ((self = (manifest_object *) cms_object_der_read_helper(type, bio)) != NULL)
+    self->manifest = NULL;
+
+  return (PyObject *) self;
 }
 
-static char crl_object_clear_extensions__doc__[] =
-  "Clear all extensions attached to this CRL.\n"
+static char manifest_object_der_read__doc__[] =
+  "Read a DER-encoded manifest object from a string.\n"
   ;
 
 static PyObject *
-crl_object_clear_extensions(crl_object *self)
+manifest_object_der_read(PyTypeObject *type, PyObject *args)
 {
-  X509_EXTENSION *ext;
-
-  ENTERING(crl_object_clear_extensions);
-
-  while ((ext = X509_CRL_delete_ext(self->crl, 0)) != NULL)
-    X509_EXTENSION_free(ext);
-
-  Py_RETURN_NONE;
+  ENTERING(manifest_object_der_read);
+  return read_from_string_helper(manifest_object_der_read_helper, type, args);
 }
 
-static char crl_object_sign__doc__[] =
-  "Sign this CRL with a private key.\n"
-  "\n"
-  "The \"key\" parameter should be an instance of the Asymmetric class,\n"
-  "containing a private key.\n"
-  "\n"
-  "The optional \"digest\" parameter indicates which digest to compute and\n"
-  "sign, and should be one of the following:\n"
-  "\n"
-  "* SHA1_DIGEST\n"
-  "* SHA256_DIGEST\n"
-  "* SHA384_DIGEST\n"
-  "* SHA512_DIGEST\n"
-  "\n"
-  "The default digest algorithm is SHA-256.\n"
+static char manifest_object_der_read_file__doc__[] =
+  "Read a DER-encoded manifest object from a file.\n"
   ;
 
 static PyObject *
-crl_object_sign(crl_object *self, PyObject *args)
+manifest_object_der_read_file(PyTypeObject *type, PyObject *args)
 {
-  asymmetric_object *asym;
-  int digest_type = SHA256_DIGEST;
-  const EVP_MD *digest_method = NULL;
+  ENTERING(manifest_object_der_read_file);
+  return read_from_file_helper(manifest_object_der_read_helper, type, args);
+}
 
-  ENTERING(crl_object_sign);
+static PyObject *
+manifest_object_pem_read_helper(PyTypeObject *type, BIO *bio)
+{
+  manifest_object *self;
 
-  if (!PyArg_ParseTuple(args, "O!|i", &POW_Asymmetric_Type, &asym, &digest_type))
-    goto error;
+  ENTERING(manifest_object_pem_read_helper);
 
-  if ((digest_method = evp_digest_factory(digest_type)) == NULL)
-    lose("Unsupported digest algorithm");
+  if ((self = (manifest_object *) cms_object_pem_read_helper(type, bio)) != NULL)
+    self->manifest = NULL;
 
-  if (!X509_CRL_sign(self->crl, asym->pkey, digest_method))
-    lose_openssl_error("Couldn't sign CRL");
+  return (PyObject *) self;
+}
 
-  Py_RETURN_NONE;
+static char manifest_object_pem_read__doc__[] =
+  "Read a PEM-encoded manifest object from a string.\n"
+  ;
 
- error:
-  return NULL;
+static PyObject *
+manifest_object_pem_read(PyTypeObject *type, PyObject *args)
+{
+  ENTERING(manifest_object_pem_read);
+  return read_from_string_helper(manifest_object_pem_read_helper, type, args);
 }
 
-static char crl_object_verify__doc__[] =
-  "Verify this CRL's signature against its issuer.\n"
+static char manifest_object_pem_read_file__doc__[] =
+  "Read a PEM-encoded manifest object from a file.\n"
   ;
 
 static PyObject *
-crl_object_verify(crl_object *self, PyObject *args)
+manifest_object_pem_read_file(PyTypeObject *type, PyObject *args)
 {
-  x509_object *issuer;
+  ENTERING(manifest_object_pem_read_file);
+  return read_from_file_helper(manifest_object_pem_read_helper, type, args);
+}
 
-  ENTERING(crl_object_verify);
+static char manifest_object_get_version__doc__[] =
+  "Return the version number of this manifest.\n"
+  ;
 
-  if (!PyArg_ParseTuple(args, "O!", &POW_X509_Type, &issuer))
+static PyObject *
+manifest_object_get_version(manifest_object *self)
+{
+  ENTERING(manifest_object_get_version);
+
+  if (!manifest_object_decode(self))
     goto error;
 
-  if (!X509_CRL_verify(self->crl, X509_get_pubkey(issuer->x509)))
-    lose_validation_error("X509_CRL_verify() raised an exception");
+  if (self->manifest == NULL)
+    lose_not_verified("Can't report version of unverified manifest");
 
-  Py_RETURN_NONE;
+  if (self->manifest->version)
+    return Py_BuildValue("N", ASN1_INTEGER_to_PyLong(self->manifest->version));
+  else
+    return PyInt_FromLong(0);
 
  error:
   return NULL;
 }
 
-static char crl_object_check_rpki_conformance__doc__[] =
-  "Check this CRL for conformance to the RPKI profile.\n"
+static char manifest_object_set_version__doc__[] =
+  "Set the version number of this manifest.\n"
+  "\n"
+  "The \"version\" parameter should be a non-negative integer.\n"
+  "\n"
+  "As of this writing, zero is both the default and the only defined version.\n"
+  "Attempting to set any version number other than zero will fail, as we\n"
+  "don't understand how to write other versions, by definition.\n"
   ;
 
 static PyObject *
-crl_object_check_rpki_conformance(crl_object *self, PyObject *args, PyObject *kwds)
+manifest_object_set_version(manifest_object *self, PyObject *args)
 {
-  static char *kwlist[] = {"issuer", "status", NULL};
-  x509_object *issuer = NULL;
-  PyObject *status = Py_None;
+  int version = 0;
 
-  ENTERING(crl_object_check_rpki_conformance);
+  ENTERING(manifest_object_set_version);
 
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!O!", kwlist, &POW_X509_Type, &issuer, &PySet_Type, &status))
+  if (!PyArg_ParseTuple(args, "|i", &version))
     goto error;
 
-  if (!check_crl(self->crl, issuer->x509, status))
+  if (version != 0)
+    lose("RFC 6486 only defines RPKI manifest version zero");
+
+  if (!manifest_object_decode(self))
     goto error;
 
+  if (self->manifest == NULL)
+    lose_not_verified("Can't set version of unverified manifest");
+
+  ASN1_INTEGER_free(self->manifest->version);
+  self->manifest->version = NULL;
+
   Py_RETURN_NONE;
 
  error:
   return NULL;
 }
 
-static char crl_object_pem_write__doc__[] =
-  "Return the PEM encoding of this CRL, as a string.\n"
+static char manifest_object_get_manifest_number__doc__[] =
+  "Return the manifestNumber of this manifest.\n"
   ;
 
 static PyObject *
-crl_object_pem_write(crl_object *self)
+manifest_object_get_manifest_number(manifest_object *self)
 {
-  PyObject *result = NULL;
-  BIO *bio = NULL;
-
-  ENTERING(crl_object_pem_write);
+  ENTERING(manifest_object_get_manifest_number);
 
-  if ((bio = BIO_new(BIO_s_mem())) == NULL)
-    lose_no_memory();
+  if (!manifest_object_decode(self))
+    goto error;
 
-  if (!PEM_write_bio_X509_CRL(bio, self->crl))
-    lose_openssl_error("Unable to write CRL");
+  if (self->manifest == NULL)
+    lose_not_verified("Can't get manifestNumber of unverified manifest");
 
-  result = BIO_to_PyString_helper(bio);
+  return Py_BuildValue("N", ASN1_INTEGER_to_PyLong(self->manifest->manifestNumber));
 
- error:                         /* Fall through */
-  BIO_free(bio);
-  return result;
+ error:
+  return NULL;
 }
 
-static char crl_object_der_write__doc__[] =
-  "Return the DER encoding of this CRL, as a string.\n"
+static char manifest_object_set_manifest_number__doc__[] =
+  "Set the manifestNumber of this manifest.\n"
+  "\n"
+  "The \"manifestNumber\" parameter should be a non-negative integer.\n"
   ;
 
 static PyObject *
-crl_object_der_write(crl_object *self)
+manifest_object_set_manifest_number(manifest_object *self, PyObject *args)
 {
-  PyObject *result = NULL;
-  BIO *bio = NULL;
+  PyObject *manifestNumber = NULL;
+  PyObject *zero = NULL;
+  int ok = 0;
 
-  ENTERING(crl_object_der_write);
+  ENTERING(manifest_object_set_manifest_number);
 
-  if ((bio = BIO_new(BIO_s_mem())) == NULL)
-    lose_no_memory();
+  if (!PyArg_ParseTuple(args, "O", &manifestNumber))
+    goto error;
 
-  if (!i2d_X509_CRL_bio(bio, self->crl))
-    lose_openssl_error("Unable to write CRL");
+  if ((zero = PyInt_FromLong(0)) == NULL)
+    goto error;
 
-  result = BIO_to_PyString_helper(bio);
+  switch (PyObject_RichCompareBool(manifestNumber, zero, Py_GE)) {
+  case -1:
+    goto error;
+  case 0:
+    lose("Negative manifest number is not allowed");
+  }
+
+  if (!manifest_object_decode(self))
+    goto error;
+
+  if (self->manifest == NULL)
+    lose_not_verified("Can't set manifestNumber of unverified manifest");
+
+  ASN1_INTEGER_free(self->manifest->manifestNumber);
+
+  if ((self->manifest->manifestNumber = PyLong_to_ASN1_INTEGER(manifestNumber)) == NULL)
+    goto error;
+
+  ok = 1;
+
+ error:
+  Py_XDECREF(zero);
 
- error:                         /* Fall through */
-  BIO_free(bio);
-  return result;
+  if (ok)
+    Py_RETURN_NONE;
+  else
+    return NULL;
 }
 
-static char crl_object_get_aki__doc__[] =
-  EXTENSION_GET_AKI__DOC__
+static char manifest_object_set_this_update__doc__[] =
+  "Set this manifest's \"thisUpdate\" value.\n"
+  "\n"
+  "The \"time\" parameter should be a datetime object.\n"
   ;
 
 static PyObject *
-crl_object_get_aki(crl_object *self)
+manifest_object_set_this_update (manifest_object *self, PyObject *args)
 {
-  return extension_get_aki(crl_object_extension_get_helper(self, NID_authority_key_identifier));
-}
+  ASN1_TIME *t = NULL;
+  PyObject *o = NULL;
 
-static char crl_object_set_aki__doc__[] =
-  EXTENSION_SET_AKI__DOC__
-  ;
+  ENTERING(manifest_object_set_this_update);
 
-static PyObject *
-crl_object_set_aki(crl_object *self, PyObject *args)
-{
-  return crl_object_extension_set_helper(self, extension_set_aki(args));
-}
+  if (!PyArg_ParseTuple(args, "O", &o))
+    goto error;
 
-static char crl_object_get_crl_number__doc__[] =
-  "Return the CRL Number extension value from this CRL, an integer.\n"
-  ;
+  if (!manifest_object_decode(self))
+    goto error;
 
-static PyObject *
-crl_object_get_crl_number(crl_object *self)
-{
-  ASN1_INTEGER *ext = X509_CRL_get_ext_d2i(self->crl, NID_crl_number, NULL, NULL);
-  PyObject *result = NULL;
+  if (self->manifest == NULL)
+    lose_not_verified("Can't set thisUpdate value of unverified manifest");
 
-  ENTERING(crl_object_get_crl_number);
+  if ((t = Python_to_ASN1_TIME(o, 0)) == NULL)
+    lose("Couldn't convert thisUpdate string");
 
-  if (ext == NULL)
-    Py_RETURN_NONE;
+  ASN1_TIME_free(self->manifest->thisUpdate);
+  self->manifest->thisUpdate = t;
+  Py_RETURN_NONE;
 
-  result = Py_BuildValue("N", ASN1_INTEGER_to_PyLong(ext));
-  ASN1_INTEGER_free(ext);
-  return result;
+ error:
+  ASN1_TIME_free(t);
+  return NULL;
 }
 
-static char crl_object_set_crl_number__doc__[] =
-  "Set the CRL Number extension value in this CRL.\n"
-  "\n"
-  "The \"number\" parameter should be an integer.\n"
+static char manifest_object_get_this_update__doc__[] =
+  "Return this manifest's \"thisUpdate\" value as a datetime.\n"
   ;
 
 static PyObject *
-crl_object_set_crl_number(crl_object *self, PyObject *args)
+manifest_object_get_this_update (manifest_object *self)
 {
-  ASN1_INTEGER *ext = NULL;
-  PyObject *crl_number = NULL;
-
-  ENTERING(crl_object_set_crl_number);
+  ENTERING(manifest_object_get_this_update);
 
-  if (!PyArg_ParseTuple(args, "O", &crl_number) ||
-      (ext = PyLong_to_ASN1_INTEGER(crl_number)) == NULL)
+  if (!manifest_object_decode(self))
     goto error;
 
-  if (!X509_CRL_add1_ext_i2d(self->crl, NID_crl_number, ext, 0, X509V3_ADD_REPLACE))
-    lose_openssl_error("Couldn't add CRL Number extension to CRL");
+  if (self->manifest == NULL)
+    lose_not_verified("Can't get thisUpdate value of unverified manifest");
 
-  ASN1_INTEGER_free(ext);
-  Py_RETURN_NONE;
+  return ASN1_TIME_to_Python(self->manifest->thisUpdate);
 
  error:
-  ASN1_INTEGER_free(ext);
   return NULL;
 }
 
-static char crl_object_pprint__doc__[] =
-  "Return a pretty-printed rendition of this CRL.\n"
+static char manifest_object_set_next_update__doc__[] =
+  "Set this manifest's \"nextUpdate\" value.\n"
+  "\n"
+  "The \"time\" parameter should be a datetime object.\n"
   ;
 
 static PyObject *
-crl_object_pprint(crl_object *self)
+manifest_object_set_next_update (manifest_object *self, PyObject *args)
 {
-  PyObject *result = NULL;
-  BIO *bio = NULL;
-
-  ENTERING(crl_object_pprint);
-
-  if ((bio = BIO_new(BIO_s_mem())) == NULL)
-    lose_no_memory();
+  ASN1_TIME *t = NULL;
+  PyObject *o = NULL;
 
-  if (!X509_CRL_print(bio, self->crl))
-    lose_openssl_error("Unable to pretty-print CRL");
+  ENTERING(manifest_object_set_next_update);
 
-  result = BIO_to_PyString_helper(bio);
+  if (!PyArg_ParseTuple(args, "O", &o))
+    goto error;
 
- error:                         /* Fall through */
-  BIO_free(bio);
-  return result;
-}
+  if (!manifest_object_decode(self))
+    goto error;
 
-static struct PyMethodDef crl_object_methods[] = {
-  Define_Method(sign,                   crl_object_sign,                        METH_VARARGS),
-  Define_Method(verify,                 crl_object_verify,                      METH_VARARGS),
-  Define_Method(checkRPKIConformance,   crl_object_check_rpki_conformance,      METH_KEYWORDS),
-  Define_Method(getVersion,             crl_object_get_version,                 METH_NOARGS),
-  Define_Method(setVersion,             crl_object_set_version,                 METH_VARARGS),
-  Define_Method(getIssuer,              crl_object_get_issuer,                  METH_VARARGS),
-  Define_Method(setIssuer,              crl_object_set_issuer,                  METH_VARARGS),
-  Define_Method(getThisUpdate,          crl_object_get_this_update,     	METH_NOARGS),
-  Define_Method(setThisUpdate,          crl_object_set_this_update,             METH_VARARGS),
-  Define_Method(getNextUpdate,          crl_object_get_next_update,             METH_NOARGS),
-  Define_Method(setNextUpdate,          crl_object_set_next_update,             METH_VARARGS),
-  Define_Method(getRevoked,             crl_object_get_revoked,                 METH_NOARGS),
-  Define_Method(isRevoked,              crl_object_is_revoked,                  METH_VARARGS),
-  Define_Method(addRevocations,         crl_object_add_revocations,             METH_VARARGS),
-  Define_Method(clearExtensions,        crl_object_clear_extensions,            METH_NOARGS),
-  Define_Method(pemWrite,               crl_object_pem_write,                   METH_NOARGS),
-  Define_Method(derWrite,               crl_object_der_write,                   METH_NOARGS),
-  Define_Method(pprint,                 crl_object_pprint,                      METH_NOARGS),
-  Define_Method(getAKI,                 crl_object_get_aki,                     METH_NOARGS),
-  Define_Method(setAKI,                 crl_object_set_aki,                     METH_VARARGS),
-  Define_Method(getCRLNumber,           crl_object_get_crl_number,              METH_NOARGS),
-  Define_Method(setCRLNumber,           crl_object_set_crl_number,              METH_VARARGS),
-  Define_Method(getIssuerHash,          crl_object_get_issuer_hash,             METH_NOARGS),
-  Define_Class_Method(pemRead,          crl_object_pem_read,                    METH_VARARGS),
-  Define_Class_Method(pemReadFile,      crl_object_pem_read_file,               METH_VARARGS),
-  Define_Class_Method(derRead,          crl_object_der_read,                    METH_VARARGS),
-  Define_Class_Method(derReadFile,      crl_object_der_read_file,               METH_VARARGS),
-  {NULL}
-};
+  if (self->manifest == NULL)
+    lose_not_verified("Can't set nextUpdate value of unverified manifest"); 
 
-static char POW_CRL_Type__doc__[] =
-  "Container for OpenSSL's X509 CRL management facilities.\n"
-  ;
+  if ((t = Python_to_ASN1_TIME(o, 0)) == NULL)
+    lose("Couldn't parse nextUpdate string");
 
-static PyTypeObject POW_CRL_Type = {
-  PyObject_HEAD_INIT(0)
-  0,                                     /* ob_size */
-  "rpki.POW.CRL",                        /* tp_name */
-  sizeof(crl_object),                    /* tp_basicsize */
-  0,                                     /* tp_itemsize */
-  (destructor)crl_object_dealloc,        /* tp_dealloc */
-  0,                                     /* tp_print */
-  0,                                     /* tp_getattr */
-  0,                                     /* tp_setattr */
-  0,                                     /* tp_compare */
-  0,                                     /* tp_repr */
-  0,                                     /* tp_as_number */
-  0,                                     /* tp_as_sequence */
-  0,                                     /* tp_as_mapping */
-  0,                                     /* tp_hash */
-  0,                                     /* tp_call */
-  0,                                     /* tp_str */
-  0,                                     /* tp_getattro */
-  0,                                     /* tp_setattro */
-  0,                                     /* tp_as_buffer */
-  Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, /* tp_flags */
-  POW_CRL_Type__doc__,                   /* tp_doc */
-  0,                                     /* tp_traverse */
-  0,                                     /* tp_clear */
-  0,                                     /* tp_richcompare */
-  0,                                     /* tp_weaklistoffset */
-  0,                                     /* tp_iter */
-  0,                                     /* tp_iternext */
-  crl_object_methods,                    /* tp_methods */
-  0,                                     /* tp_members */
-  0,                                     /* tp_getset */
-  0,                                     /* tp_base */
-  0,                                     /* tp_dict */
-  0,                                     /* tp_descr_get */
-  0,                                     /* tp_descr_set */
-  0,                                     /* tp_dictoffset */
-  0,                                     /* tp_init */
-  0,                                     /* tp_alloc */
-  crl_object_new,                        /* tp_new */
-};
+  ASN1_TIME_free(self->manifest->nextUpdate);
+  self->manifest->nextUpdate = t;
+  Py_RETURN_NONE;
 
-
+ error:
+  ASN1_TIME_free(t);
+  return NULL;
+}
 
-/*
- * Asymmetric object.
- */
+static char manifest_object_get_next_update__doc__[] =
+  "Return this manifest's \"nextUpdate\" value as a datetime.\n"
+  ;
 
 static PyObject *
-asymmetric_object_new(PyTypeObject *type, GCC_UNUSED PyObject *args, GCC_UNUSED PyObject *kwds)
+manifest_object_get_next_update (manifest_object *self)
 {
-  asymmetric_object *self = NULL;
-
-  ENTERING(asymmetric_object_new);
+  ENTERING(manifest_object_get_next_update);
 
-  if ((self = (asymmetric_object *) type->tp_alloc(type, 0)) == NULL)
+  if (!manifest_object_decode(self))
     goto error;
 
-  self->pkey = NULL;
+  if (self->manifest == NULL)
+    lose_not_verified("Can't extract nextUpdate value of unverified manifest");
 
-  return (PyObject *) self;
+  return ASN1_TIME_to_Python(self->manifest->nextUpdate);
 
  error:
-
-  Py_XDECREF(self);
   return NULL;
 }
 
-static int
-asymmetric_object_init(asymmetric_object *self, PyObject *args, PyObject *kwds)
+static char manifest_object_get_algorithm__doc__[] =
+  "Return this manifest's fileHashAlg OID.\n"
+  ;
+
+static PyObject *
+manifest_object_get_algorithm(manifest_object *self)
 {
-  static char *kwlist[] = {NULL};
+  PyObject *result = NULL;
 
-  ENTERING(asymmetric_object_init);
+  ENTERING(manifest_object_get_algorithm);
 
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "", kwlist))
+  if (!manifest_object_decode(self))
     goto error;
 
-  /*
-   * We used to take arguments to generate an RSA key, but that's
-   * now in the .generateRSA() class method.
-   */
+  if (self->manifest == NULL)
+    lose_not_verified("Can't extract algorithm OID of unverified manifest");
 
-  return 0;
+  result = ASN1_OBJECT_to_PyString(self->manifest->fileHashAlg);
 
  error:
-  return -1;
+  return result;
 }
 
-static void
-asymmetric_object_dealloc(asymmetric_object *self)
-{
-  ENTERING(asymmetric_object_dealloc);
-  EVP_PKEY_free(self->pkey);
-  self->ob_type->tp_free((PyObject*) self);
-}
+static char manifest_object_set_algorithm__doc__[] =
+  "Set this manifest's fileHashAlg OID.\n"
+  ;
 
 static PyObject *
-asymmetric_object_pem_read_private_helper(PyTypeObject *type, BIO *bio, char *pass)
+manifest_object_set_algorithm(manifest_object *self, PyObject *args)
 {
-  asymmetric_object *self = NULL;
+  ASN1_OBJECT *oid = NULL;
+  const char *s = NULL;
 
-  ENTERING(asymmetric_object_pem_read_private_helper);
+  ENTERING(manifest_object_set_algorithm);
+
+  if (!PyArg_ParseTuple(args, "s", &s))
+    goto error;
 
-  if ((self = (asymmetric_object *) asymmetric_object_new(type, NULL, NULL)) == NULL)
+  if (!manifest_object_decode(self))
     goto error;
 
-  if (!PEM_read_bio_PrivateKey(bio, &self->pkey, NULL, pass))
-    lose_openssl_error("Couldn't load private key");
+  if (self->manifest == NULL)
+    lose_not_verified("Can't set algorithm OID for unverified manifest");
 
-  whack_ec_key_to_namedCurve(self->pkey);
+  if ((oid = OBJ_txt2obj(s, 1)) == NULL)
+    lose_no_memory();
 
-  return (PyObject *) self;
+  ASN1_OBJECT_free(self->manifest->fileHashAlg);
+  self->manifest->fileHashAlg = oid;
+  Py_RETURN_NONE;
 
  error:
-  Py_XDECREF(self);
+  ASN1_OBJECT_free(oid);
   return NULL;
 }
 
-/*
- * We can't use the generic read_from_*_helper() functions here
- * because of optional the PEM password, so we just code the two PEM
- * read cases for private keys directly.  Other than the passphrase,
- * code is pretty much the same as the generic functions.
- *
- * It turns out that OpenSSL is moving away from its old raw PKCS #1.5
- * private key format in favor of PKCS #8.  This makes sense, but it
- * leaves us with a minor mess to track.  Many OpenSSL functions that
- * originally expected PKCS #1.5 now also accept PKCS #8, so there's
- * no tearing hurry about this, but at some point we might want to
- * switch to writing PKCS #8.  It looks like this would be relatively
- * straightforward: see functions i2d_PKCS8PrivateKey_bio() and
- * PEM_write_bio_PKCS8PrivateKey(), and note that PKCS #8 supports
- * encrypted private keys in DER format, so the DER methods should
- * take a passphrase argument as the PEM methods do.
- */
-
-static char asymmetric_object_pem_read_private__doc__[] =
-  "Read a PEM-encoded private key from a string.\n"
+static char manifest_object_add_files__doc__[] =
+  "Add a collection of <filename, hash> pairs to this manifest.\n"
   "\n"
-  "Optional second argument is a passphrase for the key.\n"
+  "The \"iterable\" parameter should be an iterable object supplying\n"
+  "returning two-element sequences; the first element of each sequence\n"
+  "should be the filename (a text string), the second element should be the\n"
+  "hash (a binary string).\n"
   ;
 
 static PyObject *
-asymmetric_object_pem_read_private(PyTypeObject *type, PyObject *args)
+manifest_object_add_files(manifest_object *self, PyObject *args)
 {
-  PyObject *result = NULL;
-  char *pass = NULL;
-  char *src = NULL;
-  BIO *bio = NULL;
-  Py_ssize_t len = 0;
+  PyObject *iterable = NULL;
+  PyObject *iterator = NULL;
+  PyObject *item = NULL;
+  PyObject *fast = NULL;
+  FileAndHash *fah = NULL;
+  char *file = NULL;
+  char *hash = NULL;
+  Py_ssize_t filelen, hashlen;
+  int ok = 0;
 
-  ENTERING(asymmetric_object_pem_read_private);
+  ENTERING(manifest_object_add_files);
 
-  if (!PyArg_ParseTuple(args, "s#|s", &src, &len, &pass))
+  if (!manifest_object_decode(self))
     goto error;
 
-  if ((bio = BIO_new_mem_buf(src, len)) == NULL)
-    lose_no_memory();
+  if (self->manifest == NULL)
+    lose_not_verified("Can't add files to unverified manifest");
 
-  result = asymmetric_object_pem_read_private_helper(type, bio, pass);
+  if (!PyArg_ParseTuple(args, "O", &iterable) ||
+      (iterator = PyObject_GetIter(iterable)) == NULL)
+    goto error;
+
+  while ((item = PyIter_Next(iterator)) != NULL) {
+
+    if ((fast = PySequence_Fast(item, "FileAndHash entry must be a sequence")) == NULL)
+      goto error;
+
+    if (PySequence_Fast_GET_SIZE(fast) != 2)
+      lose_type_error("FileAndHash entry must be two-element sequence");
+
+    if (PyString_AsStringAndSize(PySequence_Fast_GET_ITEM(fast, 0), &file, &filelen) < 0 ||
+        PyString_AsStringAndSize(PySequence_Fast_GET_ITEM(fast, 1), &hash, &hashlen) < 0)
+      goto error;
+
+    if ((fah = FileAndHash_new()) == NULL ||
+        !ASN1_OCTET_STRING_set(fah->file, (unsigned char *) file, filelen) ||
+        !ASN1_BIT_STRING_set(fah->hash, (unsigned char *) hash, hashlen) ||
+        !sk_FileAndHash_push(self->manifest->fileList, fah))
+      lose_no_memory();
+
+    fah->hash->flags &= ~7;
+    fah->hash->flags |= ASN1_STRING_FLAG_BITS_LEFT;
+
+    fah = NULL;
+    Py_XDECREF(item);
+    Py_XDECREF(fast);
+    item = fast = NULL;
+  }
+
+  ok = 1;
 
  error:
-  BIO_free(bio);
-  return result;
+  Py_XDECREF(iterator);
+  Py_XDECREF(item);
+  Py_XDECREF(fast);
+  FileAndHash_free(fah);
+
+  if (ok)
+    Py_RETURN_NONE;
+  else
+    return NULL;
 }
 
-static char asymmetric_object_pem_read_private_file__doc__[] =
-  "Read a PEM-encoded private key from a file.\n"
-  "\n"
-  "Optional second argument is a passphrase for the key.\n"
+static char manifest_object_get_files__doc__[] =
+  "Return a tuple of <filename, hash> pairs representing the contents of\n"
+  "this manifest.\n"
   ;
 
 static PyObject *
-asymmetric_object_pem_read_private_file(PyTypeObject *type, PyObject *args)
+manifest_object_get_files(manifest_object *self)
 {
-  const char *filename = NULL;
   PyObject *result = NULL;
-  char *pass = NULL;
-  BIO *bio = NULL;
+  PyObject *item = NULL;
+  der_view_t files, file, hash;
+  unsigned unused;
+  size_t i;
 
-  ENTERING(asymmetric_object_pem_read_private_file);
+  ENTERING(manifest_object_get_files);
 
-  if (!PyArg_ParseTuple(args, "s|s", &filename, &pass))
+  if (!manifest_object_encode(self))
     goto error;
 
-  if ((bio = BIO_new_file(filename, "rb")) == NULL)
-    lose_openssl_error("Could not open file");
+  if (self->econtent == NULL)
+    lose_not_verified("Can't get files from unverified manifest");
 
-  result = asymmetric_object_pem_read_private_helper(type, bio, pass);
+  if ((result = PyTuple_New(self->view.nfiles)) == NULL)
+    goto error;
+
+  for (i = 0, files = self->view.fileList; i < self->view.nfiles; i++) {
+    if (!manifest_view_next_file(&files, &file, &hash, &unused))
+      lose("Inexplicable failure walking manifest fileList");
+
+    item = Py_BuildValue("(s#s#)",
+                         file.data, (Py_ssize_t) file.len,
+                         hash.data, (Py_ssize_t) hash.len);
+    if (item == NULL)
+      goto error;
+
+    PyTuple_SET_ITEM(result, i, item);
+    item = NULL;
+  }
 
- error:
-  BIO_free(bio);
   return result;
+
+ error:
+  Py_XDECREF(result);
+  Py_XDECREF(item);
+  return NULL;
 }
 
-/*
- * Used to be only PEM format private keys had passphrases, but with PKCS #8
- * that's not really true anymore.  We may need to extend the API here to allow
- * passphrases for DER private keys as well.
- */
+static char manifest_object_sign__doc__[] =
+  "Sign this manifest.  See the CMS class's .sign() method for details.\n"
+  ;
 
 static PyObject *
-asymmetric_object_der_read_private_helper(PyTypeObject *type, BIO *bio)
+manifest_object_sign(manifest_object *self, PyObject *args)
 {
-  asymmetric_object *self = NULL;
+  asymmetric_object *signkey = NULL;
+  x509_object *signcert = NULL;
+  PyObject *x509_iterable = Py_None;
+  PyObject *crl_iterable = Py_None;
+  char *oid = NULL;
+  unsigned flags = 0;
+  BIO *bio = NULL;
+  int ok = 0;
 
-  ENTERING(asymmetric_object_der_read_private_helper);
+  ENTERING(manifest_object_sign);
 
-  if ((self = (asymmetric_object *) asymmetric_object_new(type, NULL, NULL)) == NULL)
+  if (!PyArg_ParseTuple(args, "O!O!|OOsI",
+                        &POW_X509_Type, &signcert,
+                        &POW_Asymmetric_Type, &signkey,
+                        &x509_iterable,
+                        &crl_iterable,
+                        &oid,
+                        &flags))
     goto error;
 
-  if (!d2i_PrivateKey_bio(bio, &self->pkey))
-    lose_openssl_error("Couldn't load private key");
+  if ((bio = BIO_new(BIO_s_mem())) == NULL)
+    lose_no_memory();
 
-  whack_ec_key_to_namedCurve(self->pkey);
+  assert_no_unhandled_openssl_errors();
 
-  return (PyObject *) self;
+  if (!manifest_object_write_econtent(self, bio))
+    lose_openssl_error("Couldn't encode manifest");
+
+  assert_no_unhandled_openssl_errors();
+
+  if (!cms_object_sign_helper(&self->cms, bio, signcert, signkey,
+                              x509_iterable, crl_iterable, oid, flags))
+    lose_openssl_error("Couldn't sign manifest");
+
+  assert_no_unhandled_openssl_errors();
+
+  ok = 1;
 
  error:
+  BIO_free(bio);
 
-  Py_XDECREF(self);
-  return NULL;
+  if (ok)
+    Py_RETURN_NONE;
+  else
+    return NULL;
 }
 
-static char asymmetric_object_der_read_private__doc__[] =
-  "Read a DER-encoded private key from a string.\n"
+static struct PyMethodDef manifest_object_methods[] = {
+  Define_Method(getVersion,			manifest_object_get_version,                    METH_NOARGS),
+  Define_Method(setVersion,			manifest_object_set_version,                    METH_VARARGS),
+  Define_Method(getManifestNumber,		manifest_object_get_manifest_number,            METH_NOARGS),
+  Define_Method(setManifestNumber,		manifest_object_set_manifest_number,            METH_VARARGS),
+  Define_Method(getThisUpdate,			manifest_object_get_this_update,                METH_NOARGS),
+  Define_Method(setThisUpdate,			manifest_object_set_this_update,                METH_VARARGS),
+  Define_Method(getNextUpdate,			manifest_object_get_next_update,                METH_NOARGS),
+  Define_Method(setNextUpdate,			manifest_object_set_next_update,                METH_VARARGS),
+  Define_Method(getAlgorithm,			manifest_object_get_algorithm,                  METH_NOARGS),
+  Define_Method(setAlgorithm,			manifest_object_set_algorithm,                  METH_VARARGS),
+  Define_Method(getFiles,			manifest_object_get_files,                      METH_NOARGS),
+  Define_Method(addFiles,			manifest_object_add_files,                      METH_VARARGS),
+  Define_Method(sign,				manifest_object_sign,                           METH_VARARGS),
+  Define_Method(verify,				manifest_object_verify,                         METH_KEYWORDS),
+  Define_Method(checkRPKIConformance,		manifest_object_check_rpki_conformance,         METH_KEYWORDS),
+  Define_Method(extractWithoutVerifying,	manifest_object_extract_without_verifying,      METH_NOARGS),
+  Define_Class_Method(pemRead,			manifest_object_pem_read,                       METH_VARARGS),
+  Define_Class_Method(pemReadFile,		manifest_object_pem_read_file,                  METH_VARARGS),
+  Define_Class_Method(derRead,			manifest_object_der_read,                       METH_VARARGS),
+  Define_Class_Method(derReadFile,		manifest_object_der_read_file,                  METH_VARARGS),
+  {NULL}
+};
+
+static char POW_Manifest_Type__doc__[] =
+  "This class provides access to RPKI manifest payload.\n"
+  "Most methods are inherited from or share code with the CMS class.\n"
   ;
 
-static PyObject *
-asymmetric_object_der_read_private(PyTypeObject *type, PyObject *args)
-{
-  ENTERING(asymmetric_object_der_read_private);
-  return read_from_string_helper(asymmetric_object_der_read_private_helper, type, args);
-}
+static PyTypeObject POW_Manifest_Type = {
+  PyObject_HEAD_INIT(0)
+  0,                                            /* ob_size */
+  "rpki.POW.Manifest",                          /* tp_name */
+  sizeof(manifest_object),                      /* tp_basicsize */
+  0,                                            /* tp_itemsize */
+  (destructor)manifest_object_dealloc,          /* tp_dealloc */
+  0,                                            /* tp_print */
+  0,                                            /* tp_getattr */
+  0,                                            /* tp_setattr */
+  0,                                            /* tp_compare */
+  0,                                            /* tp_repr */
+  0,                                            /* tp_as_number */
+  0,                                            /* tp_as_sequence */
+  0,                                            /* tp_as_mapping */
+  0,                                            /* tp_hash */
+  0,                                            /* tp_call */
+  0,                                            /* tp_str */
+  0,                                            /* tp_getattro */
+  0,                                            /* tp_setattro */
+  0,                                            /* tp_as_buffer */
+  Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,     /* tp_flags */
+  POW_Manifest_Type__doc__,                     /* tp_doc */
+  0,                                            /* tp_traverse */
+  0,                                            /* tp_clear */
+  0,                                            /* tp_richcompare */
+  0,                                            /* tp_weaklistoffset */
+  0,                                            /* tp_iter */
+  0,                                            /* tp_iternext */
+  manifest_object_methods,                      /* tp_methods */
+  0,                                            /* tp_members */
+  0,                                            /* tp_getset */
+  &POW_CMS_Type,                                /* tp_base */
+  0,                                            /* tp_dict */
+  0,                                            /* tp_descr_get */
+  0,                                            /* tp_descr_set */
+  0,                                            /* tp_dictoffset */
+  0,                                            /* tp_init */
+  0,                                            /* tp_alloc */
+  manifest_object_new,                          /* tp_new */
+};
+
+
 
-static char asymmetric_object_der_read_private_file__doc__[] =
-  "Read a DER-encoded private key from a file.\n"
-  ;
+/*
+ * ManifestBuilder object.
+ */
 
-static PyObject *
-asymmetric_object_der_read_private_file(PyTypeObject *type, PyObject *args)
-{
-  ENTERING(asymmetric_object_der_read_private_file);
-  return read_from_file_helper(asymmetric_object_der_read_private_helper, type, args);
-}
+/*
+ * Write a DER tag and length, returning the number of octets used.
+ * If buf is NULL, just compute the length.
+ */
 
-static PyObject *
-asymmetric_object_pem_read_public_helper(PyTypeObject *type, BIO *bio)
+static size_t
+manifest_builder_der_header(unsigned char *buf, unsigned char tag, size_t len)
 {
-  asymmetric_object *self = NULL;
-
-  ENTERING(asymmetric_object_pem_read_public_helper);
+  size_t n, i;
 
-  if ((self = (asymmetric_object *) asymmetric_object_new(type, NULL, NULL)) == NULL)
-    goto error;
-
-  if (!PEM_read_bio_PUBKEY(bio, &self->pkey, NULL, NULL))
-    lose_openssl_error("Couldn't load public key");
+  if (len < 0x80) {
+    if (buf) {
+      buf[0] = tag;
+      buf[1] = (unsigned char) len;
+    }
+    return 2;
+  }
 
-  whack_ec_key_to_namedCurve(self->pkey);
+  for (n = 1; n < sizeof(len) && (len >> (n * 8)) != 0; n++)
+    continue;
 
-  return (PyObject *) self;
+  if (buf) {
+    buf[0] = tag;
+    buf[1] = (unsigned char) (0x80 | n);
+    for (i = 0; i < n; i++)
+      buf[2 + i] = (unsigned char) (len >> ((n - 1 - i) * 8));
+  }
 
- error:
-  Py_XDECREF(self);
-  return NULL;
+  return 2 + n;
 }
 
-static PyObject *
-asymmetric_object_der_read_public_helper(PyTypeObject *type, BIO *bio)
-{
-  asymmetric_object *self = NULL;
+/*
+ * Binary search for an entry by name.  Returns the index at which the
+ * name is or would be, and sets *found accordingly.
+ */
 
-  ENTERING(asymmetric_object_der_read_public_helper);
+static size_t
+manifest_builder_find(manifest_builder_object *self, const char *name, size_t name_len, int *found)
+{
+  size_t lo = 0, hi = self->n_entries, mid;
+  int cmp;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    cmp = memcmp(self->entries[mid].name, name,
+                 self->entries[mid].name_len < name_len ? self->entries[mid].name_len : name_len);
+    if (cmp == 0)
+      cmp = (self->entries[mid].name_len > name_len) - (self->entries[mid].name_len < name_len);
+    if (cmp == 0) {
+      *found = 1;
+      return mid;
+    }
+    if (cmp < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
 
-  if ((self = (asymmetric_object *) asymmetric_object_new(type, NULL, NULL)) == NULL)
-    goto error;
+  *found = 0;
+  return lo;
+}
 
-  if (!d2i_PUBKEY_bio(bio, &self->pkey))
-    lose_openssl_error("Couldn't load public key");
+/*
+ * DER-encode a single FileAndHash, the same way Manifest.addFiles()
+ * would, for later splicing into the fileList.
+ */
 
-  whack_ec_key_to_namedCurve(self->pkey);
+static int
+manifest_builder_encode_entry(manifest_builder_entry *e)
+{
+  FileAndHash *fah = NULL;
+  unsigned char *p;
+  int len, ok = 0;
 
-  return (PyObject *) self;
+  if ((fah = FileAndHash_new()) == NULL ||
+      !ASN1_OCTET_STRING_set(fah->file, (unsigned char *) e->name, e->name_len) ||
+      !ASN1_BIT_STRING_set(fah->hash, e->hash, e->hash_len))
+    lose_no_memory();
 
- error:
+  fah->hash->flags &= ~7;
+  fah->hash->flags |= ASN1_STRING_FLAG_BITS_LEFT;
 
-  Py_XDECREF(self);
-  return NULL;
-}
+  if ((len = i2d_FileAndHash(fah, NULL)) <= 0)
+    lose_openssl_error("Couldn't encode manifest entry");
 
-static char asymmetric_object_pem_read_public__doc__[] =
-  "Read a PEM-encoded public key from a string.\n"
-  ;
+  PyMem_Free(e->der);
 
-static PyObject *
-asymmetric_object_pem_read_public(PyTypeObject *type, PyObject *args)
-{
-  ENTERING(asymmetric_object_pem_read_public);
-  return read_from_string_helper(asymmetric_object_pem_read_public_helper, type, args);
-}
+  if ((e->der = p = PyMem_Malloc(len)) == NULL)
+    lose_no_memory();
 
-static char asymmetric_object_pem_read_public_file__doc__[] =
-  "Read a PEM-encoded public key from a file.\n"
-  ;
+  e->der_len = i2d_FileAndHash(fah, &p);
+  ok = 1;
 
-static PyObject *
-asymmetric_object_pem_read_public_file(PyTypeObject *type, PyObject *args)
-{
-  ENTERING(asymmetric_object_pem_read_public_file);
-  return read_from_file_helper(asymmetric_object_pem_read_public_helper, type, args);
+ error:
+  FileAndHash_free(fah);
+  return ok;
 }
 
-static char asymmetric_object_der_read_public__doc__[] =
-  "Read a DER-encoded public key from a string.\n"
-  ;
+/*
+ * Add or replace an entry.  Entries whose hash hasn't changed keep
+ * their cached encoding, and don't invalidate the cached fileList.
+ */
 
-static PyObject *
-asymmetric_object_der_read_public(PyTypeObject *type, PyObject *args)
+static int
+manifest_builder_set(manifest_builder_object *self,
+                     const char *name, size_t name_len,
+                     const unsigned char *hash, size_t hash_len)
 {
-  ENTERING(asymmetric_object_der_read_public);
-  return read_from_string_helper(asymmetric_object_der_read_public_helper, type, args);
-}
+  manifest_builder_entry *e = NULL;
+  size_t i;
+  int found;
 
-static char asymmetric_object_der_read_public_file__doc__[] =
-  "Read a DER-encoded public key from a file.\n"
-  ;
+  if (hash_len > sizeof(e->hash))
+    lose_value_error("Manifest hash too long");
 
-static PyObject *
-asymmetric_object_der_read_public_file(PyTypeObject *type, PyObject *args)
-{
-  ENTERING(asymmetric_object_der_read_public_file);
-  return read_from_file_helper(asymmetric_object_der_read_public_helper, type, args);
-}
+  i = manifest_builder_find(self, name, name_len, &found);
 
-static char asymmetric_object_pem_write_private__doc__[] =
-  "Return the PEM encoding of an \"Asymmetric\" private key.\n"
-  "\n"
-  "This method takes an optional parameter \"passphrase\" which, if\n"
-  "specified, will be used to encrypt the private key with AES-256-CBC.\n"
-  "\n"
-  "If you don't specify a passphrase, the key will not be encrypted.\n"
-  ;
+  if (found) {
+    e = &self->entries[i];
+    e->generation = self->generation;
+    if (e->hash_len == hash_len && !memcmp(e->hash, hash, hash_len))
+      return 1;
+    memcpy(e->hash, hash, hash_len);
+    e->hash_len = hash_len;
+    self->dirty = 1;
+    return manifest_builder_encode_entry(e);
+  }
 
-static PyObject *
-asymmetric_object_pem_write_private(asymmetric_object *self, PyObject *args)
-{
-  PyObject *result = NULL;
-  char *passphrase = NULL;
-  const EVP_CIPHER *evp_method = NULL;
-  BIO *bio = NULL;
+  if (self->n_entries == self->max_entries) {
+    size_t n = self->max_entries ? self->max_entries * 2 : 64;
+    manifest_builder_entry *p = PyMem_Realloc(self->entries, n * sizeof(*p));
+    if (p == NULL)
+      lose_no_memory();
+    self->entries = p;
+    self->max_entries = n;
+  }
 
-  ENTERING(asymmetric_object_pem_write_private);
+  memmove(&self->entries[i + 1], &self->entries[i], (self->n_entries - i) * sizeof(*e));
+  self->n_entries++;
 
-  if (!PyArg_ParseTuple(args, "|s", &passphrase))
-    goto error;
+  e = &self->entries[i];
+  memset(e, 0, sizeof(*e));
 
-  if ((bio = BIO_new(BIO_s_mem())) == NULL)
-    lose_no_memory();
+  if ((e->name = PyMem_Malloc(name_len)) == NULL)
+    goto remove;
 
-  if (passphrase)
-    evp_method = EVP_aes_256_cbc();
+  memcpy(e->name, name, name_len);
+  e->name_len = name_len;
+  memcpy(e->hash, hash, hash_len);
+  e->hash_len = hash_len;
+  e->generation = self->generation;
+  self->dirty = 1;
 
-  if (!PEM_write_bio_PrivateKey(bio, self->pkey, evp_method, NULL, 0, NULL, passphrase))
-    lose_openssl_error("Unable to write key");
+  if (manifest_builder_encode_entry(e))
+    return 1;
 
-  result = BIO_to_PyString_helper(bio);
+ remove:
+  PyMem_Free(e->name);
+  PyMem_Free(e->der);
+  memmove(&self->entries[i], &self->entries[i + 1], (self->n_entries - i - 1) * sizeof(*e));
+  self->n_entries--;
+  if (!PyErr_Occurred())
+    PyErr_NoMemory();
 
- error:                         /* Fall through */
-  BIO_free(bio);
-  return result;
+ error:
+  return 0;
 }
 
-static char asymmetric_object_pem_write_public__doc__[] =
-  "Return the PEM encoding of an \"Asymmetric\" public key.\n"
-  ;
-
-static PyObject *
-asymmetric_object_pem_write_public(asymmetric_object *self)
+static void
+manifest_builder_delete(manifest_builder_object *self, size_t i)
 {
-  PyObject *result = NULL;
-  BIO *bio = NULL;
-
-  ENTERING(asymmetric_object_pem_write_public);
-
-  if ((bio = BIO_new(BIO_s_mem())) == NULL)
-    lose_no_memory();
-
-  if (!PEM_write_bio_PUBKEY(bio, self->pkey))
-    lose_openssl_error("Unable to write key");
-
-  result = BIO_to_PyString_helper(bio);
-
- error:                         /* Fall through */
-  BIO_free(bio);
-  return result;
+  PyMem_Free(self->entries[i].name);
+  PyMem_Free(self->entries[i].der);
+  memmove(&self->entries[i], &self->entries[i + 1], (self->n_entries - i - 1) * sizeof(*self->entries));
+  self->n_entries--;
+  self->dirty = 1;
 }
 
-static char asymmetric_object_der_write_private__doc__[] =
-  "Return the DER encoding of an \"Asymmetric\" private key.\n"
-  ;
+/*
+ * Hash an object and add it under the given name.
+ */
 
-static PyObject *
-asymmetric_object_der_write_private(asymmetric_object *self)
+static int
+manifest_builder_set_object(manifest_builder_object *self,
+                            const char *name, size_t name_len,
+                            const unsigned char *der, size_t der_len)
 {
-  PyObject *result = NULL;
-  BIO *bio = NULL;
+  unsigned char hash[SHA256_DIGEST_LENGTH];
 
-  ENTERING(asymmetric_object_der_write_private);
+  SHA256(der, der_len, hash);
+  return manifest_builder_set(self, name, name_len, hash, sizeof(hash));
+}
 
-  if ((bio = BIO_new(BIO_s_mem())) == NULL)
-    lose_no_memory();
+/*
+ * Return the DER encoding of the fileList, rebuilding the cached copy
+ * from the per-entry encodings if anything has changed.
+ */
 
-  if (!i2d_PrivateKey_bio(bio, self->pkey))
-    lose_openssl_error("Unable to write private key");
+static const unsigned char *
+manifest_builder_file_list(manifest_builder_object *self, size_t *len)
+{
+  size_t i, body_len = 0, hdr_len;
+  unsigned char *p;
 
-  result = BIO_to_PyString_helper(bio);
+  if (!self->dirty && self->file_list != NULL) {
+    *len = self->file_list_len;
+    return self->file_list;
+  }
 
- error:                         /* Fall through */
-  BIO_free(bio);
-  return result;
-}
+  for (i = 0; i < self->n_entries; i++)
+    body_len += self->entries[i].der_len;
 
-static char asymmetric_object_der_write_public__doc__[] =
-  "Return the DER encoding of an \"Asymmetric\" public key.\n"
-  ;
+  hdr_len = manifest_builder_der_header(NULL, 0x30, body_len);
 
-static PyObject *
-asymmetric_object_der_write_public(asymmetric_object *self)
-{
-  PyObject *result = NULL;
-  BIO *bio = NULL;
+  PyMem_Free(self->file_list);
+  self->file_list = NULL;
 
-  ENTERING(asymmetric_object_der_write_public);
+  if ((self->file_list = p = PyMem_Malloc(hdr_len + body_len)) == NULL)
+    return (const unsigned char *) PyErr_NoMemory();
 
-  if ((bio = BIO_new(BIO_s_mem())) == NULL)
-    lose_no_memory();
+  p += manifest_builder_der_header(p, 0x30, body_len);
 
-  if (!i2d_PUBKEY_bio(bio, self->pkey))
-    lose_openssl_error("Unable to write public key");
+  for (i = 0; i < self->n_entries; i++) {
+    memcpy(p, self->entries[i].der, self->entries[i].der_len);
+    p += self->entries[i].der_len;
+  }
 
-  result = BIO_to_PyString_helper(bio);
+  self->file_list_len = hdr_len + body_len;
+  self->dirty = 0;
 
- error:                         /* Fall through */
-  BIO_free(bio);
-  return result;
+  *len = self->file_list_len;
+  return self->file_list;
 }
 
-static char asymmetric_object_generate_rsa__doc__[] =
-  "Generate a new RSA keypair.\n"
-  "\n"
-  "Optional argument key_size is the desired key size, in bits;\n"
-  "if not specified, the default is 2048."
-  ;
-
 static PyObject *
-asymmetric_object_generate_rsa(PyTypeObject *type, PyObject *args, PyObject *kwds)
+manifest_builder_object_new(PyTypeObject *type, GCC_UNUSED PyObject *args, GCC_UNUSED PyObject *kwds)
 {
-  static char *kwlist[] = {"key_size", NULL};
-  asymmetric_object *self = NULL;
-  EVP_PKEY_CTX *ctx = NULL;
-  int key_size = 2048;
-  int ok = 0;
-
-  ENTERING(asymmetric_object_generate_rsa);
-
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|i", kwlist, &key_size))
-    goto error;
+  manifest_builder_object *self = NULL;
 
-  if ((self = (asymmetric_object *) asymmetric_object_new(type, NULL, NULL)) == NULL)
-    goto error;
-
-  /*
-   * Explictly setting RSA_F4 would be tedious, as it requires messing
-   * about with bignums, and F4 is the default, so we leave it alone.
-   * In case this ever changes, the required sequence would be:
-   * BN_new(), BN_set_word(), EVP_PKEY_CTX_set_rsa_keygen_pubexp(),
-   * BN_free().
-   */
+  ENTERING(manifest_builder_object_new);
 
-  if ((ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, NULL)) == NULL ||
-      EVP_PKEY_keygen_init(ctx) <= 0 ||
-      EVP_PKEY_CTX_set_rsa_keygen_bits(ctx, key_size) <= 0 ||
-      EVP_PKEY_keygen(ctx, &self->pkey) <= 0)
-    lose_openssl_error("Couldn't generate new RSA key");
+  if ((self = (manifest_builder_object *) type->tp_alloc(type, 0)) == NULL)
+    return NULL;
 
-  ok = 1;
+  self->entries = NULL;
+  self->n_entries = self->max_entries = 0;
+  self->file_list = NULL;
+  self->file_list_len = 0;
+  self->dirty = 1;
+  self->generation = 0;
 
- error:
-  EVP_PKEY_CTX_free(ctx);
+  return (PyObject *) self;
+}
 
-  if (ok)
-    return (PyObject *) self;
+static void
+manifest_builder_object_dealloc(manifest_builder_object *self)
+{
+  size_t i;
 
-  Py_XDECREF(self);
-  return NULL;
+  ENTERING(manifest_builder_object_dealloc);
+
+  for (i = 0; i < self->n_entries; i++) {
+    PyMem_Free(self->entries[i].name);
+    PyMem_Free(self->entries[i].der);
+  }
+
+  PyMem_Free(self->entries);
+  PyMem_Free(self->file_list);
+  self->ob_type->tp_free((PyObject*) self);
 }
 
-static char asymmetric_object_generate_from_params__doc__[] =
-  "Generate a new keypair using an AsymmetricParams object.\n"
+static char manifest_builder_object_add__doc__[] =
+  "Add or replace an entry, given the filename and its hash.\n"
   ;
 
 static PyObject *
-asymmetric_object_generate_from_params(PyTypeObject *type, PyObject *args)
+manifest_builder_object_add(manifest_builder_object *self, PyObject *args)
 {
-  asymmetric_params_object *params = NULL;
-  asymmetric_object *self = NULL;
-  EVP_PKEY_CTX *ctx = NULL;
-  int ok = 0;
+  char *name = NULL, *hash = NULL;
+  Py_ssize_t name_len, hash_len;
 
-  ENTERING(asymmetric_object_generate_from_params);
+  ENTERING(manifest_builder_object_add);
 
-  if (!PyArg_ParseTuple(args, "O!", &POW_AsymmetricParams_Type, &params))
-    goto error;
+  if (!PyArg_ParseTuple(args, "s#s#", &name, &name_len, &hash, &hash_len))
+    return NULL;
 
-  if ((self = (asymmetric_object *) asymmetric_object_new(type, NULL, NULL)) == NULL)
-    goto error;
+  if (!manifest_builder_set(self, name, name_len, (unsigned char *) hash, hash_len))
+    return NULL;
 
-  if ((ctx = EVP_PKEY_CTX_new(params->pkey, NULL)) == NULL ||
-      EVP_PKEY_keygen_init(ctx) <= 0 ||
-      EVP_PKEY_keygen(ctx, &self->pkey) <= 0)
-    lose_openssl_error("Couldn't generate new key");
+  Py_RETURN_NONE;
+}
 
-  whack_ec_key_to_namedCurve(self->pkey);
+static char manifest_builder_object_add_object__doc__[] =
+  "Add or replace an entry, given the filename and the DER of the object.\n"
+  "\n"
+  "The object is hashed with SHA-256 here, so callers need not do it.\n"
+  ;
 
-  ok = 1;
+static PyObject *
+manifest_builder_object_add_object(manifest_builder_object *self, PyObject *args)
+{
+  char *name = NULL, *der = NULL;
+  Py_ssize_t name_len, der_len;
 
- error:
-  EVP_PKEY_CTX_free(ctx);
+  ENTERING(manifest_builder_object_add_object);
 
-  if (ok)
-    return (PyObject *) self;
+  if (!PyArg_ParseTuple(args, "s#s#", &name, &name_len, &der, &der_len))
+    return NULL;
 
-  Py_XDECREF(self);
-  return NULL;
+  if (!manifest_builder_set_object(self, name, name_len, (unsigned char *) der, der_len))
+    return NULL;
+
+  Py_RETURN_NONE;
 }
 
-static char asymmetric_object_calculate_ski__doc__[] =
-  "Calculate SKI value for this key.\n"
-  "\n"
-  "The SKI is the SHA-1 hash of key's SubjectPublicKey value.\n"
+static char manifest_builder_object_remove__doc__[] =
+  "Remove an entry by filename.  Returns True if there was such an entry.\n"
   ;
 
 static PyObject *
-asymmetric_object_calculate_ski(asymmetric_object *self)
+manifest_builder_object_remove(manifest_builder_object *self, PyObject *args)
 {
-  PyObject *result = NULL;
-  X509_PUBKEY *pubkey = NULL;
-  unsigned char digest[EVP_MAX_MD_SIZE];
-  unsigned digest_length;
-  const unsigned char *key_data = NULL;
-  int key_length;
+  char *name = NULL;
+  Py_ssize_t name_len;
+  size_t i;
+  int found;
 
-  ENTERING(asymmetric_object_calculate_ski);
+  ENTERING(manifest_builder_object_remove);
 
-  if (!X509_PUBKEY_set(&pubkey, self->pkey) ||
-      !X509_PUBKEY_get0_param(NULL, &key_data, &key_length, NULL, pubkey))
-    lose_openssl_error("Couldn't extract public key");
+  if (!PyArg_ParseTuple(args, "s#", &name, &name_len))
+    return NULL;
 
-  if (!EVP_Digest(key_data, key_length, digest, &digest_length, EVP_sha1(), NULL))
-    lose_openssl_error("Couldn't calculate SHA-1 digest of public key");
+  i = manifest_builder_find(self, name, name_len, &found);
 
-  result = PyString_FromStringAndSize((char *) digest, digest_length);
+  if (found)
+    manifest_builder_delete(self, i);
 
- error:
-  X509_PUBKEY_free(pubkey);
-  return result;
+  return PyBool_FromLong(found);
 }
 
-static struct PyMethodDef asymmetric_object_methods[] = {
-  Define_Method(pemWritePrivate,          asymmetric_object_pem_write_private,          METH_VARARGS),
-  Define_Method(pemWritePublic,           asymmetric_object_pem_write_public,           METH_NOARGS),
-  Define_Method(derWritePrivate,          asymmetric_object_der_write_private,          METH_NOARGS),
-  Define_Method(derWritePublic,           asymmetric_object_der_write_public,           METH_NOARGS),
-  Define_Method(calculateSKI,             asymmetric_object_calculate_ski,              METH_NOARGS),
-  Define_Class_Method(pemReadPublic,      asymmetric_object_pem_read_public,            METH_VARARGS),
-  Define_Class_Method(pemReadPublicFile,  asymmetric_object_pem_read_public_file,       METH_VARARGS),
-  Define_Class_Method(derReadPublic,      asymmetric_object_der_read_public,            METH_VARARGS),
-  Define_Class_Method(derReadPublicFile,  asymmetric_object_der_read_public_file,       METH_VARARGS),
-  Define_Class_Method(pemReadPrivate,     asymmetric_object_pem_read_private,           METH_VARARGS),
-  Define_Class_Method(pemReadPrivateFile, asymmetric_object_pem_read_private_file,      METH_VARARGS),
-  Define_Class_Method(derReadPrivate,     asymmetric_object_der_read_private,           METH_VARARGS),
-  Define_Class_Method(derReadPrivateFile, asymmetric_object_der_read_private_file,      METH_VARARGS),
-  Define_Class_Method(generateRSA,        asymmetric_object_generate_rsa,               METH_KEYWORDS),
-  Define_Class_Method(generateFromParams, asymmetric_object_generate_from_params,       METH_VARARGS),
-  {NULL}
-};
-
-static char POW_Asymmetric_Type__doc__[] =
-  "Container for OpenSSL's EVP_PKEY asymmetric key classes.\n"
+static char manifest_builder_object_sync__doc__[] =
+  "Make the entries match a complete set of objects.\n"
+  "\n"
+  "The \"iterable\" parameter should supply (filename, DER) pairs.  Each\n"
+  "object is hashed and added or replaced as with .addObject(), and any\n"
+  "existing entry not mentioned is removed.  Entries whose hash did not\n"
+  "change keep their cached encoding.\n"
   ;
 
-static PyTypeObject POW_Asymmetric_Type = {
-  PyObject_HEAD_INIT(0)
-  0,                                     /* ob_size */
-  "rpki.POW.Asymmetric",                 /* tp_name */
-  sizeof(asymmetric_object),             /* tp_basicsize */
-  0,                                     /* tp_itemsize */
-  (destructor)asymmetric_object_dealloc, /* tp_dealloc */
-  0,                                     /* tp_print */
-  0,                                     /* tp_getattr */
-  0,                                     /* tp_setattr */
-  0,                                     /* tp_compare */
-  0,                                     /* tp_repr */
-  0,                                     /* tp_as_number */
-  0,                                     /* tp_as_sequence */
-  0,                                     /* tp_as_mapping */
-  0,                                     /* tp_hash */
-  0,                                     /* tp_call */
-  0,                                     /* tp_str */
-  0,                                     /* tp_getattro */
-  0,                                     /* tp_setattro */
-  0,                                     /* tp_as_buffer */
-  Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, /* tp_flags */
-  POW_Asymmetric_Type__doc__,            /* tp_doc */
-  0,                                     /* tp_traverse */
-  0,                                     /* tp_clear */
-  0,                                     /* tp_richcompare */
-  0,                                     /* tp_weaklistoffset */
-  0,                                     /* tp_iter */
-  0,                                     /* tp_iternext */
-  asymmetric_object_methods,             /* tp_methods */
-  0,                                     /* tp_members */
-  0,                                     /* tp_getset */
-  0,                                     /* tp_base */
-  0,                                     /* tp_dict */
-  0,                                     /* tp_descr_get */
-  0,                                     /* tp_descr_set */
-  0,                                     /* tp_dictoffset */
-  (initproc) asymmetric_object_init,     /* tp_init */
-  0,                                     /* tp_alloc */
-  asymmetric_object_new,                 /* tp_new */
-};
-
-
-
-/*
- * AsymmetricParams object.
- */
-
 static PyObject *
-asymmetric_params_object_new(PyTypeObject *type, GCC_UNUSED PyObject *args, GCC_UNUSED PyObject *kwds)
+manifest_builder_object_sync(manifest_builder_object *self, PyObject *args)
 {
-  asymmetric_params_object *self = NULL;
+  PyObject *iterable = NULL;
+  PyObject *iterator = NULL;
+  PyObject *item = NULL;
+  PyObject *fast = NULL;
+  char *name = NULL, *der = NULL;
+  Py_ssize_t name_len, der_len;
+  size_t i;
 
-  ENTERING(asymmetric_params_object_new);
+  ENTERING(manifest_builder_object_sync);
 
-  if ((self = (asymmetric_params_object *) type->tp_alloc(type, 0)) == NULL)
+  if (!PyArg_ParseTuple(args, "O", &iterable) ||
+      (iterator = PyObject_GetIter(iterable)) == NULL)
     goto error;
 
-  self->pkey = NULL;
+  self->generation++;
 
-  return (PyObject *) self;
+  while ((item = PyIter_Next(iterator)) != NULL) {
 
- error:
+    if ((fast = PySequence_Fast(item, "Manifest entry must be a sequence")) == NULL)
+      goto error;
 
-  Py_XDECREF(self);
-  return NULL;
-}
+    if (PySequence_Fast_GET_SIZE(fast) != 2)
+      lose_type_error("Manifest entry must be two-element sequence");
 
-static int
-asymmetric_params_object_init(asymmetric_params_object *self, PyObject *args, PyObject *kwds)
-{
-  static char *kwlist[] = {NULL};
+    if (PyString_AsStringAndSize(PySequence_Fast_GET_ITEM(fast, 0), &name, &name_len) < 0 ||
+        PyString_AsStringAndSize(PySequence_Fast_GET_ITEM(fast, 1), &der, &der_len) < 0 ||
+        !manifest_builder_set_object(self, name, name_len, (unsigned char *) der, der_len))
+      goto error;
 
-  ENTERING(asymmetric_params_object_init);
+    Py_XDECREF(item);
+    Py_XDECREF(fast);
+    item = fast = NULL;
+  }
 
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "", kwlist))
+  if (PyErr_Occurred())
     goto error;
 
-  return 0;
+  for (i = self->n_entries; i > 0; i--)
+    if (self->entries[i - 1].generation != self->generation)
+      manifest_builder_delete(self, i - 1);
+
+  Py_XDECREF(iterator);
+  Py_RETURN_NONE;
 
  error:
-  return -1;
+  Py_XDECREF(iterator);
+  Py_XDECREF(item);
+  Py_XDECREF(fast);
+  return NULL;
 }
 
-static void
-asymmetric_params_object_dealloc(asymmetric_params_object *self)
-{
-  ENTERING(asymmetric_params_object_dealloc);
-  EVP_PKEY_free(self->pkey);
-  self->ob_type->tp_free((PyObject*) self);
-}
+static char manifest_builder_object_get_files__doc__[] =
+  "Return a tuple of <filename, hash> pairs, sorted by filename.\n"
+  ;
 
 static PyObject *
-asymmetric_params_object_pem_read_helper(PyTypeObject *type, BIO *bio)
+manifest_builder_object_get_files(manifest_builder_object *self)
 {
-  asymmetric_params_object *self = NULL;
+  PyObject *result = NULL;
+  PyObject *item = NULL;
+  size_t i;
 
-  ENTERING(asymmetric_params_object_pem_read_helper);
+  ENTERING(manifest_builder_object_get_files);
 
-  if ((self = (asymmetric_params_object *) asymmetric_params_object_new(type, NULL, NULL)) == NULL)
+  if ((result = PyTuple_New(self->n_entries)) == NULL)
     goto error;
 
-  if (!PEM_read_bio_Parameters(bio, &self->pkey))
-    lose_openssl_error("Couldn't load PEM encoded key parameters");
+  for (i = 0; i < self->n_entries; i++) {
+    if ((item = Py_BuildValue("(s#s#)",
+                              self->entries[i].name, (Py_ssize_t) self->entries[i].name_len,
+                              self->entries[i].hash, (Py_ssize_t) self->entries[i].hash_len)) == NULL)
+      goto error;
+    PyTuple_SET_ITEM(result, i, item);
+    item = NULL;
+  }
 
-  return (PyObject *) self;
+  return result;
 
  error:
-
-  Py_XDECREF(self);
+  Py_XDECREF(result);
+  Py_XDECREF(item);
   return NULL;
 }
 
-static char asymmetric_params_object_pem_read__doc__[] =
-  "Read PEM-encoded key parameters from a string.\n"
-  ;
+/*
+ * Write a manifest's eContent to a BIO, using the builder's entries
+ * as its fileList, and leave the Manifest object consistent with what
+ * we wrote.  The fileList is spliced in from cached DER, so only
+ * entries which changed since the last call get re-encoded.
+ */
 
-static PyObject *
-asymmetric_params_object_pem_read(PyTypeObject *type, PyObject *args)
-{
-  ENTERING(asymmetric_params_object_pem_read);
-  return read_from_string_helper(asymmetric_params_object_pem_read_helper, type, args);
-}
+static int
+manifest_builder_write_econtent(manifest_builder_object *self, manifest_object *manifest, BIO *bio)
+{
+  STACK_OF(FileAndHash) *saved = NULL;
+  STACK_OF(FileAndHash) *empty = NULL;
+  const unsigned char *file_list = NULL;
+  size_t file_list_len = 0, prefix_len, outer_len;
+  unsigned char *header = NULL, *content = NULL, *p;
+  const unsigned char *q;
+  Manifest *decoded = NULL;
+  long body_len;
+  int header_len, tag, xclass;
+  int ok = 0;
 
-static char asymmetric_params_object_pem_read_file__doc__[] =
-  "Read PEM-encoded key parameters from a file.\n"
-  ;
+  if (!manifest_object_decode(manifest))
+    goto error;
 
-static PyObject *
-asymmetric_params_object_pem_read_file(PyTypeObject *type, PyObject *args)
-{
-  ENTERING(asymmetric_params_object_pem_read_file);
-  return read_from_file_helper(asymmetric_params_object_pem_read_helper, type, args);
-}
+  if (manifest->manifest == NULL)
+    lose_not_verified("Can't sign unverified manifest");
 
-static char asymmetric_params_object_pem_write__doc__[] =
-  "Return the PEM encoding of this set of key parameters, as a string.\n"
-  ;
+  if ((file_list = manifest_builder_file_list(self, &file_list_len)) == NULL)
+    goto error;
 
-static PyObject *
-asymmetric_params_object_pem_write(asymmetric_params_object *self)
-{
-  PyObject *result = NULL;
-  BIO *bio = NULL;
+  /*
+   * Encode everything but the fileList by encoding the manifest with
+   * an empty fileList, which always comes out as 0x30 0x00 at the end.
+   */
 
-  ENTERING(asymmetric_params_object_pem_write);
+  if ((empty = sk_FileAndHash_new_null()) == NULL)
+    lose_no_memory();
 
-  if ((bio = BIO_new(BIO_s_mem())) == NULL)
+  saved = manifest->manifest->fileList;
+  manifest->manifest->fileList = empty;
+  header_len = i2d_Manifest(manifest->manifest, &header);
+  manifest->manifest->fileList = saved;
+
+  if (header_len <= 0)
+    lose_openssl_error("Couldn't encode manifest");
+
+  q = header;
+
+  if (ASN1_get_object(&q, &body_len, &tag, &xclass, header_len) & 0x80)
+    lose_openssl_error("Couldn't parse encoded manifest");
+
+  if (body_len < 2 || q + body_len != header + header_len || q[body_len - 2] != 0x30 || q[body_len - 1] != 0x00)
+    lose("Unexpected encoding of empty manifest fileList");
+
+  prefix_len = body_len - 2;
+  outer_len = manifest_builder_der_header(NULL, 0x30, prefix_len + file_list_len);
+
+  if ((content = p = PyMem_Malloc(outer_len + prefix_len + file_list_len)) == NULL)
     lose_no_memory();
 
-  if (PEM_write_bio_Parameters(bio, self->pkey) <= 0)
-    lose_openssl_error("Unable to write key parameters");
+  p += manifest_builder_der_header(p, 0x30, prefix_len + file_list_len);
+  memcpy(p, q, prefix_len);
+  p += prefix_len;
+  memcpy(p, file_list, file_list_len);
+  p += file_list_len;
+
+  if (BIO_write(bio, content, p - content) != p - content)
+    lose_openssl_error("Couldn't write manifest");
+
+  q = content;
+
+  if ((decoded = d2i_Manifest(NULL, &q, p - content)) == NULL)
+    lose_openssl_error("Couldn't decode spliced manifest");
 
-  result = BIO_to_PyString_helper(bio);
+  Manifest_free(manifest->manifest);
+  manifest->manifest = decoded;
 
- error:                         /* Fall through */
-  BIO_free(bio);
-  return result;
+  ok = 1;
+
+ error:
+  sk_FileAndHash_free(empty);
+  OPENSSL_free(header);
+  PyMem_Free(content);
+  return ok;
 }
 
-static char asymmetric_params_object_generate_ec__doc__[] =
-  "Generate a new set of EC parameters.\n"
+static char manifest_builder_object_sign__doc__[] =
+  "Sign a manifest using this builder's entries as its fileList.\n"
   "\n"
-  "Optional argument curve is a numeric code representing the curve to use;\n"
-  "if not specified, the default is P-256."
+  "The \"manifest\" parameter is a Manifest object whose version,\n"
+  "manifestNumber, thisUpdate, nextUpdate, and fileHashAlg have already\n"
+  "been set; any files it already lists are replaced.  The remaining\n"
+  "parameters are as for Manifest.sign().\n"
+  "\n"
+  "The fileList is spliced into the eContent from cached DER, so only\n"
+  "entries which changed since the last call get re-encoded.\n"
   ;
 
 static PyObject *
-asymmetric_params_object_generate_ec(PyTypeObject *type, PyObject *args, PyObject *kwds)
+manifest_builder_object_sign(manifest_builder_object *self, PyObject *args, PyObject *kwds)
 {
-  static char *kwlist[] = {"curve", NULL};
-  asymmetric_params_object *self = NULL;
-  EVP_PKEY_CTX *ctx = NULL;
-  int curve = NID_X9_62_prime256v1;
+  static char *kwlist[] = {"manifest", "signcert", "key", "certs", "crls", "eContentType", "flags", NULL};
+  manifest_object *manifest = NULL;
+  asymmetric_object *signkey = NULL;
+  x509_object *signcert = NULL;
+  PyObject *x509_iterable = Py_None;
+  PyObject *crl_iterable = Py_None;
+  char *oid = NULL;
+  unsigned flags = 0;
+  BIO *bio = NULL;
   int ok = 0;
 
-  ENTERING(asymmetric_params_object_generate_ec);
+  ENTERING(manifest_builder_object_sign);
 
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|i", kwlist, &curve))
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!O!O!|OOzI", kwlist,
+                                   &POW_Manifest_Type, &manifest,
+                                   &POW_X509_Type, &signcert,
+                                   &POW_Asymmetric_Type, &signkey,
+                                   &x509_iterable,
+                                   &crl_iterable,
+                                   &oid,
+                                   &flags))
     goto error;
 
-  if ((self = (asymmetric_params_object *) asymmetric_params_object_new(type, NULL, NULL)) == NULL)
+  if ((bio = BIO_new(BIO_s_mem())) == NULL)
+    lose_no_memory();
+
+  if (!manifest_builder_write_econtent(self, manifest, bio))
     goto error;
 
-  if ((ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL)) == NULL ||
-      EVP_PKEY_paramgen_init(ctx) <= 0 ||
-      EVP_PKEY_CTX_set_ec_paramgen_curve_nid(ctx, curve) <= 0 ||
-      EVP_PKEY_paramgen(ctx, &self->pkey) <= 0)
-    lose_openssl_error("Couldn't generate key parameters");
+  if (!cms_object_sign_helper(&manifest->cms, bio, signcert, signkey,
+                              x509_iterable, crl_iterable, oid, flags))
+    lose_openssl_error("Couldn't sign manifest");
 
   ok = 1;
 
  error:
-  EVP_PKEY_CTX_free(ctx);
+  BIO_free(bio);
 
   if (ok)
-    return (PyObject *) self;
-
-  Py_XDECREF(self);
-  return NULL;
+    Py_RETURN_NONE;
+  else
+    return NULL;
 }
 
-static char asymmetric_params_object_generate_dh__doc__[] =
-  "Generate a new set of DH parameters.\n"
-  "\n"
-  "Optional argument prime_length is length of the DH prime parameter\n"
-  "to use, in bits; if not specified, the default is 2048 bits.\n"
+static struct PyMethodDef manifest_builder_object_methods[] = {
+  Define_Method(add,			manifest_builder_object_add,            METH_VARARGS),
+  Define_Method(addObject,		manifest_builder_object_add_object,     METH_VARARGS),
+  Define_Method(remove,			manifest_builder_object_remove,         METH_VARARGS),
+  Define_Method(sync,			manifest_builder_object_sync,           METH_VARARGS),
+  Define_Method(getFiles,		manifest_builder_object_get_files,      METH_NOARGS),
+  Define_Method(sign,			manifest_builder_object_sign,           METH_KEYWORDS),
+  {NULL}
+};
+
+static char POW_ManifestBuilder_Type__doc__[] =
+  "Incremental builder for manifest fileLists.\n"
   "\n"
-  "Be warned that generating DH parameters with a 2048-bit prime may\n"
-  "take a ridiculously long time.\n"
+  "A ManifestBuilder keeps a sorted index of (filename, hash) entries,\n"
+  "each with its DER encoding cached, plus a cached encoding of the\n"
+  "whole fileList.  A CA which keeps one of these around between manifest\n"
+  "regenerations only pays for the entries which actually changed,\n"
+  "rather than rebuilding and re-encoding the whole list every time.\n"
   ;
 
-static PyObject *
-asymmetric_params_object_generate_dh(PyTypeObject *type, PyObject *args, PyObject *kwds)
-{
-  static char *kwlist[] = {"prime_length", NULL};
-  asymmetric_params_object *self = NULL;
-  EVP_PKEY_CTX *ctx = NULL;
-  int prime_length = 2048;
-  int ok = 0;
-
-  ENTERING(asymmetric_params_object_generate_dh);
+static PyTypeObject POW_ManifestBuilder_Type = {
+  PyObject_HEAD_INIT(0)
+  0,                                        /* ob_size */
+  "rpki.POW.ManifestBuilder",               /* tp_name */
+  sizeof(manifest_builder_object),          /* tp_basicsize */
+  0,                                        /* tp_itemsize */
+  (destructor)manifest_builder_object_dealloc, /* tp_dealloc */
+  0,                                        /* tp_print */
+  0,                                        /* tp_getattr */
+  0,                                        /* tp_setattr */
+  0,                                        /* tp_compare */
+  0,                                        /* tp_repr */
+  0,                                        /* tp_as_number */
+  0,                                        /* tp_as_sequence */
+  0,                                        /* tp_as_mapping */
+  0,                                        /* tp_hash */
+  0,                                        /* tp_call */
+  0,                                        /* tp_str */
+  0,                                        /* tp_getattro */
+  0,                                        /* tp_setattro */
+  0,                                        /* tp_as_buffer */
+  Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, /* tp_flags */
+  POW_ManifestBuilder_Type__doc__,          /* tp_doc */
+  0,                                        /* tp_traverse */
+  0,                                        /* tp_clear */
+  0,                                        /* tp_richcompare */
+  0,                                        /* tp_weaklistoffset */
+  0,                                        /* tp_iter */
+  0,                                        /* tp_iternext */
+  manifest_builder_object_methods,          /* tp_methods */
+  0,                                        /* tp_members */
+  0,                                        /* tp_getset */
+  0,                                        /* tp_base */
+  0,                                        /* tp_dict */
+  0,                                        /* tp_descr_get */
+  0,                                        /* tp_descr_set */
+  0,                                        /* tp_dictoffset */
+  0,                                        /* tp_init */
+  0,                                        /* tp_alloc */
+  manifest_builder_object_new,              /* tp_new */
+};
 
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|i", kwlist, &prime_length))
-    goto error;
 
-  if ((self = (asymmetric_params_object *) asymmetric_params_object_new(type, NULL, NULL)) == NULL)
-    goto error;
+
 
-  if ((ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_DH, NULL)) == NULL ||
-      EVP_PKEY_paramgen_init(ctx) <= 0 ||
-      EVP_PKEY_CTX_set_dh_paramgen_prime_len(ctx, prime_length) <= 0 ||
-      EVP_PKEY_paramgen(ctx, &self->pkey) <= 0)
-    lose_openssl_error("Couldn't generate key parameters");
+/*
+ * ROA object.
+ */
 
-  ok = 1;
+static PyObject *
+roa_object_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+  roa_object *self = NULL;
 
- error:
-  EVP_PKEY_CTX_free(ctx);
+  ENTERING(roa_object_new);
 
-  if (ok)
+  if ((self = (roa_object *) cms_object_new(type, args, kwds)) != NULL &&
+      (self->roa = ROA_new()) != NULL)
     return (PyObject *) self;
 
   Py_XDECREF(self);
   return NULL;
 }
 
-static char asymmetric_params_object_generate_dsa__doc__[] =
-  "Generate a new set of DSA parameters.\n"
-  "\n"
-  "Optional argument key_length is the length of the key to generate, in bits;\n"
-  "if not specified, the default is 2048 bits."
-  ;
+static void
+roa_object_dealloc(roa_object *self)
+{
+  ENTERING(roa_object_dealloc);
+  ROA_free(self->roa);
+  OPENSSL_free(self->econtent);
+  cms_object_dealloc(&self->cms);
+}
 
-static PyObject *
-asymmetric_params_object_generate_dsa(PyTypeObject *type, PyObject *args, PyObject *kwds)
+/*
+ * Take ownership of a DER-encoded eContent buffer (allocated with
+ * OPENSSL_malloc()), replacing any DER this object held before.  The
+ * buffer is freed on failure.  Caller is responsible for making sure
+ * the ASN.1 structure, if any, matches.
+ */
+
+static int
+roa_object_set_econtent(roa_object *self, unsigned char *der, size_t len)
 {
-  static char *kwlist[] = {"key_length", NULL};
-  asymmetric_params_object *self = NULL;
-  EVP_PKEY_CTX *ctx = NULL;
-  int key_length = 2048;
-  int ok = 0;
+  roa_view_t view;
 
-  ENTERING(asymmetric_params_object_generate_dsa);
+  if (!roa_view_parse(&view, der, len)) {
+    OPENSSL_free(der);
+    lose("Couldn't decode ROA");
+  }
 
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|i", kwlist, &key_length))
-    goto error;
+  OPENSSL_free(self->econtent);
+  self->econtent = der;
+  self->econtent_len = len;
+  self->view = view;
+  return 1;
 
-  if ((self = (asymmetric_params_object *) asymmetric_params_object_new(type, NULL, NULL)) == NULL)
-    goto error;
+ error:
+  return 0;
+}
 
-  if ((ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_DSA, NULL)) == NULL ||
-      EVP_PKEY_paramgen_init(ctx) <= 0 ||
-      EVP_PKEY_CTX_set_dsa_paramgen_bits(ctx, key_length) <= 0 ||
-      EVP_PKEY_paramgen(ctx, &self->pkey) <= 0)
-    lose_openssl_error("Couldn't generate key parameters");
+/*
+ * Replace this object's contents with a copy of a CMS eContent.
+ * We check the structure here, but put off building the ASN.1
+ * structure until something asks for it.
+ */
 
-  ok = 1;
+static int
+roa_object_read_econtent(roa_object *self, const ASN1_OCTET_STRING *econtent)
+{
+  unsigned char *der = NULL;
+  size_t len = econtent->length;
 
- error:
-  EVP_PKEY_CTX_free(ctx);
+  if ((der = OPENSSL_malloc(len > 0 ? len : 1)) == NULL)
+    lose_no_memory();
 
-  if (ok)
-    return (PyObject *) self;
+  memcpy(der, econtent->data, len);
 
-  Py_XDECREF(self);
-  return NULL;
+  if (!roa_object_set_econtent(self, der, len))
+    goto error;
+
+  ROA_free(self->roa);
+  self->roa = NULL;
+  return 1;
+
+ error:
+  return 0;
 }
 
-static struct PyMethodDef asymmetric_params_object_methods[] = {
-  Define_Method(pemWrite,               asymmetric_params_object_pem_write,             METH_NOARGS),
-  Define_Class_Method(pemRead,          asymmetric_params_object_pem_read,              METH_VARARGS),
-  Define_Class_Method(pemReadFile,      asymmetric_params_object_pem_read_file,         METH_VARARGS),
-  Define_Class_Method(generateEC,       asymmetric_params_object_generate_ec,		METH_KEYWORDS),
-  Define_Class_Method(generateDH,	asymmetric_params_object_generate_dh,           METH_KEYWORDS),
-  Define_Class_Method(generateDSA,	asymmetric_params_object_generate_dsa,          METH_KEYWORDS),
-  {NULL}
-};
+/*
+ * Make sure the ASN.1 structure is current, for methods which read or
+ * modify it.  After this returns, the object no longer holds DER, so
+ * any changes the caller makes are safe.
+ */
 
-static char POW_AsymmetricParams_Type__doc__[] =
-  "Container for OpenSSL's EVP_PKEY asymmetric key parameter classes.\n"
-  ;
+static int
+roa_object_decode(roa_object *self)
+{
+  const unsigned char *p = self->econtent;
+  ROA *roa;
 
-static PyTypeObject POW_AsymmetricParams_Type = {
-  PyObject_HEAD_INIT(0)
-  0,                                     /* ob_size */
-  "rpki.POW.AsymmetricParams",           /* tp_name */
-  sizeof(asymmetric_params_object),      /* tp_basicsize */
-  0,                                     /* tp_itemsize */
-  (destructor)asymmetric_params_object_dealloc, /* tp_dealloc */
-  0,                                     /* tp_print */
-  0,                                     /* tp_getattr */
-  0,                                     /* tp_setattr */
-  0,                                     /* tp_compare */
-  0,                                     /* tp_repr */
-  0,                                     /* tp_as_number */
-  0,                                     /* tp_as_sequence */
-  0,                                     /* tp_as_mapping */
-  0,                                     /* tp_hash */
-  0,                                     /* tp_call */
-  0,                                     /* tp_str */
-  0,                                     /* tp_getattro */
-  0,                                     /* tp_setattro */
-  0,                                     /* tp_as_buffer */
-  Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, /* tp_flags */
-  POW_AsymmetricParams_Type__doc__,      /* tp_doc */
-  0,                                     /* tp_traverse */
-  0,                                     /* tp_clear */
-  0,                                     /* tp_richcompare */
-  0,                                     /* tp_weaklistoffset */
-  0,                                     /* tp_iter */
-  0,                                     /* tp_iternext */
-  asymmetric_params_object_methods,      /* tp_methods */
-  0,                                     /* tp_members */
-  0,                                     /* tp_getset */
-  0,                                     /* tp_base */
-  0,                                     /* tp_dict */
-  0,                                     /* tp_descr_get */
-  0,                                     /* tp_descr_set */
-  0,                                     /* tp_dictoffset */
-  (initproc) asymmetric_params_object_init, /* tp_init */
-  0,                                     /* tp_alloc */
-  asymmetric_params_object_new,          /* tp_new */
-};
+  if (self->econtent == NULL)
+    return 1;
 
-
+  if (self->roa == NULL) {
+    if ((roa = (ROA *) ASN1_item_d2i(NULL, &p, self->econtent_len, ASN1_ITEM_rptr(ROA))) == NULL)
+      lose_openssl_error("Couldn't decode ROA");
+    self->roa = roa;
+  }
+
+  OPENSSL_free(self->econtent);
+  self->econtent = NULL;
+  self->econtent_len = 0;
+  return 1;
+
+ error:
+  return 0;
+}
 
 /*
- * Digest object.
+ * Make sure the DER is current, for methods which read it through the
+ * view.  This is a no-op for objects we got from .verify(); objects
+ * built or modified locally get encoded here.
  */
 
-static PyObject *
-digest_object_new(PyTypeObject *type, GCC_UNUSED PyObject *args, GCC_UNUSED PyObject *kwds)
+static int
+roa_object_encode(roa_object *self)
 {
-  digest_object *self = NULL;
+  unsigned char *der = NULL;
+  int len;
 
-  ENTERING(digest_object_new);
+  if (self->econtent != NULL)
+    return 1;
 
-  if ((self = (digest_object *) type->tp_alloc(type, 0)) == NULL)
-    goto error;
+  if (self->roa == NULL)
+    return 1;
 
-  self->digest_type = 0;
+  if ((len = ASN1_item_i2d((ASN1_VALUE *) self->roa, &der, ASN1_ITEM_rptr(ROA))) <= 0)
+    lose_openssl_error("Couldn't encode ROA");
 
-  return (PyObject *) self;
+  return roa_object_set_econtent(self, der, len);
 
  error:
-  return NULL;
+  return 0;
 }
 
+/*
+ * Write this object's eContent to a BIO for signing, using the DER we
+ * already have if we have it.
+ */
+
 static int
-digest_object_init(digest_object *self, PyObject *args, PyObject *kwds)
+roa_object_write_econtent(roa_object *self, BIO *bio)
 {
-  static char *kwlist[] = {"digest_type", NULL};
-  const EVP_MD *digest_method = NULL;
-  int digest_type = 0;
+  if (self->econtent != NULL)
+    return BIO_write(bio, self->econtent, self->econtent_len) == (int) self->econtent_len;
+  else
+    return ASN1_item_i2d_bio(ASN1_ITEM_rptr(ROA), bio, self->roa);
+}
 
-  ENTERING(digest_object_init);
+static char roa_object_verify__doc__[] =
+  "Verify this ROA against a trusted certificate store.\n"
+  "\n"
+  CMS_OBJECT_VERIFY_HELPER__DOC__
+  ;
 
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "i", kwlist, &digest_type))
-    goto error;
+static PyObject *
+roa_object_verify(roa_object *self, PyObject *args, PyObject *kwds)
+{
+  ASN1_OCTET_STRING *econtent;
+  int ok = 0;
 
-  if ((digest_method = evp_digest_factory(digest_type)) == NULL)
-    lose("Unsupported digest algorithm");
+  ENTERING(roa_object_verify);
 
-  self->digest_type = digest_type;
-  if (!EVP_DigestInit(&self->digest_ctx, digest_method))
-    lose_openssl_error("Couldn't initialize digest");
+  if ((econtent = cms_object_verify_helper(&self->cms, args, kwds)) == NULL)
+    goto error;
+  
+  if (!roa_object_read_econtent(self, econtent))
+    goto error;
 
-  return 0;
+  ok = 1;
 
  error:
-  return -1;
+  if (ok)
+    Py_RETURN_NONE;
+  else
+    return NULL;
 }
 
-static void
-digest_object_dealloc(digest_object *self)
-{
-  ENTERING(digest_object_dealloc);
-  EVP_MD_CTX_cleanup(&self->digest_ctx);
-  self->ob_type->tp_free((PyObject*) self);
-}
 
-static char digest_object_update__doc__[] =
-  "Add data to this digest.\n"
+static char roa_object_extract_without_verifying__doc__[] =
+  "Extract ROA payload from CMS wrapper without attempting CMS verification.\n"
   "\n"
-  "the \"data\" parameter should be a string containing the data to be added.\n"
+  "NEVER USE THIS METHOD ON AN UNVERIFIED ROA!\n"
   ;
 
 static PyObject *
-digest_object_update(digest_object *self, PyObject *args)
+roa_object_extract_without_verifying(roa_object *self)
 {
-  char *data = NULL;
-  Py_ssize_t len = 0;
+  ASN1_OCTET_STRING *econtent;
+  int ok = 0;
 
-  ENTERING(digest_object_update);
+  ENTERING(roa_object_extract_without_verifying);
 
-  if (!PyArg_ParseTuple(args, "s#", &data, &len))
+  if ((econtent = cms_object_extract_without_verifying_helper(&self->cms)) == NULL)
     goto error;
 
-  if (!EVP_DigestUpdate(&self->digest_ctx, data, len))
-    lose_openssl_error("EVP_DigestUpdate() failed");
+  if (!roa_object_read_econtent(self, econtent))
+    goto error;
 
-  Py_RETURN_NONE;
+  ok = 1;
 
  error:
-  return NULL;
+  if (ok)
+    Py_RETURN_NONE;
+  else
+    return NULL;
 }
 
-static char digest_object_copy__doc__[] =
-  "Return a copy of this Digest object.\n"
+static char roa_object_check_rpki_conformance__doc__[] =
+  "Check this ROA for conformance to the RPKI profile.\n"
   ;
 
 static PyObject *
-digest_object_copy(digest_object *self)
+roa_object_check_rpki_conformance(roa_object *self, PyObject *args, PyObject *kwds)
 {
-  digest_object *new = NULL;
+  static char *kwlist[] = {"status", NULL};
+  PyObject *status = Py_None;
 
-  ENTERING(digest_object_copy);
+  ENTERING(roa_object_check_rpki_conformance);
 
-  if ((new = (digest_object *) digest_object_new(&POW_Digest_Type, NULL, NULL)) == NULL)
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!", kwlist, &PySet_Type, &status))
     goto error;
 
-  new->digest_type = self->digest_type;
-  if (!EVP_MD_CTX_copy(&new->digest_ctx, &self->digest_ctx))
-    lose_openssl_error("Couldn't copy digest");
+  if (!roa_object_decode(self))
+    goto error;
 
-  return (PyObject*) new;
+  if (!check_cms(self->cms.cms, status) || !check_roa(self->cms.cms, self->roa, status))
+    goto error;
 
- error:
+  Py_RETURN_NONE;
 
-  Py_XDECREF(new);
+ error:
   return NULL;
 }
 
-static char digest_object_digest__doc__[] =
-  "Return the digest of all the data which this Digest object has processed.\n"
-  "\n"
-  "This method can be called at any time and will not effect the internal\n"
-  "state of the Digest object.\n"
-  ;
+static PyObject *
+roa_object_pem_read_helper(PyTypeObject *type, BIO *bio)
+{
+  roa_object *self;
 
-/*
- * Do we really need to do this copy?  Nice general operation, but does
- * anything we're doing for RPKI care?
- */
+  ENTERING(roa_object_pem_read_helper);
+
+  if ((self = (roa_object *) cms_object_pem_read_helper(type, bio)) != NULL)
+    self->roa = NULL;
+
+  return (PyObject *) self;
+}
 
 static PyObject *
-digest_object_digest(digest_object *self)
+roa_object_der_read_helper(PyTypeObject *type, BIO *bio)
 {
-  unsigned char digest_text[EVP_MAX_MD_SIZE];
-  unsigned digest_len = 0;
-  PyObject *result = NULL;
-  EVP_MD_CTX ctx;
+  roa_object *self;
 
-  ENTERING(digest_object_digest);
+  ENTERING(roa_object_der_read_helper);
 
-  if (!EVP_MD_CTX_copy(&ctx, &self->digest_ctx))
-    lose_openssl_error("Couldn't copy digest");
+  if ((self = (roa_object *) cms_object_der_read_helper(type, bio)) != NULL)
+    self->roa = NULL;
 
-  EVP_DigestFinal(&ctx, digest_text, &digest_len);
+  return (PyObject *) self;
+}
 
-  result = Py_BuildValue("s#", digest_text, (Py_ssize_t) digest_len);
+static char roa_object_pem_read__doc__[] =
+  "Read a PEM-encoded ROA object from a string.\n"
+  ;
 
- error:
-  EVP_MD_CTX_cleanup(&ctx);
-  return result;
+static PyObject *
+roa_object_pem_read(PyTypeObject *type, PyObject *args)
+{
+  ENTERING(roa_object_pem_read);
+  return read_from_string_helper(roa_object_pem_read_helper, type, args);
 }
 
-static struct PyMethodDef digest_object_methods[] = {
-  Define_Method(update,         digest_object_update,   METH_VARARGS),
-  Define_Method(digest,         digest_object_digest,   METH_NOARGS),
-  Define_Method(copy,           digest_object_copy,     METH_NOARGS),
-  {NULL}
-};
+static char roa_object_pem_read_file__doc__[] =
+  "Read a PEM-encoded ROA object from a file.\n"
+  ;
 
-static char POW_Digest_Type__doc__[] =
-  "This class provides access to the digest functionality of OpenSSL.\n"
-  "It emulates the digest modules in the Python Standard Library, but\n"
-  "does not currently support the \"hexdigest\" method.\n"
-  "\n"
-  "The constructor takes one parameter, the kind of Digest object to create.\n"
-  "This should be one of the following:\n"
-  "\n"
-  "  * SHA1_DIGEST\n"
-  "  * SHA256_DIGEST\n"
-  "  * SHA384_DIGEST\n"
-  "  * SHA512_DIGEST\n"
+static PyObject *
+roa_object_pem_read_file(PyTypeObject *type, PyObject *args)
+{
+  ENTERING(roa_object_pem_read_file);
+  return read_from_file_helper(roa_object_pem_read_helper, type, args);
+}
+
+static char roa_object_der_read__doc__[] =
+  "Read a DER-encoded ROA object from a string.\n"
   ;
 
-static PyTypeObject POW_Digest_Type = {
-  PyObject_HEAD_INIT(0)
-  0,                                  /* ob_size */
-  "rpki.POW.Digest",                  /* tp_name */
-  sizeof(digest_object),              /* tp_basicsize */
-  0,                                  /* tp_itemsize */
-  (destructor)digest_object_dealloc,  /* tp_dealloc */
-  0,                                  /* tp_print */
-  0,                                  /* tp_getattr */
-  0,                                  /* tp_setattr */
-  0,                                  /* tp_compare */
-  0,                                  /* tp_repr */
-  0,                                  /* tp_as_number */
-  0,                                  /* tp_as_sequence */
-  0,                                  /* tp_as_mapping */
-  0,                                  /* tp_hash */
-  0,                                  /* tp_call */
-  0,                                  /* tp_str */
-  0,                                  /* tp_getattro */
-  0,                                  /* tp_setattro */
-  0,                                  /* tp_as_buffer */
-  Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, /* tp_flags */
-  POW_Digest_Type__doc__,             /* tp_doc */
-  0,                                  /* tp_traverse */
-  0,                                  /* tp_clear */
-  0,                                  /* tp_richcompare */
-  0,                                  /* tp_weaklistoffset */
-  0,                                  /* tp_iter */
-  0,                                  /* tp_iternext */
-  digest_object_methods,              /* tp_methods */
-  0,                                  /* tp_members */
-  0,                                  /* tp_getset */
-  0,                                  /* tp_base */
-  0,                                  /* tp_dict */
-  0,                                  /* tp_descr_get */
-  0,                                  /* tp_descr_set */
-  0,                                  /* tp_dictoffset */
-  (initproc) digest_object_init,      /* tp_init */
-  0,                                  /* tp_alloc */
-  digest_object_new,                  /* tp_new */
-};
+static PyObject *
+roa_object_der_read(PyTypeObject *type, PyObject *args)
+{
+  ENTERING(roa_object_der_read);
+  return read_from_string_helper(roa_object_der_read_helper, type, args);
+}
 
-
+static char roa_object_der_read_file__doc__[] =
+  "Read a DER-encoded ROA object from a file.\n"
+  ;
 
-/*
- * CMS object.
- */
+static PyObject *
+roa_object_der_read_file(PyTypeObject *type, PyObject *args)
+{
+  ENTERING(roa_object_der_read_file);
+  return read_from_file_helper(roa_object_der_read_helper, type, args);
+}
+
+static char roa_object_get_version__doc__[] =
+  "Return the version number of this ROA.\n"
+  ;
 
 static PyObject *
-cms_object_new(PyTypeObject *type, GCC_UNUSED PyObject *args, GCC_UNUSED PyObject *kwds)
+roa_object_get_version(roa_object *self)
 {
-  cms_object *self;
+  ENTERING(roa_object_get_version);
 
-  ENTERING(cms_object_new);
+  if (!roa_object_decode(self))
+    goto error;
+
+  if (self->roa == NULL)
+    lose_not_verified("Can't get version of unverified ROA");
 
-  if ((self = (cms_object *) type->tp_alloc(type, 0)) != NULL)
-    return (PyObject *) self;
+  if (self->roa->version)
+    return Py_BuildValue("N", ASN1_INTEGER_to_PyLong(self->roa->version));
+  else
+    return PyInt_FromLong(0);
 
-  Py_XDECREF(self);
+ error:
   return NULL;
 }
 
-static void
-cms_object_dealloc(cms_object *self)
-{
-  ENTERING(cms_object_dealloc);
-  CMS_ContentInfo_free(self->cms);
-  self->ob_type->tp_free((PyObject*) self);
-}
+static char roa_object_set_version__doc__[] =
+  "Set the version number of this ROA.\n"
+  "\n"
+  "The \"version\" parameter should be a non-negative integer.\n"
+  "\n"
+  "As of this writing, zero is both the default and the only defined version.\n"
+  "Attempting to set any version number other than zero will fail, as we\n"
+  "don't understand how to write other versions, by definition.\n"
+  ;
 
 static PyObject *
-cms_object_pem_read_helper(PyTypeObject *type, BIO *bio)
+roa_object_set_version(roa_object *self, PyObject *args)
 {
-  cms_object *self;
+  int version = 0;
 
-  ENTERING(cms_object_pem_read_helper);
+  ENTERING(roa_object_set_version);
 
-  if ((self = (cms_object *) type->tp_new(type, NULL, NULL)) == NULL)
+  if (!roa_object_decode(self))
     goto error;
 
-  if (!PEM_read_bio_CMS(bio, &self->cms, NULL, NULL))
-    lose_openssl_error("Couldn't load PEM encoded CMS message");
+  if (self->roa == NULL)
+    lose_not_verified("Can't set version of unverified ROA");
 
-  return (PyObject *) self;
+  if (!PyArg_ParseTuple(args, "|i", &version))
+    goto error;
+
+  if (version != 0)
+    lose("RFC 6482 only defines ROA version zero");
+
+  ASN1_INTEGER_free(self->roa->version);
+  self->roa->version = NULL;
+
+  Py_RETURN_NONE;
 
  error:
-  Py_XDECREF(self);
   return NULL;
 }
 
+static char roa_object_get_asid__doc__[] =
+  "Return the Autonomous System ID of this ROA.\n"
+  ;
+
 static PyObject *
-cms_object_der_read_helper(PyTypeObject *type, BIO *bio)
+roa_object_get_asid(roa_object *self)
 {
-  cms_object *self;
-
-  ENTERING(cms_object_der_read_helper);
+  ENTERING(roa_object_get_asid);
 
-  if ((self = (cms_object *) type->tp_new(type, NULL, NULL)) == NULL)
+  if (!roa_object_decode(self))
     goto error;
 
-  if (!d2i_CMS_bio(bio, &self->cms))
-    lose_openssl_error("Couldn't load DER encoded CMS message");
+  if (self->roa == NULL)
+    lose_not_verified("Can't get ASN of unverified ROA");
 
-  return (PyObject *) self;
+  return Py_BuildValue("N", ASN1_INTEGER_to_PyLong(self->roa->asID));
 
  error:
-  Py_XDECREF(self);
   return NULL;
 }
 
-static char cms_object_pem_read__doc__[] =
-  "Read a PEM-encoded CMS object from a string.\n"
+static char roa_object_set_asid__doc__[] =
+  "Sets the Autonomous System ID of this ROA.\n"
+  "\n"
+  "The \"asID\" parameter should be a non-negative integer.\n"
   ;
 
 static PyObject *
-cms_object_pem_read(PyTypeObject *type, PyObject *args)
+roa_object_set_asid(roa_object *self, PyObject *args)
 {
-  ENTERING(cms_object_pem_read);
-  return read_from_string_helper(cms_object_pem_read_helper, type, args);
-}
+  PyObject *asID = NULL;
+  PyObject *zero = NULL;
+  int ok = 0;
 
-static char cms_object_pem_read_file__doc__[] =
-  "Read a PEM-encoded CMS object from a file.\n"
-  ;
+  ENTERING(roa_object_set_asid);
 
-static PyObject *
-cms_object_pem_read_file(PyTypeObject *type, PyObject *args)
-{
-  ENTERING(cms_object_pem_read_file);
-  return read_from_file_helper(cms_object_pem_read_helper, type, args);
-}
+  if (!roa_object_decode(self))
+    goto error;
 
-static char cms_object_der_read__doc__[] =
-  "Read a DER-encoded CMS object from a string.\n"
-  ;
+  if (self->roa == NULL)
+    lose_not_verified("Can't set ASN of unverified ROA");
 
-static PyObject *
-cms_object_der_read(PyTypeObject *type, PyObject *args)
-{
-  ENTERING(cms_object_der_read);
-  return read_from_string_helper(cms_object_der_read_helper, type, args);
-}
+  if (!PyArg_ParseTuple(args, "O", &asID))
+    goto error;
 
-static char cms_object_der_read_file__doc__[] =
-  "Read a DER-encoded CMS object from a file.\n"
-  ;
+  if ((zero = PyInt_FromLong(0)) == NULL)
+    goto error;
 
-static PyObject *
-cms_object_der_read_file(PyTypeObject *type, PyObject *args)
-{
-  ENTERING(cms_object_der_read_file);
-  return read_from_file_helper(cms_object_der_read_helper, type, args);
+  switch (PyObject_RichCompareBool(asID, zero, Py_GE)) {
+  case -1:
+    goto error;
+  case 0:
+    lose("Negative asID is not allowed");
+  }
+
+  ASN1_INTEGER_free(self->roa->asID);
+
+  if ((self->roa->asID = PyLong_to_ASN1_INTEGER(asID)) == NULL)
+    goto error;
+
+  ok = 1;
+
+ error:
+  Py_XDECREF(zero);
+
+  if (ok)
+    Py_RETURN_NONE;
+  else
+    return NULL;
 }
 
-static char cms_object_pem_write__doc__[] =
-  "Return the DER encoding of this CMS message.\n"
+static char roa_object_get_prefixes__doc__[] =
+  "Return this ROA's prefix list.  This is a two-element\n"
+  "tuple: the first element is the IPv4 prefix set, the second is the\n"
+  "IPv6 prefix set.\n"
+  "\n"
+  "Each prefix set is either None, if there are no prefixes for this IP\n"
+  "version, or a sequence of three-element tuple representing ROA prefix\n"
+  "entries.\n"
+  "\n"
+  "Each ROA prefix entry consists of the prefix itself (an IPAddress),\n"
+  "the prefix length (an integer), and the maxPrefixLen value, which is\n"
+  "either an integer or None depending on whether the maxPrefixLen value\n"
+  "is set for this prefix.\n"
   ;
 
 static PyObject *
-cms_object_pem_write(cms_object *self)
+roa_object_get_prefixes(roa_object *self)
 {
   PyObject *result = NULL;
-  BIO *bio = NULL;
+  PyObject *ipv4_result = NULL;
+  PyObject *ipv6_result = NULL;
+  PyObject *item = NULL;
+  ipaddress_object *addr = NULL;
+  der_view_t families, family, addresses, iter, address, maxLength;
+  unsigned unused, afi;
+  unsigned long maxlen;
+  int j;
 
-  ENTERING(cms_object_pem_write);
+  ENTERING(roa_object_get_prefixes);
 
-  if ((bio = BIO_new(BIO_s_mem())) == NULL)
-    lose_no_memory();
+  if (!roa_object_encode(self))
+    goto error;
 
-  if (!PEM_write_bio_CMS(bio, self->cms))
-    lose_openssl_error("Unable to write CMS object");
+  if (self->econtent == NULL)
+    lose_not_verified("Can't get prefixes from unverified ROA");
 
-  result = BIO_to_PyString_helper(bio);
+  for (families = self->view.ipAddrBlocks; roa_view_next_family(&families, &family, &addresses); ) {
+    const ipaddress_version *ip_type = NULL;
+    PyObject **resultp = NULL;
 
- error:                         /* Fall through */
-  BIO_free(bio);
-  return result;
-}
+    afi = family.len < 2 ? 0 : (family.data[0] << 8) | (family.data[1]);
 
-static char cms_object_der_write__doc__[] =
-  "Return the DER encoding of this CMS message.\n"
-  ;
+    switch (afi) {
+    case IANA_AFI_IPV4: resultp = &ipv4_result; ip_type = &ipaddress_version_4; break;
+    case IANA_AFI_IPV6: resultp = &ipv6_result; ip_type = &ipaddress_version_6; break;
+    default:            lose_value_error("Unknown AFI");
+    }
 
-static PyObject *
-cms_object_der_write(cms_object *self)
-{
-  PyObject *result = NULL;
-  BIO *bio = NULL;
+    if (family.len > 2)
+      lose_value_error("Unsupported SAFI");
 
-  ENTERING(cms_object_der_write);
+    if (*resultp != NULL)
+      lose_value_error("Duplicate ROAIPAddressFamily");
 
-  if ((bio = BIO_new(BIO_s_mem())) == NULL)
-    lose_no_memory();
+    for (j = 0, iter = addresses; roa_view_next_address(&iter, &address, &unused, &maxLength); j++)
+      ;
 
-  if (!i2d_CMS_bio(bio, self->cms))
-    lose_openssl_error("Unable to write CMS object");
+    if ((*resultp = PyTuple_New(j)) == NULL)
+      goto error;
 
-  result = BIO_to_PyString_helper(bio);
+    for (j = 0; roa_view_next_address(&addresses, &address, &unused, &maxLength); j++) {
+      unsigned prefixlen = address.len * 8 - unused;
+
+      if ((addr = (ipaddress_object *) POW_IPAddress_Type.tp_alloc(&POW_IPAddress_Type, 0)) == NULL)
+        goto error;
+
+      addr->type = ip_type;
+
+      memset(addr->address, 0, sizeof(addr->address));
+
+      if (address.len > addr->type->length)
+        lose("ROAIPAddress BIT STRING too long for AFI");
+
+      if (address.len > 0) {
+        memcpy(addr->address, address.data, address.len);
+
+        if (unused != 0) {
+          unsigned char mask = 0xFF >> (8 - unused);
+          addr->address[address.len - 1] &= ~mask;
+        }
+      }
+
+      if (maxLength.data != NULL && !der_integer_to_ulong(&maxLength, &maxlen))
+        lose_value_error("ROAIPAddress maxLength out of range");
+
+      if (maxLength.data == NULL)
+        item = Py_BuildValue("(NIO)", addr, prefixlen, Py_None);
+      else
+        item = Py_BuildValue("(NIk)", addr, prefixlen, maxlen);
+
+      if (item == NULL)
+        goto error;
+
+      PyTuple_SET_ITEM(*resultp, j, item);
+      item = NULL;
+      addr = NULL;
+    }
+  }
+
+  result = Py_BuildValue("(OO)",
+                         (ipv4_result == NULL ? Py_None : ipv4_result),
+                         (ipv6_result == NULL ? Py_None : ipv6_result));
 
  error:                         /* Fall through */
-  BIO_free(bio);
+  Py_XDECREF(addr);
+  Py_XDECREF(item);
+  Py_XDECREF(ipv4_result);
+  Py_XDECREF(ipv6_result);
+
   return result;
 }
 
-static int
-cms_object_sign_helper(cms_object *self,
-                       BIO *bio,
-                       x509_object *signcert,
-                       asymmetric_object *signkey,
-                       PyObject *x509_iterable,
-                       PyObject *crl_iterable,
-                       char *oid,
-                       unsigned flags)                       
+static char roa_object_set_prefixes__doc__[] =
+  "Set this ROA's prefix list.\n"
+  "\n"
+  "This method takes two arguments, \"ipv4\" and \"ipv6\".  Each of these\n"
+  "is either None, if no prefixes should be set for this IP version, or\n"
+  "an iterable object returning ROA prefix entries in the same format as\n"
+  "returned by the .getPrefixes() method.  The maxPrefixLen value may be\n"
+  "omitted (that is, the ROA prefix entry tuple may be of length two\n"
+  "rather than of length three); this will be taken as equivalent to\n"
+  "specifying a maxPrefixLen value of None.\n"
+  ;
+
+static PyObject *
+roa_object_set_prefixes(roa_object *self, PyObject *args, PyObject *kwds)
 {
-  STACK_OF(X509) *x509_stack = NULL;
-  ASN1_OBJECT *econtent_type = NULL;
-  CMS_ContentInfo *cms = NULL;
+  static char *kwlist[] = {"ipv4", "ipv6", NULL};
+  STACK_OF(ROAIPAddressFamily) *prefixes = NULL;
+  ROAIPAddressFamily *fam = NULL;
+  ROAIPAddress *a = NULL;
+  PyObject *ipv4_arg = Py_None;
+  PyObject *ipv6_arg = Py_None;
   PyObject *iterator = NULL;
   PyObject *item = NULL;
+  PyObject *fast = NULL;
   int ok = 0;
+  int v;
 
-  ENTERING(cms_object_sign_helper);
+  ENTERING(roa_object_set_prefixes);
 
-  assert_no_unhandled_openssl_errors();
+  if (!roa_object_decode(self))
+    goto error;
 
-  flags &= CMS_NOCERTS | CMS_NOATTR;
-  flags |= CMS_BINARY | CMS_NOSMIMECAP | CMS_PARTIAL | CMS_USE_KEYID;
+  if (self->roa == NULL)
+    lose_not_verified("Can't set prefixes of unverified ROA");
 
-  if ((x509_stack = x509_helper_iterable_to_stack(x509_iterable)) == NULL)
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|OO", kwlist, &ipv4_arg, &ipv6_arg))
     goto error;
 
-  assert_no_unhandled_openssl_errors();
+  if ((prefixes = sk_ROAIPAddressFamily_new_null()) == NULL)
+    lose_no_memory();
 
-  if (oid && (econtent_type = OBJ_txt2obj(oid, 1)) == NULL)
-    lose_openssl_error("Couldn't parse OID");
+  for (v = 0; v < (int) (sizeof(ipaddress_versions)/sizeof(*ipaddress_versions)); v++) {
+    const struct ipaddress_version *ip_type = ipaddress_versions[v];
+    unsigned char afibuf[2];
+    PyObject **argp;
 
-  assert_no_unhandled_openssl_errors();
+    switch (ip_type->version) {
+    case 4: argp = &ipv4_arg; break;
+    case 6: argp = &ipv6_arg; break;
+    default: continue;
+    }
 
-  if ((cms = CMS_sign(NULL, NULL, x509_stack, bio, flags)) == NULL)
-    lose_openssl_error("Couldn't create CMS message");
+    if (*argp == Py_None)
+      continue;
 
-  assert_no_unhandled_openssl_errors();
+    afibuf[0] = (ip_type->afi >> 8) & 0xFF;
+    afibuf[1] = (ip_type->afi     ) & 0xFF;
 
-  if (econtent_type)
-    CMS_set1_eContentType(cms, econtent_type);
+    if ((iterator = PyObject_GetIter(*argp)) == NULL)
+      goto error;
 
-  assert_no_unhandled_openssl_errors();
+    while ((item = PyIter_Next(iterator)) != NULL) {
+      unsigned prefixlen, maxprefixlen, bitlen, bytelen;
+      ipaddress_object *addr = NULL;
+      PyObject *maxlenobj = Py_None;
 
-  if (!CMS_add1_signer(cms, signcert->x509, signkey->pkey, EVP_sha256(), flags))
-    lose_openssl_error("Couldn't sign CMS message");
+      if ((fast = PySequence_Fast(item, "ROA prefix must be a sequence")) == NULL)
+        goto error;
 
-  assert_no_unhandled_openssl_errors();
+      switch (PySequence_Fast_GET_SIZE(fast)) {
+      case 3:
+        maxlenobj = PySequence_Fast_GET_ITEM(fast, 2);
+        /* Fall through */
+      case 2:
+        if (!POW_IPAddress_Check(PySequence_Fast_GET_ITEM(fast, 0)))
+          lose_type_error("First element of ROA prefix must be an IPAddress object");
+        addr = (ipaddress_object *) PySequence_Fast_GET_ITEM(fast, 0);
+        prefixlen = (unsigned) PyInt_AsLong(PySequence_Fast_GET_ITEM(fast, 1));
+        if (PyErr_Occurred())
+          goto error;
+        break;
+      default:
+        lose_type_error("ROA prefix must be a two- or three-element sequence");
+      }
 
-  if (crl_iterable != Py_None) {
+      if (maxlenobj == Py_None) {
+        maxprefixlen = prefixlen;
+      } else {
+        maxprefixlen = (unsigned) PyInt_AsLong(maxlenobj);
+        if (PyErr_Occurred())
+          goto error;
+      }
 
-    if ((iterator = PyObject_GetIter(crl_iterable)) == NULL)
-      goto error;
+      if (addr->type != ip_type)
+        lose_value_error("Bad ROA prefix");
 
-    while ((item = PyIter_Next(iterator)) != NULL) {
+      if (prefixlen > addr->type->length * 8)
+        lose("Bad prefix length");
 
-      if (!POW_CRL_Check(item))
-        lose_type_error("Expected a CRL object");
+      if (maxprefixlen > addr->type->length * 8 || maxprefixlen < prefixlen)
+        lose("Bad maxLength value");
+
+      bytelen = (prefixlen + 7) / 8;
+      bitlen = prefixlen % 8;
+
+      if ((a = ROAIPAddress_new()) == NULL ||
+          (a->IPAddress == NULL && (a->IPAddress = ASN1_BIT_STRING_new()) == NULL) ||
+          !ASN1_BIT_STRING_set(a->IPAddress, addr->address, bytelen))
+        lose_no_memory();
+
+      a->IPAddress->flags &= ~7;
+      a->IPAddress->flags |= ASN1_STRING_FLAG_BITS_LEFT;
+      if (bitlen > 0) {
+        a->IPAddress->data[bytelen - 1] &= ~(0xFF >> bitlen);
+        a->IPAddress->flags |= 8 - bitlen;
+      }
+
+      if (prefixlen != maxprefixlen &&
+          ((a->maxLength = ASN1_INTEGER_new()) == NULL ||
+           !ASN1_INTEGER_set(a->maxLength, maxprefixlen)))
+        lose_no_memory();
 
-      if (!CMS_add1_crl(cms, ((crl_object *) item)->crl))
-        lose_openssl_error("Couldn't add CRL to CMS");
+      if (fam == NULL &&
+          ((fam = ROAIPAddressFamily_new()) == NULL ||
+           !sk_ROAIPAddressFamily_push(prefixes, fam) ||
+           !ASN1_OCTET_STRING_set(fam->addressFamily, afibuf, sizeof(afibuf))))
+        lose_no_memory();
 
-      assert_no_unhandled_openssl_errors();
+      if (!sk_ROAIPAddress_push(fam->addresses, a))
+        lose_no_memory();
 
+      a = NULL;
       Py_XDECREF(item);
-      item = NULL;
+      Py_XDECREF(fast);
+      item = fast = NULL;
     }
-  }
 
-  if (!CMS_final(cms, bio, NULL, flags))
-    lose_openssl_error("Couldn't finalize CMS signatures");
-
-  assert_no_unhandled_openssl_errors();
+    fam = NULL;
+    Py_XDECREF(iterator);
+    iterator = NULL;
+  }
 
-  CMS_ContentInfo_free(self->cms);
-  self->cms = cms;
-  cms = NULL;
+  sk_ROAIPAddressFamily_pop_free(self->roa->ipAddrBlocks, ROAIPAddressFamily_free);
+  self->roa->ipAddrBlocks = prefixes;
+  prefixes = NULL;
 
   ok = 1;
 
- error:                          /* fall through */
-  CMS_ContentInfo_free(cms);
-  sk_X509_free(x509_stack);
-  ASN1_OBJECT_free(econtent_type);
+ error:
+  sk_ROAIPAddressFamily_pop_free(prefixes, ROAIPAddressFamily_free);
+  ROAIPAddressFamily_free(fam);
+  ROAIPAddress_free(a);
   Py_XDECREF(iterator);
   Py_XDECREF(item);
+  Py_XDECREF(fast);
 
-  return ok;
+  if (ok)
+    Py_RETURN_NONE;
+  else
+    return NULL;
 }
 
-static char cms_object_sign__doc__[] =
-  "Sign this CMS message message with a private key.\n"
-  "\n"
-  "The \"signcert\" parameter should be the certificate against which the\n"
-  "message will eventually be verified, an X509 object.\n"
-  "\n"
-  "The \"key\" parameter should be the private key with which to sign the\n"
-  "message, an Asymmetric object.\n"
-  "\n"
-  "The \"data\" parameter should be the message to be signed, a string.\n"
-  "\n"
-  "The optional \"certs\" parameter should be an iterable supplying X509 objects\n"
-  "to be included in the signed message.\n"
-  "\n"
-  "The optional \"crls\" parameter should be an iterable supplying CRL objects\n"
-  "to be included in the signed message.\n"
-  "\n"
-  "The optional \"eContentType\" parameter should be an Object Identifier\n"
-  "to use as the eContentType value in the signed message.\n"
-  "\n"
-  "The optional \"flags\" parameters should be an integer holding a bitmask,\n"
-  "and can include the following flags:\n"
-  "\n"
-  "  * CMS_NOCERTS\n"
-  "  * CMS_NOATTR\n"
+static char roa_object_sign__doc__[] =
+  "Sign this ROA.  See CMS.sign() for details.\n"
   ;
 
 static PyObject *
-cms_object_sign(cms_object *self, PyObject *args)
+roa_object_sign(roa_object *self, PyObject *args)
 {
   asymmetric_object *signkey = NULL;
   x509_object *signcert = NULL;
   PyObject *x509_iterable = Py_None;
   PyObject *crl_iterable = Py_None;
-  char *buf = NULL, *oid = NULL;
-  Py_ssize_t len;
+  char *oid = NULL;
   unsigned flags = 0;
   BIO *bio = NULL;
   int ok = 0;
 
-  ENTERING(cms_object_sign);
+  ENTERING(roa_object_sign);
 
-  if (!PyArg_ParseTuple(args, "O!O!s#|OOsI",
+  if (!PyArg_ParseTuple(args, "O!O!|OOsI",
                         &POW_X509_Type, &signcert,
                         &POW_Asymmetric_Type, &signkey,
-                        &buf, &len,
                         &x509_iterable,
                         &crl_iterable,
                         &oid,
                         &flags))
     goto error;
 
+  if ((bio = BIO_new(BIO_s_mem())) == NULL)
+    lose_no_memory();
+
   assert_no_unhandled_openssl_errors();
 
-  if ((bio = BIO_new_mem_buf(buf, len)) == NULL)
-    lose_no_memory();
+  if (!roa_object_write_econtent(self, bio))
+    lose_openssl_error("Couldn't encode ROA");
+
+  assert_no_unhandled_openssl_errors();
+
+  if (!cms_object_sign_helper(&self->cms, bio, signcert, signkey,
+                              x509_iterable, crl_iterable, oid, flags))
+    lose_openssl_error("Couldn't sign ROA");
+
+  assert_no_unhandled_openssl_errors();
+
+  ok = 1;
+
+ error:
+  BIO_free(bio);
+
+  if (ok)
+    Py_RETURN_NONE;
+  else
+    return NULL;
+}
+
+static struct PyMethodDef roa_object_methods[] = {
+  Define_Method(getVersion,                     roa_object_get_version,                 METH_NOARGS),
+  Define_Method(setVersion,                     roa_object_set_version,                 METH_VARARGS),
+  Define_Method(getASID,                        roa_object_get_asid,                    METH_NOARGS),
+  Define_Method(setASID,                        roa_object_set_asid,                    METH_VARARGS),
+  Define_Method(getPrefixes,                    roa_object_get_prefixes,                METH_NOARGS),
+  Define_Method(setPrefixes,                    roa_object_set_prefixes,                METH_KEYWORDS),
+  Define_Method(sign,                           roa_object_sign,                        METH_VARARGS),
+  Define_Method(verify,                         roa_object_verify,                      METH_KEYWORDS),
+  Define_Method(extractWithoutVerifying,        roa_object_extract_without_verifying,   METH_NOARGS),
+  Define_Method(checkRPKIConformance,           roa_object_check_rpki_conformance,      METH_KEYWORDS),
+  Define_Class_Method(pemRead,                  roa_object_pem_read,                    METH_VARARGS),
+  Define_Class_Method(pemReadFile,              roa_object_pem_read_file,               METH_VARARGS),
+  Define_Class_Method(derRead,                  roa_object_der_read,                    METH_VARARGS),
+  Define_Class_Method(derReadFile,              roa_object_der_read_file,               METH_VARARGS),
+  {NULL}
+};
+
+static char POW_ROA_Type__doc__[] =
+  "This class provides access to RPKI ROA payload.\n"
+  "Most methods are inherited from or share code with the CMS class.\n"
+  ;
+
+static PyTypeObject POW_ROA_Type = {
+  PyObject_HEAD_INIT(0)
+  0,                                            /* ob_size */
+  "rpki.POW.ROA",                               /* tp_name */
+  sizeof(roa_object),                           /* tp_basicsize */
+  0,                                            /* tp_itemsize */
+  (destructor)roa_object_dealloc,               /* tp_dealloc */
+  0,                                            /* tp_print */
+  0,                                            /* tp_getattr */
+  0,                                            /* tp_setattr */
+  0,                                            /* tp_compare */
+  0,                                            /* tp_repr */
+  0,                                            /* tp_as_number */
+  0,                                            /* tp_as_sequence */
+  0,                                            /* tp_as_mapping */
+  0,                                            /* tp_hash */
+  0,                                            /* tp_call */
+  0,                                            /* tp_str */
+  0,                                            /* tp_getattro */
+  0,                                            /* tp_setattro */
+  0,                                            /* tp_as_buffer */
+  Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,     /* tp_flags */
+  POW_ROA_Type__doc__,                          /* tp_doc */
+  0,                                            /* tp_traverse */
+  0,                                            /* tp_clear */
+  0,                                            /* tp_richcompare */
+  0,                                            /* tp_weaklistoffset */
+  0,                                            /* tp_iter */
+  0,                                            /* tp_iternext */
+  roa_object_methods,                           /* tp_methods */
+  0,                                            /* tp_members */
+  0,                                            /* tp_getset */
+  &POW_CMS_Type,                                /* tp_base */
+  0,                                            /* tp_dict */
+  0,                                            /* tp_descr_get */
+  0,                                            /* tp_descr_set */
+  0,                                            /* tp_dictoffset */
+  0,                                            /* tp_init */
+  0,                                            /* tp_alloc */
+  roa_object_new,                               /* tp_new */
+};
 
-  assert_no_unhandled_openssl_errors();
+
 
-  if (!cms_object_sign_helper(self, bio, signcert, signkey,
-                              x509_iterable, crl_iterable, oid, flags))
-    lose_openssl_error("Couldn't sign CMS object");
+/*
+ * PKCS10 object.
+ */
 
-  assert_no_unhandled_openssl_errors();
+static PyObject *
+pkcs10_object_new(PyTypeObject *type, GCC_UNUSED PyObject *args, GCC_UNUSED PyObject *kwds)
+{
+  pkcs10_object *self;
 
-  ok = 1;
+  ENTERING(pkcs10_object_new);
 
- error:
-  BIO_free(bio);
+  if ((self = (pkcs10_object *) type->tp_alloc(type, 0)) != NULL &&
+      (self->pkcs10 = X509_REQ_new()) != NULL &&
+      (self->exts = sk_X509_EXTENSION_new_null()) != NULL)
+    return (PyObject *) self;
 
-  if (ok)
-    Py_RETURN_NONE;
-  else
-    return NULL;
+  Py_XDECREF(self);
+  return NULL;
 }
 
-static BIO *
-cms_object_extract_without_verifying_helper(cms_object *self)
+static void
+pkcs10_object_dealloc(pkcs10_object *self)
 {
-  const unsigned flags =
-    CMS_NOCRL | CMS_NO_SIGNER_CERT_VERIFY | CMS_NO_ATTR_VERIFY | CMS_NO_CONTENT_VERIFY;
-
-  BIO *bio = NULL;
-
-  ENTERING(cms_object_extract_without_verifying_helper);
-
-  if ((bio = BIO_new(BIO_s_mem())) == NULL)
-    lose_no_memory();
+  ENTERING(pkcs10_object_dealloc);
+  X509_REQ_free(self->pkcs10);
+  sk_X509_EXTENSION_pop_free(self->exts, X509_EXTENSION_free);
+  self->ob_type->tp_free((PyObject*) self);
+}
 
-  if (CMS_verify(self->cms, NULL, NULL, NULL, bio, flags) <= 0)
-    lose_openssl_error("Couldn't parse CMS message");
+static PyObject *
+pkcs10_object_pem_read_helper(PyTypeObject *type, BIO *bio)
+{
+  pkcs10_object *self = NULL;
 
-  return bio;
+  ENTERING(pkcs10_object_pem_read_helper);
 
- error:
-  BIO_free(bio);
-  return NULL;
-}
+  assert_no_unhandled_openssl_errors();
 
+  if ((self = (pkcs10_object *) pkcs10_object_new(type, NULL, NULL)) == NULL)
+    goto error;
 
-#define CMS_OBJECT_VERIFY_HELPER__DOC__                                         \
-  "\n"                                                                          \
-  "The optional \"certs\" parameter is a set of certificates to search\n"       \
-  "for the signer's certificate.\n"                                             \
-  "\n"                                                                          \
-  "The optional \"flags\" parameter is an integer of bit flags,\n"              \
-  "containing zero or more of the following:\n"                                 \
-  "\n"                                                                          \
-  "  * CMS_NOINTERN\n"                                                          \
-  "  * CMS_NOCRL\n"                                                             \
-  "  * CMS_NO_SIGNER_CERT_VERIFY\n"                                             \
-  "  * CMS_NO_ATTR_VERIFY\n"                                                    \
-  "  * CMS_NO_CONTENT_VERIFY\n"                                                 \
-  "\n"                                                                          \
-  "Note that this method does NOT verify X.509 certificates, it just\n"         \
-  "verifies the CMS signature.  Use certificate verification functions\n"       \
-  "to verify certificates."
+  assert_no_unhandled_openssl_errors();
 
-#warning Should we really allow the full range of flags here, or constrain to just the useful cases?
+  if (!PEM_read_bio_X509_REQ(bio, &self->pkcs10, NULL, NULL))
+    lose_openssl_error("Couldn't load PEM encoded PKCS#10 request");
 
-static BIO *
-cms_object_verify_helper(cms_object *self, PyObject *args, PyObject *kwds)
-{
-  static char *kwlist[] = {"certs", "flags", NULL};
-  PyObject *certs_iterable = Py_None;
-  STACK_OF(X509) *certs_stack = NULL;
-  unsigned flags = 0, ok = 0;
-  BIO *bio = NULL;
+  sk_X509_EXTENSION_pop_free(self->exts, X509_EXTENSION_free);
+  self->exts = X509_REQ_get_extensions(self->pkcs10);
 
-  const unsigned flag_mask =
-    CMS_NOINTERN | CMS_NOCRL | CMS_NO_SIGNER_CERT_VERIFY |
-    CMS_NO_ATTR_VERIFY | CMS_NO_CONTENT_VERIFY;
+  assert_no_unhandled_openssl_errors();
 
-  ENTERING(cms_object_verify_helper);
+  return (PyObject *) self;
 
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|OI", kwlist, &certs_iterable, &flags))
-    goto error;
+ error:
 
-  if ((flags & ~flag_mask) != 0)
-    lose_value_error("Bad CMS_verify() flags");
+  Py_XDECREF(self);
+  return NULL;
+}
 
-  flags |= CMS_NO_SIGNER_CERT_VERIFY;
+static PyObject *
+pkcs10_object_der_read_helper(PyTypeObject *type, BIO *bio)
+{
+  pkcs10_object *self = NULL;
 
-  if ((bio = BIO_new(BIO_s_mem())) == NULL)
-    lose_no_memory();
+  ENTERING(pkcs10_object_der_read_helper);
 
   assert_no_unhandled_openssl_errors();
 
-  if (certs_iterable != Py_None &&
-      (certs_stack = x509_helper_iterable_to_stack(certs_iterable)) == NULL)
+  if ((self = (pkcs10_object *) pkcs10_object_new(type, NULL, NULL)) == NULL)
     goto error;
 
   assert_no_unhandled_openssl_errors();
 
-  if (CMS_verify(self->cms, certs_stack, NULL, NULL, bio, flags) <= 0)
-    lose_openssl_error("Couldn't verify CMS message");
+  if (!d2i_X509_REQ_bio(bio, &self->pkcs10))
+    lose_openssl_error("Couldn't load DER encoded PKCS#10 request");
+
+  sk_X509_EXTENSION_pop_free(self->exts, X509_EXTENSION_free);
+  self->exts = X509_REQ_get_extensions(self->pkcs10);
 
   assert_no_unhandled_openssl_errors();
 
-  ok = 1;
+  return (PyObject *) self;
 
- error:                          /* fall through */
-  sk_X509_free(certs_stack);
+ error:
+  Py_XDECREF(self);
+  return NULL;
+}
 
-  if (ok)
-    return bio;
+static char pkcs10_object_pem_read__doc__[] =
+  "Read a PEM-encoded PKCS#10 object from a string.\n"
+  ;
 
-  BIO_free(bio);
-  return NULL;
+static PyObject *
+pkcs10_object_pem_read(PyTypeObject *type, PyObject *args)
+{
+  ENTERING(pkcs10_object_pem_read);
+  return read_from_string_helper(pkcs10_object_pem_read_helper, type, args);
 }
 
-static char cms_object_verify__doc__[] =
-  "Verify this CMS message against a trusted certificate store.\n"
-  "\n"
-  CMS_OBJECT_VERIFY_HELPER__DOC__
-  "\n"
-  "Return value is the decoded CMS content, as a Python string.\n"
+static char pkcs10_object_pem_read_file__doc__[] =
+  "Read a PEM-encoded PKCS#10 object from a file.\n"
   ;
 
 static PyObject *
-cms_object_verify(cms_object *self, PyObject *args, PyObject *kwds)
+pkcs10_object_pem_read_file(PyTypeObject *type, PyObject *args)
 {
-  PyObject *result = NULL;
-  BIO *bio = NULL;
+  ENTERING(pkcs10_object_pem_read_file);
+  return read_from_file_helper(pkcs10_object_pem_read_helper, type, args);
+}
 
-  ENTERING(cms_object_verify);
+static char pkcs10_object_der_read__doc__[] =
+  "Read a DER-encoded PKCS#10 object from a string.\n"
+  ;
 
-  if ((bio = cms_object_verify_helper(self, args, kwds)) != NULL)
-    result = BIO_to_PyString_helper(bio);
+static PyObject *
+pkcs10_object_der_read(PyTypeObject *type, PyObject *args)
+{
+  ENTERING(pkcs10_object_der_read);
+  return read_from_string_helper(pkcs10_object_der_read_helper, type, args);
+}
 
-  BIO_free(bio);
-  return result;
+static char pkcs10_object_der_read_file__doc__[] =
+  "Read a DER-encoded PKCS#10 object from a file.\n"
+  ;
+
+static PyObject *
+pkcs10_object_der_read_file(PyTypeObject *type, PyObject *args)
+{
+  ENTERING(pkcs10_object_der_read_file);
+  return read_from_file_helper(pkcs10_object_der_read_helper, type, args);
 }
 
-static char cms_object_extract_without_verifying__doc__[] =
-  "Extract content from a CMS object without attempting CMS verification.\n"
-  "\n"
-  "NEVER USE THIS METHOD ON AN UNVERIFIED CMS OBJECT!\n"
+static char pkcs10_object_pem_write__doc__[] =
+  "Returns the PEM encoding of this PKCS#10 object.\n"
   ;
 
 static PyObject *
-cms_object_extract_without_verifying(cms_object *self)
+pkcs10_object_pem_write(pkcs10_object *self)
 {
   PyObject *result = NULL;
   BIO *bio = NULL;
 
-  ENTERING(cms_object_extract_without_verifying);
+  ENTERING(pkcs10_object_pem_write);
+
+  if ((bio = BIO_new(BIO_s_mem())) == NULL)
+    lose_no_memory();
+
+  if (!PEM_write_bio_X509_REQ(bio, self->pkcs10))
+    lose_openssl_error("Unable to write PKCS#10 request");
 
-  if ((bio = cms_object_extract_without_verifying_helper(self)) != NULL)
-    result = BIO_to_PyString_helper(bio);
+  result = BIO_to_PyString_helper(bio);
 
+ error:                         /* Fall through */
   BIO_free(bio);
   return result;
 }
 
-static char cms_object_check_rpki_conformance__doc__[] =
-  "Check this CMS message for conformance to the RPKI profile.\n"
+static char pkcs10_object_der_write__doc__[] =
+  "Return the DER encoding of this PKCS#10 object.\n"
   ;
 
 static PyObject *
-cms_object_check_rpki_conformance(cms_object *self, PyObject *args, PyObject *kwds)
+pkcs10_object_der_write(pkcs10_object *self)
 {
-  static char *kwlist[] = {"status", NULL};
-  PyObject *status = Py_None;
+  PyObject *result = NULL;
+  BIO *bio = NULL;
 
-  ENTERING(cms_object_check_rpki_conformance);
+  ENTERING(pkcs10_object_der_write);
 
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!", kwlist, &PySet_Type, &status))
-    goto error;
+  if ((bio = BIO_new(BIO_s_mem())) == NULL)
+    lose_no_memory();
 
-  if (!check_cms(self->cms, status))
-    goto error;
+  if (!i2d_X509_REQ_bio(bio, self->pkcs10))
+    lose_openssl_error("Unable to write PKCS#10 request");
 
-  Py_RETURN_NONE;
+  result = BIO_to_PyString_helper(bio);
 
- error:
-  return NULL;
+ error:                         /* Fall through */
+  BIO_free(bio);
+  return result;
 }
 
-static char cms_object_eContentType__doc__[] =
-  "Return the eContentType OID of this CMS message.\n"
-  ;
+static X509_EXTENSION *
+pkcs10_object_extension_get_helper(pkcs10_object *self, int nid)
+{
+  if (self != NULL && self->exts != NULL)
+    return X509v3_get_ext(self->exts, X509v3_get_ext_by_NID(self->exts, nid, -1));
+  else
+    return NULL;
+}
 
 static PyObject *
-cms_object_eContentType(cms_object *self)
+pkcs10_object_extension_set_helper(pkcs10_object *self, extension_wrapper ext)
 {
-  const ASN1_OBJECT *oid = NULL;
-  PyObject *result = NULL;
-
-  ENTERING(cms_object_eContentType);
+  int ok = 0;
 
-  if ((oid = CMS_get0_eContentType(self->cms)) == NULL)
-    lose_openssl_error("Couldn't extract eContentType from CMS message");
+  if (ext.value == NULL)
+    goto error;
 
-  assert_no_unhandled_openssl_errors();
+  if (!X509V3_add1_i2d(&self->exts, ext.nid, ext.value, ext.critical, X509V3_ADD_REPLACE))
+    lose_openssl_error("Couldn't add extension to PKCS #10 object");
 
-  result = ASN1_OBJECT_to_PyString(oid);
+  ok = 1;
 
  error:
-  return result;
+  ext.destructor(ext.value);
+  if (ok)
+    Py_RETURN_NONE;
+  else
+    return NULL;
 }
 
-static char cms_object_signingTime__doc__[] =
-  "Return the signingTime of this CMS message.\n"
+static char pkcs10_object_get_public_key__doc__[] =
+  "Return the public key from this PKCS#10 request, as an Asymmetric\n"
+  "object.\n"
   ;
 
 static PyObject *
-cms_object_signingTime(cms_object *self)
+pkcs10_object_get_public_key(pkcs10_object *self)
 {
-  PyObject *result = NULL;
-  STACK_OF(CMS_SignerInfo) *sis = NULL;
-  CMS_SignerInfo *si = NULL;
-  X509_ATTRIBUTE *xa = NULL;
-  ASN1_TYPE *so = NULL;
-  int i;
-
-  ENTERING(cms_object_signingTime);
-
-  if ((sis = CMS_get0_SignerInfos(self->cms)) == NULL)
-    lose_openssl_error("Couldn't extract signerInfos from CMS message[1]");
-
-  if (sk_CMS_SignerInfo_num(sis) != 1)
-    lose_openssl_error("Couldn't extract signerInfos from CMS message[2]");
-
-  si = sk_CMS_SignerInfo_value(sis, 0);
-
-  if ((i = CMS_signed_get_attr_by_NID(si, NID_pkcs9_signingTime, -1)) < 0)
-    lose_openssl_error("Couldn't extract signerInfos from CMS message[3]");
+  PyTypeObject *type = &POW_Asymmetric_Type;
+  asymmetric_object *asym = NULL;
 
-  if ((xa = CMS_signed_get_attr(si, i)) == NULL)
-    lose_openssl_error("Couldn't extract signerInfos from CMS message[4]");
+  ENTERING(pkcs10_object_get_public_key);
 
-  if (xa->single)
-    lose("Couldn't extract signerInfos from CMS message[5]");
+  if ((asym = (asymmetric_object *) type->tp_alloc(type, 0)) == NULL)
+    goto error;
 
-  if (X509_ATTRIBUTE_count(xa) != 1)
-    lose("Couldn't extract signerInfos from CMS message[6]");
+  if ((asym->pkey = X509_REQ_get_pubkey(self->pkcs10)) == NULL)
+    lose_openssl_error("Couldn't extract public key from PKCS#10 request");
 
-  if ((so = X509_ATTRIBUTE_get0_type(xa, 0)) == NULL)
-    lose("Couldn't extract signerInfos from CMS message[7]");
+  whack_ec_key_to_namedCurve(asym->pkey);
 
-  switch (so->type) {
-  case V_ASN1_UTCTIME:
-    result = ASN1_TIME_to_Python(so->value.utctime);
-    break;
-  case V_ASN1_GENERALIZEDTIME:
-    result = ASN1_TIME_to_Python(so->value.generalizedtime);
-    break;
-  default:
-    lose("Couldn't extract signerInfos from CMS message[8]");
-  }
+  return (PyObject *) asym;
 
  error:
-  return result;
+  Py_XDECREF(asym);
+  return NULL;
 }
 
-static char cms_object_pprint__doc__[] =
-  "Return a pretty-printed representation of this CMS message.\n"
+static char pkcs10_object_set_public_key__doc__[] =
+  "Set the public key for this PKCS#10 request.\n"
+  "\n"
+  "The \"key\" parameter should be an instance of the Asymmetric class,\n"
+  "containing a public key.\n"
   ;
 
 static PyObject *
-cms_object_pprint(cms_object *self)
+pkcs10_object_set_public_key(pkcs10_object *self, PyObject *args)
 {
-  BIO *bio = NULL;
-  PyObject *result = NULL;
+  asymmetric_object *asym;
 
-  ENTERING(cms_object_pprint);
+  ENTERING(pkcs10_object_set_public_key);
 
-  if ((bio = BIO_new(BIO_s_mem())) == NULL)
-    lose_no_memory();
+  if (!PyArg_ParseTuple(args, "O!", &POW_Asymmetric_Type, &asym))
+    goto error;
 
-  if (!CMS_ContentInfo_print_ctx(bio, self->cms, 0, NULL))
-    lose_openssl_error("Unable to pretty-print CMS object");
+  if (!X509_REQ_set_pubkey(self->pkcs10, asym->pkey))
+    lose_openssl_error("Couldn't set certificate's PKCS#10 request");
 
-  result = BIO_to_PyString_helper(bio);
+  Py_RETURN_NONE;
 
  error:
-  BIO_free(bio);
-  return result;
+  return NULL;
 }
 
-static char cms_object_certs__doc__[] =
-  "Return any certificates embedded in this CMS message, as a sequence\n"
-  "of X509 objects.   This sequence will be empty if the message wrapper\n"
-  "contains no certificates.\n"
+static char pkcs10_object_sign__doc__[] =
+  "Sign a PKCS#10 request with a private key.\n"
+  "\n"
+  "The \"key\" parameter should be an instance of the Asymmetric class,\n"
+  "containing a private key.\n"
+  "\n"
+  "The optional \"digest\" parameter indicates which digest to compute and\n"
+  "sign, and should be one of the following:\n"
+  "\n"
+  "* SHA1_DIGEST\n"
+  "* SHA256_DIGEST\n"
+  "* SHA384_DIGEST\n"
+  "* SHA512_DIGEST\n"
+  "\n"
+  "The default digest algorithm is SHA-256.\n"
   ;
 
-/*
- * Might want to accept an optional subclass argument.
- */
-
 static PyObject *
-cms_object_certs(cms_object *self)
+pkcs10_object_sign(pkcs10_object *self, PyObject *args)
 {
-  STACK_OF(X509) *certs = NULL;
-  PyObject *result = NULL;
-
-  ENTERING(cms_object_certs);
+  asymmetric_object *asym;
+  int loc, digest_type = SHA256_DIGEST;
+  const EVP_MD *digest_method = NULL;
 
-  if ((certs = CMS_get1_certs(self->cms)) != NULL)
-    result = stack_to_tuple_helper(CHECKED_PTR_OF(STACK_OF(X509), certs),
-                                   stack_to_tuple_helper_get_x509);
-  else if (!ERR_peek_error())
-    result = Py_BuildValue("()");
-  else
-    lose_openssl_error("Couldn't extract certs from CMS message");
+  ENTERING(pkcs10_object_sign);
 
- error:                          /* fall through */
-  sk_X509_pop_free(certs, X509_free);
-  return result;
-}
+  if (!PyArg_ParseTuple(args, "O!|i", &POW_Asymmetric_Type, &asym, &digest_type))
+    goto error;
 
-static char cms_object_crls__doc__[] =
-  "Return any CRLs embedded in this CMS message, as a sequence of CRL objects.\n"
-  "This sequence will be empty if the message contains no CRLs.\n"
-  ;
+  if ((digest_method = evp_digest_factory(digest_type)) == NULL)
+    lose("Unsupported digest algorithm");
 
-/*
- * Might want to accept an optional subclass argument.
- */
+  while ((loc = X509_REQ_get_attr_by_NID(self->pkcs10, NID_ext_req, -1)) >= 0)
+    X509_ATTRIBUTE_free(X509_REQ_delete_attr(self->pkcs10, loc));
 
-static PyObject *
-cms_object_crls(cms_object *self)
-{
-  STACK_OF(X509_CRL) *crls = NULL;
-  PyObject *result = NULL;
+  if (sk_X509_EXTENSION_num(self->exts) > 0 &&
+      !X509_REQ_add_extensions(self->pkcs10, self->exts))
+    lose_openssl_error("Couldn't add extensions block to PKCS#10 request");
 
-  ENTERING(cms_object_crls);
+  if (!X509_REQ_sign(self->pkcs10, asym->pkey, digest_method))
+    lose_openssl_error("Couldn't sign PKCS#10 request");
 
-  if ((crls = CMS_get1_crls(self->cms)) != NULL)
-    result = stack_to_tuple_helper(CHECKED_PTR_OF(STACK_OF(X509_CRL), crls),
-                                   stack_to_tuple_helper_get_crl);
-  else if (!ERR_peek_error())
-    result = Py_BuildValue("()");
-  else
-    lose_openssl_error("Couldn't extract CRLs from CMS message");
+  Py_RETURN_NONE;
 
- error:                          /* fall through */
-  sk_X509_CRL_pop_free(crls, X509_CRL_free);
-  return result;
+ error:
+  return NULL;
 }
 
-static struct PyMethodDef cms_object_methods[] = {
-  Define_Method(pemWrite,                       cms_object_pem_write,                   METH_NOARGS),
-  Define_Method(derWrite,                       cms_object_der_write,                   METH_NOARGS),
-  Define_Method(sign,                           cms_object_sign,                        METH_VARARGS),
-  Define_Method(verify,                         cms_object_verify,                      METH_KEYWORDS),
-  Define_Method(extractWithoutVerifying,        cms_object_extract_without_verifying,   METH_NOARGS),
-  Define_Method(checkRPKIConformance,           cms_object_check_rpki_conformance,      METH_KEYWORDS),
-  Define_Method(eContentType,                   cms_object_eContentType,                METH_NOARGS),
-  Define_Method(signingTime,                    cms_object_signingTime,                 METH_NOARGS),
-  Define_Method(pprint,                         cms_object_pprint,                      METH_NOARGS),
-  Define_Method(certs,                          cms_object_certs,                       METH_NOARGS),
-  Define_Method(crls,                           cms_object_crls,                        METH_NOARGS),
-  Define_Class_Method(pemRead,                  cms_object_pem_read,                    METH_VARARGS),
-  Define_Class_Method(pemReadFile,              cms_object_pem_read_file,               METH_VARARGS),
-  Define_Class_Method(derRead,                  cms_object_der_read,                    METH_VARARGS),
-  Define_Class_Method(derReadFile,              cms_object_der_read_file,               METH_VARARGS),
-  {NULL}
-};
-
-static char POW_CMS_Type__doc__[] =
-  "Wrapper for OpenSSL's CMS class.  At present this only handes signed\n"
-  "objects, as those are the only kind of CMS objects used in RPKI.\n"
+static char pkcs10_object_verify__doc__[] =
+  "Verify a PKCS#10 request.\n"
+  "\n"
+  "This calls OpenSSL's X509_REQ_verify() method to check the request's\n"
+  "self-signature.\n"
   ;
 
-static PyTypeObject POW_CMS_Type = {
-  PyObject_HEAD_INIT(0)
-  0,                                  /* ob_size */
-  "rpki.POW.CMS",                     /* tp_name */
-  sizeof(cms_object),                 /* tp_basicsize */
-  0,                                  /* tp_itemsize */
-  (destructor)cms_object_dealloc,     /* tp_dealloc */
-  0,                                  /* tp_print */
-  0,                                  /* tp_getattr */
-  0,                                  /* tp_setattr */
-  0,                                  /* tp_compare */
-  0,                                  /* tp_repr */
-  0,                                  /* tp_as_number */
-  0,                                  /* tp_as_sequence */
-  0,                                  /* tp_as_mapping */
-  0,                                  /* tp_hash */
-  0,                                  /* tp_call */
-  0,                                  /* tp_str */
-  0,                                  /* tp_getattro */
-  0,                                  /* tp_setattro */
-  0,                                  /* tp_as_buffer */
-  Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, /* tp_flags */
-  POW_CMS_Type__doc__,                /* tp_doc */
-  0,                                  /* tp_traverse */
-  0,                                  /* tp_clear */
-  0,                                  /* tp_richcompare */
-  0,                                  /* tp_weaklistoffset */
-  0,                                  /* tp_iter */
-  0,                                  /* tp_iternext */
-  cms_object_methods,                 /* tp_methods */
-  0,                                  /* tp_members */
-  0,                                  /* tp_getset */
-  0,                                  /* tp_base */
-  0,                                  /* tp_dict */
-  0,                                  /* tp_descr_get */
-  0,                                  /* tp_descr_set */
-  0,                                  /* tp_dictoffset */
-  0,                                  /* tp_init */
-  0,                                  /* tp_alloc */
-  cms_object_new,                     /* tp_new */
-};
-
-
-
-/*
- * Manifest object.
- */
-
 static PyObject *
-manifest_object_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+pkcs10_object_verify(pkcs10_object *self)
 {
-  manifest_object *self = NULL;
+  EVP_PKEY *pkey = NULL;
+  int status;
 
-  ENTERING(manifest_object_new);
+  ENTERING(pkcs10_object_verify);
+
+  if ((pkey = X509_REQ_get_pubkey(self->pkcs10)) == NULL)
+    lose_openssl_error("Couldn't extract public key from PKCS#10 for verification");
+
+  if ((status = X509_REQ_verify(self->pkcs10, pkey)) < 0)
+    lose_openssl_error("Couldn't verify PKCS#10 signature");
 
-  if ((self = (manifest_object *) cms_object_new(type, args, kwds)) != NULL &&
-      (self->manifest = Manifest_new()) != NULL)
-    return (PyObject *) self;
+  EVP_PKEY_free(pkey);
+  return PyBool_FromLong(status);
 
-  Py_XDECREF(self);
+ error:
+  EVP_PKEY_free(pkey);
   return NULL;
 }
 
-static void
-manifest_object_dealloc(manifest_object *self)
+static char pkcs10_object_get_version__doc__[] =
+  "Return the version number of this PKCS#10 request.\n"
+  ;
+
+static PyObject *
+pkcs10_object_get_version(pkcs10_object *self)
 {
-  ENTERING(manifest_object_dealloc);
-  Manifest_free(self->manifest);
-  cms_object_dealloc(&self->cms);
+  ENTERING(pkcs10_object_get_version);
+  return Py_BuildValue("l", X509_REQ_get_version(self->pkcs10));
 }
 
-static char manifest_object_verify__doc__[] =
-  "Verify this manifest against a trusted certificate store.\n"
+static char pkcs10_object_set_version__doc__[] =
+  "Set the version number of this PKCS#10 request.\n"
   "\n"
-  CMS_OBJECT_VERIFY_HELPER__DOC__
-  ;
+  "The \"version\" parameter should be an integer, but the only defined\n"
+  "value is zero, so this field is optional and defaults to zero.\n"
+;
 
 static PyObject *
-manifest_object_verify(manifest_object *self, PyObject *args, PyObject *kwds)
+pkcs10_object_set_version(pkcs10_object *self, PyObject *args)
 {
-  BIO *bio = NULL;
-  int ok = 0;
+  long version = 0;
 
-  ENTERING(manifest_object_verify);
+  ENTERING(pkcs10_object_set_version);
 
-  if ((bio = cms_object_verify_helper(&self->cms, args, kwds)) == NULL)
+  if (!PyArg_ParseTuple(args, "|l", &version))
     goto error;
 
-  if (!ASN1_item_d2i_bio(ASN1_ITEM_rptr(Manifest), bio, &self->manifest))
-    lose_openssl_error("Couldn't decode manifest");
+  if (version != 0)
+    lose("RFC 6487 6.1.1 forbids non-zero values for this field");
 
-  ok = 1;
+  if (!X509_REQ_set_version(self->pkcs10, version))
+    lose("Couldn't set certificate version");
+
+  Py_RETURN_NONE;
 
  error:
-  BIO_free(bio);
 
-  if (ok)
-    Py_RETURN_NONE;
-  else
-    return NULL;
+  return NULL;
 }
 
-static char manifest_object_extract_without_verifying__doc__[] =
-  "Extract manifest payload from CMS wrapper without attempting CMS verification.\n"
+static char pkcs10_object_get_subject__doc__[] =
+  "Return this PKCS #10 request's subject name.\n"
   "\n"
-  "NEVER USE THIS METHOD ON AN UNVERIFIED MANIFEST!\n"
+  "See the X509.getIssuer() method for details of the return value and\n"
+  "use of the optional \"format\" parameter.\n"
   ;
 
 static PyObject *
-manifest_object_extract_without_verifying(manifest_object *self)
+pkcs10_object_get_subject(pkcs10_object *self, PyObject *args)
 {
-  BIO *bio = NULL;
-  int ok = 0;
+  PyObject *result = NULL;
+  int format = OIDNAME_FORMAT;
 
-  ENTERING(manifest_object_extract_without_verifying);
+  ENTERING(pkcs10_object_get_subject);
 
-  if ((bio = cms_object_extract_without_verifying_helper(&self->cms)) == NULL)
+  if (!PyArg_ParseTuple(args, "|i", &format))
     goto error;
 
-  if (!ASN1_item_d2i_bio(ASN1_ITEM_rptr(Manifest), bio, &self->manifest))
-    lose_openssl_error("Couldn't decode manifest");
-
-  ok = 1;
-
- error:
-  BIO_free(bio);
+  result = x509_object_helper_get_name(X509_REQ_get_subject_name(self->pkcs10),
+                                       format);
 
-  if (ok)
-    Py_RETURN_NONE;
-  else
-    return NULL;
+ error:                         /* Fall through */
+  return result;
 }
 
-static char manifest_object_check_rpki_conformance__doc__[] =
-  "Check this manifest for conformance to the RPKI profile.\n"
+static char pkcs10_object_set_subject__doc__[] =
+  "Set this PKCS#10 request's subject name.\n"
+  "\n"
+  "The \"name\" parameter should be in the same format as the return\n"
+  "value from the \"getSubject\" method.\n"
   ;
 
 static PyObject *
-manifest_object_check_rpki_conformance(manifest_object *self, PyObject *args, PyObject *kwds)
+pkcs10_object_set_subject(pkcs10_object *self, PyObject *args)
 {
-  static char *kwlist[] = {"status", NULL};
-  PyObject *status = Py_None;
+  PyObject *name_sequence = NULL;
+  X509_NAME *name = NULL;
 
-  ENTERING(manifest_object_check_rpki_conformance);
+  ENTERING(pkcs10_object_set_subject);
 
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!", kwlist, &PySet_Type, &status))
+  if (!PyArg_ParseTuple(args, "O", &name_sequence))
     goto error;
 
-  if (!check_cms(self->cms.cms, status) || !check_manifest(self->cms.cms, self->manifest, status))
+  if (!PySequence_Check(name_sequence))
+    lose_type_error("Expected a sequence object");
+
+  if ((name = x509_object_helper_set_name(name_sequence)) == NULL)
     goto error;
 
+  if (!X509_REQ_set_subject_name(self->pkcs10, name))
+    lose("Unable to set subject name");
+
+  X509_NAME_free(name);
+
   Py_RETURN_NONE;
 
  error:
+  X509_NAME_free(name);
   return NULL;
 }
 
+static char pkcs10_object_get_key_usage__doc__[] =
+  EXTENSION_GET_KEY_USAGE__DOC__
+  ;
 
 static PyObject *
-manifest_object_der_read_helper(PyTypeObject *type, BIO *bio)
+pkcs10_object_get_key_usage(pkcs10_object *self)
 {
-  manifest_object *self;
-
-  ENTERING(manifest_object_der_read_helper);
+  return extension_get_key_usage(pkcs10_object_extension_get_helper(self, NID_key_usage));
+}
 
-  if ((self = (manifest_object *) cms_object_der_read_helper(type, bio)) != NULL)
-    self->manifest = NULL;
+static char pkcs10_object_set_key_usage__doc__[] =
+  "Set the KeyUsage extension for this PKCS#10 request.\n"
+  "\n"
+  EXTENSION_SET_KEY_USAGE__DOC__
+  ;
 
-  return (PyObject *) self;
+static PyObject *
+pkcs10_object_set_key_usage(pkcs10_object *self, PyObject *args)
+{
+  return pkcs10_object_extension_set_helper(self, extension_set_key_usage(args));
 }
 
-static char manifest_object_der_read__doc__[] =
-  "Read a DER-encoded manifest object from a string.\n"
+static char pkcs10_object_get_eku__doc__[] =
+  EXTENSION_GET_EKU__DOC__
   ;
 
 static PyObject *
-manifest_object_der_read(PyTypeObject *type, PyObject *args)
+pkcs10_object_get_eku(pkcs10_object *self)
 {
-  ENTERING(manifest_object_der_read);
-  return read_from_string_helper(manifest_object_der_read_helper, type, args);
+  return extension_get_eku(pkcs10_object_extension_get_helper(self, NID_ext_key_usage));
 }
 
-static char manifest_object_der_read_file__doc__[] =
-  "Read a DER-encoded manifest object from a file.\n"
+static char pkcs10_object_set_eku__doc__[] =
+  "Set the ExtendedKeyUsage extension for this PKCS #10 request.\n"
+  "\n"
+  EXTENSION_SET_EKU__DOC__
   ;
 
 static PyObject *
-manifest_object_der_read_file(PyTypeObject *type, PyObject *args)
+pkcs10_object_set_eku(pkcs10_object *self, PyObject *args)
 {
-  ENTERING(manifest_object_der_read_file);
-  return read_from_file_helper(manifest_object_der_read_helper, type, args);
+  return pkcs10_object_extension_set_helper(self, extension_set_eku(args));
 }
 
+static char pkcs10_object_get_basic_constraints__doc__[] =
+  "Return BasicConstraints value for this PKCS#10 request.\n"
+  "\n"
+  EXTENSION_GET_BASIC_CONSTRAINTS__DOC__
+  ;
+
 static PyObject *
-manifest_object_pem_read_helper(PyTypeObject *type, BIO *bio)
+pkcs10_object_get_basic_constraints(pkcs10_object *self)
 {
-  manifest_object *self;
-
-  ENTERING(manifest_object_pem_read_helper);
+  return extension_get_basic_constraints(pkcs10_object_extension_get_helper(self, NID_basic_constraints));
+}
 
-  if ((self = (manifest_object *) cms_object_pem_read_helper(type, bio)) != NULL)
-    self->manifest = NULL;
+static char pkcs10_object_set_basic_constraints__doc__[] =
+  "Set BasicConstraints value for this PKCS#10 request.\n"
+  "\n"
+  EXTENSION_SET_BASIC_CONSTRAINTS__DOC__
+  ;
 
-  return (PyObject *) self;
+static PyObject *
+pkcs10_object_set_basic_constraints(pkcs10_object *self, PyObject *args)
+{
+  return pkcs10_object_extension_set_helper(self, extension_set_basic_constraints(args));
 }
 
-static char manifest_object_pem_read__doc__[] =
-  "Read a PEM-encoded manifest object from a string.\n"
+static char pkcs10_object_get_sia__doc__[] =
+  "Return the SIA values for this PKCS#10 request.\n"
+  "\n"
+  EXTENSION_GET_SIA__DOC__
   ;
 
 static PyObject *
-manifest_object_pem_read(PyTypeObject *type, PyObject *args)
+pkcs10_object_get_sia(pkcs10_object *self)
 {
-  ENTERING(manifest_object_pem_read);
-  return read_from_string_helper(manifest_object_pem_read_helper, type, args);
+  return extension_get_sia(pkcs10_object_extension_get_helper(self, NID_sinfo_access));
 }
 
-static char manifest_object_pem_read_file__doc__[] =
-  "Read a PEM-encoded manifest object from a file.\n"
+static char pkcs10_object_set_sia__doc__[] =
+  "Set SIA values for this PKCS#10 request.\n"
+  "\n"
+  EXTENSION_SET_SIA__DOC__
   ;
 
 static PyObject *
-manifest_object_pem_read_file(PyTypeObject *type, PyObject *args)
+pkcs10_object_set_sia(pkcs10_object *self, PyObject *args, PyObject *kwds)
 {
-  ENTERING(manifest_object_pem_read_file);
-  return read_from_file_helper(manifest_object_pem_read_helper, type, args);
+  return pkcs10_object_extension_set_helper(self, extension_set_sia(args, kwds));
 }
 
-static char manifest_object_get_version__doc__[] =
-  "Return the version number of this manifest.\n"
+static char pkcs10_object_get_signature_algorithm__doc__[] =
+  "Return this PKCS #10 reqeuest's signature algorithm OID.\n"
   ;
 
 static PyObject *
-manifest_object_get_version(manifest_object *self)
+pkcs10_object_get_signature_algorithm(pkcs10_object *self)
 {
-  ENTERING(manifest_object_get_version);
+  ASN1_OBJECT *oid = NULL;
 
-  if (self->manifest == NULL)
-    lose_not_verified("Can't report version of unverified manifest");
+  ENTERING(pkcs10_object_get_signature_algorithm);
 
-  if (self->manifest->version)
-    return Py_BuildValue("N", ASN1_INTEGER_to_PyLong(self->manifest->version));
-  else
-    return PyInt_FromLong(0);
+  X509_ALGOR_get0(&oid, NULL, NULL, self->pkcs10->sig_alg);
 
- error:
-  return NULL;
+  return ASN1_OBJECT_to_PyString(oid);
 }
 
-static char manifest_object_set_version__doc__[] =
-  "Set the version number of this manifest.\n"
-  "\n"
-  "The \"version\" parameter should be a non-negative integer.\n"
-  "\n"
-  "As of this writing, zero is both the default and the only defined version.\n"
-  "Attempting to set any version number other than zero will fail, as we\n"
-  "don't understand how to write other versions, by definition.\n"
+static char pkcs10_object_get_extension_oids__doc__[] =
+  "Return the set of extension OIDs used in this request.  This is mostly\n"
+  "useful for enforcing restrictions on what extensions are allowed to be\n"
+  "present, eg, to conform with the RPKI profile.\n"
   ;
 
 static PyObject *
-manifest_object_set_version(manifest_object *self, PyObject *args)
+pkcs10_object_get_extension_oids(pkcs10_object *self)
 {
-  int version = 0;
+  PyObject *result = NULL;
+  PyObject *oid = NULL;
+  int i;
 
-  ENTERING(manifest_object_set_version);
+  ENTERING(pkcs10_object_get_extension_oids);
 
-  if (!PyArg_ParseTuple(args, "|i", &version))
+  if ((result = PyFrozenSet_New(NULL)) == NULL)
     goto error;
 
-  if (version != 0)
-    lose("RFC 6486 only defines RPKI manifest version zero");
-
-  if (self->manifest == NULL)
-    lose_not_verified("Can't set version of unverified manifest");
-
-  ASN1_INTEGER_free(self->manifest->version);
-  self->manifest->version = NULL;
+  for (i = 0; i < sk_X509_EXTENSION_num(self->exts); i++) {
+    X509_EXTENSION *ext = sk_X509_EXTENSION_value(self->exts, i);
+    if ((oid = ASN1_OBJECT_to_PyString(X509_EXTENSION_get_object(ext))) == NULL ||
+        PySet_Add(result, oid) < 0)
+      goto error;
+    Py_XDECREF(oid);
+    oid = NULL;
+  }
 
-  Py_RETURN_NONE;
+  return result;
 
  error:
-  return NULL;
+  Py_XDECREF(result);
+  Py_XDECREF(oid);
+  return NULL;  
 }
 
-static char manifest_object_get_manifest_number__doc__[] =
-  "Return the manifestNumber of this manifest.\n"
+static char pkcs10_object_pprint__doc__[] =
+  "Return a pretty-printed rendition of this PKCS#10 request.\n"
   ;
 
 static PyObject *
-manifest_object_get_manifest_number(manifest_object *self)
+pkcs10_object_pprint(pkcs10_object *self)
 {
-  ENTERING(manifest_object_get_manifest_number);
-
-  if (self->manifest == NULL)
-    lose_not_verified("Can't get manifestNumber of unverified manifest");
+  PyObject *result = NULL;
+  BIO *bio = NULL;
 
-  return Py_BuildValue("N", ASN1_INTEGER_to_PyLong(self->manifest->manifestNumber));
+  ENTERING(pkcs10_object_pprint);
 
- error:
-  return NULL;
-}
+  if ((bio = BIO_new(BIO_s_mem())) == NULL)
+    lose_no_memory();
 
-static char manifest_object_set_manifest_number__doc__[] =
-  "Set the manifestNumber of this manifest.\n"
-  "\n"
-  "The \"manifestNumber\" parameter should be a non-negative integer.\n"
-  ;
+  if (!X509_REQ_print(bio, self->pkcs10))
+    lose_openssl_error("Unable to pretty-print PKCS#10 request");
 
-static PyObject *
-manifest_object_set_manifest_number(manifest_object *self, PyObject *args)
-{
-  PyObject *manifestNumber = NULL;
-  PyObject *zero = NULL;
-  int ok = 0;
+  result = BIO_to_PyString_helper(bio);
 
-  ENTERING(manifest_object_set_manifest_number);
+ error:                         /* Fall through */
+  BIO_free(bio);
+  return result;
+}
 
-  if (!PyArg_ParseTuple(args, "O", &manifestNumber))
-    goto error;
+static struct PyMethodDef pkcs10_object_methods[] = {
+  Define_Method(pemWrite,               pkcs10_object_pem_write,                METH_NOARGS),
+  Define_Method(derWrite,               pkcs10_object_der_write,                METH_NOARGS),
+  Define_Method(sign,                   pkcs10_object_sign,                     METH_VARARGS),
+  Define_Method(verify,                 pkcs10_object_verify,                   METH_NOARGS),
+  Define_Method(getPublicKey,           pkcs10_object_get_public_key,           METH_NOARGS),
+  Define_Method(setPublicKey,           pkcs10_object_set_public_key,           METH_VARARGS),
+  Define_Method(getVersion,             pkcs10_object_get_version,              METH_NOARGS),
+  Define_Method(setVersion,             pkcs10_object_set_version,              METH_VARARGS),
+  Define_Method(getSubject,             pkcs10_object_get_subject,              METH_VARARGS),
+  Define_Method(setSubject,             pkcs10_object_set_subject,              METH_VARARGS),
+  Define_Method(pprint,                 pkcs10_object_pprint,                   METH_NOARGS),
+  Define_Method(getKeyUsage,            pkcs10_object_get_key_usage,            METH_NOARGS),
+  Define_Method(setKeyUsage,            pkcs10_object_set_key_usage,            METH_VARARGS),
+  Define_Method(getEKU,                 pkcs10_object_get_eku,                  METH_NOARGS),
+  Define_Method(setEKU,                 pkcs10_object_set_eku,                  METH_VARARGS),
+  Define_Method(getBasicConstraints,    pkcs10_object_get_basic_constraints,    METH_NOARGS),
+  Define_Method(setBasicConstraints,    pkcs10_object_set_basic_constraints,    METH_VARARGS),
+  Define_Method(getSIA,                 pkcs10_object_get_sia,                  METH_NOARGS),
+  Define_Method(setSIA,                 pkcs10_object_set_sia,                  METH_KEYWORDS),
+  Define_Method(getSignatureAlgorithm,  pkcs10_object_get_signature_algorithm,  METH_NOARGS),
+  Define_Method(getExtensionOIDs,       pkcs10_object_get_extension_oids,       METH_NOARGS),
+  Define_Class_Method(pemRead,          pkcs10_object_pem_read,                 METH_VARARGS),
+  Define_Class_Method(pemReadFile,      pkcs10_object_pem_read_file,            METH_VARARGS),
+  Define_Class_Method(derRead,          pkcs10_object_der_read,                 METH_VARARGS),
+  Define_Class_Method(derReadFile,      pkcs10_object_der_read_file,            METH_VARARGS),
+  {NULL}
+};
 
-  if ((zero = PyInt_FromLong(0)) == NULL)
-    goto error;
+static char POW_PKCS10_Type__doc__[] =
+  "This class represents a PKCS#10 request.\n"
+  ;
 
-  switch (PyObject_RichCompareBool(manifestNumber, zero, Py_GE)) {
-  case -1:
-    goto error;
-  case 0:
-    lose("Negative manifest number is not allowed");
-  }
+static PyTypeObject POW_PKCS10_Type = {
+  PyObject_HEAD_INIT(0)
+  0,                                        /* ob_size */
+  "rpki.POW.PKCS10",                        /* tp_name */
+  sizeof(pkcs10_object),                    /* tp_basicsize */
+  0,                                        /* tp_itemsize */
+  (destructor)pkcs10_object_dealloc,        /* tp_dealloc */
+  0,                                        /* tp_print */
+  0,                                        /* tp_getattr */
+  0,                                        /* tp_setattr */
+  0,                                        /* tp_compare */
+  0,                                        /* tp_repr */
+  0,                                        /* tp_as_number */
+  0,                                        /* tp_as_sequence */
+  0,                                        /* tp_as_mapping */
+  0,                                        /* tp_hash */
+  0,                                        /* tp_call */
+  0,                                        /* tp_str */
+  0,                                        /* tp_getattro */
+  0,                                        /* tp_setattro */
+  0,                                        /* tp_as_buffer */
+  Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, /* tp_flags */
+  POW_PKCS10_Type__doc__,                   /* tp_doc */
+  0,                                        /* tp_traverse */
+  0,                                        /* tp_clear */
+  0,                                        /* tp_richcompare */
+  0,                                        /* tp_weaklistoffset */
+  0,                                        /* tp_iter */
+  0,                                        /* tp_iternext */
+  pkcs10_object_methods,                    /* tp_methods */
+  0,                                        /* tp_members */
+  0,                                        /* tp_getset */
+  0,                                        /* tp_base */
+  0,                                        /* tp_dict */
+  0,                                        /* tp_descr_get */
+  0,                                        /* tp_descr_set */
+  0,                                        /* tp_dictoffset */
+  0,                                        /* tp_init */
+  0,                                        /* tp_alloc */
+  pkcs10_object_new,                        /* tp_new */
+};
 
-  if (self->manifest == NULL)
-    lose_not_verified("Can't set manifestNumber of unverified manifest");
+
 
-  ASN1_INTEGER_free(self->manifest->manifestNumber);
+/*
+ * RRDPParser object.
+ *
+ * This is an incremental parser for RRDP (RFC 8182) snapshot and
+ * delta files.  It is not a general XML parser: it understands exactly
+ * as much XML as RRDP needs (one root element, one level of publish and
+ * withdraw elements, base64 text) and rejects everything else.  The
+ * point is to be able to feed it a file a chunk at a time as it comes
+ * off the wire and get back decoded objects, without ever holding more
+ * than one object in memory, no matter how large the snapshot.
+ */
 
-  if ((self->manifest->manifestNumber = PyLong_to_ASN1_INTEGER(manifestNumber)) == NULL)
-    goto error;
+/*
+ * Set a parse error.  Once we've failed, we stay failed.
+ */
 
-  ok = 1;
+#define lose_rrdp_error(_self_, _msg_)                                  \
+  do {                                                                  \
+    (_self_)->failed = 1;                                               \
+    PyErr_SetString(POWErrorObject, (_msg_));                           \
+    goto error;                                                         \
+  } while (0)
 
- error:
-  Py_XDECREF(zero);
+static int
+rrdp_is_space(const int c)
+{
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
 
-  if (ok)
-    Py_RETURN_NONE;
-  else
-    return NULL;
+static int
+rrdp_base64_value(const int c)
+{
+  if (c >= 'A' && c <= 'Z')
+    return c - 'A';
+  if (c >= 'a' && c <= 'z')
+    return c - 'a' + 26;
+  if (c >= '0' && c <= '9')
+    return c - '0' + 52;
+  if (c == '+')
+    return 62;
+  if (c == '/')
+    return 63;
+  return -1;
 }
 
-static char manifest_object_set_this_update__doc__[] =
-  "Set this manifest's \"thisUpdate\" value.\n"
-  "\n"
-  "The \"time\" parameter should be a datetime object.\n"
-  ;
+static char *
+rrdp_strdup(const char *s)
+{
+  char *result = PyMem_Malloc(strlen(s) + 1);
+  if (result != NULL)
+    strcpy(result, s);
+  return result;
+}
 
 static PyObject *
-manifest_object_set_this_update (manifest_object *self, PyObject *args)
+rrdp_parser_object_new(PyTypeObject *type, GCC_UNUSED PyObject *args, GCC_UNUSED PyObject *kwds)
 {
-  ASN1_TIME *t = NULL;
-  PyObject *o = NULL;
+  rrdp_parser_object *self = NULL;
 
-  ENTERING(manifest_object_set_this_update);
+  ENTERING(rrdp_parser_object_new);
 
-  if (!PyArg_ParseTuple(args, "O", &o))
+  if ((self = (rrdp_parser_object *) type->tp_alloc(type, 0)) == NULL)
     goto error;
 
-  if (self->manifest == NULL)
-    lose_not_verified("Can't set thisUpdate value of unverified manifest");
-
-  if ((t = Python_to_ASN1_TIME(o, 0)) == NULL)
-    lose("Couldn't convert thisUpdate string");
+  self->state = rrdp_state_text;
+  self->level = rrdp_level_prolog;
+  self->max_object_len = RRDP_DEFAULT_MAX_OBJECT_LEN;
 
-  ASN1_TIME_free(self->manifest->thisUpdate);
-  self->manifest->thisUpdate = t;
-  Py_RETURN_NONE;
+  return (PyObject *) self;
 
  error:
-  ASN1_TIME_free(t);
   return NULL;
 }
 
-static char manifest_object_get_this_update__doc__[] =
-  "Return this manifest's \"thisUpdate\" value as a datetime.\n"
-  ;
-
-static PyObject *
-manifest_object_get_this_update (manifest_object *self)
+static int
+rrdp_parser_object_init(rrdp_parser_object *self, PyObject *args, PyObject *kwds)
 {
-  ENTERING(manifest_object_get_this_update);
+  static char *kwlist[] = {"kind", "session_id", "serial", "directory", "max_object_size", NULL};
+  const char *kind = NULL, *session_id = NULL, *directory = NULL;
+  PyObject *serial = Py_None;
+  Py_ssize_t max_object_len = self->max_object_len;
 
-  if (self->manifest == NULL)
-    lose_not_verified("Can't get thisUpdate value of unverified manifest");
+  ENTERING(rrdp_parser_object_init);
 
-  return ASN1_TIME_to_Python(self->manifest->thisUpdate);
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|zzOzn", kwlist,
+                                   &kind, &session_id, &serial, &directory, &max_object_len))
+    goto error;
 
- error:
-  return NULL;
-}
+  if (kind != NULL && strcmp(kind, "snapshot") && strcmp(kind, "delta"))
+    lose_value_error("RRDP file kind must be \"snapshot\" or \"delta\"");
 
-static char manifest_object_set_next_update__doc__[] =
-  "Set this manifest's \"nextUpdate\" value.\n"
-  "\n"
-  "The \"time\" parameter should be a datetime object.\n"
-  ;
+  if (max_object_len <= 0)
+    lose_value_error("Maximum object size must be positive");
 
-static PyObject *
-manifest_object_set_next_update (manifest_object *self, PyObject *args)
-{
-  ASN1_TIME *t = NULL;
-  PyObject *o = NULL;
+  self->expected_kind = kind == NULL ? rrdp_kind_unknown : kind[0] == 's' ? rrdp_kind_snapshot : rrdp_kind_delta;
+  self->max_object_len = max_object_len;
 
-  ENTERING(manifest_object_set_next_update);
+  if ((session_id != NULL && (self->expected_session_id = rrdp_strdup(session_id)) == NULL) ||
+      (directory  != NULL && (self->directory           = rrdp_strdup(directory))  == NULL))
+    lose_no_memory();
 
-  if (!PyArg_ParseTuple(args, "O", &o))
+  if (serial != Py_None && (self->expected_serial = PyNumber_Long(serial)) == NULL)
     goto error;
 
-  if (self->manifest == NULL)
-    lose_not_verified("Can't set nextUpdate value of unverified manifest"); 
-
-  if ((t = Python_to_ASN1_TIME(o, 0)) == NULL)
-    lose("Couldn't parse nextUpdate string");
-
-  ASN1_TIME_free(self->manifest->nextUpdate);
-  self->manifest->nextUpdate = t;
-  Py_RETURN_NONE;
+  return 0;
 
  error:
-  ASN1_TIME_free(t);
-  return NULL;
+  return -1;
 }
 
-static char manifest_object_get_next_update__doc__[] =
-  "Return this manifest's \"nextUpdate\" value as a datetime.\n"
-  ;
+static void
+rrdp_parser_object_dealloc(rrdp_parser_object *self)
+{
+  ENTERING(rrdp_parser_object_dealloc);
+  PyMem_Free(self->tag);
+  PyMem_Free(self->der);
+  PyMem_Free(self->uri);
+  PyMem_Free(self->hash);
+  PyMem_Free(self->session_id);
+  PyMem_Free(self->expected_session_id);
+  PyMem_Free(self->directory);
+  Py_XDECREF(self->serial);
+  Py_XDECREF(self->expected_serial);
+  self->ob_type->tp_free((PyObject*) self);
+}
 
-static PyObject *
-manifest_object_get_next_update (manifest_object *self)
+/*
+ * Append decoded bytes to the current object.
+ */
+
+static int
+rrdp_parser_append_der(rrdp_parser_object *self, const unsigned char *data, const size_t len)
 {
-  ENTERING(manifest_object_get_next_update);
+  unsigned char *der;
+  size_t size;
 
-  if (self->manifest == NULL)
-    lose_not_verified("Can't extract nextUpdate value of unverified manifest");
+  if (self->der_len + len > self->max_object_len)
+    lose_rrdp_error(self, "RRDP object exceeds maximum object size");
 
-  return ASN1_TIME_to_Python(self->manifest->nextUpdate);
+  if (self->der_len + len > self->der_size) {
+    for (size = self->der_size ? self->der_size : 4096; size < self->der_len + len; size *= 2)
+      ;
+    if ((der = PyMem_Realloc(self->der, size)) == NULL)
+      lose_no_memory();
+    self->der = der;
+    self->der_size = size;
+  }
+
+  memcpy(self->der + self->der_len, data, len);
+  self->der_len += len;
+  return 1;
 
  error:
-  return NULL;
+  return 0;
 }
 
-static char manifest_object_get_algorithm__doc__[] =
-  "Return this manifest's fileHashAlg OID.\n"
-  ;
+/*
+ * Decode one character of base64 text inside a publish element.
+ */
+
+static int
+rrdp_parser_base64(rrdp_parser_object *self, const int c)
+{
+  unsigned char out[3];
+  int v;
+
+  if (rrdp_is_space(c))
+    return 1;
+
+  if (self->b64_done)
+    lose_rrdp_error(self, "Base64 data after padding in RRDP publish element");
+
+  if (c == '=') {
+    if (self->b64_n < 2)
+      lose_rrdp_error(self, "Misplaced base64 padding in RRDP publish element");
+    self->b64_pad++;
+    self->b64[self->b64_n++] = 0;
+  }
+
+  else if ((v = rrdp_base64_value(c)) < 0 || self->b64_pad > 0)
+    lose_rrdp_error(self, "Bad base64 data in RRDP publish element");
+
+  else
+    self->b64[self->b64_n++] = v;
 
-static PyObject *
-manifest_object_get_algorithm(manifest_object *self)
-{
-  PyObject *result = NULL;
+  if (self->b64_n < 4)
+    return 1;
 
-  ENTERING(manifest_object_get_algorithm);
+  out[0] = (self->b64[0] << 2) | (self->b64[1] >> 4);
+  out[1] = (self->b64[1] << 4) | (self->b64[2] >> 2);
+  out[2] = (self->b64[2] << 6) | (self->b64[3]);
 
-  if (self->manifest == NULL)
-    lose_not_verified("Can't extract algorithm OID of unverified manifest");
+  self->b64_done = self->b64_pad > 0;
+  self->b64_n = 0;
 
-  result = ASN1_OBJECT_to_PyString(self->manifest->fileHashAlg);
+  return rrdp_parser_append_der(self, out, 3 - self->b64_pad);
 
  error:
-  return result;
+  return 0;
 }
 
-static char manifest_object_set_algorithm__doc__[] =
-  "Set this manifest's fileHashAlg OID.\n"
-  ;
+/*
+ * Convert an rsync URI into a filename under our output directory,
+ * refusing anything that would let the publisher write outside it.
+ */
 
-static PyObject *
-manifest_object_set_algorithm(manifest_object *self, PyObject *args)
+static char *
+rrdp_parser_uri_to_filename(rrdp_parser_object *self)
 {
-  ASN1_OBJECT *oid = NULL;
-  const char *s = NULL;
+  static const char scheme[] = "rsync://";
+  const char *path = self->uri + sizeof(scheme) - 1;
+  const char *p, *q;
+  char *result = NULL;
 
-  ENTERING(manifest_object_set_algorithm);
+  if (strncmp(self->uri, scheme, sizeof(scheme) - 1))
+    lose_rrdp_error(self, "RRDP URI is not an rsync URI");
 
-  if (!PyArg_ParseTuple(args, "s", &s))
-    goto error;
+  /*
+   * Empty components also catch a missing filename.
+   */
 
-  if (self->manifest == NULL)
-    lose_not_verified("Can't set algorithm OID for unverified manifest");
+  for (p = path; p != NULL; p = q == NULL ? NULL : q + 1) {
+    q = strchr(p, '/');
+    if (*p == '/' || *p == '\0' ||
+        (p[0] == '.' && (p[1] == '/' || p[1] == '\0')) ||
+        (p[0] == '.' && p[1] == '.' && (p[2] == '/' || p[2] == '\0')))
+      lose_rrdp_error(self, "RRDP URI contains bad path component");
+  }
 
-  if ((oid = OBJ_txt2obj(s, 1)) == NULL)
+  if ((result = PyMem_Malloc(strlen(self->directory) + strlen(path) + 2)) == NULL)
     lose_no_memory();
 
-  ASN1_OBJECT_free(self->manifest->fileHashAlg);
-  self->manifest->fileHashAlg = oid;
-  Py_RETURN_NONE;
+  sprintf(result, "%s/%s", self->directory, path);
+  return result;
 
  error:
-  ASN1_OBJECT_free(oid);
   return NULL;
 }
 
-static char manifest_object_add_files__doc__[] =
-  "Add a collection of <filename, hash> pairs to this manifest.\n"
-  "\n"
-  "The \"iterable\" parameter should be an iterable object supplying\n"
-  "returning two-element sequences; the first element of each sequence\n"
-  "should be the filename (a text string), the second element should be the\n"
-  "hash (a binary string).\n"
-  ;
+/*
+ * Check that the file a publish element replaces or a withdraw element
+ * removes is the one the publisher says it is.  RFC 8182 requires the
+ * hash attribute to match our copy, so we refuse to touch a file we
+ * don't have or whose SHA-256 is something else.
+ */
 
-static PyObject *
-manifest_object_add_files(manifest_object *self, PyObject *args)
+static int
+rrdp_parser_check_hash(rrdp_parser_object *self, const char *filename)
 {
-  PyObject *iterable = NULL;
-  PyObject *iterator = NULL;
-  PyObject *item = NULL;
-  PyObject *fast = NULL;
-  FileAndHash *fah = NULL;
-  char *file = NULL;
-  char *hash = NULL;
-  Py_ssize_t filelen, hashlen;
-  int ok = 0;
+  unsigned char buffer[8192], digest[HASH_SHA256_LEN];
+  char hexdigest[2 * HASH_SHA256_LEN + 1];
+  SHA256_CTX ctx;
+  FILE *f = NULL;
+  size_t n;
+  int i, ok = 0;
 
-  ENTERING(manifest_object_add_files);
-
-  if (self->manifest == NULL)
-    lose_not_verified("Can't add files to unverified manifest");
+  if ((f = fopen(filename, "rb")) == NULL && errno == ENOENT)
+    lose_rrdp_error(self, "RRDP element replaces or withdraws an object we don't have");
 
-  if (!PyArg_ParseTuple(args, "O", &iterable) ||
-      (iterator = PyObject_GetIter(iterable)) == NULL)
+  if (f == NULL) {
+    PyErr_SetFromErrnoWithFilename(PyExc_OSError, filename);
     goto error;
+  }
 
-  while ((item = PyIter_Next(iterator)) != NULL) {
-
-    if ((fast = PySequence_Fast(item, "FileAndHash entry must be a sequence")) == NULL)
-      goto error;
+  SHA256_Init(&ctx);
 
-    if (PySequence_Fast_GET_SIZE(fast) != 2)
-      lose_type_error("FileAndHash entry must be two-element sequence");
+  while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+    SHA256_Update(&ctx, buffer, n);
 
-    if (PyString_AsStringAndSize(PySequence_Fast_GET_ITEM(fast, 0), &file, &filelen) < 0 ||
-        PyString_AsStringAndSize(PySequence_Fast_GET_ITEM(fast, 1), &hash, &hashlen) < 0)
-      goto error;
+  if (ferror(f)) {
+    PyErr_SetFromErrnoWithFilename(PyExc_OSError, filename);
+    goto error;
+  }
 
-    if ((fah = FileAndHash_new()) == NULL ||
-        !ASN1_OCTET_STRING_set(fah->file, (unsigned char *) file, filelen) ||
-        !ASN1_BIT_STRING_set(fah->hash, (unsigned char *) hash, hashlen) ||
-        !sk_FileAndHash_push(self->manifest->fileList, fah))
-      lose_no_memory();
+  SHA256_Final(digest, &ctx);
 
-    fah->hash->flags &= ~7;
-    fah->hash->flags |= ASN1_STRING_FLAG_BITS_LEFT;
+  for (i = 0; i < HASH_SHA256_LEN; i++)
+    sprintf(hexdigest + 2 * i, "%02x", digest[i]);
 
-    fah = NULL;
-    Py_XDECREF(item);
-    Py_XDECREF(fast);
-    item = fast = NULL;
-  }
+  if (strcmp(hexdigest, self->hash))
+    lose_rrdp_error(self, "RRDP hash attribute doesn't match the object it replaces or withdraws");
 
   ok = 1;
 
  error:
-  Py_XDECREF(iterator);
-  Py_XDECREF(item);
-  Py_XDECREF(fast);
-  FileAndHash_free(fah);
-
-  if (ok)
-    Py_RETURN_NONE;
-  else
-    return NULL;
+  if (f != NULL)
+    (void) fclose(f);
+  return ok;
 }
 
-static char manifest_object_get_files__doc__[] =
-  "Return a tuple of <filename, hash> pairs representing the contents of\n"
-  "this manifest.\n"
-  ;
+/*
+ * Write the current object to the output directory, creating parent
+ * directories as needed.  Write to a temporary file and rename it into
+ * place, so that nobody ever sees a partial object.  mkstemp() creates
+ * the temporary file owner-only, but these are public objects, so we
+ * make it world-readable like anything else in the tree.
+ */
 
-static PyObject *
-manifest_object_get_files(manifest_object *self)
+static int
+rrdp_parser_write_file(rrdp_parser_object *self)
 {
-  PyObject *result = NULL;
-  PyObject *item = NULL;
-  int i;
-
-  ENTERING(manifest_object_get_files);
-
-  if (self->manifest == NULL)
-    lose_not_verified("Can't get files from unverified manifest");
-
-  if (self->manifest->fileList == NULL)
-    lose("Inexplicable NULL manifest fileList pointer");
+  char *filename = NULL, *tempname = NULL, *p;
+  FILE *f = NULL;
+  int written, fd = -1, ok = 0;
 
-  if ((result = PyTuple_New(sk_FileAndHash_num(self->manifest->fileList))) == NULL)
+  if ((filename = rrdp_parser_uri_to_filename(self)) == NULL)
     goto error;
 
-  for (i = 0; i < sk_FileAndHash_num(self->manifest->fileList); i++) {
-    FileAndHash *fah = sk_FileAndHash_value(self->manifest->fileList, i);
+  if (self->hash != NULL && !rrdp_parser_check_hash(self, filename))
+    goto error;
 
-    item = Py_BuildValue("(s#s#)",
-                         ASN1_STRING_data(fah->file),
-                         (Py_ssize_t) ASN1_STRING_length(fah->file),
-                         ASN1_STRING_data(fah->hash),
-                         (Py_ssize_t) ASN1_STRING_length(fah->hash));
-    if (item == NULL)
+  for (p = filename + strlen(self->directory) + 1; (p = strchr(p, '/')) != NULL; p++) {
+    *p = '\0';
+    if (mkdir(filename, 0777) < 0 && errno != EEXIST) {
+      PyErr_SetFromErrnoWithFilename(PyExc_OSError, filename);
       goto error;
-
-    PyTuple_SET_ITEM(result, i, item);
-    item = NULL;
+    }
+    *p = '/';
   }
 
-  return result;
-
- error:
-  Py_XDECREF(result);
-  Py_XDECREF(item);
-  return NULL;
-}
-
-static char manifest_object_sign__doc__[] =
-  "Sign this manifest.  See the CMS class's .sign() method for details.\n"
-  ;
-
-static PyObject *
-manifest_object_sign(manifest_object *self, PyObject *args)
-{
-  asymmetric_object *signkey = NULL;
-  x509_object *signcert = NULL;
-  PyObject *x509_iterable = Py_None;
-  PyObject *crl_iterable = Py_None;
-  char *oid = NULL;
-  unsigned flags = 0;
-  BIO *bio = NULL;
-  int ok = 0;
+  if ((tempname = PyMem_Malloc(strlen(filename) + sizeof(".XXXXXX"))) == NULL)
+    lose_no_memory();
 
-  ENTERING(manifest_object_sign);
+  strcpy(tempname, filename);
+  strcat(tempname, ".XXXXXX");
 
-  if (!PyArg_ParseTuple(args, "O!O!|OOsI",
-                        &POW_X509_Type, &signcert,
-                        &POW_Asymmetric_Type, &signkey,
-                        &x509_iterable,
-                        &crl_iterable,
-                        &oid,
-                        &flags))
+  if ((fd = mkstemp(tempname)) < 0) {
+    PyErr_SetFromErrnoWithFilename(PyExc_OSError, tempname);
     goto error;
+  }
 
-  if ((bio = BIO_new(BIO_s_mem())) == NULL)
-    lose_no_memory();
-
-  assert_no_unhandled_openssl_errors();
-
-  if (!ASN1_item_i2d_bio(ASN1_ITEM_rptr(Manifest), bio, self->manifest))
-    lose_openssl_error("Couldn't encode manifest");
+  if (fchmod(fd, 0644) < 0 || (f = fdopen(fd, "wb")) == NULL) {
+    PyErr_SetFromErrnoWithFilename(PyExc_OSError, tempname);
+    (void) close(fd);
+    (void) unlink(tempname);
+    goto error;
+  }
 
-  assert_no_unhandled_openssl_errors();
+  written = fwrite(self->der, 1, self->der_len, f) == self->der_len;
 
-  if (!cms_object_sign_helper(&self->cms, bio, signcert, signkey,
-                              x509_iterable, crl_iterable, oid, flags))
-    lose_openssl_error("Couldn't sign manifest");
+  if (fclose(f) != 0 || !written) {
+    PyErr_SetFromErrnoWithFilename(PyExc_OSError, tempname);
+    (void) unlink(tempname);
+    goto error;
+  }
 
-  assert_no_unhandled_openssl_errors();
+  if (rename(tempname, filename) < 0) {
+    PyErr_SetFromErrnoWithFilename(PyExc_OSError, filename);
+    (void) unlink(tempname);
+    goto error;
+  }
 
   ok = 1;
 
  error:
-  BIO_free(bio);
-
-  if (ok)
-    Py_RETURN_NONE;
-  else
-    return NULL;
+  PyMem_Free(filename);
+  PyMem_Free(tempname);
+  return ok;
 }
 
-static struct PyMethodDef manifest_object_methods[] = {
-  Define_Method(getVersion,			manifest_object_get_version,                    METH_NOARGS),
-  Define_Method(setVersion,			manifest_object_set_version,                    METH_VARARGS),
-  Define_Method(getManifestNumber,		manifest_object_get_manifest_number,            METH_NOARGS),
-  Define_Method(setManifestNumber,		manifest_object_set_manifest_number,            METH_VARARGS),
-  Define_Method(getThisUpdate,			manifest_object_get_this_update,                METH_NOARGS),
-  Define_Method(setThisUpdate,			manifest_object_set_this_update,                METH_VARARGS),
-  Define_Method(getNextUpdate,			manifest_object_get_next_update,                METH_NOARGS),
-  Define_Method(setNextUpdate,			manifest_object_set_next_update,                METH_VARARGS),
-  Define_Method(getAlgorithm,			manifest_object_get_algorithm,                  METH_NOARGS),
-  Define_Method(setAlgorithm,			manifest_object_set_algorithm,                  METH_VARARGS),
-  Define_Method(getFiles,			manifest_object_get_files,                      METH_NOARGS),
-  Define_Method(addFiles,			manifest_object_add_files,                      METH_VARARGS),
-  Define_Method(sign,				manifest_object_sign,                           METH_VARARGS),
-  Define_Method(verify,				manifest_object_verify,                         METH_KEYWORDS),
-  Define_Method(checkRPKIConformance,		manifest_object_check_rpki_conformance,         METH_KEYWORDS),
-  Define_Method(extractWithoutVerifying,	manifest_object_extract_without_verifying,      METH_NOARGS),
-  Define_Class_Method(pemRead,			manifest_object_pem_read,                       METH_VARARGS),
-  Define_Class_Method(pemReadFile,		manifest_object_pem_read_file,                  METH_VARARGS),
-  Define_Class_Method(derRead,			manifest_object_der_read,                       METH_VARARGS),
-  Define_Class_Method(derReadFile,		manifest_object_der_read_file,                  METH_VARARGS),
-  {NULL}
-};
+static int
+rrdp_parser_remove_file(rrdp_parser_object *self)
+{
+  char *filename = NULL;
+  int ok = 0;
 
-static char POW_Manifest_Type__doc__[] =
-  "This class provides access to RPKI manifest payload.\n"
-  "Most methods are inherited from or share code with the CMS class.\n"
-  ;
+  if ((filename = rrdp_parser_uri_to_filename(self)) == NULL ||
+      !rrdp_parser_check_hash(self, filename))
+    goto error;
 
-static PyTypeObject POW_Manifest_Type = {
-  PyObject_HEAD_INIT(0)
-  0,                                            /* ob_size */
-  "rpki.POW.Manifest",                          /* tp_name */
-  sizeof(manifest_object),                      /* tp_basicsize */
-  0,                                            /* tp_itemsize */
-  (destructor)manifest_object_dealloc,          /* tp_dealloc */
-  0,                                            /* tp_print */
-  0,                                            /* tp_getattr */
-  0,                                            /* tp_setattr */
-  0,                                            /* tp_compare */
-  0,                                            /* tp_repr */
-  0,                                            /* tp_as_number */
-  0,                                            /* tp_as_sequence */
-  0,                                            /* tp_as_mapping */
-  0,                                            /* tp_hash */
-  0,                                            /* tp_call */
-  0,                                            /* tp_str */
-  0,                                            /* tp_getattro */
-  0,                                            /* tp_setattro */
-  0,                                            /* tp_as_buffer */
-  Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,     /* tp_flags */
-  POW_Manifest_Type__doc__,                     /* tp_doc */
-  0,                                            /* tp_traverse */
-  0,                                            /* tp_clear */
-  0,                                            /* tp_richcompare */
-  0,                                            /* tp_weaklistoffset */
-  0,                                            /* tp_iter */
-  0,                                            /* tp_iternext */
-  manifest_object_methods,                      /* tp_methods */
-  0,                                            /* tp_members */
-  0,                                            /* tp_getset */
-  &POW_CMS_Type,                                /* tp_base */
-  0,                                            /* tp_dict */
-  0,                                            /* tp_descr_get */
-  0,                                            /* tp_descr_set */
-  0,                                            /* tp_dictoffset */
-  0,                                            /* tp_init */
-  0,                                            /* tp_alloc */
-  manifest_object_new,                          /* tp_new */
-};
+  if (unlink(filename) < 0) {
+    PyErr_SetFromErrnoWithFilename(PyExc_OSError, filename);
+    goto error;
+  }
 
-
+  ok = 1;
+
+ error:
+  PyMem_Free(filename);
+  return ok;
+}
 
 /*
- * ROA object.
+ * Finish a publish or withdraw element: hash the object, write it
+ * out or wrap it up as a Python string, and append an event tuple to
+ * the list we're returning from .feed().
  */
 
-static PyObject *
-roa_object_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+static int
+rrdp_parser_emit(rrdp_parser_object *self, PyObject *events)
 {
-  roa_object *self = NULL;
+  unsigned char digest[HASH_SHA256_LEN];
+  char hexdigest[2 * HASH_SHA256_LEN + 1];
+  PyObject *der = NULL, *event = NULL;
+  int i, ok = 0;
 
-  ENTERING(roa_object_new);
+  if (self->element == rrdp_element_withdraw) {
 
-  if ((self = (roa_object *) cms_object_new(type, args, kwds)) != NULL &&
-      (self->roa = ROA_new()) != NULL)
-    return (PyObject *) self;
+    if (self->directory != NULL && !rrdp_parser_remove_file(self))
+      goto error;
 
-  Py_XDECREF(self);
-  return NULL;
-}
+    event = Py_BuildValue("(sszOO)", "withdraw", self->uri, self->hash, Py_None, Py_None);
 
-static void
-roa_object_dealloc(roa_object *self)
-{
-  ENTERING(roa_object_dealloc);
-  ROA_free(self->roa);
-  cms_object_dealloc(&self->cms);
-}
+  } else {
 
-static char roa_object_verify__doc__[] =
-  "Verify this ROA against a trusted certificate store.\n"
-  "\n"
-  CMS_OBJECT_VERIFY_HELPER__DOC__
-  ;
+    if (self->b64_n != 0)
+      lose_rrdp_error(self, "Truncated base64 data in RRDP publish element");
 
-static PyObject *
-roa_object_verify(roa_object *self, PyObject *args, PyObject *kwds)
-{
-  BIO *bio = NULL;
-  int ok = 0;
+    SHA256(self->der, self->der_len, digest);
+    for (i = 0; i < HASH_SHA256_LEN; i++)
+      sprintf(hexdigest + 2 * i, "%02x", digest[i]);
 
-  ENTERING(roa_object_verify);
+    if (self->directory != NULL) {
+      if (!rrdp_parser_write_file(self))
+        goto error;
+      Py_INCREF(Py_None);
+      der = Py_None;
+    }
+
+    else if ((der = PyString_FromStringAndSize((char *) self->der, self->der_len)) == NULL)
+      goto error;
+
+    event = Py_BuildValue("(sszsN)", "publish", self->uri, self->hash, hexdigest, der);
+    der = NULL;
+  }
 
-  if ((bio = cms_object_verify_helper(&self->cms, args, kwds)) == NULL)
+  if (event == NULL || PyList_Append(events, event) < 0)
     goto error;
-  
-  if (!ASN1_item_d2i_bio(ASN1_ITEM_rptr(ROA), bio, &self->roa))
-    lose_openssl_error("Couldn't decode ROA");
 
   ok = 1;
 
  error:
-  BIO_free(bio);
-
-  if (ok)
-    Py_RETURN_NONE;
-  else
-    return NULL;
+  PyMem_Free(self->uri);
+  PyMem_Free(self->hash);
+  self->uri = self->hash = NULL;
+  self->element = rrdp_element_none;
+  self->der_len = 0;
+  self->b64_n = self->b64_pad = self->b64_done = 0;
+  Py_XDECREF(der);
+  Py_XDECREF(event);
+  return ok;
 }
 
+/*
+ * Split the attributes out of a start tag, decoding the handful of
+ * entity references that can legitimately show up in attribute values.
+ * Everything happens in place in the tag buffer, since decoding never
+ * makes anything longer.  Returns the number of attributes, or -1 on
+ * error.
+ */
 
-static char roa_object_extract_without_verifying__doc__[] =
-  "Extract ROA payload from CMS wrapper without attempting CMS verification.\n"
-  "\n"
-  "NEVER USE THIS METHOD ON AN UNVERIFIED ROA!\n"
-  ;
-
-static PyObject *
-roa_object_extract_without_verifying(roa_object *self)
+static int
+rrdp_parser_split_attributes(rrdp_parser_object *self, char *p, char **names, char **values, const int max_attributes)
 {
-  BIO *bio = NULL;
-  int ok = 0;
+  static const struct { const char *name; char value; } entities[] = {
+    {"amp;", '&'}, {"lt;", '<'}, {"gt;", '>'}, {"quot;", '"'}, {"apos;", '\''}
+  };
+  char *q, quote;
+  int i, n = 0;
 
-  ENTERING(roa_object_extract_without_verifying);
+  for (;;) {
 
-  if ((bio = cms_object_extract_without_verifying_helper(&self->cms)) == NULL)
-    goto error;
+    while (rrdp_is_space(*p))
+      p++;
 
-  if (!ASN1_item_d2i_bio(ASN1_ITEM_rptr(ROA), bio, &self->roa))
-    lose_openssl_error("Couldn't decode ROA");
+    if (*p == '\0')
+      return n;
 
-  ok = 1;
+    if (n >= max_attributes)
+      lose_rrdp_error(self, "Too many attributes in RRDP element");
 
- error:
-  BIO_free(bio);
+    names[n] = p;
 
-  if (ok)
-    Py_RETURN_NONE;
-  else
-    return NULL;
+    while (*p != '\0' && *p != '=' && !rrdp_is_space(*p))
+      p++;
+
+    q = p;
+
+    while (rrdp_is_space(*p))
+      p++;
+
+    if (*p++ != '=')
+      lose_rrdp_error(self, "Malformed attribute in RRDP element");
+
+    *q = '\0';
+
+    while (rrdp_is_space(*p))
+      p++;
+
+    if ((quote = *p++) != '"' && quote != '\'')
+      lose_rrdp_error(self, "Unquoted attribute value in RRDP element");
+
+    values[n] = q = p;
+
+    while (*p != quote) {
+      if (*p == '\0' || *p == '<')
+        lose_rrdp_error(self, "Malformed attribute value in RRDP element");
+      if (*p != '&') {
+        *q++ = *p++;
+        continue;
+      }
+      for (i = 0; i < (int) (sizeof(entities)/sizeof(*entities)); i++)
+        if (!strncmp(p + 1, entities[i].name, strlen(entities[i].name)))
+          break;
+      if (i == (int) (sizeof(entities)/sizeof(*entities)))
+        lose_rrdp_error(self, "Unsupported entity reference in RRDP attribute value");
+      *q++ = entities[i].value;
+      p += strlen(entities[i].name) + 1;
+    }
+
+    *q = '\0';
+    p++;
+    n++;
+
+    if (*p != '\0' && !rrdp_is_space(*p))
+      lose_rrdp_error(self, "Malformed attribute in RRDP element");
+  }
+
+ error:
+  return -1;
 }
 
-static char roa_object_check_rpki_conformance__doc__[] =
-  "Check this ROA for conformance to the RPKI profile.\n"
-  ;
+/*
+ * Handle the root element's start tag.
+ */
 
-static PyObject *
-roa_object_check_rpki_conformance(roa_object *self, PyObject *args, PyObject *kwds)
+static int
+rrdp_parser_root(rrdp_parser_object *self, const char *name, char **names, char **values, const int n)
 {
-  static char *kwlist[] = {"status", NULL};
-  PyObject *status = Py_None;
+  const char *xmlns = NULL, *version = NULL, *session_id = NULL, *serial = NULL;
+  const char *p;
+  int i;
 
-  ENTERING(roa_object_check_rpki_conformance);
+  if (!strcmp(name, "snapshot"))
+    self->kind = rrdp_kind_snapshot;
+  else if (!strcmp(name, "delta"))
+    self->kind = rrdp_kind_delta;
+  else
+    lose_rrdp_error(self, "RRDP file root is neither snapshot nor delta");
+
+  if (self->expected_kind != rrdp_kind_unknown && self->expected_kind != self->kind)
+    lose_rrdp_error(self, "Unexpected RRDP file kind");
+
+  for (i = 0; i < n; i++) {
+    if (!strcmp(names[i], "xmlns") && xmlns == NULL)
+      xmlns = values[i];
+    else if (!strcmp(names[i], "version") && version == NULL)
+      version = values[i];
+    else if (!strcmp(names[i], "session_id") && session_id == NULL)
+      session_id = values[i];
+    else if (!strcmp(names[i], "serial") && serial == NULL)
+      serial = values[i];
+    else
+      lose_rrdp_error(self, "Unexpected attribute in RRDP root element");
+  }
 
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!", kwlist, &PySet_Type, &status))
-    goto error;
+  if (xmlns == NULL || strcmp(xmlns, RRDP_XMLNS))
+    lose_rrdp_error(self, "Missing or wrong RRDP XML namespace");
 
-  if (!check_cms(self->cms.cms, status) || !check_roa(self->cms.cms, self->roa, status))
+  if (version == NULL || strcmp(version, "1"))
+    lose_rrdp_error(self, "Unsupported RRDP version");
+
+  if (session_id == NULL || *session_id == '\0')
+    lose_rrdp_error(self, "Missing RRDP session_id");
+
+  if (self->expected_session_id != NULL && strcmp(session_id, self->expected_session_id))
+    lose_rrdp_error(self, "Unexpected RRDP session_id");
+
+  if (serial == NULL || *serial == '\0')
+    lose_rrdp_error(self, "Missing RRDP serial");
+
+  for (p = serial; *p != '\0'; p++)
+    if (*p < '0' || *p > '9')
+      lose_rrdp_error(self, "Malformed RRDP serial");
+
+  if ((self->session_id = rrdp_strdup(session_id)) == NULL)
+    lose_no_memory();
+
+  if ((self->serial = PyLong_FromString((char *) serial, NULL, 10)) == NULL)
     goto error;
 
-  Py_RETURN_NONE;
+  if (self->expected_serial != NULL) {
+    switch (PyObject_RichCompareBool(self->serial, self->expected_serial, Py_EQ)) {
+    case 1:
+      break;
+    case 0:
+      lose_rrdp_error(self, "Unexpected RRDP serial");
+    default:
+      goto error;
+    }
+  }
+
+  return 1;
 
  error:
-  return NULL;
+  return 0;
 }
 
-static PyObject *
-roa_object_pem_read_helper(PyTypeObject *type, BIO *bio)
+/*
+ * Handle a publish or withdraw start tag.
+ */
+
+static int
+rrdp_parser_child(rrdp_parser_object *self, const char *name, char **names, char **values, const int n)
 {
-  roa_object *self;
+  const char *uri = NULL, *hash = NULL;
+  char *p;
+  int i;
 
-  ENTERING(roa_object_pem_read_helper);
+  if (!strcmp(name, "publish"))
+    self->element = rrdp_element_publish;
+  else if (!strcmp(name, "withdraw") && self->kind == rrdp_kind_delta)
+    self->element = rrdp_element_withdraw;
+  else
+    lose_rrdp_error(self, "Unexpected element in RRDP file");
 
-  if ((self = (roa_object *) cms_object_pem_read_helper(type, bio)) != NULL)
-    self->roa = NULL;
+  for (i = 0; i < n; i++) {
+    if (!strcmp(names[i], "uri") && uri == NULL)
+      uri = values[i];
+    else if (!strcmp(names[i], "hash") && hash == NULL && self->kind == rrdp_kind_delta)
+      hash = values[i];
+    else
+      lose_rrdp_error(self, "Unexpected attribute in RRDP element");
+  }
 
-  return (PyObject *) self;
-}
+  if (uri == NULL || *uri == '\0')
+    lose_rrdp_error(self, "Missing uri attribute in RRDP element");
 
-static PyObject *
-roa_object_der_read_helper(PyTypeObject *type, BIO *bio)
-{
-  roa_object *self;
+  if (self->element == rrdp_element_withdraw && hash == NULL)
+    lose_rrdp_error(self, "Missing hash attribute in RRDP withdraw element");
 
-  ENTERING(roa_object_der_read_helper);
+  if (hash != NULL && strlen(hash) != 2 * HASH_SHA256_LEN)
+    lose_rrdp_error(self, "Malformed hash attribute in RRDP element");
 
-  if ((self = (roa_object *) cms_object_der_read_helper(type, bio)) != NULL)
-    self->roa = NULL;
+  if ((self->uri = rrdp_strdup(uri)) == NULL ||
+      (hash != NULL && (self->hash = rrdp_strdup(hash)) == NULL))
+    lose_no_memory();
 
-  return (PyObject *) self;
-}
+  for (p = self->hash; p != NULL && *p != '\0'; p++) {
+    if (*p >= 'A' && *p <= 'F')
+      *p += 'a' - 'A';
+    if ((*p < '0' || *p > '9') && (*p < 'a' || *p > 'f'))
+      lose_rrdp_error(self, "Malformed hash attribute in RRDP element");
+  }
 
-static char roa_object_pem_read__doc__[] =
-  "Read a PEM-encoded ROA object from a string.\n"
-  ;
+  self->der_len = 0;
+  self->b64_n = self->b64_pad = self->b64_done = 0;
+  return 1;
 
-static PyObject *
-roa_object_pem_read(PyTypeObject *type, PyObject *args)
-{
-  ENTERING(roa_object_pem_read);
-  return read_from_string_helper(roa_object_pem_read_helper, type, args);
+ error:
+  return 0;
 }
 
-static char roa_object_pem_read_file__doc__[] =
-  "Read a PEM-encoded ROA object from a file.\n"
-  ;
+/*
+ * Process one complete tag (everything between '<' and '>').
+ */
 
-static PyObject *
-roa_object_pem_read_file(PyTypeObject *type, PyObject *args)
+static int
+rrdp_parser_tag(rrdp_parser_object *self, PyObject *events)
 {
-  ENTERING(roa_object_pem_read_file);
-  return read_from_file_helper(roa_object_pem_read_helper, type, args);
-}
+  char *names[RRDP_MAX_ATTRIBUTES], *values[RRDP_MAX_ATTRIBUTES];
+  char *tag = self->tag, *name, *p;
+  int n, empty = 0;
 
-static char roa_object_der_read__doc__[] =
-  "Read a DER-encoded ROA object from a string.\n"
-  ;
+  /*
+   * The tag buffer is only allocated once we've seen a character of
+   * the tag, so "<>" leaves us with no buffer at all.
+   */
 
-static PyObject *
-roa_object_der_read(PyTypeObject *type, PyObject *args)
-{
-  ENTERING(roa_object_der_read);
-  return read_from_string_helper(roa_object_der_read_helper, type, args);
-}
+  if (tag == NULL || self->tag_len == 0)
+    lose_rrdp_error(self, "Empty tag in RRDP file");
 
-static char roa_object_der_read_file__doc__[] =
-  "Read a DER-encoded ROA object from a file.\n"
-  ;
+  tag[self->tag_len] = '\0';
 
-static PyObject *
-roa_object_der_read_file(PyTypeObject *type, PyObject *args)
-{
-  ENTERING(roa_object_der_read_file);
-  return read_from_file_helper(roa_object_der_read_helper, type, args);
+  /*
+   * Processing instructions (including the XML declaration) are
+   * harmless and we ignore them, but only outside the root element.
+   * DOCTYPE, CDATA and so forth have no business in RRDP.
+   */
+
+  if (*tag == '?') {
+    if (self->level != rrdp_level_prolog && self->level != rrdp_level_epilog)
+      lose_rrdp_error(self, "Processing instruction inside RRDP root element");
+    if (self->tag_len < 2 || tag[self->tag_len - 1] != '?')
+      lose_rrdp_error(self, "Malformed processing instruction in RRDP file");
+    return 1;
+  }
+
+  if (*tag == '!')
+    lose_rrdp_error(self, "Unsupported XML construct in RRDP file");
+
+  /*
+   * End tags.
+   */
+
+  if (*tag == '/') {
+    for (p = tag + self->tag_len; p > tag + 1 && rrdp_is_space(p[-1]); p--)
+      p[-1] = '\0';
+    name = tag + 1;
+    switch (self->level) {
+    case rrdp_level_child:
+      if (strcmp(name, self->element == rrdp_element_publish ? "publish" : "withdraw"))
+        lose_rrdp_error(self, "Mismatched end tag in RRDP file");
+      self->level = rrdp_level_root;
+      return rrdp_parser_emit(self, events);
+    case rrdp_level_root:
+      if (strcmp(name, self->kind == rrdp_kind_snapshot ? "snapshot" : "delta"))
+        lose_rrdp_error(self, "Mismatched end tag in RRDP file");
+      self->level = rrdp_level_epilog;
+      return 1;
+    default:
+      lose_rrdp_error(self, "Unexpected end tag in RRDP file");
+    }
+  }
+
+  /*
+   * Start tags.
+   */
+
+  if (self->tag_len > 0 && tag[self->tag_len - 1] == '/') {
+    tag[self->tag_len - 1] = '\0';
+    empty = 1;
+  }
+
+  for (name = p = tag; *p != '\0' && !rrdp_is_space(*p); p++)
+    ;
+  if (*p != '\0')
+    *p++ = '\0';
+
+  if (*name == '\0')
+    lose_rrdp_error(self, "Malformed tag in RRDP file");
+
+  if ((n = rrdp_parser_split_attributes(self, p, names, values, RRDP_MAX_ATTRIBUTES)) < 0)
+    goto error;
+
+  switch (self->level) {
+
+  case rrdp_level_prolog:
+    if (!rrdp_parser_root(self, name, names, values, n))
+      goto error;
+    self->level = empty ? rrdp_level_epilog : rrdp_level_root;
+    return 1;
+
+  case rrdp_level_root:
+    if (!rrdp_parser_child(self, name, names, values, n))
+      goto error;
+    if (empty)
+      return rrdp_parser_emit(self, events);
+    self->level = rrdp_level_child;
+    return 1;
+
+  default:
+    lose_rrdp_error(self, "Unexpected element in RRDP file");
+  }
+
+ error:
+  return 0;
 }
 
-static char roa_object_get_version__doc__[] =
-  "Return the version number of this ROA.\n"
+static char rrdp_parser_object_feed__doc__[] =
+  "Feed a chunk of an RRDP snapshot or delta file to this parser.\n"
+  "\n"
+  "Chunks may be split at arbitrary points.  Returns a list, possibly\n"
+  "empty, of the elements completed by this chunk.  Each element is a\n"
+  "five-element tuple:\n"
+  "\n"
+  "* \"publish\" or \"withdraw\";\n"
+  "\n"
+  "* the object's URI;\n"
+  "\n"
+  "* the (lowercase hex) hash attribute of the object being replaced or\n"
+  "  withdrawn, or None for a new object;\n"
+  "\n"
+  "* the (lowercase hex) SHA-256 of the published object, or None for\n"
+  "  a withdrawal; and\n"
+  "\n"
+  "* the DER of the published object, or None for a withdrawal or when\n"
+  "  this parser was created with an output directory, in which case the\n"
+  "  object has already been written to (or removed from) that directory.\n"
   ;
 
 static PyObject *
-roa_object_get_version(roa_object *self)
+rrdp_parser_object_feed(rrdp_parser_object *self, PyObject *args)
 {
-  ENTERING(roa_object_get_version);
+  PyObject *events = NULL;
+  const char *data = NULL;
+  Py_ssize_t len = 0, i;
+  char *tag;
+  int c;
 
-  if (self->roa == NULL)
-    lose_not_verified("Can't get version of unverified ROA");
+  ENTERING(rrdp_parser_object_feed);
+
+  if (!PyArg_ParseTuple(args, "s#", &data, &len))
+    goto error;
+
+  if (self->failed)
+    lose("RRDPParser has already failed");
+
+  if ((events = PyList_New(0)) == NULL)
+    goto error;
+
+  for (i = 0; i < len; i++) {
+    c = (unsigned char) data[i];
+
+    switch (self->state) {
+
+    case rrdp_state_text:
+      if (c == '<') {
+        self->state = rrdp_state_tag;
+        self->tag_len = 0;
+        self->quote = 0;
+      } else if (self->level == rrdp_level_child && self->element == rrdp_element_publish) {
+        if (!rrdp_parser_base64(self, c))
+          goto error;
+      } else if (!rrdp_is_space(c)) {
+        lose_rrdp_error(self, "Unexpected text in RRDP file");
+      }
+      continue;
+
+    case rrdp_state_comment:
+      if (c == '>' && self->dashes >= 2)
+        self->state = rrdp_state_text;
+      self->dashes = c == '-' ? self->dashes + 1 : 0;
+      continue;
+
+    case rrdp_state_tag:
+      if (c == '>' && self->quote == 0) {
+        self->state = rrdp_state_text;
+        if (!rrdp_parser_tag(self, events))
+          goto error;
+        continue;
+      }
+      if (c == '"' || c == '\'')
+        self->quote = self->quote == 0 ? c : self->quote == c ? 0 : self->quote;
+      if (self->tag_len + 1 >= self->tag_size) {
+        if (self->tag_size >= RRDP_MAX_TAG_LEN)
+          lose_rrdp_error(self, "RRDP tag too long");
+        if ((tag = PyMem_Realloc(self->tag, self->tag_size ? self->tag_size * 2 : 256)) == NULL)
+          lose_no_memory();
+        self->tag = tag;
+        self->tag_size = self->tag_size ? self->tag_size * 2 : 256;
+      }
+      self->tag[self->tag_len++] = c;
+      if (self->tag_len == 3 && !memcmp(self->tag, "!--", 3)) {
+        self->state = rrdp_state_comment;
+        self->dashes = 0;
+      }
+      continue;
+    }
+  }
 
-  if (self->roa->version)
-    return Py_BuildValue("N", ASN1_INTEGER_to_PyLong(self->roa->version));
-  else
-    return PyInt_FromLong(0);
+  return events;
 
  error:
+  Py_XDECREF(events);
   return NULL;
 }
 
-static char roa_object_set_version__doc__[] =
-  "Set the version number of this ROA.\n"
-  "\n"
-  "The \"version\" parameter should be a non-negative integer.\n"
+static char rrdp_parser_object_close__doc__[] =
+  "Tell this parser that there is no more input.\n"
   "\n"
-  "As of this writing, zero is both the default and the only defined version.\n"
-  "Attempting to set any version number other than zero will fail, as we\n"
-  "don't understand how to write other versions, by definition.\n"
+  "Raises an exception if the input so far was not a complete RRDP file.\n"
   ;
 
 static PyObject *
-roa_object_set_version(roa_object *self, PyObject *args)
+rrdp_parser_object_close(rrdp_parser_object *self)
 {
-  int version = 0;
-
-  ENTERING(roa_object_set_version);
+  ENTERING(rrdp_parser_object_close);
 
-  if (self->roa == NULL)
-    lose_not_verified("Can't set version of unverified ROA");
-
-  if (!PyArg_ParseTuple(args, "|i", &version))
-    goto error;
-
-  if (version != 0)
-    lose("RFC 6482 only defines ROA version zero");
+  if (self->failed)
+    lose("RRDPParser has already failed");
 
-  ASN1_INTEGER_free(self->roa->version);
-  self->roa->version = NULL;
+  if (self->level != rrdp_level_epilog || self->state != rrdp_state_text)
+    lose_rrdp_error(self, "Truncated RRDP file");
 
   Py_RETURN_NONE;
 
@@ -8697,1105 +12092,1556 @@ roa_object_set_version(roa_object *self, PyObject *args)
   return NULL;
 }
 
-static char roa_object_get_asid__doc__[] =
-  "Return the Autonomous System ID of this ROA.\n"
+static char rrdp_parser_object_get_kind__doc__[] =
+  "Return \"snapshot\" or \"delta\", or None if the parser hasn't seen\n"
+  "the root element yet.\n"
   ;
 
 static PyObject *
-roa_object_get_asid(roa_object *self)
+rrdp_parser_object_get_kind(rrdp_parser_object *self)
 {
-  ENTERING(roa_object_get_asid);
-
-  if (self->roa == NULL)
-    lose_not_verified("Can't get ASN of unverified ROA");
+  switch (self->kind) {
+  case rrdp_kind_snapshot:      return PyString_FromString("snapshot");
+  case rrdp_kind_delta:         return PyString_FromString("delta");
+  default:                      Py_RETURN_NONE;
+  }
+}
 
-  return Py_BuildValue("N", ASN1_INTEGER_to_PyLong(self->roa->asID));
+static char rrdp_parser_object_get_session_id__doc__[] =
+  "Return the session_id from the root element, or None if the parser\n"
+  "hasn't seen the root element yet.\n"
+  ;
 
- error:
-  return NULL;
+static PyObject *
+rrdp_parser_object_get_session_id(rrdp_parser_object *self)
+{
+  if (self->session_id == NULL)
+    Py_RETURN_NONE;
+  return PyString_FromString(self->session_id);
 }
 
-static char roa_object_set_asid__doc__[] =
-  "Sets the Autonomous System ID of this ROA.\n"
-  "\n"
-  "The \"asID\" parameter should be a non-negative integer.\n"
+static char rrdp_parser_object_get_serial__doc__[] =
+  "Return the serial number from the root element, or None if the parser\n"
+  "hasn't seen the root element yet.\n"
   ;
 
 static PyObject *
-roa_object_set_asid(roa_object *self, PyObject *args)
+rrdp_parser_object_get_serial(rrdp_parser_object *self)
 {
-  PyObject *asID = NULL;
-  PyObject *zero = NULL;
-  int ok = 0;
+  if (self->serial == NULL)
+    Py_RETURN_NONE;
+  Py_INCREF(self->serial);
+  return self->serial;
+}
 
-  ENTERING(roa_object_set_asid);
+static struct PyMethodDef rrdp_parser_object_methods[] = {
+  Define_Method(feed,           rrdp_parser_object_feed,                METH_VARARGS),
+  Define_Method(close,          rrdp_parser_object_close,               METH_NOARGS),
+  Define_Method(getKind,        rrdp_parser_object_get_kind,            METH_NOARGS),
+  Define_Method(getSessionID,   rrdp_parser_object_get_session_id,      METH_NOARGS),
+  Define_Method(getSerial,      rrdp_parser_object_get_serial,          METH_NOARGS),
+  {NULL}
+};
 
-  if (self->roa == NULL)
-    lose_not_verified("Can't set ASN of unverified ROA");
+static char POW_RRDPParser_Type__doc__[] =
+  "Incremental parser for RRDP snapshot and delta files.\n"
+  "\n"
+  "Feed the file to the .feed() method in chunks of any size, then call\n"
+  "the .close() method.  Base64 decoding and hashing of published objects\n"
+  "happen in C, and memory use is bounded by the largest single object,\n"
+  "not by the size of the file.\n"
+  "\n"
+  "The constructor takes several optional keyword arguments:\n"
+  "\n"
+  "* \"kind\": \"snapshot\" or \"delta\", the kind of file expected;\n"
+  "\n"
+  "* \"session_id\": the expected RRDP session_id;\n"
+  "\n"
+  "* \"serial\": the expected RRDP serial number;\n"
+  "\n"
+  "* \"directory\": if specified, published objects are written to (and\n"
+  "  withdrawn objects removed from) this directory, using the same\n"
+  "  layout as rsync would, rather than being returned as strings.  A\n"
+  "  file is only replaced or removed if its SHA-256 matches the hash\n"
+  "  attribute of the element replacing or withdrawing it;\n"
+  "\n"
+  "* \"max_object_size\": the largest decoded object we will accept.\n"
+  "\n"
+  "Any mismatch against the expected values, and any deviation from\n"
+  "the RRDP syntax, raises an exception.\n"
+  ;
 
-  if (!PyArg_ParseTuple(args, "O", &asID))
-    goto error;
+static PyTypeObject POW_RRDPParser_Type = {
+  PyObject_HEAD_INIT(0)
+  0,                                        /* ob_size */
+  "rpki.POW.RRDPParser",                    /* tp_name */
+  sizeof(rrdp_parser_object),               /* tp_basicsize */
+  0,                                        /* tp_itemsize */
+  (destructor)rrdp_parser_object_dealloc,   /* tp_dealloc */
+  0,                                        /* tp_print */
+  0,                                        /* tp_getattr */
+  0,                                        /* tp_setattr */
+  0,                                        /* tp_compare */
+  0,                                        /* tp_repr */
+  0,                                        /* tp_as_number */
+  0,                                        /* tp_as_sequence */
+  0,                                        /* tp_as_mapping */
+  0,                                        /* tp_hash */
+  0,                                        /* tp_call */
+  0,                                        /* tp_str */
+  0,                                        /* tp_getattro */
+  0,                                        /* tp_setattro */
+  0,                                        /* tp_as_buffer */
+  Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, /* tp_flags */
+  POW_RRDPParser_Type__doc__,               /* tp_doc */
+  0,                                        /* tp_traverse */
+  0,                                        /* tp_clear */
+  0,                                        /* tp_richcompare */
+  0,                                        /* tp_weaklistoffset */
+  0,                                        /* tp_iter */
+  0,                                        /* tp_iternext */
+  rrdp_parser_object_methods,               /* tp_methods */
+  0,                                        /* tp_members */
+  0,                                        /* tp_getset */
+  0,                                        /* tp_base */
+  0,                                        /* tp_dict */
+  0,                                        /* tp_descr_get */
+  0,                                        /* tp_descr_set */
+  0,                                        /* tp_dictoffset */
+  (initproc) rrdp_parser_object_init,       /* tp_init */
+  0,                                        /* tp_alloc */
+  rrdp_parser_object_new,                   /* tp_new */
+};
 
-  if ((zero = PyInt_FromLong(0)) == NULL)
-    goto error;
 
-  switch (PyObject_RichCompareBool(asID, zero, Py_GE)) {
-  case -1:
-    goto error;
-  case 0:
-    lose("Negative asID is not allowed");
-  }
+
 
-  ASN1_INTEGER_free(self->roa->asID);
+/*
+ * SigningPool object.
+ */
 
-  if ((self->roa->asID = PyLong_to_ASN1_INTEGER(asID)) == NULL)
-    goto error;
+/*
+ * OpenSSL versions before 1.1.0 need locking callbacks before they
+ * can be used from more than one thread.  We install these the first
+ * time a SigningPool is created, unless something else (eg, Python's
+ * own _ssl module) already has, so code which never uses a pool pays
+ * nothing.
+ *
+ * Our CRYPTO_set_mem_functions() call in init_POW() routes OpenSSL's
+ * allocations through PyMem_Malloc() et al, which in release builds
+ * of Python 2 are thin wrappers around malloc() and safe to call
+ * without holding the GIL.
+ */
 
-  ok = 1;
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
 
- error:
-  Py_XDECREF(zero);
+static pthread_mutex_t *signing_pool_openssl_locks;
 
-  if (ok)
-    Py_RETURN_NONE;
+static void
+signing_pool_openssl_locking_callback(int mode, int n, GCC_UNUSED const char *file, GCC_UNUSED int line)
+{
+  if (mode & CRYPTO_LOCK)
+    pthread_mutex_lock(&signing_pool_openssl_locks[n]);
   else
-    return NULL;
+    pthread_mutex_unlock(&signing_pool_openssl_locks[n]);
 }
 
-static char roa_object_get_prefixes__doc__[] =
-  "Return this ROA's prefix list.  This is a two-element\n"
-  "tuple: the first element is the IPv4 prefix set, the second is the\n"
-  "IPv6 prefix set.\n"
-  "\n"
-  "Each prefix set is either None, if there are no prefixes for this IP\n"
-  "version, or a sequence of three-element tuple representing ROA prefix\n"
-  "entries.\n"
-  "\n"
-  "Each ROA prefix entry consists of the prefix itself (an IPAddress),\n"
-  "the prefix length (an integer), and the maxPrefixLen value, which is\n"
-  "either an integer or None depending on whether the maxPrefixLen value\n"
-  "is set for this prefix.\n"
-  ;
+static void
+signing_pool_openssl_threadid_callback(CRYPTO_THREADID *id)
+{
+  CRYPTO_THREADID_set_numeric(id, (unsigned long) pthread_self());
+}
 
-static PyObject *
-roa_object_get_prefixes(roa_object *self)
+#endif  /* OPENSSL_VERSION_NUMBER < 0x10100000L */
+
+static int
+signing_pool_openssl_thread_setup(void)
 {
-  PyObject *result = NULL;
-  PyObject *ipv4_result = NULL;
-  PyObject *ipv6_result = NULL;
-  PyObject *item = NULL;
-  ipaddress_object *addr = NULL;
-  int i, j;
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+  int i, n;
 
-  ENTERING(roa_object_get_prefixes);
+  if (CRYPTO_get_locking_callback() != NULL)
+    return 1;
 
-  if (self->roa == NULL)
-    lose_not_verified("Can't get prefixes from unverified ROA");
+  n = CRYPTO_num_locks();
 
-  for (i = 0; i < sk_ROAIPAddressFamily_num(self->roa->ipAddrBlocks); i++) {
-    ROAIPAddressFamily *fam = sk_ROAIPAddressFamily_value(self->roa->ipAddrBlocks, i);
-    const unsigned afi = (fam->addressFamily->data[0] << 8) | (fam->addressFamily->data[1]);
-    const ipaddress_version *ip_type = NULL;
-    PyObject **resultp = NULL;
+  if ((signing_pool_openssl_locks = malloc(n * sizeof(*signing_pool_openssl_locks))) == NULL)
+    return 0;
 
-    switch (afi) {
-    case IANA_AFI_IPV4: resultp = &ipv4_result; ip_type = &ipaddress_version_4; break;
-    case IANA_AFI_IPV6: resultp = &ipv6_result; ip_type = &ipaddress_version_6; break;
-    default:            lose_value_error("Unknown AFI");
-    }
+  for (i = 0; i < n; i++)
+    pthread_mutex_init(&signing_pool_openssl_locks[i], NULL);
 
-    if (fam->addressFamily->length > 2)
-      lose_value_error("Unsupported SAFI");
+  CRYPTO_THREADID_set_callback(signing_pool_openssl_threadid_callback);
+  CRYPTO_set_locking_callback(signing_pool_openssl_locking_callback);
+#endif
+  return 1;
+}
 
-    if (*resultp != NULL)
-      lose_value_error("Duplicate ROAIPAddressFamily");
+/*
+ * Job handling.  Everything a job needs is extracted from the Python
+ * objects while we hold the GIL, and the objects themselves are kept
+ * alive by references held in the job until the result is collected,
+ * so worker threads never touch the Python API.
+ */
 
-    if ((*resultp = PyTuple_New(sk_ROAIPAddress_num(fam->addresses))) == NULL)
-      goto error;
+static signing_job *
+signing_job_new(signing_job_type type, PyObject *target)
+{
+  signing_job *job = NULL;
 
-    for (j = 0; j < sk_ROAIPAddress_num(fam->addresses); j++) {
-      ROAIPAddress *a = sk_ROAIPAddress_value(fam->addresses, j);
-      unsigned prefixlen = ((a->IPAddress)->length * 8 - ((a->IPAddress)->flags & 7));
+  if ((job = PyMem_Malloc(sizeof(*job))) == NULL)
+    return (signing_job *) PyErr_NoMemory();
 
-      if ((addr = (ipaddress_object *) POW_IPAddress_Type.tp_alloc(&POW_IPAddress_Type, 0)) == NULL)
-        goto error;
+  memset(job, 0, sizeof(*job));
+  job->type = type;
+  job->target = target;
+  Py_XINCREF(target);
+  return job;
+}
 
-      addr->type = ip_type;
+static void
+signing_job_free(signing_job *job)
+{
+  if (job == NULL)
+    return;
 
-      memset(addr->address, 0, sizeof(addr->address));
+  if (job->type == signing_job_generate_rsa)
+    EVP_PKEY_free(job->pkey);
 
-      if ((unsigned) a->IPAddress->length > addr->type->length)
-        lose("ROAIPAddress BIT STRING too long for AFI");
+  Py_XDECREF(job->target);
+  Py_XDECREF(job->refs);
+  BIO_free(job->bio);
+  sk_X509_free(job->certs);
+  sk_X509_CRL_free(job->crls);
+  ASN1_OBJECT_free(job->econtent_type);
+  CMS_ContentInfo_free(job->cms);
+  PyMem_Free(job);
+}
 
-      if (a->IPAddress->length > 0) {
-        memcpy(addr->address, a->IPAddress->data, a->IPAddress->length);
+/*
+ * Run one job.  Called from worker threads, without the GIL.
+ */
 
-        if ((a->IPAddress->flags & 7) != 0) {
-          unsigned char mask = 0xFF >> (8 - (a->IPAddress->flags & 7));
-          addr->address[a->IPAddress->length - 1] &= ~mask;
-        }
-      }
+static void
+signing_job_run(signing_job *job)
+{
+  const char *file;
 
-      if (a->maxLength == NULL)
-        item = Py_BuildValue("(NIO)", addr, prefixlen, Py_None);
-      else
-        item = Py_BuildValue("(NIl)", addr, prefixlen, ASN1_INTEGER_get(a->maxLength));
+  switch (job->type) {
 
-      if (item == NULL)
-        goto error;
+  case signing_job_generate_rsa:
+    job->ok = (job->pkey = asymmetric_object_generate_rsa_key(job->key_size)) != NULL;
+    break;
 
-      PyTuple_SET_ITEM(*resultp, j, item);
-      item = NULL;
-      addr = NULL;
-    }
+  case signing_job_sign_x509:
+    job->ok = X509_sign(job->x509, job->pkey, job->digest) > 0;
+    break;
+
+  case signing_job_sign_crl:
+    job->ok = X509_CRL_sign(job->crl, job->pkey, job->digest) > 0;
+    break;
+
+  case signing_job_sign_cms:
+    job->ok = (job->cms = cms_object_sign_core(job->bio, job->signcert, job->pkey,
+                                               job->certs, job->crls,
+                                               job->econtent_type, job->flags)) != NULL;
+    break;
   }
 
-  result = Py_BuildValue("(OO)",
-                         (ipv4_result == NULL ? Py_None : ipv4_result),
-                         (ipv6_result == NULL ? Py_None : ipv6_result));
+  /*
+   * OpenSSL's error queue is per-thread, so save whatever this job
+   * left there for the collecting thread to turn into an exception.
+   */
 
- error:                         /* Fall through */
-  Py_XDECREF(addr);
-  Py_XDECREF(item);
-  Py_XDECREF(ipv4_result);
-  Py_XDECREF(ipv6_result);
+  while (job->n_errors < SIGNING_JOB_MAX_ERRORS &&
+         (job->errors[job->n_errors] = ERR_get_error_line(&file, &job->error_lines[job->n_errors])) != 0) {
+    strncpy(job->error_files[job->n_errors], file ? file : "", sizeof(job->error_files[job->n_errors]) - 1);
+    job->n_errors++;
+  }
 
-  return result;
+  ERR_clear_error();
 }
 
-static char roa_object_set_prefixes__doc__[] =
-  "Set this ROA's prefix list.\n"
-  "\n"
-  "This method takes two arguments, \"ipv4\" and \"ipv6\".  Each of these\n"
-  "is either None, if no prefixes should be set for this IP version, or\n"
-  "an iterable object returning ROA prefix entries in the same format as\n"
-  "returned by the .getPrefixes() method.  The maxPrefixLen value may be\n"
-  "omitted (that is, the ROA prefix entry tuple may be of length two\n"
-  "rather than of length three); this will be taken as equivalent to\n"
-  "specifying a maxPrefixLen value of None.\n"
-  ;
-
-static PyObject *
-roa_object_set_prefixes(roa_object *self, PyObject *args, PyObject *kwds)
-{
-  static char *kwlist[] = {"ipv4", "ipv6", NULL};
-  STACK_OF(ROAIPAddressFamily) *prefixes = NULL;
-  ROAIPAddressFamily *fam = NULL;
-  ROAIPAddress *a = NULL;
-  PyObject *ipv4_arg = Py_None;
-  PyObject *ipv6_arg = Py_None;
-  PyObject *iterator = NULL;
-  PyObject *item = NULL;
-  PyObject *fast = NULL;
-  int ok = 0;
-  int v;
+/*
+ * Turn a completed job into a (handle, result, error) tuple.  Called
+ * with the GIL held.
+ */
 
-  ENTERING(roa_object_set_prefixes);
+static PyObject *
+signing_job_result(signing_job *job)
+{
+  asymmetric_object *asym = NULL;
+  PyObject *result = NULL;
+  PyObject *type = NULL, *value = NULL, *traceback = NULL;
+  int i;
 
-  if (self->roa == NULL)
-    lose_not_verified("Can't set prefixes of unverified ROA");
+  if (job->ok) {
 
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|OO", kwlist, &ipv4_arg, &ipv6_arg))
-    goto error;
+    switch (job->type) {
 
-  if ((prefixes = sk_ROAIPAddressFamily_new_null()) == NULL)
-    lose_no_memory();
+    case signing_job_generate_rsa:
+      if ((asym = (asymmetric_object *) asymmetric_object_new(&POW_Asymmetric_Type, NULL, NULL)) == NULL)
+        goto error;
+      asym->pkey = job->pkey;
+      job->pkey = NULL;
+      result = Py_BuildValue("(lNO)", job->handle, asym, Py_None);
+      break;
 
-  for (v = 0; v < (int) (sizeof(ipaddress_versions)/sizeof(*ipaddress_versions)); v++) {
-    const struct ipaddress_version *ip_type = ipaddress_versions[v];
-    unsigned char afibuf[2];
-    PyObject **argp;
+    case signing_job_sign_cms:
+      if (job->cms != NULL) {
+        CMS_ContentInfo_free(((cms_object *) job->target)->cms);
+        ((cms_object *) job->target)->cms = job->cms;
+        job->cms = NULL;
+      }
+      /* Fall through */
 
-    switch (ip_type->version) {
-    case 4: argp = &ipv4_arg; break;
-    case 6: argp = &ipv6_arg; break;
-    default: continue;
+    default:
+      result = Py_BuildValue("(lOO)", job->handle, job->target, Py_None);
+      break;
     }
 
-    if (*argp == Py_None)
-      continue;
+  } else {
 
-    afibuf[0] = (ip_type->afi >> 8) & 0xFF;
-    afibuf[1] = (ip_type->afi     ) & 0xFF;
+    for (i = 0; i < job->n_errors; i++)
+      ERR_put_error(ERR_GET_LIB(job->errors[i]), ERR_GET_FUNC(job->errors[i]), ERR_GET_REASON(job->errors[i]),
+                    job->error_files[i], job->error_lines[i]);
 
-    if ((iterator = PyObject_GetIter(*argp)) == NULL)
-      goto error;
+    switch (job->type) {
+    case signing_job_generate_rsa:
+      set_openssl_exception(OpenSSLErrorObject, "Couldn't generate new RSA key", 0);
+      break;
+    case signing_job_sign_x509:
+      set_openssl_exception(OpenSSLErrorObject, "Couldn't sign certificate", 0);
+      break;
+    case signing_job_sign_crl:
+      set_openssl_exception(OpenSSLErrorObject, "Couldn't sign CRL", 0);
+      break;
+    case signing_job_sign_cms:
+      set_openssl_exception(OpenSSLErrorObject, "Couldn't sign CMS message", 0);
+      break;
+    }
 
-    while ((item = PyIter_Next(iterator)) != NULL) {
-      unsigned prefixlen, maxprefixlen, bitlen, bytelen;
-      ipaddress_object *addr = NULL;
-      PyObject *maxlenobj = Py_None;
+    PyErr_Fetch(&type, &value, &traceback);
+    PyErr_NormalizeException(&type, &value, &traceback);
+    result = Py_BuildValue("(lOO)", job->handle, Py_None, value);
+  }
 
-      if ((fast = PySequence_Fast(item, "ROA prefix must be a sequence")) == NULL)
-        goto error;
+ error:
+  Py_XDECREF(type);
+  Py_XDECREF(value);
+  Py_XDECREF(traceback);
+  return result;
+}
 
-      switch (PySequence_Fast_GET_SIZE(fast)) {
-      case 3:
-        maxlenobj = PySequence_Fast_GET_ITEM(fast, 2);
-        /* Fall through */
-      case 2:
-        if (!POW_IPAddress_Check(PySequence_Fast_GET_ITEM(fast, 0)))
-          lose_type_error("First element of ROA prefix must be an IPAddress object");
-        addr = (ipaddress_object *) PySequence_Fast_GET_ITEM(fast, 0);
-        prefixlen = (unsigned) PyInt_AsLong(PySequence_Fast_GET_ITEM(fast, 1));
-        if (PyErr_Occurred())
-          goto error;
-        break;
-      default:
-        lose_type_error("ROA prefix must be a two- or three-element sequence");
-      }
+/*
+ * Worker thread.
+ */
 
-      if (maxlenobj == Py_None) {
-        maxprefixlen = prefixlen;
-      } else {
-        maxprefixlen = (unsigned) PyInt_AsLong(maxlenobj);
-        if (PyErr_Occurred())
-          goto error;
-      }
+static void *
+signing_pool_worker(void *arg)
+{
+  signing_pool_object *self = arg;
+  signing_job *job;
 
-      if (addr->type != ip_type)
-        lose_value_error("Bad ROA prefix");
+  for (;;) {
 
-      if (prefixlen > addr->type->length * 8)
-        lose("Bad prefix length");
+    pthread_mutex_lock(&self->mutex);
 
-      if (maxprefixlen > addr->type->length * 8 || maxprefixlen < prefixlen)
-        lose("Bad maxLength value");
+    while (!self->shutdown && self->queue_head == NULL)
+      pthread_cond_wait(&self->work_cond, &self->mutex);
 
-      bytelen = (prefixlen + 7) / 8;
-      bitlen = prefixlen % 8;
+    if (self->shutdown) {
+      pthread_mutex_unlock(&self->mutex);
+      break;
+    }
 
-      if ((a = ROAIPAddress_new()) == NULL ||
-          (a->IPAddress == NULL && (a->IPAddress = ASN1_BIT_STRING_new()) == NULL) ||
-          !ASN1_BIT_STRING_set(a->IPAddress, addr->address, bytelen))
-        lose_no_memory();
+    job = self->queue_head;
+    if ((self->queue_head = job->next) == NULL)
+      self->queue_tail = NULL;
+    job->next = NULL;
 
-      a->IPAddress->flags &= ~7;
-      a->IPAddress->flags |= ASN1_STRING_FLAG_BITS_LEFT;
-      if (bitlen > 0) {
-        a->IPAddress->data[bytelen - 1] &= ~(0xFF >> bitlen);
-        a->IPAddress->flags |= 8 - bitlen;
-      }
+    pthread_mutex_unlock(&self->mutex);
 
-      if (prefixlen != maxprefixlen &&
-          ((a->maxLength = ASN1_INTEGER_new()) == NULL ||
-           !ASN1_INTEGER_set(a->maxLength, maxprefixlen)))
-        lose_no_memory();
+    signing_job_run(job);
 
-      if (fam == NULL &&
-          ((fam = ROAIPAddressFamily_new()) == NULL ||
-           !sk_ROAIPAddressFamily_push(prefixes, fam) ||
-           !ASN1_OCTET_STRING_set(fam->addressFamily, afibuf, sizeof(afibuf))))
-        lose_no_memory();
+    pthread_mutex_lock(&self->mutex);
 
-      if (!sk_ROAIPAddress_push(fam->addresses, a))
-        lose_no_memory();
+    if (self->done_tail == NULL)
+      self->done_head = job;
+    else
+      self->done_tail->next = job;
+    self->done_tail = job;
 
-      a = NULL;
-      Py_XDECREF(item);
-      Py_XDECREF(fast);
-      item = fast = NULL;
-    }
+    pthread_cond_broadcast(&self->done_cond);
+    pthread_mutex_unlock(&self->mutex);
 
-    fam = NULL;
-    Py_XDECREF(iterator);
-    iterator = NULL;
+    /*
+     * Wake up anybody watching our file descriptor.  The pipe is
+     * non-blocking, and if it's full there's already a wakeup pending,
+     * so we don't care whether this write succeeds.
+     */
+
+    if (write(self->pipe_fds[1], "", 1) < 0 && errno != EAGAIN)
+      KVETCH("Couldn't write to SigningPool wakeup pipe");
   }
 
-  sk_ROAIPAddressFamily_pop_free(self->roa->ipAddrBlocks, ROAIPAddressFamily_free);
-  self->roa->ipAddrBlocks = prefixes;
-  prefixes = NULL;
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+  ERR_remove_thread_state(NULL);
+#endif
 
-  ok = 1;
+  return NULL;
+}
 
- error:
-  sk_ROAIPAddressFamily_pop_free(prefixes, ROAIPAddressFamily_free);
-  ROAIPAddressFamily_free(fam);
-  ROAIPAddress_free(a);
-  Py_XDECREF(iterator);
-  Py_XDECREF(item);
-  Py_XDECREF(fast);
+static void
+signing_pool_stop(signing_pool_object *self)
+{
+  int i;
 
-  if (ok)
-    Py_RETURN_NONE;
-  else
-    return NULL;
-}
+  if (!self->initialized)
+    return;
 
-static char roa_object_sign__doc__[] =
-  "Sign this ROA.  See CMS.sign() for details.\n"
-  ;
+  pthread_mutex_lock(&self->mutex);
+  self->shutdown = 1;
+  pthread_cond_broadcast(&self->work_cond);
+  pthread_mutex_unlock(&self->mutex);
+
+  /*
+   * Workers never need the GIL, but a worker in the middle of an RSA
+   * key generation might take a while to notice that we're shutting
+   * down, so let other Python threads run while we wait.
+   */
+
+  Py_BEGIN_ALLOW_THREADS;
+  for (i = 0; i < self->n_threads; i++)
+    pthread_join(self->threads[i], NULL);
+  Py_END_ALLOW_THREADS;
+
+  self->n_threads = 0;
+}
 
 static PyObject *
-roa_object_sign(roa_object *self, PyObject *args)
+signing_pool_object_new(PyTypeObject *type, GCC_UNUSED PyObject *args, GCC_UNUSED PyObject *kwds)
 {
-  asymmetric_object *signkey = NULL;
-  x509_object *signcert = NULL;
-  PyObject *x509_iterable = Py_None;
-  PyObject *crl_iterable = Py_None;
-  char *oid = NULL;
-  unsigned flags = 0;
-  BIO *bio = NULL;
-  int ok = 0;
+  signing_pool_object *self = NULL;
 
-  ENTERING(roa_object_sign);
+  ENTERING(signing_pool_object_new);
 
-  if (!PyArg_ParseTuple(args, "O!O!|OOsI",
-                        &POW_X509_Type, &signcert,
-                        &POW_Asymmetric_Type, &signkey,
-                        &x509_iterable,
-                        &crl_iterable,
-                        &oid,
-                        &flags))
-    goto error;
+  if ((self = (signing_pool_object *) type->tp_alloc(type, 0)) == NULL)
+    return NULL;
 
-  if ((bio = BIO_new(BIO_s_mem())) == NULL)
-    lose_no_memory();
+  self->initialized = 0;
+  self->shutdown = 0;
+  self->threads = NULL;
+  self->n_threads = 0;
+  self->pipe_fds[0] = self->pipe_fds[1] = -1;
+  self->queue_head = self->queue_tail = NULL;
+  self->done_head = self->done_tail = NULL;
+  self->next_handle = 1;
+  self->n_outstanding = 0;
 
-  assert_no_unhandled_openssl_errors();
+  return (PyObject *) self;
+}
 
-  if (!ASN1_item_i2d_bio(ASN1_ITEM_rptr(ROA), bio, self->roa))
-    lose_openssl_error("Couldn't encode ROA");
+static int
+signing_pool_object_init(signing_pool_object *self, PyObject *args, PyObject *kwds)
+{
+  static char *kwlist[] = {"threads", NULL};
+  int n_threads = 0;
+  int i;
 
-  assert_no_unhandled_openssl_errors();
+  ENTERING(signing_pool_object_init);
 
-  if (!cms_object_sign_helper(&self->cms, bio, signcert, signkey,
-                              x509_iterable, crl_iterable, oid, flags))
-    lose_openssl_error("Couldn't sign ROA");
+  if (self->initialized)
+    lose("SigningPool already initialized");
 
-  assert_no_unhandled_openssl_errors();
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|i", kwlist, &n_threads))
+    goto error;
 
-  ok = 1;
+  if (n_threads <= 0 && (n_threads = (int) sysconf(_SC_NPROCESSORS_ONLN)) <= 0)
+    n_threads = 1;
 
- error:
-  BIO_free(bio);
+  if (!signing_pool_openssl_thread_setup())
+    lose_no_memory();
 
-  if (ok)
-    Py_RETURN_NONE;
-  else
-    return NULL;
-}
+  if (pipe(self->pipe_fds) < 0 ||
+      fcntl(self->pipe_fds[0], F_SETFL, O_NONBLOCK) < 0 ||
+      fcntl(self->pipe_fds[1], F_SETFL, O_NONBLOCK) < 0 ||
+      fcntl(self->pipe_fds[0], F_SETFD, FD_CLOEXEC) < 0 ||
+      fcntl(self->pipe_fds[1], F_SETFD, FD_CLOEXEC) < 0) {
+    PyErr_SetFromErrno(PyExc_OSError);
+    goto error;
+  }
 
-static struct PyMethodDef roa_object_methods[] = {
-  Define_Method(getVersion,                     roa_object_get_version,                 METH_NOARGS),
-  Define_Method(setVersion,                     roa_object_set_version,                 METH_VARARGS),
-  Define_Method(getASID,                        roa_object_get_asid,                    METH_NOARGS),
-  Define_Method(setASID,                        roa_object_set_asid,                    METH_VARARGS),
-  Define_Method(getPrefixes,                    roa_object_get_prefixes,                METH_NOARGS),
-  Define_Method(setPrefixes,                    roa_object_set_prefixes,                METH_KEYWORDS),
-  Define_Method(sign,                           roa_object_sign,                        METH_VARARGS),
-  Define_Method(verify,                         roa_object_verify,                      METH_KEYWORDS),
-  Define_Method(extractWithoutVerifying,        roa_object_extract_without_verifying,   METH_NOARGS),
-  Define_Method(checkRPKIConformance,           roa_object_check_rpki_conformance,      METH_KEYWORDS),
-  Define_Class_Method(pemRead,                  roa_object_pem_read,                    METH_VARARGS),
-  Define_Class_Method(pemReadFile,              roa_object_pem_read_file,               METH_VARARGS),
-  Define_Class_Method(derRead,                  roa_object_der_read,                    METH_VARARGS),
-  Define_Class_Method(derReadFile,              roa_object_der_read_file,               METH_VARARGS),
-  {NULL}
-};
+  if ((self->threads = PyMem_Malloc(n_threads * sizeof(*self->threads))) == NULL)
+    lose_no_memory();
 
-static char POW_ROA_Type__doc__[] =
-  "This class provides access to RPKI ROA payload.\n"
-  "Most methods are inherited from or share code with the CMS class.\n"
-  ;
+  pthread_mutex_init(&self->mutex, NULL);
+  pthread_cond_init(&self->work_cond, NULL);
+  pthread_cond_init(&self->done_cond, NULL);
+  self->initialized = 1;
 
-static PyTypeObject POW_ROA_Type = {
-  PyObject_HEAD_INIT(0)
-  0,                                            /* ob_size */
-  "rpki.POW.ROA",                               /* tp_name */
-  sizeof(roa_object),                           /* tp_basicsize */
-  0,                                            /* tp_itemsize */
-  (destructor)roa_object_dealloc,               /* tp_dealloc */
-  0,                                            /* tp_print */
-  0,                                            /* tp_getattr */
-  0,                                            /* tp_setattr */
-  0,                                            /* tp_compare */
-  0,                                            /* tp_repr */
-  0,                                            /* tp_as_number */
-  0,                                            /* tp_as_sequence */
-  0,                                            /* tp_as_mapping */
-  0,                                            /* tp_hash */
-  0,                                            /* tp_call */
-  0,                                            /* tp_str */
-  0,                                            /* tp_getattro */
-  0,                                            /* tp_setattro */
-  0,                                            /* tp_as_buffer */
-  Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,     /* tp_flags */
-  POW_ROA_Type__doc__,                          /* tp_doc */
-  0,                                            /* tp_traverse */
-  0,                                            /* tp_clear */
-  0,                                            /* tp_richcompare */
-  0,                                            /* tp_weaklistoffset */
-  0,                                            /* tp_iter */
-  0,                                            /* tp_iternext */
-  roa_object_methods,                           /* tp_methods */
-  0,                                            /* tp_members */
-  0,                                            /* tp_getset */
-  &POW_CMS_Type,                                /* tp_base */
-  0,                                            /* tp_dict */
-  0,                                            /* tp_descr_get */
-  0,                                            /* tp_descr_set */
-  0,                                            /* tp_dictoffset */
-  0,                                            /* tp_init */
-  0,                                            /* tp_alloc */
-  roa_object_new,                               /* tp_new */
-};
+  for (i = 0; i < n_threads; i++) {
+    if ((errno = pthread_create(&self->threads[i], NULL, signing_pool_worker, self)) != 0) {
+      PyErr_SetFromErrno(PyExc_OSError);
+      goto error;
+    }
+    self->n_threads++;
+  }
 
-
+  return 0;
+
+ error:
+  signing_pool_stop(self);
+  return -1;
+}
+
+static void
+signing_pool_object_dealloc(signing_pool_object *self)
+{
+  signing_job *job;
+
+  ENTERING(signing_pool_object_dealloc);
+
+  signing_pool_stop(self);
+
+  while ((job = self->queue_head) != NULL) {
+    self->queue_head = job->next;
+    signing_job_free(job);
+  }
+
+  while ((job = self->done_head) != NULL) {
+    self->done_head = job->next;
+    signing_job_free(job);
+  }
+
+  if (self->initialized) {
+    pthread_mutex_destroy(&self->mutex);
+    pthread_cond_destroy(&self->work_cond);
+    pthread_cond_destroy(&self->done_cond);
+  }
+
+  if (self->pipe_fds[0] >= 0)
+    (void) close(self->pipe_fds[0]);
+  if (self->pipe_fds[1] >= 0)
+    (void) close(self->pipe_fds[1]);
+
+  PyMem_Free(self->threads);
+  self->ob_type->tp_free((PyObject*) self);
+}
 
 /*
- * PKCS10 object.
+ * Queue a job, taking ownership of it, and return its handle.
  */
 
 static PyObject *
-pkcs10_object_new(PyTypeObject *type, GCC_UNUSED PyObject *args, GCC_UNUSED PyObject *kwds)
+signing_pool_submit(signing_pool_object *self, signing_job *job)
 {
-  pkcs10_object *self;
+  if (!self->initialized || self->n_threads == 0) {
+    signing_job_free(job);
+    PyErr_SetString(POWErrorObject, "SigningPool not initialized");
+    return NULL;
+  }
 
-  ENTERING(pkcs10_object_new);
+  job->handle = self->next_handle++;
+  job->next = NULL;
 
-  if ((self = (pkcs10_object *) type->tp_alloc(type, 0)) != NULL &&
-      (self->pkcs10 = X509_REQ_new()) != NULL &&
-      (self->exts = sk_X509_EXTENSION_new_null()) != NULL)
-    return (PyObject *) self;
+  pthread_mutex_lock(&self->mutex);
 
-  Py_XDECREF(self);
-  return NULL;
+  if (self->queue_tail == NULL)
+    self->queue_head = job;
+  else
+    self->queue_tail->next = job;
+  self->queue_tail = job;
+
+  pthread_cond_signal(&self->work_cond);
+  pthread_mutex_unlock(&self->mutex);
+
+  self->n_outstanding++;
+
+  return PyInt_FromLong(job->handle);
 }
 
-static void
-pkcs10_object_dealloc(pkcs10_object *self)
+static char signing_pool_object_generate_rsa__doc__[] =
+  "Queue generation of a new RSA keypair.\n"
+  "\n"
+  "Optional argument key_size is the desired key size, in bits;\n"
+  "if not specified, the default is 2048.\n"
+  "\n"
+  "Returns a job handle; the result, when collected, is a new\n"
+  "Asymmetric object.\n"
+  ;
+
+static PyObject *
+signing_pool_object_generate_rsa(signing_pool_object *self, PyObject *args, PyObject *kwds)
 {
-  ENTERING(pkcs10_object_dealloc);
-  X509_REQ_free(self->pkcs10);
-  sk_X509_EXTENSION_pop_free(self->exts, X509_EXTENSION_free);
-  self->ob_type->tp_free((PyObject*) self);
+  static char *kwlist[] = {"key_size", NULL};
+  signing_job *job = NULL;
+  int key_size = 2048;
+
+  ENTERING(signing_pool_object_generate_rsa);
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|i", kwlist, &key_size))
+    return NULL;
+
+  if ((job = signing_job_new(signing_job_generate_rsa, NULL)) == NULL)
+    return NULL;
+
+  job->key_size = key_size;
+
+  return signing_pool_submit(self, job);
 }
 
+static char signing_pool_object_sign_x509__doc__[] =
+  "Queue signing of a certificate.\n"
+  "\n"
+  "Arguments are the X509 object to sign, an Asymmetric object holding\n"
+  "the private key, and, optionally, the digest algorithm, as with\n"
+  "X509.sign().  The certificate is signed in place, so the caller\n"
+  "must not touch it until the job completes.\n"
+  "\n"
+  "Returns a job handle; the result, when collected, is the X509 object.\n"
+  ;
+
 static PyObject *
-pkcs10_object_pem_read_helper(PyTypeObject *type, BIO *bio)
+signing_pool_object_sign_x509(signing_pool_object *self, PyObject *args)
 {
-  pkcs10_object *self = NULL;
+  asymmetric_object *asym = NULL;
+  x509_object *x509 = NULL;
+  int digest_type = SHA256_DIGEST;
+  signing_job *job = NULL;
 
-  ENTERING(pkcs10_object_pem_read_helper);
+  ENTERING(signing_pool_object_sign_x509);
 
-  assert_no_unhandled_openssl_errors();
+  if (!PyArg_ParseTuple(args, "O!O!|i", &POW_X509_Type, &x509, &POW_Asymmetric_Type, &asym, &digest_type))
+    goto error;
 
-  if ((self = (pkcs10_object *) pkcs10_object_new(type, NULL, NULL)) == NULL)
+  if ((job = signing_job_new(signing_job_sign_x509, (PyObject *) x509)) == NULL)
     goto error;
 
-  assert_no_unhandled_openssl_errors();
+  if ((job->digest = evp_digest_factory(digest_type)) == NULL)
+    lose("Unsupported digest algorithm");
 
-  if (!PEM_read_bio_X509_REQ(bio, &self->pkcs10, NULL, NULL))
-    lose_openssl_error("Couldn't load PEM encoded PKCS#10 request");
+  job->x509 = x509->x509;
+  job->pkey = asym->pkey;
+  job->refs = (PyObject *) asym;
+  Py_INCREF(job->refs);
 
-  sk_X509_EXTENSION_pop_free(self->exts, X509_EXTENSION_free);
-  self->exts = X509_REQ_get_extensions(self->pkcs10);
+  return signing_pool_submit(self, job);
 
-  assert_no_unhandled_openssl_errors();
+ error:
+  signing_job_free(job);
+  return NULL;
+}
 
-  return (PyObject *) self;
+static char signing_pool_object_sign_crl__doc__[] =
+  "Queue signing of a CRL.\n"
+  "\n"
+  "Arguments are the CRL object to sign, an Asymmetric object holding\n"
+  "the private key, and, optionally, the digest algorithm, as with\n"
+  "CRL.sign().  The CRL is signed in place, so the caller must not\n"
+  "touch it until the job completes.\n"
+  "\n"
+  "Returns a job handle; the result, when collected, is the CRL object.\n"
+  ;
 
- error:
+static PyObject *
+signing_pool_object_sign_crl(signing_pool_object *self, PyObject *args)
+{
+  asymmetric_object *asym = NULL;
+  crl_object *crl = NULL;
+  int digest_type = SHA256_DIGEST;
+  signing_job *job = NULL;
 
-  Py_XDECREF(self);
+  ENTERING(signing_pool_object_sign_crl);
+
+  if (!PyArg_ParseTuple(args, "O!O!|i", &POW_CRL_Type, &crl, &POW_Asymmetric_Type, &asym, &digest_type))
+    goto error;
+
+  if ((job = signing_job_new(signing_job_sign_crl, (PyObject *) crl)) == NULL)
+    goto error;
+
+  if ((job->digest = evp_digest_factory(digest_type)) == NULL)
+    lose("Unsupported digest algorithm");
+
+  job->crl = crl->crl;
+  job->pkey = asym->pkey;
+  job->refs = (PyObject *) asym;
+  Py_INCREF(job->refs);
+
+  return signing_pool_submit(self, job);
+
+ error:
+  signing_job_free(job);
   return NULL;
 }
 
+static char signing_pool_object_sign_cms__doc__[] =
+  "Queue signing of a CMS message.\n"
+  "\n"
+  "The \"cms\" parameter is the CMS, Manifest, or ROA object to sign.\n"
+  "For Manifest and ROA objects, the eContent is encoded from the object\n"
+  "itself, as with their .sign() methods; for plain CMS objects, the\n"
+  "\"data\" parameter supplies the message to be signed.  For Manifest\n"
+  "objects, the optional \"builder\" parameter is a ManifestBuilder\n"
+  "whose entries are spliced in as the fileList, as with its .sign()\n"
+  "method.\n"
+  "\n"
+  "The remaining parameters are as for CMS.sign().  The signed message\n"
+  "replaces the object's current content when the result is collected,\n"
+  "so the object is safe to read (but not to modify) in the meantime.\n"
+  "\n"
+  "Returns a job handle; the result, when collected, is the CMS object.\n"
+  ;
+
 static PyObject *
-pkcs10_object_der_read_helper(PyTypeObject *type, BIO *bio)
+signing_pool_object_sign_cms(signing_pool_object *self, PyObject *args, PyObject *kwds)
 {
-  pkcs10_object *self = NULL;
+  static char *kwlist[] = {"cms", "signcert", "key", "data", "certs", "crls", "eContentType", "flags", "builder", NULL};
+  asymmetric_object *signkey = NULL;
+  x509_object *signcert = NULL;
+  cms_object *cms = NULL;
+  PyObject *data = Py_None;
+  PyObject *builder = Py_None;
+  PyObject *x509_iterable = Py_None;
+  PyObject *crl_iterable = Py_None;
+  PyObject *x509_tuple = NULL;
+  PyObject *crl_tuple = NULL;
+  char *oid = NULL;
+  unsigned flags = 0;
+  signing_job *job = NULL;
 
-  ENTERING(pkcs10_object_der_read_helper);
+  ENTERING(signing_pool_object_sign_cms);
 
-  assert_no_unhandled_openssl_errors();
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!O!O!|OOOzIO", kwlist,
+                                   &POW_CMS_Type, &cms,
+                                   &POW_X509_Type, &signcert,
+                                   &POW_Asymmetric_Type, &signkey,
+                                   &data,
+                                   &x509_iterable,
+                                   &crl_iterable,
+                                   &oid,
+                                   &flags,
+                                   &builder))
+    goto error;
 
-  if ((self = (pkcs10_object *) pkcs10_object_new(type, NULL, NULL)) == NULL)
+  if (builder != Py_None && !POW_Manifest_Check(cms))
+    lose_type_error("Builder argument only allowed when signing Manifest");
+
+  if (builder != Py_None && !POW_ManifestBuilder_Check(builder))
+    lose_type_error("Builder argument must be a ManifestBuilder");
+
+  if ((job = signing_job_new(signing_job_sign_cms, (PyObject *) cms)) == NULL)
     goto error;
 
-  assert_no_unhandled_openssl_errors();
+  /*
+   * Iterables might be generators, so turn them into tuples we can
+   * hold onto, lest the objects go away while the job is queued.
+   */
 
-  if (!d2i_X509_REQ_bio(bio, &self->pkcs10))
-    lose_openssl_error("Couldn't load DER encoded PKCS#10 request");
+  if (x509_iterable != Py_None && (x509_tuple = PySequence_Tuple(x509_iterable)) == NULL)
+    goto error;
 
-  sk_X509_EXTENSION_pop_free(self->exts, X509_EXTENSION_free);
-  self->exts = X509_REQ_get_extensions(self->pkcs10);
+  if (crl_iterable != Py_None && (crl_tuple = PySequence_Tuple(crl_iterable)) == NULL)
+    goto error;
+
+  if ((job->certs = x509_helper_iterable_to_stack(x509_tuple ? x509_tuple : Py_None)) == NULL ||
+      (job->crls  = crl_helper_iterable_to_stack(crl_tuple ? crl_tuple : Py_None)) == NULL)
+    goto error;
+
+  if (oid && (job->econtent_type = OBJ_txt2obj(oid, 1)) == NULL)
+    lose_openssl_error("Couldn't parse OID");
+
+  if (POW_Manifest_Check(cms) || POW_ROA_Check(cms)) {
+
+    if (data != Py_None)
+      lose_type_error("Data argument not allowed when signing Manifest or ROA");
+
+    if ((job->bio = BIO_new(BIO_s_mem())) == NULL)
+      lose_no_memory();
+
+    if (builder != Py_None &&
+        !manifest_builder_write_econtent((manifest_builder_object *) builder, (manifest_object *) cms, job->bio))
+      goto error;
+
+    if (POW_Manifest_Check(cms) && builder == Py_None &&
+        !manifest_object_write_econtent((manifest_object *) cms, job->bio))
+      lose_openssl_error("Couldn't encode manifest");
+
+    if (POW_ROA_Check(cms) &&
+        !roa_object_write_econtent((roa_object *) cms, job->bio))
+      lose_openssl_error("Couldn't encode ROA");
+
+  } else {
+
+    if (!PyString_Check(data))
+      lose_type_error("Data argument must be a string");
+
+    if ((job->bio = BIO_new_mem_buf(PyString_AS_STRING(data), PyString_GET_SIZE(data))) == NULL)
+      lose_no_memory();
+  }
 
   assert_no_unhandled_openssl_errors();
 
-  return (PyObject *) self;
+  if ((job->refs = Py_BuildValue("(OOOOO)", signcert, signkey, data,
+                                 x509_tuple ? x509_tuple : Py_None,
+                                 crl_tuple  ? crl_tuple  : Py_None)) == NULL)
+    goto error;
+
+  job->signcert = signcert->x509;
+  job->pkey = signkey->pkey;
+  job->flags = flags;
+
+  Py_XDECREF(x509_tuple);
+  Py_XDECREF(crl_tuple);
+
+  return signing_pool_submit(self, job);
 
  error:
-  Py_XDECREF(self);
+  signing_job_free(job);
+  Py_XDECREF(x509_tuple);
+  Py_XDECREF(crl_tuple);
   return NULL;
 }
 
-static char pkcs10_object_pem_read__doc__[] =
-  "Read a PEM-encoded PKCS#10 object from a string.\n"
+static char signing_pool_object_fileno__doc__[] =
+  "Return a file descriptor which becomes readable when jobs complete.\n"
+  "\n"
+  "This is intended for use with an event loop's I/O watcher; don't read\n"
+  "from it directly, call .completed() instead.\n"
   ;
 
 static PyObject *
-pkcs10_object_pem_read(PyTypeObject *type, PyObject *args)
+signing_pool_object_fileno(signing_pool_object *self)
 {
-  ENTERING(pkcs10_object_pem_read);
-  return read_from_string_helper(pkcs10_object_pem_read_helper, type, args);
+  ENTERING(signing_pool_object_fileno);
+  return Py_BuildValue("i", self->pipe_fds[0]);
 }
 
-static char pkcs10_object_pem_read_file__doc__[] =
-  "Read a PEM-encoded PKCS#10 object from a file.\n"
+static char signing_pool_object_pending__doc__[] =
+  "Return the number of jobs which have been queued but not yet collected.\n"
   ;
 
 static PyObject *
-pkcs10_object_pem_read_file(PyTypeObject *type, PyObject *args)
+signing_pool_object_pending(signing_pool_object *self)
 {
-  ENTERING(pkcs10_object_pem_read_file);
-  return read_from_file_helper(pkcs10_object_pem_read_helper, type, args);
+  ENTERING(signing_pool_object_pending);
+  return Py_BuildValue("l", self->n_outstanding);
 }
 
-static char pkcs10_object_der_read__doc__[] =
-  "Read a DER-encoded PKCS#10 object from a string.\n"
+static char signing_pool_object_completed__doc__[] =
+  "Collect results of completed jobs.\n"
+  "\n"
+  "Returns a list of (handle, result, error) tuples.  For jobs which\n"
+  "succeeded, \"error\" is None; for jobs which failed, \"result\" is None\n"
+  "and \"error\" is the exception which the equivalent synchronous call\n"
+  "would have raised.  A job whose result can't be returned is reported\n"
+  "as failed, with the exception that prevented returning it.\n"
+  "\n"
+  "If the optional \"wait\" parameter is true and jobs are outstanding but\n"
+  "none has completed yet, this method blocks until at least one does.\n"
   ;
 
 static PyObject *
-pkcs10_object_der_read(PyTypeObject *type, PyObject *args)
+signing_pool_object_completed(signing_pool_object *self, PyObject *args, PyObject *kwds)
 {
-  ENTERING(pkcs10_object_der_read);
-  return read_from_string_helper(pkcs10_object_der_read_helper, type, args);
+  static char *kwlist[] = {"wait", NULL};
+  PyObject *result = NULL;
+  PyObject *item = NULL;
+  signing_job *done = NULL;
+  signing_job *job = NULL;
+  PyObject *type = NULL, *value = NULL, *traceback = NULL;
+  PyObject *wait = Py_False;
+  char buffer[64];
+
+  ENTERING(signing_pool_object_completed);
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", kwlist, &wait))
+    goto error;
+
+  if (!self->initialized)
+    lose("SigningPool not initialized");
+
+  if ((result = PyList_New(0)) == NULL)
+    goto error;
+
+  while (read(self->pipe_fds[0], buffer, sizeof(buffer)) > 0)
+    continue;
+
+  if (PyObject_IsTrue(wait) && self->n_outstanding > 0) {
+    Py_BEGIN_ALLOW_THREADS;
+    pthread_mutex_lock(&self->mutex);
+    while (self->done_head == NULL)
+      pthread_cond_wait(&self->done_cond, &self->mutex);
+    pthread_mutex_unlock(&self->mutex);
+    Py_END_ALLOW_THREADS;
+  }
+
+  pthread_mutex_lock(&self->mutex);
+  done = self->done_head;
+  self->done_head = self->done_tail = NULL;
+  pthread_mutex_unlock(&self->mutex);
+
+  /*
+   * A job whose result we can't build is reported as failed with
+   * whatever exception that raised.  If we can't even do that, we
+   * stop, put the jobs we haven't reported back on the done list for
+   * the next call, and return what we have.
+   */
+
+  while ((job = done) != NULL) {
+
+    if ((item = signing_job_result(job)) == NULL) {
+      PyErr_Fetch(&type, &value, &traceback);
+      PyErr_NormalizeException(&type, &value, &traceback);
+      item = Py_BuildValue("(lOO)", job->handle, Py_None, value ? value : Py_None);
+      Py_XDECREF(type);
+      Py_XDECREF(value);
+      Py_XDECREF(traceback);
+      type = value = traceback = NULL;
+    }
+
+    if (item == NULL || PyList_Append(result, item) < 0)
+      break;
+
+    done = job->next;
+    self->n_outstanding--;
+    signing_job_free(job);
+    Py_XDECREF(item);
+    item = NULL;
+  }
+
+  if (done == NULL)
+    return result;
+
+  Py_XDECREF(item);
+
+  for (job = done; job->next != NULL; job = job->next)
+    continue;
+
+  pthread_mutex_lock(&self->mutex);
+  if ((job->next = self->done_head) == NULL)
+    self->done_tail = job;
+  self->done_head = done;
+  pthread_mutex_unlock(&self->mutex);
+
+  if (write(self->pipe_fds[1], "", 1) < 0 && errno != EAGAIN)
+    KVETCH("Couldn't write to SigningPool wakeup pipe");
+
+  if (PyList_GET_SIZE(result) == 0)
+    goto error;
+
+  PyErr_Clear();
+  return result;
+
+ error:
+  Py_XDECREF(result);
+  return NULL;
 }
 
-static char pkcs10_object_der_read_file__doc__[] =
-  "Read a DER-encoded PKCS#10 object from a file.\n"
+static struct PyMethodDef signing_pool_object_methods[] = {
+  Define_Method(generateRSA,	signing_pool_object_generate_rsa,       METH_KEYWORDS),
+  Define_Method(signX509,	signing_pool_object_sign_x509,          METH_VARARGS),
+  Define_Method(signCRL,	signing_pool_object_sign_crl,           METH_VARARGS),
+  Define_Method(signCMS,	signing_pool_object_sign_cms,           METH_KEYWORDS),
+  Define_Method(fileno,		signing_pool_object_fileno,             METH_NOARGS),
+  Define_Method(pending,	signing_pool_object_pending,            METH_NOARGS),
+  Define_Method(completed,	signing_pool_object_completed,          METH_KEYWORDS),
+  {NULL}
+};
+
+static char POW_SigningPool_Type__doc__[] =
+  "Pool of worker threads for RSA key generation and signing.\n"
+  "\n"
+  "Key generation and signing are the expensive operations when issuing\n"
+  "RPKI objects, and the synchronous methods run them in the calling\n"
+  "thread while holding the Python interpreter lock.  A SigningPool\n"
+  "runs them on its own threads instead, so a single event loop can keep\n"
+  "every core busy.\n"
+  "\n"
+  "Each of the .generateRSA(), .signX509(), .signCRL(), and .signCMS()\n"
+  "methods queues a job and returns an integer handle immediately.\n"
+  "When jobs finish, the descriptor returned by .fileno() becomes\n"
+  "readable, and .completed() returns the results.\n"
+  "\n"
+  "The constructor takes an optional \"threads\" argument; by default,\n"
+  "the pool starts one thread per online CPU.\n"
   ;
 
-static PyObject *
-pkcs10_object_der_read_file(PyTypeObject *type, PyObject *args)
-{
-  ENTERING(pkcs10_object_der_read_file);
-  return read_from_file_helper(pkcs10_object_der_read_helper, type, args);
-}
+static PyTypeObject POW_SigningPool_Type = {
+  PyObject_HEAD_INIT(0)
+  0,                                        /* ob_size */
+  "rpki.POW.SigningPool",                   /* tp_name */
+  sizeof(signing_pool_object),              /* tp_basicsize */
+  0,                                        /* tp_itemsize */
+  (destructor)signing_pool_object_dealloc,  /* tp_dealloc */
+  0,                                        /* tp_print */
+  0,                                        /* tp_getattr */
+  0,                                        /* tp_setattr */
+  0,                                        /* tp_compare */
+  0,                                        /* tp_repr */
+  0,                                        /* tp_as_number */
+  0,                                        /* tp_as_sequence */
+  0,                                        /* tp_as_mapping */
+  0,                                        /* tp_hash */
+  0,                                        /* tp_call */
+  0,                                        /* tp_str */
+  0,                                        /* tp_getattro */
+  0,                                        /* tp_setattro */
+  0,                                        /* tp_as_buffer */
+  Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, /* tp_flags */
+  POW_SigningPool_Type__doc__,              /* tp_doc */
+  0,                                        /* tp_traverse */
+  0,                                        /* tp_clear */
+  0,                                        /* tp_richcompare */
+  0,                                        /* tp_weaklistoffset */
+  0,                                        /* tp_iter */
+  0,                                        /* tp_iternext */
+  signing_pool_object_methods,              /* tp_methods */
+  0,                                        /* tp_members */
+  0,                                        /* tp_getset */
+  0,                                        /* tp_base */
+  0,                                        /* tp_dict */
+  0,                                        /* tp_descr_get */
+  0,                                        /* tp_descr_set */
+  0,                                        /* tp_dictoffset */
+  (initproc) signing_pool_object_init,      /* tp_init */
+  0,                                        /* tp_alloc */
+  signing_pool_object_new,                  /* tp_new */
+};
+
+
+
+
+/*
+ * RSAKeyPool object.
+ */
 
-static char pkcs10_object_pem_write__doc__[] =
-  "Returns the PEM encoding of this PKCS#10 object.\n"
-  ;
+/*
+ * Worker thread.  Tops the pool up whenever it falls below its target
+ * size.  Key generation happens outside the mutex, so a consumer is
+ * never stuck behind a keygen in progress.  If key generation fails,
+ * whatever broke it is unlikely to fix itself immediately, so we back
+ * off, doubling the delay each time, rather than spin.
+ */
 
-static PyObject *
-pkcs10_object_pem_write(pkcs10_object *self)
+static void *
+rsa_key_pool_worker(void *arg)
 {
-  PyObject *result = NULL;
-  BIO *bio = NULL;
+  rsa_key_pool_object *self = arg;
+  struct timespec deadline;
+  EVP_PKEY *pkey;
+  int backoff = 1;
 
-  ENTERING(pkcs10_object_pem_write);
+  for (;;) {
 
-  if ((bio = BIO_new(BIO_s_mem())) == NULL)
-    lose_no_memory();
+    pthread_mutex_lock(&self->mutex);
 
-  if (!PEM_write_bio_X509_REQ(bio, self->pkcs10))
-    lose_openssl_error("Unable to write PKCS#10 request");
+    while (!self->shutdown && self->count >= self->size)
+      pthread_cond_wait(&self->cond, &self->mutex);
 
-  result = BIO_to_PyString_helper(bio);
+    if (self->shutdown) {
+      pthread_mutex_unlock(&self->mutex);
+      break;
+    }
 
- error:                         /* Fall through */
-  BIO_free(bio);
-  return result;
-}
+    pthread_mutex_unlock(&self->mutex);
 
-static char pkcs10_object_der_write__doc__[] =
-  "Return the DER encoding of this PKCS#10 object.\n"
-  ;
+    if ((pkey = asymmetric_object_generate_rsa_key(self->key_size)) == NULL) {
+      ERR_clear_error();
+      pthread_mutex_lock(&self->mutex);
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_sec += backoff;
+      while (!self->shutdown && pthread_cond_timedwait(&self->cond, &self->mutex, &deadline) != ETIMEDOUT)
+        continue;
+      pthread_mutex_unlock(&self->mutex);
+      if (backoff < RSA_KEY_POOL_MAX_BACKOFF)
+        backoff *= 2;
+      continue;
+    }
 
-static PyObject *
-pkcs10_object_der_write(pkcs10_object *self)
-{
-  PyObject *result = NULL;
-  BIO *bio = NULL;
+    backoff = 1;
 
-  ENTERING(pkcs10_object_der_write);
+    pthread_mutex_lock(&self->mutex);
 
-  if ((bio = BIO_new(BIO_s_mem())) == NULL)
-    lose_no_memory();
+    if (self->count < self->size) {
+      self->keys[(self->head + self->count) % self->size] = pkey;
+      self->count++;
+      pkey = NULL;
+    }
 
-  if (!i2d_X509_REQ_bio(bio, self->pkcs10))
-    lose_openssl_error("Unable to write PKCS#10 request");
+    pthread_mutex_unlock(&self->mutex);
 
-  result = BIO_to_PyString_helper(bio);
+    EVP_PKEY_free(pkey);
+  }
 
- error:                         /* Fall through */
-  BIO_free(bio);
-  return result;
-}
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+  ERR_remove_thread_state(NULL);
+#endif
 
-static X509_EXTENSION *
-pkcs10_object_extension_get_helper(pkcs10_object *self, int nid)
-{
-  if (self != NULL && self->exts != NULL)
-    return X509v3_get_ext(self->exts, X509v3_get_ext_by_NID(self->exts, nid, -1));
-  else
-    return NULL;
+  return NULL;
 }
 
-static PyObject *
-pkcs10_object_extension_set_helper(pkcs10_object *self, extension_wrapper ext)
+/*
+ * Take a key from the pool, or return NULL if the pool is empty.
+ */
+
+static EVP_PKEY *
+rsa_key_pool_take(rsa_key_pool_object *self)
 {
-  int ok = 0;
+  EVP_PKEY *pkey = NULL;
 
-  if (ext.value == NULL)
-    goto error;
+  if (!self->initialized)
+    return NULL;
 
-  if (!X509V3_add1_i2d(&self->exts, ext.nid, ext.value, ext.critical, X509V3_ADD_REPLACE))
-    lose_openssl_error("Couldn't add extension to PKCS #10 object");
+  pthread_mutex_lock(&self->mutex);
 
-  ok = 1;
+  if (self->count > 0) {
+    pkey = self->keys[self->head];
+    self->keys[self->head] = NULL;
+    self->head = (self->head + 1) % self->size;
+    self->count--;
+    pthread_cond_signal(&self->cond);
+  }
 
- error:
-  ext.destructor(ext.value);
-  if (ok)
-    Py_RETURN_NONE;
-  else
-    return NULL;
+  pthread_mutex_unlock(&self->mutex);
+
+  return pkey;
 }
 
-static char pkcs10_object_get_public_key__doc__[] =
-  "Return the public key from this PKCS#10 request, as an Asymmetric\n"
-  "object.\n"
-  ;
+/*
+ * Add a key to the pool, taking ownership of it.  Returns zero (and
+ * leaves ownership with the caller) if the pool is full.
+ */
 
-static PyObject *
-pkcs10_object_get_public_key(pkcs10_object *self)
+static int
+rsa_key_pool_put(rsa_key_pool_object *self, EVP_PKEY *pkey)
 {
-  PyTypeObject *type = &POW_Asymmetric_Type;
-  asymmetric_object *asym = NULL;
-
-  ENTERING(pkcs10_object_get_public_key);
-
-  if ((asym = (asymmetric_object *) type->tp_alloc(type, 0)) == NULL)
-    goto error;
+  int ok = 0;
 
-  if ((asym->pkey = X509_REQ_get_pubkey(self->pkcs10)) == NULL)
-    lose_openssl_error("Couldn't extract public key from PKCS#10 request");
+  pthread_mutex_lock(&self->mutex);
 
-  whack_ec_key_to_namedCurve(asym->pkey);
+  if (self->count < self->size) {
+    self->keys[(self->head + self->count) % self->size] = pkey;
+    self->count++;
+    ok = 1;
+  }
 
-  return (PyObject *) asym;
+  pthread_mutex_unlock(&self->mutex);
 
- error:
-  Py_XDECREF(asym);
-  return NULL;
+  return ok;
 }
 
-static char pkcs10_object_set_public_key__doc__[] =
-  "Set the public key for this PKCS#10 request.\n"
-  "\n"
-  "The \"key\" parameter should be an instance of the Asymmetric class,\n"
-  "containing a public key.\n"
-  ;
-
-static PyObject *
-pkcs10_object_set_public_key(pkcs10_object *self, PyObject *args)
+static void
+rsa_key_pool_stop(rsa_key_pool_object *self)
 {
-  asymmetric_object *asym;
-
-  ENTERING(pkcs10_object_set_public_key);
+  int i;
 
-  if (!PyArg_ParseTuple(args, "O!", &POW_Asymmetric_Type, &asym))
-    goto error;
+  if (!self->initialized)
+    return;
 
-  if (!X509_REQ_set_pubkey(self->pkcs10, asym->pkey))
-    lose_openssl_error("Couldn't set certificate's PKCS#10 request");
+  pthread_mutex_lock(&self->mutex);
+  self->shutdown = 1;
+  pthread_cond_broadcast(&self->cond);
+  pthread_mutex_unlock(&self->mutex);
 
-  Py_RETURN_NONE;
+  Py_BEGIN_ALLOW_THREADS;
+  for (i = 0; i < self->n_threads; i++)
+    pthread_join(self->threads[i], NULL);
+  Py_END_ALLOW_THREADS;
 
- error:
-  return NULL;
+  self->n_threads = 0;
 }
 
-static char pkcs10_object_sign__doc__[] =
-  "Sign a PKCS#10 request with a private key.\n"
-  "\n"
-  "The \"key\" parameter should be an instance of the Asymmetric class,\n"
-  "containing a private key.\n"
-  "\n"
-  "The optional \"digest\" parameter indicates which digest to compute and\n"
-  "sign, and should be one of the following:\n"
-  "\n"
-  "* SHA1_DIGEST\n"
-  "* SHA256_DIGEST\n"
-  "* SHA384_DIGEST\n"
-  "* SHA512_DIGEST\n"
-  "\n"
-  "The default digest algorithm is SHA-256.\n"
-  ;
-
 static PyObject *
-pkcs10_object_sign(pkcs10_object *self, PyObject *args)
+rsa_key_pool_object_new(PyTypeObject *type, GCC_UNUSED PyObject *args, GCC_UNUSED PyObject *kwds)
 {
-  asymmetric_object *asym;
-  int loc, digest_type = SHA256_DIGEST;
-  const EVP_MD *digest_method = NULL;
+  rsa_key_pool_object *self = NULL;
 
-  ENTERING(pkcs10_object_sign);
+  ENTERING(rsa_key_pool_object_new);
 
-  if (!PyArg_ParseTuple(args, "O!|i", &POW_Asymmetric_Type, &asym, &digest_type))
-    goto error;
+  if ((self = (rsa_key_pool_object *) type->tp_alloc(type, 0)) == NULL)
+    return NULL;
 
-  if ((digest_method = evp_digest_factory(digest_type)) == NULL)
-    lose("Unsupported digest algorithm");
+  self->initialized = 0;
+  self->shutdown = 0;
+  self->threads = NULL;
+  self->n_threads = 0;
+  self->keys = NULL;
+  self->size = self->head = self->count = 0;
+  self->key_size = 2048;
+  self->hits = self->misses = 0;
 
-  while ((loc = X509_REQ_get_attr_by_NID(self->pkcs10, NID_ext_req, -1)) >= 0)
-    X509_ATTRIBUTE_free(X509_REQ_delete_attr(self->pkcs10, loc));
+  return (PyObject *) self;
+}
 
-  if (sk_X509_EXTENSION_num(self->exts) > 0 &&
-      !X509_REQ_add_extensions(self->pkcs10, self->exts))
-    lose_openssl_error("Couldn't add extensions block to PKCS#10 request");
+static int
+rsa_key_pool_object_init(rsa_key_pool_object *self, PyObject *args, PyObject *kwds)
+{
+  static char *kwlist[] = {"size", "key_size", "threads", NULL};
+  int n_threads = 1;
+  int size = 100;
+  int i;
 
-  if (!X509_REQ_sign(self->pkcs10, asym->pkey, digest_method))
-    lose_openssl_error("Couldn't sign PKCS#10 request");
+  ENTERING(rsa_key_pool_object_init);
 
-  Py_RETURN_NONE;
+  if (self->initialized)
+    lose("RSAKeyPool already initialized");
 
- error:
-  return NULL;
-}
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|iii", kwlist, &size, &self->key_size, &n_threads))
+    goto error;
 
-static char pkcs10_object_verify__doc__[] =
-  "Verify a PKCS#10 request.\n"
-  "\n"
-  "This calls OpenSSL's X509_REQ_verify() method to check the request's\n"
-  "self-signature.\n"
-  ;
+  if (size <= 0)
+    lose_value_error("Pool size must be positive");
 
-static PyObject *
-pkcs10_object_verify(pkcs10_object *self)
-{
-  EVP_PKEY *pkey = NULL;
-  int status;
+  if (n_threads <= 0)
+    lose_value_error("Thread count must be positive");
 
-  ENTERING(pkcs10_object_verify);
+  if (!signing_pool_openssl_thread_setup())
+    lose_no_memory();
 
-  if ((pkey = X509_REQ_get_pubkey(self->pkcs10)) == NULL)
-    lose_openssl_error("Couldn't extract public key from PKCS#10 for verification");
+  if ((self->keys = PyMem_Malloc(size * sizeof(*self->keys))) == NULL ||
+      (self->threads = PyMem_Malloc(n_threads * sizeof(*self->threads))) == NULL)
+    lose_no_memory();
 
-  if ((status = X509_REQ_verify(self->pkcs10, pkey)) < 0)
-    lose_openssl_error("Couldn't verify PKCS#10 signature");
+  memset(self->keys, 0, size * sizeof(*self->keys));
+  self->size = size;
 
-  EVP_PKEY_free(pkey);
-  return PyBool_FromLong(status);
+  pthread_mutex_init(&self->mutex, NULL);
+  pthread_cond_init(&self->cond, NULL);
+  self->initialized = 1;
 
- error:
-  EVP_PKEY_free(pkey);
-  return NULL;
-}
+  for (i = 0; i < n_threads; i++) {
+    if ((errno = pthread_create(&self->threads[i], NULL, rsa_key_pool_worker, self)) != 0) {
+      PyErr_SetFromErrno(PyExc_OSError);
+      goto error;
+    }
+    self->n_threads++;
+  }
 
-static char pkcs10_object_get_version__doc__[] =
-  "Return the version number of this PKCS#10 request.\n"
-  ;
+  return 0;
 
-static PyObject *
-pkcs10_object_get_version(pkcs10_object *self)
-{
-  ENTERING(pkcs10_object_get_version);
-  return Py_BuildValue("l", X509_REQ_get_version(self->pkcs10));
+ error:
+  rsa_key_pool_stop(self);
+  return -1;
 }
 
-static char pkcs10_object_set_version__doc__[] =
-  "Set the version number of this PKCS#10 request.\n"
-  "\n"
-  "The \"version\" parameter should be an integer, but the only defined\n"
-  "value is zero, so this field is optional and defaults to zero.\n"
-;
-
-static PyObject *
-pkcs10_object_set_version(pkcs10_object *self, PyObject *args)
+static void
+rsa_key_pool_object_dealloc(rsa_key_pool_object *self)
 {
-  long version = 0;
-
-  ENTERING(pkcs10_object_set_version);
-
-  if (!PyArg_ParseTuple(args, "|l", &version))
-    goto error;
-
-  if (version != 0)
-    lose("RFC 6487 6.1.1 forbids non-zero values for this field");
+  int i;
 
-  if (!X509_REQ_set_version(self->pkcs10, version))
-    lose("Couldn't set certificate version");
+  ENTERING(rsa_key_pool_object_dealloc);
 
-  Py_RETURN_NONE;
+  rsa_key_pool_stop(self);
 
- error:
+  if (self->initialized) {
+    for (i = 0; i < self->size; i++)
+      EVP_PKEY_free(self->keys[i]);
+    pthread_mutex_destroy(&self->mutex);
+    pthread_cond_destroy(&self->cond);
+  }
 
-  return NULL;
+  PyMem_Free(self->keys);
+  PyMem_Free(self->threads);
+  self->ob_type->tp_free((PyObject*) self);
 }
 
-static char pkcs10_object_get_subject__doc__[] =
-  "Return this PKCS #10 request's subject name.\n"
+static char rsa_key_pool_object_get__doc__[] =
+  "Return a new RSA key as an Asymmetric object.\n"
   "\n"
-  "See the X509.getIssuer() method for details of the return value and\n"
-  "use of the optional \"format\" parameter.\n"
+  "If the pool has a key available, this returns it immediately;\n"
+  "otherwise, it generates one on the spot, just as\n"
+  "Asymmetric.generateRSA() would.\n"
   ;
 
 static PyObject *
-pkcs10_object_get_subject(pkcs10_object *self, PyObject *args)
+rsa_key_pool_object_get(rsa_key_pool_object *self)
 {
-  PyObject *result = NULL;
-  int format = OIDNAME_FORMAT;
+  asymmetric_object *asym = NULL;
 
-  ENTERING(pkcs10_object_get_subject);
+  ENTERING(rsa_key_pool_object_get);
 
-  if (!PyArg_ParseTuple(args, "|i", &format))
+  if ((asym = (asymmetric_object *) asymmetric_object_new(&POW_Asymmetric_Type, NULL, NULL)) == NULL)
     goto error;
 
-  result = x509_object_helper_get_name(X509_REQ_get_subject_name(self->pkcs10),
-                                       format);
+  if ((asym->pkey = rsa_key_pool_take(self)) != NULL) {
+    self->hits++;
+  } else {
+    self->misses++;
+    if ((asym->pkey = asymmetric_object_generate_rsa_key(self->key_size)) == NULL)
+      lose_openssl_error("Couldn't generate new RSA key");
+  }
+
+  return (PyObject *) asym;
 
- error:                         /* Fall through */
-  return result;
+ error:
+  Py_XDECREF(asym);
+  return NULL;
 }
 
-static char pkcs10_object_set_subject__doc__[] =
-  "Set this PKCS#10 request's subject name.\n"
+static char rsa_key_pool_object_save__doc__[] =
+  "Move the keys currently in the pool to a file.\n"
   "\n"
-  "The \"name\" parameter should be in the same format as the return\n"
-  "value from the \"getSubject\" method.\n"
+  "The keys are written as passphrase-encrypted PKCS #8 PEM, to a\n"
+  "temporary file which is then renamed to \"filename\", readable only\n"
+  "by its owner.  Keys written to the file are removed from the pool,\n"
+  "so that no key can be both saved and handed out.\n"
+  "\n"
+  "Returns the number of keys saved.\n"
   ;
 
 static PyObject *
-pkcs10_object_set_subject(pkcs10_object *self, PyObject *args)
+rsa_key_pool_object_save(rsa_key_pool_object *self, PyObject *args)
 {
-  PyObject *name_sequence = NULL;
-  X509_NAME *name = NULL;
+  char *filename = NULL, *passphrase = NULL, *tempname = NULL;
+  EVP_PKEY *pkey = NULL;
+  BIO *bio = NULL;
+  long n = 0;
+  int fd = -1;
+  int ok = 0;
 
-  ENTERING(pkcs10_object_set_subject);
+  ENTERING(rsa_key_pool_object_save);
 
-  if (!PyArg_ParseTuple(args, "O", &name_sequence))
+  if (!PyArg_ParseTuple(args, "ss", &filename, &passphrase))
     goto error;
 
-  if (!PySequence_Check(name_sequence))
-    lose_type_error("Expected a sequence object");
+  if ((tempname = PyMem_Malloc(strlen(filename) + sizeof(".XXXXXX"))) == NULL)
+    lose_no_memory();
 
-  if ((name = x509_object_helper_set_name(name_sequence)) == NULL)
+  strcpy(tempname, filename);
+  strcat(tempname, ".XXXXXX");
+
+  if ((fd = mkstemp(tempname)) < 0) {
+    PyErr_SetFromErrnoWithFilename(PyExc_OSError, tempname);
+    PyMem_Free(tempname);
+    tempname = NULL;
     goto error;
+  }
 
-  if (!X509_REQ_set_subject_name(self->pkcs10, name))
-    lose("Unable to set subject name");
+  if ((bio = BIO_new_fd(fd, BIO_CLOSE)) == NULL)
+    lose_no_memory();
 
-  X509_NAME_free(name);
+  fd = -1;
 
-  Py_RETURN_NONE;
+  /*
+   * Workers refill the pool as we empty it, so stop after one pool's
+   * worth of keys rather than chasing them.
+   */
 
- error:
-  X509_NAME_free(name);
-  return NULL;
-}
+  while (n < self->size && (pkey = rsa_key_pool_take(self)) != NULL) {
+    if (!PEM_write_bio_PKCS8PrivateKey(bio, pkey, EVP_aes_256_cbc(), NULL, 0, NULL, passphrase))
+      lose_openssl_error("Couldn't write RSA key pool");
+    EVP_PKEY_free(pkey);
+    pkey = NULL;
+    n++;
+  }
 
-static char pkcs10_object_get_key_usage__doc__[] =
-  EXTENSION_GET_KEY_USAGE__DOC__
-  ;
+  if (BIO_flush(bio) <= 0)
+    lose_openssl_error("Couldn't write RSA key pool");
 
-static PyObject *
-pkcs10_object_get_key_usage(pkcs10_object *self)
-{
-  return extension_get_key_usage(pkcs10_object_extension_get_helper(self, NID_key_usage));
-}
+  BIO_free(bio);
+  bio = NULL;
 
-static char pkcs10_object_set_key_usage__doc__[] =
-  "Set the KeyUsage extension for this PKCS#10 request.\n"
-  "\n"
-  EXTENSION_SET_KEY_USAGE__DOC__
-  ;
+  if (rename(tempname, filename) < 0) {
+    PyErr_SetFromErrnoWithFilename(PyExc_OSError, filename);
+    goto error;
+  }
 
-static PyObject *
-pkcs10_object_set_key_usage(pkcs10_object *self, PyObject *args)
-{
-  return pkcs10_object_extension_set_helper(self, extension_set_key_usage(args));
-}
+  ok = 1;
 
-static char pkcs10_object_get_eku__doc__[] =
-  EXTENSION_GET_EKU__DOC__
-  ;
+ error:
+  if (!ok && tempname != NULL)
+    (void) unlink(tempname);
+  if (fd >= 0)
+    (void) close(fd);
+  EVP_PKEY_free(pkey);
+  BIO_free(bio);
+  PyMem_Free(tempname);
 
-static PyObject *
-pkcs10_object_get_eku(pkcs10_object *self)
-{
-  return extension_get_eku(pkcs10_object_extension_get_helper(self, NID_ext_key_usage));
+  if (ok)
+    return Py_BuildValue("l", n);
+  else
+    return NULL;
 }
 
-static char pkcs10_object_set_eku__doc__[] =
-  "Set the ExtendedKeyUsage extension for this PKCS #10 request.\n"
+static char rsa_key_pool_object_load__doc__[] =
+  "Add keys saved by .save() back into the pool.\n"
   "\n"
-  EXTENSION_SET_EKU__DOC__
-  ;
-
-static PyObject *
-pkcs10_object_set_eku(pkcs10_object *self, PyObject *args)
-{
-  return pkcs10_object_extension_set_helper(self, extension_set_eku(args));
-}
-
-static char pkcs10_object_get_basic_constraints__doc__[] =
-  "Return BasicConstraints value for this PKCS#10 request.\n"
+  "Every key in the file is decrypted before any is added to the pool.\n"
+  "If that fails (wrong passphrase, damaged file), this method raises an\n"
+  "exception and leaves both the pool and the file alone.  Otherwise the\n"
+  "file is deleted before the keys go into the pool, whether or not they\n"
+  "all fit, so that no key is ever loaded twice.  Keys of the wrong type\n"
+  "or size are discarded.\n"
   "\n"
-  EXTENSION_GET_BASIC_CONSTRAINTS__DOC__
+  "Returns the number of keys loaded.\n"
   ;
 
 static PyObject *
-pkcs10_object_get_basic_constraints(pkcs10_object *self)
+rsa_key_pool_object_load(rsa_key_pool_object *self, PyObject *args)
 {
-  return extension_get_basic_constraints(pkcs10_object_extension_get_helper(self, NID_basic_constraints));
-}
+  char *filename = NULL, *passphrase = NULL;
+  char *name = NULL, *header = NULL;
+  unsigned char *data = NULL;
+  const unsigned char *d;
+  long len;
+  PKCS8_PRIV_KEY_INFO *p8inf = NULL;
+  X509_SIG *p8 = NULL;
+  EVP_PKEY *pkey = NULL;
+  EVP_PKEY **keys = NULL;
+  BIO *bio = NULL;
+  long n = 0;
+  int i, n_keys = 0;
+  int ok = 0;
 
-static char pkcs10_object_set_basic_constraints__doc__[] =
-  "Set BasicConstraints value for this PKCS#10 request.\n"
-  "\n"
-  EXTENSION_SET_BASIC_CONSTRAINTS__DOC__
-  ;
+  ENTERING(rsa_key_pool_object_load);
 
-static PyObject *
-pkcs10_object_set_basic_constraints(pkcs10_object *self, PyObject *args)
-{
-  return pkcs10_object_extension_set_helper(self, extension_set_basic_constraints(args));
-}
+  if (!PyArg_ParseTuple(args, "ss", &filename, &passphrase))
+    goto error;
 
-static char pkcs10_object_get_sia__doc__[] =
-  "Return the SIA values for this PKCS#10 request.\n"
-  "\n"
-  EXTENSION_GET_SIA__DOC__
-  ;
+  if (!self->initialized)
+    lose("RSAKeyPool not initialized");
 
-static PyObject *
-pkcs10_object_get_sia(pkcs10_object *self)
-{
-  return extension_get_sia(pkcs10_object_extension_get_helper(self, NID_sinfo_access));
-}
+  /*
+   * The pool can't take more than one pool's worth of keys, so that's
+   * all we keep, but we decode everything, to check the whole file.
+   */
 
-static char pkcs10_object_set_sia__doc__[] =
-  "Set SIA values for this PKCS#10 request.\n"
-  "\n"
-  EXTENSION_SET_SIA__DOC__
-  ;
+  if ((keys = PyMem_Malloc(self->size * sizeof(*keys))) == NULL)
+    lose_no_memory();
 
-static PyObject *
-pkcs10_object_set_sia(pkcs10_object *self, PyObject *args, PyObject *kwds)
-{
-  return pkcs10_object_extension_set_helper(self, extension_set_sia(args, kwds));
-}
+  if ((bio = BIO_new_file(filename, "r")) == NULL) {
+    ERR_clear_error();
+    PyErr_SetFromErrnoWithFilename(PyExc_OSError, filename);
+    goto error;
+  }
 
-static char pkcs10_object_get_signature_algorithm__doc__[] =
-  "Return this PKCS #10 reqeuest's signature algorithm OID.\n"
-  ;
+  /*
+   * We decode the PEM blocks ourselves rather than calling
+   * PEM_read_bio_PrivateKey(), so that running off the end of the
+   * file looks the same ("no start line") as it always has.
+   */
 
-static PyObject *
-pkcs10_object_get_signature_algorithm(pkcs10_object *self)
-{
-  ASN1_OBJECT *oid = NULL;
+  while (PEM_read_bio(bio, &name, &header, &data, &len)) {
 
-  ENTERING(pkcs10_object_get_signature_algorithm);
+    if (strcmp(name, PEM_STRING_PKCS8) != 0)
+      lose("Unexpected PEM block in RSA key pool file");
 
-  X509_ALGOR_get0(&oid, NULL, NULL, self->pkcs10->sig_alg);
+    d = data;
 
-  return ASN1_OBJECT_to_PyString(oid);
-}
+    if ((p8 = d2i_X509_SIG(NULL, &d, len)) == NULL ||
+        (p8inf = PKCS8_decrypt(p8, passphrase, strlen(passphrase))) == NULL ||
+        (pkey = EVP_PKCS82PKEY(p8inf)) == NULL)
+      lose_openssl_error("Couldn't decode RSA key pool entry");
 
-static char pkcs10_object_get_extension_oids__doc__[] =
-  "Return the set of extension OIDs used in this request.  This is mostly\n"
-  "useful for enforcing restrictions on what extensions are allowed to be\n"
-  "present, eg, to conform with the RPKI profile.\n"
-  ;
+    if (EVP_PKEY_base_id(pkey) == EVP_PKEY_RSA &&
+        EVP_PKEY_bits(pkey) == self->key_size &&
+        n_keys < self->size) {
+      keys[n_keys++] = pkey;
+      pkey = NULL;
+    }
 
-static PyObject *
-pkcs10_object_get_extension_oids(pkcs10_object *self)
-{
-  PyObject *result = NULL;
-  PyObject *oid = NULL;
-  int i;
+    EVP_PKEY_free(pkey);
+    PKCS8_PRIV_KEY_INFO_free(p8inf);
+    X509_SIG_free(p8);
+    OPENSSL_free(name);
+    OPENSSL_free(header);
+    OPENSSL_free(data);
+    pkey = NULL;
+    p8inf = NULL;
+    p8 = NULL;
+    name = header = NULL;
+    data = NULL;
+  }
 
-  ENTERING(pkcs10_object_get_extension_oids);
+  if (ERR_GET_REASON(ERR_peek_last_error()) != PEM_R_NO_START_LINE)
+    lose_openssl_error("Couldn't read RSA key pool file");
 
-  if ((result = PyFrozenSet_New(NULL)) == NULL)
+  ERR_clear_error();
+
+  if (unlink(filename) < 0) {
+    PyErr_SetFromErrnoWithFilename(PyExc_OSError, filename);
     goto error;
+  }
 
-  for (i = 0; i < sk_X509_EXTENSION_num(self->exts); i++) {
-    X509_EXTENSION *ext = sk_X509_EXTENSION_value(self->exts, i);
-    if ((oid = ASN1_OBJECT_to_PyString(X509_EXTENSION_get_object(ext))) == NULL ||
-        PySet_Add(result, oid) < 0)
-      goto error;
-    Py_XDECREF(oid);
-    oid = NULL;
+  for (i = 0; i < n_keys; i++) {
+    if (rsa_key_pool_put(self, keys[i])) {
+      keys[i] = NULL;
+      n++;
+    }
   }
 
-  return result;
+  ok = 1;
 
  error:
-  Py_XDECREF(result);
-  Py_XDECREF(oid);
-  return NULL;  
+  for (i = 0; i < n_keys; i++)
+    EVP_PKEY_free(keys[i]);
+  PyMem_Free(keys);
+  EVP_PKEY_free(pkey);
+  PKCS8_PRIV_KEY_INFO_free(p8inf);
+  X509_SIG_free(p8);
+  OPENSSL_free(name);
+  OPENSSL_free(header);
+  OPENSSL_free(data);
+  BIO_free(bio);
+
+  if (ok)
+    return Py_BuildValue("l", n);
+  else
+    return NULL;
 }
 
-static char pkcs10_object_pprint__doc__[] =
-  "Return a pretty-printed rendition of this PKCS#10 request.\n"
+static char rsa_key_pool_object_get_stats__doc__[] =
+  "Return a tuple (available, size, hits, misses) describing the pool.\n"
   ;
 
 static PyObject *
-pkcs10_object_pprint(pkcs10_object *self)
+rsa_key_pool_object_get_stats(rsa_key_pool_object *self)
 {
-  PyObject *result = NULL;
-  BIO *bio = NULL;
-
-  ENTERING(pkcs10_object_pprint);
-
-  if ((bio = BIO_new(BIO_s_mem())) == NULL)
-    lose_no_memory();
+  int count = 0;
 
-  if (!X509_REQ_print(bio, self->pkcs10))
-    lose_openssl_error("Unable to pretty-print PKCS#10 request");
+  ENTERING(rsa_key_pool_object_get_stats);
 
-  result = BIO_to_PyString_helper(bio);
+  if (self->initialized) {
+    pthread_mutex_lock(&self->mutex);
+    count = self->count;
+    pthread_mutex_unlock(&self->mutex);
+  }
 
- error:                         /* Fall through */
-  BIO_free(bio);
-  return result;
+  return Py_BuildValue("(iikk)", count, self->size, self->hits, self->misses);
 }
 
-static struct PyMethodDef pkcs10_object_methods[] = {
-  Define_Method(pemWrite,               pkcs10_object_pem_write,                METH_NOARGS),
-  Define_Method(derWrite,               pkcs10_object_der_write,                METH_NOARGS),
-  Define_Method(sign,                   pkcs10_object_sign,                     METH_VARARGS),
-  Define_Method(verify,                 pkcs10_object_verify,                   METH_NOARGS),
-  Define_Method(getPublicKey,           pkcs10_object_get_public_key,           METH_NOARGS),
-  Define_Method(setPublicKey,           pkcs10_object_set_public_key,           METH_VARARGS),
-  Define_Method(getVersion,             pkcs10_object_get_version,              METH_NOARGS),
-  Define_Method(setVersion,             pkcs10_object_set_version,              METH_VARARGS),
-  Define_Method(getSubject,             pkcs10_object_get_subject,              METH_VARARGS),
-  Define_Method(setSubject,             pkcs10_object_set_subject,              METH_VARARGS),
-  Define_Method(pprint,                 pkcs10_object_pprint,                   METH_NOARGS),
-  Define_Method(getKeyUsage,            pkcs10_object_get_key_usage,            METH_NOARGS),
-  Define_Method(setKeyUsage,            pkcs10_object_set_key_usage,            METH_VARARGS),
-  Define_Method(getEKU,                 pkcs10_object_get_eku,                  METH_NOARGS),
-  Define_Method(setEKU,                 pkcs10_object_set_eku,                  METH_VARARGS),
-  Define_Method(getBasicConstraints,    pkcs10_object_get_basic_constraints,    METH_NOARGS),
-  Define_Method(setBasicConstraints,    pkcs10_object_set_basic_constraints,    METH_VARARGS),
-  Define_Method(getSIA,                 pkcs10_object_get_sia,                  METH_NOARGS),
-  Define_Method(setSIA,                 pkcs10_object_set_sia,                  METH_KEYWORDS),
-  Define_Method(getSignatureAlgorithm,  pkcs10_object_get_signature_algorithm,  METH_NOARGS),
-  Define_Method(getExtensionOIDs,       pkcs10_object_get_extension_oids,       METH_NOARGS),
-  Define_Class_Method(pemRead,          pkcs10_object_pem_read,                 METH_VARARGS),
-  Define_Class_Method(pemReadFile,      pkcs10_object_pem_read_file,            METH_VARARGS),
-  Define_Class_Method(derRead,          pkcs10_object_der_read,                 METH_VARARGS),
-  Define_Class_Method(derReadFile,      pkcs10_object_der_read_file,            METH_VARARGS),
+static struct PyMethodDef rsa_key_pool_object_methods[] = {
+  Define_Method(get,		rsa_key_pool_object_get,                METH_NOARGS),
+  Define_Method(save,		rsa_key_pool_object_save,               METH_VARARGS),
+  Define_Method(load,		rsa_key_pool_object_load,               METH_VARARGS),
+  Define_Method(getStats,	rsa_key_pool_object_get_stats,          METH_NOARGS),
   {NULL}
 };
 
-static char POW_PKCS10_Type__doc__[] =
-  "This class represents a PKCS#10 request.\n"
+static char POW_RSAKeyPool_Type__doc__[] =
+  "Buffer of pre-generated RSA keys.\n"
+  "\n"
+  "RSA key generation is by far the most expensive operation in issuing\n"
+  "a signed object with a one-off EE certificate.  An RSAKeyPool keeps a\n"
+  "buffer of fresh keys topped up by background threads, so that taking\n"
+  "a key is a constant-time operation as long as the pool keeps up.\n"
+  "\n"
+  "The constructor takes three optional keyword arguments: \"size\", the\n"
+  "number of keys to keep on hand (default 100); \"key_size\", in bits\n"
+  "(default 2048); and \"threads\", the number of background threads\n"
+  "(default 1).\n"
+  "\n"
+  "Use setRSAKeyPool() to make Asymmetric.generateRSA() draw from a pool.\n"
   ;
 
-static PyTypeObject POW_PKCS10_Type = {
+static PyTypeObject POW_RSAKeyPool_Type = {
   PyObject_HEAD_INIT(0)
   0,                                        /* ob_size */
-  "rpki.POW.PKCS10",                        /* tp_name */
-  sizeof(pkcs10_object),                    /* tp_basicsize */
+  "rpki.POW.RSAKeyPool",                    /* tp_name */
+  sizeof(rsa_key_pool_object),              /* tp_basicsize */
   0,                                        /* tp_itemsize */
-  (destructor)pkcs10_object_dealloc,        /* tp_dealloc */
+  (destructor)rsa_key_pool_object_dealloc,  /* tp_dealloc */
   0,                                        /* tp_print */
   0,                                        /* tp_getattr */
   0,                                        /* tp_setattr */
@@ -9811,14 +13657,14 @@ static PyTypeObject POW_PKCS10_Type = {
   0,                                        /* tp_setattro */
   0,                                        /* tp_as_buffer */
   Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, /* tp_flags */
-  POW_PKCS10_Type__doc__,                   /* tp_doc */
+  POW_RSAKeyPool_Type__doc__,               /* tp_doc */
   0,                                        /* tp_traverse */
   0,                                        /* tp_clear */
   0,                                        /* tp_richcompare */
   0,                                        /* tp_weaklistoffset */
   0,                                        /* tp_iter */
   0,                                        /* tp_iternext */
-  pkcs10_object_methods,                    /* tp_methods */
+  rsa_key_pool_object_methods,              /* tp_methods */
   0,                                        /* tp_members */
   0,                                        /* tp_getset */
   0,                                        /* tp_base */
@@ -9826,11 +13672,12 @@ static PyTypeObject POW_PKCS10_Type = {
   0,                                        /* tp_descr_get */
   0,                                        /* tp_descr_set */
   0,                                        /* tp_dictoffset */
-  0,                                        /* tp_init */
+  (initproc) rsa_key_pool_object_init,      /* tp_init */
   0,                                        /* tp_alloc */
-  pkcs10_object_new,                        /* tp_new */
+  rsa_key_pool_object_new,                  /* tp_new */
 };
 
+
 
 
 /*
@@ -10156,6 +14003,39 @@ pow_module_custom_datetime(GCC_UNUSED PyObject *self, PyObject *args)
   return NULL;
 }
 
+static char pow_module_set_rsa_key_pool__doc__[] =
+  "Install an RSAKeyPool for Asymmetric.generateRSA() to draw from.\n"
+  "\n"
+  "Pass None to go back to generating every key on demand.\n"
+  ;
+
+static PyObject *
+pow_module_set_rsa_key_pool(GCC_UNUSED PyObject *self, PyObject *args)
+{
+  PyObject *pool = NULL;
+
+  ENTERING(pow_module_set_rsa_key_pool);
+
+  if (!PyArg_ParseTuple(args, "O", &pool))
+    goto error;
+
+  if (pool != Py_None && !PyObject_TypeCheck(pool, &POW_RSAKeyPool_Type))
+    lose_type_error("Expected an RSAKeyPool object or None");
+
+  if (pool == Py_None)
+    pool = NULL;
+
+  Py_XINCREF(pool);
+  Py_XDECREF(default_rsa_key_pool);
+  default_rsa_key_pool = (rsa_key_pool_object *) pool;
+
+  Py_RETURN_NONE;
+
+ error:
+  return NULL;
+}
+
+
 
 static struct PyMethodDef pow_module_methods[] = {
   Define_Method(getError,               pow_module_get_error,                   METH_NOARGS),
@@ -10167,6 +14047,7 @@ static struct PyMethodDef pow_module_methods[] = {
   Define_Method(writeRandomFile,        pow_module_write_random_file,           METH_VARARGS),
   Define_Method(addObject,              pow_module_add_object,                  METH_VARARGS),
   Define_Method(customDatetime,         pow_module_custom_datetime,             METH_VARARGS),
+  Define_Method(setRSAKeyPool,          pow_module_set_rsa_key_pool,            METH_VARARGS),
   {NULL}
 };
 
@@ -10224,8 +14105,12 @@ init_POW(void)
   Define_Class(POW_CMS_Type);
   Define_Class(POW_IPAddress_Type);
   Define_Class(POW_Manifest_Type);
+  Define_Class(POW_ManifestBuilder_Type);
   Define_Class(POW_ROA_Type);
   Define_Class(POW_PKCS10_Type);
+  Define_Class(POW_RRDPParser_Type);
+  Define_Class(POW_SigningPool_Type);
+  Define_Class(POW_RSAKeyPool_Type);
 
 #undef Define_Class
 
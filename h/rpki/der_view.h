@@ -0,0 +1,390 @@
+/*
+ * Copyright (C) 2015--2016  Parsons Government Services ("PARSONS")
+ * Portions copyright (C) 2013--2014  Dragon Research Labs ("DRL")
+ * Portions copyright (C) 2009--2013  Internet Systems Consortium ("ISC")
+ * Portions copyright (C) 2006--2008  American Registry for Internet Numbers ("ARIN")
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notices and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND PARSONS, DRL, ISC, AND ARIN
+ * DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS.  IN NO EVENT
+ * SHALL PARSONS, DRL, ISC, OR ARIN BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* $Id$ */
+
+#ifndef __DER_VIEW_H__
+#define __DER_VIEW_H__
+
+#include <stddef.h>
+#include <string.h>
+
+/*
+ * Hand-written DER decoders for ROA and manifest eContent.
+ *
+ * OpenSSL's template decoder (the ROA and Manifest templates in
+ * roa.h and manifest.h) allocates an object for every INTEGER, BIT
+ * STRING, IA5String and SEQUENCE it finds, which adds up on large
+ * manifests.  These decoders check the same structure, but all they
+ * return is views: pointers into the caller's buffer plus lengths.
+ * Nothing here allocates memory, so the views are only good for as
+ * long as the caller keeps the buffer.
+ *
+ * The *_parse() functions check the whole object, including every
+ * list element, so once one of them succeeds the *_next_*() iterators
+ * can't fail except by running off the end of the list.
+ *
+ * Like roa.h and manifest.h, this file contains function definitions,
+ * so include it in only one source file per program.
+ */
+
+typedef struct der_view {
+  const unsigned char *data;
+  size_t len;
+} der_view_t;
+
+#define	DER_TAG_INTEGER			0x02
+#define	DER_TAG_BIT_STRING		0x03
+#define	DER_TAG_OCTET_STRING		0x04
+#define	DER_TAG_OBJECT			0x06
+#define	DER_TAG_IA5STRING		0x16
+#define	DER_TAG_GENERALIZEDTIME		0x18
+#define	DER_TAG_SEQUENCE		0x30
+#define	DER_TAG_EXPLICIT_0		0xA0
+
+/*
+ * Length of a GeneralizedTime in the only form RFC 5280 allows:
+ * YYYYMMDDHHMMSSZ.  Times in this form sort correctly with memcmp().
+ */
+#define	DER_GENERALIZEDTIME_LEN		15
+
+/*
+ * DER encoding of the OID for SHA-256, without tag and length.
+ */
+#define	DER_OID_SHA256			"\x60\x86\x48\x01\x65\x03\x04\x02\x01"
+#define	DER_OID_SHA256_LEN		9
+
+/*
+ * Pull one TLV with the expected tag off the front of a view,
+ * returning its contents.  We only handle single-octet tags and
+ * definite lengths in minimal form, which is all DER allows for the
+ * types we care about.
+ */
+static int der_get(der_view_t *v, const unsigned char tag, der_view_t *content)
+{
+  const unsigned char *p;
+  size_t n, len, i, nlen;
+
+  if (v == NULL || v->data == NULL || v->len < 2 || v->data[0] != tag)
+    return 0;
+
+  p = v->data + 2;
+  n = v->len - 2;
+
+  if (v->data[1] < 0x80) {
+    len = v->data[1];
+  } else {
+    nlen = v->data[1] & 0x7F;
+    if (nlen == 0 || nlen > 4 || nlen > sizeof(size_t) || nlen > n || p[0] == 0)
+      return 0;
+    for (len = 0, i = 0; i < nlen; i++)
+      len = (len << 8) | p[i];
+    if (len < 0x80)
+      return 0;
+    p += nlen;
+    n -= nlen;
+  }
+
+  if (len > n)
+    return 0;
+
+  if (content != NULL) {
+    content->data = p;
+    content->len = len;
+  }
+
+  v->data = p + len;
+  v->len = n - len;
+  return 1;
+}
+
+/*
+ * Pull an INTEGER off the front of a view, checking that it's
+ * minimally encoded.
+ */
+static int der_get_integer(der_view_t *v, der_view_t *content)
+{
+  der_view_t c;
+
+  if (!der_get(v, DER_TAG_INTEGER, &c) || c.len == 0 ||
+      (c.len > 1 && c.data[0] == 0x00 && (c.data[1] & 0x80) == 0) ||
+      (c.len > 1 && c.data[0] == 0xFF && (c.data[1] & 0x80) != 0))
+    return 0;
+
+  if (content != NULL)
+    *content = c;
+  return 1;
+}
+
+/*
+ * Check whether the contents of an INTEGER are non-negative and fit
+ * in the given number of octets as an unsigned value.
+ */
+static int der_integer_fits(const der_view_t *c, const size_t octets)
+{
+  if (c == NULL || c->len == 0 || (c->data[0] & 0x80) != 0)
+    return 0;
+  return c->len <= octets || (c->len == octets + 1 && c->data[0] == 0x00);
+}
+
+/*
+ * Convert the contents of a non-negative INTEGER to an unsigned long.
+ * Fails if the value doesn't fit.
+ */
+static int der_integer_to_ulong(const der_view_t *c, unsigned long *result)
+{
+  unsigned long u = 0;
+  size_t i;
+
+  if (!der_integer_fits(c, sizeof(*result)))
+    return 0;
+
+  for (i = 0; i < c->len; i++)
+    u = (u << 8) | c->data[i];
+
+  *result = u;
+  return 1;
+}
+
+/*
+ * Pull a BIT STRING off the front of a view, returning the bits
+ * (without the leading unused-bits octet) and the number of unused
+ * bits in the last octet.  Like OpenSSL, we don't insist that the
+ * unused bits be zero, so callers which care need to mask them.
+ */
+static int der_get_bit_string(der_view_t *v, der_view_t *bits, unsigned *unused)
+{
+  der_view_t c;
+
+  if (!der_get(v, DER_TAG_BIT_STRING, &c) || c.len == 0 || c.data[0] > 7 ||
+      (c.len == 1 && c.data[0] != 0))
+    return 0;
+
+  if (bits != NULL) {
+    bits->data = c.data + 1;
+    bits->len = c.len - 1;
+  }
+  if (unused != NULL)
+    *unused = c.data[0];
+  return 1;
+}
+
+/*
+ * Pull a GeneralizedTime off the front of a view.  RFC 5280 only
+ * allows YYYYMMDDHHMMSSZ, so that's all we accept.
+ */
+static int der_get_generalizedtime(der_view_t *v, der_view_t *content)
+{
+  der_view_t c;
+  size_t i;
+
+  if (!der_get(v, DER_TAG_GENERALIZEDTIME, &c) || c.len != DER_GENERALIZEDTIME_LEN ||
+      c.data[DER_GENERALIZEDTIME_LEN - 1] != 'Z')
+    return 0;
+
+  for (i = 0; i < DER_GENERALIZEDTIME_LEN - 1; i++)
+    if (c.data[i] < '0' || c.data[i] > '9')
+      return 0;
+
+  if (content != NULL)
+    *content = c;
+  return 1;
+}
+
+/*
+ * Pull an IA5String off the front of a view.  We also reject NULs,
+ * since everything downstream of us treats these as C strings.
+ */
+static int der_get_ia5string(der_view_t *v, der_view_t *content)
+{
+  der_view_t c;
+  size_t i;
+
+  if (!der_get(v, DER_TAG_IA5STRING, &c))
+    return 0;
+
+  for (i = 0; i < c.len; i++)
+    if (c.data[i] == 0x00 || c.data[i] > 0x7F)
+      return 0;
+
+  if (content != NULL)
+    *content = c;
+  return 1;
+}
+
+/*
+ * Pull the "version [0] INTEGER DEFAULT 0" field that starts both
+ * ROAs and manifests.  If the field is absent, the view's data
+ * pointer is NULL.  If it's present we return it even if it's zero,
+ * since DER says a defaulted field equal to its default must be
+ * omitted, and the caller may want to complain about that.
+ */
+static int der_get_default_version(der_view_t *v, der_view_t *version)
+{
+  der_view_t c;
+
+  version->data = NULL;
+  version->len = 0;
+
+  if (v->len == 0 || v->data[0] != DER_TAG_EXPLICIT_0)
+    return 1;
+
+  return der_get(v, DER_TAG_EXPLICIT_0, &c) && der_get_integer(&c, version) && c.len == 0;
+}
+
+
+
+/*
+ * RouteOriginAttestation (RFC 6482).
+ */
+
+typedef struct roa_view {
+  der_view_t version;		/* data == NULL if absent */
+  der_view_t asID;		/* INTEGER contents */
+  der_view_t ipAddrBlocks;	/* SEQUENCE OF contents */
+} roa_view_t;
+
+/*
+ * Pull the next ROAIPAddressFamily from an iterator over
+ * ipAddrBlocks.  The iterator is just a view, initialized to the
+ * ipAddrBlocks view.
+ */
+static int roa_view_next_family(der_view_t *iter,
+				der_view_t *addressFamily,
+				der_view_t *addresses)
+{
+  der_view_t family;
+
+  return (der_get(iter, DER_TAG_SEQUENCE, &family) &&
+	  der_get(&family, DER_TAG_OCTET_STRING, addressFamily) &&
+	  der_get(&family, DER_TAG_SEQUENCE, addresses) &&
+	  family.len == 0);
+}
+
+/*
+ * Pull the next ROAIPAddress from an iterator over a family's
+ * addresses.  If maxLength is absent, its data pointer is NULL.
+ */
+static int roa_view_next_address(der_view_t *iter,
+				 der_view_t *address,
+				 unsigned *unused,
+				 der_view_t *maxLength)
+{
+  der_view_t a;
+
+  maxLength->data = NULL;
+  maxLength->len = 0;
+
+  return (der_get(iter, DER_TAG_SEQUENCE, &a) &&
+	  der_get_bit_string(&a, address, unused) &&
+	  (a.len == 0 || der_get_integer(&a, maxLength)) &&
+	  a.len == 0);
+}
+
+/*
+ * Check the structure of a ROA and set up views of its fields.
+ */
+static int roa_view_parse(roa_view_t *roa, const unsigned char *der, const size_t len)
+{
+  der_view_t v, seq, families, addresses, af, address, maxLength;
+  unsigned unused;
+
+  v.data = der;
+  v.len = len;
+
+  if (!der_get(&v, DER_TAG_SEQUENCE, &seq) || v.len != 0 ||
+      !der_get_default_version(&seq, &roa->version) ||
+      !der_get_integer(&seq, &roa->asID) ||
+      !der_get(&seq, DER_TAG_SEQUENCE, &roa->ipAddrBlocks) ||
+      seq.len != 0)
+    return 0;
+
+  for (families = roa->ipAddrBlocks; families.len > 0; ) {
+    if (!roa_view_next_family(&families, &af, &addresses))
+      return 0;
+    while (addresses.len > 0)
+      if (!roa_view_next_address(&addresses, &address, &unused, &maxLength))
+	return 0;
+  }
+
+  return 1;
+}
+
+
+
+/*
+ * Manifest (RFC 6486).
+ */
+
+typedef struct manifest_view {
+  der_view_t version;		/* data == NULL if absent */
+  der_view_t manifestNumber;	/* INTEGER contents */
+  der_view_t thisUpdate;	/* YYYYMMDDHHMMSSZ */
+  der_view_t nextUpdate;	/* YYYYMMDDHHMMSSZ */
+  der_view_t fileHashAlg;	/* OBJECT IDENTIFIER contents */
+  der_view_t fileList;		/* SEQUENCE OF contents */
+  size_t nfiles;
+} manifest_view_t;
+
+/*
+ * Pull the next FileAndHash from an iterator over fileList.
+ */
+static int manifest_view_next_file(der_view_t *iter,
+				   der_view_t *file,
+				   der_view_t *hash,
+				   unsigned *unused)
+{
+  der_view_t fah;
+
+  return (der_get(iter, DER_TAG_SEQUENCE, &fah) &&
+	  der_get_ia5string(&fah, file) &&
+	  der_get_bit_string(&fah, hash, unused) &&
+	  fah.len == 0);
+}
+
+/*
+ * Check the structure of a manifest and set up views of its fields.
+ */
+static int manifest_view_parse(manifest_view_t *m, const unsigned char *der, const size_t len)
+{
+  der_view_t v, seq, files, file, hash;
+  unsigned unused;
+
+  v.data = der;
+  v.len = len;
+
+  if (!der_get(&v, DER_TAG_SEQUENCE, &seq) || v.len != 0 ||
+      !der_get_default_version(&seq, &m->version) ||
+      !der_get_integer(&seq, &m->manifestNumber) ||
+      !der_get_generalizedtime(&seq, &m->thisUpdate) ||
+      !der_get_generalizedtime(&seq, &m->nextUpdate) ||
+      !der_get(&seq, DER_TAG_OBJECT, &m->fileHashAlg) ||
+      !der_get(&seq, DER_TAG_SEQUENCE, &m->fileList) ||
+      seq.len != 0)
+    return 0;
+
+  for (m->nfiles = 0, files = m->fileList; files.len > 0; m->nfiles++)
+    if (!manifest_view_next_file(&files, &file, &hash, &unused))
+      return 0;
+
+  return 1;
+}
+
+#endif /* __DER_VIEW_H__ */
@@ -0,0 +1,262 @@
+/*
+ * Copyright (C) 2015--2016  Parsons Government Services ("PARSONS")
+ * Portions copyright (C) 2013--2014  Dragon Research Labs ("DRL")
+ * Portions copyright (C) 2009--2013  Internet Systems Consortium ("ISC")
+ * Portions copyright (C) 2006--2008  American Registry for Internet Numbers ("ARIN")
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notices and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND PARSONS, DRL, ISC, AND ARIN
+ * DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS.  IN NO EVENT
+ * SHALL PARSONS, DRL, ISC, OR ARIN BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* $Id$ */
+
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#include <assert.h>
+#include <string.h>
+
+#include <openssl/x509.h>
+#include <openssl/x509v3.h>
+#include <openssl/cms.h>
+
+/*
+ * Low-level RPKI profile checks shared by rcynic and POW, so that the
+ * two validators agree on what they accept and do the same amount of
+ * work to decide it.  Reporting is left to the callers, since rcynic
+ * logs validation status codes and POW records them in a Python set.
+ *
+ * The per-object checks (check_crl(), check_cms(), check_manifest(),
+ * check_roa()) are not here.  rcynic's versions stop at the first
+ * problem, apply its allow-* policy options, compare times against
+ * its notion of "now", and choose between object generations; POW's
+ * versions record every problem and carry on.  They do share the
+ * pieces below, including the one pass over each extension list.
+ */
+
+/*
+ * Check whether a Distinguished Name conforms to the rescert profile.
+ * The profile is very restrictive: it only allows one mandatory
+ * CommonName field and one optional SerialNumber field, both of which
+ * must be of type PrintableString.
+ */
+
+static int check_allowed_dn(X509_NAME *dn)
+{
+  X509_NAME_ENTRY *ne;
+  ASN1_STRING *s;
+  int loc;
+
+  if (dn == NULL)
+    return 0;
+
+  switch (X509_NAME_entry_count(dn)) {
+
+  case 2:
+    if ((loc = X509_NAME_get_index_by_NID(dn, NID_serialNumber, -1)) < 0 ||
+	(ne = X509_NAME_get_entry(dn, loc)) == NULL ||
+	(s = X509_NAME_ENTRY_get_data(ne)) == NULL ||
+	ASN1_STRING_type(s) != V_ASN1_PRINTABLESTRING)
+      return 0;
+
+    /* Fall through */
+
+  case 1:
+    if ((loc = X509_NAME_get_index_by_NID(dn, NID_commonName, -1)) < 0 ||
+	(ne = X509_NAME_get_entry(dn, loc)) == NULL ||
+	(s = X509_NAME_ENTRY_get_data(ne)) == NULL ||
+	ASN1_STRING_type(s) != V_ASN1_PRINTABLESTRING)
+      return 0;
+
+    return 1;
+
+  default:
+    return 0;
+  }
+}
+
+/*
+ * Check whether an ASN.1 TIME value conforms to RFC 5280 4.1.2.5.
+ */
+
+static int check_allowed_time_encoding(ASN1_TIME *t)
+{
+  switch (t->type) {
+
+  case V_ASN1_UTCTIME:
+    return t->length == sizeof("yymmddHHMMSSZ") - 1;
+
+  case  V_ASN1_GENERALIZEDTIME:
+    return (t->length == sizeof("yyyymmddHHMMSSZ") - 1 &&
+	    strcmp("205", (char *) t->data) <= 0);
+
+  }
+  return 0;
+}
+
+/*
+ * Extract one datum from a CMS_SignerInfo.  Decrements *n if the
+ * attribute is present and well formed, sets it to -1 if it isn't.
+ */
+
+static void *extract_si_datum(CMS_SignerInfo *si,
+			      int *n,
+			      const int optional,
+			      const int nid,
+			      const int asn1_type)
+{
+  int i = CMS_signed_get_attr_by_NID(si, nid, -1);
+  void *result = NULL;
+  X509_ATTRIBUTE *a;
+
+  assert(si && n);
+
+  if (i < 0 && optional)
+    return NULL;
+
+  if (i >= 0 &&
+      CMS_signed_get_attr_by_NID(si, nid, i) < 0 &&
+      (a = CMS_signed_get_attr(si, i)) != NULL &&
+      X509_ATTRIBUTE_count(a) == 1 &&
+      (result = X509_ATTRIBUTE_get0_data(a, 0, asn1_type, NULL)) != NULL)
+    --*n;
+  else
+    *n = -1;
+
+  return result;
+}
+
+/*
+ * X.509v3 extensions the RPKI profiles know about.  Anything else is
+ * disallowed everywhere.
+ */
+
+#define RPKI_PROFILE_EXTENSIONS						\
+  QE(basic_constraints,		NID_basic_constraints)			\
+  QE(subject_key_identifier,	NID_subject_key_identifier)		\
+  QE(authority_key_identifier,	NID_authority_key_identifier)		\
+  QE(key_usage,			NID_key_usage)				\
+  QE(ext_key_usage,		NID_ext_key_usage)			\
+  QE(crl_distribution_points,	NID_crl_distribution_points)		\
+  QE(info_access,		NID_info_access)			\
+  QE(sinfo_access,		NID_sinfo_access)			\
+  QE(certificate_policies,	NID_certificate_policies)		\
+  QE(sbgp_ipAddrBlock,		NID_sbgp_ipAddrBlock)			\
+  QE(sbgp_autonomousSysNum,	NID_sbgp_autonomousSysNum)		\
+  QE(crl_number,		NID_crl_number)
+
+typedef enum {
+#define QE(name, nid) rpki_ext_##name,
+  RPKI_PROFILE_EXTENSIONS
+#undef QE
+  RPKI_EXT_MAX
+} rpki_ext_t;
+
+#define	RPKI_EXT_BIT(name)	(1U << rpki_ext_##name)
+
+/*
+ * Extensions allowed in each kind of object.  Resource certificates
+ * share one set, since whether a certificate is a CA depends on
+ * which extensions it has; the profile rules sort out which of these
+ * may appear together.
+ */
+
+#define	RPKI_EXTS_CERT							\
+  (RPKI_EXT_BIT(basic_constraints)		|			\
+   RPKI_EXT_BIT(subject_key_identifier)	|			\
+   RPKI_EXT_BIT(authority_key_identifier)	|			\
+   RPKI_EXT_BIT(key_usage)			|			\
+   RPKI_EXT_BIT(ext_key_usage)			|			\
+   RPKI_EXT_BIT(crl_distribution_points)	|			\
+   RPKI_EXT_BIT(info_access)			|			\
+   RPKI_EXT_BIT(sinfo_access)			|			\
+   RPKI_EXT_BIT(certificate_policies)		|			\
+   RPKI_EXT_BIT(sbgp_ipAddrBlock)		|			\
+   RPKI_EXT_BIT(sbgp_autonomousSysNum))
+
+#define	RPKI_EXTS_CRL							\
+  (RPKI_EXT_BIT(authority_key_identifier)	|			\
+   RPKI_EXT_BIT(crl_number))
+
+/*
+ * Result of one pass over an object's extensions.  present and
+ * critical are bitmaps indexed by rpki_ext_t, ext[] holds the first
+ * instance of each extension we know about, and disallowed counts
+ * everything else: unknown extensions, extensions not allowed in
+ * this kind of object, and repeats, which RFC 5280 forbids.
+ */
+
+typedef struct rpki_extensions {
+  unsigned present, critical, disallowed;
+  X509_EXTENSION *ext[RPKI_EXT_MAX];
+} rpki_extensions_t;
+
+/*
+ * Scan an extension list once, dispatching on NID.
+ */
+
+static void rpki_extensions_scan(const STACK_OF(X509_EXTENSION) *exts,
+				 const unsigned allowed,
+				 rpki_extensions_t *e)
+{
+  X509_EXTENSION *ext;
+  rpki_ext_t which;
+  int i;
+
+  memset(e, 0, sizeof(*e));
+
+  for (i = 0; i < X509v3_get_ext_count(exts); i++) {
+    ext = X509v3_get_ext(exts, i);
+
+    switch (OBJ_obj2nid(X509_EXTENSION_get_object(ext))) {
+#define QE(name, nid) case nid: which = rpki_ext_##name; break;
+      RPKI_PROFILE_EXTENSIONS
+#undef QE
+    default:
+      e->disallowed++;
+      continue;
+    }
+
+    if ((allowed & (1U << which)) == 0 || (e->present & (1U << which)) != 0) {
+      e->disallowed++;
+      continue;
+    }
+
+    e->present |= 1U << which;
+    if (X509_EXTENSION_get_critical(ext))
+      e->critical |= 1U << which;
+    e->ext[which] = ext;
+  }
+}
+
+/*
+ * Decode an extension found by rpki_extensions_scan(), returning NULL
+ * if it wasn't there or won't decode.  An extension that won't decode
+ * counts as disallowed.  Caller frees the result, as with
+ * X509_get_ext_d2i().
+ */
+
+static void *rpki_extension_d2i(rpki_extensions_t *e, const rpki_ext_t which)
+{
+  void *result;
+
+  if (e->ext[which] == NULL)
+    return NULL;
+
+  if ((result = X509V3_EXT_d2i(e->ext[which])) == NULL)
+    e->disallowed++;
+
+  return result;
+}
+
+#endif /* __PROFILE_H__ */
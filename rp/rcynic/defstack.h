@@ -107,28 +107,28 @@
 #define sk_rsync_history_t_is_sorted(st)               SKM_sk_is_sorted(rsync_history_t, (st))
 
 /*
- * Safestack macros for task_t.
+ * Safestack macros for host_health_t.
  */
-#define sk_task_t_new(st)                     SKM_sk_new(task_t, (st))
-#define sk_task_t_new_null()                  SKM_sk_new_null(task_t)
-#define sk_task_t_free(st)                    SKM_sk_free(task_t, (st))
-#define sk_task_t_num(st)                     SKM_sk_num(task_t, (st))
-#define sk_task_t_value(st, i)                SKM_sk_value(task_t, (st), (i))
-#define sk_task_t_set(st, i, val)             SKM_sk_set(task_t, (st), (i), (val))
-#define sk_task_t_zero(st)                    SKM_sk_zero(task_t, (st))
-#define sk_task_t_push(st, val)               SKM_sk_push(task_t, (st), (val))
-#define sk_task_t_unshift(st, val)            SKM_sk_unshift(task_t, (st), (val))
-#define sk_task_t_find(st, val)               SKM_sk_find(task_t, (st), (val))
-#define sk_task_t_find_ex(st, val)            SKM_sk_find_ex(task_t, (st), (val))
-#define sk_task_t_delete(st, i)               SKM_sk_delete(task_t, (st), (i))
-#define sk_task_t_delete_ptr(st, ptr)         SKM_sk_delete_ptr(task_t, (st), (ptr))
-#define sk_task_t_insert(st, val, i)          SKM_sk_insert(task_t, (st), (val), (i))
-#define sk_task_t_set_cmp_func(st, cmp)       SKM_sk_set_cmp_func(task_t, (st), (cmp))
-#define sk_task_t_dup(st)                     SKM_sk_dup(task_t, st)
-#define sk_task_t_pop_free(st, free_func)     SKM_sk_pop_free(task_t, (st), (free_func))
-#define sk_task_t_shift(st)                   SKM_sk_shift(task_t, (st))
-#define sk_task_t_pop(st)                     SKM_sk_pop(task_t, (st))
-#define sk_task_t_sort(st)                    SKM_sk_sort(task_t, (st))
-#define sk_task_t_is_sorted(st)               SKM_sk_is_sorted(task_t, (st))
+#define sk_host_health_t_new(st)                     SKM_sk_new(host_health_t, (st))
+#define sk_host_health_t_new_null()                  SKM_sk_new_null(host_health_t)
+#define sk_host_health_t_free(st)                    SKM_sk_free(host_health_t, (st))
+#define sk_host_health_t_num(st)                     SKM_sk_num(host_health_t, (st))
+#define sk_host_health_t_value(st, i)                SKM_sk_value(host_health_t, (st), (i))
+#define sk_host_health_t_set(st, i, val)             SKM_sk_set(host_health_t, (st), (i), (val))
+#define sk_host_health_t_zero(st)                    SKM_sk_zero(host_health_t, (st))
+#define sk_host_health_t_push(st, val)               SKM_sk_push(host_health_t, (st), (val))
+#define sk_host_health_t_unshift(st, val)            SKM_sk_unshift(host_health_t, (st), (val))
+#define sk_host_health_t_find(st, val)               SKM_sk_find(host_health_t, (st), (val))
+#define sk_host_health_t_find_ex(st, val)            SKM_sk_find_ex(host_health_t, (st), (val))
+#define sk_host_health_t_delete(st, i)               SKM_sk_delete(host_health_t, (st), (i))
+#define sk_host_health_t_delete_ptr(st, ptr)         SKM_sk_delete_ptr(host_health_t, (st), (ptr))
+#define sk_host_health_t_insert(st, val, i)          SKM_sk_insert(host_health_t, (st), (val), (i))
+#define sk_host_health_t_set_cmp_func(st, cmp)       SKM_sk_set_cmp_func(host_health_t, (st), (cmp))
+#define sk_host_health_t_dup(st)                     SKM_sk_dup(host_health_t, st)
+#define sk_host_health_t_pop_free(st, free_func)     SKM_sk_pop_free(host_health_t, (st), (free_func))
+#define sk_host_health_t_shift(st)                   SKM_sk_shift(host_health_t, (st))
+#define sk_host_health_t_pop(st)                     SKM_sk_pop(host_health_t, (st))
+#define sk_host_health_t_sort(st)                    SKM_sk_sort(host_health_t, (st))
+#define sk_host_health_t_is_sorted(st)               SKM_sk_is_sorted(host_health_t, (st))
 
 #endif /* __RCYNIC_C__DEFSTACK_H__ */
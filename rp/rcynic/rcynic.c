@@ -31,6 +31,7 @@
  */
 
 #include <assert.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
@@ -38,6 +39,7 @@
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/file.h>
+#include <sys/mman.h>
 #include <errno.h>
 #include <sys/signal.h>
 #include <sys/wait.h>
@@ -67,10 +69,11 @@
 #include <openssl/asn1t.h>
 #include <openssl/cms.h>
 
-#include <rpki/roa.h>
-#include <rpki/manifest.h>
+#include <rpki/der_view.h>
+#include <rpki/profile.h>
 
 #include "bio_f_linebreak.h"
+#include "sha256_mb.h"
 
 #include "defstack.h"
 
@@ -104,6 +107,69 @@
  */
 #define	KILL_MAX	10
 
+/**
+ * Initial size of the task queue.  It grows as needed.
+ */
+#define	TASK_QUEUE_INITIAL_SIZE	1024
+
+/**
+ * Initial number of buckets in the rsync_history index.  Must be a
+ * power of two.  It grows as needed.
+ */
+#define	RSYNC_HISTORY_INDEX_INITIAL_SIZE 1024
+
+/**
+ * Number of URIs the fetch table shared by worker processes can
+ * remember having been fetched.  Past this, workers may fetch the
+ * same thing twice, but still never at the same time.
+ */
+#define	FETCH_TABLE_SEEN_MAX	65536
+
+/**
+ * Number of recent fetch durations we remember per repository host,
+ * and how many we need before we trust them enough to shorten the
+ * rsync timeout.
+ */
+#define	HOST_LATENCY_SAMPLES	16
+#define	HOST_LATENCY_MIN_SAMPLES 4
+
+/**
+ * Largest object the batch hashing stage will read into memory.
+ * Anything bigger is left for the walk to read and hash on its own,
+ * so one batch of hostile files can't pin down unbounded memory.
+ */
+#define	PRELOAD_MAX_OBJECT_SIZE	(256 * 1024)
+
+/**
+ * Adaptive rsync timeout is this multiple of a host's 95th percentile
+ * fetch time, but never less than HOST_TIMEOUT_FLOOR seconds.
+ */
+#define	HOST_TIMEOUT_FACTOR	4
+#define	HOST_TIMEOUT_FLOOR	60
+
+/**
+ * Upper limit on how long we back off from a dead repository host.
+ */
+#define	HOST_BACKOFF_MAX	(24 * 60 * 60)
+
+/**
+ * Fetch history carried forward from earlier runs is forgotten once
+ * it is this many host-retry-intervals old (but never sooner than
+ * HOST_BACKOFF_MAX), so that publication points which have gone away
+ * don't stay in the host database forever.
+ */
+#define	HOST_HISTORY_HORIZON	7
+
+/**
+ * Version number of host database file format.
+ */
+#define	HOST_DATABASE_VERSION	1
+
+/**
+ * Version number of checkpoint journal file format.
+ */
+#define	JOURNAL_VERSION		2
+
 /**
  * Version number of XML summary output.
  */
@@ -217,6 +283,7 @@ static const struct {
   QB(bad_manifest_digest_length,	"Bad manifest digest length")	    \
   QB(bad_public_key,			"Bad public key")		    \
   QB(bad_roa_asID,			"Bad ROA asID")			    \
+  QB(bad_roa_ipAddrBlocks,		"Bad ROA ipAddrBlocks")		    \
   QB(bad_certificate_serial_number,	"Bad certificate serialNumber")	    \
   QB(bad_manifest_number,		"Bad manifestNumber")		    \
   QB(certificate_bad_signature,		"Bad certificate signature")	    \
@@ -411,7 +478,8 @@ DECLARE_STACK_OF(validation_status_t)
  * Structure to hold data parsed out of a certificate.
  */
 typedef struct certinfo {
-  int ca, ta;
+  int ca, ta, unchanged;
+  int64_t notBefore, notAfter;
   object_generation_t generation;
   uri_t uri, sia, aia, crldp, manifest, signedobject, rrdpnotify;
 } certinfo_t;
@@ -430,6 +498,31 @@ typedef enum {
   walk_state_done		/**< Done walking this cert's outputs */
 } walk_state_t;
 
+/**
+ * A manifest we've accepted.  The view points into the eContent of
+ * the CMS object, which we keep for as long as we keep the view.
+ */
+typedef struct manifest {
+  manifest_view_t view;
+  CMS_ContentInfo *cms;
+  int64_t thisUpdate, nextUpdate;
+} manifest_t;
+
+/**
+ * An object which the batch hashing stage has already read and
+ * hashed.  data is NULL if the file wasn't there or isn't something
+ * the walk will parse.  object is the decoded object, if the batch
+ * signature stage decoded it; it belongs to whoever reads it first.
+ */
+typedef struct preload {
+  path_t path;
+  unsigned char *data;
+  size_t len;
+  hashbuf_t hash;
+  const ASN1_ITEM *it;
+  ASN1_VALUE *object;
+} preload_t;
+
 /**
  * Context for certificate tree walks.  This includes all the stuff
  * that we would keep as automatic variables on the call stack if we
@@ -439,12 +532,16 @@ typedef struct walk_ctx {
   unsigned refcount;
   certinfo_t certinfo;
   X509 *cert;
-  Manifest *manifest;
+  manifest_t *manifest;
+  der_view_t manifest_files;
+  preload_t *preload;
+  int preload_start, preload_count;
   object_generation_t manifest_generation;
   STACK_OF(OPENSSL_STRING) *filenames;
   int manifest_iteration, filename_iteration, stale_manifest;
   walk_state_t state;
   uri_t crldp;
+  int64_t crl_nextUpdate;
   STACK_OF(X509) *certs;
   STACK_OF(X509_CRL) *crls;
 } walk_ctx_t;
@@ -495,9 +592,10 @@ typedef struct rsync_ctx {
   unsigned tries;
   pid_t pid;
   int fd;
-  time_t started, deadline;
+  time_t started, launched, deadline, expected;
   char buffer[URI_MAX * 4];
   size_t buflen;
+  STACK_OF(OPENSSL_STRING) *changes;
 } rsync_ctx_t;
 
 DECLARE_STACK_OF(rsync_ctx_t)
@@ -510,19 +608,101 @@ typedef struct rsync_history {
   time_t started, finished;
   rsync_status_t status;
   int final_slash;
+  STACK_OF(OPENSSL_STRING) *changes; /* NULL if we don't know */
+  unsigned hash;			/* For rsync_history_index_t */
+  size_t len;
+  struct rsync_history *next;
 } rsync_history_t;
 
 DECLARE_STACK_OF(rsync_history_t)
 
 /**
- * Deferred task.
+ * Hash index over rsync_history, so that we can check a URI and all
+ * of its ancestors in one pass over the URI instead of one binary
+ * search per path component.  The stack itself still owns the
+ * entries and still supplies the sorted order for output.
+ */
+typedef struct rsync_history_index {
+  rsync_history_t **buckets;
+  unsigned size, count;
+} rsync_history_index_t;
+
+/**
+ * Fetches running in, or already attempted by, any of the worker
+ * processes run_workers() starts.  This lives in shared memory, under
+ * an fcntl() lock, so that workers whose trust anchors share a
+ * publication point neither rsync into the same part of the
+ * unauthenticated tree at once nor fetch it twice.  running[] has one
+ * slot per parallel fetch across all workers; seen[] is an
+ * open-addressed set of 64-bit FNV-1a hashes of the URIs recorded in
+ * each worker's rsync_history.
+ */
+typedef struct fetch_table {
+  uint64_t seen[FETCH_TABLE_SEEN_MAX];
+  unsigned nseen, nrunning;
+  struct {
+    pid_t pid;			/* Zero if slot is free */
+    uri_t uri;
+  } running[1];			/* Really nrunning */
+} fetch_table_t;
+
+/**
+ * Cache of issuer public keys, keyed by the SHA-256 digest of the
+ * subjectPublicKey, so that every certificate carrying a given key
+ * shares one decoded EVP_PKEY with its Montgomery context already
+ * set up.  Direct-mapped, so it never grows: a collision just evicts
+ * the older key.  Since entries are keyed by the key itself, they
+ * can't go stale, so the cache lives as long as the process does and
+ * carries over from one daemon cycle to the next.
+ */
+typedef struct key_cache_entry {
+  unsigned char hash[SHA256_DIGEST_LENGTH];
+  EVP_PKEY *pkey;
+} key_cache_entry_t;
+
+typedef struct key_cache {
+  key_cache_entry_t *entries;
+  unsigned size;
+} key_cache_t;
+
+/**
+ * Per-host fetch statistics, carried across runs in the host database,
+ * plus per-run scheduling state which is not saved.
+ * hostname must be first element.
+ */
+typedef struct host_health {
+  char hostname[HOSTNAME_MAX];
+  unsigned fetches, failures, timeouts, refusals, streak;
+  time_t last_attempt, last_success;
+  unsigned durations[HOST_LATENCY_SAMPLES];
+  unsigned nduration;
+  unsigned nsamples;		/* Durations added, ever, for merging */
+  unsigned limit;		/* Learned from refusals, zero if none */
+  unsigned failed;		/* Streak already bumped this run */
+} host_health_t;
+
+DECLARE_STACK_OF(host_health_t)
+
+/**
+ * Deferred task.  These live inline in the task queue's ring buffer
+ * rather than being allocated one at a time.
  */
 typedef struct task {
   void (*handler)(rcynic_ctx_t *, void *);
   void *cookie;
+  struct timeval queued;
 } task_t;
 
-DECLARE_STACK_OF(task_t)
+/**
+ * Queue of deferred tasks: a ring buffer which doubles in size when
+ * it fills, plus some statistics for telemetry.
+ */
+typedef struct task_queue {
+  task_t *ring;
+  unsigned size, head, count, max_count;
+  unsigned long ran;
+  double total_wait, max_wait;
+} task_queue_t;
 
 /**
  * Trust anchor locator (TAL) fetch context.
@@ -552,20 +732,30 @@ typedef struct rcynic_x509_store_ctx {
  */
 struct rcynic_ctx {
   path_t authenticated, old_authenticated, new_authenticated, unauthenticated;
-  char *jane, *rsync_program;
+  char *jane, *rsync_program, *host_database, *journal_file;
+  FILE *journal;
   STACK_OF(validation_status_t) *validation_status;
-  STACK_OF(rsync_history_t) *rsync_history;
+  STACK_OF(rsync_history_t) *rsync_history, *previous_rsync_history;
+  rsync_history_index_t *rsync_history_index;
+  STACK_OF(host_health_t) *host_health;
   STACK_OF(rsync_ctx_t) *rsync_queue;
-  STACK_OF(task_t) *task_queue;
+  task_queue_t *task_queue;
   int use_syslog, allow_stale_crl, allow_stale_manifest, use_links;
   int require_crl_in_manifest, rsync_timeout, priority[LOG_LEVEL_T_MAX];
   int allow_non_self_signed_trust_anchor, allow_object_not_in_manifest;
-  int max_parallel_fetches, max_retries, retry_wait_min, run_rsync;
+  int max_parallel_fetches, max_fetches_per_host, max_retries, retry_wait_min, run_rsync;
   int allow_digest_mismatch, allow_crl_digest_mismatch;
   int allow_nonconformant_name, allow_ee_without_signedObject;
-  int allow_1024_bit_ee_key, allow_wrong_cms_si_attributes;
-  int rsync_early;
+  int allow_1024_bit_ee_key, allow_wrong_cms_si_attributes, reuse_unchanged;
+  int rsync_early, rsync_prefetch, host_failure_threshold, host_retry_interval;
+  int ta_workers, ta_shard, ta_shards, ta_count, hash_batch_size;
+  int presigned_index, key_cache_size, journal_max_age;
+  int64_t now, now_override;
+  key_cache_t *key_cache;
   unsigned max_select_time;
+  int sigchld_fds[2];
+  fetch_table_t *fetch_table;
+  int fetch_table_lock;
   validation_status_t *validation_status_in_waiting;
   validation_status_t *validation_status_root;
   log_level_t log_level;
@@ -690,7 +880,7 @@ static const char authenticated_symlink_suffix[] = ".new";
  * new OIDs (with or without the names we would have used).
  */
 
-static const ASN1_INTEGER *asn1_zero, *asn1_four_octets, *asn1_twenty_octets;
+static const ASN1_INTEGER *asn1_zero, *asn1_twenty_octets;
 static int NID_binary_signing_time;
 
 
@@ -773,8 +963,10 @@ static rsync_history_t *rsync_history_t_new(void)
  */
 static void rsync_history_t_free(rsync_history_t *h)
 {
-  if (h)
+  if (h) {
+    sk_OPENSSL_STRING_pop_free(h->changes, OPENSSL_STRING_free);
     free(h);
+  }
 }
 
 /**
@@ -785,6 +977,36 @@ static int rsync_history_cmp(const rsync_history_t * const *a, const rsync_histo
   return strcmp((*a)->uri.s, (*b)->uri.s);
 }
 
+
+
+/**
+ * Allocate a new host_health_t object.
+ */
+static host_health_t *host_health_t_new(void)
+{
+  host_health_t *h = malloc(sizeof(*h));
+  if (h)
+    memset(h, 0, sizeof(*h));
+  return h;
+}
+
+/**
+ * Type-safe wrapper around free() to keep safestack macros happy.
+ */
+static void host_health_t_free(host_health_t *h)
+{
+  if (h)
+    free(h);
+}
+
+/**
+ * Compare two host_health_t objects.
+ */
+static int host_health_cmp(const host_health_t * const *a, const host_health_t * const *b)
+{
+  return strcmp((*a)->hostname, (*b)->hostname);
+}
+
 
 
 /**
@@ -1110,11 +1332,126 @@ static int uri_to_filename(const rcynic_ctx_t *rc,
 }
 
 /**
- * Compare filename fields of two FileAndHash structures.
+ * Compare two manifest filenames, qsort() style.  Arguments are
+ * pointers to der_view_t.
+ */
+static int manifest_filename_cmp(const void *a, const void *b)
+{
+  const der_view_t *v1 = a, *v2 = b;
+  int cmp = memcmp(v1->data, v2->data, v1->len < v2->len ? v1->len : v2->len);
+
+  if (cmp == 0 && v1->len != v2->len)
+    cmp = v1->len < v2->len ? -1 : 1;
+  return cmp;
+}
+
+/**
+ * Convert a UTCTime ("yymmddHHMMSSZ") or GeneralizedTime
+ * ("yyyymmddHHMMSSZ") string to seconds since the epoch.  These are
+ * the only encodings RFC 5280 allows, so we don't bother with
+ * fractional seconds or time zone offsets.  Returns 1 on success, 0
+ * if the string is malformed.
+ */
+static int time_string_to_epoch(const unsigned char *s, const size_t len, int64_t *result)
+{
+  static const int mdays[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+  int64_t year, mon, mday, hour, min, sec, y, era, yoe, doy, doe;
+  size_t i, o;
+  int leap;
+
+  assert(s && result);
+
+  if ((len != sizeof("yymmddHHMMSSZ") - 1 && len != sizeof("yyyymmddHHMMSSZ") - 1) || s[len - 1] != 'Z')
+    return 0;
+
+  for (i = 0; i < len - 1; i++)
+    if (s[i] < '0' || s[i] > '9')
+      return 0;
+
+#define D2(_i_) ((int64_t) (s[_i_] - '0') * 10 + (s[(_i_) + 1] - '0'))
+
+  if (len == sizeof("yymmddHHMMSSZ") - 1) {
+    year = D2(0);
+    year += year < 50 ? 2000 : 1900;
+    o = 2;
+  } else {
+    year = D2(0) * 100 + D2(2);
+    o = 4;
+  }
+
+  mon  = D2(o);
+  mday = D2(o + 2);
+  hour = D2(o + 4);
+  min  = D2(o + 6);
+  sec  = D2(o + 8);
+
+#undef D2
+
+  leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+
+  if (mon < 1 || mon > 12 || mday < 1 || mday > mdays[mon - 1] + (mon == 2 && leap) ||
+      hour > 23 || min > 59 || sec > 59)
+    return 0;
+
+  /*
+   * Days since 1970-01-01 in the proleptic Gregorian calendar,
+   * counting years from March so that leap days come last.
+   */
+  y = year - (mon <= 2);
+  era = (y >= 0 ? y : y - 399) / 400;
+  yoe = y - era * 400;
+  doy = (153 * (mon > 2 ? mon - 3 : mon + 9) + 2) / 5 + mday - 1;
+  doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+  *result = (era * 146097 + doe - 719468) * 86400 + hour * 3600 + min * 60 + sec;
+  return 1;
+}
+
+/**
+ * Convert an ASN1_TIME to seconds since the epoch.
+ */
+static int asn1_time_to_epoch(const ASN1_TIME *t, int64_t *result)
+{
+  return (t != NULL && t->data != NULL && t->length > 0 &&
+	  ((t->type == V_ASN1_UTCTIME         && t->length == sizeof("yymmddHHMMSSZ") - 1) ||
+	   (t->type == V_ASN1_GENERALIZEDTIME && t->length == sizeof("yyyymmddHHMMSSZ") - 1)) &&
+	  time_string_to_epoch(t->data, t->length, result));
+}
+
+/**
+ * Convert a GeneralizedTime from a DER view to seconds since the epoch.
+ */
+static int der_time_to_epoch(const der_view_t *t, int64_t *result)
+{
+  assert(t && t->data && t->len == DER_GENERALIZEDTIME_LEN);
+  return time_string_to_epoch(t->data, t->len, result);
+}
+
+/**
+ * Configure the time we validate against, for replaying old data or
+ * for repeatable benchmarks.  Accepts either seconds since the epoch
+ * or a GeneralizedTime string.
  */
-static int FileAndHash_name_cmp(const FileAndHash * const *a, const FileAndHash * const *b)
+static int configure_now(rcynic_ctx_t *rc, const char *val)
 {
-  return strcmp((char *) (*a)->file->data, (char *) (*b)->file->data);
+  long long res;
+  char *p;
+
+  assert(rc && val);
+
+  res = strtoll(val, &p, 10);
+
+  if (*val != '\0' && *p == '\0' && res > 0) {
+    rc->now_override = res;
+    return 1;
+  }
+
+  if (time_string_to_epoch((const unsigned char *) val, strlen(val), &rc->now_override) &&
+      rc->now_override > 0)
+    return 1;
+
+  logmsg(rc, log_usage_err, "Bad time value %s", val);
+  return 0;
 }
 
 /**
@@ -1343,28 +1680,22 @@ validation_status_sprout(validation_status_t **node,
 }
 
 /**
- * Add a validation status entry to internal log.
+ * Find or create the validation status entry for a particular URI and
+ * generation.
  */
-static void log_validation_status(rcynic_ctx_t *rc,
-				  const uri_t *uri,
-				  const mib_counter_t code,
-				  const object_generation_t generation)
+static validation_status_t *validation_status_intern(rcynic_ctx_t *rc,
+						     const uri_t *uri,
+						     const object_generation_t generation)
 {
   validation_status_t *v = NULL;
   int needs_balancing = 0;
 
-  assert(rc && uri && code < MIB_COUNTER_T_MAX && generation < OBJECT_GENERATION_MAX);
-
-  if (!rc->validation_status)
-    return;
-
-  if (code == rsync_transfer_skipped && !rc->run_rsync)
-    return;
+  assert(rc && rc->validation_status && uri && generation < OBJECT_GENERATION_MAX);
 
   if (rc->validation_status_in_waiting == NULL &&
       (rc->validation_status_in_waiting = validation_status_t_new()) == NULL) {
     logmsg(rc, log_sys_err, "Couldn't allocate validation status entry for %s", uri->s);
-    return;
+    return NULL;
   }
 
   v = rc->validation_status_in_waiting;
@@ -1379,9 +1710,33 @@ static void log_validation_status(rcynic_ctx_t *rc,
   if (rc->validation_status_in_waiting == NULL &&
       !sk_validation_status_t_push(rc->validation_status, v)) {
     logmsg(rc, log_sys_err, "Couldn't store validation status entry for %s", uri->s);
-    return;
+    return NULL;
   }
 
+  return v;
+}
+
+/**
+ * Add a validation status entry to internal log.
+ */
+static void log_validation_status(rcynic_ctx_t *rc,
+				  const uri_t *uri,
+				  const mib_counter_t code,
+				  const object_generation_t generation)
+{
+  validation_status_t *v;
+
+  assert(rc && uri && code < MIB_COUNTER_T_MAX && generation < OBJECT_GENERATION_MAX);
+
+  if (!rc->validation_status)
+    return;
+
+  if (code == rsync_transfer_skipped && !rc->run_rsync)
+    return;
+
+  if ((v = validation_status_intern(rc, uri, generation)) == NULL)
+    return;
+
   v->timestamp = time(0);
 
   if (validation_status_get_code(v, code))
@@ -1900,6 +2255,37 @@ static STACK_OF(OPENSSL_STRING) *directory_filenames(const rcynic_ctx_t *rc,
 
 
 
+/**
+ * Free a manifest and the CMS object its view points into.
+ */
+static void manifest_free(manifest_t *manifest)
+{
+  if (manifest != NULL) {
+    CMS_ContentInfo_free(manifest->cms);
+    free(manifest);
+  }
+}
+
+/**
+ * Discard whatever the batch hashing stage read for a walk context.
+ */
+static void walk_ctx_preload_clear(walk_ctx_t *w)
+{
+  int i;
+
+  assert(w);
+
+  for (i = 0; i < w->preload_count; i++) {
+    free(w->preload[i].data);
+    if (w->preload[i].object != NULL)
+      ASN1_item_free(w->preload[i].object, w->preload[i].it);
+  }
+  free(w->preload);
+  w->preload = NULL;
+  w->preload_start = 0;
+  w->preload_count = 0;
+}
+
 /**
  * Increment walk context reference count.
  */
@@ -1920,7 +2306,8 @@ static void walk_ctx_detach(walk_ctx_t *w)
   if (w != NULL && --(w->refcount) == 0) {
     assert(w->refcount == 0);
     X509_free(w->cert);
-    Manifest_free(w->manifest);
+    manifest_free(w->manifest);
+    walk_ctx_preload_clear(w);
     sk_X509_free(w->certs);
     sk_X509_CRL_pop_free(w->crls, X509_CRL_free);
     sk_OPENSSL_STRING_pop_free(w->filenames, OPENSSL_STRING_free);
@@ -1948,92 +2335,507 @@ static int walk_ctx_loop_done(STACK_OF(walk_ctx_t) *wsk)
 }
 
 /**
- * Walk context iterator.  Think of this as the thing you call in the
- * third clause of a conceptual "for" loop: this reinitializes as
- * necessary for the next pass through the loop.
- *
- * General idea here is that we have several state variables in a walk
- * context which collectively define the current pass, product URI,
- * etc, and we want to be able to iterate through this sequence via
- * the event system.  So this function steps to the next state.
- *
- * Conceptually, w->manifest->fileList and w->filenames form a single
- * array with index w->manifest_iteration + w->filename_iteration.
- * Beware of fencepost errors, I've gotten this wrong once already.
- * Slightly odd coding here is to make it easier to check this.
+ * Point walk context's manifest cursor back at the first entry.
  */
-static void walk_ctx_loop_next(const rcynic_ctx_t *rc, STACK_OF(walk_ctx_t) *wsk)
+static void walk_ctx_manifest_rewind(walk_ctx_t *w)
 {
-  walk_ctx_t *w = walk_ctx_stack_head(wsk);
-  int n_manifest, n_filenames;
+  assert(w);
+  walk_ctx_preload_clear(w);
+  w->manifest_iteration = 0;
+  if (w->manifest != NULL) {
+    w->manifest_files = w->manifest->view.fileList;
+  } else {
+    w->manifest_files.data = NULL;
+    w->manifest_files.len = 0;
+  }
+}
 
-  assert(rc && wsk && w);
+/**
+ * Construct the URI of a manifest entry or directory listing entry.
+ */
+static int walk_ctx_entry_uri(const rcynic_ctx_t *rc,
+			      const walk_ctx_t *w,
+			      const char *name,
+			      const size_t namelen,
+			      uri_t *uri)
+{
+  size_t sialen = strlen(w->certinfo.sia.s);
 
-  assert(w->manifest_iteration >= 0 && w->filename_iteration >= 0);
+  if (sialen + namelen >= sizeof(uri->s)) {
+    logmsg(rc, log_data_err, "URI %s%.*s too long, skipping", w->certinfo.sia.s, (int) namelen, name);
+    return 0;
+  }
 
-  n_manifest  = w->manifest  ? sk_FileAndHash_num(w->manifest->fileList) : 0;
-  n_filenames = w->filenames ? sk_OPENSSL_STRING_num(w->filenames)       : 0;
+  memcpy(uri->s, w->certinfo.sia.s, sialen);
+  memcpy(uri->s + sialen, name, namelen);
+  uri->s[sialen + namelen] = '\0';
+  return 1;
+}
 
-  if (w->manifest_iteration + w->filename_iteration < n_manifest + n_filenames) {
-    if (w->manifest_iteration < n_manifest)
-      w->manifest_iteration++;
-    else
-      w->filename_iteration++;
-  }
+/**
+ * Read a whole file into memory, provided it's no larger than max_len.
+ */
+static int read_whole_file(const path_t *path,
+			   unsigned char **data,
+			   size_t *len,
+			   const size_t max_len)
+{
+  unsigned char *buf = NULL;
+  struct stat st;
+  size_t n = 0;
+  ssize_t r;
+  int fd;
 
-  assert(w->manifest_iteration <= n_manifest && w->filename_iteration <= n_filenames);
+  if ((fd = open(path->s, O_RDONLY)) < 0)
+    return 0;
 
-  if (w->manifest_iteration + w->filename_iteration < n_manifest + n_filenames)
-    return;
+  if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) ||
+      (uintmax_t) st.st_size > max_len ||
+      (buf = malloc(st.st_size > 0 ? st.st_size : 1)) == NULL)
+    goto error;
 
-  while (!walk_ctx_loop_done(wsk)) {
-    w->state++;
-    w->manifest_iteration = 0;
-    w->filename_iteration = 0;
-    sk_OPENSSL_STRING_pop_free(w->filenames, OPENSSL_STRING_free);
-    w->filenames = directory_filenames(rc, w->state, &w->certinfo.sia);
-    if (w->manifest != NULL || w->filenames != NULL)
-      return;
+  while (n < (size_t) st.st_size) {
+    if ((r = read(fd, buf + n, st.st_size - n)) < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      goto error;
+    n += r;
   }
-}
 
-static int check_manifest(rcynic_ctx_t *rc, STACK_OF(walk_ctx_t) *wsk);
+  close(fd);
+  *data = buf;
+  *len = n;
+  return 1;
+
+ error:
+  close(fd);
+  free(buf);
+  return 0;
+}
 
 /**
- * Loop initializer for walk context.  Think of this as the thing you
- * call in the first clause of a conceptual "for" loop.
+ * Test whether two files have identical contents.
  */
-static void walk_ctx_loop_init(rcynic_ctx_t *rc, STACK_OF(walk_ctx_t) *wsk)
+static int files_identical(const path_t *a, const path_t *b)
 {
-  walk_ctx_t *w = walk_ctx_stack_head(wsk);
+  char buf_a[4096], buf_b[4096];
+  FILE *f_a = NULL, *f_b = NULL;
+  struct stat st_a, st_b;
+  size_t n_a, n_b;
+  int ret = 0;
 
-  assert(rc && wsk && w && w->state == walk_state_ready);
+  assert(a && b);
 
-  if (!w->manifest && !check_manifest(rc, wsk)) {
-    /*
-     * Simple failure to find a manifest doesn't get here.  This is
-     * for manifest failures that cause us to reject all of this
-     * certificate's products due to policy knob settings.
-     */
-    w->state = walk_state_done;
-    return;
-  }
+  if (stat(a->s, &st_a) < 0 || stat(b->s, &st_b) < 0 ||
+      st_a.st_size != st_b.st_size)
+    return 0;
 
-  if (!w->manifest)
-    logmsg(rc, log_telemetry, "Couldn't get manifest %s, blundering onward", w->certinfo.manifest.s);
+  if (st_a.st_dev == st_b.st_dev && st_a.st_ino == st_b.st_ino)
+    return 1;
 
-  w->manifest_iteration = 0;
-  w->filename_iteration = 0;
+  if ((f_a = fopen(a->s, "rb")) == NULL || (f_b = fopen(b->s, "rb")) == NULL)
+    goto done;
+
+  do {
+    n_a = fread(buf_a, 1, sizeof(buf_a), f_a);
+    n_b = fread(buf_b, 1, sizeof(buf_b), f_b);
+    if (n_a != n_b || memcmp(buf_a, buf_b, n_a))
+      goto done;
+  } while (n_a > 0);
+
+  ret = !ferror(f_a) && !ferror(f_b);
+
+ done:
+  if (f_a)
+    (void) fclose(f_a);
+  if (f_b)
+    (void) fclose(f_b);
+  return ret;
+}
+
+/**
+ * Check whether the current and backup generations of an object are
+ * byte-for-byte identical.  If so, checking both would just repeat
+ * the same signature verifications with the same result, so callers
+ * check only the current generation.
+ */
+static int same_object_generations(const rcynic_ctx_t *rc,
+				   const uri_t *uri)
+{
+  path_t new_path, old_path;
+
+  assert(rc && uri);
+
+  if (!uri_to_filename(rc, uri, &new_path, &rc->unauthenticated) ||
+      !uri_to_filename(rc, uri, &old_path, &rc->old_authenticated) ||
+      !files_identical(&new_path, &old_path))
+    return 0;
+
+  logmsg(rc, log_telemetry, "Backup of %s is identical to current, not checking it again", uri->s);
+  return 1;
+}
+
+/**
+ * Allocate an issuer key cache.
+ */
+static key_cache_t *key_cache_new(const unsigned size)
+{
+  key_cache_t *kc = malloc(sizeof(*kc));
+
+  assert(size > 0);
+
+  if (kc == NULL)
+    return NULL;
+
+  if ((kc->entries = calloc(size, sizeof(*kc->entries))) == NULL) {
+    free(kc);
+    return NULL;
+  }
+
+  kc->size = size;
+  return kc;
+}
+
+/**
+ * Free an issuer key cache and every key in it.
+ */
+static void key_cache_free(key_cache_t *kc)
+{
+  unsigned i;
+
+  if (kc == NULL)
+    return;
+  for (i = 0; i < kc->size; i++)
+    EVP_PKEY_free(kc->entries[i].pkey);
+  free(kc->entries);
+  free(kc);
+}
+
+/**
+ * Get a certificate's public key for signature checking, from the
+ * issuer key cache if possible.  On a miss we decode the key, set up
+ * its RSA Montgomery context now rather than on first use, and keep
+ * it.  Either way, if OpenSSL hasn't yet decoded this certificate's
+ * key we hand it ours, so that X509_verify_cert() and CMS_verify()
+ * use the cached key too.  Caller must EVP_PKEY_free() the result.
+ */
+static EVP_PKEY *key_cache_get(const rcynic_ctx_t *rc, X509 *x)
+{
+  unsigned char hash[EVP_MAX_MD_SIZE];
+  key_cache_entry_t *e;
+  unsigned hashlen;
+  EVP_PKEY *pkey;
+  BN_CTX *bnctx;
+  RSA *rsa;
+
+  assert(rc && x);
+
+  if (rc->key_cache == NULL ||
+      !X509_pubkey_digest(x, EVP_sha256(), hash, &hashlen) ||
+      hashlen != sizeof(e->hash))
+    return X509_get_pubkey(x);
+
+  e = &rc->key_cache->entries[(((uint32_t) hash[0] << 24) | ((uint32_t) hash[1] << 16) |
+			       ((uint32_t) hash[2] <<  8) | ((uint32_t) hash[3] <<  0)) % rc->key_cache->size];
+
+  if (e->pkey == NULL || memcmp(e->hash, hash, sizeof(e->hash))) {
+    if ((pkey = X509_get_pubkey(x)) == NULL)
+      return NULL;
+    if (EVP_PKEY_type(pkey->type) == EVP_PKEY_RSA &&
+	(rsa = pkey->pkey.rsa) != NULL &&
+	(rsa->flags & RSA_FLAG_CACHE_PUBLIC) != 0 &&
+	(bnctx = BN_CTX_new()) != NULL) {
+      (void) BN_MONT_CTX_set_locked(&rsa->_method_mod_n, CRYPTO_LOCK_RSA, rsa->n, bnctx);
+      BN_CTX_free(bnctx);
+    }
+    EVP_PKEY_free(e->pkey);
+    memcpy(e->hash, hash, sizeof(e->hash));
+    e->pkey = pkey;
+  }
+
+  if (x->cert_info->key->pkey == NULL) {
+    CRYPTO_add(&e->pkey->references, 1, CRYPTO_LOCK_EVP_PKEY);
+    x->cert_info->key->pkey = e->pkey;
+  }
+
+  CRYPTO_add(&e->pkey->references, 1, CRYPTO_LOCK_EVP_PKEY);
+  return e->pkey;
+}
+
+
+
+static int object_unchanged(const rcynic_ctx_t *, const uri_t *, const object_generation_t);
+
+/**
+ * Batch signature stage.  Every certificate the batch hashing stage
+ * just read, and every EE certificate in the signed objects it read,
+ * should have been signed by this walk context's certificate.  Decode
+ * them all, then check all of those signatures back to back against
+ * the one issuer key, which keeps the key and its Montgomery context
+ * hot rather than interleaving them with everything else
+ * check_x509() does.  Certificates which pass are marked with their
+ * issuer so that check_x509() doesn't check them again.  Anything
+ * which fails here is left unmarked and gets the full treatment
+ * later, so that it's reported properly.
+ *
+ * verify[i] is false for objects whose signatures check_x509() would
+ * skip anyway because they're unchanged since the last run.
+ */
+static void walk_ctx_presign(const rcynic_ctx_t *rc, walk_ctx_t *w, const char *verify)
+{
+  STACK_OF(X509) *certs;
+  X509 **pending = NULL;
+  EVP_PKEY *pkey = NULL;
+  const unsigned char *der;
+  size_t plen;
+  int i, n;
+
+  assert(rc && w && verify);
+
+  if (w->preload_count == 0 ||
+      (pending = malloc(w->preload_count * sizeof(*pending))) == NULL ||
+      (pkey = key_cache_get(rc, w->cert)) == NULL)
+    goto done;
+
+  for (i = n = 0; i < w->preload_count; i++) {
+    preload_t *p = &w->preload[i];
+
+    if (p->data == NULL || !verify[i])
+      continue;
+
+    plen = strlen(p->path.s);
+    assert(plen >= 4);
+
+    if (!strcmp(p->path.s + plen - 4, ".cer"))
+      p->it = ASN1_ITEM_rptr(X509);
+    else
+      p->it = ASN1_ITEM_rptr(CMS_ContentInfo);
+
+    der = p->data;
+    if ((p->object = ASN1_item_d2i(NULL, &der, p->len, p->it)) == NULL)
+      continue;
+
+    if (p->it == ASN1_ITEM_rptr(X509)) {
+      pending[n++] = (X509 *) p->object;
+    } else if ((certs = CMS_get1_certs((CMS_ContentInfo *) p->object)) != NULL) {
+      if (sk_X509_num(certs) == 1)
+	pending[n++] = sk_X509_value(certs, 0);
+      sk_X509_pop_free(certs, X509_free);
+    }
+  }
+
+  for (i = 0; i < n; i++)
+    if (X509_verify(pending[i], pkey) > 0)
+      (void) X509_set_ex_data(pending[i], rc->presigned_index, w->cert);
+
+ done:
+  EVP_PKEY_free(pkey);
+  free(pending);
+}
+
+/**
+ * Batch hashing stage.  Read the next rc->hash_batch_size objects
+ * listed on the manifest and hash them all in one sha256_mb() call,
+ * so the check routines can parse the copies we read rather than
+ * reading and hashing each file separately.  We only do this for the
+ * current generation, since most objects in the backup generation
+ * were already accepted from the current one and won't be read again.
+ * Files over PRELOAD_MAX_OBJECT_SIZE are skipped here and take the
+ * normal path when the walk reaches them.
+ */
+static void walk_ctx_preload(const rcynic_ctx_t *rc, walk_ctx_t *w)
+{
+  const unsigned char **data = NULL;
+  unsigned char **digest = NULL;
+  char *verify = NULL;
+  size_t *len = NULL;
+  der_view_t files, file, hash;
+  unsigned unused;
+  uri_t uri;
+  int i, n, k;
+
+  assert(rc && w);
+
+  walk_ctx_preload_clear(w);
+
+  if (rc->hash_batch_size <= 0 || w->state != walk_state_current || w->manifest == NULL ||
+      w->manifest_iteration >= (int) w->manifest->view.nfiles)
+    return;
+
+  n = (int) w->manifest->view.nfiles - w->manifest_iteration;
+  if (n > rc->hash_batch_size)
+    n = rc->hash_batch_size;
+
+  if ((w->preload = calloc(n, sizeof(*w->preload))) == NULL ||
+      (data   = malloc(n * sizeof(*data)))   == NULL ||
+      (len    = malloc(n * sizeof(*len)))    == NULL ||
+      (digest = malloc(n * sizeof(*digest))) == NULL ||
+      (verify = calloc(n, sizeof(*verify)))  == NULL) {
+    logmsg(rc, log_sys_err, "Couldn't allocate batch hashing buffers for %s", w->certinfo.manifest.s);
+    free(w->preload);
+    w->preload = NULL;
+    goto done;
+  }
+
+  w->preload_start = w->manifest_iteration;
+  w->preload_count = n;
+
+  for (i = k = 0, files = w->manifest_files;
+       i < n && manifest_view_next_file(&files, &file, &hash, &unused);
+       i++) {
+    preload_t *p = &w->preload[i];
+
+    if (file.len < 4 ||
+	(memcmp(file.data + file.len - 4, ".cer", 4) &&
+	 memcmp(file.data + file.len - 4, ".roa", 4) &&
+	 memcmp(file.data + file.len - 4, ".gbr", 4)))
+      continue;
+
+    if (!walk_ctx_entry_uri(rc, w, (const char *) file.data, file.len, &uri) ||
+	!uri_to_filename(rc, &uri, &p->path, &rc->unauthenticated) ||
+	!read_whole_file(&p->path, &p->data, &p->len, PRELOAD_MAX_OBJECT_SIZE))
+      continue;
+
+    data[k] = p->data;
+    len[k] = p->len;
+    digest[k] = p->hash.h;
+    k++;
+
+    verify[i] = !(w->certinfo.unchanged && object_unchanged(rc, &uri, object_generation_current));
+  }
+
+  sha256_mb(data, len, digest, k);
+
+  walk_ctx_presign(rc, w, verify);
+
+ done:
+  free(data);
+  free(len);
+  free(digest);
+  free(verify);
+}
+
+/**
+ * Find the batch hashing stage's copy of the object the walk is
+ * currently looking at, if it has one and it's the file we want.
+ */
+static preload_t *walk_ctx_preloaded(STACK_OF(walk_ctx_t) *wsk, const path_t *path)
+{
+  walk_ctx_t *w = walk_ctx_stack_head(wsk);
+  preload_t *p;
+
+  if (w == NULL || w->preload == NULL ||
+      w->manifest_iteration <  w->preload_start ||
+      w->manifest_iteration >= w->preload_start + w->preload_count)
+    return NULL;
+
+  p = &w->preload[w->manifest_iteration - w->preload_start];
+
+  if (p->data == NULL || strcmp(p->path.s, path->s))
+    return NULL;
+
+  return p;
+}
+
+/**
+ * Walk context iterator.  Think of this as the thing you call in the
+ * third clause of a conceptual "for" loop: this reinitializes as
+ * necessary for the next pass through the loop.
+ *
+ * General idea here is that we have several state variables in a walk
+ * context which collectively define the current pass, product URI,
+ * etc, and we want to be able to iterate through this sequence via
+ * the event system.  So this function steps to the next state.
+ *
+ * Conceptually, w->manifest->view.fileList and w->filenames form a
+ * single array with index w->manifest_iteration + w->filename_iteration.
+ * Beware of fencepost errors, I've gotten this wrong once already.
+ * Slightly odd coding here is to make it easier to check this.
+ *
+ * w->manifest_files is a cursor into the DER fileList which always
+ * starts with entry w->manifest_iteration, so that stepping through
+ * the manifest doesn't require rescanning it from the beginning.
+ */
+static void walk_ctx_loop_next(const rcynic_ctx_t *rc, STACK_OF(walk_ctx_t) *wsk)
+{
+  walk_ctx_t *w = walk_ctx_stack_head(wsk);
+  int n_manifest, n_filenames;
+
+  assert(rc && wsk && w);
+
+  assert(w->manifest_iteration >= 0 && w->filename_iteration >= 0);
+
+  n_manifest  = w->manifest  ? (int) w->manifest->view.nfiles         : 0;
+  n_filenames = w->filenames ? sk_OPENSSL_STRING_num(w->filenames) : 0;
+
+  if (w->manifest_iteration + w->filename_iteration < n_manifest + n_filenames) {
+    if (w->manifest_iteration < n_manifest) {
+      der_view_t file, hash;
+      unsigned unused;
+      (void) manifest_view_next_file(&w->manifest_files, &file, &hash, &unused);
+      w->manifest_iteration++;
+      if (w->preload_count > 0 && w->manifest_iteration == w->preload_start + w->preload_count)
+	walk_ctx_preload(rc, w);
+    } else {
+      w->filename_iteration++;
+    }
+  }
+
+  assert(w->manifest_iteration <= n_manifest && w->filename_iteration <= n_filenames);
+
+  if (w->manifest_iteration + w->filename_iteration < n_manifest + n_filenames)
+    return;
+
+  while (!walk_ctx_loop_done(wsk)) {
+    w->state++;
+    walk_ctx_manifest_rewind(w);
+    w->filename_iteration = 0;
+    sk_OPENSSL_STRING_pop_free(w->filenames, OPENSSL_STRING_free);
+    w->filenames = directory_filenames(rc, w->state, &w->certinfo.sia);
+    if (w->manifest != NULL || w->filenames != NULL)
+      return;
+  }
+}
+
+static int check_manifest(rcynic_ctx_t *rc, STACK_OF(walk_ctx_t) *wsk);
+
+/**
+ * Loop initializer for walk context.  Think of this as the thing you
+ * call in the first clause of a conceptual "for" loop.
+ */
+static void walk_ctx_loop_init(rcynic_ctx_t *rc, STACK_OF(walk_ctx_t) *wsk)
+{
+  walk_ctx_t *w = walk_ctx_stack_head(wsk);
+
+  assert(rc && wsk && w && w->state == walk_state_ready);
+
+  if (!w->manifest && !check_manifest(rc, wsk)) {
+    /*
+     * Simple failure to find a manifest doesn't get here.  This is
+     * for manifest failures that cause us to reject all of this
+     * certificate's products due to policy knob settings.
+     */
+    w->state = walk_state_done;
+    return;
+  }
+
+  if (!w->manifest)
+    logmsg(rc, log_telemetry, "Couldn't get manifest %s, blundering onward", w->certinfo.manifest.s);
+
+  walk_ctx_manifest_rewind(w);
+  w->filename_iteration = 0;
   w->state++;
   assert(w->state == walk_state_current);
 
+  walk_ctx_preload(rc, w);
+
   assert(w->filenames == NULL);
   w->filenames = directory_filenames(rc, w->state, &w->certinfo.sia);
 
-  w->stale_manifest = w->manifest != NULL && X509_cmp_current_time(w->manifest->nextUpdate) < 0;
+  w->stale_manifest = w->manifest != NULL && w->manifest->nextUpdate <= rc->now;
 
   while (!walk_ctx_loop_done(wsk) &&
-	 (w->manifest == NULL  || w->manifest_iteration >= sk_FileAndHash_num(w->manifest->fileList)) &&
+	 (w->manifest == NULL  || w->manifest_iteration >= (int) w->manifest->view.nfiles) &&
 	 (w->filenames == NULL || w->filename_iteration >= sk_OPENSSL_STRING_num(w->filenames)))
     walk_ctx_loop_next(rc, wsk);
 }
@@ -2048,16 +2850,23 @@ static int walk_ctx_loop_this(const rcynic_ctx_t *rc,
 			      size_t *hashlen)
 {
   const walk_ctx_t *w = walk_ctx_stack_head(wsk);
+  der_view_t iter, file, fah_hash;
   const char *name = NULL;
-  FileAndHash *fah = NULL;
+  size_t namelen = 0;
+  unsigned unused;
+  int from_manifest = 0;
 
   assert(rc && wsk && w && uri && hash && hashlen);
 
-  if (w->manifest != NULL && w->manifest_iteration < sk_FileAndHash_num(w->manifest->fileList)) {
-    fah = sk_FileAndHash_value(w->manifest->fileList, w->manifest_iteration);
-    name = (const char *) fah->file->data;
+  if (w->manifest != NULL && w->manifest_iteration < (int) w->manifest->view.nfiles) {
+    iter = w->manifest_files;
+    if ((from_manifest = manifest_view_next_file(&iter, &file, &fah_hash, &unused)) != 0) {
+      name = (const char *) file.data;
+      namelen = file.len;
+    }
   } else if (w->filenames != NULL && w->filename_iteration < sk_OPENSSL_STRING_num(w->filenames)) {
     name = sk_OPENSSL_STRING_value(w->filenames, w->filename_iteration);
+    namelen = strlen(name);
   }
 
   if (name == NULL) {
@@ -2068,18 +2877,13 @@ static int walk_ctx_loop_this(const rcynic_ctx_t *rc,
     return 0;
   }
 
-  if (strlen(w->certinfo.sia.s) + strlen(name) >= sizeof(uri->s)) {
-    logmsg(rc, log_data_err, "URI %s%s too long, skipping", w->certinfo.sia.s, uri->s);
+  if (!walk_ctx_entry_uri(rc, w, name, namelen, uri))
     return 0;
-  }
 
-  strcpy(uri->s, w->certinfo.sia.s);
-  strcat(uri->s, name);
-
-  if (fah != NULL) {
-    sk_OPENSSL_STRING_remove(w->filenames, name);
-    *hash = fah->hash->data;
-    *hashlen = fah->hash->length;
+  if (from_manifest) {
+    sk_OPENSSL_STRING_remove(w->filenames, uri->s + strlen(w->certinfo.sia.s));
+    *hash = fah_hash.data;
+    *hashlen = fah_hash.len;
   } else {
     *hash = NULL;
     *hashlen = 0;
@@ -2190,6 +2994,74 @@ static void walk_ctx_stack_free(STACK_OF(walk_ctx_t) *wsk)
 
 static int rsync_count_running(const rcynic_ctx_t *);
 
+/**
+ * Allocate a task queue.
+ */
+static task_queue_t *task_queue_new(const unsigned size)
+{
+  task_queue_t *q = malloc(sizeof(*q));
+
+  assert(size > 0);
+
+  if (q == NULL)
+    return NULL;
+
+  memset(q, 0, sizeof(*q));
+
+  if ((q->ring = malloc(size * sizeof(*q->ring))) == NULL) {
+    free(q);
+    return NULL;
+  }
+
+  q->size = size;
+  return q;
+}
+
+/**
+ * Free a task queue.
+ */
+static void task_queue_free(task_queue_t *q)
+{
+  if (q == NULL)
+    return;
+  free(q->ring);
+  free(q);
+}
+
+/**
+ * Double the size of a full task queue, unwrapping the ring buffer
+ * into the bottom of the new allocation as we go.
+ */
+static int task_queue_grow(task_queue_t *q)
+{
+  unsigned i, size = q->size * 2;
+  task_t *ring;
+
+  assert(q->count == q->size);
+
+  if (size < q->size || (ring = malloc(size * sizeof(*ring))) == NULL)
+    return 0;
+
+  for (i = 0; i < q->count; i++)
+    ring[i] = q->ring[(q->head + i) % q->size];
+
+  free(q->ring);
+  q->ring = ring;
+  q->size = size;
+  q->head = 0;
+  return 1;
+}
+
+/**
+ * Difference between two timevals, in seconds.
+ */
+static double timeval_diff(const struct timeval *start,
+			   const struct timeval *finish)
+{
+  return ((double) (finish->tv_sec - start->tv_sec) +
+	  (double) (finish->tv_usec - start->tv_usec) / 1000000.0);
+}
+
 /**
  * Add a task to the task queue.
  */
@@ -2197,3370 +3069,5696 @@ static int task_add(const rcynic_ctx_t *rc,
 		    void (*handler)(rcynic_ctx_t *, void *),
 		    void *cookie)
 {
-  task_t *t = malloc(sizeof(*t));
+  task_queue_t *q;
+  task_t *t;
 
   assert(rc && rc->task_queue && handler);
 
   assert(rsync_count_running(rc) <= rc->max_parallel_fetches);
 
-  if (!t)
+  q = rc->task_queue;
+
+  if (q->count == q->size && !task_queue_grow(q))
     return 0;
 
+  t = &q->ring[(q->head + q->count) % q->size];
   t->handler = handler;
   t->cookie = cookie;
+  gettimeofday(&t->queued, NULL);
 
-  if (sk_task_t_push(rc->task_queue, t))
-    return 1;
+  if (++q->count > q->max_count)
+    q->max_count = q->count;
 
-  free(t);
-  return 0;
+  return 1;
 }
 
 /**
- * Run tasks until queue is empty.
+ * Run tasks until queue is empty.  We copy each task out of the ring
+ * before running it, because the handler may well add more tasks.
  */
 static void task_run_q(rcynic_ctx_t *rc)
 {
-  task_t *t;
+  task_queue_t *q;
+  struct timeval now;
+  double delay;
+  task_t t;
+
   assert(rc && rc->task_queue);
-  while ((t = sk_task_t_shift(rc->task_queue)) != NULL) {
-    t->handler(rc, t->cookie);
-    free(t);
+
+  q = rc->task_queue;
+
+  while (q->count > 0) {
+    t = q->ring[q->head];
+    q->head = (q->head + 1) % q->size;
+    q->count--;
+    gettimeofday(&now, NULL);
+    delay = timeval_diff(&t.queued, &now);
+    q->total_wait += delay;
+    if (delay > q->max_wait)
+      q->max_wait = delay;
+    q->ran++;
+    t.handler(rc, t.cookie);
   }
 }
 
-
-
 /**
- * Check cache of whether we've already fetched a particular URI.
+ * Log task queue statistics.
  */
-static rsync_history_t *rsync_history_uri(const rcynic_ctx_t *rc,
-					  const uri_t *uri)
+static void task_queue_log_stats(const rcynic_ctx_t *rc)
 {
-  rsync_history_t h;
-  char *s;
-  int i;
+  const task_queue_t *q;
 
-  assert(rc && uri && rc->rsync_history);
+  assert(rc && rc->task_queue);
 
-  if (!is_rsync(uri->s))
-    return NULL;
+  q = rc->task_queue;
 
-  h.uri = *uri;
+  logmsg(rc, log_telemetry,
+	 "Task queue: ran %lu tasks, maximum depth %u, mean wait %.6f seconds, maximum wait %.6f seconds",
+	 q->ran, q->max_count, q->ran ? q->total_wait / q->ran : 0.0, q->max_wait);
+}
 
-  while ((s = strrchr(h.uri.s, '/')) != NULL && s[1] == '\0')
-    *s = '\0';
 
-  while ((i = sk_rsync_history_t_find(rc->rsync_history, &h)) < 0) {
-    if ((s = strrchr(h.uri.s, '/')) == NULL ||
-	(s - h.uri.s) < SIZEOF_RSYNC)
-      return NULL;
-    *s = '\0';
-  }
-
-  return sk_rsync_history_t_value(rc->rsync_history, i);
-}
 
 /**
- * Record that we've already attempted to synchronize a particular
- * rsync URI.
+ * Allocate an rsync_history index.
  */
-static void rsync_history_add(const rcynic_ctx_t *rc,
-			      const rsync_ctx_t *ctx,
-			      const rsync_status_t status)
+static rsync_history_index_t *rsync_history_index_new(const unsigned size)
 {
-  int final_slash = 0;
-  rsync_history_t *h;
-  uri_t uri;
-  size_t n;
-  char *s;
+  rsync_history_index_t *x = malloc(sizeof(*x));
 
-  assert(rc && ctx && rc->rsync_history && is_rsync(ctx->uri.s));
+  assert(size > 0 && (size & (size - 1)) == 0);
 
-  uri = ctx->uri;
+  if (x == NULL)
+    return NULL;
 
-  while ((s = strrchr(uri.s, '/')) != NULL && s[1] == '\0') {
-    final_slash = 1;
-    *s = '\0';
+  if ((x->buckets = calloc(size, sizeof(*x->buckets))) == NULL) {
+    free(x);
+    return NULL;
   }
 
-  if (status != rsync_status_done) {
+  x->size = size;
+  x->count = 0;
+  return x;
+}
 
-    n = SIZEOF_RSYNC + strcspn(uri.s + SIZEOF_RSYNC, "/");
-    assert(n < sizeof(uri.s));
-    uri.s[n] = '\0';
-    final_slash = 1;
+/**
+ * Free an rsync_history index.  Doesn't touch the entries, which
+ * belong to the rsync_history stack.
+ */
+static void rsync_history_index_free(rsync_history_index_t *x)
+{
+  if (x == NULL)
+    return;
+  free(x->buckets);
+  free(x);
+}
 
-    if ((h = rsync_history_uri(rc, &uri)) != NULL) {
-      assert(h->status != rsync_status_done);
-      return;
-    }
-  }
+/**
+ * Empty an rsync_history index, keeping the bucket array.
+ */
+static void rsync_history_index_clear(rsync_history_index_t *x)
+{
+  assert(x);
+  memset(x->buckets, 0, x->size * sizeof(*x->buckets));
+  x->count = 0;
+}
 
-  if ((h = rsync_history_t_new()) != NULL) {
-    h->uri = uri;
-    h->status = status;
-    h->started = ctx->started;
-    h->finished = time(0);
-    h->final_slash = final_slash;
-  }
+/**
+ * One step of the FNV-1a hash.  We hash URIs one character at a time
+ * so that we get the hash of every prefix along the way.
+ */
+#define	FNV_INITIAL	2166136261U
+#define	FNV_STEP(h, c)	(((h) ^ (unsigned char) (c)) * 16777619U)
 
-  if (h == NULL || !sk_rsync_history_t_push(rc->rsync_history, h)) {
-    rsync_history_t_free(h);
-    logmsg(rc, log_sys_err,
-	   "Couldn't add %s to rsync_history, blundering onwards", uri.s);
+/**
+ * 64-bit FNV-1a, for the fetch table, which keeps only the hash.
+ */
+#define	FNV64_INITIAL	UINT64_C(14695981039346656037)
+#define	FNV64_STEP(h, c) (((h) ^ (unsigned char) (c)) * UINT64_C(1099511628211))
+
+/**
+ * Add an entry to an rsync_history index.  If we can't grow the
+ * bucket array we just live with longer chains.
+ */
+static void rsync_history_index_add(rsync_history_index_t *x,
+				    rsync_history_t *h)
+{
+  rsync_history_t **buckets, *next;
+  unsigned i, size;
+  const char *s;
+
+  assert(x && h);
+
+  h->hash = FNV_INITIAL;
+  for (s = h->uri.s; *s; s++)
+    h->hash = FNV_STEP(h->hash, *s);
+  h->len = s - h->uri.s;
+
+  if (x->count >= x->size && (size = x->size * 2) > x->size &&
+      (buckets = calloc(size, sizeof(*buckets))) != NULL) {
+    for (i = 0; i < x->size; i++) {
+      for (; x->buckets[i] != NULL; x->buckets[i] = next) {
+	next = x->buckets[i]->next;
+	x->buckets[i]->next = buckets[x->buckets[i]->hash & (size - 1)];
+	buckets[x->buckets[i]->hash & (size - 1)] = x->buckets[i];
+      }
+    }
+    free(x->buckets);
+    x->buckets = buckets;
+    x->size = size;
   }
-}
 
-
+  h->next = x->buckets[h->hash & (x->size - 1)];
+  x->buckets[h->hash & (x->size - 1)] = h;
+  x->count++;
+}
 
 /**
- * Return count of how many rsync contexts are in running.
+ * Look up an exact string in an rsync_history index, given its hash.
  */
-static int rsync_count_running(const rcynic_ctx_t *rc)
+static rsync_history_t *rsync_history_index_find(const rsync_history_index_t *x,
+						 const char *s,
+						 const size_t len,
+						 const unsigned hash)
 {
-  const rsync_ctx_t *ctx;
-  int i, n = 0;
+  rsync_history_t *h;
 
-  assert(rc && rc->rsync_queue);
+  assert(x && s);
 
-  for (i = 0; (ctx = sk_rsync_ctx_t_value(rc->rsync_queue, i)) != NULL; ++i) {
-    switch (ctx->state) {
-    case rsync_state_running:
-    case rsync_state_closed:
-    case rsync_state_terminating:
-      n++;
-    default:
-      continue;
-    }
-  }
+  for (h = x->buckets[hash & (x->size - 1)]; h != NULL; h = h->next)
+    if (h->hash == hash && h->len == len && !strncmp(h->uri.s, s, len))
+      return h;
 
-  return n;
+  return NULL;
 }
 
 /**
- * Test whether an rsync context conflicts with anything that's
- * currently runable.
+ * Check cache of whether we've already fetched a particular URI.
+ *
+ * The URI counts as fetched if it or any ancestor of it is in the
+ * history, where ancestors are the prefixes ending just before any
+ * slash after the scheme.  FNV-1a gives us the hash of each prefix as
+ * we go, so one pass over the URI finds the longest match.
  */
-static int rsync_conflicts(const rcynic_ctx_t *rc,
-			   const rsync_ctx_t *ctx)
+static rsync_history_t *rsync_history_uri(const rcynic_ctx_t *rc,
+					  const uri_t *uri)
 {
-  const rsync_ctx_t *c;
-  int i;
+  rsync_history_t *h, *result = NULL;
+  unsigned hash = FNV_INITIAL;
+  size_t i, n;
 
-  assert(rc && ctx && rc->rsync_queue);
+  assert(rc && uri && rc->rsync_history_index);
 
-  for (i = 0; (c = sk_rsync_ctx_t_value(rc->rsync_queue, i)) != NULL; ++i)
-    if (c != ctx &&
-	(c->state == rsync_state_initial ||
-	 c->state == rsync_state_running) &&
-	conflicting_uris(&c->uri, &ctx->uri))
-      return 1;
+  if (!is_rsync(uri->s))
+    return NULL;
 
-  return 0;
+  for (n = strlen(uri->s); n > 0 && uri->s[n - 1] == '/'; n--)
+    ;
+
+  for (i = 0; i < n; i++) {
+    if (i >= SIZEOF_RSYNC && uri->s[i] == '/' &&
+	(h = rsync_history_index_find(rc->rsync_history_index, uri->s, i, hash)) != NULL)
+      result = h;
+    hash = FNV_STEP(hash, uri->s[i]);
+  }
+
+  if ((h = rsync_history_index_find(rc->rsync_history_index, uri->s, n, hash)) != NULL)
+    result = h;
+
+  return result;
 }
 
 /**
- * Test whether a rsync context is runable at this time.
+ * Check whether the current rsync_history has an entry for exactly
+ * the same URI as some other rsync_history_t, ignoring ancestors.
  */
-static int rsync_runable(const rcynic_ctx_t *rc,
-			 const rsync_ctx_t *ctx)
+static rsync_history_t *rsync_history_exact(const rcynic_ctx_t *rc,
+					    const rsync_history_t *r)
 {
-  assert(rc && ctx);
+  unsigned hash = FNV_INITIAL;
+  const char *s;
 
-  switch (ctx->state) {
+  assert(rc && r && rc->rsync_history_index);
 
-  case rsync_state_initial:
-  case rsync_state_running:
-    return 1;
+  for (s = r->uri.s; *s; s++)
+    hash = FNV_STEP(hash, *s);
 
-  case rsync_state_retry_wait:
-    return ctx->deadline <= time(0);
+  return rsync_history_index_find(rc->rsync_history_index, r->uri.s, s - r->uri.s, hash);
+}
 
-  case rsync_state_closed:
-  case rsync_state_terminating:
-    return 0;
+/**
+ * Take or drop the fetch table lock.  fcntl() locks belong to the
+ * process, so the one descriptor all the workers inherited still
+ * gives each worker a lock of its own.
+ */
+static int fetch_table_lock(const rcynic_ctx_t *rc, const short type)
+{
+  struct flock fl;
 
-  case rsync_state_conflict_wait:
-    return !rsync_conflicts(rc, ctx);
+  assert(rc && rc->fetch_table && rc->fetch_table_lock >= 0);
 
-  default:
-    break;
+  memset(&fl, 0, sizeof(fl));
+  fl.l_type = type;
+  fl.l_whence = SEEK_SET;
+
+  while (fcntl(rc->fetch_table_lock, F_SETLKW, &fl) < 0) {
+    if (errno != EINTR) {
+      logmsg(rc, log_sys_err, "Couldn't %s fetch table: %s",
+	     (type == F_UNLCK ? "unlock" : "lock"), strerror(errno));
+      return 0;
+    }
   }
 
-  return 0;
+  return 1;
 }
 
 /**
- * Return count of runable rsync contexts.
+ * Find a hash in the fetch table's seen set, or the empty slot where
+ * it belongs.  Zero marks an empty slot, so a hash of zero is stored
+ * as one.  Caller holds the lock.
  */
-static int rsync_count_runable(const rcynic_ctx_t *rc)
+static unsigned fetch_table_seen_slot(const fetch_table_t *t, uint64_t hash)
 {
-  const rsync_ctx_t *ctx;
-  int i, n = 0;
+  unsigned i;
 
-  assert(rc && rc->rsync_queue);
+  if (hash == 0)
+    hash = 1;
 
-  for (i = 0; (ctx = sk_rsync_ctx_t_value(rc->rsync_queue, i)) != NULL; ++i)
-    if (rsync_runable(rc, ctx))
-      n++;
+  for (i = hash % FETCH_TABLE_SEEN_MAX; t->seen[i] != 0 && t->seen[i] != hash;
+       i = (i + 1) % FETCH_TABLE_SEEN_MAX)
+    ;
 
-  return n;
+  return i;
 }
 
 /**
- * Call rsync context handler, if one is set.
+ * Check whether any worker has already attempted to fetch a URI or
+ * one of its ancestors, by the same rules as rsync_history_uri().
  */
-static void rsync_call_handler(rcynic_ctx_t *rc,
-			       rsync_ctx_t *ctx,
-			       const rsync_status_t status)
+static int fetch_table_seen(const rcynic_ctx_t *rc, const uri_t *uri)
 {
-  if (!ctx)
-    return;
-
-  switch (status) {
+  const fetch_table_t *t = rc->fetch_table;
+  uint64_t hash = FNV64_INITIAL;
+  int result = 0;
+  size_t i, n;
 
-  case rsync_status_pending:
-  case rsync_status_done:
-    break;
+  assert(rc && uri);
 
-  case rsync_status_failed:
-    log_validation_status(rc, &ctx->uri, rsync_transfer_failed, object_generation_null);
-    break;
+  if (t == NULL || !is_rsync(uri->s) || !fetch_table_lock(rc, F_WRLCK))
+    return 0;
 
-  case rsync_status_timed_out:
-    log_validation_status(rc, &ctx->uri, rsync_transfer_timed_out, object_generation_null);
-    break;
+  for (n = strlen(uri->s); n > 0 && uri->s[n - 1] == '/'; n--)
+    ;
 
-  case rsync_status_skipped:
-    log_validation_status(rc, &ctx->uri, rsync_transfer_skipped, object_generation_null);
-    break;
+  for (i = 0; !result && i < n; i++) {
+    if (i >= SIZEOF_RSYNC && uri->s[i] == '/')
+      result = t->seen[fetch_table_seen_slot(t, hash)] != 0;
+    hash = FNV64_STEP(hash, uri->s[i]);
   }
 
-  if (ctx->handler)
-    ctx->handler(rc, ctx, status, &ctx->uri, ctx->cookie);
+  if (!result)
+    result = t->seen[fetch_table_seen_slot(t, hash)] != 0;
+
+  (void) fetch_table_lock(rc, F_UNLCK);
+  return result;
 }
 
 /**
- * Run an rsync process.
+ * Tell the other workers that we've attempted to fetch a URI, as
+ * recorded in our rsync_history.  If the seen set is getting full we
+ * stop adding to it, and the other workers will fetch the URI again
+ * if they need it.
  */
-static void rsync_run(rcynic_ctx_t *rc,
-		      rsync_ctx_t *ctx)
+static void fetch_table_note(const rcynic_ctx_t *rc, const uri_t *uri)
 {
-  static const char * const rsync_cmd[] = {
-    "rsync", "--update", "--times", "--copy-links", "--itemize-changes"
-  };
-  static const char * const rsync_tree_args[] = {
-    "--recursive", "--delete"
-  };
+  fetch_table_t *t = rc->fetch_table;
+  uint64_t hash = FNV64_INITIAL;
+  const char *s;
+  unsigned i;
 
-  const char *argv[10];
-  path_t path;
-  int i, argc = 0, flags, pipe_fds[2];
+  assert(rc && uri);
 
-  pipe_fds[0] = pipe_fds[1] = -1;
+  if (t == NULL || !fetch_table_lock(rc, F_WRLCK))
+    return;
 
-  assert(rc && ctx && ctx->pid == 0 && ctx->state != rsync_state_running && rsync_runable(rc, ctx));
+  for (s = uri->s; *s; s++)
+    hash = FNV64_STEP(hash, *s);
 
-  if (rsync_history_uri(rc, &ctx->uri)) {
-    logmsg(rc, log_verbose, "Late rsync cache hit for %s", ctx->uri.s);
-    rsync_call_handler(rc, ctx, rsync_status_done);
-    (void) sk_rsync_ctx_t_delete_ptr(rc->rsync_queue, ctx);
-    free(ctx);
-    return;
-  }
+  i = fetch_table_seen_slot(t, hash);
 
-  assert(rsync_count_running(rc) < rc->max_parallel_fetches);
+  if (t->seen[i] == 0 && t->nseen < FETCH_TABLE_SEEN_MAX / 4 * 3) {
+    t->seen[i] = hash ? hash : 1;
+    t->nseen++;
+  }
 
-  logmsg(rc, log_telemetry, "Fetching %s", ctx->uri.s);
+  (void) fetch_table_lock(rc, F_UNLCK);
+}
 
-  memset(argv, 0, sizeof(argv));
+/**
+ * Check whether some other worker is running a fetch which conflicts
+ * with an rsync context, clearing out any slots left behind by workers
+ * which died without releasing them.  Caller holds the lock.
+ */
+static int fetch_table_conflicts(fetch_table_t *t, const rsync_ctx_t *ctx)
+{
+  pid_t self = getpid();
+  unsigned i;
 
-  for (i = 0; i < sizeof(rsync_cmd)/sizeof(*rsync_cmd); i++) {
-    assert(argc < sizeof(argv)/sizeof(*argv));
-    argv[argc++] = rsync_cmd[i];
-  }
-  if (endswith(ctx->uri.s, "/")) {
-    for (i = 0; i < sizeof(rsync_tree_args)/sizeof(*rsync_tree_args); i++) {
-      assert(argc < sizeof(argv)/sizeof(*argv));
-      argv[argc++] = rsync_tree_args[i];
+  for (i = 0; i < t->nrunning; i++) {
+    if (t->running[i].pid == 0 || t->running[i].pid == self ||
+	!conflicting_uris(&t->running[i].uri, &ctx->uri))
+      continue;
+    if (kill(t->running[i].pid, 0) < 0 && errno == ESRCH) {
+      t->running[i].pid = 0;
+      continue;
     }
+    return 1;
   }
 
-  if (rc->rsync_program)
-    argv[0] = rc->rsync_program;
+  return 0;
+}
 
-  if (!uri_to_filename(rc, &ctx->uri, &path, &rc->unauthenticated)) {
-    logmsg(rc, log_data_err, "Couldn't extract filename from URI: %s", ctx->uri.s);
-    goto lose;
-  }
+/**
+ * Check whether an rsync context has to wait for a fetch running in
+ * some other worker.
+ */
+static int fetch_table_busy(const rcynic_ctx_t *rc, const rsync_ctx_t *ctx)
+{
+  int result;
 
-  assert(argc < sizeof(argv)/sizeof(*argv));
-  argv[argc++] = ctx->uri.s;
+  assert(rc && ctx);
 
-  assert(argc < sizeof(argv)/sizeof(*argv));
-  argv[argc++] = path.s;
+  if (rc->fetch_table == NULL || !fetch_table_lock(rc, F_WRLCK))
+    return 0;
 
-  if (!mkdir_maybe(rc, &path)) {
-    logmsg(rc, log_sys_err, "Couldn't make target directory: %s", path.s);
-    goto lose;
-  }
+  result = fetch_table_conflicts(rc->fetch_table, ctx);
 
-  for (i = 0; i < argc; i++)
-    logmsg(rc, log_debug, "rsync argv[%d]: %s", i, argv[i]);
+  (void) fetch_table_lock(rc, F_UNLCK);
+  return result;
+}
 
-  if (pipe(pipe_fds) < 0) {
-    logmsg(rc, log_sys_err, "pipe() failed: %s", strerror(errno));
-    goto lose;
-  }
+/**
+ * Claim a running slot in the fetch table for an rsync context we're
+ * about to start.  Fails if another worker has already attempted the
+ * URI or is running a conflicting fetch; the caller should wait and
+ * ask again.  If we can't get the lock we blunder onwards without it.
+ */
+static int fetch_table_claim(const rcynic_ctx_t *rc, const rsync_ctx_t *ctx)
+{
+  fetch_table_t *t = rc->fetch_table;
+  unsigned i;
 
-  switch ((ctx->pid = vfork())) {
+  assert(rc && ctx);
 
-  case -1:
-     logmsg(rc, log_sys_err, "vfork() failed: %s", strerror(errno));
-     goto lose;
+  if (t == NULL)
+    return 1;
 
-  case 0:
-    /*
-     * Child
-     */
-#define whine(msg) ((void) write(2, msg, sizeof(msg) - 1))
-    if (close(pipe_fds[0]) < 0)
-      whine("close(pipe_fds[0]) failed\n");
-    else if (dup2(pipe_fds[1], 1) < 0)
-      whine("dup2(pipe_fds[1], 1) failed\n");
-    else if (dup2(pipe_fds[1], 2) < 0)
-      whine("dup2(pipe_fds[1], 2) failed\n");
-    else if (close(pipe_fds[1]) < 0)
-      whine("close(pipe_fds[1]) failed\n");
-    else if (execvp(argv[0], (char * const *) argv) < 0)
-      whine("execvp(argv[0], (char * const *) argv) failed\n");
-    whine("last system error: ");
-    write(2, strerror(errno), strlen(strerror(errno)));
-    whine("\n");
-    _exit(1);
-#undef whine
+  if (fetch_table_seen(rc, &ctx->uri))
+    return 0;
 
-  default:
-    /*
-     * Parent
-     */
-    ctx->fd = pipe_fds[0];
-    if ((flags = fcntl(ctx->fd, F_GETFL, 0)) == -1 ||
-	fcntl(ctx->fd, F_SETFL, flags | O_NONBLOCK) == -1) {
-      logmsg(rc, log_sys_err, "fcntl(ctx->fd, F_[GS]ETFL, O_NONBLOCK) failed: %s",
-	     strerror(errno));
-      goto lose;
-    }
-    (void) close(pipe_fds[1]);
-    ctx->state = rsync_state_running;
-    ctx->problem = rsync_problem_none;
-    if (!ctx->started)
-      ctx->started = time(0);
-    if (rc->rsync_timeout)
-      ctx->deadline = time(0) + rc->rsync_timeout;
-    logmsg(rc, log_verbose, "Subprocess %u started, queued %d, runable %d, running %d, max %d, URI %s",
-	   (unsigned) ctx->pid, sk_rsync_ctx_t_num(rc->rsync_queue), rsync_count_runable(rc), rsync_count_running(rc), rc->max_parallel_fetches, ctx->uri.s);
-    rsync_call_handler(rc, ctx, rsync_status_pending);
-    return;
+  if (!fetch_table_lock(rc, F_WRLCK))
+    return 1;
 
-  }
+  if (fetch_table_conflicts(t, ctx))
+    i = t->nrunning;
+  else
+    for (i = 0; i < t->nrunning && t->running[i].pid != 0; i++)
+      ;
 
- lose:
-  if (pipe_fds[0] != -1)
-    (void) close(pipe_fds[0]);
-  if (pipe_fds[1] != -1)
-    (void) close(pipe_fds[1]);
-  if (rc->rsync_queue && ctx)
-    (void) sk_rsync_ctx_t_delete_ptr(rc->rsync_queue, ctx);
-  rsync_call_handler(rc, ctx, rsync_status_failed);
-  if (ctx->pid > 0) {
-    (void) kill(ctx->pid, SIGKILL);
-    ctx->pid = 0;
+  if (i < t->nrunning) {
+    t->running[i].pid = getpid();
+    t->running[i].uri = ctx->uri;
   }
+
+  (void) fetch_table_lock(rc, F_UNLCK);
+  return i < t->nrunning;
 }
 
 /**
- * Process one line of rsync's output.  This is a separate function
- * primarily to centralize scraping for magic error strings.
+ * Release an rsync context's slot in the fetch table, once its rsync
+ * process has exited.
  */
-static void do_one_rsync_log_line(const rcynic_ctx_t *rc,
-				  rsync_ctx_t *ctx)
+static void fetch_table_release(const rcynic_ctx_t *rc, const rsync_ctx_t *ctx)
 {
-  unsigned u;
-  char *s;
+  fetch_table_t *t = rc->fetch_table;
+  pid_t self = getpid();
+  unsigned i;
 
-  /*
-   * Send line to our log unless it's empty.
-   */
-  if (ctx->buffer[strspn(ctx->buffer, " \t\n\r")] != '\0')
-    logmsg(rc, log_telemetry, "rsync[%u]: %s", ctx->pid, ctx->buffer);
+  assert(rc && ctx);
 
-  /*
-   * Check for magic error strings
-   */
-  if ((s = strstr(ctx->buffer, "@ERROR: max connections")) != NULL) {
-    ctx->problem = rsync_problem_refused;
-    if (sscanf(s, "@ERROR: max connections (%u) reached -- try again later", &u) == 1)
-      logmsg(rc, log_verbose, "Subprocess %u reported limit of %u for %s", ctx->pid, u, ctx->uri.s);
-  }
+  if (t == NULL || !fetch_table_lock(rc, F_WRLCK))
+    return;
+
+  for (i = 0; i < t->nrunning; i++)
+    if (t->running[i].pid == self && !strcmp(t->running[i].uri.s, ctx->uri.s))
+      t->running[i].pid = 0;
+
+  (void) fetch_table_lock(rc, F_UNLCK);
 }
 
 /**
- * Construct select() arguments.
+ * Check whether an rsync_history entry carried forward from an
+ * earlier run is too old to be worth keeping.
  */
-static int rsync_construct_select(const rcynic_ctx_t *rc,
-				  const time_t now,
-				  fd_set *rfds,
-				  struct timeval *tv)
+static int rsync_history_stale(const rcynic_ctx_t *rc,
+			       const rsync_history_t *r,
+			       const time_t now)
 {
-  rsync_ctx_t *ctx;
-  time_t when = 0;
-  int i, n = 0;
-
-  assert(rc && rc->rsync_queue && rfds && tv && rc->max_select_time >= 0);
-
-  FD_ZERO(rfds);
+  time_t horizon;
 
-  for (i = 0; (ctx = sk_rsync_ctx_t_value(rc->rsync_queue, i)) != NULL; ++i) {
+  assert(rc && r);
 
-    switch (ctx->state) {
+  horizon = (time_t) rc->host_retry_interval * HOST_HISTORY_HORIZON;
+  if (horizon < HOST_BACKOFF_MAX)
+    horizon = HOST_BACKOFF_MAX;
 
-    case rsync_state_running:
-      assert(ctx->fd >= 0);
-      FD_SET(ctx->fd, rfds);
-      if (ctx->fd > n)
-	n = ctx->fd;
-      if (!rc->rsync_timeout)
-	continue;
-      /* Fall through */
+  return r->started + horizon < now;
+}
 
-    case rsync_state_retry_wait:
-      if (when == 0 || ctx->deadline < when)
-	when = ctx->deadline;
-      /* Fall through */
+/**
+ * Record a completed fetch in the checkpoint journal.  The journal is
+ * line buffered, so each entry is on disk (well, in the kernel) as
+ * soon as we've written it, and a run killed at any point leaves a
+ * usable journal behind.
+ */
+static void journal_rsync(const rcynic_ctx_t *rc,
+			  const rsync_history_t *h)
+{
+  assert(rc && h);
 
-    default:
-      continue;
-    }
-  }
+  if (rc->journal == NULL)
+    return;
 
-  if (!when)
-    tv->tv_sec = rc->max_select_time;
-  else if (when < now)
-    tv->tv_sec = 0;
-  else if (when < now + rc->max_select_time)
-    tv->tv_sec = when - now;
-  else
-    tv->tv_sec = rc->max_select_time;
-  tv->tv_usec = 0;
-  return n;
+  if (fprintf(rc->journal, "%s%s %ld %ld\n", h->uri.s, (h->final_slash ? "/" : ""),
+	      (long) h->started, (long) h->finished) < 0)
+    logmsg(rc, log_sys_err, "Couldn't write to journal %s: %s",
+	   rc->journal_file, strerror(errno));
 }
 
 /**
- * Convert rsync_status_t to mib_counter_t.
- *
- * Maybe some day this will go away and we won't be carrying
- * essentially the same information in two different databases, but
- * for now I'll settle for cleaning up the duplicate code logic.
+ * Record that we've already attempted to synchronize a particular
+ * rsync URI.
  */
-static mib_counter_t rsync_status_to_mib_counter(rsync_status_t status)
+static void rsync_history_add(const rcynic_ctx_t *rc,
+			      rsync_ctx_t *ctx,
+			      const rsync_status_t status)
 {
-  switch (status) {
-  case rsync_status_done:	return rsync_transfer_succeeded;
-  case rsync_status_timed_out:	return rsync_transfer_timed_out;
-  case rsync_status_failed:	return rsync_transfer_failed;
-  case rsync_status_skipped:	return rsync_transfer_skipped;
-  default:
-    /*
-     * Keep GCC from whining about untested cases.
-     */
-    assert(status == rsync_status_done ||
-	   status == rsync_status_timed_out ||
-	   status == rsync_status_failed ||
-	   status == rsync_status_skipped);
-    return rsync_transfer_failed;
+  int final_slash = 0;
+  rsync_history_t *h;
+  uri_t uri;
+  size_t n;
+  char *s;
+
+  assert(rc && ctx && rc->rsync_history && rc->rsync_history_index && is_rsync(ctx->uri.s));
+
+  uri = ctx->uri;
+
+  while ((s = strrchr(uri.s, '/')) != NULL && s[1] == '\0') {
+    final_slash = 1;
+    *s = '\0';
+  }
+
+  if (status != rsync_status_done) {
+
+    n = SIZEOF_RSYNC + strcspn(uri.s + SIZEOF_RSYNC, "/");
+    assert(n < sizeof(uri.s));
+    uri.s[n] = '\0';
+    final_slash = 1;
+
+    if ((h = rsync_history_uri(rc, &uri)) != NULL) {
+      assert(h->status != rsync_status_done);
+      return;
+    }
+  }
+
+  if ((h = rsync_history_t_new()) != NULL) {
+    h->uri = uri;
+    h->status = status;
+    h->started = ctx->started;
+    h->finished = time(0);
+    h->final_slash = final_slash;
+    if (status == rsync_status_done) {
+      h->changes = ctx->changes;
+      ctx->changes = NULL;
+      if (h->changes != NULL)
+	sk_OPENSSL_STRING_sort(h->changes);
+    }
+  }
+
+  if (h == NULL || !sk_rsync_history_t_push(rc->rsync_history, h)) {
+    rsync_history_t_free(h);
+    logmsg(rc, log_sys_err,
+	   "Couldn't add %s to rsync_history, blundering onwards", uri.s);
+    return;
   }
+
+  rsync_history_index_add(rc->rsync_history_index, h);
+  fetch_table_note(rc, &h->uri);
+
+  if (status == rsync_status_done)
+    journal_rsync(rc, h);
 }
 
+
+
 /**
- * Manager for queue of rsync tasks in progress.
- *
- * General plan here is to process one completed child, or output
- * accumulated from children, or block if there is absolutely nothing
- * to do, on the theory that caller had nothing to do either or would
- * not have called us.  Once we've done something allegedly useful, we
- * return, because this is not the event loop; if and when the event
- * loop has nothing more important to do, we'll be called again.
- *
- * So this is the only place where the program blocks waiting for
- * children, but we only do it when we know there's nothing else
- * useful that we could be doing while we wait.
+ * Look up how long fetching a particular rsync URI took the last time
+ * we did it, as recorded in the host database.  Returns zero if we
+ * don't know.
  */
-static void rsync_mgr(rcynic_ctx_t *rc)
+static time_t rsync_history_expected(const rcynic_ctx_t *rc,
+				     const uri_t *uri)
 {
-  rsync_status_t rsync_status;
-  int i, n, pid_status = -1;
-  rsync_ctx_t *ctx = NULL;
-  time_t now = time(0);
-  struct timeval tv;
-  fd_set rfds;
-  pid_t pid;
+  rsync_history_t h, *hp;
   char *s;
+  int i;
 
-  assert(rc && rc->rsync_queue);
+  assert(rc && uri);
 
-  /*
-   * Check for exited subprocesses.
-   */
+  if (rc->previous_rsync_history == NULL || !is_rsync(uri->s))
+    return 0;
 
-  while ((pid = waitpid(-1, &pid_status, WNOHANG)) > 0) {
+  h.uri = *uri;
 
-    /*
-     * Child exited, handle it.
-     */
+  while ((s = strrchr(h.uri.s, '/')) != NULL && s[1] == '\0')
+    *s = '\0';
 
-    logmsg(rc, log_verbose, "Subprocess %u exited with status %d",
-	   (unsigned) pid, WEXITSTATUS(pid_status));
+  if ((i = sk_rsync_history_t_find(rc->previous_rsync_history, &h)) < 0 ||
+      (hp = sk_rsync_history_t_value(rc->previous_rsync_history, i)) == NULL ||
+      hp->finished < hp->started)
+    return 0;
 
-    for (i = 0; (ctx = sk_rsync_ctx_t_value(rc->rsync_queue, i)) != NULL; ++i)
-      if (ctx->pid == pid)
-	break;
-    if (ctx == NULL) {
-      assert(i == sk_rsync_ctx_t_num(rc->rsync_queue));
-      logmsg(rc, log_sys_err, "Couldn't find rsync context for pid %d", pid);
-      continue;
-    }
+  return hp->finished - hp->started;
+}
 
-    close(ctx->fd);
-    ctx->fd = -1;
 
-    if (ctx->buflen > 0) {
-      assert(ctx->buflen < sizeof(ctx->buffer));
-      ctx->buffer[ctx->buflen] = '\0';
-      do_one_rsync_log_line(rc, ctx);
-      ctx->buflen = 0;
-    }
 
-    switch (WEXITSTATUS(pid_status)) {
+/**
+ * Test whether an object is known not to have changed since the last
+ * run, in which case we may be able to skip the expensive parts of
+ * checking it.  This requires that we fetched its publication point
+ * successfully this run, that rsync's itemized output didn't mention
+ * it, and that it's byte-for-byte what we accepted last time.
+ */
+static int object_unchanged(const rcynic_ctx_t *rc,
+			    const uri_t *uri,
+			    const object_generation_t generation)
+{
+  const rsync_history_t *h;
+  path_t current, previous;
 
-    case 0:
-      rsync_status = rsync_status_done;
-      break;
+  assert(rc && uri);
 
-    case 5:			/* "Error starting client-server protocol" */
-      /*
-       * Handle remote rsyncd refusing to talk to us because we've
-       * exceeded its connection limit.  Back off for a short
-       * interval, then retry.
-       */
-      if (ctx->problem == rsync_problem_refused && ctx->tries < rc->max_retries) {
-	unsigned char r;
-	if (!RAND_bytes(&r, sizeof(r)))
-	  r = 60;
-	ctx->deadline = time(0) + rc->retry_wait_min + r;
-	ctx->state = rsync_state_retry_wait;
-	ctx->problem = rsync_problem_none;
-	ctx->pid = 0;
-	ctx->tries++;
-	logmsg(rc, log_telemetry, "Scheduling retry for %s", ctx->uri.s);
-	continue;
-      }
-      goto failure;
-
-    case 23:			/* "Partial transfer due to error" */
-      /*
-       * This appears to be a catch-all for "something bad happened
-       * trying to do what you asked me to do".  In the cases I've
-       * seen to date, this is things like "the directory you
-       * requested isn't there" or "NFS exploded when I tried to touch
-       * the directory".  These aren't network layer failures, so we
-       * (probably) shouldn't give up on the repository host.
-       */
-      rsync_status = rsync_status_done;
-      log_validation_status(rc, &ctx->uri, rsync_partial_transfer, object_generation_null);
-      break;
+  return (rc->reuse_unchanged &&
+	  generation == object_generation_current &&
+	  (h = rsync_history_uri(rc, uri)) != NULL &&
+	  h->status == rsync_status_done &&
+	  h->changes != NULL &&
+	  sk_OPENSSL_STRING_find(h->changes, uri->s) < 0 &&
+	  uri_to_filename(rc, uri, &current, &rc->unauthenticated) &&
+	  uri_to_filename(rc, uri, &previous, &rc->old_authenticated) &&
+	  files_identical(&current, &previous));
+}
 
-    default:
-    failure:
-      rsync_status = rsync_status_failed;
-      logmsg(rc, log_data_err, "rsync %u exited with status %d fetching %s",
-	     (unsigned) pid, WEXITSTATUS(pid_status), ctx->uri.s);
-      break;
-    }
 
-    if (rc->rsync_timeout && now >= ctx->deadline)
-      rsync_status = rsync_status_timed_out;
-    log_validation_status(rc, &ctx->uri,
-			  rsync_status_to_mib_counter(rsync_status),
-			  object_generation_null);
-    rsync_history_add(rc, ctx, rsync_status);
-    rsync_call_handler(rc, ctx, rsync_status);
-    (void) sk_rsync_ctx_t_delete_ptr(rc->rsync_queue, ctx);
-    free(ctx);
-    ctx = NULL;
-  }
 
-  if (pid == -1 && errno != EINTR && errno != ECHILD)
-    logmsg(rc, log_sys_err, "waitpid() returned error: %s", strerror(errno));
+/**
+ * Extract the hostname from an rsync URI.
+ */
+static int uri_to_hostname(const uri_t *uri, char *hostname, const size_t size)
+{
+  size_t n;
 
-  assert(rsync_count_running(rc) <= rc->max_parallel_fetches);
+  assert(uri && hostname && size > 0);
 
-  /*
-   * Look for rsync contexts that have become runable.  Odd loop
-   * structure is because rsync_run() might decide to remove the
-   * specified rsync task from the queue instead of running it.
-   */
-  for (i = 0; (ctx = sk_rsync_ctx_t_value(rc->rsync_queue, i)) != NULL; i++) {
-    n = sk_rsync_ctx_t_num(rc->rsync_queue);
-    if (ctx->state != rsync_state_running &&
-	rsync_runable(rc, ctx) &&
-	rsync_count_running(rc) < rc->max_parallel_fetches)
-      rsync_run(rc, ctx);
-    if (n > sk_rsync_ctx_t_num(rc->rsync_queue))
-      i--;
-  }
+  if (!is_rsync(uri->s))
+    return 0;
 
-  assert(rsync_count_running(rc) <= rc->max_parallel_fetches);
+  n = strcspn(uri->s + SIZEOF_RSYNC, "/");
 
-  /*
-   * Check for log text from subprocesses.
-   */
+  if (n == 0 || n >= size)
+    return 0;
 
-  n = rsync_construct_select(rc, now, &rfds, &tv);
+  memcpy(hostname, uri->s + SIZEOF_RSYNC, n);
+  hostname[n] = '\0';
+  return 1;
+}
 
-  if (n > 0 && tv.tv_sec)
-    logmsg(rc, log_verbose, "Waiting up to %u seconds for rsync, queued %d, runable %d, running %d, max %d",
-	   (unsigned) tv.tv_sec, sk_rsync_ctx_t_num(rc->rsync_queue), rsync_count_runable(rc),
-	   rsync_count_running(rc), rc->max_parallel_fetches);
+/**
+ * Find the health record for the repository host named by an rsync
+ * URI, optionally creating it.  Returns NULL if we're not keeping a
+ * host database.
+ */
+static host_health_t *host_health_find(const rcynic_ctx_t *rc,
+				       const uri_t *uri,
+				       const int create)
+{
+  host_health_t hh, *h;
+  int i;
 
-  if (n > 0) {
-#if 0
-    logmsg(rc, log_debug, "++ select(%d, %u)", n, tv.tv_sec);
-#endif
-    n = select(n + 1, &rfds, NULL, NULL, &tv);
-  }
+  assert(rc && uri);
 
-  if (n > 0) {
+  if (rc->host_health == NULL ||
+      !uri_to_hostname(uri, hh.hostname, sizeof(hh.hostname)))
+    return NULL;
 
-    for (i = 0; (ctx = sk_rsync_ctx_t_value(rc->rsync_queue, i)) != NULL; ++i) {
-      if (ctx->fd <= 0 || !FD_ISSET(ctx->fd, &rfds))
-	continue;
+  if ((i = sk_host_health_t_find(rc->host_health, &hh)) >= 0)
+    return sk_host_health_t_value(rc->host_health, i);
 
-      assert(ctx->buflen < sizeof(ctx->buffer) - 1);
+  if (!create)
+    return NULL;
 
-      while ((n = read(ctx->fd, ctx->buffer + ctx->buflen, sizeof(ctx->buffer) - 1 - ctx->buflen)) > 0) {
-	ctx->buflen += n;
-	assert(ctx->buflen < sizeof(ctx->buffer));
-	ctx->buffer[ctx->buflen] = '\0';
+  if ((h = host_health_t_new()) == NULL ||
+      !sk_host_health_t_push(rc->host_health, h)) {
+    host_health_t_free(h);
+    logmsg(rc, log_sys_err, "Couldn't add %s to host database, blundering onwards", hh.hostname);
+    return NULL;
+  }
 
-	while ((s = strchr(ctx->buffer, '\n')) != NULL) {
-	  *s++ = '\0';
-	  do_one_rsync_log_line(rc, ctx);
-	  assert(s > ctx->buffer && s < ctx->buffer + sizeof(ctx->buffer));
-	  ctx->buflen -= s - ctx->buffer;
-	  assert(ctx->buflen < sizeof(ctx->buffer));
-	  if (ctx->buflen > 0)
-	    memmove(ctx->buffer, s, ctx->buflen);
-	  ctx->buffer[ctx->buflen] = '\0';
-	}
+  strcpy(h->hostname, hh.hostname);
+  return h;
+}
 
-	if (ctx->buflen == sizeof(ctx->buffer) - 1) {
-	  ctx->buffer[sizeof(ctx->buffer) - 1] = '\0';
-	  do_one_rsync_log_line(rc, ctx);
-	  ctx->buflen = 0;
-	}
-      }
+/**
+ * Remember how long a fetch took, discarding the oldest sample if
+ * we've run out of room.
+ */
+static void host_health_add_duration(host_health_t *h, const time_t duration)
+{
+  assert(h && h->nduration <= HOST_LATENCY_SAMPLES);
 
-      if (n == 0) {
-	(void) close(ctx->fd);
-	ctx->fd = -1;
-	ctx->state = rsync_state_closed;
-      }
-    }
-  }
+  if (h->nduration == HOST_LATENCY_SAMPLES)
+    memmove(h->durations, h->durations + 1, sizeof(h->durations) - sizeof(*h->durations));
+  else
+    h->nduration++;
 
-  assert(rsync_count_running(rc) <= rc->max_parallel_fetches);
+  h->durations[h->nduration - 1] = duration < 0 ? 0 : (unsigned) duration;
+  h->nsamples++;
+}
 
-  /*
-   * Deal with children that have been running too long.
-   */
-  if (rc->rsync_timeout) {
-    for (i = 0; (ctx = sk_rsync_ctx_t_value(rc->rsync_queue, i)) != NULL; ++i) {
-      int sig;
-      if (ctx->pid <= 0 || now < ctx->deadline)
-	continue;
-      sig = ctx->tries++ < KILL_MAX ? SIGTERM : SIGKILL;
-      if (ctx->state != rsync_state_terminating) {
-	ctx->problem = rsync_problem_timed_out;
-	ctx->state = rsync_state_terminating;
-	ctx->tries = 0;
-	logmsg(rc, log_telemetry, "Subprocess %u is taking too long fetching %s, whacking it", (unsigned) ctx->pid, ctx->uri.s);
-	rsync_history_add(rc, ctx, rsync_status_timed_out);
-      } else if (sig == SIGTERM) {
-	logmsg(rc, log_verbose, "Whacking subprocess %u again", (unsigned) ctx->pid);
-      } else {
-	logmsg(rc, log_verbose, "Whacking subprocess %u with big hammer", (unsigned) ctx->pid);
-      }
-      (void) kill(ctx->pid, sig);
-      ctx->deadline = now + 1;
-    }
-  }
+/**
+ * qsort() comparision function for fetch durations.
+ */
+static int host_health_duration_cmp(const void *a, const void *b)
+{
+  const unsigned *u = a, *v = b;
+  return (*u > *v) - (*u < *v);
 }
 
 /**
- * Set up rsync context and attempt to start it.
+ * Return the given percentile of a host's recent fetch durations.
  */
-static void rsync_init(rcynic_ctx_t *rc,
-		       const uri_t *uri,
-		       void *cookie,
-		       void (*handler)(rcynic_ctx_t *, const rsync_ctx_t *, const rsync_status_t, const uri_t *, void *))
+static unsigned host_health_percentile(const host_health_t *h, const unsigned pct)
 {
-  rsync_ctx_t *ctx = NULL;
+  unsigned sorted[HOST_LATENCY_SAMPLES];
 
-  assert(rc && uri && strlen(uri->s) > SIZEOF_RSYNC);
+  assert(h && h->nduration > 0 && h->nduration <= HOST_LATENCY_SAMPLES && pct <= 100);
 
-  if (!rc->run_rsync) {
-    logmsg(rc, log_verbose, "rsync disabled, skipping %s", uri->s);
-    if (handler)
-      handler(rc, NULL, rsync_status_skipped, uri, cookie);
-    return;
-  }
+  memcpy(sorted, h->durations, h->nduration * sizeof(*sorted));
+  qsort(sorted, h->nduration, sizeof(*sorted), host_health_duration_cmp);
+  return sorted[((h->nduration - 1) * pct + 50) / 100];
+}
 
-  if (rsync_history_uri(rc, uri)) {
-    logmsg(rc, log_verbose, "rsync cache hit for %s", uri->s);
-    if (handler)
-      handler(rc, NULL, rsync_status_done, uri, cookie);
-    return;
-  }
+/**
+ * Figure out how long to let rsync run when fetching a URI.  If we
+ * have enough history for the repository host, we use a multiple of
+ * its 95th percentile fetch time, clamped to the configured timeout,
+ * so that a host which has gone into a tarpit doesn't eat the whole
+ * rsync-timeout interval every run.
+ */
+static time_t host_health_timeout(const rcynic_ctx_t *rc, const uri_t *uri)
+{
+  const host_health_t *h;
+  time_t timeout;
 
-  if ((ctx = malloc(sizeof(*ctx))) == NULL) {
-    logmsg(rc, log_sys_err, "malloc(rsync_ctxt_t) failed");
-    if (handler)
-      handler(rc, NULL, rsync_status_failed, uri, cookie);
-    return;
-  }
+  assert(rc && uri);
 
-  memset(ctx, 0, sizeof(*ctx));
-  ctx->uri = *uri;
-  ctx->handler = handler;
-  ctx->cookie = cookie;
-  ctx->fd = -1;
+  if (!rc->rsync_timeout || !rc->host_database ||
+      (h = host_health_find(rc, uri, 0)) == NULL ||
+      h->nduration < HOST_LATENCY_MIN_SAMPLES)
+    return rc->rsync_timeout;
 
-  if (!sk_rsync_ctx_t_push(rc->rsync_queue, ctx)) {
-    logmsg(rc, log_sys_err, "Couldn't push rsync state object onto queue, punting %s", ctx->uri.s);
-    rsync_call_handler(rc, ctx, rsync_status_failed);
-    free(ctx);
-    return;
-  }
+  timeout = (time_t) host_health_percentile(h, 95) * HOST_TIMEOUT_FACTOR;
 
-  if (rsync_conflicts(rc, ctx)) {
-    logmsg(rc, log_debug, "New rsync context %s is feeling conflicted", ctx->uri.s);
-    ctx->state = rsync_state_conflict_wait;
-  }
+  if (timeout < HOST_TIMEOUT_FLOOR)
+    timeout = HOST_TIMEOUT_FLOOR;
+  if (timeout > rc->rsync_timeout)
+    timeout = rc->rsync_timeout;
+
+  return timeout;
 }
 
 /**
- * rsync a trust anchor.
+ * Check whether a repository host has failed often enough recently
+ * that we should skip fetching from it and just use what we have.
+ * Backoff doubles with each consecutive failure past the threshold,
+ * up to HOST_BACKOFF_MAX; once the backoff interval has passed we let
+ * one fetch through as a probe.
  */
-static void rsync_ta(rcynic_ctx_t *rc,
-		     const uri_t *uri,
-		     tal_ctx_t *tctx,
-		     void (*handler)(rcynic_ctx_t *, const rsync_ctx_t *,
-				     const rsync_status_t, const uri_t *, void *))
+static int host_health_is_dead(const rcynic_ctx_t *rc, const uri_t *uri)
 {
-  assert(endswith(uri->s, ".cer"));
-  rsync_init(rc, uri, tctx, handler);
+  const host_health_t *h;
+  time_t backoff, now = time(0);
+  timestamp_t ts;
+  unsigned i;
+
+  assert(rc && uri);
+
+  if (rc->host_failure_threshold <= 0 || !rc->host_database ||
+      (h = host_health_find(rc, uri, 0)) == NULL ||
+      h->streak < (unsigned) rc->host_failure_threshold)
+    return 0;
+
+  backoff = rc->host_retry_interval;
+  for (i = rc->host_failure_threshold; i < h->streak && backoff < HOST_BACKOFF_MAX; i++)
+    backoff *= 2;
+  if (backoff > HOST_BACKOFF_MAX)
+    backoff = HOST_BACKOFF_MAX;
+
+  if (h->last_attempt + backoff <= now)
+    return 0;
+
+  backoff += h->last_attempt;
+  logmsg(rc, log_telemetry, "Host %s has failed %u times in a row, not fetching %s until %s",
+	 h->hostname, h->streak, uri->s, time_to_string(&ts, &backoff));
+  return 1;
 }
 
 /**
- * rsync an entire subtree, generally rooted at a SIA collection.
+ * Check whether a failed fetch means we couldn't talk to the host at
+ * all, as opposed to the host answering and then having trouble with
+ * what we asked for.  Only the former says anything about whether the
+ * host is dead.  The exit codes are rsync's "error starting
+ * client-server protocol" (5), "error in socket I/O" (10), "timeout
+ * in data send/receive" (30) and "timeout waiting for daemon
+ * connection" (35).
  */
-static void rsync_tree(rcynic_ctx_t *rc,
-		       const uri_t *uri,
-		       STACK_OF(walk_ctx_t) *wsk,
-		       void (*handler)(rcynic_ctx_t *, const rsync_ctx_t *,
-				       const rsync_status_t, const uri_t *, void *))
+static int host_health_connection_failure(const rsync_ctx_t *ctx,
+					  const rsync_status_t status,
+					  const int exit_status)
 {
-  assert(endswith(uri->s, "/"));
-  rsync_init(rc, uri, wsk, handler);
-}
+  assert(ctx);
 
-
+  if (status == rsync_status_timed_out ||
+      ctx->problem == rsync_problem_timed_out ||
+      ctx->problem == rsync_problem_refused)
+    return 1;
+
+  switch (exit_status) {
+  case 5:
+  case 10:
+  case 30:
+  case 35:
+    return 1;
+  default:
+    return 0;
+  }
+}
 
 /**
- * Clean up old stuff from previous rsync runs.  --delete doesn't help
- * if the URI changes and we never visit the old URI again.
+ * Update host statistics when an rsync process finishes.
+ *
+ * A host which fails several fetches in one run has still only failed
+ * one run, so the failure streak goes up at most once per host per
+ * run, and only for connection-level failures.
  */
-static int prune_unauthenticated(const rcynic_ctx_t *rc,
-				 const path_t *name,
-				 const size_t baselen)
+static void host_health_record(const rcynic_ctx_t *rc,
+			       const rsync_ctx_t *ctx,
+			       const rsync_status_t status,
+			       const int exit_status)
 {
-  path_t path;
-  struct dirent *d;
-  DIR *dir;
-  const char *slash;
+  host_health_t *h;
+  time_t now = time(0);
 
-  assert(rc && name && baselen > 0 && strlen(name->s) >= baselen);
+  assert(rc && ctx);
 
-  if (!is_directory(name)) {
-    logmsg(rc, log_usage_err, "prune: %s is not a directory", name->s);
-    return 0;
-  }
+  if ((h = host_health_find(rc, &ctx->uri, 1)) == NULL)
+    return;
 
-  if ((dir = opendir(name->s)) == NULL) {
-    logmsg(rc, log_sys_err, "prune: opendir() failed on %s: %s", name->s, strerror(errno));
-    return 0;
-  }
+  h->fetches++;
+  h->last_attempt = ctx->launched;
 
-  slash = endswith(name->s, "/") ? "" : "/";
+  switch (status) {
 
-  while ((d = readdir(dir)) != NULL) {
-    if (!strcmp(d->d_name, ".") || !strcmp(d->d_name, ".."))
-      continue;
-
-    if (snprintf(path.s, sizeof(path.s), "%s%s%s", name->s, slash, d->d_name) >= sizeof(path.s)) {
-      logmsg(rc, log_debug, "prune: %s%s%s too long", name->s, slash, d->d_name);
-      goto done;
-    }
+  case rsync_status_done:
+    h->streak = 0;
+    h->last_success = now;
+    host_health_add_duration(h, now - ctx->launched);
+    break;
 
-    if (validation_status_find_filename(rc, path.s + baselen)) {
-      logmsg(rc, log_debug, "prune: cache hit %s", path.s);
-      continue;
-    }
+  case rsync_status_timed_out:
+    /*
+     * Count the time we gave it as a sample, so that a host which has
+     * just gotten slower walks its timeout back up instead of being
+     * cut off at the same point every run.
+     */
+    h->timeouts++;
+    host_health_add_duration(h, now - ctx->launched);
+    /* Fall through */
 
-    if (unlink(path.s) == 0) {
-      logmsg(rc, log_debug, "prune: removed %s", path.s);
-      continue;
+  default:
+    h->failures++;
+    if (!h->failed && host_health_connection_failure(ctx, status, exit_status)) {
+      h->failed = 1;
+      h->streak++;
     }
-
-    if (prune_unauthenticated(rc, &path, baselen))
-      continue;
-
-    logmsg(rc, log_sys_err, "prune: removing %s failed: %s", path.s, strerror(errno));
-    goto done;
+    break;
   }
-
-  if (rmdir(name->s) == 0)
-    logmsg(rc, log_debug, "prune: removed %s", name->s);
-  else if (errno != ENOTEMPTY)
-    logmsg(rc, log_sys_err, "prune: couldn't remove %s: %s", name->s, strerror(errno));
-
- done:
-  closedir(dir);
-  return !d;
 }
 
-
+
 
 /**
- * Read a DER object using a BIO pipeline that hashes the file content
- * as we read it.  Returns the internal form of the parsed DER object,
- * sets the hash buffer (if specified) as a side effect.  The default
- * hash algorithm is SHA-256.
+ * Return count of how many rsync contexts are in running.
  */
-static void *read_file_with_hash(const path_t *filename,
-				 const ASN1_ITEM *it,
-				 const EVP_MD *md,
-				 hashbuf_t *hash)
+static int rsync_count_running(const rcynic_ctx_t *rc)
 {
-  void *result = NULL;
-  BIO *b;
+  const rsync_ctx_t *ctx;
+  int i, n = 0;
 
-  if ((b = BIO_new_file(filename->s, "rb")) == NULL)
-    goto error;
+  assert(rc && rc->rsync_queue);
 
-  if (hash != NULL) {
-    BIO *b2 = BIO_new(BIO_f_md());
-    if (b2 == NULL)
-      goto error;
-    if (md == NULL)
-      md = EVP_sha256();
-    if (!BIO_set_md(b2, md)) {
-      BIO_free(b2);
-      goto error;
+  for (i = 0; (ctx = sk_rsync_ctx_t_value(rc->rsync_queue, i)) != NULL; ++i) {
+    switch (ctx->state) {
+    case rsync_state_running:
+    case rsync_state_closed:
+    case rsync_state_terminating:
+      n++;
+    default:
+      continue;
     }
-    BIO_push(b2, b);
-    b = b2;
-  }
-
-  if ((result = ASN1_item_d2i_bio(it, b, NULL)) == NULL)
-    goto error;
-
-  if (hash != NULL) {
-    memset(hash, 0, sizeof(*hash));
-    BIO_gets(b, (char *) hash, sizeof(hash->h));
   }
 
- error:
-  BIO_free_all(b);
-  return result;
+  return n;
 }
 
 /**
- * Read and hash a certificate.
+ * Test whether two rsync URIs name the same repository host.
  */
-static X509 *read_cert(const path_t *filename, hashbuf_t *hash)
+static int same_host_uris(const uri_t *a, const uri_t *b)
 {
-  return read_file_with_hash(filename, ASN1_ITEM_rptr(X509), NULL, hash);
-}
+  size_t n;
 
-/**
- * Read and hash a CRL.
- */
-static X509_CRL *read_crl(const path_t *filename, hashbuf_t *hash)
-{
-  return read_file_with_hash(filename, ASN1_ITEM_rptr(X509_CRL), NULL, hash);
-}
+  assert(a && is_rsync(a->s) && b && is_rsync(b->s));
 
-/**
- * Read and hash a CMS message.
- */
-static CMS_ContentInfo *read_cms(const path_t *filename, hashbuf_t *hash)
-{
-  return read_file_with_hash(filename, ASN1_ITEM_rptr(CMS_ContentInfo), NULL, hash);
-}
+  n = SIZEOF_RSYNC + strcspn(a->s + SIZEOF_RSYNC, "/");
 
-
+  return !strncmp(a->s, b->s, n) && (b->s[n] == '/' || b->s[n] == '\0');
+}
 
 /**
- * Extract CRLDP data from a certificate.  Stops looking after finding
- * the first rsync URI.
+ * Return count of how many rsync contexts are running against the same
+ * repository host as a particular rsync context, including that
+ * context itself if it's running.
  */
-static int extract_crldp_uri(rcynic_ctx_t *rc,
-			     const uri_t *uri,
-			     const object_generation_t generation,
-			     const STACK_OF(DIST_POINT) *crldp,
-			     uri_t *result)
+static int rsync_count_running_host(const rcynic_ctx_t *rc,
+				    const rsync_ctx_t *ctx)
 {
-  DIST_POINT *d;
-  int i;
-
-  assert(rc && uri && crldp && result);
-
-  if (sk_DIST_POINT_num(crldp) != 1)
-    goto bad;
-
-  d = sk_DIST_POINT_value(crldp, 0);
+  const rsync_ctx_t *c;
+  int i, n = 0;
 
-  if (d->reasons || d->CRLissuer || !d->distpoint || d->distpoint->type != 0)
-    goto bad;
+  assert(rc && ctx && rc->rsync_queue);
 
-  for (i = 0; i < sk_GENERAL_NAME_num(d->distpoint->name.fullname); i++) {
-    GENERAL_NAME *n = sk_GENERAL_NAME_value(d->distpoint->name.fullname, i);
-    if (n == NULL || n->type != GEN_URI)
-      goto bad;
-    if (!is_rsync((char *) n->d.uniformResourceIdentifier->data))
-      log_validation_status(rc, uri, non_rsync_uri_in_extension, generation);
-    else if (sizeof(result->s) <= n->d.uniformResourceIdentifier->length)
-      log_validation_status(rc, uri, uri_too_long, generation);
-    else if (result->s[0])
-      log_validation_status(rc, uri, multiple_rsync_uris_in_extension, generation);
-    else
-      strcpy(result->s, (char *) n->d.uniformResourceIdentifier->data);
+  for (i = 0; (c = sk_rsync_ctx_t_value(rc->rsync_queue, i)) != NULL; ++i) {
+    switch (c->state) {
+    case rsync_state_running:
+    case rsync_state_closed:
+    case rsync_state_terminating:
+      if (same_host_uris(&c->uri, &ctx->uri))
+	n++;
+    default:
+      continue;
+    }
   }
 
-  return result->s[0];
-
- bad:
-  log_validation_status(rc, uri, malformed_crldp_extension, generation);
-  return 0;
+  return n;
 }
 
 /**
- * Extract SIA or AIA data from a certificate.
+ * Test whether starting an rsync context would exceed the limit on
+ * parallel fetches from its repository host.  The limit is the
+ * configured max-parallel-fetches-per-host value, lowered for the rest
+ * of this run if the host has refused connections from us.
  */
-static int extract_access_uri(rcynic_ctx_t *rc,
-			      const uri_t *uri,
-			      const object_generation_t generation,
-			      const AUTHORITY_INFO_ACCESS *xia,
-			      const int nid,
-			      uri_t *result,
-			      int *count,
-			      int (*relevant)(const char *))
+static int rsync_host_saturated(const rcynic_ctx_t *rc,
+				const rsync_ctx_t *ctx)
 {
-  int i;
+  const host_health_t *h;
+  int limit;
 
-  assert(rc && uri && xia && result && count);
+  assert(rc && ctx);
 
-  for (i = 0; i < sk_ACCESS_DESCRIPTION_num(xia); i++) {
-    ACCESS_DESCRIPTION *a = sk_ACCESS_DESCRIPTION_value(xia, i);
-    if (a == NULL || a->location->type != GEN_URI)
-      return 0;
-    if (OBJ_obj2nid(a->method) != nid)
-      continue;
-    ++*count;
-    if (relevant && !relevant((char *) a->location->d.uniformResourceIdentifier->data))
-      continue;
-    if (sizeof(result->s) <= a->location->d.uniformResourceIdentifier->length)
-      log_validation_status(rc, uri, uri_too_long, generation);
-    else if (result->s[0])
-      log_validation_status(rc, uri, multiple_rsync_uris_in_extension, generation);
-    else
-      strcpy(result->s, (char *) a->location->d.uniformResourceIdentifier->data);
-  }
-  return 1;
-}
+  limit = rc->max_fetches_per_host;
 
-
+  if ((h = host_health_find(rc, &ctx->uri, 0)) != NULL && h->limit > 0 &&
+      (limit <= 0 || h->limit < (unsigned) limit))
+    limit = h->limit;
+
+  return limit > 0 && rsync_count_running_host(rc, ctx) >= limit;
+}
 
 /**
- * Check to see whether an AKI extension is present, is of the right
- * form, and matches the issuer.
+ * Test whether an rsync context conflicts with anything that's
+ * currently runable, here or in another worker.
  */
-static int check_aki(rcynic_ctx_t *rc,
-		     const uri_t *uri,
-		     const X509 *issuer,
-		     const AUTHORITY_KEYID *aki,
-		     const object_generation_t generation)
+static int rsync_conflicts(const rcynic_ctx_t *rc,
+			   const rsync_ctx_t *ctx)
 {
-  assert(rc && uri && issuer && issuer->skid);
-
-  if (aki == NULL) {
-    log_validation_status(rc, uri, aki_extension_missing, generation);
-    return 0;
-  }
+  const rsync_ctx_t *c;
+  int i;
 
-  if (!aki->keyid || aki->serial || aki->issuer) {
-    log_validation_status(rc, uri, aki_extension_wrong_format, generation);
-    return 0;
-  }
+  assert(rc && ctx && rc->rsync_queue);
 
-  if (ASN1_OCTET_STRING_cmp(aki->keyid, issuer->skid)) {
-    log_validation_status(rc, uri, aki_extension_issuer_mismatch, generation);
-    return 0;
-  }
+  for (i = 0; (c = sk_rsync_ctx_t_value(rc->rsync_queue, i)) != NULL; ++i)
+    if (c != ctx &&
+	(c->state == rsync_state_initial ||
+	 c->state == rsync_state_running) &&
+	conflicting_uris(&c->uri, &ctx->uri))
+      return 1;
 
-  return 1;
+  return fetch_table_busy(rc, ctx);
 }
 
-
-
 /**
- * Check whether a Distinguished Name conforms to the rescert profile.
- * The profile is very restrictive: it only allows one mandatory
- * CommonName field and one optional SerialNumber field, both of which
- * must be of type PrintableString.
+ * Test whether a rsync context is runable at this time.
  */
-static int check_allowed_dn(X509_NAME *dn)
+static int rsync_runable(const rcynic_ctx_t *rc,
+			 const rsync_ctx_t *ctx)
 {
-  X509_NAME_ENTRY *ne;
-  ASN1_STRING *s;
-  int loc;
-
-  if (dn == NULL)
-    return 0;
+  assert(rc && ctx);
 
-  switch (X509_NAME_entry_count(dn)) {
+  switch (ctx->state) {
 
-  case 2:
-    if ((loc = X509_NAME_get_index_by_NID(dn, NID_serialNumber, -1)) < 0 ||
-	(ne = X509_NAME_get_entry(dn, loc)) == NULL ||
-	(s = X509_NAME_ENTRY_get_data(ne)) == NULL ||
-	ASN1_STRING_type(s) != V_ASN1_PRINTABLESTRING)
-      return 0;
+  case rsync_state_initial:
+  case rsync_state_running:
+    return 1;
 
-    /* Fall through */
+  case rsync_state_retry_wait:
+    return ctx->deadline <= time(0);
 
-  case 1:
-    if ((loc = X509_NAME_get_index_by_NID(dn, NID_commonName, -1)) < 0 ||
-	(ne = X509_NAME_get_entry(dn, loc)) == NULL ||
-	(s = X509_NAME_ENTRY_get_data(ne)) == NULL ||
-	ASN1_STRING_type(s) != V_ASN1_PRINTABLESTRING)
-      return 0;
+  case rsync_state_closed:
+  case rsync_state_terminating:
+    return 0;
 
-    return 1;
+  case rsync_state_conflict_wait:
+    return !rsync_conflicts(rc, ctx);
 
   default:
-    return 0;
+    break;
   }
+
+  return 0;
 }
 
+static void rsync_prefetch_callback(rcynic_ctx_t *, const rsync_ctx_t *,
+				    const rsync_status_t, const uri_t *, void *);
+
 /**
- * Check whether an ASN.1 TIME value conforms to RFC 5280 4.1.2.5.
+ * Return count of runable rsync contexts.  Prefetches nobody has asked
+ * for yet don't count, as the tree walk isn't waiting for them.
  */
-static int check_allowed_time_encoding(ASN1_TIME *t)
+static int rsync_count_runable(const rcynic_ctx_t *rc)
 {
-  switch (t->type) {
+  const rsync_ctx_t *ctx;
+  int i, n = 0;
 
-  case V_ASN1_UTCTIME:
-    return t->length == sizeof("yymmddHHMMSSZ") - 1;
+  assert(rc && rc->rsync_queue);
 
-  case  V_ASN1_GENERALIZEDTIME:
-    return (t->length == sizeof("yyyymmddHHMMSSZ") - 1 &&
-	    strcmp("205", (char *) t->data) <= 0);
+  for (i = 0; (ctx = sk_rsync_ctx_t_value(rc->rsync_queue, i)) != NULL; ++i)
+    if (ctx->handler != rsync_prefetch_callback && rsync_runable(rc, ctx))
+      n++;
 
-  }
-  return 0;
+  return n;
 }
 
 /**
- * Compare ASN1_TIME values.
+ * Call rsync context handler, if one is set.
  */
-static int asn1_time_cmp(ASN1_TIME *t1, ASN1_TIME *t2)
-{
-  ASN1_GENERALIZEDTIME *g1 = ASN1_TIME_to_generalizedtime(t1, NULL);
-  ASN1_GENERALIZEDTIME *g2 = ASN1_TIME_to_generalizedtime(t2, NULL);
-
-  int cmp = ASN1_STRING_cmp(g1, g2);
+static void rsync_call_handler(rcynic_ctx_t *rc,
+			       rsync_ctx_t *ctx,
+			       const rsync_status_t status)
+{
+  if (!ctx)
+    return;
 
-  ASN1_GENERALIZEDTIME_free(g1);
-  ASN1_GENERALIZEDTIME_free(g2);
+  switch (status) {
 
-  return cmp;
-}
+  case rsync_status_pending:
+  case rsync_status_done:
+    break;
 
-
+  case rsync_status_failed:
+    log_validation_status(rc, &ctx->uri, rsync_transfer_failed, object_generation_null);
+    break;
+
+  case rsync_status_timed_out:
+    log_validation_status(rc, &ctx->uri, rsync_transfer_timed_out, object_generation_null);
+    break;
+
+  case rsync_status_skipped:
+    log_validation_status(rc, &ctx->uri, rsync_transfer_skipped, object_generation_null);
+    break;
+  }
+
+  if (ctx->handler)
+    ctx->handler(rc, ctx, status, &ctx->uri, ctx->cookie);
+}
 
 /**
- * Attempt to read and check one CRL from disk.
+ * Run an rsync process.
  */
-
-static X509_CRL *check_crl_1(rcynic_ctx_t *rc,
-			     const uri_t *uri,
-			     path_t *path,
-			     const path_t *prefix,
-			     X509 *issuer,
-			     const object_generation_t generation)
+static void rsync_run(rcynic_ctx_t *rc,
+		      rsync_ctx_t *ctx)
 {
-  STACK_OF(X509_REVOKED) *revoked;
-  X509_CRL *crl = NULL;
-  EVP_PKEY *pkey;
-  int i, ret;
+  static const char * const rsync_cmd[] = {
+    "rsync", "--update", "--times", "--copy-links", "--itemize-changes"
+  };
+  static const char * const rsync_tree_args[] = {
+    "--recursive", "--delete"
+  };
 
-  assert(uri && path && issuer);
+  const char *argv[10];
+  path_t path;
+  int i, argc = 0, flags, pipe_fds[2];
 
-  if (!uri_to_filename(rc, uri, path, prefix) ||
-      (crl = read_crl(path, NULL)) == NULL)
-    goto punt;
+  pipe_fds[0] = pipe_fds[1] = -1;
 
-  if (X509_CRL_get_version(crl) != 1) {
-    log_validation_status(rc, uri, wrong_object_version, generation);
-    goto punt;
-  }
+  assert(rc && ctx && ctx->pid == 0 && ctx->state != rsync_state_running && rsync_runable(rc, ctx));
 
-  if (!crl->crl || !crl->crl->sig_alg || !crl->crl->sig_alg->algorithm ||
-      OBJ_obj2nid(crl->crl->sig_alg->algorithm) != NID_sha256WithRSAEncryption) {
-    log_validation_status(rc, uri, nonconformant_signature_algorithm, generation);
-    goto punt;
+  if (rsync_history_uri(rc, &ctx->uri)) {
+    logmsg(rc, log_verbose, "Late rsync cache hit for %s", ctx->uri.s);
+    rsync_call_handler(rc, ctx, rsync_status_done);
+    (void) sk_rsync_ctx_t_delete_ptr(rc->rsync_queue, ctx);
+    free(ctx);
+    return;
   }
 
-  if (!check_allowed_time_encoding(X509_CRL_get_lastUpdate(crl)) ||
-      !check_allowed_time_encoding(X509_CRL_get_nextUpdate(crl))) {
-    log_validation_status(rc, uri, nonconformant_asn1_time_value, generation);
-    goto punt;
+  if (fetch_table_seen(rc, &ctx->uri)) {
+    logmsg(rc, log_verbose, "Another worker already fetched %s", ctx->uri.s);
+    rsync_call_handler(rc, ctx, rsync_status_done);
+    (void) sk_rsync_ctx_t_delete_ptr(rc->rsync_queue, ctx);
+    free(ctx);
+    return;
   }
 
-  if (X509_cmp_current_time(X509_CRL_get_lastUpdate(crl)) > 0) {
-    log_validation_status(rc, uri, crl_not_yet_valid, generation);
-    goto punt;
+  if (!fetch_table_claim(rc, ctx)) {
+    logmsg(rc, log_debug, "Another worker is fetching something that conflicts with %s", ctx->uri.s);
+    ctx->state = rsync_state_conflict_wait;
+    return;
   }
 
-  if (X509_cmp_current_time(X509_CRL_get_nextUpdate(crl)) < 0) {
-    log_validation_status(rc, uri, stale_crl_or_manifest, generation);
-    if (!rc->allow_stale_crl)
-      goto punt;
-  }
+  assert(rsync_count_running(rc) < rc->max_parallel_fetches);
 
-  if (!check_aki(rc, uri, issuer, crl->akid, generation))
-    goto punt;
+  logmsg(rc, log_telemetry, "Fetching %s", ctx->uri.s);
 
-  if (crl->crl_number == NULL) {
-    log_validation_status(rc, uri, crl_number_extension_missing, generation);
-    goto punt;
-  }
+  sk_OPENSSL_STRING_pop_free(ctx->changes, OPENSSL_STRING_free);
+  if (rc->reuse_unchanged && (ctx->changes = sk_OPENSSL_STRING_new(uri_cmp)) == NULL)
+    logmsg(rc, log_sys_err, "Couldn't allocate change list for %s, blundering onwards", ctx->uri.s);
 
-  if (ASN1_INTEGER_cmp(crl->crl_number, asn1_zero) < 0) {
-    log_validation_status(rc, uri, crl_number_is_negative, generation);
-    goto punt;
-  }
+  memset(argv, 0, sizeof(argv));
 
-  if (ASN1_INTEGER_cmp(crl->crl_number, asn1_twenty_octets) > 0) {
-    log_validation_status(rc, uri, crl_number_out_of_range, generation);
-    goto punt;
+  for (i = 0; i < sizeof(rsync_cmd)/sizeof(*rsync_cmd); i++) {
+    assert(argc < sizeof(argv)/sizeof(*argv));
+    argv[argc++] = rsync_cmd[i];
   }
-
-  if (X509_CRL_get_ext_count(crl) != 2) {
-    log_validation_status(rc, uri, disallowed_x509v3_extension, generation);
-    goto punt;
+  if (endswith(ctx->uri.s, "/")) {
+    for (i = 0; i < sizeof(rsync_tree_args)/sizeof(*rsync_tree_args); i++) {
+      assert(argc < sizeof(argv)/sizeof(*argv));
+      argv[argc++] = rsync_tree_args[i];
+    }
   }
 
-  if (X509_NAME_cmp(X509_CRL_get_issuer(crl), X509_get_subject_name(issuer))) {
-    log_validation_status(rc, uri, crl_issuer_name_mismatch, generation);
-    goto punt;
+  if (rc->rsync_program)
+    argv[0] = rc->rsync_program;
+
+  if (!uri_to_filename(rc, &ctx->uri, &path, &rc->unauthenticated)) {
+    logmsg(rc, log_data_err, "Couldn't extract filename from URI: %s", ctx->uri.s);
+    goto lose;
   }
 
-  if (!check_allowed_dn(X509_CRL_get_issuer(crl))) {
-    log_validation_status(rc, uri, nonconformant_issuer_name, generation);
-    if (!rc->allow_nonconformant_name)
-      goto punt;
+  assert(argc < sizeof(argv)/sizeof(*argv));
+  argv[argc++] = ctx->uri.s;
+
+  assert(argc < sizeof(argv)/sizeof(*argv));
+  argv[argc++] = path.s;
+
+  if (!mkdir_maybe(rc, &path)) {
+    logmsg(rc, log_sys_err, "Couldn't make target directory: %s", path.s);
+    goto lose;
   }
 
-  if ((revoked = X509_CRL_get_REVOKED(crl)) != NULL) {
-    for (i = sk_X509_REVOKED_num(revoked) - 1; i >= 0; --i) {
-      if (X509_REVOKED_get_ext_count(sk_X509_REVOKED_value(revoked, i)) > 0) {
-	log_validation_status(rc, uri, disallowed_x509v3_extension, generation);
-	goto punt;
-      }
-    }
+  for (i = 0; i < argc; i++)
+    logmsg(rc, log_debug, "rsync argv[%d]: %s", i, argv[i]);
+
+  if (pipe(pipe_fds) < 0) {
+    logmsg(rc, log_sys_err, "pipe() failed: %s", strerror(errno));
+    goto lose;
   }
 
-  if ((pkey = X509_get_pubkey(issuer)) == NULL)
-    goto punt;
-  ret = X509_CRL_verify(crl, pkey);
-  EVP_PKEY_free(pkey);
+  switch ((ctx->pid = vfork())) {
 
-  if (ret > 0)
-    return crl;
+  case -1:
+     logmsg(rc, log_sys_err, "vfork() failed: %s", strerror(errno));
+     goto lose;
 
- punt:
-  X509_CRL_free(crl);
-  return NULL;
+  case 0:
+    /*
+     * Child
+     */
+#define whine(msg) ((void) write(2, msg, sizeof(msg) - 1))
+    if (close(pipe_fds[0]) < 0)
+      whine("close(pipe_fds[0]) failed\n");
+    else if (dup2(pipe_fds[1], 1) < 0)
+      whine("dup2(pipe_fds[1], 1) failed\n");
+    else if (dup2(pipe_fds[1], 2) < 0)
+      whine("dup2(pipe_fds[1], 2) failed\n");
+    else if (close(pipe_fds[1]) < 0)
+      whine("close(pipe_fds[1]) failed\n");
+    else if (execvp(argv[0], (char * const *) argv) < 0)
+      whine("execvp(argv[0], (char * const *) argv) failed\n");
+    whine("last system error: ");
+    write(2, strerror(errno), strlen(strerror(errno)));
+    whine("\n");
+    _exit(1);
+#undef whine
+
+  default:
+    /*
+     * Parent
+     */
+    ctx->fd = pipe_fds[0];
+    if ((flags = fcntl(ctx->fd, F_GETFL, 0)) == -1 ||
+	fcntl(ctx->fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+      logmsg(rc, log_sys_err, "fcntl(ctx->fd, F_[GS]ETFL, O_NONBLOCK) failed: %s",
+	     strerror(errno));
+      goto lose;
+    }
+    (void) close(pipe_fds[1]);
+    ctx->state = rsync_state_running;
+    ctx->problem = rsync_problem_none;
+    if (!ctx->started)
+      ctx->started = time(0);
+    ctx->launched = time(0);
+    if (rc->rsync_timeout)
+      ctx->deadline = ctx->launched + host_health_timeout(rc, &ctx->uri);
+    logmsg(rc, log_verbose, "Subprocess %u started, queued %d, runable %d, running %d, max %d, URI %s",
+	   (unsigned) ctx->pid, sk_rsync_ctx_t_num(rc->rsync_queue), rsync_count_runable(rc), rsync_count_running(rc), rc->max_parallel_fetches, ctx->uri.s);
+    rsync_call_handler(rc, ctx, rsync_status_pending);
+    return;
+
+  }
+
+ lose:
+  if (pipe_fds[0] != -1)
+    (void) close(pipe_fds[0]);
+  if (pipe_fds[1] != -1)
+    (void) close(pipe_fds[1]);
+  if (rc->rsync_queue && ctx)
+    (void) sk_rsync_ctx_t_delete_ptr(rc->rsync_queue, ctx);
+  sk_OPENSSL_STRING_pop_free(ctx->changes, OPENSSL_STRING_free);
+  ctx->changes = NULL;
+  rsync_call_handler(rc, ctx, rsync_status_failed);
+  if (ctx->pid > 0) {
+    (void) kill(ctx->pid, SIGKILL);
+    ctx->pid = 0;
+  }
+  fetch_table_release(rc, ctx);
 }
 
 /**
- * Check whether we already have a particular CRL, attempt to fetch it
- * and check issuer's signature if we don't.
- *
- * General plan here is to do basic checks on both current and backup
- * generation CRLs, then, if both generations pass all of our other
- * tests, pick the generation with the highest CRL number, to protect
- * against replay attacks.
+ * Process one line of rsync's output.  This is a separate function
+ * primarily to centralize scraping for magic error strings.
  */
-static X509_CRL *check_crl(rcynic_ctx_t *rc,
-			   const uri_t *uri,
-			   X509 *issuer)
+static void do_one_rsync_log_line(const rcynic_ctx_t *rc,
+				  rsync_ctx_t *ctx)
 {
-  X509_CRL *old_crl, *new_crl, *result = NULL;
-  path_t old_path, new_path;
+  unsigned u;
+  char *s;
 
-  if (uri_to_filename(rc, uri, &new_path, &rc->new_authenticated) &&
-      (new_crl = read_crl(&new_path, NULL)) != NULL)
-    return new_crl;
+  /*
+   * Send line to our log unless it's empty.
+   */
+  if (ctx->buffer[strspn(ctx->buffer, " \t\n\r")] != '\0')
+    logmsg(rc, log_telemetry, "rsync[%u]: %s", ctx->pid, ctx->buffer);
 
-  logmsg(rc, log_telemetry, "Checking CRL %s", uri->s);
+  /*
+   * Check for magic error strings
+   */
+  if ((s = strstr(ctx->buffer, "@ERROR: max connections")) != NULL) {
+    ctx->problem = rsync_problem_refused;
+    if (sscanf(s, "@ERROR: max connections (%u) reached -- try again later", &u) == 1)
+      logmsg(rc, log_verbose, "Subprocess %u reported limit of %u for %s", ctx->pid, u, ctx->uri.s);
+    return;
+  }
 
-  new_crl = check_crl_1(rc, uri, &new_path, &rc->unauthenticated,
-			issuer, object_generation_current);
-
-  old_crl = check_crl_1(rc, uri, &old_path, &rc->old_authenticated,
-			issuer, object_generation_backup);
-
-  if (!new_crl)
-    result = old_crl;
-
-  else if (!old_crl)
-    result = new_crl;
-
-  else {
-    ASN1_GENERALIZEDTIME *g_old = ASN1_TIME_to_generalizedtime(X509_CRL_get_lastUpdate(old_crl), NULL);
-    ASN1_GENERALIZEDTIME *g_new = ASN1_TIME_to_generalizedtime(X509_CRL_get_lastUpdate(new_crl), NULL);
-    int num_cmp = ASN1_INTEGER_cmp(old_crl->crl_number, new_crl->crl_number);
-    int date_cmp = (!g_old || !g_new) ? 0 : ASN1_STRING_cmp(g_old, g_new);
-
-    if (!g_old)
-      log_validation_status(rc, uri, bad_thisupdate, object_generation_backup);
-    if (!g_new)
-      log_validation_status(rc, uri, bad_thisupdate, object_generation_current);
-    if (num_cmp > 0)
-      log_validation_status(rc, uri, backup_number_higher_than_current, object_generation_current);
-    if (g_old && g_new && date_cmp > 0)
-      log_validation_status(rc, uri, backup_thisupdate_newer_than_current, object_generation_current);
-
-    if (num_cmp > 0 && (!g_old || !g_new || date_cmp > 0))
-      result = old_crl;
-    else
-      result = new_crl;
-
-    ASN1_GENERALIZEDTIME_free(g_old);
-    ASN1_GENERALIZEDTIME_free(g_new);
+  /*
+   * Collect --itemize-changes output.  Lines look like
+   * "YXcstpoguax name" or "*deleting   name"; we don't care what
+   * changed, just that rsync thought something about the name did,
+   * so we record every itemized name as changed.  Anything we can't
+   * record means we don't know what changed, so we give up on the
+   * whole list.  We don't check for duplicates here: searching the
+   * stack would re-sort it after every push, and an occasional
+   * duplicate does no harm to lookups once the fetch has finished.
+   */
+  if (ctx->changes != NULL &&
+      strlen(ctx->buffer) > 12 && ctx->buffer[11] == ' ' &&
+      strchr("<>ch.*", ctx->buffer[0]) != NULL) {
+    uri_t uri = ctx->uri;
+    s = ctx->buffer + 12;
+    if (endswith(uri.s, "/") && strlen(uri.s) + strlen(s) >= sizeof(uri.s))
+      uri.s[0] = '\0';
+    else if (endswith(uri.s, "/"))
+      strcat(uri.s, s);
+    if (uri.s[0] == '\0' ||
+	!sk_OPENSSL_STRING_push_strdup(ctx->changes, uri.s)) {
+      sk_OPENSSL_STRING_pop_free(ctx->changes, OPENSSL_STRING_free);
+      ctx->changes = NULL;
+    }
   }
-
-  if (result && result == new_crl)
-    install_object(rc, uri, &new_path, object_generation_current);
-  else if (!access(new_path.s, F_OK))
-    log_validation_status(rc, uri, object_rejected, object_generation_current);
-
-  if (result && result == old_crl)
-    install_object(rc, uri, &old_path, object_generation_backup);
-  else if (!result && !access(old_path.s, F_OK))
-    log_validation_status(rc, uri, object_rejected, object_generation_backup);
-
-  if (result != new_crl)
-    X509_CRL_free(new_crl);
-
-  if (result != old_crl)
-    X509_CRL_free(old_crl);
-
-  return result;
 }
 
+/**
+ * Write end of the pipe the SIGCHLD handler uses to wake up select().
+ * This has to be a global, since signal handlers don't get arguments.
+ */
+static int sigchld_write_fd = -1;
 
 /**
- * Check digest of a CRL we've already accepted.
+ * SIGCHLD handler.  All we do here is poke the self-pipe, so that
+ * rsync_mgr() wakes up and reaps the child instead of our having to
+ * poll for it.
  */
-static int check_crl_digest(const rcynic_ctx_t *rc,
-			    const uri_t *uri,
-			    const unsigned char *hash,
-			    const size_t hashlen)
+static void sigchld_handler(int sig)
 {
-  X509_CRL *crl = NULL;
-  hashbuf_t hashbuf;
-  path_t path;
-  int result;
-
-  assert(rc && uri && hash);
-
-  if (!uri_to_filename(rc, uri, &path, &rc->new_authenticated) ||
-      (crl = read_crl(&path, &hashbuf)) == NULL)
-    return 0;
-
-  result = hashlen <= sizeof(hashbuf.h) && !memcmp(hashbuf.h, hash, hashlen);
-
-  X509_CRL_free(crl);
-
-  return result;
+  int saved_errno = errno;
+  (void) write(sigchld_write_fd, "", 1);
+  errno = saved_errno;
 }
 
-
-
 /**
- * Validation callback function for use with x509_verify_cert().
+ * Set up the SIGCHLD self-pipe.
  */
-static int check_x509_cb(int ok, X509_STORE_CTX *ctx)
+static int sigchld_setup(rcynic_ctx_t *rc)
 {
-  rcynic_x509_store_ctx_t *rctx = (rcynic_x509_store_ctx_t *) ctx;
-  mib_counter_t code;
-
-  assert(rctx != NULL);
+  struct sigaction sa;
+  int i, flags;
 
-  switch (ctx->error) {
-  case X509_V_OK:
-    return ok;
+  assert(rc);
 
-  case X509_V_ERR_SUBJECT_ISSUER_MISMATCH:
-    /*
-     * Informational events, not really errors.  ctx->check_issued()
-     * is called in many places where failure to find an issuer is not
-     * a failure for the calling function.  Just leave these alone.
-     */
-    return ok;
+  if (pipe(rc->sigchld_fds) < 0) {
+    logmsg(rc, log_sys_err, "pipe() failed: %s", strerror(errno));
+    rc->sigchld_fds[0] = rc->sigchld_fds[1] = -1;
+    return 0;
+  }
 
-  case X509_V_ERR_CRL_HAS_EXPIRED:
-    /*
-     * This isn't really an error, exactly.  CRLs don't really
-     * "expire".  What OpenSSL really means by this error is just
-     * "it's now later than the issuer said it intended to publish a
-     * new CRL".  Whether we treat this as an error or not is
-     * configurable, see the allow_stale_crl parameter.
-     *
-     * Deciding whether to allow stale CRLs is check_crl_1()'s job,
-     * not ours.  By the time this callback occurs, we've already
-     * accepted the CRL; this callback is just notifying us that the
-     * object being checked is tainted by a stale CRL.  So we mark the
-     * object as tainted and carry on.
-     */
-    log_validation_status(rctx->rc, &rctx->subject->uri, tainted_by_stale_crl, rctx->subject->generation);
-    ok = 1;
-    return ok;
+  for (i = 0; i < 2; i++) {
+    if ((flags = fcntl(rc->sigchld_fds[i], F_GETFL, 0)) == -1 ||
+	fcntl(rc->sigchld_fds[i], F_SETFL, flags | O_NONBLOCK) == -1 ||
+	fcntl(rc->sigchld_fds[i], F_SETFD, FD_CLOEXEC) == -1) {
+      logmsg(rc, log_sys_err, "fcntl() failed on SIGCHLD pipe: %s", strerror(errno));
+      return 0;
+    }
+  }
 
-  case X509_V_ERR_UNABLE_TO_GET_ISSUER_CERT:
-    /*
-     * This is another error that's only an error in the strange world
-     * of OpenSSL, but a more serious one.  By default, OpenSSL
-     * expects all trust anchors to be self-signed.  This is not a
-     * PKIX requirement, it's just an OpenSSL thing, but one violates
-     * it at one's peril, because the only way to convince OpenSSL to
-     * allow a non-self-signed trust anchor is to intercept this
-     * "error" in the verify callback handler.
-     *
-     * So this program supports non-self-signed trust anchors, but be
-     * warned that enabling this feature may cause this program's
-     * output not to work with other OpenSSL-based applications.
-     */
-    if (rctx->rc->allow_non_self_signed_trust_anchor)
-      ok = 1;
-    log_validation_status(rctx->rc, &rctx->subject->uri, trust_anchor_not_self_signed, rctx->subject->generation);
-    return ok;
+  sigchld_write_fd = rc->sigchld_fds[1];
 
-  /*
-   * Select correct MIB counter for every known OpenSSL verify errors
-   * except the ones we handle explicitly above, then fall through to
-   * common handling for all of these.
-   */
-#define QV(x)							\
-  case x:							\
-    code = mib_openssl_##x;					\
-    break;
-    MIB_COUNTERS_FROM_OPENSSL;
-#undef	QV
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = sigchld_handler;
+  sigemptyset(&sa.sa_mask);
+  sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
 
-  default:
-    code = unknown_openssl_verify_error;
-    break;
+  if (sigaction(SIGCHLD, &sa, NULL) < 0) {
+    logmsg(rc, log_sys_err, "sigaction(SIGCHLD) failed: %s", strerror(errno));
+    return 0;
   }
 
-  log_validation_status(rctx->rc, &rctx->subject->uri, code, rctx->subject->generation);
-  return ok;
+  return 1;
 }
 
 /**
- * Check crypto aspects of a certificate, policy OID, RFC 3779 path
- * validation, and conformance to the RPKI certificate profile.
+ * Tear down the SIGCHLD self-pipe.
  */
-static int check_x509(rcynic_ctx_t *rc,
-		      STACK_OF(walk_ctx_t) *wsk,
-		      const uri_t *uri,
-		      X509 *x,
-		      certinfo_t *certinfo,
-		      const object_generation_t generation)
+static void sigchld_cleanup(rcynic_ctx_t *rc)
 {
-  walk_ctx_t *w = walk_ctx_stack_head(wsk);
-  rcynic_x509_store_ctx_t rctx;
-  EVP_PKEY *issuer_pkey = NULL, *subject_pkey = NULL;
-  unsigned long flags = (X509_V_FLAG_POLICY_CHECK | X509_V_FLAG_EXPLICIT_POLICY | X509_V_FLAG_X509_STRICT);
-  AUTHORITY_INFO_ACCESS *sia = NULL, *aia = NULL;
-  STACK_OF(POLICYINFO) *policies = NULL;
-  ASN1_BIT_STRING *ski_pubkey = NULL;
-  STACK_OF(DIST_POINT) *crldp = NULL;
-  EXTENDED_KEY_USAGE *eku = NULL;
-  BASIC_CONSTRAINTS *bc = NULL;
-  hashbuf_t ski_hashbuf;
-  unsigned ski_hashlen, afi;
-  int i, ok, crit, loc, ex_count, routercert = 0, ret = 0;
+  int i;
 
-  assert(rc && wsk && w && uri && x && w->cert);
+  assert(rc);
 
-  /*
-   * Cleanup logic will explode if rctx.ctx hasn't been initialized,
-   * so we need to do this before running any test that can fail.
-   */
-  if (!X509_STORE_CTX_init(&rctx.ctx, rc->x509_store, x, NULL))
-    return 0;
+  if (sigchld_write_fd >= 0)
+    (void) signal(SIGCHLD, SIG_DFL);
+  sigchld_write_fd = -1;
 
-  /*
-   * certinfo == NULL means x is a self-signed trust anchor.
-   */
-  if (certinfo == NULL)
-    certinfo = &w->certinfo;
+  for (i = 0; i < 2; i++) {
+    if (rc->sigchld_fds[i] >= 0)
+      (void) close(rc->sigchld_fds[i]);
+    rc->sigchld_fds[i] = -1;
+  }
+}
 
-  memset(certinfo, 0, sizeof(*certinfo));
+/**
+ * Construct select() arguments.
+ *
+ * We always include the SIGCHLD pipe, so that select() returns when
+ * a child exits even if it closed its output earlier.  We don't block
+ * at all if the task queue has work waiting, or if the rsync queue is
+ * empty, which can happen when rsync_run() finds that it doesn't need
+ * to run the last context after all.
+ */
+static int rsync_construct_select(const rcynic_ctx_t *rc,
+				  const time_t now,
+				  fd_set *rfds,
+				  struct timeval *tv)
+{
+  rsync_ctx_t *ctx;
+  time_t when = 0;
+  int i, n = 0;
 
-  certinfo->uri = *uri;
-  certinfo->generation = generation;
+  assert(rc && rc->rsync_queue && rfds && tv && rc->max_select_time >= 0);
 
-  if (ASN1_INTEGER_cmp(X509_get_serialNumber(x), asn1_zero) <= 0 ||
-      ASN1_INTEGER_cmp(X509_get_serialNumber(x), asn1_twenty_octets) > 0) {
-    log_validation_status(rc, uri, bad_certificate_serial_number, generation);
-    goto done;
-  }
+  FD_ZERO(rfds);
 
-  if (!check_allowed_time_encoding(X509_get_notBefore(x)) ||
-      !check_allowed_time_encoding(X509_get_notAfter(x))) {
-    log_validation_status(rc, uri, nonconformant_asn1_time_value, generation);
-    goto done;
+  if (rc->sigchld_fds[0] >= 0) {
+    FD_SET(rc->sigchld_fds[0], rfds);
+    n = rc->sigchld_fds[0];
   }
 
-  /*
-   * Apparently nothing ever looks at these fields, so there are no
-   * API functions for them.  We wouldn't bother either if they
-   * weren't forbidden by the RPKI certificate profile.
-   */
-  if (!x->cert_info || x->cert_info->issuerUID || x->cert_info->subjectUID) {
-    log_validation_status(rc, uri, nonconformant_certificate_uid, generation);
-    goto done;
-  }
+  for (i = 0; (ctx = sk_rsync_ctx_t_value(rc->rsync_queue, i)) != NULL; ++i) {
 
-  /*
-   * Keep track of allowed extensions we've seen.  Once we've
-   * processed all the ones we expect, anything left is an error.
-   */
-  ex_count = X509_get_ext_count(x);
+    switch (ctx->state) {
 
-  /*
-   * We don't use X509_check_ca() to set certinfo->ca anymore, because
-   * it's not paranoid enough to enforce the RPKI certificate profile,
-   * but we still call it because we need it (or something) to invoke
-   * x509v3_cache_extensions() for us.
-   */
-  (void) X509_check_ca(x);
+    case rsync_state_running:
+      assert(ctx->fd >= 0);
+      FD_SET(ctx->fd, rfds);
+      if (ctx->fd > n)
+	n = ctx->fd;
+      if (!rc->rsync_timeout)
+	continue;
+      /* Fall through */
 
-  if ((bc = X509_get_ext_d2i(x, NID_basic_constraints, &crit, NULL)) != NULL) {
-    ex_count--;
-    if (!crit || bc->ca <= 0 || bc->pathlen != NULL) {
-      log_validation_status(rc, uri, malformed_basic_constraints, generation);
-      goto done;
+    case rsync_state_retry_wait:
+      if (when == 0 || ctx->deadline < when)
+	when = ctx->deadline;
+      continue;
+
+    case rsync_state_conflict_wait:
+      /*
+       * Nobody tells us when another worker's fetch finishes, so if
+       * that's what we're waiting for, we have to poll.
+       */
+      if (rc->fetch_table != NULL && (when == 0 || now + 1 < when))
+	when = now + 1;
+      continue;
+
+    default:
+      continue;
     }
   }
 
-  certinfo->ca = bc != NULL;
+  if (rc->task_queue->count > 0 || sk_rsync_ctx_t_num(rc->rsync_queue) == 0)
+    tv->tv_sec = 0;
+  else if (!when)
+    tv->tv_sec = rc->max_select_time;
+  else if (when < now)
+    tv->tv_sec = 0;
+  else if (when < now + rc->max_select_time)
+    tv->tv_sec = when - now;
+  else
+    tv->tv_sec = rc->max_select_time;
+  tv->tv_usec = 0;
+  return n;
+}
+
+/**
+ * Convert rsync_status_t to mib_counter_t.
+ *
+ * Maybe some day this will go away and we won't be carrying
+ * essentially the same information in two different databases, but
+ * for now I'll settle for cleaning up the duplicate code logic.
+ */
+static mib_counter_t rsync_status_to_mib_counter(rsync_status_t status)
+{
+  switch (status) {
+  case rsync_status_done:	return rsync_transfer_succeeded;
+  case rsync_status_timed_out:	return rsync_transfer_timed_out;
+  case rsync_status_failed:	return rsync_transfer_failed;
+  case rsync_status_skipped:	return rsync_transfer_skipped;
+  default:
+    /*
+     * Keep GCC from whining about untested cases.
+     */
+    assert(status == rsync_status_done ||
+	   status == rsync_status_timed_out ||
+	   status == rsync_status_failed ||
+	   status == rsync_status_skipped);
+    return rsync_transfer_failed;
+  }
+}
+
+/**
+ * Manager for queue of rsync tasks in progress.
+ *
+ * General plan here is to process one completed child, or output
+ * accumulated from children, or block if there is absolutely nothing
+ * to do, on the theory that caller had nothing to do either or would
+ * not have called us.  Once we've done something allegedly useful, we
+ * return, because this is not the event loop; if and when the event
+ * loop has nothing more important to do, we'll be called again.
+ *
+ * So this is the only place where the program blocks waiting for
+ * children, but we only do it when we know there's nothing else
+ * useful that we could be doing while we wait.  The SIGCHLD pipe
+ * wakes us when a child exits, so we never have to spin waiting for
+ * a child which has already closed its output.
+ */
+static void rsync_mgr(rcynic_ctx_t *rc)
+{
+  rsync_status_t rsync_status;
+  int i, n, pid_status = -1;
+  rsync_ctx_t *ctx = NULL;
+  host_health_t *h;
+  time_t now = time(0);
+  struct timeval tv;
+  fd_set rfds;
+  pid_t pid;
+  char *s, c;
+
+  assert(rc && rc->rsync_queue);
+
+  /*
+   * Check for exited subprocesses.
+   */
+
+  while ((pid = waitpid(-1, &pid_status, WNOHANG)) > 0) {
+
+    /*
+     * Child exited, handle it.
+     */
+
+    logmsg(rc, log_verbose, "Subprocess %u exited with status %d",
+	   (unsigned) pid, WEXITSTATUS(pid_status));
+
+    for (i = 0; (ctx = sk_rsync_ctx_t_value(rc->rsync_queue, i)) != NULL; ++i)
+      if (ctx->pid == pid)
+	break;
+    if (ctx == NULL) {
+      assert(i == sk_rsync_ctx_t_num(rc->rsync_queue));
+      logmsg(rc, log_sys_err, "Couldn't find rsync context for pid %d", pid);
+      continue;
+    }
+
+    close(ctx->fd);
+    ctx->fd = -1;
+
+    if (ctx->buflen > 0) {
+      assert(ctx->buflen < sizeof(ctx->buffer));
+      ctx->buffer[ctx->buflen] = '\0';
+      do_one_rsync_log_line(rc, ctx);
+      ctx->buflen = 0;
+    }
+
+    switch (WEXITSTATUS(pid_status)) {
+
+    case 0:
+      rsync_status = rsync_status_done;
+      break;
+
+    case 5:			/* "Error starting client-server protocol" */
+      /*
+       * Handle remote rsyncd refusing to talk to us because we've
+       * exceeded its connection limit.  Back off for a short
+       * interval, then retry.
+       */
+      if (ctx->problem == rsync_problem_refused &&
+	  (h = host_health_find(rc, &ctx->uri, 1)) != NULL)
+	h->refusals++;
+      if (ctx->problem == rsync_problem_refused && ctx->tries < rc->max_retries) {
+	unsigned char r;
+	/*
+	 * If we still have other fetches running against this host,
+	 * we're probably the ones who used up its connection limit, so
+	 * lower our limit for this host and retry as soon as one of
+	 * our own fetches finishes rather than sleeping.
+	 */
+	if (h != NULL && (n = rsync_count_running_host(rc, ctx) - 1) > 0) {
+	  if (h->limit == 0 || n < h->limit) {
+	    h->limit = n;
+	    logmsg(rc, log_verbose, "Limiting parallel fetches from %s to %d", h->hostname, n);
+	  }
+	  ctx->deadline = time(0);
+	} else {
+	  if (!RAND_bytes(&r, sizeof(r)))
+	    r = 60;
+	  ctx->deadline = time(0) + rc->retry_wait_min + r;
+	}
+	ctx->state = rsync_state_retry_wait;
+	ctx->problem = rsync_problem_none;
+	ctx->pid = 0;
+	sk_OPENSSL_STRING_pop_free(ctx->changes, OPENSSL_STRING_free);
+	ctx->changes = NULL;
+	ctx->tries++;
+	fetch_table_release(rc, ctx);
+	logmsg(rc, log_telemetry, "Scheduling retry for %s", ctx->uri.s);
+	continue;
+      }
+      goto failure;
+
+    case 23:			/* "Partial transfer due to error" */
+      /*
+       * This appears to be a catch-all for "something bad happened
+       * trying to do what you asked me to do".  In the cases I've
+       * seen to date, this is things like "the directory you
+       * requested isn't there" or "NFS exploded when I tried to touch
+       * the directory".  These aren't network layer failures, so we
+       * (probably) shouldn't give up on the repository host.
+       */
+      rsync_status = rsync_status_done;
+      log_validation_status(rc, &ctx->uri, rsync_partial_transfer, object_generation_null);
+      sk_OPENSSL_STRING_pop_free(ctx->changes, OPENSSL_STRING_free);
+      ctx->changes = NULL;
+      break;
+
+    default:
+    failure:
+      rsync_status = rsync_status_failed;
+      logmsg(rc, log_data_err, "rsync %u exited with status %d fetching %s",
+	     (unsigned) pid, WEXITSTATUS(pid_status), ctx->uri.s);
+      break;
+    }
+
+    if (rc->rsync_timeout && now >= ctx->deadline)
+      rsync_status = rsync_status_timed_out;
+    log_validation_status(rc, &ctx->uri,
+			  rsync_status_to_mib_counter(rsync_status),
+			  object_generation_null);
+    rsync_history_add(rc, ctx, rsync_status);
+    fetch_table_release(rc, ctx);
+    host_health_record(rc, ctx, rsync_status, WEXITSTATUS(pid_status));
+    rsync_call_handler(rc, ctx, rsync_status);
+    (void) sk_rsync_ctx_t_delete_ptr(rc->rsync_queue, ctx);
+    sk_OPENSSL_STRING_pop_free(ctx->changes, OPENSSL_STRING_free);
+    free(ctx);
+    ctx = NULL;
+  }
+
+  if (pid == -1 && errno != EINTR && errno != ECHILD)
+    logmsg(rc, log_sys_err, "waitpid() returned error: %s", strerror(errno));
+
+  assert(rsync_count_running(rc) <= rc->max_parallel_fetches);
+
+  /*
+   * Look for rsync contexts that have become runable and start them
+   * while we have free slots.  Among the candidates, pick the one that
+   * took longest last time, so that the slow repositories which set
+   * the length of the whole run get started first and quick ones fill
+   * in around them.  Ties, including everything we have no history
+   * for, go to the one whose repository host has the fewest fetches in
+   * progress, so that slots get handed out round-robin across hosts
+   * instead of all going to whichever host comes first in tree walk
+   * order.  rsync_run() might decide to remove the selected context
+   * from the queue instead of running it; either way it stops being a
+   * candidate.
+   */
+  while (rsync_count_running(rc) < rc->max_parallel_fetches) {
+    rsync_ctx_t *best = NULL;
+    int load, best_load = 0;
+
+    for (i = 0; (ctx = sk_rsync_ctx_t_value(rc->rsync_queue, i)) != NULL; i++) {
+      if (ctx->state == rsync_state_running ||
+	  !rsync_runable(rc, ctx) ||
+	  rsync_host_saturated(rc, ctx))
+	continue;
+      load = rsync_count_running_host(rc, ctx);
+      if (best == NULL || ctx->expected > best->expected ||
+	  (ctx->expected == best->expected && load < best_load)) {
+	best = ctx;
+	best_load = load;
+      }
+    }
+
+    if (best == NULL)
+      break;
+
+    rsync_run(rc, best);
+  }
+
+  assert(rsync_count_running(rc) <= rc->max_parallel_fetches);
+
+  /*
+   * Check for log text from subprocesses.
+   */
+
+  n = rsync_construct_select(rc, now, &rfds, &tv);
+
+  if (n > 0 && tv.tv_sec)
+    logmsg(rc, log_verbose, "Waiting up to %u seconds for rsync, queued %d, runable %d, running %d, max %d",
+	   (unsigned) tv.tv_sec, sk_rsync_ctx_t_num(rc->rsync_queue), rsync_count_runable(rc),
+	   rsync_count_running(rc), rc->max_parallel_fetches);
+
+  if (n > 0) {
+#if 0
+    logmsg(rc, log_debug, "++ select(%d, %u)", n, tv.tv_sec);
+#endif
+    n = select(n + 1, &rfds, NULL, NULL, &tv);
+  }
+
+  if (n > 0) {
+
+    if (rc->sigchld_fds[0] >= 0 && FD_ISSET(rc->sigchld_fds[0], &rfds))
+      while (read(rc->sigchld_fds[0], &c, 1) > 0)
+	;
+
+    for (i = 0; (ctx = sk_rsync_ctx_t_value(rc->rsync_queue, i)) != NULL; ++i) {
+      if (ctx->fd <= 0 || !FD_ISSET(ctx->fd, &rfds))
+	continue;
+
+      assert(ctx->buflen < sizeof(ctx->buffer) - 1);
+
+      while ((n = read(ctx->fd, ctx->buffer + ctx->buflen, sizeof(ctx->buffer) - 1 - ctx->buflen)) > 0) {
+	ctx->buflen += n;
+	assert(ctx->buflen < sizeof(ctx->buffer));
+	ctx->buffer[ctx->buflen] = '\0';
+
+	while ((s = strchr(ctx->buffer, '\n')) != NULL) {
+	  *s++ = '\0';
+	  do_one_rsync_log_line(rc, ctx);
+	  assert(s > ctx->buffer && s < ctx->buffer + sizeof(ctx->buffer));
+	  ctx->buflen -= s - ctx->buffer;
+	  assert(ctx->buflen < sizeof(ctx->buffer));
+	  if (ctx->buflen > 0)
+	    memmove(ctx->buffer, s, ctx->buflen);
+	  ctx->buffer[ctx->buflen] = '\0';
+	}
+
+	if (ctx->buflen == sizeof(ctx->buffer) - 1) {
+	  ctx->buffer[sizeof(ctx->buffer) - 1] = '\0';
+	  do_one_rsync_log_line(rc, ctx);
+	  ctx->buflen = 0;
+	}
+      }
+
+      if (n == 0) {
+	(void) close(ctx->fd);
+	ctx->fd = -1;
+	ctx->state = rsync_state_closed;
+      }
+    }
+  }
+
+  assert(rsync_count_running(rc) <= rc->max_parallel_fetches);
+
+  /*
+   * Deal with children that have been running too long.
+   */
+  if (rc->rsync_timeout) {
+    for (i = 0; (ctx = sk_rsync_ctx_t_value(rc->rsync_queue, i)) != NULL; ++i) {
+      int sig;
+      if (ctx->pid <= 0 || now < ctx->deadline)
+	continue;
+      sig = ctx->tries++ < KILL_MAX ? SIGTERM : SIGKILL;
+      if (ctx->state != rsync_state_terminating) {
+	ctx->problem = rsync_problem_timed_out;
+	ctx->state = rsync_state_terminating;
+	ctx->tries = 0;
+	logmsg(rc, log_telemetry, "Subprocess %u is taking too long fetching %s, whacking it", (unsigned) ctx->pid, ctx->uri.s);
+	rsync_history_add(rc, ctx, rsync_status_timed_out);
+      } else if (sig == SIGTERM) {
+	logmsg(rc, log_verbose, "Whacking subprocess %u again", (unsigned) ctx->pid);
+      } else {
+	logmsg(rc, log_verbose, "Whacking subprocess %u with big hammer", (unsigned) ctx->pid);
+      }
+      (void) kill(ctx->pid, sig);
+      ctx->deadline = now + 1;
+    }
+  }
+}
+
+/**
+ * Set up rsync context and attempt to start it.
+ */
+static void rsync_init(rcynic_ctx_t *rc,
+		       const uri_t *uri,
+		       void *cookie,
+		       void (*handler)(rcynic_ctx_t *, const rsync_ctx_t *, const rsync_status_t, const uri_t *, void *))
+{
+  rsync_ctx_t *ctx = NULL;
+  int i;
+
+  assert(rc && uri && strlen(uri->s) > SIZEOF_RSYNC);
+
+  if (!rc->run_rsync) {
+    logmsg(rc, log_verbose, "rsync disabled, skipping %s", uri->s);
+    if (handler)
+      handler(rc, NULL, rsync_status_skipped, uri, cookie);
+    return;
+  }
+
+  if (rsync_history_uri(rc, uri)) {
+    logmsg(rc, log_verbose, "rsync cache hit for %s", uri->s);
+    if (handler)
+      handler(rc, NULL, rsync_status_done, uri, cookie);
+    return;
+  }
+
+  if (fetch_table_seen(rc, uri)) {
+    logmsg(rc, log_verbose, "Another worker already fetched %s", uri->s);
+    if (handler)
+      handler(rc, NULL, rsync_status_done, uri, cookie);
+    return;
+  }
+
+  if (host_health_is_dead(rc, uri)) {
+    log_validation_status(rc, uri, rsync_transfer_skipped, object_generation_null);
+    if (handler)
+      handler(rc, NULL, rsync_status_skipped, uri, cookie);
+    return;
+  }
+
+  /*
+   * If we already queued a prefetch for this URI, take it over rather
+   * than queuing a second fetch behind it.  If it's already running,
+   * the new handler needs to hear about that now, since it missed the
+   * pending callback from rsync_run().
+   */
+  for (i = 0; handler != rsync_prefetch_callback &&
+	 (ctx = sk_rsync_ctx_t_value(rc->rsync_queue, i)) != NULL; i++) {
+    if (ctx->handler != rsync_prefetch_callback || strcmp(ctx->uri.s, uri->s))
+      continue;
+    logmsg(rc, log_verbose, "Taking over prefetch of %s", uri->s);
+    ctx->handler = handler;
+    ctx->cookie = cookie;
+    if (ctx->state == rsync_state_running || ctx->state == rsync_state_closed)
+      rsync_call_handler(rc, ctx, rsync_status_pending);
+    return;
+  }
+
+  if ((ctx = malloc(sizeof(*ctx))) == NULL) {
+    logmsg(rc, log_sys_err, "malloc(rsync_ctxt_t) failed");
+    if (handler)
+      handler(rc, NULL, rsync_status_failed, uri, cookie);
+    return;
+  }
+
+  memset(ctx, 0, sizeof(*ctx));
+  ctx->uri = *uri;
+  ctx->handler = handler;
+  ctx->cookie = cookie;
+  ctx->fd = -1;
+  ctx->expected = rsync_history_expected(rc, uri);
+
+  if (!sk_rsync_ctx_t_push(rc->rsync_queue, ctx)) {
+    logmsg(rc, log_sys_err, "Couldn't push rsync state object onto queue, punting %s", ctx->uri.s);
+    rsync_call_handler(rc, ctx, rsync_status_failed);
+    free(ctx);
+    return;
+  }
+
+  if (rsync_conflicts(rc, ctx)) {
+    logmsg(rc, log_debug, "New rsync context %s is feeling conflicted", ctx->uri.s);
+    ctx->state = rsync_state_conflict_wait;
+  }
+}
+
+/**
+ * rsync a trust anchor.
+ */
+static void rsync_ta(rcynic_ctx_t *rc,
+		     const uri_t *uri,
+		     tal_ctx_t *tctx,
+		     void (*handler)(rcynic_ctx_t *, const rsync_ctx_t *,
+				     const rsync_status_t, const uri_t *, void *))
+{
+  assert(endswith(uri->s, ".cer"));
+  rsync_init(rc, uri, tctx, handler);
+}
+
+/**
+ * rsync an entire subtree, generally rooted at a SIA collection.
+ */
+static void rsync_tree(rcynic_ctx_t *rc,
+		       const uri_t *uri,
+		       STACK_OF(walk_ctx_t) *wsk,
+		       void (*handler)(rcynic_ctx_t *, const rsync_ctx_t *,
+				       const rsync_status_t, const uri_t *, void *))
+{
+  assert(endswith(uri->s, "/"));
+  rsync_init(rc, uri, wsk, handler);
+}
+
+/**
+ * rsync callback for speculative prefetches nobody has claimed yet.
+ * Nothing to do: if the tree walk wants this URI after we're done,
+ * rsync_history will tell it that we already have it.
+ */
+static void rsync_prefetch_callback(rcynic_ctx_t *rc,
+				    const rsync_ctx_t *ctx,
+				    const rsync_status_t status,
+				    const uri_t *uri,
+				    void *cookie)
+{
+  if (status != rsync_status_pending)
+    logmsg(rc, log_debug, "Prefetch of %s finished with status %d", uri->s, (int) status);
+}
+
+/**
+ * Queue fetches for everything we successfully fetched last time,
+ * without waiting for the tree walk to work its way down to them.
+ * Fetch latency would otherwise stack up with the depth of the tree.
+ * Publication points which have gone away cost us one wasted fetch;
+ * new ones still get fetched on demand by the walk.
+ */
+static void rsync_prefetch(rcynic_ctx_t *rc)
+{
+  const rsync_history_t *h;
+  uri_t uri;
+  int i;
+
+  assert(rc && rc->previous_rsync_history);
+
+  if (!rc->run_rsync || !rc->rsync_early || !rc->rsync_prefetch)
+    return;
+
+  for (i = 0; (h = sk_rsync_history_t_value(rc->previous_rsync_history, i)) != NULL; i++) {
+    if (!h->final_slash || strlen(h->uri.s) <= SIZEOF_RSYNC)
+      continue;
+    if (snprintf(uri.s, sizeof(uri.s), "%s/", h->uri.s) >= sizeof(uri.s))
+      continue;
+    rsync_init(rc, &uri, NULL, rsync_prefetch_callback);
+  }
+
+  logmsg(rc, log_verbose, "Queued prefetches, %d rsync contexts now queued",
+	 sk_rsync_ctx_t_num(rc->rsync_queue));
+}
+
+
+
+/**
+ * Clean up old stuff from previous rsync runs.  --delete doesn't help
+ * if the URI changes and we never visit the old URI again.
+ */
+static int prune_unauthenticated(const rcynic_ctx_t *rc,
+				 const path_t *name,
+				 const size_t baselen)
+{
+  path_t path;
+  struct dirent *d;
+  DIR *dir;
+  const char *slash;
+
+  assert(rc && name && baselen > 0 && strlen(name->s) >= baselen);
+
+  if (!is_directory(name)) {
+    logmsg(rc, log_usage_err, "prune: %s is not a directory", name->s);
+    return 0;
+  }
+
+  if ((dir = opendir(name->s)) == NULL) {
+    logmsg(rc, log_sys_err, "prune: opendir() failed on %s: %s", name->s, strerror(errno));
+    return 0;
+  }
+
+  slash = endswith(name->s, "/") ? "" : "/";
+
+  while ((d = readdir(dir)) != NULL) {
+    if (!strcmp(d->d_name, ".") || !strcmp(d->d_name, ".."))
+      continue;
+
+    if (snprintf(path.s, sizeof(path.s), "%s%s%s", name->s, slash, d->d_name) >= sizeof(path.s)) {
+      logmsg(rc, log_debug, "prune: %s%s%s too long", name->s, slash, d->d_name);
+      goto done;
+    }
+
+    if (validation_status_find_filename(rc, path.s + baselen)) {
+      logmsg(rc, log_debug, "prune: cache hit %s", path.s);
+      continue;
+    }
+
+    if (unlink(path.s) == 0) {
+      logmsg(rc, log_debug, "prune: removed %s", path.s);
+      continue;
+    }
+
+    if (prune_unauthenticated(rc, &path, baselen))
+      continue;
+
+    logmsg(rc, log_sys_err, "prune: removing %s failed: %s", path.s, strerror(errno));
+    goto done;
+  }
+
+  if (rmdir(name->s) == 0)
+    logmsg(rc, log_debug, "prune: removed %s", name->s);
+  else if (errno != ENOTEMPTY)
+    logmsg(rc, log_sys_err, "prune: couldn't remove %s: %s", name->s, strerror(errno));
+
+ done:
+  closedir(dir);
+  return !d;
+}
+
+
+
+/**
+ * Read a DER object using a BIO pipeline that hashes the file content
+ * as we read it.  Returns the internal form of the parsed DER object,
+ * sets the hash buffer (if specified) as a side effect.  The default
+ * hash algorithm is SHA-256.
+ */
+static void *read_file_with_hash(const path_t *filename,
+				 const ASN1_ITEM *it,
+				 const EVP_MD *md,
+				 hashbuf_t *hash)
+{
+  void *result = NULL;
+  BIO *b;
+
+  if ((b = BIO_new_file(filename->s, "rb")) == NULL)
+    goto error;
+
+  if (hash != NULL) {
+    BIO *b2 = BIO_new(BIO_f_md());
+    if (b2 == NULL)
+      goto error;
+    if (md == NULL)
+      md = EVP_sha256();
+    if (!BIO_set_md(b2, md)) {
+      BIO_free(b2);
+      goto error;
+    }
+    BIO_push(b2, b);
+    b = b2;
+  }
+
+  if ((result = ASN1_item_d2i_bio(it, b, NULL)) == NULL)
+    goto error;
+
+  if (hash != NULL) {
+    memset(hash, 0, sizeof(*hash));
+    BIO_gets(b, (char *) hash, sizeof(hash->h));
+  }
+
+ error:
+  BIO_free_all(b);
+  return result;
+}
+
+/**
+ * Read a DER object for the walk.  If the batch hashing stage already
+ * read and hashed this file we parse its copy, so the hash we return
+ * is the hash of the bytes we parsed, or take the object the batch
+ * signature stage already decoded from that copy; otherwise we read
+ * the file.
+ */
+static void *read_object_with_hash(STACK_OF(walk_ctx_t) *wsk,
+				   const path_t *filename,
+				   const ASN1_ITEM *it,
+				   hashbuf_t *hash)
+{
+  preload_t *p = walk_ctx_preloaded(wsk, filename);
+  const unsigned char *der;
+  void *result;
+
+  if (p == NULL)
+    return read_file_with_hash(filename, it, NULL, hash);
+
+  if (hash != NULL)
+    *hash = p->hash;
+
+  if (p->object != NULL && p->it == it) {
+    result = p->object;
+    p->object = NULL;
+    return result;
+  }
+
+  der = p->data;
+  return ASN1_item_d2i(NULL, &der, p->len, it);
+}
+
+/**
+ * Read and hash a certificate.
+ */
+static X509 *read_cert(const path_t *filename, hashbuf_t *hash)
+{
+  return read_file_with_hash(filename, ASN1_ITEM_rptr(X509), NULL, hash);
+}
+
+/**
+ * Read and hash a CRL.
+ */
+static X509_CRL *read_crl(const path_t *filename, hashbuf_t *hash)
+{
+  return read_file_with_hash(filename, ASN1_ITEM_rptr(X509_CRL), NULL, hash);
+}
+
+
+
+/**
+ * Extract CRLDP data from a certificate.  Stops looking after finding
+ * the first rsync URI.
+ */
+static int extract_crldp_uri(rcynic_ctx_t *rc,
+			     const uri_t *uri,
+			     const object_generation_t generation,
+			     const STACK_OF(DIST_POINT) *crldp,
+			     uri_t *result)
+{
+  DIST_POINT *d;
+  int i;
+
+  assert(rc && uri && crldp && result);
+
+  if (sk_DIST_POINT_num(crldp) != 1)
+    goto bad;
+
+  d = sk_DIST_POINT_value(crldp, 0);
+
+  if (d->reasons || d->CRLissuer || !d->distpoint || d->distpoint->type != 0)
+    goto bad;
+
+  for (i = 0; i < sk_GENERAL_NAME_num(d->distpoint->name.fullname); i++) {
+    GENERAL_NAME *n = sk_GENERAL_NAME_value(d->distpoint->name.fullname, i);
+    if (n == NULL || n->type != GEN_URI)
+      goto bad;
+    if (!is_rsync((char *) n->d.uniformResourceIdentifier->data))
+      log_validation_status(rc, uri, non_rsync_uri_in_extension, generation);
+    else if (sizeof(result->s) <= n->d.uniformResourceIdentifier->length)
+      log_validation_status(rc, uri, uri_too_long, generation);
+    else if (result->s[0])
+      log_validation_status(rc, uri, multiple_rsync_uris_in_extension, generation);
+    else
+      strcpy(result->s, (char *) n->d.uniformResourceIdentifier->data);
+  }
+
+  return result->s[0];
+
+ bad:
+  log_validation_status(rc, uri, malformed_crldp_extension, generation);
+  return 0;
+}
+
+/**
+ * Extract SIA or AIA data from a certificate.
+ */
+static int extract_access_uri(rcynic_ctx_t *rc,
+			      const uri_t *uri,
+			      const object_generation_t generation,
+			      const AUTHORITY_INFO_ACCESS *xia,
+			      const int nid,
+			      uri_t *result,
+			      int *count,
+			      int (*relevant)(const char *))
+{
+  int i;
+
+  assert(rc && uri && xia && result && count);
+
+  for (i = 0; i < sk_ACCESS_DESCRIPTION_num(xia); i++) {
+    ACCESS_DESCRIPTION *a = sk_ACCESS_DESCRIPTION_value(xia, i);
+    if (a == NULL || a->location->type != GEN_URI)
+      return 0;
+    if (OBJ_obj2nid(a->method) != nid)
+      continue;
+    ++*count;
+    if (relevant && !relevant((char *) a->location->d.uniformResourceIdentifier->data))
+      continue;
+    if (sizeof(result->s) <= a->location->d.uniformResourceIdentifier->length)
+      log_validation_status(rc, uri, uri_too_long, generation);
+    else if (result->s[0])
+      log_validation_status(rc, uri, multiple_rsync_uris_in_extension, generation);
+    else
+      strcpy(result->s, (char *) a->location->d.uniformResourceIdentifier->data);
+  }
+  return 1;
+}
+
+
+
+/**
+ * Check to see whether an AKI extension is present, is of the right
+ * form, and matches the issuer.
+ */
+static int check_aki(rcynic_ctx_t *rc,
+		     const uri_t *uri,
+		     const X509 *issuer,
+		     const AUTHORITY_KEYID *aki,
+		     const object_generation_t generation)
+{
+  assert(rc && uri && issuer && issuer->skid);
+
+  if (aki == NULL) {
+    log_validation_status(rc, uri, aki_extension_missing, generation);
+    return 0;
+  }
+
+  if (!aki->keyid || aki->serial || aki->issuer) {
+    log_validation_status(rc, uri, aki_extension_wrong_format, generation);
+    return 0;
+  }
+
+  if (ASN1_OCTET_STRING_cmp(aki->keyid, issuer->skid)) {
+    log_validation_status(rc, uri, aki_extension_issuer_mismatch, generation);
+    return 0;
+  }
+
+  return 1;
+}
+
+
+
+/**
+ * Attempt to read and check one CRL from disk.
+ */
+
+static X509_CRL *check_crl_1(rcynic_ctx_t *rc,
+			     const uri_t *uri,
+			     path_t *path,
+			     const path_t *prefix,
+			     X509 *issuer,
+			     const object_generation_t generation)
+{
+  STACK_OF(X509_REVOKED) *revoked;
+  int64_t lastUpdate, nextUpdate;
+  rpki_extensions_t exts;
+  X509_CRL *crl = NULL;
+  EVP_PKEY *pkey;
+  int i, ret;
+
+  assert(uri && path && issuer);
+
+  if (!uri_to_filename(rc, uri, path, prefix) ||
+      (crl = read_crl(path, NULL)) == NULL)
+    goto punt;
+
+  if (X509_CRL_get_version(crl) != 1) {
+    log_validation_status(rc, uri, wrong_object_version, generation);
+    goto punt;
+  }
+
+  if (!crl->crl || !crl->crl->sig_alg || !crl->crl->sig_alg->algorithm ||
+      OBJ_obj2nid(crl->crl->sig_alg->algorithm) != NID_sha256WithRSAEncryption) {
+    log_validation_status(rc, uri, nonconformant_signature_algorithm, generation);
+    goto punt;
+  }
+
+  if (!check_allowed_time_encoding(X509_CRL_get_lastUpdate(crl)) ||
+      !check_allowed_time_encoding(X509_CRL_get_nextUpdate(crl)) ||
+      !asn1_time_to_epoch(X509_CRL_get_lastUpdate(crl), &lastUpdate) ||
+      !asn1_time_to_epoch(X509_CRL_get_nextUpdate(crl), &nextUpdate)) {
+    log_validation_status(rc, uri, nonconformant_asn1_time_value, generation);
+    goto punt;
+  }
+
+  if (lastUpdate > rc->now) {
+    log_validation_status(rc, uri, crl_not_yet_valid, generation);
+    goto punt;
+  }
+
+  if (nextUpdate <= rc->now) {
+    log_validation_status(rc, uri, stale_crl_or_manifest, generation);
+    if (!rc->allow_stale_crl)
+      goto punt;
+  }
+
+  if (!check_aki(rc, uri, issuer, crl->akid, generation))
+    goto punt;
+
+  if (crl->crl_number == NULL) {
+    log_validation_status(rc, uri, crl_number_extension_missing, generation);
+    goto punt;
+  }
+
+  if (ASN1_INTEGER_cmp(crl->crl_number, asn1_zero) < 0) {
+    log_validation_status(rc, uri, crl_number_is_negative, generation);
+    goto punt;
+  }
+
+  if (ASN1_INTEGER_cmp(crl->crl_number, asn1_twenty_octets) > 0) {
+    log_validation_status(rc, uri, crl_number_out_of_range, generation);
+    goto punt;
+  }
+
+  rpki_extensions_scan(crl->crl->extensions, RPKI_EXTS_CRL, &exts);
+  if (exts.disallowed > 0 || exts.present != RPKI_EXTS_CRL) {
+    log_validation_status(rc, uri, disallowed_x509v3_extension, generation);
+    goto punt;
+  }
+
+  if (X509_NAME_cmp(X509_CRL_get_issuer(crl), X509_get_subject_name(issuer))) {
+    log_validation_status(rc, uri, crl_issuer_name_mismatch, generation);
+    goto punt;
+  }
+
+  if (!check_allowed_dn(X509_CRL_get_issuer(crl))) {
+    log_validation_status(rc, uri, nonconformant_issuer_name, generation);
+    if (!rc->allow_nonconformant_name)
+      goto punt;
+  }
+
+  if ((revoked = X509_CRL_get_REVOKED(crl)) != NULL) {
+    for (i = sk_X509_REVOKED_num(revoked) - 1; i >= 0; --i) {
+      if (X509_REVOKED_get_ext_count(sk_X509_REVOKED_value(revoked, i)) > 0) {
+	log_validation_status(rc, uri, disallowed_x509v3_extension, generation);
+	goto punt;
+      }
+    }
+  }
+
+  if ((pkey = key_cache_get(rc, issuer)) == NULL)
+    goto punt;
+  ret = X509_CRL_verify(crl, pkey);
+  EVP_PKEY_free(pkey);
+
+  if (ret > 0)
+    return crl;
+
+ punt:
+  X509_CRL_free(crl);
+  return NULL;
+}
+
+/**
+ * Check whether we already have a particular CRL, attempt to fetch it
+ * and check issuer's signature if we don't.
+ *
+ * General plan here is to do basic checks on both current and backup
+ * generation CRLs, then, if both generations pass all of our other
+ * tests, pick the generation with the highest CRL number, to protect
+ * against replay attacks.
+ */
+static X509_CRL *check_crl(rcynic_ctx_t *rc,
+			   const uri_t *uri,
+			   X509 *issuer)
+{
+  X509_CRL *old_crl, *new_crl, *result = NULL;
+  path_t old_path, new_path;
+
+  if (uri_to_filename(rc, uri, &new_path, &rc->new_authenticated) &&
+      (new_crl = read_crl(&new_path, NULL)) != NULL)
+    return new_crl;
+
+  logmsg(rc, log_telemetry, "Checking CRL %s", uri->s);
+
+  new_crl = check_crl_1(rc, uri, &new_path, &rc->unauthenticated,
+			issuer, object_generation_current);
+
+  if (same_object_generations(rc, uri)) {
+    old_crl = NULL;
+    (void) uri_to_filename(rc, uri, &old_path, &rc->old_authenticated);
+  } else {
+    old_crl = check_crl_1(rc, uri, &old_path, &rc->old_authenticated,
+			  issuer, object_generation_backup);
+  }
+
+  if (!new_crl)
+    result = old_crl;
+
+  else if (!old_crl)
+    result = new_crl;
+
+  else {
+    ASN1_GENERALIZEDTIME *g_old = ASN1_TIME_to_generalizedtime(X509_CRL_get_lastUpdate(old_crl), NULL);
+    ASN1_GENERALIZEDTIME *g_new = ASN1_TIME_to_generalizedtime(X509_CRL_get_lastUpdate(new_crl), NULL);
+    int num_cmp = ASN1_INTEGER_cmp(old_crl->crl_number, new_crl->crl_number);
+    int date_cmp = (!g_old || !g_new) ? 0 : ASN1_STRING_cmp(g_old, g_new);
+
+    if (!g_old)
+      log_validation_status(rc, uri, bad_thisupdate, object_generation_backup);
+    if (!g_new)
+      log_validation_status(rc, uri, bad_thisupdate, object_generation_current);
+    if (num_cmp > 0)
+      log_validation_status(rc, uri, backup_number_higher_than_current, object_generation_current);
+    if (g_old && g_new && date_cmp > 0)
+      log_validation_status(rc, uri, backup_thisupdate_newer_than_current, object_generation_current);
+
+    if (num_cmp > 0 && (!g_old || !g_new || date_cmp > 0))
+      result = old_crl;
+    else
+      result = new_crl;
+
+    ASN1_GENERALIZEDTIME_free(g_old);
+    ASN1_GENERALIZEDTIME_free(g_new);
+  }
+
+  if (result && result == new_crl)
+    install_object(rc, uri, &new_path, object_generation_current);
+  else if (!access(new_path.s, F_OK))
+    log_validation_status(rc, uri, object_rejected, object_generation_current);
+
+  if (result && result == old_crl)
+    install_object(rc, uri, &old_path, object_generation_backup);
+  else if (!result && !access(old_path.s, F_OK))
+    log_validation_status(rc, uri, object_rejected, object_generation_backup);
+
+  if (result != new_crl)
+    X509_CRL_free(new_crl);
+
+  if (result != old_crl)
+    X509_CRL_free(old_crl);
+
+  return result;
+}
+
+
+/**
+ * Check digest of a CRL we've already accepted.
+ */
+static int check_crl_digest(const rcynic_ctx_t *rc,
+			    const uri_t *uri,
+			    const unsigned char *hash,
+			    const size_t hashlen)
+{
+  X509_CRL *crl = NULL;
+  hashbuf_t hashbuf;
+  path_t path;
+  int result;
+
+  assert(rc && uri && hash);
+
+  if (!uri_to_filename(rc, uri, &path, &rc->new_authenticated) ||
+      (crl = read_crl(&path, &hashbuf)) == NULL)
+    return 0;
+
+  result = hashlen <= sizeof(hashbuf.h) && !memcmp(hashbuf.h, hash, hashlen);
+
+  X509_CRL_free(crl);
+
+  return result;
+}
+
+
+
+/**
+ * Validation callback function for use with x509_verify_cert().
+ */
+static int check_x509_cb(int ok, X509_STORE_CTX *ctx)
+{
+  rcynic_x509_store_ctx_t *rctx = (rcynic_x509_store_ctx_t *) ctx;
+  mib_counter_t code;
+
+  assert(rctx != NULL);
+
+  switch (ctx->error) {
+  case X509_V_OK:
+    return ok;
+
+  case X509_V_ERR_SUBJECT_ISSUER_MISMATCH:
+    /*
+     * Informational events, not really errors.  ctx->check_issued()
+     * is called in many places where failure to find an issuer is not
+     * a failure for the calling function.  Just leave these alone.
+     */
+    return ok;
+
+  case X509_V_ERR_CRL_HAS_EXPIRED:
+    /*
+     * This isn't really an error, exactly.  CRLs don't really
+     * "expire".  What OpenSSL really means by this error is just
+     * "it's now later than the issuer said it intended to publish a
+     * new CRL".  Whether we treat this as an error or not is
+     * configurable, see the allow_stale_crl parameter.
+     *
+     * Deciding whether to allow stale CRLs is check_crl_1()'s job,
+     * not ours.  By the time this callback occurs, we've already
+     * accepted the CRL; this callback is just notifying us that the
+     * object being checked is tainted by a stale CRL.  So we mark the
+     * object as tainted and carry on.
+     */
+    log_validation_status(rctx->rc, &rctx->subject->uri, tainted_by_stale_crl, rctx->subject->generation);
+    ok = 1;
+    return ok;
+
+  case X509_V_ERR_UNABLE_TO_GET_ISSUER_CERT:
+    /*
+     * This is another error that's only an error in the strange world
+     * of OpenSSL, but a more serious one.  By default, OpenSSL
+     * expects all trust anchors to be self-signed.  This is not a
+     * PKIX requirement, it's just an OpenSSL thing, but one violates
+     * it at one's peril, because the only way to convince OpenSSL to
+     * allow a non-self-signed trust anchor is to intercept this
+     * "error" in the verify callback handler.
+     *
+     * So this program supports non-self-signed trust anchors, but be
+     * warned that enabling this feature may cause this program's
+     * output not to work with other OpenSSL-based applications.
+     */
+    if (rctx->rc->allow_non_self_signed_trust_anchor)
+      ok = 1;
+    log_validation_status(rctx->rc, &rctx->subject->uri, trust_anchor_not_self_signed, rctx->subject->generation);
+    return ok;
+
+  /*
+   * Select correct MIB counter for every known OpenSSL verify errors
+   * except the ones we handle explicitly above, then fall through to
+   * common handling for all of these.
+   */
+#define QV(x)							\
+  case x:							\
+    code = mib_openssl_##x;					\
+    break;
+    MIB_COUNTERS_FROM_OPENSSL;
+#undef	QV
+
+  default:
+    code = unknown_openssl_verify_error;
+    break;
+  }
+
+  log_validation_status(rctx->rc, &rctx->subject->uri, code, rctx->subject->generation);
+  return ok;
+}
+
+/**
+ * Check crypto aspects of a certificate, policy OID, RFC 3779 path
+ * validation, and conformance to the RPKI certificate profile.
+ */
+static int check_x509(rcynic_ctx_t *rc,
+		      STACK_OF(walk_ctx_t) *wsk,
+		      const uri_t *uri,
+		      X509 *x,
+		      certinfo_t *certinfo,
+		      const object_generation_t generation)
+{
+  walk_ctx_t *w = walk_ctx_stack_head(wsk);
+  rcynic_x509_store_ctx_t rctx;
+  EVP_PKEY *issuer_pkey = NULL, *subject_pkey = NULL;
+  unsigned long flags = (X509_V_FLAG_POLICY_CHECK | X509_V_FLAG_EXPLICIT_POLICY | X509_V_FLAG_X509_STRICT);
+  AUTHORITY_INFO_ACCESS *sia = NULL, *aia = NULL;
+  STACK_OF(POLICYINFO) *policies = NULL;
+  ASN1_BIT_STRING *ski_pubkey = NULL;
+  STACK_OF(DIST_POINT) *crldp = NULL;
+  EXTENDED_KEY_USAGE *eku = NULL;
+  BASIC_CONSTRAINTS *bc = NULL;
+  rpki_extensions_t exts;
+  hashbuf_t ski_hashbuf;
+  unsigned ski_hashlen, afi;
+  int i, ok, routercert = 0, ret = 0;
+
+  assert(rc && wsk && w && uri && x && w->cert);
+
+  /*
+   * Cleanup logic will explode if rctx.ctx hasn't been initialized,
+   * so we need to do this before running any test that can fail.
+   */
+  if (!X509_STORE_CTX_init(&rctx.ctx, rc->x509_store, x, NULL))
+    return 0;
+
+  /*
+   * certinfo == NULL means x is a self-signed trust anchor.
+   */
+  if (certinfo == NULL)
+    certinfo = &w->certinfo;
+
+  memset(certinfo, 0, sizeof(*certinfo));
+
+  certinfo->uri = *uri;
+  certinfo->generation = generation;
+
+  if (ASN1_INTEGER_cmp(X509_get_serialNumber(x), asn1_zero) <= 0 ||
+      ASN1_INTEGER_cmp(X509_get_serialNumber(x), asn1_twenty_octets) > 0) {
+    log_validation_status(rc, uri, bad_certificate_serial_number, generation);
+    goto done;
+  }
+
+  if (!check_allowed_time_encoding(X509_get_notBefore(x)) ||
+      !check_allowed_time_encoding(X509_get_notAfter(x)) ||
+      !asn1_time_to_epoch(X509_get_notBefore(x), &certinfo->notBefore) ||
+      !asn1_time_to_epoch(X509_get_notAfter(x),  &certinfo->notAfter)) {
+    log_validation_status(rc, uri, nonconformant_asn1_time_value, generation);
+    goto done;
+  }
+
+  /*
+   * Apparently nothing ever looks at these fields, so there are no
+   * API functions for them.  We wouldn't bother either if they
+   * weren't forbidden by the RPKI certificate profile.
+   */
+  if (!x->cert_info || x->cert_info->issuerUID || x->cert_info->subjectUID) {
+    log_validation_status(rc, uri, nonconformant_certificate_uid, generation);
+    goto done;
+  }
+
+  /*
+   * We don't use X509_check_ca() to set certinfo->ca anymore, because
+   * it's not paranoid enough to enforce the RPKI certificate profile,
+   * but we still call it because we need it (or something) to invoke
+   * x509v3_cache_extensions() for us.
+   */
+  (void) X509_check_ca(x);
+
+  /*
+   * One pass over the extensions finds everything the profile allows
+   * and notes which are critical.  Anything else is an error, which
+   * we report once we've run the more specific checks below.
+   *
+   * x509v3_cache_extensions() has already decoded the SKI, AKI, and
+   * RFC 3779 extensions, so we use its results rather than decoding
+   * them again.  As with rpki_extension_d2i(), an extension which is
+   * present but wouldn't decode counts as disallowed.
+   */
+  rpki_extensions_scan(x->cert_info->extensions, RPKI_EXTS_CERT, &exts);
+
+  if (((exts.present & RPKI_EXT_BIT(subject_key_identifier))   && x->skid         == NULL) ||
+      ((exts.present & RPKI_EXT_BIT(authority_key_identifier)) && x->akid         == NULL) ||
+      ((exts.present & RPKI_EXT_BIT(sbgp_ipAddrBlock))         && x->rfc3779_addr == NULL) ||
+      ((exts.present & RPKI_EXT_BIT(sbgp_autonomousSysNum))    && x->rfc3779_asid == NULL))
+    exts.disallowed++;
+
+  if ((bc = rpki_extension_d2i(&exts, rpki_ext_basic_constraints)) != NULL) {
+    if (!(exts.critical & RPKI_EXT_BIT(basic_constraints)) || bc->ca <= 0 || bc->pathlen != NULL) {
+      log_validation_status(rc, uri, malformed_basic_constraints, generation);
+      goto done;
+    }
+  }
+
+  certinfo->ca = bc != NULL;
+
+  if (certinfo == &w->certinfo) {
+    certinfo->ta = 1;
+    if (!certinfo->ca) {
+      log_validation_status(rc, uri, malformed_trust_anchor, generation);
+      goto done;
+    }
+  }
+
+  /*
+   * If neither this certificate nor anything above it has changed
+   * since the last run, we can skip the signature checks below.  We
+   * still run all the profile checks, since they're cheap.
+   */
+  certinfo->unchanged = ((certinfo->ta || w->certinfo.unchanged) &&
+			 object_unchanged(rc, uri, generation));
+
+  if ((aia = rpki_extension_d2i(&exts, rpki_ext_info_access)) != NULL) {
+    int n_caIssuers = 0;
+    if (!extract_access_uri(rc, uri, generation, aia, NID_ad_ca_issuers,
+			    &certinfo->aia, &n_caIssuers, NULL) ||
+	!certinfo->aia.s[0] ||
+	sk_ACCESS_DESCRIPTION_num(aia) != n_caIssuers) {
+      log_validation_status(rc, uri, malformed_aia_extension, generation);
+      goto done;
+    }
+  }
+
+  if (certinfo->ta && aia) {
+    log_validation_status(rc, uri, aia_extension_forbidden, generation);
+    goto done;
+  }
+
+  if (!certinfo->ta && !aia) {
+    log_validation_status(rc, uri, aia_extension_missing, generation);
+    goto done;
+  }
+
+  if ((eku = rpki_extension_d2i(&exts, rpki_ext_ext_key_usage)) != NULL) {
+    if ((exts.critical & RPKI_EXT_BIT(ext_key_usage)) || certinfo->ca || !endswith(uri->s, ".cer") || sk_ASN1_OBJECT_num(eku) == 0) {
+      log_validation_status(rc, uri, inappropriate_eku_extension, generation);
+      goto done;
+    }
+    for (i = 0; i < sk_ASN1_OBJECT_num(eku); i++)
+      routercert |= OBJ_obj2nid(sk_ASN1_OBJECT_value(eku, i)) == NID_id_kp_bgpsec_router;
+  }
+
+  if ((sia = rpki_extension_d2i(&exts, rpki_ext_sinfo_access)) != NULL) {
+    int got_caDirectory,     got_rpkiManifest,     got_signedObject;
+    int   n_caDirectory = 0,   n_rpkiManifest = 0,   n_signedObject = 0, n_rpkiNotify = 0;
+    ok = (extract_access_uri(rc, uri, generation, sia, NID_caRepository,
+			     &certinfo->sia, &n_caDirectory, is_rsync) &&
+	  extract_access_uri(rc, uri, generation, sia, NID_ad_rpkiManifest,
+			     &certinfo->manifest, &n_rpkiManifest, is_rsync) &&
+	  extract_access_uri(rc, uri, generation, sia, NID_ad_signedObject,
+			     &certinfo->signedobject, &n_signedObject, is_rsync) &&
+	  extract_access_uri(rc, uri, generation, sia, NID_ad_rpkiNotify,
+			     &certinfo->rrdpnotify, &n_rpkiNotify, is_http));
+    got_caDirectory  = certinfo->sia.s[0]          != '\0';
+    got_rpkiManifest = certinfo->manifest.s[0]     != '\0';
+    got_signedObject = certinfo->signedobject.s[0] != '\0';
+    ok &= (sk_ACCESS_DESCRIPTION_num(sia) ==
+	   n_caDirectory + n_rpkiManifest + n_signedObject + n_rpkiNotify);
+    if (certinfo->ca)
+      ok &=  got_caDirectory &&  got_rpkiManifest && !got_signedObject;
+    else if (rc->allow_ee_without_signedObject)
+      ok &= !got_caDirectory && !got_rpkiManifest;
+    else
+      ok &= !got_caDirectory && !got_rpkiManifest &&  got_signedObject;
+    if (!ok) {
+      log_validation_status(rc, uri, malformed_sia_extension, generation);
+      goto done;
+    }
+  } else if (certinfo->ca || !rc->allow_ee_without_signedObject) {
+    log_validation_status(rc, uri, sia_extension_missing, generation);
+    goto done;
+  } else if (!routercert) {
+    log_validation_status(rc, uri, sia_extension_missing_from_ee, generation);
+  }
+
+  if (certinfo->signedobject.s[0] && strcmp(uri->s, certinfo->signedobject.s))
+    log_validation_status(rc, uri, bad_signed_object_uri, generation);
+
+  if ((crldp = rpki_extension_d2i(&exts, rpki_ext_crl_distribution_points)) != NULL) {
+    if (!extract_crldp_uri(rc, uri, generation, crldp, &certinfo->crldp))
+      goto done;
+  }
+
+  rctx.rc = rc;
+  rctx.subject = certinfo;
+
+  if (w->certs == NULL && (w->certs = walk_ctx_stack_certs(rc, wsk)) == NULL)
+    goto done;
+
+  if (X509_get_version(x) != 2) {
+    log_validation_status(rc, uri, wrong_object_version, generation);
+    goto done;
+  }
+
+  if (!x->cert_info || !x->cert_info->signature || !x->cert_info->signature->algorithm ||
+      OBJ_obj2nid(x->cert_info->signature->algorithm) != NID_sha256WithRSAEncryption) {
+    log_validation_status(rc, uri, nonconformant_signature_algorithm, generation);
+    goto done;
+  }
+
+  if (certinfo->sia.s[0] && certinfo->sia.s[strlen(certinfo->sia.s) - 1] != '/') {
+    log_validation_status(rc, uri, malformed_cadirectory_uri, generation);
+    goto done;
+  }
+
+  if (!w->certinfo.ta && strcmp(w->certinfo.uri.s, certinfo->aia.s))
+    log_validation_status(rc, uri, aia_doesnt_match_issuer, generation);
+
+  if (certinfo->ca && !certinfo->sia.s[0]) {
+    log_validation_status(rc, uri, sia_cadirectory_uri_missing, generation);
+    goto done;
+  }
+
+  if (certinfo->ca && !certinfo->manifest.s[0]) {
+    log_validation_status(rc, uri, sia_manifest_uri_missing, generation);
+    goto done;
+  }
+
+  if (certinfo->ca && !startswith(certinfo->manifest.s, certinfo->sia.s)) {
+    log_validation_status(rc, uri, manifest_carepository_mismatch, generation);
+    goto done;
+  }
+
+  if (!x->skid) {
+    log_validation_status(rc, uri, ski_extension_missing, generation);
+    goto done;
+  }
+
+  if (!check_allowed_dn(X509_get_subject_name(x))) {
+    log_validation_status(rc, uri, nonconformant_subject_name, generation);
+    if (!rc->allow_nonconformant_name)
+      goto done;
+  }
+
+  if (!check_allowed_dn(X509_get_issuer_name(x))) {
+    log_validation_status(rc, uri, nonconformant_issuer_name, generation);
+    if (!rc->allow_nonconformant_name)
+      goto done;
+  }
+
+  if ((policies = rpki_extension_d2i(&exts, rpki_ext_certificate_policies)) != NULL) {
+    POLICYQUALINFO *qualifier = NULL;
+    POLICYINFO *policy = NULL;
+    if (!(exts.critical & RPKI_EXT_BIT(certificate_policies)) || sk_POLICYINFO_num(policies) != 1 ||
+	(policy = sk_POLICYINFO_value(policies, 0)) == NULL ||
+	OBJ_obj2nid(policy->policyid) != NID_cp_ipAddr_asNumber ||
+	sk_POLICYQUALINFO_num(policy->qualifiers) > 1 ||
+	(sk_POLICYQUALINFO_num(policy->qualifiers) == 1 &&
+	 ((qualifier = sk_POLICYQUALINFO_value(policy->qualifiers, 0)) == NULL ||
+	  OBJ_obj2nid(qualifier->pqualid) != NID_id_qt_cps))) {
+      log_validation_status(rc, uri, bad_certificate_policy, generation);
+      goto done;
+    }
+    if (qualifier)
+      log_validation_status(rc, uri, policy_qualifier_cps, generation);
+  }
+
+  if (!(exts.critical & RPKI_EXT_BIT(key_usage)) ||
+      (x->ex_flags & EXFLAG_KUSAGE) == 0 ||
+      x->ex_kusage != (certinfo->ca ? KU_KEY_CERT_SIGN | KU_CRL_SIGN : KU_DIGITAL_SIGNATURE)) {
+    log_validation_status(rc, uri, bad_key_usage, generation);
+    goto done;
+  }
+
+  if (x->rfc3779_addr) {
+    if (routercert ||
+	!(exts.critical & RPKI_EXT_BIT(sbgp_ipAddrBlock)) ||
+	!v3_addr_is_canonical(x->rfc3779_addr) ||
+	sk_IPAddressFamily_num(x->rfc3779_addr) == 0) {
+      log_validation_status(rc, uri, bad_ipaddrblocks, generation);
+      goto done;
+    }
+    for (i = 0; i < sk_IPAddressFamily_num(x->rfc3779_addr); i++) {
+      IPAddressFamily *f = sk_IPAddressFamily_value(x->rfc3779_addr, i);
+      afi = v3_addr_get_afi(f);
+      if (afi != IANA_AFI_IPV4 && afi != IANA_AFI_IPV6) {
+	log_validation_status(rc, uri, unknown_afi, generation);
+	goto done;
+      }
+      if (f->addressFamily->length != 2) {
+	log_validation_status(rc, uri, safi_not_allowed, generation);
+	goto done;
+      }
+    }
+  }
+
+  if (x->rfc3779_asid) {
+    if (!(exts.critical & RPKI_EXT_BIT(sbgp_autonomousSysNum)) ||
+	!v3_asid_is_canonical(x->rfc3779_asid) ||
+	x->rfc3779_asid->asnum == NULL ||
+	x->rfc3779_asid->rdi != NULL ||
+	(routercert && x->rfc3779_asid->asnum->type == ASIdentifierChoice_inherit)) {
+      log_validation_status(rc, uri, bad_asidentifiers, generation);
+      goto done;
+    }
+  }
+
+  if (!x->rfc3779_addr && !x->rfc3779_asid) {
+    log_validation_status(rc, uri, missing_resources, generation);
+    goto done;
+  }
+
+  subject_pkey = X509_get_pubkey(x);
+  ok = subject_pkey != NULL;
+  if (ok) {
+    ASN1_OBJECT *algorithm;
+
+    (void) X509_PUBKEY_get0_param(&algorithm, NULL, NULL, NULL, X509_get_X509_PUBKEY(x));
+
+    switch (OBJ_obj2nid(algorithm)) {
+
+    case NID_rsaEncryption:
+      ok = (EVP_PKEY_type(subject_pkey->type) == EVP_PKEY_RSA &&
+	    BN_get_word(subject_pkey->pkey.rsa->e) == 65537);
+      if (!ok)
+	break;
+      if (!certinfo->ca && rc->allow_1024_bit_ee_key &&
+	  BN_num_bits(subject_pkey->pkey.rsa->n) == 1024)
+	log_validation_status(rc, uri, ee_certificate_with_1024_bit_key, generation);
+      else
+	ok = BN_num_bits(subject_pkey->pkey.rsa->n) == 2048;
+      break;
+
+    case NID_X9_62_id_ecPublicKey:
+      ok = !certinfo->ca && routercert;
+      break;
+
+    default:
+      ok = 0;
+    }
+  }
+  if (!ok) {
+    log_validation_status(rc, uri, bad_public_key, generation);
+    goto done;
+  }
+
+  if (x->skid == NULL ||
+      (ski_pubkey = X509_get0_pubkey_bitstr(x)) == NULL ||
+      !EVP_Digest(ski_pubkey->data, ski_pubkey->length,
+		  ski_hashbuf.h, &ski_hashlen, EVP_sha1(), NULL) ||
+      ski_hashlen != 20 ||
+      ski_hashlen != x->skid->length ||
+      memcmp(ski_hashbuf.h, x->skid->data, ski_hashlen)) {
+    log_validation_status(rc, uri, ski_public_key_mismatch, generation);
+    goto done;
+  }
+
+  if (x->akid) {
+    if (!check_aki(rc, uri, w->cert, x->akid, generation))
+      goto done;
+  }
+
+  if (!x->akid && !certinfo->ta) {
+    log_validation_status(rc, uri, aki_extension_missing, generation);
+    goto done;
+  }
+
+  /*
+   * Check the signature against the issuer we expect, unless the batch
+   * signature stage already did, and remember that we did so that
+   * X509_verify_cert() doesn't check it again.
+   */
+  if ((certinfo->ta || !certinfo->unchanged) &&
+      X509_get_ex_data(x, rc->presigned_index) != w->cert) {
+    if ((issuer_pkey = key_cache_get(rc, w->cert)) == NULL || X509_verify(x, issuer_pkey) <= 0) {
+      log_validation_status(rc, uri, certificate_bad_signature, generation);
+      goto done;
+    }
+    (void) X509_set_ex_data(x, rc->presigned_index, w->cert);
+  }
+
+  if (certinfo->ta) {
+
+    if (certinfo->crldp.s[0]) {
+      log_validation_status(rc, uri, trust_anchor_with_crldp, generation);
+      goto done;
+    }
+
+  } else {
+
+    if (!certinfo->crldp.s[0]) {
+      log_validation_status(rc, uri, crldp_uri_missing, generation);
+      goto done;
+    }
+
+    if (!certinfo->ca && !startswith(certinfo->crldp.s, w->certinfo.sia.s)) {
+      log_validation_status(rc, uri, crldp_doesnt_match_issuer_sia, generation);
+      goto done;
+    }
+
+    if (w->crls == NULL && ((w->crls = sk_X509_CRL_new_null()) == NULL ||
+			    !sk_X509_CRL_push(w->crls, NULL))) {
+      logmsg(rc, log_sys_err, "Internal allocation error setting up CRL for validation");
+      goto done;
+    }
+
+    assert(sk_X509_CRL_num(w->crls) == 1);
+    assert((w->crldp.s[0] == '\0') == (sk_X509_CRL_value(w->crls, 0) == NULL));
+
+    if (strcmp(w->crldp.s, certinfo->crldp.s)) {
+      X509_CRL *old_crl = sk_X509_CRL_value(w->crls, 0);
+      X509_CRL *new_crl = check_crl(rc, &certinfo->crldp, w->cert);
+
+      if (w->crldp.s[0])
+	log_validation_status(rc, uri, issuer_uses_multiple_crldp_values, generation);
+
+      if (new_crl == NULL) {
+	log_validation_status(rc, uri, bad_crl, generation);
+	goto done;
+      }
+
+      if (old_crl && new_crl && ASN1_INTEGER_cmp(old_crl->crl_number, new_crl->crl_number) < 0) {
+	log_validation_status(rc, uri, crldp_names_newer_crl, generation);
+	X509_CRL_free(old_crl);
+	old_crl = NULL;
+      }
+
+      if (old_crl == NULL) {
+	sk_X509_CRL_set(w->crls, 0, new_crl);
+	w->crldp = certinfo->crldp;
+	if (!asn1_time_to_epoch(X509_CRL_get_nextUpdate(new_crl), &w->crl_nextUpdate))
+	  w->crl_nextUpdate = 0;
+      } else {
+	X509_CRL_free(new_crl);
+      }
+    }
+
+    assert(sk_X509_CRL_value(w->crls, 0));
+    flags |= X509_V_FLAG_CRL_CHECK;
+    X509_STORE_CTX_set0_crls(&rctx.ctx, w->crls);
+  }
+
+  if (exts.disallowed > 0) {
+    log_validation_status(rc, uri, disallowed_x509v3_extension, generation);
+    goto done;
+  }
+
+  assert(w->certs != NULL);
+  X509_STORE_CTX_trusted_stack(&rctx.ctx, w->certs);
+  X509_STORE_CTX_set_verify_cb(&rctx.ctx, check_x509_cb);
+
+  /*
+   * If the batch signature stage or the check above already verified
+   * this certificate's signature against w->cert, say so using
+   * OpenSSL's own per-certificate flag, which internal_verify()
+   * checks before calling X509_verify().  The issuer X509_verify_cert()
+   * finds is the one whose subject and SKI match our issuer and AKI,
+   * and we've checked every SKI against its public key, so it has the
+   * key we already checked against.
+   */
+  if (X509_get_ex_data(x, rc->presigned_index) == w->cert)
+    x->valid = 1;
+
+  X509_VERIFY_PARAM_set_flags(rctx.ctx.param, flags);
+
+  X509_VERIFY_PARAM_set_time(rctx.ctx.param, (time_t) rc->now);
+
+  X509_VERIFY_PARAM_add0_policy(rctx.ctx.param, OBJ_nid2obj(NID_cp_ipAddr_asNumber));
+
+  /*
+   * An unchanged certificate under an unchanged issuer passed full
+   * validation last run, so all that can have changed since then is
+   * the clock and the CRL.  If it's still within its validity period,
+   * the (freshly checked) CRL isn't stale, and the certificate isn't on
+   * it, we're done; otherwise, fall back to full validation, which will
+   * also log whatever the problem is.
+   */
+  if (certinfo->unchanged && !certinfo->ta) {
+    X509_CRL *crl = sk_X509_CRL_value(w->crls, 0);
+    X509_REVOKED *revoked = NULL;
+    if (certinfo->notBefore >= rc->now ||
+	certinfo->notAfter <= rc->now ||
+	w->crl_nextUpdate <= rc->now ||
+	X509_CRL_get0_by_serial(crl, &revoked, X509_get_serialNumber(x)) > 0)
+      certinfo->unchanged = 0;
+  }
+
+  if (certinfo->unchanged && !certinfo->ta)
+    logmsg(rc, log_verbose, "%s unchanged since last run, skipping signature checks", uri->s);
+  else if (X509_verify_cert(&rctx.ctx) <= 0) {
+    log_validation_status(rc, uri, certificate_failed_validation, generation);
+    goto done;
+  }
+
+  ret = 1;
+
+ done:
+  X509_STORE_CTX_cleanup(&rctx.ctx);
+  EVP_PKEY_free(issuer_pkey);
+  EVP_PKEY_free(subject_pkey);
+  BASIC_CONSTRAINTS_free(bc);
+  sk_ACCESS_DESCRIPTION_pop_free(sia, ACCESS_DESCRIPTION_free);
+  sk_ACCESS_DESCRIPTION_pop_free(aia, ACCESS_DESCRIPTION_free);
+  sk_DIST_POINT_pop_free(crldp, DIST_POINT_free);
+  sk_POLICYINFO_pop_free(policies, POLICYINFO_free);
+  sk_ASN1_OBJECT_pop_free(eku, ASN1_OBJECT_free);
+
+  return ret;
+}
+
+/**
+ * Check a signed CMS object.
+ */
+static int check_cms(rcynic_ctx_t *rc,
+		     STACK_OF(walk_ctx_t) *wsk,
+		     const uri_t *uri,
+		     path_t *path,
+		     const path_t *prefix,
+		     CMS_ContentInfo **pcms,
+		     X509 **px,
+		     certinfo_t *certinfo,
+		     der_view_t *econtent,
+		     const unsigned char *hash,
+		     const size_t hashlen,
+		     const int expected_eContentType_nid,
+		     const int require_inheritance,
+		     const object_generation_t generation)
+{
+  STACK_OF(CMS_SignerInfo) *signer_infos = NULL;
+  ASN1_OCTET_STRING **pos;
+  CMS_ContentInfo *cms = NULL;
+  CMS_SignerInfo *si = NULL;
+  ASN1_OCTET_STRING *sid = NULL;
+  X509_NAME *si_issuer = NULL;
+  ASN1_INTEGER *si_serial = NULL;
+  STACK_OF(X509_CRL) *crls = NULL;
+  STACK_OF(X509) *certs = NULL;
+  X509_ALGOR *signature_alg = NULL, *digest_alg = NULL;
+  ASN1_OBJECT *oid = NULL;
+  hashbuf_t hashbuf;
+  X509 *x = NULL;
+  certinfo_t certinfo_;
+  unsigned flags;
+  int i, result = 0;
+
+  assert(rc && wsk && uri && path && prefix);
+
+  if (!certinfo)
+    certinfo = &certinfo_;
+
+  if (!uri_to_filename(rc, uri, path, prefix))
+    goto error;
 
-  if (certinfo == &w->certinfo) {
-    certinfo->ta = 1;
-    if (!certinfo->ca) {
-      log_validation_status(rc, uri, malformed_trust_anchor, generation);
-      goto done;
-    }
+  cms = read_object_with_hash(wsk, path, ASN1_ITEM_rptr(CMS_ContentInfo), hash ? &hashbuf : NULL);
+
+  if (!cms)
+    goto error;
+
+  if (hash && (hashlen > sizeof(hashbuf.h) ||
+	       memcmp(hashbuf.h, hash, hashlen))) {
+    log_validation_status(rc, uri, digest_mismatch, generation);
+    if (!rc->allow_digest_mismatch)
+      goto error;
   }
 
-  if ((aia = X509_get_ext_d2i(x, NID_info_access, NULL, NULL)) != NULL) {
-    int n_caIssuers = 0;
-    ex_count--;
-    if (!extract_access_uri(rc, uri, generation, aia, NID_ad_ca_issuers,
-			    &certinfo->aia, &n_caIssuers, NULL) ||
-	!certinfo->aia.s[0] ||
-	sk_ACCESS_DESCRIPTION_num(aia) != n_caIssuers) {
-      log_validation_status(rc, uri, malformed_aia_extension, generation);
-      goto done;
-    }
+  if (OBJ_obj2nid(CMS_get0_eContentType(cms)) != expected_eContentType_nid) {
+    log_validation_status(rc, uri, bad_cms_econtenttype, generation);
+    goto error;
   }
 
-  if (certinfo->ta && aia) {
-    log_validation_status(rc, uri, aia_extension_forbidden, generation);
-    goto done;
+  /*
+   * We never ask CMS_verify() to copy the eContent out: with no
+   * output BIO it digests the embedded OCTET STRING in place, and
+   * callers decode the eContent from the same buffer.
+   */
+  if ((pos = CMS_get0_content(cms)) == NULL || *pos == NULL) {
+    log_validation_status(rc, uri, cms_econtent_decode_error, generation);
+    goto error;
   }
 
-  if (!certinfo->ta && !aia) {
-    log_validation_status(rc, uri, aia_extension_missing, generation);
-    goto done;
+  /*
+   * Skip the signature check if this object and everything above it
+   * is unchanged since the last run.  We still need CMS_verify() to
+   * match the SignerInfo to its certificate.  check_x509() will make
+   * its own decision about the EE certificate.
+   */
+  flags = CMS_NO_SIGNER_CERT_VERIFY;
+  if (walk_ctx_stack_head(wsk)->certinfo.unchanged && object_unchanged(rc, uri, generation))
+    flags |= CMS_NO_ATTR_VERIFY | CMS_NO_CONTENT_VERIFY;
+
+  if (CMS_verify(cms, NULL, NULL, NULL, NULL, flags) <= 0) {
+    log_validation_status(rc, uri, cms_validation_failure, generation);
+    goto error;
   }
 
-  if ((eku = X509_get_ext_d2i(x, NID_ext_key_usage, &crit, NULL)) != NULL) {
-    ex_count--;
-    if (crit || certinfo->ca || !endswith(uri->s, ".cer") || sk_ASN1_OBJECT_num(eku) == 0) {
-      log_validation_status(rc, uri, inappropriate_eku_extension, generation);
-      goto done;
-    }
-    for (i = 0; i < sk_ASN1_OBJECT_num(eku); i++)
-      routercert |= OBJ_obj2nid(sk_ASN1_OBJECT_value(eku, i)) == NID_id_kp_bgpsec_router;
+  if ((crls = CMS_get1_crls(cms)) != NULL) {
+    log_validation_status(rc, uri, cms_includes_crls, generation);
+    goto error;
   }
 
-  if ((sia = X509_get_ext_d2i(x, NID_sinfo_access, NULL, NULL)) != NULL) {
-    int got_caDirectory,     got_rpkiManifest,     got_signedObject;
-    int   n_caDirectory = 0,   n_rpkiManifest = 0,   n_signedObject = 0, n_rpkiNotify = 0;
-    ex_count--;
-    ok = (extract_access_uri(rc, uri, generation, sia, NID_caRepository,
-			     &certinfo->sia, &n_caDirectory, is_rsync) &&
-	  extract_access_uri(rc, uri, generation, sia, NID_ad_rpkiManifest,
-			     &certinfo->manifest, &n_rpkiManifest, is_rsync) &&
-	  extract_access_uri(rc, uri, generation, sia, NID_ad_signedObject,
-			     &certinfo->signedobject, &n_signedObject, is_rsync) &&
-	  extract_access_uri(rc, uri, generation, sia, NID_ad_rpkiNotify,
-			     &certinfo->rrdpnotify, &n_rpkiNotify, is_http));
-    got_caDirectory  = certinfo->sia.s[0]          != '\0';
-    got_rpkiManifest = certinfo->manifest.s[0]     != '\0';
-    got_signedObject = certinfo->signedobject.s[0] != '\0';
-    ok &= (sk_ACCESS_DESCRIPTION_num(sia) ==
-	   n_caDirectory + n_rpkiManifest + n_signedObject + n_rpkiNotify);
-    if (certinfo->ca)
-      ok &=  got_caDirectory &&  got_rpkiManifest && !got_signedObject;
-    else if (rc->allow_ee_without_signedObject)
-      ok &= !got_caDirectory && !got_rpkiManifest;
-    else
-      ok &= !got_caDirectory && !got_rpkiManifest &&  got_signedObject;
-    if (!ok) {
-      log_validation_status(rc, uri, malformed_sia_extension, generation);
-      goto done;
+  if ((signer_infos = CMS_get0_SignerInfos(cms)) == NULL ||
+      sk_CMS_SignerInfo_num(signer_infos) != 1 ||
+      (si = sk_CMS_SignerInfo_value(signer_infos, 0)) == NULL ||
+      !CMS_SignerInfo_get0_signer_id(si, &sid, &si_issuer, &si_serial) ||
+      sid == NULL || si_issuer != NULL || si_serial != NULL ||
+      CMS_unsigned_get_attr_count(si) != -1) {
+    log_validation_status(rc, uri, bad_cms_signer_infos, generation);
+    goto error;
+  }
+
+  CMS_SignerInfo_get0_algs(si, NULL, &x, &digest_alg, &signature_alg);
+
+  if (x == NULL) {
+    log_validation_status(rc, uri, cms_signer_missing, generation);
+    goto error;
+  }
+
+  if ((certs = CMS_get1_certs(cms)) == NULL ||
+      sk_X509_num(certs) != 1 ||
+      X509_cmp(x, sk_X509_value(certs, 0))) {
+    log_validation_status(rc, uri, bad_cms_signer, generation);
+    goto error;
+  }
+
+  X509_ALGOR_get0(&oid, NULL, NULL, signature_alg);
+  i = OBJ_obj2nid(oid);
+  if (i != NID_sha256WithRSAEncryption && i != NID_rsaEncryption) {
+    log_validation_status(rc, uri, wrong_cms_si_signature_algorithm, generation);
+    goto error;
+  }
+
+  X509_ALGOR_get0(&oid, NULL, NULL, digest_alg);
+  if (OBJ_obj2nid(oid) != NID_sha256) {
+    log_validation_status(rc, uri, wrong_cms_si_digest_algorithm, generation);
+    goto error;
+  }
+
+  i = CMS_signed_get_attr_count(si);
+
+  (void) extract_si_datum(si, &i, 1, NID_pkcs9_signingTime,   V_ASN1_UTCTIME);
+  (void) extract_si_datum(si, &i, 1, NID_binary_signing_time, V_ASN1_INTEGER);
+  oid =  extract_si_datum(si, &i, 0, NID_pkcs9_contentType,   V_ASN1_OBJECT);
+  (void) extract_si_datum(si, &i, 0, NID_pkcs9_messageDigest, V_ASN1_OCTET_STRING);
+
+  if (i != 0) {
+    log_validation_status(rc, uri, bad_cms_si_signed_attributes, generation);
+    if (!rc->allow_wrong_cms_si_attributes)
+      goto error;
+  }
+
+  if (OBJ_obj2nid(oid) != expected_eContentType_nid) {
+    log_validation_status(rc, uri, bad_cms_si_contenttype, generation);
+    goto error;
+  }
+
+  if (CMS_SignerInfo_cert_cmp(si, x)) {
+    log_validation_status(rc, uri, cms_ski_mismatch, generation);
+    goto error;
+  }
+
+  if (!check_x509(rc, wsk, uri, x, certinfo, generation))
+    goto error;
+
+  if (require_inheritance && x->rfc3779_addr) {
+    for (i = 0; i < sk_IPAddressFamily_num(x->rfc3779_addr); i++) {
+      IPAddressFamily *f = sk_IPAddressFamily_value(x->rfc3779_addr, i);
+      if (f->ipAddressChoice->type != IPAddressChoice_inherit) {
+	log_validation_status(rc, uri, rfc3779_inheritance_required, generation);
+	goto error;
+      }
     }
-  } else if (certinfo->ca || !rc->allow_ee_without_signedObject) {
-    log_validation_status(rc, uri, sia_extension_missing, generation);
-    goto done;
-  } else if (!routercert) {
-    log_validation_status(rc, uri, sia_extension_missing_from_ee, generation);
   }
 
-  if (certinfo->signedobject.s[0] && strcmp(uri->s, certinfo->signedobject.s))
-    log_validation_status(rc, uri, bad_signed_object_uri, generation);
+  if (require_inheritance && x->rfc3779_asid && x->rfc3779_asid->asnum &&
+      x->rfc3779_asid->asnum->type != ASIdentifierChoice_inherit) {
+    log_validation_status(rc, uri, rfc3779_inheritance_required, generation);
+    goto error;
+  }
+
+  if (econtent) {
+    econtent->data = (*pos)->data;
+    econtent->len  = (*pos)->length;
+  }
+
+  if (pcms) {
+    *pcms = cms;
+    cms = NULL;
+  }
+
+  if (px)
+    *px = x;
+
+  result = 1;
+
+ error:
+  CMS_ContentInfo_free(cms);
+  sk_X509_CRL_pop_free(crls, X509_CRL_free);
+  sk_X509_pop_free(certs, X509_free);
+
+  return result;
+}
+
+
+
+/**
+ * Load certificate, check against manifest, then run it through all
+ * the check_x509() tests.
+ */
+static X509 *check_cert_1(rcynic_ctx_t *rc,
+			  STACK_OF(walk_ctx_t) *wsk,
+			  const uri_t *uri,
+			  path_t *path,
+			  const path_t *prefix,
+			  certinfo_t *certinfo,
+			  const unsigned char *hash,
+			  const size_t hashlen,
+			  object_generation_t generation)
+{
+  hashbuf_t hashbuf;
+  X509 *x = NULL;
+
+  assert(uri && path && wsk && certinfo);
+
+  if (!uri_to_filename(rc, uri, path, prefix))
+    return NULL;
+
+  if (access(path->s, R_OK))
+    return NULL;
+
+  x = read_object_with_hash(wsk, path, ASN1_ITEM_rptr(X509), hash ? &hashbuf : NULL);
+
+  if (!x) {
+    logmsg(rc, log_sys_err, "Can't read certificate %s", path->s);
+    goto punt;
+  }
+
+  if (hash && (hashlen > sizeof(hashbuf.h) ||
+	       memcmp(hashbuf.h, hash, hashlen))) {
+    log_validation_status(rc, uri, digest_mismatch, generation);
+    if (!rc->allow_digest_mismatch)
+      goto punt;
+  }
+
+  if (check_x509(rc, wsk, uri, x, certinfo, generation))
+    return x;
+
+ punt:
+  X509_free(x);
+  return NULL;
+}
+
+/**
+ * Try to find a good copy of a certificate either in fresh data or in
+ * backup data from a previous run of this program.
+ */
+static X509 *check_cert(rcynic_ctx_t *rc,
+			STACK_OF(walk_ctx_t) *wsk,
+			uri_t *uri,
+			certinfo_t *certinfo,
+			const unsigned char *hash,
+			const size_t hashlen)
+{
+  walk_ctx_t *w = walk_ctx_stack_head(wsk);
+  object_generation_t generation;
+  const path_t *prefix = NULL;
+  path_t path;
+  X509 *x;
+
+  assert(rc && uri && wsk && w && certinfo);
+
+  switch (w->state) {
+  case walk_state_current:
+    prefix = &rc->unauthenticated;
+    generation = object_generation_current;
+    break;
+  case walk_state_backup:
+    prefix = &rc->old_authenticated;
+    generation = object_generation_backup;
+    break;
+  default:
+    return NULL;
+  }
+
+  if (skip_checking_this_object(rc, uri, generation))
+    return NULL;
+
+  if ((x = check_cert_1(rc, wsk, uri, &path, prefix, certinfo,
+			hash, hashlen, generation)) != NULL)
+    install_object(rc, uri, &path, generation);
+  else if (!access(path.s, F_OK))
+    log_validation_status(rc, uri, object_rejected, generation);
+  else if (hash && generation == w->manifest_generation)
+    log_validation_status(rc, uri, manifest_lists_missing_object, generation);
 
-  if ((crldp = X509_get_ext_d2i(x, NID_crl_distribution_points, NULL, NULL)) != NULL) {
-    ex_count--;
-    if (!extract_crldp_uri(rc, uri, generation, crldp, &certinfo->crldp))
-      goto done;
+  return x;
+}
+
+
+
+/**
+ * Read and check one manifest from disk.
+ */
+static manifest_t *check_manifest_1(rcynic_ctx_t *rc,
+				    STACK_OF(walk_ctx_t) *wsk,
+				    const uri_t *uri,
+				    path_t *path,
+				    const path_t *prefix,
+				    certinfo_t *certinfo,
+				    const object_generation_t generation)
+{
+  manifest_t *manifest = NULL, *result = NULL;
+  der_view_t *names = NULL, files, hash, econtent;
+  X509 *x;
+  unsigned unused;
+  size_t i;
+
+  assert(rc && wsk && uri && path && prefix && certinfo);
+
+  if ((manifest = calloc(1, sizeof(*manifest))) == NULL) {
+    logmsg(rc, log_sys_err, "Couldn't allocate manifest %s", uri->s);
+    goto done;
   }
 
-  rctx.rc = rc;
-  rctx.subject = certinfo;
+  if (!check_cms(rc, wsk, uri, path, prefix, &manifest->cms, &x, certinfo, &econtent, NULL, 0,
+		 NID_ct_rpkiManifest, 1, generation))
+    goto done;
 
-  if (w->certs == NULL && (w->certs = walk_ctx_stack_certs(rc, wsk)) == NULL)
+  if (!manifest_view_parse(&manifest->view, econtent.data, econtent.len)) {
+    log_validation_status(rc, uri, cms_econtent_decode_error, generation);
     goto done;
+  }
 
-  if (X509_get_version(x) != 2) {
+  if (manifest->view.version.data != NULL) {
     log_validation_status(rc, uri, wrong_object_version, generation);
     goto done;
   }
 
-  if (!x->cert_info || !x->cert_info->signature || !x->cert_info->signature->algorithm ||
-      OBJ_obj2nid(x->cert_info->signature->algorithm) != NID_sha256WithRSAEncryption) {
-    log_validation_status(rc, uri, nonconformant_signature_algorithm, generation);
+  if (!der_time_to_epoch(&manifest->view.thisUpdate, &manifest->thisUpdate) ||
+      !der_time_to_epoch(&manifest->view.nextUpdate, &manifest->nextUpdate)) {
+    log_validation_status(rc, uri, cms_econtent_decode_error, generation);
     goto done;
   }
 
-  if (certinfo->sia.s[0] && certinfo->sia.s[strlen(certinfo->sia.s) - 1] != '/') {
-    log_validation_status(rc, uri, malformed_cadirectory_uri, generation);
+  if (manifest->thisUpdate > rc->now) {
+    log_validation_status(rc, uri, manifest_not_yet_valid, generation);
     goto done;
   }
 
-  if (!w->certinfo.ta && strcmp(w->certinfo.uri.s, certinfo->aia.s))
-    log_validation_status(rc, uri, aia_doesnt_match_issuer, generation);
+  if (manifest->nextUpdate <= rc->now) {
+    log_validation_status(rc, uri, stale_crl_or_manifest, generation);
+    if (!rc->allow_stale_manifest)
+      goto done;
+  }
 
-  if (certinfo->ca && !certinfo->sia.s[0]) {
-    log_validation_status(rc, uri, sia_cadirectory_uri_missing, generation);
+  /*
+   * check_cms() has already parsed the EE certificate's validity
+   * period into *certinfo.
+   */
+  if (manifest->thisUpdate < certinfo->notBefore ||
+      manifest->nextUpdate > certinfo->notAfter) {
+    log_validation_status(rc, uri, manifest_interval_overruns_cert, generation);
     goto done;
   }
 
-  if (certinfo->ca && !certinfo->manifest.s[0]) {
-    log_validation_status(rc, uri, sia_manifest_uri_missing, generation);
+  if ((manifest->view.manifestNumber.data[0] & 0x80) != 0 ||
+      manifest->view.manifestNumber.len > 20) {
+    log_validation_status(rc, uri, bad_manifest_number, generation);
     goto done;
   }
 
-  if (certinfo->ca && !startswith(certinfo->manifest.s, certinfo->sia.s)) {
-    log_validation_status(rc, uri, manifest_carepository_mismatch, generation);
+  if (manifest->view.fileHashAlg.len != DER_OID_SHA256_LEN ||
+      memcmp(manifest->view.fileHashAlg.data, DER_OID_SHA256, DER_OID_SHA256_LEN)) {
+    log_validation_status(rc, uri, nonconformant_digest_algorithm, generation);
     goto done;
   }
 
-  if (x->skid) {
-    ex_count--;
-  } else {
-    log_validation_status(rc, uri, ski_extension_missing, generation);
+  if (manifest->view.nfiles > 0 &&
+      (names = malloc(manifest->view.nfiles * sizeof(*names))) == NULL) {
+    logmsg(rc, log_sys_err, "Couldn't allocate filename array for manifest %s", uri->s);
     goto done;
   }
 
-  if (!check_allowed_dn(X509_get_subject_name(x))) {
-    log_validation_status(rc, uri, nonconformant_subject_name, generation);
-    if (!rc->allow_nonconformant_name)
+  for (i = 0, files = manifest->view.fileList; i < manifest->view.nfiles; i++) {
+    if (!manifest_view_next_file(&files, &names[i], &hash, &unused)) {
+      log_validation_status(rc, uri, cms_econtent_decode_error, generation);
       goto done;
-  }
-
-  if (!check_allowed_dn(X509_get_issuer_name(x))) {
-    log_validation_status(rc, uri, nonconformant_issuer_name, generation);
-    if (!rc->allow_nonconformant_name)
+    }
+    if (hash.len != HASH_SHA256_LEN || unused != 0) {
+      log_validation_status(rc, uri, bad_manifest_digest_length, generation);
       goto done;
+    }
   }
 
-  if ((policies = X509_get_ext_d2i(x, NID_certificate_policies, &crit, NULL)) != NULL) {
-    POLICYQUALINFO *qualifier = NULL;
-    POLICYINFO *policy = NULL;
-    ex_count--;
-    if (!crit || sk_POLICYINFO_num(policies) != 1 ||
-	(policy = sk_POLICYINFO_value(policies, 0)) == NULL ||
-	OBJ_obj2nid(policy->policyid) != NID_cp_ipAddr_asNumber ||
-	sk_POLICYQUALINFO_num(policy->qualifiers) > 1 ||
-	(sk_POLICYQUALINFO_num(policy->qualifiers) == 1 &&
-	 ((qualifier = sk_POLICYQUALINFO_value(policy->qualifiers, 0)) == NULL ||
-	  OBJ_obj2nid(qualifier->pqualid) != NID_id_qt_cps))) {
-      log_validation_status(rc, uri, bad_certificate_policy, generation);
+  if (manifest->view.nfiles > 1)
+    qsort(names, manifest->view.nfiles, sizeof(*names), manifest_filename_cmp);
+
+  for (i = 0; i + 1 < manifest->view.nfiles; i++) {
+    if (!manifest_filename_cmp(&names[i], &names[i + 1])) {
+      log_validation_status(rc, uri, duplicate_name_in_manifest, generation);
       goto done;
     }
-    if (qualifier)
-      log_validation_status(rc, uri, policy_qualifier_cps, generation);
   }
 
-  if (!X509_EXTENSION_get_critical(X509_get_ext(x, X509_get_ext_by_NID(x, NID_key_usage, -1))) ||
-      (x->ex_flags & EXFLAG_KUSAGE) == 0 ||
-      x->ex_kusage != (certinfo->ca ? KU_KEY_CERT_SIGN | KU_CRL_SIGN : KU_DIGITAL_SIGNATURE)) {
-    log_validation_status(rc, uri, bad_key_usage, generation);
-    goto done;
+  result = manifest;
+  manifest = NULL;
+
+ done:
+  manifest_free(manifest);
+  free(names);
+  return result;
+}
+
+/**
+ * Compare two non-negative minimally encoded DER INTEGERs, such as
+ * manifest numbers.
+ */
+static int der_integer_cmp(const der_view_t *a, const der_view_t *b)
+{
+  if (a->len != b->len)
+    return a->len < b->len ? -1 : 1;
+  return memcmp(a->data, b->data, a->len);
+}
+
+/**
+ * Check whether we already have a particular manifest, attempt to fetch it
+ * and check issuer's signature if we don't.
+ *
+ * General plan here is to do basic checks on both current and backup
+ * generation manifests, then, if both generations pass all of our
+ * other tests, pick the generation with the highest manifest number,
+ * to protect against replay attacks.
+ *
+ * Once we've picked the manifest we're going to use, we need to check
+ * it against the CRL we've chosen.  Not much we can do if they don't
+ * match besides whine about it, but we do need to whine in this case.
+ */
+static int check_manifest(rcynic_ctx_t *rc,
+			  STACK_OF(walk_ctx_t) *wsk)
+{
+  walk_ctx_t *w = walk_ctx_stack_head(wsk);
+  manifest_t *old_manifest, *new_manifest, *result = NULL;
+  certinfo_t old_certinfo, new_certinfo;
+  const uri_t *uri, *crldp = NULL;
+  object_generation_t generation = object_generation_null;
+  path_t old_path, new_path;
+  der_view_t files, file, hash;
+  const char *crl_tail;
+  unsigned unused;
+  int found = 0, ok = 1;
+
+  assert(rc && wsk && w && !w->manifest);
+
+  uri = &w->certinfo.manifest;
+
+  logmsg(rc, log_telemetry, "Checking manifest %s", uri->s);
+
+  new_manifest = check_manifest_1(rc, wsk, uri, &new_path,
+				  &rc->unauthenticated, &new_certinfo,
+				  object_generation_current);
+
+  if (same_object_generations(rc, uri)) {
+    old_manifest = NULL;
+    (void) uri_to_filename(rc, uri, &old_path, &rc->old_authenticated);
+  } else {
+    old_manifest = check_manifest_1(rc, wsk, uri, &old_path,
+				    &rc->old_authenticated, &old_certinfo,
+				    object_generation_backup);
   }
-  ex_count--;
 
-  if (x->rfc3779_addr) {
-    ex_count--;
-    if (routercert ||
-	(loc = X509_get_ext_by_NID(x, NID_sbgp_ipAddrBlock, -1)) < 0 ||
-	!X509_EXTENSION_get_critical(X509_get_ext(x, loc)) ||
-	!v3_addr_is_canonical(x->rfc3779_addr) ||
-	sk_IPAddressFamily_num(x->rfc3779_addr) == 0) {
-      log_validation_status(rc, uri, bad_ipaddrblocks, generation);
-      goto done;
+  if (!new_manifest)
+    result = old_manifest;
+
+  else if (!old_manifest)
+    result = new_manifest;
+
+  else {
+    int num_cmp = der_integer_cmp(&old_manifest->view.manifestNumber, &new_manifest->view.manifestNumber);
+    int date_cmp = memcmp(old_manifest->view.thisUpdate.data, new_manifest->view.thisUpdate.data,
+			  DER_GENERALIZEDTIME_LEN);
+
+    if (num_cmp > 0)
+      log_validation_status(rc, uri, backup_number_higher_than_current, object_generation_current);
+    if (date_cmp > 0)
+      log_validation_status(rc, uri, backup_thisupdate_newer_than_current, object_generation_current);
+
+    if (num_cmp > 0 && date_cmp > 0)
+      result = old_manifest;
+    else
+      result = new_manifest;
+  }
+
+  if (result && result == new_manifest) {
+    generation = object_generation_current;
+    install_object(rc, uri, &new_path, generation);
+    crldp = &new_certinfo.crldp;
+  }
+
+  if (result && result == old_manifest) {
+    generation = object_generation_backup;
+    install_object(rc, uri, &old_path, generation);
+    crldp = &old_certinfo.crldp;
+  }
+
+  if (result) {
+    crl_tail = strrchr(crldp->s, '/');
+    assert(crl_tail != NULL);
+    crl_tail++;
+
+    for (files = result->view.fileList; !found && manifest_view_next_file(&files, &file, &hash, &unused); )
+      found = file.len == strlen(crl_tail) && !memcmp(file.data, crl_tail, file.len);
+
+    if (!found) {
+      log_validation_status(rc, uri, crl_not_in_manifest, generation);
+      if (rc->require_crl_in_manifest)
+	ok = 0;
     }
-    for (i = 0; i < sk_IPAddressFamily_num(x->rfc3779_addr); i++) {
-      IPAddressFamily *f = sk_IPAddressFamily_value(x->rfc3779_addr, i);
-      afi = v3_addr_get_afi(f);
-      if (afi != IANA_AFI_IPV4 && afi != IANA_AFI_IPV6) {
-	log_validation_status(rc, uri, unknown_afi, generation);
-	goto done;
-      }
-      if (f->addressFamily->length != 2) {
-	log_validation_status(rc, uri, safi_not_allowed, generation);
-	goto done;
-      }
+
+    else if (!check_crl_digest(rc, crldp, hash.data, hash.len)) {
+      log_validation_status(rc, uri, digest_mismatch, generation);
+      if (!rc->allow_crl_digest_mismatch)
+	ok = 0;
     }
   }
 
-  if (x->rfc3779_asid) {
-    ex_count--;
-    if ((loc = X509_get_ext_by_NID(x, NID_sbgp_autonomousSysNum, -1)) < 0 ||
-	!X509_EXTENSION_get_critical(X509_get_ext(x, loc)) ||
-	!v3_asid_is_canonical(x->rfc3779_asid) ||
-	x->rfc3779_asid->asnum == NULL ||
-	x->rfc3779_asid->rdi != NULL ||
-	(routercert && x->rfc3779_asid->asnum->type == ASIdentifierChoice_inherit)) {
-      log_validation_status(rc, uri, bad_asidentifiers, generation);
-      goto done;
-    }
+  if ((!result || result != new_manifest) && !access(new_path.s, F_OK))
+    log_validation_status(rc, uri, object_rejected, object_generation_current);
+
+  if (!result && !access(old_path.s, F_OK))
+    log_validation_status(rc, uri, object_rejected, object_generation_backup);
+
+  if (result != new_manifest)
+    manifest_free(new_manifest);
+
+  if (result != old_manifest)
+    manifest_free(old_manifest);
+
+  w->manifest = result;
+  if (crldp)
+    w->crldp = *crldp;
+  w->manifest_generation = generation;
+
+  return ok;
+}
+
+
+
+/**
+ * Mark CRL or manifest that we're rechecking so XML report makes more sense.
+ */
+static void rsync_needed_mark_recheck(rcynic_ctx_t *rc,
+				      const uri_t *uri)
+{
+  validation_status_t *v = NULL;
+
+  if (uri->s[0] != '\0')
+    v = validation_status_find(rc->validation_status_root,
+			       uri, object_generation_current);
+
+  if (v) {
+    validation_status_set_code(v, stale_crl_or_manifest, 0);
+    log_validation_status(rc, uri, rechecking_object,
+			  object_generation_current);
   }
+}
+
+/**
+ * Check whether we need to rsync a particular tree.  This depends on
+ * the setting of rc->rsync_early, whether we have a valid manifest on
+ * file, and whether that manifest is stale yet.
+ */
+static int rsync_needed(rcynic_ctx_t *rc,
+			STACK_OF(walk_ctx_t) *wsk)
+{
+  walk_ctx_t *w = walk_ctx_stack_head(wsk);
+  int needed;
+
+  assert(rc && wsk && w);
+
+  needed = (rc->rsync_early ||
+	    !check_manifest(rc, wsk) ||
+	    w->manifest == NULL ||
+	    w->manifest->nextUpdate <= rc->now);
 
-  if (!x->rfc3779_addr && !x->rfc3779_asid) {
-    log_validation_status(rc, uri, missing_resources, generation);
-    goto done;
+  if (needed && w->manifest != NULL) {
+    rsync_needed_mark_recheck(rc, &w->certinfo.manifest);
+    rsync_needed_mark_recheck(rc, &w->certinfo.crldp);
+    manifest_free(w->manifest);
+    w->manifest = NULL;
   }
 
-  subject_pkey = X509_get_pubkey(x);
-  ok = subject_pkey != NULL;
-  if (ok) {
-    ASN1_OBJECT *algorithm;
+  return needed;
+}
 
-    (void) X509_PUBKEY_get0_param(&algorithm, NULL, NULL, NULL, X509_get_X509_PUBKEY(x));
+
 
-    switch (OBJ_obj2nid(algorithm)) {
+/**
+ * Extract a ROA prefix from the DER bitstring encoding.  maxLength
+ * is a view of the INTEGER contents, with NULL data if absent.
+ */
+static int extract_roa_prefix(const der_view_t *address,
+			      const unsigned unused,
+			      const der_view_t *maxLength,
+			      const unsigned afi,
+			      unsigned char *addr,
+			      unsigned *prefixlen,
+			      unsigned *max_prefixlen)
+{
+  unsigned length;
+  unsigned long maxlen = 0;
 
-    case NID_rsaEncryption:
-      ok = (EVP_PKEY_type(subject_pkey->type) == EVP_PKEY_RSA &&
-	    BN_get_word(subject_pkey->pkey.rsa->e) == 65537);
-      if (!ok)
-	break;
-      if (!certinfo->ca && rc->allow_1024_bit_ee_key &&
-	  BN_num_bits(subject_pkey->pkey.rsa->n) == 1024)
-	log_validation_status(rc, uri, ee_certificate_with_1024_bit_key, generation);
-      else
-	ok = BN_num_bits(subject_pkey->pkey.rsa->n) == 2048;
-      break;
+  assert(address && maxLength && addr && prefixlen && max_prefixlen);
 
-    case NID_X9_62_id_ecPublicKey:
-      ok = !certinfo->ca && routercert;
-      break;
+  switch (afi) {
+  case IANA_AFI_IPV4: length =  4; break;
+  case IANA_AFI_IPV6: length = 16; break;
+  default: return 0;
+  }
 
-    default:
-      ok = 0;
+  if (address->len > length ||
+      (maxLength->data != NULL &&
+       (!der_integer_to_ulong(maxLength, &maxlen) || maxlen > (unsigned long) length * 8)))
+    return 0;
+
+  if (address->len > 0) {
+    memcpy(addr, address->data, address->len);
+    if (unused != 0) {
+      unsigned char mask = 0xFF >> (8 - unused);
+      addr[address->len - 1] &= ~mask;
     }
   }
-  if (!ok) {
-    log_validation_status(rc, uri, bad_public_key, generation);
-    goto done;
-  }
 
-  if (x->skid == NULL ||
-      (ski_pubkey = X509_get0_pubkey_bitstr(x)) == NULL ||
-      !EVP_Digest(ski_pubkey->data, ski_pubkey->length,
-		  ski_hashbuf.h, &ski_hashlen, EVP_sha1(), NULL) ||
-      ski_hashlen != 20 ||
-      ski_hashlen != x->skid->length ||
-      memcmp(ski_hashbuf.h, x->skid->data, ski_hashlen)) {
-    log_validation_status(rc, uri, ski_public_key_mismatch, generation);
-    goto done;
-  }
+  memset(addr + address->len, 0, length - address->len);
+  *prefixlen = (address->len * 8) - unused;
+  *max_prefixlen = maxLength->data != NULL ? (unsigned) maxlen : *prefixlen;
 
-  if (x->akid) {
-    ex_count--;
-    if (!check_aki(rc, uri, w->cert, x->akid, generation))
-      goto done;
-  }
+  return 1;
+}
 
-  if (!x->akid && !certinfo->ta) {
-    log_validation_status(rc, uri, aki_extension_missing, generation);
-    goto done;
-  }
+/**
+ * Unsigned 128-bit integer, big enough for an IPv6 address.  IPv4
+ * addresses use the low 32 bits.
+ */
+typedef struct { uint64_t hi, lo; } u128_t;
 
-  if ((issuer_pkey = X509_get_pubkey(w->cert)) == NULL || X509_verify(x, issuer_pkey) <= 0) {
-    log_validation_status(rc, uri, certificate_bad_signature, generation);
-    goto done;
-  }
+/**
+ * Closed interval of IP addresses.
+ */
+typedef struct { u128_t min, max; } ip_interval_t;
 
-  if (certinfo->ta) {
+/**
+ * IP address resources as sorted, merged interval lists, one per
+ * address family.  This is much cheaper to build and to compare than
+ * OpenSSL's IPAddrBlocks, which matters for ROAs with thousands of
+ * prefixes.
+ */
+typedef struct {
+  ip_interval_t *v4, *v6;
+  size_t n_v4, n_v6;
+} ip_resources_t;
 
-    if (certinfo->crldp.s[0]) {
-      log_validation_status(rc, uri, trust_anchor_with_crldp, generation);
-      goto done;
-    }
+/**
+ * Convert a big-endian address of up to 16 octets to a u128_t.
+ */
+static u128_t u128_from_bytes(const unsigned char *b, const size_t n)
+{
+  u128_t u = {0, 0};
+  size_t i;
 
-  } else {
+  assert(n <= 16);
 
-    if (!certinfo->crldp.s[0]) {
-      log_validation_status(rc, uri, crldp_uri_missing, generation);
-      goto done;
-    }
+  for (i = 0; i < n; i++) {
+    u.hi = (u.hi << 8) | (u.lo >> 56);
+    u.lo = (u.lo << 8) | b[i];
+  }
 
-    if (!certinfo->ca && !startswith(certinfo->crldp.s, w->certinfo.sia.s)) {
-      log_validation_status(rc, uri, crldp_doesnt_match_issuer_sia, generation);
-      goto done;
-    }
+  return u;
+}
 
-    if (w->crls == NULL && ((w->crls = sk_X509_CRL_new_null()) == NULL ||
-			    !sk_X509_CRL_push(w->crls, NULL))) {
-      logmsg(rc, log_sys_err, "Internal allocation error setting up CRL for validation");
-      goto done;
-    }
+/**
+ * Compare two u128_t values.
+ */
+static int u128_cmp(const u128_t a, const u128_t b)
+{
+  if (a.hi != b.hi)
+    return a.hi < b.hi ? -1 : 1;
+  if (a.lo != b.lo)
+    return a.lo < b.lo ? -1 : 1;
+  return 0;
+}
 
-    assert(sk_X509_CRL_num(w->crls) == 1);
-    assert((w->crldp.s[0] == '\0') == (sk_X509_CRL_value(w->crls, 0) == NULL));
+/**
+ * Compare two intervals by lower bound, qsort() style.
+ */
+static int ip_interval_cmp(const void *a, const void *b)
+{
+  return u128_cmp(((const ip_interval_t *) a)->min, ((const ip_interval_t *) b)->min);
+}
 
-    if (strcmp(w->crldp.s, certinfo->crldp.s)) {
-      X509_CRL *old_crl = sk_X509_CRL_value(w->crls, 0);
-      X509_CRL *new_crl = check_crl(rc, &certinfo->crldp, w->cert);
+/**
+ * Sort an interval list and merge intervals which overlap or touch,
+ * leaving the same canonical form RFC 3779 uses.  This also takes
+ * care of nested ROA prefixes.
+ */
+static void ip_intervals_canonize(ip_interval_t *v, size_t *n)
+{
+  size_t i, j;
 
-      if (w->crldp.s[0])
-	log_validation_status(rc, uri, issuer_uses_multiple_crldp_values, generation);
+  if (*n < 2)
+    return;
 
-      if (new_crl == NULL) {
-	log_validation_status(rc, uri, bad_crl, generation);
-	goto done;
-      }
+  qsort(v, *n, sizeof(*v), ip_interval_cmp);
 
-      if (old_crl && new_crl && ASN1_INTEGER_cmp(old_crl->crl_number, new_crl->crl_number) < 0) {
-	log_validation_status(rc, uri, crldp_names_newer_crl, generation);
-	X509_CRL_free(old_crl);
-	old_crl = NULL;
-      }
+  for (i = 0, j = 1; j < *n; j++) {
+    u128_t next = v[i].max;
 
-      if (old_crl == NULL) {
-	sk_X509_CRL_set(w->crls, 0, new_crl);
-	w->crldp = certinfo->crldp;
-      } else {
-	X509_CRL_free(new_crl);
-      }
+    if (++next.lo == 0)
+      next.hi++;
+
+    if (u128_cmp(v[j].min, v[i].max) <= 0 ||
+	(u128_cmp(next, v[i].max) > 0 && u128_cmp(v[j].min, next) <= 0)) {
+      if (u128_cmp(v[j].max, v[i].max) > 0)
+	v[i].max = v[j].max;
+    } else {
+      v[++i] = v[j];
     }
+  }
 
-    assert(sk_X509_CRL_value(w->crls, 0));
-    flags |= X509_V_FLAG_CRL_CHECK;
-    X509_STORE_CTX_set0_crls(&rctx.ctx, w->crls);
+  *n = i + 1;
+}
+
+/**
+ * Check whether canonical interval list a is a subset of canonical
+ * interval list b, by walking both lists in parallel.
+ */
+static int ip_intervals_subset(const ip_interval_t *a, const size_t na,
+			       const ip_interval_t *b, const size_t nb)
+{
+  size_t i, j;
+
+  for (i = j = 0; i < na; i++) {
+    while (j < nb && u128_cmp(b[j].max, a[i].min) < 0)
+      j++;
+    if (j == nb ||
+	u128_cmp(b[j].min, a[i].min) > 0 ||
+	u128_cmp(b[j].max, a[i].max) < 0)
+      return 0;
   }
 
-  if (ex_count > 0) {
-    log_validation_status(rc, uri, disallowed_x509v3_extension, generation);
-    goto done;
+  return 1;
+}
+
+/**
+ * Free an ip_resources_t's interval lists.
+ */
+static void ip_resources_free(ip_resources_t *r)
+{
+  if (r != NULL) {
+    free(r->v4);
+    free(r->v6);
+    memset(r, 0, sizeof(*r));
   }
+}
 
-  assert(w->certs != NULL);
-  X509_STORE_CTX_trusted_stack(&rctx.ctx, w->certs);
-  X509_STORE_CTX_set_verify_cb(&rctx.ctx, check_x509_cb);
+/**
+ * Extract a certificate's IP address resources.  Returns 1 on
+ * success, 0 if the certificate has no IP resources or uses
+ * inheritance (which, like v3_addr_subset(), we treat as containing
+ * nothing), -1 if we ran out of memory.
+ */
+static int ip_resources_from_x509(X509 *x, ip_resources_t *r)
+{
+  unsigned char min[ADDR_RAW_BUF_LEN], max[ADDR_RAW_BUF_LEN];
+  IPAddressOrRanges *aors;
+  IPAddressFamily *f;
+  ip_interval_t *v;
+  size_t *n;
+  int i, j, length;
 
-  X509_VERIFY_PARAM_set_flags(rctx.ctx.param, flags);
+  assert(x && r);
 
-  X509_VERIFY_PARAM_add0_policy(rctx.ctx.param, OBJ_nid2obj(NID_cp_ipAddr_asNumber));
+  memset(r, 0, sizeof(*r));
 
-  if (X509_verify_cert(&rctx.ctx) <= 0) {
-    log_validation_status(rc, uri, certificate_failed_validation, generation);
-    goto done;
-  }
+  if (x->rfc3779_addr == NULL || v3_addr_inherits(x->rfc3779_addr))
+    return 0;
 
-  ret = 1;
+  for (i = 0; i < sk_IPAddressFamily_num(x->rfc3779_addr); i++) {
+    f = sk_IPAddressFamily_value(x->rfc3779_addr, i);
 
- done:
-  X509_STORE_CTX_cleanup(&rctx.ctx);
-  EVP_PKEY_free(issuer_pkey);
-  EVP_PKEY_free(subject_pkey);
-  BASIC_CONSTRAINTS_free(bc);
-  sk_ACCESS_DESCRIPTION_pop_free(sia, ACCESS_DESCRIPTION_free);
-  sk_ACCESS_DESCRIPTION_pop_free(aia, ACCESS_DESCRIPTION_free);
-  sk_DIST_POINT_pop_free(crldp, DIST_POINT_free);
-  sk_POLICYINFO_pop_free(policies, POLICYINFO_free);
-  sk_ASN1_OBJECT_pop_free(eku, ASN1_OBJECT_free);
+    if (f->addressFamily->length != 2 ||
+	f->ipAddressChoice->type != IPAddressChoice_addressesOrRanges ||
+	sk_IPAddressOrRange_num(aors = f->ipAddressChoice->u.addressesOrRanges) <= 0)
+      continue;
 
-  return ret;
+    switch (v3_addr_get_afi(f)) {
+    case IANA_AFI_IPV4: n = &r->n_v4; break;
+    case IANA_AFI_IPV6: n = &r->n_v6; break;
+    default: continue;
+    }
+
+    if ((v = realloc(n == &r->n_v4 ? r->v4 : r->v6,
+		     (*n + sk_IPAddressOrRange_num(aors)) * sizeof(*v))) == NULL) {
+      ip_resources_free(r);
+      return -1;
+    }
+
+    if (n == &r->n_v4)
+      r->v4 = v;
+    else
+      r->v6 = v;
+
+    for (j = 0; j < sk_IPAddressOrRange_num(aors); j++) {
+      length = v3_addr_get_range(sk_IPAddressOrRange_value(aors, j), v3_addr_get_afi(f),
+				 min, max, sizeof(min));
+      if (length == 0)
+	continue;
+      v[*n].min = u128_from_bytes(min, length);
+      v[*n].max = u128_from_bytes(max, length);
+      ++*n;
+    }
+  }
+
+  ip_intervals_canonize(r->v4, &r->n_v4);
+  ip_intervals_canonize(r->v6, &r->n_v6);
+  return 1;
 }
 
 /**
- * Extract one datum from a CMS_SignerInfo.
+ * Convert a ROA prefix, as returned by extract_roa_prefix(), to an
+ * interval.
  */
-static void *extract_si_datum(CMS_SignerInfo *si,
-			      int *n,
-			      const int optional,
-			      const int nid,
-			      const int asn1_type)
+static void ip_interval_from_prefix(const unsigned char *addr,
+				    const unsigned length,
+				    const unsigned prefixlen,
+				    ip_interval_t *r)
 {
-  int i = CMS_signed_get_attr_by_NID(si, nid, -1);
-  void *result = NULL;
-  X509_ATTRIBUTE *a;
+  unsigned char max[ADDR_RAW_BUF_LEN];
+  unsigned i = prefixlen / 8;
 
-  assert(si && n);
+  assert(addr && length <= sizeof(max) && prefixlen <= length * 8 && r);
 
-  if (i < 0 && optional)
-    return NULL;
+  memcpy(max, addr, length);
 
-  if (i >= 0 &&
-      CMS_signed_get_attr_by_NID(si, nid, i) < 0 &&
-      (a = CMS_signed_get_attr(si, i)) != NULL &&
-      X509_ATTRIBUTE_count(a) == 1 &&
-      (result = X509_ATTRIBUTE_get0_data(a, 0, asn1_type, NULL)) != NULL)
-    --*n;
-  else
-    *n = -1;
+  if (prefixlen % 8 != 0)
+    max[i++] |= 0xFF >> (prefixlen % 8);
 
-  return result;
+  for (; i < length; i++)
+    max[i] = 0xFF;
+
+  r->min = u128_from_bytes(addr, length);
+  r->max = u128_from_bytes(max,  length);
 }
 
 /**
- * Check a signed CMS object.
+ * Read and check one ROA from disk.
  */
-static int check_cms(rcynic_ctx_t *rc,
-		     STACK_OF(walk_ctx_t) *wsk,
-		     const uri_t *uri,
-		     path_t *path,
-		     const path_t *prefix,
-		     CMS_ContentInfo **pcms,
-		     X509 **px,
-		     certinfo_t *certinfo,
-		     BIO *bio,
-		     const unsigned char *hash,
-		     const size_t hashlen,
-		     const int expected_eContentType_nid,
-		     const int require_inheritance,
-		     const object_generation_t generation)
+static int check_roa_1(rcynic_ctx_t *rc,
+		       STACK_OF(walk_ctx_t) *wsk,
+		       const uri_t *uri,
+		       path_t *path,
+		       const path_t *prefix,
+		       const unsigned char *hash,
+		       const size_t hashlen,
+		       const object_generation_t generation)
 {
-  STACK_OF(CMS_SignerInfo) *signer_infos = NULL;
+  ip_resources_t roa_resources, ee_resources;
+  unsigned char addrbuf[ADDR_RAW_BUF_LEN];
+  der_view_t econtent, families, addressFamily, addresses, address, maxLength;
   CMS_ContentInfo *cms = NULL;
-  CMS_SignerInfo *si = NULL;
-  ASN1_OCTET_STRING *sid = NULL;
-  X509_NAME *si_issuer = NULL;
-  ASN1_INTEGER *si_serial = NULL;
-  STACK_OF(X509_CRL) *crls = NULL;
-  STACK_OF(X509) *certs = NULL;
-  X509_ALGOR *signature_alg = NULL, *digest_alg = NULL;
-  ASN1_OBJECT *oid = NULL;
-  hashbuf_t hashbuf;
   X509 *x = NULL;
-  certinfo_t certinfo_;
-  int i, result = 0;
-
-  assert(rc && wsk && uri && path && prefix);
-
-  if (!certinfo)
-    certinfo = &certinfo_;
-
-  if (!uri_to_filename(rc, uri, path, prefix))
-    goto error;
-
-  if (hash)
-    cms = read_cms(path, &hashbuf);
-  else
-    cms = read_cms(path, NULL);
-
-  if (!cms)
-    goto error;
-
-  if (hash && (hashlen > sizeof(hashbuf.h) ||
-	       memcmp(hashbuf.h, hash, hashlen))) {
-    log_validation_status(rc, uri, digest_mismatch, generation);
-    if (!rc->allow_digest_mismatch)
-      goto error;
-  }
+  roa_view_t roa;
+  ip_interval_t *v;
+  size_t *n, *alloc, v4_alloc = 0, v6_alloc = 0;
+  int has_safi = 0, result = 0;
+  unsigned afi, prefixlen, max_prefixlen, unused;
 
-  if (OBJ_obj2nid(CMS_get0_eContentType(cms)) != expected_eContentType_nid) {
-    log_validation_status(rc, uri, bad_cms_econtenttype, generation);
-    goto error;
-  }
+  assert(rc && wsk && uri && path && prefix);
 
-  if (CMS_verify(cms, NULL, NULL, NULL, bio, CMS_NO_SIGNER_CERT_VERIFY) <= 0) {
-    log_validation_status(rc, uri, cms_validation_failure, generation);
-    goto error;
-  }
+  memset(&roa_resources, 0, sizeof(roa_resources));
+  memset(&ee_resources,  0, sizeof(ee_resources));
 
-  if ((crls = CMS_get1_crls(cms)) != NULL) {
-    log_validation_status(rc, uri, cms_includes_crls, generation);
+  if (!check_cms(rc, wsk, uri, path, prefix, &cms, &x, NULL, &econtent, NULL, 0,
+		 NID_ct_ROA, 0, generation))
     goto error;
-  }
 
-  if ((signer_infos = CMS_get0_SignerInfos(cms)) == NULL ||
-      sk_CMS_SignerInfo_num(signer_infos) != 1 ||
-      (si = sk_CMS_SignerInfo_value(signer_infos, 0)) == NULL ||
-      !CMS_SignerInfo_get0_signer_id(si, &sid, &si_issuer, &si_serial) ||
-      sid == NULL || si_issuer != NULL || si_serial != NULL ||
-      CMS_unsigned_get_attr_count(si) != -1) {
-    log_validation_status(rc, uri, bad_cms_signer_infos, generation);
+  if (!roa_view_parse(&roa, econtent.data, econtent.len)) {
+    log_validation_status(rc, uri, cms_econtent_decode_error, generation);
     goto error;
   }
 
-  CMS_SignerInfo_get0_algs(si, NULL, &x, &digest_alg, &signature_alg);
-
-  if (x == NULL) {
-    log_validation_status(rc, uri, cms_signer_missing, generation);
+  if (roa.version.data != NULL) {
+    log_validation_status(rc, uri, wrong_object_version, generation);
     goto error;
   }
 
-  if ((certs = CMS_get1_certs(cms)) == NULL ||
-      sk_X509_num(certs) != 1 ||
-      X509_cmp(x, sk_X509_value(certs, 0))) {
-    log_validation_status(rc, uri, bad_cms_signer, generation);
+  if (!der_integer_fits(&roa.asID, 4)) {
+    log_validation_status(rc, uri, bad_roa_asID, generation);
     goto error;
   }
 
-  X509_ALGOR_get0(&oid, NULL, NULL, signature_alg);
-  i = OBJ_obj2nid(oid);
-  if (i != NID_sha256WithRSAEncryption && i != NID_rsaEncryption) {
-    log_validation_status(rc, uri, wrong_cms_si_signature_algorithm, generation);
-    goto error;
-  }
+  /*
+   * RFC 6482 says ipAddrBlocks and each family's addresses are
+   * SIZE (1..MAX).  Check this explicitly: an empty ROA would
+   * otherwise sail through the subset test below.
+   */
 
-  X509_ALGOR_get0(&oid, NULL, NULL, digest_alg);
-  if (OBJ_obj2nid(oid) != NID_sha256) {
-    log_validation_status(rc, uri, wrong_cms_si_digest_algorithm, generation);
+  if (roa.ipAddrBlocks.len == 0) {
+    log_validation_status(rc, uri, bad_roa_ipAddrBlocks, generation);
     goto error;
   }
 
-  i = CMS_signed_get_attr_count(si);
-
-  (void) extract_si_datum(si, &i, 1, NID_pkcs9_signingTime,   V_ASN1_UTCTIME);
-  (void) extract_si_datum(si, &i, 1, NID_binary_signing_time, V_ASN1_INTEGER);
-  oid =  extract_si_datum(si, &i, 0, NID_pkcs9_contentType,   V_ASN1_OBJECT);
-  (void) extract_si_datum(si, &i, 0, NID_pkcs9_messageDigest, V_ASN1_OCTET_STRING);
+  /*
+   * Extract prefixes from ROA and convert them into interval lists.
+   * Nested and overlapping prefixes are legal in a ROA; they fall out
+   * when we canonize the lists below.
+   */
 
-  if (i != 0) {
-    log_validation_status(rc, uri, bad_cms_si_signed_attributes, generation);
-    if (!rc->allow_wrong_cms_si_attributes)
+  for (families = roa.ipAddrBlocks; roa_view_next_family(&families, &addressFamily, &addresses); ) {
+    if (addressFamily.len < 2 || addressFamily.len > 3) {
+      log_validation_status(rc, uri, malformed_roa_addressfamily, generation);
       goto error;
-  }
-
-  if (OBJ_obj2nid(oid) != expected_eContentType_nid) {
-    log_validation_status(rc, uri, bad_cms_si_contenttype, generation);
-    goto error;
-  }
+    }
+    if (addresses.len == 0) {
+      log_validation_status(rc, uri, bad_roa_ipAddrBlocks, generation);
+      goto error;
+    }
+    afi = (addressFamily.data[0] << 8) | (addressFamily.data[1]);
+    if (afi != IANA_AFI_IPV4 && afi != IANA_AFI_IPV6) {
+      log_validation_status(rc, uri, roa_contains_bad_afi_value, generation);
+      goto error;
+    }
+    while (roa_view_next_address(&addresses, &address, &unused, &maxLength)) {
+      if (!extract_roa_prefix(&address, unused, &maxLength, afi, addrbuf, &prefixlen, &max_prefixlen)) {
+	log_validation_status(rc, uri, roa_resources_malformed, generation);
+	goto error;
+      }
+      if (max_prefixlen < prefixlen) {
+	log_validation_status(rc, uri, roa_max_prefixlen_too_short, generation);
+	goto error;
+      }
 
-  if (CMS_SignerInfo_cert_cmp(si, x)) {
-    log_validation_status(rc, uri, cms_ski_mismatch, generation);
-    goto error;
-  }
+      /*
+       * Certificates never carry a SAFI, so a ROA prefix qualified
+       * by one can never be covered by the EE certificate.
+       */
+      if (addressFamily.len == 3) {
+	has_safi = 1;
+	continue;
+      }
 
-  if (!check_x509(rc, wsk, uri, x, certinfo, generation))
-    goto error;
+      if (afi == IANA_AFI_IPV4) {
+	n = &roa_resources.n_v4;
+	alloc = &v4_alloc;
+      } else {
+	n = &roa_resources.n_v6;
+	alloc = &v6_alloc;
+      }
 
-  if (require_inheritance && x->rfc3779_addr) {
-    for (i = 0; i < sk_IPAddressFamily_num(x->rfc3779_addr); i++) {
-      IPAddressFamily *f = sk_IPAddressFamily_value(x->rfc3779_addr, i);
-      if (f->ipAddressChoice->type != IPAddressChoice_inherit) {
-	log_validation_status(rc, uri, rfc3779_inheritance_required, generation);
-	goto error;
+      if (*n == *alloc) {
+	*alloc = *alloc ? *alloc * 2 : 16;
+	if ((v = realloc(afi == IANA_AFI_IPV4 ? roa_resources.v4 : roa_resources.v6,
+			 *alloc * sizeof(*v))) == NULL) {
+	  logmsg(rc, log_sys_err, "Couldn't allocate prefix list for ROA %s", uri->s);
+	  goto error;
+	}
+	if (afi == IANA_AFI_IPV4)
+	  roa_resources.v4 = v;
+	else
+	  roa_resources.v6 = v;
       }
+
+      ip_interval_from_prefix(addrbuf, afi == IANA_AFI_IPV4 ? 4 : 16, prefixlen,
+			      (afi == IANA_AFI_IPV4 ? roa_resources.v4 : roa_resources.v6) + (*n)++);
     }
   }
 
-  if (require_inheritance && x->rfc3779_asid && x->rfc3779_asid->asnum &&
-      x->rfc3779_asid->asnum->type != ASIdentifierChoice_inherit) {
-    log_validation_status(rc, uri, rfc3779_inheritance_required, generation);
+  ip_intervals_canonize(roa_resources.v4, &roa_resources.n_v4);
+  ip_intervals_canonize(roa_resources.v6, &roa_resources.n_v6);
+
+  /*
+   * The EE certificate's resources were already decoded by OpenSSL
+   * when check_cms() verified it, so use those rather than decoding
+   * the extension again.
+   */
+
+  if (ip_resources_from_x509(x, &ee_resources) < 0) {
+    logmsg(rc, log_sys_err, "Couldn't allocate EE resources for ROA %s", uri->s);
     goto error;
   }
 
-  if (pcms) {
-    *pcms = cms;
-    cms = NULL;
+  if (has_safi ||
+      !ip_intervals_subset(roa_resources.v4, roa_resources.n_v4, ee_resources.v4, ee_resources.n_v4) ||
+      !ip_intervals_subset(roa_resources.v6, roa_resources.n_v6, ee_resources.v6, ee_resources.n_v6)) {
+    log_validation_status(rc, uri, roa_resource_not_in_ee, generation);
+    goto error;
   }
 
-  if (px)
-    *px = x;
-
   result = 1;
 
  error:
   CMS_ContentInfo_free(cms);
-  sk_X509_CRL_pop_free(crls, X509_CRL_free);
-  sk_X509_pop_free(certs, X509_free);
+  ip_resources_free(&roa_resources);
+  ip_resources_free(&ee_resources);
 
   return result;
 }
 
-
-
 /**
- * Load certificate, check against manifest, then run it through all
- * the check_x509() tests.
+ * Check whether we already have a particular ROA, attempt to fetch it
+ * and check issuer's signature if we don't.
  */
-static X509 *check_cert_1(rcynic_ctx_t *rc,
-			  STACK_OF(walk_ctx_t) *wsk,
-			  const uri_t *uri,
-			  path_t *path,
-			  const path_t *prefix,
-			  certinfo_t *certinfo,
-			  const unsigned char *hash,
-			  const size_t hashlen,
-			  object_generation_t generation)
+static void check_roa(rcynic_ctx_t *rc,
+		      STACK_OF(walk_ctx_t) *wsk,
+		      const uri_t *uri,
+		      const unsigned char *hash,
+		      const size_t hashlen)
 {
-  hashbuf_t hashbuf;
-  X509 *x = NULL;
-
-  assert(uri && path && wsk && certinfo);
+  walk_ctx_t *w = walk_ctx_stack_head(wsk);
+  path_t path;
 
-  if (!uri_to_filename(rc, uri, path, prefix))
-    return NULL;
+  assert(rc && wsk && w && uri);
 
-  if (access(path->s, R_OK))
-    return NULL;
+  if (uri_to_filename(rc, uri, &path, &rc->new_authenticated) &&
+      !access(path.s, F_OK))
+    return;
 
-  if (hash)
-    x = read_cert(path, &hashbuf);
-  else
-    x = read_cert(path, NULL);
+  logmsg(rc, log_telemetry, "Checking ROA %s", uri->s);
 
-  if (!x) {
-    logmsg(rc, log_sys_err, "Can't read certificate %s", path->s);
-    goto punt;
+  if (check_roa_1(rc, wsk, uri, &path, &rc->unauthenticated,
+		  hash, hashlen, object_generation_current)) {
+    install_object(rc, uri, &path, object_generation_current);
+    return;
   }
 
-  if (hash && (hashlen > sizeof(hashbuf.h) ||
-	       memcmp(hashbuf.h, hash, hashlen))) {
-    log_validation_status(rc, uri, digest_mismatch, generation);
-    if (!rc->allow_digest_mismatch)
-      goto punt;
+  if (!access(path.s, F_OK))
+    log_validation_status(rc, uri, object_rejected, object_generation_current);
+  else if (hash)
+    log_validation_status(rc, uri, manifest_lists_missing_object, object_generation_current);
+
+  if (same_object_generations(rc, uri)) {
+    log_validation_status(rc, uri, object_rejected, object_generation_backup);
+    return;
   }
 
-  if (check_x509(rc, wsk, uri, x, certinfo, generation))
-    return x;
+  if (check_roa_1(rc, wsk, uri, &path, &rc->old_authenticated,
+		  hash, hashlen, object_generation_backup)) {
+    install_object(rc, uri, &path, object_generation_backup);
+    return;
+  }
 
- punt:
-  X509_free(x);
-  return NULL;
+  if (!access(path.s, F_OK))
+    log_validation_status(rc, uri, object_rejected, object_generation_backup);
+  else if (hash && w->manifest_generation == object_generation_backup)
+    log_validation_status(rc, uri, manifest_lists_missing_object, object_generation_backup);
 }
 
+
+
 /**
- * Try to find a good copy of a certificate either in fresh data or in
- * backup data from a previous run of this program.
+ * Read and check one Ghostbuster record from disk.
  */
-static X509 *check_cert(rcynic_ctx_t *rc,
-			STACK_OF(walk_ctx_t) *wsk,
-			uri_t *uri,
-			certinfo_t *certinfo,
-			const unsigned char *hash,
-			const size_t hashlen)
+static int check_ghostbuster_1(rcynic_ctx_t *rc,
+			       STACK_OF(walk_ctx_t) *wsk,
+			       const uri_t *uri,
+			       path_t *path,
+			       const path_t *prefix,
+			       const unsigned char *hash,
+			       const size_t hashlen,
+			       const object_generation_t generation)
 {
-  walk_ctx_t *w = walk_ctx_stack_head(wsk);
-  object_generation_t generation;
-  const path_t *prefix = NULL;
-  path_t path;
+  CMS_ContentInfo *cms = NULL;
   X509 *x;
+  int result = 0;
 
-  assert(rc && uri && wsk && w && certinfo);
+  assert(rc && wsk && uri && path && prefix);
 
-  switch (w->state) {
-  case walk_state_current:
-    prefix = &rc->unauthenticated;
-    generation = object_generation_current;
-    break;
-  case walk_state_backup:
-    prefix = &rc->old_authenticated;
-    generation = object_generation_backup;
-    break;
-  default:
-    return NULL;
-  }
+  if (!check_cms(rc, wsk, uri, path, prefix, &cms, &x, NULL, NULL, NULL, 0,
+		 NID_ct_rpkiGhostbusters, 1, generation))
+    goto error;
 
-  if (skip_checking_this_object(rc, uri, generation))
-    return NULL;
+#if 0
+  /*
+   * Here is where we would check the VCard, by asking check_cms()
+   * for a view of the eContent.
+   */
+#endif
 
-  if ((x = check_cert_1(rc, wsk, uri, &path, prefix, certinfo,
-			hash, hashlen, generation)) != NULL)
-    install_object(rc, uri, &path, generation);
-  else if (!access(path.s, F_OK))
-    log_validation_status(rc, uri, object_rejected, generation);
-  else if (hash && generation == w->manifest_generation)
-    log_validation_status(rc, uri, manifest_lists_missing_object, generation);
+  result = 1;
 
-  return x;
-}
+ error:
+  CMS_ContentInfo_free(cms);
 
-
+  return result;
+}
 
 /**
- * Read and check one manifest from disk.
+ * Check whether we already have a particular Ghostbuster record,
+ * attempt to fetch it and check issuer's signature if we don't.
  */
-static Manifest *check_manifest_1(rcynic_ctx_t *rc,
-				  STACK_OF(walk_ctx_t) *wsk,
-				  const uri_t *uri,
-				  path_t *path,
-				  const path_t *prefix,
-				  certinfo_t *certinfo,
-				  const object_generation_t generation)
-{
-  STACK_OF(FileAndHash) *sorted_fileList = NULL;
-  Manifest *manifest = NULL, *result = NULL;
-  CMS_ContentInfo *cms = NULL;
-  FileAndHash *fah = NULL, *fah2 = NULL;
-  BIO *bio = NULL;
-  X509 *x;
-  int i;
+static void check_ghostbuster(rcynic_ctx_t *rc,
+			      STACK_OF(walk_ctx_t) *wsk,
+			      const uri_t *uri,
+			      const unsigned char *hash,
+			      const size_t hashlen)
+{
+  walk_ctx_t *w = walk_ctx_stack_head(wsk);
+  path_t path;
 
-  assert(rc && wsk && uri && path && prefix);
+  assert(rc && wsk && w && uri);
 
-  if ((bio = BIO_new(BIO_s_mem())) == NULL) {
-    logmsg(rc, log_sys_err, "Couldn't allocate BIO for manifest %s", uri->s);
-    goto done;
-  }
+  if (uri_to_filename(rc, uri, &path, &rc->new_authenticated) &&
+      !access(path.s, F_OK))
+    return;
 
-  if (!check_cms(rc, wsk, uri, path, prefix, &cms, &x, certinfo, bio, NULL, 0,
-		 NID_ct_rpkiManifest, 1, generation))
-    goto done;
+  logmsg(rc, log_telemetry, "Checking Ghostbuster record %s", uri->s);
 
-  if ((manifest = ASN1_item_d2i_bio(ASN1_ITEM_rptr(Manifest), bio, NULL)) == NULL) {
-    log_validation_status(rc, uri, cms_econtent_decode_error, generation);
-    goto done;
+  if (check_ghostbuster_1(rc, wsk, uri, &path, &rc->unauthenticated,
+			  hash, hashlen, object_generation_current)) {
+    install_object(rc, uri, &path, object_generation_current);
+    return;
   }
 
-  if (manifest->version) {
-    log_validation_status(rc, uri, wrong_object_version, generation);
-    goto done;
-  }
+  if (!access(path.s, F_OK))
+    log_validation_status(rc, uri, object_rejected, object_generation_current);
+  else if (hash)
+    log_validation_status(rc, uri, manifest_lists_missing_object, object_generation_current);
 
-  if (X509_cmp_current_time(manifest->thisUpdate) > 0) {
-    log_validation_status(rc, uri, manifest_not_yet_valid, generation);
-    goto done;
+  if (same_object_generations(rc, uri)) {
+    log_validation_status(rc, uri, object_rejected, object_generation_backup);
+    return;
   }
 
-  if (X509_cmp_current_time(manifest->nextUpdate) < 0) {
-    log_validation_status(rc, uri, stale_crl_or_manifest, generation);
-    if (!rc->allow_stale_manifest)
-      goto done;
+  if (check_ghostbuster_1(rc, wsk, uri, &path, &rc->old_authenticated,
+			  hash, hashlen, object_generation_backup)) {
+    install_object(rc, uri, &path, object_generation_backup);
+    return;
   }
 
-  if (asn1_time_cmp(manifest->thisUpdate, X509_get_notBefore(x)) < 0 ||
-      asn1_time_cmp(manifest->nextUpdate, X509_get_notAfter(x))  > 0) {
-    log_validation_status(rc, uri, manifest_interval_overruns_cert, generation);
-    goto done;
-  }
+  if (!access(path.s, F_OK))
+    log_validation_status(rc, uri, object_rejected, object_generation_backup);
+  else if (hash && w->manifest_generation == object_generation_backup)
+    log_validation_status(rc, uri, manifest_lists_missing_object, object_generation_backup);
+}
 
-  if (ASN1_INTEGER_cmp(manifest->manifestNumber, asn1_zero) < 0 ||
-      ASN1_INTEGER_cmp(manifest->manifestNumber, asn1_twenty_octets) > 0) {
-    log_validation_status(rc, uri, bad_manifest_number, generation);
-    goto done;
-  }
+
 
-  if (OBJ_obj2nid(manifest->fileHashAlg) != NID_sha256) {
-    log_validation_status(rc, uri, nonconformant_digest_algorithm, generation);
-    goto done;
-  }
+static void walk_cert(rcynic_ctx_t *, void *);
 
-  if ((sorted_fileList = sk_FileAndHash_dup(manifest->fileList)) == NULL) {
-    logmsg(rc, log_sys_err, "Couldn't allocate shallow copy of fileList for manifest %s", uri->s);
-    goto done;
-  }
+/**
+ * rsync callback for fetching SIA tree.
+ */
+static void rsync_sia_callback(rcynic_ctx_t *rc,
+			       const rsync_ctx_t *ctx,
+			       const rsync_status_t status,
+			       const uri_t *uri,
+			       void *cookie)
+{
+  STACK_OF(walk_ctx_t) *wsk = cookie;
+  walk_ctx_t *w = walk_ctx_stack_head(wsk);
 
-  (void) sk_FileAndHash_set_cmp_func(sorted_fileList, FileAndHash_name_cmp);
-  sk_FileAndHash_sort(sorted_fileList);
+  assert(rc && wsk);
 
-  for (i = 0; (fah = sk_FileAndHash_value(sorted_fileList, i)) != NULL && (fah2 = sk_FileAndHash_value(sorted_fileList, i + 1)) != NULL; i++) {
-    if (!strcmp((char *) fah->file->data, (char *) fah2->file->data)) {
-      log_validation_status(rc, uri, duplicate_name_in_manifest, generation);
-      goto done;
-    }
+  if (status != rsync_status_pending) {
+    w->state++;
+    task_add(rc, walk_cert, wsk);
+    return;
   }
 
-  for (i = 0; (fah = sk_FileAndHash_value(manifest->fileList, i)) != NULL; i++) {
-    if (fah->hash->length != HASH_SHA256_LEN ||
-	(fah->hash->flags & (ASN1_STRING_FLAG_BITS_LEFT | 7)) > ASN1_STRING_FLAG_BITS_LEFT) {
-      log_validation_status(rc, uri, bad_manifest_digest_length, generation);
-      goto done;
-    }
-  }
+  if (rsync_count_runable(rc) >= rc->max_parallel_fetches)
+    return;
 
-  result = manifest;
-  manifest = NULL;
+  if ((wsk = walk_ctx_stack_clone(wsk)) == NULL) {
+    logmsg(rc, log_sys_err,
+	   "walk_ctx_stack_clone() failed, probably memory exhaustion, blundering onwards without forking stack");
+    return;
+  }
 
- done:
-  BIO_free(bio);
-  Manifest_free(manifest);
-  CMS_ContentInfo_free(cms);
-  sk_FileAndHash_free(sorted_fileList);
-  return result;
+  walk_ctx_stack_pop(wsk);
+  task_add(rc, walk_cert, wsk);
 }
 
 /**
- * Check whether we already have a particular manifest, attempt to fetch it
- * and check issuer's signature if we don't.
+ * Recursive walk of certificate hierarchy (core of the program).
  *
- * General plan here is to do basic checks on both current and backup
- * generation manifests, then, if both generations pass all of our
- * other tests, pick the generation with the highest manifest number,
- * to protect against replay attacks.
+ * Walk all products of the current certificate, starting with the
+ * ones named in the manifest and continuing with any that we find in
+ * the publication directory but which are not named in the manifest.
  *
- * Once we've picked the manifest we're going to use, we need to check
- * it against the CRL we've chosen.  Not much we can do if they don't
- * match besides whine about it, but we do need to whine in this case.
+ * Dispatch to correct checking code for the object named by URI,
+ * based on the filename extension in the uri.  CRLs are a special
+ * case because we've already checked them by the time we get here, so
+ * we just ignore them.  Other objects are either certificates or
+ * CMS-signed objects of one kind or another.
  */
-static int check_manifest(rcynic_ctx_t *rc,
-			  STACK_OF(walk_ctx_t) *wsk)
+static void walk_cert(rcynic_ctx_t *rc, void *cookie)
 {
-  walk_ctx_t *w = walk_ctx_stack_head(wsk);
-  Manifest *old_manifest, *new_manifest, *result = NULL;
-  certinfo_t old_certinfo, new_certinfo;
-  const uri_t *uri, *crldp = NULL;
-  object_generation_t generation = object_generation_null;
-  path_t old_path, new_path;
-  FileAndHash *fah = NULL;
-  const char *crl_tail;
-  int i, ok = 1;
+  STACK_OF(walk_ctx_t) *wsk = cookie;
+  const unsigned char *hash = NULL;
+  object_generation_t generation;
+  size_t hashlen;
+  walk_ctx_t *w;
+  uri_t uri;
 
-  assert(rc && wsk && w && !w->manifest);
+  assert(rc && wsk);
 
-  uri = &w->certinfo.manifest;
+  while ((w = walk_ctx_stack_head(wsk)) != NULL) {
 
-  logmsg(rc, log_telemetry, "Checking manifest %s", uri->s);
+    switch (w->state) {
+    case walk_state_current:
+      generation = object_generation_current;
+      break;
+    case walk_state_backup:
+      generation = object_generation_backup;
+      break;
+    default:
+      generation = object_generation_null;
+      break;
+    }
 
-  new_manifest = check_manifest_1(rc, wsk, uri, &new_path,
-				  &rc->unauthenticated, &new_certinfo,
-				  object_generation_current);
+    switch (w->state) {
 
-  old_manifest = check_manifest_1(rc, wsk, uri, &old_path,
-				  &rc->old_authenticated, &old_certinfo,
-				  object_generation_backup);
+    case walk_state_initial:
 
-  if (!new_manifest)
-    result = old_manifest;
+      if (!w->certinfo.sia.s[0] || !w->certinfo.ca) {
+	w->state = walk_state_done;
+	continue;
+      }
 
-  else if (!old_manifest)
-    result = new_manifest;
+      if (!w->certinfo.manifest.s[0]) {
+	log_validation_status(rc, &w->certinfo.uri, sia_manifest_uri_missing, w->certinfo.generation);
+	w->state = walk_state_done;
+	continue;
+      }
 
-  else {
-    int num_cmp = ASN1_INTEGER_cmp(old_manifest->manifestNumber, new_manifest->manifestNumber);
-    int date_cmp = ASN1_STRING_cmp(old_manifest->thisUpdate, new_manifest->thisUpdate);
+      w->state++;
+      continue;
 
-    if (num_cmp > 0)
-      log_validation_status(rc, uri, backup_number_higher_than_current, object_generation_current);
-    if (date_cmp > 0)
-      log_validation_status(rc, uri, backup_thisupdate_newer_than_current, object_generation_current);
+    case walk_state_rsync:
 
-    if (num_cmp > 0 && date_cmp > 0)
-      result = old_manifest;
-    else
-      result = new_manifest;
-  }
+      if (rsync_needed(rc, wsk)) {
+	rsync_tree(rc, &w->certinfo.sia, wsk, rsync_sia_callback);
+	return;
+      }
+      log_validation_status(rc, &w->certinfo.sia, rsync_transfer_skipped, object_generation_null);
+      w->state++;
+      continue;
 
-  if (result && result == new_manifest) {
-    generation = object_generation_current;
-    install_object(rc, uri, &new_path, generation);
-    crldp = &new_certinfo.crldp;
-  }
+    case walk_state_ready:
 
-  if (result && result == old_manifest) {
-    generation = object_generation_backup;
-    install_object(rc, uri, &old_path, generation);
-    crldp = &old_certinfo.crldp;
-  }
+      walk_ctx_loop_init(rc, wsk);      /* sets w->state */
+      continue;
 
-  if (result) {
-    crl_tail = strrchr(crldp->s, '/');
-    assert(crl_tail != NULL);
-    crl_tail++;
+    case walk_state_current:
+    case walk_state_backup:
 
-    for (i = 0; (fah = sk_FileAndHash_value(result->fileList, i)) != NULL; i++)
-      if (!strcmp((char *) fah->file->data, crl_tail))
-	break;
+      if (!walk_ctx_loop_this(rc, wsk, &uri, &hash, &hashlen)) {
+	walk_ctx_loop_next(rc, wsk);
+	continue;
+      }
 
-    if (!fah) {
-      log_validation_status(rc, uri, crl_not_in_manifest, generation);
-      if (rc->require_crl_in_manifest)
-	ok = 0;
-    }
+      if (endswith(uri.s, ".crl") || endswith(uri.s, ".mft") || endswith(uri.s, ".mnf")) {
+	walk_ctx_loop_next(rc, wsk);
+	continue;			/* CRLs and manifests checked elsewhere */
+      }
 
-    else if (!check_crl_digest(rc, crldp, fah->hash->data, fah->hash->length)) {
-      log_validation_status(rc, uri, digest_mismatch, generation);
-      if (!rc->allow_crl_digest_mismatch)
-	ok = 0;
-    }
-  }
+      if (hash == NULL && !rc->allow_object_not_in_manifest) {
+	log_validation_status(rc, &uri, skipped_because_not_in_manifest, generation);
+	walk_ctx_loop_next(rc, wsk);
+	continue;
+      }
 
-  if ((!result || result != new_manifest) && !access(new_path.s, F_OK))
-    log_validation_status(rc, uri, object_rejected, object_generation_current);
+      if (hash == NULL)
+	log_validation_status(rc, &uri, tainted_by_not_being_in_manifest, generation);
+      else if (w->stale_manifest)
+	log_validation_status(rc, &uri, tainted_by_stale_manifest, generation);
 
-  if (!result && !access(old_path.s, F_OK))
-    log_validation_status(rc, uri, object_rejected, object_generation_backup);
+      if (endswith(uri.s, ".roa")) {
+	check_roa(rc, wsk, &uri, hash, hashlen);
+	walk_ctx_loop_next(rc, wsk);
+	continue;
+      }
 
-  if (result != new_manifest)
-    Manifest_free(new_manifest);
+      if (endswith(uri.s, ".gbr")) {
+	check_ghostbuster(rc, wsk, &uri, hash, hashlen);
+	walk_ctx_loop_next(rc, wsk);
+	continue;
+      }
 
-  if (result != old_manifest)
-    Manifest_free(old_manifest);
+      if (endswith(uri.s, ".cer")) {
+	certinfo_t certinfo;
+	X509 *x = check_cert(rc, wsk, &uri, &certinfo, hash, hashlen);
+	if (!walk_ctx_stack_push(wsk, x, &certinfo))
+	  walk_ctx_loop_next(rc, wsk);
+	continue;
+      }
+
+      log_validation_status(rc, &uri, unknown_object_type_skipped, object_generation_null);
+      walk_ctx_loop_next(rc, wsk);
+      continue;
+
+    case walk_state_done:
+
+      walk_ctx_stack_pop(wsk);	/* Resume our issuer's state */
+      continue;
 
-  w->manifest = result;
-  if (crldp)
-    w->crldp = *crldp;
-  w->manifest_generation = generation;
+    }
+  }
 
-  return ok;
+  assert(walk_ctx_stack_head(wsk) == NULL);
+  walk_ctx_stack_free(wsk);
 }
 
-
-
 /**
- * Mark CRL or manifest that we're rechecking so XML report makes more sense.
+ * Check a trust anchor.  Yes, we trust it, by definition, but it
+ * still needs to conform to the certificate profile, the
+ * self-signature must be correct, etcetera.
+ *
+ * Ownership of the TA certificate object passes to this function when
+ * called (ie, freeing "x" is our responsibility).
  */
-static void rsync_needed_mark_recheck(rcynic_ctx_t *rc,
-				      const uri_t *uri)
+static int check_ta(rcynic_ctx_t *rc, X509 *x, const uri_t *uri,
+		    const path_t *path1, const path_t *path2,
+		    const object_generation_t generation)
 {
-  validation_status_t *v = NULL;
+  STACK_OF(walk_ctx_t) *wsk = NULL;
+  walk_ctx_t *w = NULL;
 
-  if (uri->s[0] != '\0')
-    v = validation_status_find(rc->validation_status_root,
-			       uri, object_generation_current);
+  assert(rc && x && uri && path1 && path2);
 
-  if (v) {
-    validation_status_set_code(v, stale_crl_or_manifest, 0);
-    log_validation_status(rc, uri, rechecking_object,
-			  object_generation_current);
+  if (x == NULL)
+    return 1;
+
+  if ((wsk = walk_ctx_stack_new()) == NULL) {
+    logmsg(rc, log_sys_err, "Couldn't allocate walk context stack");
+    X509_free(x);
+    return 0;
   }
-}
 
-/**
- * Check whether we need to rsync a particular tree.  This depends on
- * the setting of rc->rsync_early, whether we have a valid manifest on
- * file, and whether that manifest is stale yet.
- */
-static int rsync_needed(rcynic_ctx_t *rc,
-			STACK_OF(walk_ctx_t) *wsk)
-{
-  walk_ctx_t *w = walk_ctx_stack_head(wsk);
-  int needed;
+  if ((w = walk_ctx_stack_push(wsk, x, NULL)) == NULL) {
+    logmsg(rc, log_sys_err, "Couldn't push walk context stack");
+    walk_ctx_stack_free(wsk);
+    X509_free(x);
+    return 0;
+  }
 
-  assert(rc && wsk && w);
+  if (!check_x509(rc, wsk, uri, x, NULL, generation)) {
+    log_validation_status(rc, uri, object_rejected, generation);
+    walk_ctx_stack_free(wsk);
+    return 1;
+  }
 
-  needed = (rc->rsync_early ||
-	    !check_manifest(rc, wsk) ||
-	    w->manifest == NULL ||
-	    X509_cmp_current_time(w->manifest->nextUpdate) < 0);
+  logmsg(rc, log_telemetry, "Copying trust anchor %s to %s", path1->s, path2->s);
 
-  if (needed && w->manifest != NULL) {
-    rsync_needed_mark_recheck(rc, &w->certinfo.manifest);
-    rsync_needed_mark_recheck(rc, &w->certinfo.crldp);
-    Manifest_free(w->manifest);
-    w->manifest = NULL;
+  if (!mkdir_maybe(rc, path2) || !cp_ln(rc, path1, path2)) {
+    walk_ctx_stack_free(wsk);
+    return 0;
   }
 
-  return needed;
+  log_validation_status(rc, uri, object_accepted, generation);
+  task_add(rc, walk_cert, wsk);
+  return 1;
 }
 
 
 
 /**
- * Extract a ROA prefix from the ASN.1 bitstring encoding.
+ * Check a trust anchor read from a local file.
  */
-static int extract_roa_prefix(const ROAIPAddress *ra,
-			      const unsigned afi,
-			      unsigned char *addr,
-			      unsigned *prefixlen,
-			      unsigned *max_prefixlen)
+static int check_ta_cer(rcynic_ctx_t *rc,
+			const char *fn)
+
 {
-  unsigned length;
-  long maxlen;
+  path_t path1, path2;
+  unsigned long hash;
+  X509 *x = NULL;
+  uri_t uri;
+  int i;
+
+  assert(rc && fn);
 
-  assert(ra && addr && prefixlen && max_prefixlen);
+  logmsg(rc, log_telemetry, "Processing trust anchor from file %s", fn);
 
-  maxlen = ASN1_INTEGER_get(ra->maxLength);
+  if (strlen(fn) >= sizeof(path1.s)) {
+    logmsg(rc, log_usage_err, "Trust anchor path name too long %s", fn);
+    return 0;
+  }
+  strcpy(path1.s, fn);
+  filename_to_uri(&uri, path1.s);
 
-  switch (afi) {
-  case IANA_AFI_IPV4: length =  4; break;
-  case IANA_AFI_IPV6: length = 16; break;
-  default: return 0;
+  if ((x = read_cert(&path1, NULL)) == NULL) {
+    logmsg(rc, log_usage_err, "Couldn't read trust anchor from file %s", fn);
+    log_validation_status(rc, &uri, unreadable_trust_anchor, object_generation_null);
+    goto lose;
   }
 
-  if (ra->IPAddress->length < 0 || ra->IPAddress->length > length ||
-      maxlen < 0 || maxlen > (long) length * 8)
-    return 0;
+  hash = X509_subject_name_hash(x);
 
-  if (ra->IPAddress->length > 0) {
-    memcpy(addr, ra->IPAddress->data, ra->IPAddress->length);
-    if ((ra->IPAddress->flags & 7) != 0) {
-      unsigned char mask = 0xFF >> (8 - (ra->IPAddress->flags & 7));
-      addr[ra->IPAddress->length - 1] &= ~mask;
+  for (i = 0; i < INT_MAX; i++) {
+    if (snprintf(path2.s, sizeof(path2.s), "%s%lx.%d.cer",
+		 rc->new_authenticated.s, hash, i) >= sizeof(path2.s)) {
+      logmsg(rc, log_sys_err,
+	     "Couldn't construct path name for trust anchor %s", path1.s);
+      goto lose;
     }
+    if (access(path2.s, F_OK))
+      break;
+  }
+  if (i == INT_MAX) {
+    logmsg(rc, log_sys_err, "Couldn't find a free name for trust anchor %s", path1.s);
+    goto lose;
   }
 
-  memset(addr + ra->IPAddress->length, 0, length - ra->IPAddress->length);
-  *prefixlen = (ra->IPAddress->length * 8) - (ra->IPAddress->flags & 7);
-  *max_prefixlen = ra->maxLength ? (unsigned) maxlen : *prefixlen;
+  return check_ta(rc, x, &uri, &path1, &path2, object_generation_null);
 
-  return 1;
+ lose:
+  log_validation_status(rc, &uri, trust_anchor_skipped, object_generation_null);
+  X509_free(x);
+  return 0;
 }
 
+
+
 /**
- * Read and check one ROA from disk.
+ * Allocate a new tal_ctx_t.
  */
-static int check_roa_1(rcynic_ctx_t *rc,
-		       STACK_OF(walk_ctx_t) *wsk,
-		       const uri_t *uri,
-		       path_t *path,
-		       const path_t *prefix,
-		       const unsigned char *hash,
-		       const size_t hashlen,
-		       const object_generation_t generation)
+static tal_ctx_t *tal_ctx_t_new(void)
 {
-  STACK_OF(IPAddressFamily) *roa_resources = NULL, *ee_resources = NULL;
-  unsigned char addrbuf[ADDR_RAW_BUF_LEN];
-  CMS_ContentInfo *cms = NULL;
-  BIO *bio = NULL;
-  ROA *roa = NULL;
-  X509 *x = NULL;
-  int i, j, result = 0;
-  unsigned afi, *safi = NULL, safi_, prefixlen, max_prefixlen;
-  ROAIPAddressFamily *rf;
-  ROAIPAddress *ra;
-
-  assert(rc && wsk && uri && path && prefix);
+  tal_ctx_t *tctx = malloc(sizeof(*tctx));
+  if (tctx)
+    memset(tctx, 0, sizeof(*tctx));
+  return tctx;
+}
 
-  if ((bio = BIO_new(BIO_s_mem())) == NULL) {
-    logmsg(rc, log_sys_err, "Couldn't allocate BIO for ROA %s", uri->s);
-    goto error;
+/**
+ * Free a tal_ctx_t.
+ */
+static void tal_ctx_t_free(tal_ctx_t *tctx)
+{
+  if (tctx) {
+    EVP_PKEY_free(tctx->pkey);
+    free(tctx);
   }
+}
 
-  if (!check_cms(rc, wsk, uri, path, prefix, &cms, &x, NULL, bio, NULL, 0,
-		 NID_ct_ROA, 0, generation))
-    goto error;
+/**
+ * Read a trust anchor from disk and compare with known public key.
+ *
+ * NB: EVP_PKEY_cmp() returns 1 for match, not 0 like every other
+ * xyz_cmp() function in the entire OpenSSL library.  Go figure.
+ */
+static int check_ta_tal_callback_1(rcynic_ctx_t *rc,
+				   const tal_ctx_t *tctx,
+				   object_generation_t generation)
 
-  if (!(roa = ASN1_item_d2i_bio(ASN1_ITEM_rptr(ROA), bio, NULL))) {
-    log_validation_status(rc, uri, cms_econtent_decode_error, generation);
-    goto error;
+{
+  const path_t *prefix = NULL;
+  EVP_PKEY *pkey = NULL;
+  X509 *x = NULL;
+  path_t path;
+  int ret = 0;
+
+  switch (generation) {
+  case object_generation_current:
+    prefix = &rc->unauthenticated;
+    break;
+  case object_generation_backup:
+    prefix = &rc->old_authenticated;
+    break;
+  default:
+    goto done;
   }
 
-  if (roa->version) {
-    log_validation_status(rc, uri, wrong_object_version, generation);
-    goto error;
+  if (!uri_to_filename(rc, &tctx->uri, &path, prefix)) {
+    log_validation_status(rc, &tctx->uri, unreadable_trust_anchor_locator, generation);
+    goto done;
   }
 
-  if (ASN1_INTEGER_cmp(roa->asID, asn1_zero) < 0 ||
-      ASN1_INTEGER_cmp(roa->asID, asn1_four_octets) > 0) {
-    log_validation_status(rc, uri, bad_roa_asID, generation);
-    goto error;
+  if ((x = read_cert(&path, NULL)) == NULL || (pkey = X509_get_pubkey(x)) == NULL) {
+    log_validation_status(rc, &tctx->uri, unreadable_trust_anchor, generation);
+    goto done;
   }
 
-  ee_resources = X509_get_ext_d2i(x, NID_sbgp_ipAddrBlock, NULL, NULL);
+  if (EVP_PKEY_cmp(tctx->pkey, pkey) != 1) {
+    log_validation_status(rc, &tctx->uri, trust_anchor_key_mismatch, generation);
+    goto done;
+  }
 
-  /*
-   * Extract prefixes from ROA and convert them into a resource set.
-   */
+  ret = check_ta(rc, x, &tctx->uri, &path, &tctx->path, generation);
+  x = NULL;
 
-  if (!(roa_resources = sk_IPAddressFamily_new_null()))
-    goto error;
+ done:
+  if (!ret)
+    log_validation_status(rc, &tctx->uri, object_rejected, generation);
+  EVP_PKEY_free(pkey);
+  X509_free(x);
+  return ret;
+}
 
-  for (i = 0; i < sk_ROAIPAddressFamily_num(roa->ipAddrBlocks); i++) {
-    rf = sk_ROAIPAddressFamily_value(roa->ipAddrBlocks, i);
-    if (!rf || !rf->addressFamily || rf->addressFamily->length < 2 || rf->addressFamily->length > 3) {
-      log_validation_status(rc, uri, malformed_roa_addressfamily, generation);
-      goto error;
-    }
-    afi = (rf->addressFamily->data[0] << 8) | (rf->addressFamily->data[1]);
-    if (rf->addressFamily->length == 3)
-      *(safi = &safi_) = rf->addressFamily->data[2];
-    for (j = 0; j < sk_ROAIPAddress_num(rf->addresses); j++) {
-      ra = sk_ROAIPAddress_value(rf->addresses, j);
-      if (!ra ||
-	  !extract_roa_prefix(ra, afi, addrbuf, &prefixlen, &max_prefixlen) ||
-	  !v3_addr_add_prefix(roa_resources, afi, safi, addrbuf, prefixlen)) {
-	log_validation_status(rc, uri, roa_resources_malformed, generation);
-	goto error;
-      }
-      if (max_prefixlen < prefixlen) {
-	log_validation_status(rc, uri, roa_max_prefixlen_too_short, generation);
-	goto error;
-      }
-    }
-  }
+/**
+ * rsync callback for fetching a TAL.
+ */
+static void rsync_tal_callback(rcynic_ctx_t *rc,
+			       const rsync_ctx_t *ctx,
+			       const rsync_status_t status,
+			       const uri_t *uri,
+			       void *cookie)
+{
+  tal_ctx_t *tctx = cookie;
+
+  assert(rc && tctx);
+
+  if (status == rsync_status_pending)
+    return;
+
+  if (!check_ta_tal_callback_1(rc, tctx, object_generation_current) &&
+      !check_ta_tal_callback_1(rc, tctx, object_generation_backup))
+    log_validation_status(rc, &tctx->uri, trust_anchor_skipped, object_generation_null);
+
+  tal_ctx_t_free(tctx);
+}
+
+/**
+ * Check a trust anchor read from a trust anchor locator (TAL).
+ */
+static int check_ta_tal(rcynic_ctx_t *rc,
+			const char *fn)
 
-  /*
-   * ROAs can include nested prefixes, so direct translation to
-   * resource sets could include overlapping ranges, which is illegal.
-   * So we have to remove nested stuff before whacking into canonical
-   * form.  Fortunately, this is relatively easy, since we know these
-   * are just prefixes, not ranges: in a list of prefixes sorted by
-   * the RFC 3779 rules, the first element of a set of nested prefixes
-   * will always be the least specific.
-   */
+{
+  tal_ctx_t *tctx = NULL;
+  BIO *bio = NULL;
+  int ret = 1;
 
-  for (i = 0; i < sk_IPAddressFamily_num(roa_resources); i++) {
-    IPAddressFamily *f = sk_IPAddressFamily_value(roa_resources, i);
+  assert(rc && fn);
 
-    if ((afi = v3_addr_get_afi(f)) == 0) {
-      log_validation_status(rc, uri, roa_contains_bad_afi_value, generation);
-      goto error;
-    }
+  logmsg(rc, log_telemetry, "Processing trust anchor locator from file %s", fn);
 
-    if (f->ipAddressChoice->type == IPAddressChoice_addressesOrRanges) {
-      IPAddressOrRanges *aors = f->ipAddressChoice->u.addressesOrRanges;
+  if ((tctx = tal_ctx_t_new()) == NULL) {
+    logmsg(rc, log_sys_err, "malloc(tal_ctxt_t) failed");
+    goto done;
+  }
 
-      sk_IPAddressOrRange_sort(aors);
+  bio = BIO_new_file(fn, "r");
 
-      for (j = 0; j < sk_IPAddressOrRange_num(aors) - 1; j++) {
-	IPAddressOrRange *a = sk_IPAddressOrRange_value(aors, j);
-	IPAddressOrRange *b = sk_IPAddressOrRange_value(aors, j + 1);
-	unsigned char a_min[ADDR_RAW_BUF_LEN], a_max[ADDR_RAW_BUF_LEN];
-	unsigned char b_min[ADDR_RAW_BUF_LEN], b_max[ADDR_RAW_BUF_LEN];
-	int length;
+  if (!bio)
+    logmsg(rc, log_usage_err, "Couldn't open trust anchor locator file %s", fn);
 
-	if ((length = v3_addr_get_range(a, afi, a_min, a_max, ADDR_RAW_BUF_LEN)) == 0 ||
-	    (length = v3_addr_get_range(b, afi, b_min, b_max, ADDR_RAW_BUF_LEN)) == 0) {
-	  log_validation_status(rc, uri, roa_resources_malformed, generation);
-	  goto error;
-	}
+  if (!bio || BIO_gets(bio, tctx->uri.s, sizeof(tctx->uri.s)) <= 0) {
+    uri_t furi;
+    filename_to_uri(&furi, fn);
+    log_validation_status(rc, &furi, unreadable_trust_anchor_locator, object_generation_null);
+    goto done;
+  }
 
-	if (memcmp(a_max, b_max, length) >= 0) {
-	  (void) sk_IPAddressOrRange_delete(aors, j + 1);
-	  IPAddressOrRange_free(b);
-	  --j;
-	}
-      }
-    }
+  tctx->uri.s[strcspn(tctx->uri.s, " \t\r\n")] = '\0';
+
+  if (!uri_to_filename(rc, &tctx->uri, &tctx->path, &rc->new_authenticated)) {
+    log_validation_status(rc, &tctx->uri, unreadable_trust_anchor_locator, object_generation_null);
+    goto done;
   }
 
-  if (!v3_addr_canonize(roa_resources)) {
-    log_validation_status(rc, uri, roa_resources_malformed, generation);
-    goto error;
+  if (!endswith(tctx->uri.s, ".cer")) {
+    log_validation_status(rc, &tctx->uri, malformed_tal_uri, object_generation_null);
+    goto done;
   }
 
-  if (!v3_addr_subset(roa_resources, ee_resources)) {
-    log_validation_status(rc, uri, roa_resource_not_in_ee, generation);
-    goto error;
+  bio = BIO_push(BIO_new(BIO_f_linebreak()), bio);
+  bio = BIO_push(BIO_new(BIO_f_base64()), bio);
+  if (bio)
+    tctx->pkey = d2i_PUBKEY_bio(bio, NULL);
+  if (!tctx->pkey) {
+    log_validation_status(rc, &tctx->uri, unreadable_trust_anchor_locator, object_generation_null);
+    goto done;
   }
 
-  result = 1;
+  logmsg(rc, log_telemetry, "Processing trust anchor from URI %s", tctx->uri.s);
 
- error:
-  BIO_free(bio);
-  ROA_free(roa);
-  CMS_ContentInfo_free(cms);
-  sk_IPAddressFamily_pop_free(roa_resources, IPAddressFamily_free);
-  sk_IPAddressFamily_pop_free(ee_resources, IPAddressFamily_free);
+  rsync_ta(rc, &tctx->uri, tctx, rsync_tal_callback);
+  tctx = NULL;			/* Control has passed */
 
-  return result;
+ done:
+  tal_ctx_t_free(tctx);
+  BIO_free_all(bio);
+  return ret;
 }
 
 /**
- * Check whether we already have a particular ROA, attempt to fetch it
- * and check issuer's signature if we don't.
+ * When trust anchors are split across worker processes, decide
+ * whether the next one belongs to this worker.  Every worker sees the
+ * same trust anchors in the same order, so round-robin on a counter
+ * gives each trust anchor to exactly one worker.
  */
-static void check_roa(rcynic_ctx_t *rc,
-		      STACK_OF(walk_ctx_t) *wsk,
-		      const uri_t *uri,
-		      const unsigned char *hash,
-		      const size_t hashlen)
+static int ta_is_mine(rcynic_ctx_t *rc)
 {
-  walk_ctx_t *w = walk_ctx_stack_head(wsk);
-  path_t path;
+  assert(rc);
 
-  assert(rc && wsk && w && uri);
+  if (rc->ta_shards <= 1)
+    return 1;
 
-  if (uri_to_filename(rc, uri, &path, &rc->new_authenticated) &&
-      !access(path.s, F_OK))
-    return;
+  return rc->ta_count++ % rc->ta_shards == rc->ta_shard;
+}
 
-  logmsg(rc, log_telemetry, "Checking ROA %s", uri->s);
+/**
+ * Check a directory of trust anchors and trust anchor locators.
+ */
+static int check_ta_dir(rcynic_ctx_t *rc,
+			const char *dn)
+{
+  DIR *dir = NULL;
+  struct dirent *d;
+  path_t path;
+  int is_cer, is_tal;
 
-  if (check_roa_1(rc, wsk, uri, &path, &rc->unauthenticated,
-		  hash, hashlen, object_generation_current)) {
-    install_object(rc, uri, &path, object_generation_current);
-    return;
-  }
+  assert(rc && dn);
 
-  if (!access(path.s, F_OK))
-    log_validation_status(rc, uri, object_rejected, object_generation_current);
-  else if (hash)
-    log_validation_status(rc, uri, manifest_lists_missing_object, object_generation_current);
+  if ((dir = opendir(dn)) == NULL) {
+    logmsg(rc, log_sys_err, "Couldn't open trust anchor directory %s: %s",
+	   dn, strerror(errno));
+    return 0;
+  }
 
-  if (check_roa_1(rc, wsk, uri, &path, &rc->old_authenticated,
-		  hash, hashlen, object_generation_backup)) {
-    install_object(rc, uri, &path, object_generation_backup);
-    return;
+  while ((d = readdir(dir)) != NULL) {
+    if (snprintf(path.s, sizeof(path.s), "%s/%s", dn, d->d_name) >= sizeof(path.s)) {
+      logmsg(rc, log_data_err, "Pathname %s/%s too long", dn, d->d_name);
+      break;
+    }
+    is_cer = endswith(path.s, ".cer");
+    is_tal = endswith(path.s, ".tal");
+    if ((is_cer || is_tal) && !ta_is_mine(rc))
+      continue;
+    if (is_cer && !check_ta_cer(rc, path.s))
+      break;
+    if (is_tal && !check_ta_tal(rc, path.s))
+      break;
+    if (!is_cer && !is_tal)
+      logmsg(rc, log_verbose, "Skipping non-trust-anchor %s", path.s);
   }
 
-  if (!access(path.s, F_OK))
-    log_validation_status(rc, uri, object_rejected, object_generation_backup);
-  else if (hash && w->manifest_generation == object_generation_backup)
-    log_validation_status(rc, uri, manifest_lists_missing_object, object_generation_backup);
+  if (dir != NULL)
+    closedir(dir);
+
+  return !d;;
 }
 
 
 
 /**
- * Read and check one Ghostbuster record from disk.
+ * Write detailed log of what we've done as an XML file.
  */
-static int check_ghostbuster_1(rcynic_ctx_t *rc,
-			       STACK_OF(walk_ctx_t) *wsk,
-			       const uri_t *uri,
-			       path_t *path,
-			       const path_t *prefix,
-			       const unsigned char *hash,
-			       const size_t hashlen,
-			       const object_generation_t generation)
+static int write_xml_file(const rcynic_ctx_t *rc,
+			  const char *xmlfile)
 {
-  CMS_ContentInfo *cms = NULL;
-  BIO *bio = NULL;
-  X509 *x;
-  int result = 0;
+  int i, j, use_stdout, ok;
+  char hostname[HOSTNAME_MAX];
+  mib_counter_t code;
+  timestamp_t ts;
+  FILE *f = NULL;
+  path_t xmltemp;
 
-  assert(rc && wsk && uri && path && prefix);
+  if (xmlfile == NULL)
+    return 1;
 
-#if 0
-  /*
-   * May want this later if we're going to inspect the VCard.  For now,
-   * just leave this NULL and the right thing should happen.
-   */
-  if ((bio = BIO_new(BIO_s_mem())) == NULL) {
-    logmsg(rc, log_sys_err, "Couldn't allocate BIO for Ghostbuster record %s", uri->s);
-    goto error;
+  use_stdout = !strcmp(xmlfile, "-");
+
+  logmsg(rc, log_telemetry, "Writing XML summary to %s",
+	 (use_stdout ? "standard output" : xmlfile));
+
+  if (use_stdout) {
+    f = stdout;
+    ok = 1;
+  } else if (snprintf(xmltemp.s, sizeof(xmltemp.s), "%s.%u.tmp", xmlfile, (unsigned) getpid()) >= sizeof(xmltemp.s)) {
+    logmsg(rc, log_usage_err, "Filename \"%s\" is too long, not writing XML", xmlfile);
+    return 0;
+  } else {
+    ok = (f = fopen(xmltemp.s, "w")) != NULL;
   }
-#endif
 
-  if (!check_cms(rc, wsk, uri, path, prefix, &cms, &x, NULL, bio, NULL, 0,
-		 NID_ct_rpkiGhostbusters, 1, generation))
-    goto error;
+  ok &= gethostname(hostname, sizeof(hostname)) == 0;
 
-#if 0
-  /*
-   * Here is where we would read the VCard from the bio returned by
-   * CMS_verify() so that we could check the VCard.
-   */
-#endif
+  if (ok)
+    ok &= fprintf(f, "<?xml version=\"1.0\" ?>\n"
+		  "<rcynic-summary date=\"%s\" rcynic-version=\"%s\""
+		  " summary-version=\"%d\" reporting-hostname=\"%s\">\n"
+		  "  <labels>\n",
+		  time_to_string(&ts, NULL),
+		  svn_id, XML_SUMMARY_VERSION, hostname) != EOF;
 
-  result = 1;
+  for (j = 0; ok && j < MIB_COUNTER_T_MAX; ++j)
+    ok &= fprintf(f, "    <%s kind=\"%s\">%s</%s>\n",
+		  mib_counter_label[j], mib_counter_kind[j],
+		  (mib_counter_desc[j]
+		   ? mib_counter_desc[j]
+		   : X509_verify_cert_error_string(mib_counter_openssl[j])),
+		  mib_counter_label[j]) != EOF;
 
- error:
-  BIO_free(bio);
-  CMS_ContentInfo_free(cms);
+  if (ok)
+    ok &= fprintf(f, "  </labels>\n") != EOF;
 
-  return result;
-}
+  for (i = 0; ok && i < sk_validation_status_t_num(rc->validation_status); i++) {
+    validation_status_t *v = sk_validation_status_t_value(rc->validation_status, i);
+    assert(v);
 
-/**
- * Check whether we already have a particular Ghostbuster record,
- * attempt to fetch it and check issuer's signature if we don't.
- */
-static void check_ghostbuster(rcynic_ctx_t *rc,
-			      STACK_OF(walk_ctx_t) *wsk,
-			      const uri_t *uri,
-			      const unsigned char *hash,
-			      const size_t hashlen)
-{
-  walk_ctx_t *w = walk_ctx_stack_head(wsk);
-  path_t path;
+    (void) time_to_string(&ts, &v->timestamp);
 
-  assert(rc && wsk && w && uri);
+    for (code = (mib_counter_t) 0; ok && code < MIB_COUNTER_T_MAX; code++) {
+      if (validation_status_get_code(v, code)) {
+	if (ok)
+	  ok &= fprintf(f, "  <validation_status timestamp=\"%s\" status=\"%s\"",
+			ts.s, mib_counter_label[code]) != EOF;
+	if (ok && (v->generation == object_generation_current ||
+		   v->generation == object_generation_backup))
+	  ok &= fprintf(f, " generation=\"%s\"",
+			object_generation_label[v->generation]) != EOF;
+	if (ok)
+	  ok &= fprintf(f, ">%s</validation_status>\n", v->uri.s) != EOF;
+      }
+    }
+  }
 
-  if (uri_to_filename(rc, uri, &path, &rc->new_authenticated) &&
-      !access(path.s, F_OK))
-    return;
+  /*
+   * Lookups go through rsync_history_index, so nothing has kept the
+   * stack sorted while we were adding to it.
+   */
+  sk_rsync_history_t_sort(rc->rsync_history);
+
+  for (i = 0; ok && i < sk_rsync_history_t_num(rc->rsync_history); i++) {
+    rsync_history_t *h = sk_rsync_history_t_value(rc->rsync_history, i);
+    assert(h);
+
+    if (ok)
+      ok &= fprintf(f, "  <rsync_history") != EOF;
+    if (ok && h->started)
+      ok &= fprintf(f, " started=\"%s\"",
+		    time_to_string(&ts, &h->started)) != EOF;
+    if (ok && h->finished)
+      ok &= fprintf(f, " finished=\"%s\"",
+		    time_to_string(&ts, &h->finished)) != EOF;
+    if (ok && h->status != rsync_status_done)
+      ok &= fprintf(f, " error=\"%u\"", (unsigned) h->status) != EOF;
+    if (ok)
+      ok &= fprintf(f, ">%s%s</rsync_history>\n",
+		    h->uri.s, (h->final_slash ? "/" : "")) != EOF;
+  }
 
-  logmsg(rc, log_telemetry, "Checking Ghostbuster record %s", uri->s);
+  if (ok)
+    ok &= fprintf(f, "</rcynic-summary>\n") != EOF;
 
-  if (check_ghostbuster_1(rc, wsk, uri, &path, &rc->unauthenticated,
-			  hash, hashlen, object_generation_current)) {
-    install_object(rc, uri, &path, object_generation_current);
-    return;
-  }
+  if (f && !use_stdout)
+    ok &= fclose(f) != EOF;
 
-  if (!access(path.s, F_OK))
-    log_validation_status(rc, uri, object_rejected, object_generation_current);
-  else if (hash)
-    log_validation_status(rc, uri, manifest_lists_missing_object, object_generation_current);
+  if (ok && !use_stdout)
+    ok &= rename(xmltemp.s, xmlfile) == 0;
 
-  if (check_ghostbuster_1(rc, wsk, uri, &path, &rc->old_authenticated,
-			  hash, hashlen, object_generation_backup)) {
-    install_object(rc, uri, &path, object_generation_backup);
-    return;
-  }
+  if (!ok)
+    logmsg(rc, log_sys_err, "Couldn't write XML summary to %s: %s",
+	   (use_stdout ? "standard output" : xmlfile), strerror(errno));
 
-  if (!access(path.s, F_OK))
-    log_validation_status(rc, uri, object_rejected, object_generation_backup);
-  else if (hash && w->manifest_generation == object_generation_backup)
-    log_validation_status(rc, uri, manifest_lists_missing_object, object_generation_backup);
+  if (!ok && !use_stdout)
+    (void) unlink(xmltemp.s);
+
+  return ok;
 }
 
 
 
-static void walk_cert(rcynic_ctx_t *, void *);
-
 /**
- * rsync callback for fetching SIA tree.
+ * Read host database left behind by previous runs.  A missing file is
+ * not an error, it just means we're starting from scratch; a file we
+ * can't parse gets the same treatment, after a complaint.
  */
-static void rsync_sia_callback(rcynic_ctx_t *rc,
-			       const rsync_ctx_t *ctx,
-			       const rsync_status_t status,
-			       const uri_t *uri,
-			       void *cookie)
+static int read_host_database(const rcynic_ctx_t *rc)
 {
-  STACK_OF(walk_ctx_t) *wsk = cookie;
-  walk_ctx_t *w = walk_ctx_stack_head(wsk);
+  char line[HOSTNAME_MAX + 32 * (HOST_LATENCY_SAMPLES + 8)];
+  int version = 0, lineno = 0, ok = 1;
+  host_health_t *h = NULL;
+  FILE *f;
 
-  assert(rc && wsk);
+  assert(rc && rc->host_health && rc->previous_rsync_history);
 
-  if (status != rsync_status_pending) {
-    w->state++;
-    task_add(rc, walk_cert, wsk);
-    return;
+  if (rc->host_database == NULL)
+    return 1;
+
+  if ((f = fopen(rc->host_database, "r")) == NULL) {
+    if (errno == ENOENT)
+      return 1;
+    logmsg(rc, log_sys_err, "Couldn't open host database %s: %s",
+	   rc->host_database, strerror(errno));
+    return 0;
   }
 
-  if (rsync_count_runable(rc) >= rc->max_parallel_fetches)
-    return;
+  while (ok && fgets(line, sizeof(line), f) != NULL) {
+    long last_attempt, last_success;
+    unsigned long u;
+    char *s, *e;
+    size_t n;
+    int len;
 
-  if ((wsk = walk_ctx_stack_clone(wsk)) == NULL) {
-    logmsg(rc, log_sys_err,
-	   "walk_ctx_stack_clone() failed, probably memory exhaustion, blundering onwards without forking stack");
-    return;
-  }
+    lineno++;
 
-  walk_ctx_stack_pop(wsk);
-  task_add(rc, walk_cert, wsk);
-}
+    if (lineno == 1) {
+      if (sscanf(line, "# rcynic host database version %d", &version) != 1 ||
+	  version != HOST_DATABASE_VERSION) {
+	logmsg(rc, log_usage_err, "Host database %s has unrecognized format, ignoring it",
+	       rc->host_database);
+	break;
+      }
+      continue;
+    }
 
-/**
- * Recursive walk of certificate hierarchy (core of the program).
- *
- * Walk all products of the current certificate, starting with the
- * ones named in the manifest and continuing with any that we find in
- * the publication directory but which are not named in the manifest.
- *
- * Dispatch to correct checking code for the object named by URI,
- * based on the filename extension in the uri.  CRLs are a special
- * case because we've already checked them by the time we get here, so
- * we just ignore them.  Other objects are either certificates or
- * CMS-signed objects of one kind or another.
- */
-static void walk_cert(rcynic_ctx_t *rc, void *cookie)
-{
-  STACK_OF(walk_ctx_t) *wsk = cookie;
-  const unsigned char *hash = NULL;
-  object_generation_t generation;
-  size_t hashlen;
-  walk_ctx_t *w;
-  uri_t uri;
+    if (line[0] == '#' || line[strspn(line, " \t\r\n")] == '\0')
+      continue;
 
-  assert(rc && wsk);
+    if (!strncmp(line, SCHEME_RSYNC, SIZEOF_RSYNC)) {
+      rsync_history_t *r;
+      long started, finished;
 
-  while ((w = walk_ctx_stack_head(wsk)) != NULL) {
+      if ((n = strcspn(line, " \t")) >= sizeof(r->uri.s) ||
+	  sscanf(line + n, "%ld %ld", &started, &finished) != 2) {
+	ok = 0;
+	break;
+      }
 
-    switch (w->state) {
-    case walk_state_current:
-      generation = object_generation_current;
+      if ((r = rsync_history_t_new()) == NULL) {
+	logmsg(rc, log_sys_err, "Couldn't allocate rsync_history entry");
+	break;
+      }
+
+      memcpy(r->uri.s, line, n);
+      r->uri.s[n] = '\0';
+      if (n > 0 && r->uri.s[n - 1] == '/') {
+	r->uri.s[n - 1] = '\0';
+	r->final_slash = 1;
+      }
+      r->started = (time_t) started;
+      r->finished = (time_t) finished;
+
+      if (!sk_rsync_history_t_push(rc->previous_rsync_history, r)) {
+	rsync_history_t_free(r);
+	logmsg(rc, log_sys_err, "Couldn't add %s to previous rsync_history", line);
+	break;
+      }
+
+      continue;
+    }
+
+    if ((n = strcspn(line, " \t")) == 0 || n >= sizeof(h->hostname) ||
+	(h = host_health_t_new()) == NULL) {
+      ok = h != NULL;
       break;
-    case walk_state_backup:
-      generation = object_generation_backup;
+    }
+
+    memcpy(h->hostname, line, n);
+    h->hostname[n] = '\0';
+
+    if (sscanf(line + n, "%u %u %u %u %u %ld %ld%n",
+	       &h->fetches, &h->failures, &h->timeouts, &h->refusals, &h->streak,
+	       &last_attempt, &last_success, &len) != 7) {
+      ok = 0;
       break;
-    default:
-      generation = object_generation_null;
+    }
+
+    h->last_attempt = (time_t) last_attempt;
+    h->last_success = (time_t) last_success;
+
+    for (s = line + n + len; (u = strtoul(s, &e, 10)) > 0 || e > s; s = e)
+      host_health_add_duration(h, (time_t) u);
+
+    if (!sk_host_health_t_push(rc->host_health, h)) {
+      ok = 0;
       break;
     }
 
-    switch (w->state) {
+    h = NULL;
+  }
 
-    case walk_state_initial:
+  if (!ok)
+    logmsg(rc, log_data_err, "Couldn't parse line %d of host database %s, ignoring the rest of it",
+	   lineno, rc->host_database);
 
-      if (!w->certinfo.sia.s[0] || !w->certinfo.ca) {
-	w->state = walk_state_done;
-	continue;
-      }
+  host_health_t_free(h);
+  (void) fclose(f);
 
-      if (!w->certinfo.manifest.s[0]) {
-	log_validation_status(rc, &w->certinfo.uri, sia_manifest_uri_missing, w->certinfo.generation);
-	w->state = walk_state_done;
-	continue;
-      }
+  logmsg(rc, log_verbose, "Loaded %d hosts and %d rsync history entries from host database %s",
+	 sk_host_health_t_num(rc->host_health),
+	 sk_rsync_history_t_num(rc->previous_rsync_history), rc->host_database);
 
-      w->state++;
-      continue;
+  return 1;
+}
 
-    case walk_state_rsync:
+/**
+ * Write host database for use by later runs.  We write to a temporary
+ * file and rename it, so that an interrupted run leaves the old
+ * database intact.
+ */
+static int write_host_database(const rcynic_ctx_t *rc)
+{
+  FILE *f = NULL;
+  time_t now = time(0);
+  path_t temp;
+  unsigned j;
+  int i, ok;
 
-      if (rsync_needed(rc, wsk)) {
-	rsync_tree(rc, &w->certinfo.sia, wsk, rsync_sia_callback);
-	return;
-      }
-      log_validation_status(rc, &w->certinfo.sia, rsync_transfer_skipped, object_generation_null);
-      w->state++;
-      continue;
+  assert(rc);
 
-    case walk_state_ready:
+  if (rc->host_database == NULL || rc->host_health == NULL ||
+      rc->rsync_history == NULL || rc->previous_rsync_history == NULL)
+    return 1;
 
-      walk_ctx_loop_init(rc, wsk);      /* sets w->state */
-      continue;
+  if (snprintf(temp.s, sizeof(temp.s), "%s.%u.tmp", rc->host_database, (unsigned) getpid()) >= sizeof(temp.s)) {
+    logmsg(rc, log_usage_err, "Filename \"%s\" is too long, not writing host database", rc->host_database);
+    return 0;
+  }
 
-    case walk_state_current:
-    case walk_state_backup:
+  logmsg(rc, log_verbose, "Writing host database to %s", rc->host_database);
 
-      if (!walk_ctx_loop_this(rc, wsk, &uri, &hash, &hashlen)) {
-	walk_ctx_loop_next(rc, wsk);
-	continue;
-      }
+  ok = (f = fopen(temp.s, "w")) != NULL;
 
-      if (endswith(uri.s, ".crl") || endswith(uri.s, ".mft") || endswith(uri.s, ".mnf")) {
-	walk_ctx_loop_next(rc, wsk);
-	continue;			/* CRLs and manifests checked elsewhere */
-      }
+  if (ok)
+    ok &= fprintf(f, "# rcynic host database version %d\n"
+		  "# hostname fetches failures timeouts refusals streak last-attempt last-success durations...\n"
+		  "# rsync-uri started finished\n",
+		  HOST_DATABASE_VERSION) != EOF;
 
-      if (hash == NULL && !rc->allow_object_not_in_manifest) {
-	log_validation_status(rc, &uri, skipped_because_not_in_manifest, generation);
-	walk_ctx_loop_next(rc, wsk);
-	continue;
-      }
+  for (i = 0; ok && i < sk_host_health_t_num(rc->host_health); i++) {
+    host_health_t *h = sk_host_health_t_value(rc->host_health, i);
+    assert(h);
 
-      if (hash == NULL)
-	log_validation_status(rc, &uri, tainted_by_not_being_in_manifest, generation);
-      else if (w->stale_manifest)
-	log_validation_status(rc, &uri, tainted_by_stale_manifest, generation);
+    if (h->nduration > 0)
+      logmsg(rc, log_verbose, "Host %s: %u fetches, %u failures, %u timeouts, %u refusals, median %us, 95th percentile %us",
+	     h->hostname, h->fetches, h->failures, h->timeouts, h->refusals,
+	     host_health_percentile(h, 50), host_health_percentile(h, 95));
 
-      if (endswith(uri.s, ".roa")) {
-	check_roa(rc, wsk, &uri, hash, hashlen);
-	walk_ctx_loop_next(rc, wsk);
-	continue;
-      }
+    ok &= fprintf(f, "%s %u %u %u %u %u %ld %ld",
+		  h->hostname, h->fetches, h->failures, h->timeouts, h->refusals, h->streak,
+		  (long) h->last_attempt, (long) h->last_success) != EOF;
 
-      if (endswith(uri.s, ".gbr")) {
-	check_ghostbuster(rc, wsk, &uri, hash, hashlen);
-	walk_ctx_loop_next(rc, wsk);
-	continue;
-      }
+    for (j = 0; ok && j < h->nduration; j++)
+      ok &= fprintf(f, " %u", h->durations[j]) != EOF;
 
-      if (endswith(uri.s, ".cer")) {
-	certinfo_t certinfo;
-	X509 *x = check_cert(rc, wsk, &uri, &certinfo, hash, hashlen);
-	if (!walk_ctx_stack_push(wsk, x, &certinfo))
-	  walk_ctx_loop_next(rc, wsk);
-	continue;
-      }
+    if (ok)
+      ok &= putc('\n', f) != EOF;
+  }
 
-      log_validation_status(rc, &uri, unknown_object_type_skipped, object_generation_null);
-      walk_ctx_loop_next(rc, wsk);
-      continue;
+  /*
+   * Durations of successful fetches, for scheduling next time.  We
+   * carry forward entries from the previous run which we didn't
+   * refetch this time, so that skipping a fetch doesn't lose what we
+   * knew about it, unless they have passed the history horizon.
+   */
 
-    case walk_state_done:
+  for (i = 0; ok && i < sk_rsync_history_t_num(rc->rsync_history); i++) {
+    rsync_history_t *r = sk_rsync_history_t_value(rc->rsync_history, i);
+    assert(r);
+    if (r->status == rsync_status_done && r->started)
+      ok &= fprintf(f, "%s%s %ld %ld\n", r->uri.s, (r->final_slash ? "/" : ""),
+		    (long) r->started, (long) r->finished) != EOF;
+  }
 
-      walk_ctx_stack_pop(wsk);	/* Resume our issuer's state */
-      continue;
+  for (i = 0; ok && i < sk_rsync_history_t_num(rc->previous_rsync_history); i++) {
+    rsync_history_t *r = sk_rsync_history_t_value(rc->previous_rsync_history, i);
+    assert(r);
+    if (!rsync_history_exact(rc, r) && !rsync_history_stale(rc, r, now))
+      ok &= fprintf(f, "%s%s %ld %ld\n", r->uri.s, (r->final_slash ? "/" : ""),
+		    (long) r->started, (long) r->finished) != EOF;
+  }
 
-    }
+  if (f)
+    ok &= fclose(f) != EOF;
+
+  if (ok)
+    ok &= rename(temp.s, rc->host_database) == 0;
+
+  if (!ok) {
+    logmsg(rc, log_sys_err, "Couldn't write host database to %s: %s",
+	   rc->host_database, strerror(errno));
+    (void) unlink(temp.s);
   }
 
-  assert(walk_ctx_stack_head(wsk) == NULL);
-  walk_ctx_stack_free(wsk);
+  return ok;
 }
 
+
+
 /**
- * Check a trust anchor.  Yes, we trust it, by definition, but it
- * still needs to conform to the certificate profile, the
- * self-signature must be correct, etcetera.
+ * Open the checkpoint journal for this run.
  *
- * Ownership of the TA certificate object passes to this function when
- * called (ie, freeing "x" is our responsibility).
+ * If we're resuming, first load fetches which an interrupted run
+ * finished into rsync_history, so that we won't fetch those
+ * publication points again.  Either way we then start a fresh
+ * journal, copying in anything we loaded so that a second
+ * interruption doesn't lose it, and so that we don't append to a
+ * partial line left by the first one.
+ *
+ * The journal records when the interrupted run started, and we won't
+ * resume a run which started more than journal_max_age seconds ago:
+ * by then, what it fetched is too stale to stand in for fetching it
+ * again.  A resumed run keeps the original start time, so repeated
+ * interruptions can't stretch a run out indefinitely.
+ *
+ * We don't try to checkpoint the tree walk itself: validating data
+ * we already have is cheap compared to fetching it, and redoing the
+ * walk means the new output tree reflects the current state of every
+ * object rather than whatever it was when the interrupted run looked
+ * at it.
  */
-static int check_ta(rcynic_ctx_t *rc, X509 *x, const uri_t *uri,
-		    const path_t *path1, const path_t *path2,
-		    const object_generation_t generation)
+static int journal_open(rcynic_ctx_t *rc, const int resume)
 {
-  STACK_OF(walk_ctx_t) *wsk = NULL;
-  walk_ctx_t *w = NULL;
+  char line[URI_MAX + 64];
+  int i, version = 0, lineno = 0, n = 0;
+  time_t now = time(0), run_started = now;
+  rsync_history_t *h;
+  long when;
+  FILE *f;
 
-  assert(rc && x && uri && path1 && path2);
+  assert(rc && rc->rsync_history && rc->rsync_history_index && rc->journal == NULL);
 
-  if (x == NULL)
+  if (rc->journal_file == NULL)
     return 1;
 
-  if ((wsk = walk_ctx_stack_new()) == NULL) {
-    logmsg(rc, log_sys_err, "Couldn't allocate walk context stack");
-    X509_free(x);
-    return 0;
-  }
+  if (resume && (f = fopen(rc->journal_file, "r")) != NULL) {
+
+    if (fgets(line, sizeof(line), f) == NULL ||
+	sscanf(line, "# rcynic journal version %d started %ld", &version, &when) != 2 ||
+	version != JOURNAL_VERSION)
+      logmsg(rc, log_usage_err, "Journal %s has unrecognized format, not resuming",
+	     rc->journal_file);
+
+    else if (rc->journal_max_age > 0 &&
+	     ((time_t) when > now || (time_t) when + rc->journal_max_age < now))
+      logmsg(rc, log_telemetry, "Journal %s is from a run which started %ld seconds ago, not resuming",
+	     rc->journal_file, (long) (now - (time_t) when));
+
+    else {
+      run_started = (time_t) when;
+      lineno++;
+
+      while (fgets(line, sizeof(line), f) != NULL) {
+	long started, finished;
+	size_t len;
+
+	lineno++;
+
+	/*
+	 * An interrupted run can leave a partial line at the end, so
+	 * we just stop at the first line we don't like.
+	 */
+	if (strncmp(line, SCHEME_RSYNC, SIZEOF_RSYNC) ||
+	    strchr(line, '\n') == NULL ||
+	    (len = strcspn(line, " \t")) >= sizeof(h->uri.s) ||
+	    sscanf(line + len, "%ld %ld", &started, &finished) != 2) {
+	  logmsg(rc, log_verbose, "Stopped reading journal %s at line %d", rc->journal_file, lineno);
+	  break;
+	}
+
+	if ((h = rsync_history_t_new()) == NULL) {
+	  logmsg(rc, log_sys_err, "Couldn't allocate rsync_history entry");
+	  break;
+	}
+
+	memcpy(h->uri.s, line, len);
+	h->uri.s[len] = '\0';
+	while (len > 0 && h->uri.s[len - 1] == '/') {
+	  h->uri.s[--len] = '\0';
+	  h->final_slash = 1;
+	}
+	h->status = rsync_status_done;
+	h->started = (time_t) started;
+	h->finished = (time_t) finished;
+
+	if (!sk_rsync_history_t_push(rc->rsync_history, h)) {
+	  logmsg(rc, log_sys_err, "Couldn't add %s to rsync_history", h->uri.s);
+	  rsync_history_t_free(h);
+	  break;
+	}
+
+	rsync_history_index_add(rc->rsync_history_index, h);
+	n++;
+      }
+    }
 
-  if ((w = walk_ctx_stack_push(wsk, x, NULL)) == NULL) {
-    logmsg(rc, log_sys_err, "Couldn't push walk context stack");
-    walk_ctx_stack_free(wsk);
-    X509_free(x);
-    return 0;
+    (void) fclose(f);
+
+    if (n > 0)
+      logmsg(rc, log_telemetry, "Resuming interrupted run, %d completed fetches in journal %s",
+	     n, rc->journal_file);
   }
 
-  if (!check_x509(rc, wsk, uri, x, NULL, generation)) {
-    log_validation_status(rc, uri, object_rejected, generation);
-    walk_ctx_stack_free(wsk);
-    return 1;
+  if ((f = fopen(rc->journal_file, "w")) == NULL) {
+    logmsg(rc, log_sys_err, "Couldn't open journal %s: %s",
+	   rc->journal_file, strerror(errno));
+    return 0;
   }
 
-  logmsg(rc, log_telemetry, "Copying trust anchor %s to %s", path1->s, path2->s);
+  setvbuf(f, NULL, _IOLBF, 0);
 
-  if (!mkdir_maybe(rc, path2) || !cp_ln(rc, path1, path2)) {
-    walk_ctx_stack_free(wsk);
+  /*
+   * Worker processes share this stream with us, so make sure their
+   * lines land at the end of the file rather than on top of each other.
+   */
+  if ((i = fcntl(fileno(f), F_GETFL, 0)) == -1 ||
+      fcntl(fileno(f), F_SETFL, i | O_APPEND) == -1)
+    logmsg(rc, log_sys_err, "Couldn't set O_APPEND on journal %s: %s",
+	   rc->journal_file, strerror(errno));
+
+  if (fprintf(f, "# rcynic journal version %d started %ld\n", JOURNAL_VERSION, (long) run_started) < 0) {
+    logmsg(rc, log_sys_err, "Couldn't write to journal %s: %s",
+	   rc->journal_file, strerror(errno));
+    (void) fclose(f);
     return 0;
   }
 
-  log_validation_status(rc, uri, object_accepted, generation);
-  task_add(rc, walk_cert, wsk);
+  rc->journal = f;
+
+  for (i = 0; (h = sk_rsync_history_t_value(rc->rsync_history, i)) != NULL; i++)
+    if (h->status == rsync_status_done)
+      journal_rsync(rc, h);
+
   return 1;
 }
 
-
-
 /**
- * Check a trust anchor read from a local file.
+ * Close the checkpoint journal.  Once a run has finished, the journal
+ * has nothing more to tell us, so we remove it.
  */
-static int check_ta_cer(rcynic_ctx_t *rc,
-			const char *fn)
-
+static void journal_close(rcynic_ctx_t *rc, const int finished)
 {
-  path_t path1, path2;
-  unsigned long hash;
-  X509 *x = NULL;
-  uri_t uri;
-  int i;
-
-  assert(rc && fn);
-
-  logmsg(rc, log_telemetry, "Processing trust anchor from file %s", fn);
+  assert(rc);
 
-  if (strlen(fn) >= sizeof(path1.s)) {
-    logmsg(rc, log_usage_err, "Trust anchor path name too long %s", fn);
-    return 0;
-  }
-  strcpy(path1.s, fn);
-  filename_to_uri(&uri, path1.s);
+  if (rc->journal == NULL)
+    return;
 
-  if ((x = read_cert(&path1, NULL)) == NULL) {
-    logmsg(rc, log_usage_err, "Couldn't read trust anchor from file %s", fn);
-    log_validation_status(rc, &uri, unreadable_trust_anchor, object_generation_null);
-    goto lose;
-  }
+  if (fclose(rc->journal) == EOF)
+    logmsg(rc, log_sys_err, "Couldn't close journal %s: %s",
+	   rc->journal_file, strerror(errno));
 
-  hash = X509_subject_name_hash(x);
+  rc->journal = NULL;
 
-  for (i = 0; i < INT_MAX; i++) {
-    if (snprintf(path2.s, sizeof(path2.s), "%s%lx.%d.cer",
-		 rc->new_authenticated.s, hash, i) >= sizeof(path2.s)) {
-      logmsg(rc, log_sys_err,
-	     "Couldn't construct path name for trust anchor %s", path1.s);
-      goto lose;
-    }
-    if (access(path2.s, F_OK))
-      break;
-  }
-  if (i == INT_MAX) {
-    logmsg(rc, log_sys_err, "Couldn't find a free name for trust anchor %s", path1.s);
-    goto lose;
-  }
+  if (finished && unlink(rc->journal_file) < 0 && errno != ENOENT)
+    logmsg(rc, log_sys_err, "Couldn't remove journal %s: %s",
+	   rc->journal_file, strerror(errno));
+}
 
-  return check_ta(rc, x, &uri, &path1, &path2, object_generation_null);
 
- lose:
-  log_validation_status(rc, &uri, trust_anchor_skipped, object_generation_null);
-  X509_free(x);
-  return 0;
-}
 
-
+/**
+ * Set by signal handler when a daemon should exit after the current
+ * validation cycle.
+ */
+static volatile sig_atomic_t daemon_stop;
 
 /**
- * Allocate a new tal_ctx_t.
+ * Signal handler for daemon mode.
  */
-static tal_ctx_t *tal_ctx_t_new(void)
+static void daemon_stop_handler(int sig)
 {
-  tal_ctx_t *tctx = malloc(sizeof(*tctx));
-  if (tctx)
-    memset(tctx, 0, sizeof(*tctx));
-  return tctx;
+  daemon_stop = 1;
 }
 
 /**
- * Free a tal_ctx_t.
+ * Log elapsed time since some starting point.
  */
-static void tal_ctx_t_free(tal_ctx_t *tctx)
+static void log_elapsed_time(const rcynic_ctx_t *rc,
+			     const char *what,
+			     const time_t start)
 {
-  if (tctx) {
-    EVP_PKEY_free(tctx->pkey);
-    free(tctx);
-  }
+  time_t finish = time(0);
+
+  logmsg(rc, log_telemetry,
+	 "%s, elapsed time %u:%02u:%02u", what,
+	 (unsigned) ((finish - start) / 3600),
+	 (unsigned) ((finish - start) / 60 % 60),
+	 (unsigned) ((finish - start) % 60));
 }
 
 /**
- * Read a trust anchor from disk and compare with known public key.
- *
- * NB: EVP_PKEY_cmp() returns 1 for match, not 0 like every other
- * xyz_cmp() function in the entire OpenSSL library.  Go figure.
+ * Walk everything reachable from the configured trust anchors (or,
+ * in a worker, from this worker's share of them), running the event
+ * loop until there's nothing left to do.
  */
-static int check_ta_tal_callback_1(rcynic_ctx_t *rc,
-				   const tal_ctx_t *tctx,
-				   object_generation_t generation)
-
+static int walk_trust_anchors(rcynic_ctx_t *rc,
+			      STACK_OF(CONF_VALUE) *cfg_section,
+			      const path_t *ta_dir)
 {
-  const path_t *prefix = NULL;
-  EVP_PKEY *pkey = NULL;
-  X509 *x = NULL;
-  path_t path;
-  int ret = 0;
+  int i;
 
-  switch (generation) {
-  case object_generation_current:
-    prefix = &rc->unauthenticated;
-    break;
-  case object_generation_backup:
-    prefix = &rc->old_authenticated;
-    break;
-  default:
-    goto done;
-  }
+  assert(rc && cfg_section && ta_dir);
 
-  if (!uri_to_filename(rc, &tctx->uri, &path, prefix)) {
-    log_validation_status(rc, &tctx->uri, unreadable_trust_anchor_locator, generation);
-    goto done;
-  }
+  for (i = 0; i < sk_CONF_VALUE_num(cfg_section); i++) {
+    CONF_VALUE *val = sk_CONF_VALUE_value(cfg_section, i);
 
-  if ((x = read_cert(&path, NULL)) == NULL || (pkey = X509_get_pubkey(x)) == NULL) {
-    log_validation_status(rc, &tctx->uri, unreadable_trust_anchor, generation);
-    goto done;
+    assert(val && val->name && val->value);
+
+    if (!name_cmp(val->name, "trust-anchor-uri-with-key") ||
+	!name_cmp(val->name, "indirect-trust-anchor")) {
+      logmsg(rc, log_usage_err,
+	     "Directive \"%s\" is obsolete -- please use \"trust-anchor-locator\" instead",
+	     val->name);
+      return 0;
+    }
+
+    if ((!name_cmp(val->name, "trust-anchor") ||
+	 !name_cmp(val->name, "trust-anchor-locator")) &&
+	!ta_is_mine(rc))
+      continue;
+
+    if ((!name_cmp(val->name, "trust-anchor")         && !check_ta_cer(rc, val->value)) ||
+	(!name_cmp(val->name, "trust-anchor-locator") && !check_ta_tal(rc, val->value)))
+      return 0;
   }
 
-  if (EVP_PKEY_cmp(tctx->pkey, pkey) != 1) {
-    log_validation_status(rc, &tctx->uri, trust_anchor_key_mismatch, generation);
-    goto done;
+  if (*ta_dir->s != '\0' && !check_ta_dir(rc, ta_dir->s))
+    return 0;
+
+  rsync_prefetch(rc);
+
+  /*
+   * Event loop.  rsync_mgr() only blocks when the task queue is
+   * empty, and then only until some rsync process has something for
+   * us or a deadline comes due.
+   */
+  while (rc->task_queue->count > 0 || sk_rsync_ctx_t_num(rc->rsync_queue) > 0) {
+    task_run_q(rc);
+    rsync_mgr(rc);
   }
 
-  ret = check_ta(rc, x, &tctx->uri, &path, &tctx->path, generation);
-  x = NULL;
+  logmsg(rc, log_telemetry, "Event loop done, beginning final output and cleanup");
 
- done:
-  if (!ret)
-    log_validation_status(rc, &tctx->uri, object_rejected, generation);
-  EVP_PKEY_free(pkey);
-  X509_free(x);
-  return ret;
+  task_queue_log_stats(rc);
+
+  return 1;
 }
 
 /**
- * rsync callback for fetching a TAL.
+ * Send a worker's results back to the coordinator: everything in
+ * validation_status and rsync_history, plus statistics for every
+ * repository host the worker talked to.  Both processes are running
+ * the same binary, so we just copy the structures; the reader
+ * clears the pointers, which mean nothing in the other process.
  */
-static void rsync_tal_callback(rcynic_ctx_t *rc,
-			       const rsync_ctx_t *ctx,
-			       const rsync_status_t status,
-			       const uri_t *uri,
-			       void *cookie)
+static int worker_write_results(const rcynic_ctx_t *rc,
+				FILE *f,
+				const time_t start)
 {
-  tal_ctx_t *tctx = cookie;
+  const validation_status_t *v;
+  const rsync_history_t *r;
+  const host_health_t *h;
+  int i, ok = 1;
 
-  assert(rc && tctx);
+  assert(rc && f);
 
-  if (status == rsync_status_pending)
-    return;
+  for (i = 0; ok && (v = sk_validation_status_t_value(rc->validation_status, i)) != NULL; i++)
+    ok = putc('v', f) != EOF && fwrite(v, sizeof(*v), 1, f) == 1;
 
-  if (!check_ta_tal_callback_1(rc, tctx, object_generation_current) &&
-      !check_ta_tal_callback_1(rc, tctx, object_generation_backup))
-    log_validation_status(rc, &tctx->uri, trust_anchor_skipped, object_generation_null);
+  for (i = 0; ok && (r = sk_rsync_history_t_value(rc->rsync_history, i)) != NULL; i++)
+    ok = putc('r', f) != EOF && fwrite(r, sizeof(*r), 1, f) == 1;
 
-  tal_ctx_t_free(tctx);
+  for (i = 0; ok && (h = sk_host_health_t_value(rc->host_health, i)) != NULL; i++)
+    if (h->last_attempt >= start)
+      ok = putc('h', f) != EOF && fwrite(h, sizeof(*h), 1, f) == 1;
+
+  return ok && fflush(f) != EOF;
 }
 
 /**
- * Check a trust anchor read from a trust anchor locator (TAL).
- */
-static int check_ta_tal(rcynic_ctx_t *rc,
-			const char *fn)
+ * Fold one worker's statistics for a repository host into ours.
+ *
+ * Every worker started from the same copy of our statistics ("base"),
+ * so what a worker adds is the difference between its record and
+ * base, and we add that to whatever earlier workers have already
+ * added.  The failure streak follows the single-process rule as best
+ * it can: a success anywhere this run resets it, otherwise a
+ * connection failure anywhere bumps it once.
+ */
+static void host_health_merge(host_health_t *h,
+			      const host_health_t *base,
+			      const host_health_t *w)
+{
+  unsigned n, j;
+
+  assert(h && base && w);
+
+  h->fetches  += w->fetches  - base->fetches;
+  h->failures += w->failures - base->failures;
+  h->timeouts += w->timeouts - base->timeouts;
+  h->refusals += w->refusals - base->refusals;
+
+  /*
+   * The newest duration samples are at the end of the worker's list,
+   * and nsamples tells us how many of them it added, though it only
+   * kept the last HOST_LATENCY_SAMPLES.
+   */
+  n = w->nsamples - base->nsamples;
+  if (n > w->nduration)
+    n = w->nduration;
+  for (j = w->nduration - n; j < w->nduration; j++)
+    host_health_add_duration(h, (time_t) w->durations[j]);
+
+  if (w->last_success > base->last_success)
+    h->streak = h->streak < w->streak ? h->streak : w->streak;
+  else if (w->failed && h->last_success <= base->last_success && w->streak > h->streak)
+    h->streak = w->streak;
+
+  h->failed |= w->failed;
+
+  if (w->last_attempt > h->last_attempt)
+    h->last_attempt = w->last_attempt;
+  if (w->last_success > h->last_success)
+    h->last_success = w->last_success;
+}
 
+/**
+ * Merge one worker's results into our own context.
+ *
+ * Validation status entries for the same URI and generation are
+ * combined, which can only happen where two trust anchors share a
+ * repository.  rsync_history entries we already have are dropped;
+ * these are the ones loaded from the journal before the workers
+ * started, which every worker inherited.  Host statistics are merged
+ * additively against "base", the copy of ours the workers started
+ * with, so two workers fetching from the same host both count.
+ */
+static int worker_read_results(rcynic_ctx_t *rc,
+			       FILE *f,
+			       const STACK_OF(host_health_t) *base)
 {
-  tal_ctx_t *tctx = NULL;
-  BIO *bio = NULL;
-  int ret = 1;
+  static const host_health_t zero;
+  const host_health_t *b;
+  union {
+    validation_status_t v;
+    rsync_history_t r;
+    host_health_t h;
+  } u;
+  validation_status_t *v;
+  rsync_history_t *r;
+  host_health_t *h;
+  int c, i, n = 0;
+
+  assert(rc && f);
+
+  rewind(f);
+
+  while ((c = getc(f)) != EOF) {
+    switch (c) {
 
-  assert(rc && fn);
+    case 'v':
+      if (fread(&u.v, sizeof(u.v), 1, f) != 1)
+	return 0;
+      if ((v = validation_status_intern(rc, &u.v.uri, u.v.generation)) == NULL)
+	return 0;
+      for (i = 0; i < sizeof(v->events); i++)
+	v->events[i] |= u.v.events[i];
+      if (u.v.timestamp > v->timestamp)
+	v->timestamp = u.v.timestamp;
+      break;
 
-  logmsg(rc, log_telemetry, "Processing trust anchor locator from file %s", fn);
+    case 'r':
+      if (fread(&u.r, sizeof(u.r), 1, f) != 1)
+	return 0;
+      if (rsync_history_exact(rc, &u.r))
+	break;
+      if ((r = rsync_history_t_new()) == NULL)
+	return 0;
+      r->uri = u.r.uri;
+      r->started = u.r.started;
+      r->finished = u.r.finished;
+      r->status = u.r.status;
+      r->final_slash = u.r.final_slash;
+      if (!sk_rsync_history_t_push(rc->rsync_history, r)) {
+	rsync_history_t_free(r);
+	return 0;
+      }
+      rsync_history_index_add(rc->rsync_history_index, r);
+      break;
 
-  if ((tctx = tal_ctx_t_new()) == NULL) {
-    logmsg(rc, log_sys_err, "malloc(tal_ctxt_t) failed");
-    goto done;
+    case 'h':
+      if (fread(&u.h, sizeof(u.h), 1, f) != 1)
+	return 0;
+      b = &zero;
+      if ((i = sk_host_health_t_find((STACK_OF(host_health_t) *) base, &u.h)) >= 0)
+	b = sk_host_health_t_value(base, i);
+      if ((i = sk_host_health_t_find(rc->host_health, &u.h)) >= 0) {
+	host_health_merge(sk_host_health_t_value(rc->host_health, i), b, &u.h);
+	break;
+      }
+      if ((h = host_health_t_new()) == NULL)
+	return 0;
+      strcpy(h->hostname, u.h.hostname);
+      host_health_merge(h, b, &u.h);
+      if (!sk_host_health_t_push(rc->host_health, h)) {
+	host_health_t_free(h);
+	return 0;
+      }
+      break;
+
+    default:
+      return 0;
+    }
+    n++;
   }
 
-  bio = BIO_new_file(fn, "r");
+  logmsg(rc, log_verbose, "Merged %d records from worker", n);
+  return !ferror(f);
+}
 
-  if (!bio)
-    logmsg(rc, log_usage_err, "Couldn't open trust anchor locator file %s", fn);
+/**
+ * Worker i's share of a limit of "total" split n ways, never less
+ * than one.  Zero or less means no limit, which we leave alone.
+ */
+static int worker_share(const int total, const int i, const int n)
+{
+  int share;
 
-  if (!bio || BIO_gets(bio, tctx->uri.s, sizeof(tctx->uri.s)) <= 0) {
-    uri_t furi;
-    filename_to_uri(&furi, fn);
-    log_validation_status(rc, &furi, unreadable_trust_anchor_locator, object_generation_null);
-    goto done;
+  assert(n > 0 && i >= 0 && i < n);
+
+  if (total <= 0)
+    return total;
+
+  share = total / n + (i < total % n);
+  return share > 0 ? share : 1;
+}
+
+/**
+ * Split the trust anchors across rc->ta_workers worker processes and
+ * merge their results.
+ *
+ * The workers share the output and unauthenticated trees with us.
+ * Each writes only the parts of the output tree reachable from its
+ * own trust anchors, but trust anchors can share publication points,
+ * so the workers coordinate their fetches through a fetch table in
+ * shared memory: a worker waits while another is fetching a
+ * conflicting URI, and skips URIs another worker has already
+ * attempted, just as a single process would.  Each worker sends its
+ * results back through an anonymous temporary file.  We don't know in
+ * advance how big they'll be, so a file is easier than a fixed-size
+ * shared memory table.  We merge all the results before doing
+ * anything irreversible, so finalize_directories() still happens
+ * once, here, and only if every worker succeeded.
+ *
+ * The max-parallel-fetches and max-parallel-fetches-per-host limits
+ * are shared out among the workers, so that together they stay within
+ * what the configuration allows, except that each worker gets at
+ * least one of each.  We keep a copy of our host statistics as the
+ * workers see them, so that we can tell what each worker added.
+ */
+static int run_workers(rcynic_ctx_t *rc,
+		       STACK_OF(CONF_VALUE) *cfg_section,
+		       const path_t *ta_dir)
+{
+  struct {
+    pid_t pid;
+    FILE *f;
+  } *workers;
+  STACK_OF(host_health_t) *base = NULL;
+  fetch_table_t *t = MAP_FAILED;
+  FILE *lock = NULL;
+  host_health_t *h, *hb;
+  int i, status, nslots, ok = 1;
+  time_t start = time(0);
+  size_t size;
+  pid_t pid;
+
+  assert(rc && rc->ta_workers > 1 && rc->fetch_table == NULL);
+
+  for (i = nslots = 0; i < rc->ta_workers; i++)
+    nslots += worker_share(rc->max_parallel_fetches, i, rc->ta_workers);
+  if (nslots < rc->ta_workers)
+    nslots = rc->ta_workers;
+  size = sizeof(*t) + (nslots - 1) * sizeof(t->running[0]);
+
+  if ((lock = tmpfile()) == NULL ||
+      (t = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0)) == MAP_FAILED) {
+    logmsg(rc, log_sys_err, "Couldn't create fetch table for workers: %s", strerror(errno));
+    if (lock != NULL)
+      (void) fclose(lock);
+    return 0;
   }
 
-  tctx->uri.s[strcspn(tctx->uri.s, " \t\r\n")] = '\0';
+  t->nrunning = nslots;
+  rc->fetch_table = t;
+  rc->fetch_table_lock = fileno(lock);
 
-  if (!uri_to_filename(rc, &tctx->uri, &tctx->path, &rc->new_authenticated)) {
-    log_validation_status(rc, &tctx->uri, unreadable_trust_anchor_locator, object_generation_null);
+  if ((workers = calloc(rc->ta_workers, sizeof(*workers))) == NULL ||
+      (base = sk_host_health_t_new(host_health_cmp)) == NULL) {
+    logmsg(rc, log_sys_err, "Couldn't allocate worker table");
+    free(workers);
+    ok = 0;
     goto done;
   }
 
-  if (!endswith(tctx->uri.s, ".cer")) {
-    log_validation_status(rc, &tctx->uri, malformed_tal_uri, object_generation_null);
-    goto done;
+  for (i = 0; (h = sk_host_health_t_value(rc->host_health, i)) != NULL; i++) {
+    if ((hb = host_health_t_new()) == NULL || !sk_host_health_t_push(base, hb)) {
+      logmsg(rc, log_sys_err, "Couldn't copy host statistics for workers");
+      host_health_t_free(hb);
+      sk_host_health_t_pop_free(base, host_health_t_free);
+      free(workers);
+      ok = 0;
+      goto done;
+    }
+    *hb = *h;
+  }
+
+  sk_host_health_t_sort(base);
+
+  for (i = 0; i < rc->ta_workers; i++) {
+
+    if ((workers[i].f = tmpfile()) == NULL) {
+      logmsg(rc, log_sys_err, "Couldn't create worker results file: %s", strerror(errno));
+      ok = 0;
+      break;
+    }
+
+    (void) fflush(NULL);
+
+    if ((workers[i].pid = fork()) < 0) {
+      logmsg(rc, log_sys_err, "fork() failed: %s", strerror(errno));
+      ok = 0;
+      break;
+    }
+
+    if (workers[i].pid == 0) {
+      /*
+       * Worker.  We need our own SIGCHLD pipe, since our rsync
+       * children are none of the coordinator's business.  We don't
+       * prefetch: we don't know which previous URIs belong to us.
+       */
+      sigchld_cleanup(rc);
+      rc->ta_shard = i;
+      rc->ta_shards = rc->ta_workers;
+      rc->ta_count = 0;
+      rc->rsync_prefetch = 0;
+      rc->max_parallel_fetches = worker_share(rc->max_parallel_fetches, i, rc->ta_workers);
+      rc->max_fetches_per_host = worker_share(rc->max_fetches_per_host, i, rc->ta_workers);
+      ok = (sigchld_setup(rc) &&
+	    walk_trust_anchors(rc, cfg_section, ta_dir) &&
+	    worker_write_results(rc, workers[i].f, start));
+      if (!ok)
+	logmsg(rc, log_sys_err, "Worker %d failed", i);
+      log_openssl_errors(rc);
+      (void) fflush(NULL);
+      _exit(ok ? 0 : 1);
+    }
+
+    logmsg(rc, log_verbose, "Started worker %d, pid %u", i, (unsigned) workers[i].pid);
   }
 
-  bio = BIO_push(BIO_new(BIO_f_linebreak()), bio);
-  bio = BIO_push(BIO_new(BIO_f_base64()), bio);
-  if (bio)
-    tctx->pkey = d2i_PUBKEY_bio(bio, NULL);
-  if (!tctx->pkey) {
-    log_validation_status(rc, &tctx->uri, unreadable_trust_anchor_locator, object_generation_null);
-    goto done;
+  for (i = 0; i < rc->ta_workers && workers[i].pid > 0; i++) {
+
+    while ((pid = waitpid(workers[i].pid, &status, 0)) < 0 && errno == EINTR)
+      ;
+
+    if (pid < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      logmsg(rc, log_sys_err, "Worker %d (pid %u) failed", i, (unsigned) workers[i].pid);
+      ok = 0;
+    }
+
+    else if (ok && !worker_read_results(rc, workers[i].f, base)) {
+      logmsg(rc, log_sys_err, "Couldn't read results from worker %d", i);
+      ok = 0;
+    }
   }
 
-  logmsg(rc, log_telemetry, "Processing trust anchor from URI %s", tctx->uri.s);
+  for (i = 0; i < rc->ta_workers; i++)
+    if (workers[i].f != NULL)
+      (void) fclose(workers[i].f);
 
-  rsync_ta(rc, &tctx->uri, tctx, rsync_tal_callback);
-  tctx = NULL;			/* Control has passed */
+  sk_host_health_t_pop_free(base, host_health_t_free);
+  free(workers);
+
+  if (ok)
+    logmsg(rc, log_telemetry, "All %d workers done", rc->ta_workers);
 
  done:
-  tal_ctx_t_free(tctx);
-  BIO_free_all(bio);
-  return ret;
+  rc->fetch_table = NULL;
+  rc->fetch_table_lock = -1;
+  (void) munmap(t, size);
+  (void) fclose(lock);
+  return ok;
 }
 
 /**
- * Check a directory of trust anchors and trust anchor locators.
+ * Run one validation cycle: walk everything reachable from the
+ * configured trust anchors, then write out the results.
  */
-static int check_ta_dir(rcynic_ctx_t *rc,
-			const char *dn)
+static int run_cycle(rcynic_ctx_t *rc,
+		     STACK_OF(CONF_VALUE) *cfg_section,
+		     const path_t *ta_dir,
+		     const int prune,
+		     const int resume,
+		     const char *xmlfile)
 {
-  DIR *dir = NULL;
-  struct dirent *d;
-  path_t path;
-  int is_cer, is_tal;
-
-  assert(rc && dn);
+  assert(rc && cfg_section && ta_dir);
 
-  if ((dir = opendir(dn)) == NULL) {
-    logmsg(rc, log_sys_err, "Couldn't open trust anchor directory %s: %s",
-	   dn, strerror(errno));
-    return 0;
-  }
+  /*
+   * Everything in this cycle validates against the same "now", so
+   * that an object's fate doesn't depend on how long the cycle has
+   * been running, and so that --now gives repeatable results.
+   */
+  rc->now = rc->now_override > 0 ? rc->now_override : (int64_t) time(0);
 
-  while ((d = readdir(dir)) != NULL) {
-    if (snprintf(path.s, sizeof(path.s), "%s/%s", dn, d->d_name) >= sizeof(path.s)) {
-      logmsg(rc, log_data_err, "Pathname %s/%s too long", dn, d->d_name);
-      break;
-    }
-    is_cer = endswith(path.s, ".cer");
-    is_tal = endswith(path.s, ".tal");
-    if (is_cer && !check_ta_cer(rc, path.s))
-      break;
-    if (is_tal && !check_ta_tal(rc, path.s))
-      break;
-    if (!is_cer && !is_tal)
-      logmsg(rc, log_verbose, "Skipping non-trust-anchor %s", path.s);
+  if (rc->now_override > 0) {
+    timestamp_t ts;
+    time_t t = (time_t) rc->now;
+    logmsg(rc, log_telemetry, "Validating as of %s", time_to_string(&ts, &t));
   }
 
-  if (dir != NULL)
-    closedir(dir);
+  if (!journal_open(rc, resume))
+    return 0;
 
-  return !d;;
-}
+  if (!construct_directory_names(rc))
+    return 0;
 
-
+  if (!access(rc->new_authenticated.s, F_OK)) {
+    logmsg(rc, log_sys_err,
+	   "Timestamped output directory %s already exists!  Clock went backwards?",
+	   rc->new_authenticated.s);
+    return 0;
+  }
 
-/**
- * Write detailed log of what we've done as an XML file.
- */
-static int write_xml_file(const rcynic_ctx_t *rc,
-			  const char *xmlfile)
-{
-  int i, j, use_stdout, ok;
-  char hostname[HOSTNAME_MAX];
-  mib_counter_t code;
-  timestamp_t ts;
-  FILE *f = NULL;
-  path_t xmltemp;
+  if (!mkdir_maybe(rc, &rc->new_authenticated)) {
+    logmsg(rc, log_sys_err, "Couldn't prepare directory %s: %s",
+	   rc->new_authenticated.s, strerror(errno));
+    return 0;
+  }
 
-  if (xmlfile == NULL)
-    return 1;
+  if (rc->ta_workers > 1
+      ? !run_workers(rc, cfg_section, ta_dir)
+      : !walk_trust_anchors(rc, cfg_section, ta_dir))
+    return 0;
 
-  use_stdout = !strcmp(xmlfile, "-");
+  /*
+   * Losing the host database only costs us some scheduling history,
+   * which is no reason to throw away this run's validation results.
+   * write_host_database() has already logged why it failed.
+   */
+  (void) write_host_database(rc);
 
-  logmsg(rc, log_telemetry, "Writing XML summary to %s",
-	 (use_stdout ? "standard output" : xmlfile));
+  if (!finalize_directories(rc))
+    return 0;
 
-  if (use_stdout) {
-    f = stdout;
-    ok = 1;
-  } else if (snprintf(xmltemp.s, sizeof(xmltemp.s), "%s.%u.tmp", xmlfile, (unsigned) getpid()) >= sizeof(xmltemp.s)) {
-    logmsg(rc, log_usage_err, "Filename \"%s\" is too long, not writing XML", xmlfile);
+  if (prune && rc->run_rsync &&
+      !prune_unauthenticated(rc, &rc->unauthenticated,
+			     strlen(rc->unauthenticated.s))) {
+    logmsg(rc, log_sys_err, "Trouble pruning old unauthenticated data");
     return 0;
-  } else {
-    ok = (f = fopen(xmltemp.s, "w")) != NULL;
   }
 
-  ok &= gethostname(hostname, sizeof(hostname)) == 0;
-
-  if (ok)
-    ok &= fprintf(f, "<?xml version=\"1.0\" ?>\n"
-		  "<rcynic-summary date=\"%s\" rcynic-version=\"%s\""
-		  " summary-version=\"%d\" reporting-hostname=\"%s\">\n"
-		  "  <labels>\n",
-		  time_to_string(&ts, NULL),
-		  svn_id, XML_SUMMARY_VERSION, hostname) != EOF;
+  if (!write_xml_file(rc, xmlfile))
+    return 0;
 
-  for (j = 0; ok && j < MIB_COUNTER_T_MAX; ++j)
-    ok &= fprintf(f, "    <%s kind=\"%s\">%s</%s>\n",
-		  mib_counter_label[j], mib_counter_kind[j],
-		  (mib_counter_desc[j]
-		   ? mib_counter_desc[j]
-		   : X509_verify_cert_error_string(mib_counter_openssl[j])),
-		  mib_counter_label[j]) != EOF;
+  journal_close(rc, 1);
 
-  if (ok)
-    ok &= fprintf(f, "  </labels>\n") != EOF;
+  return 1;
+}
 
-  for (i = 0; ok && i < sk_validation_status_t_num(rc->validation_status); i++) {
-    validation_status_t *v = sk_validation_status_t_value(rc->validation_status, i);
-    assert(v);
+/**
+ * Get ready for another validation cycle in daemon mode.
+ *
+ * Results of the last cycle (validation status, this cycle's rsync
+ * history) go away.  Things we learned which should outlive a cycle
+ * stay resident: host statistics, the X509_STORE, the issuer key
+ * cache, the allocated queues, and rsync history, which becomes the
+ * "previous run" history that we would otherwise have read back from
+ * the host database.
+ */
+static void cycle_reset(rcynic_ctx_t *rc)
+{
+  validation_status_t *v;
+  rsync_history_t *h;
+  host_health_t *hh;
+  time_t now = time(0);
+  int i;
 
-    (void) time_to_string(&ts, &v->timestamp);
+  assert(rc && rc->task_queue->count == 0 && sk_rsync_ctx_t_num(rc->rsync_queue) == 0);
 
-    for (code = (mib_counter_t) 0; ok && code < MIB_COUNTER_T_MAX; code++) {
-      if (validation_status_get_code(v, code)) {
-	if (ok)
-	  ok &= fprintf(f, "  <validation_status timestamp=\"%s\" status=\"%s\"",
-			ts.s, mib_counter_label[code]) != EOF;
-	if (ok && (v->generation == object_generation_current ||
-		   v->generation == object_generation_backup))
-	  ok &= fprintf(f, " generation=\"%s\"",
-			object_generation_label[v->generation]) != EOF;
-	if (ok)
-	  ok &= fprintf(f, ">%s</validation_status>\n", v->uri.s) != EOF;
-      }
-    }
-  }
+  while ((v = sk_validation_status_t_pop(rc->validation_status)) != NULL)
+    validation_status_t_free(v);
+  rc->validation_status_root = NULL;
 
-  for (i = 0; ok && i < sk_rsync_history_t_num(rc->rsync_history); i++) {
-    rsync_history_t *h = sk_rsync_history_t_value(rc->rsync_history, i);
-    assert(h);
+  /*
+   * Previous entries for URIs we refetched this cycle are superseded,
+   * and ones we haven't refetched in a long time are dropped.
+   * We park the survivors on the current stack while we sort out which
+   * current entries are worth keeping, then move everything back.
+   */
 
-    if (ok)
-      ok &= fprintf(f, "  <rsync_history") != EOF;
-    if (ok && h->started)
-      ok &= fprintf(f, " started=\"%s\"",
-		    time_to_string(&ts, &h->started)) != EOF;
-    if (ok && h->finished)
-      ok &= fprintf(f, " finished=\"%s\"",
-		    time_to_string(&ts, &h->finished)) != EOF;
-    if (ok && h->status != rsync_status_done)
-      ok &= fprintf(f, " error=\"%u\"", (unsigned) h->status) != EOF;
-    if (ok)
-      ok &= fprintf(f, ">%s%s</rsync_history>\n",
-		    h->uri.s, (h->final_slash ? "/" : "")) != EOF;
+  while ((h = sk_rsync_history_t_pop(rc->previous_rsync_history)) != NULL) {
+    if (rsync_history_exact(rc, h) || rsync_history_stale(rc, h, now) ||
+	!sk_rsync_history_t_push(rc->rsync_history, h))
+      rsync_history_t_free(h);
+    else
+      h->next = NULL;
   }
 
-  if (ok)
-    ok &= fprintf(f, "</rcynic-summary>\n") != EOF;
-
-  if (f && !use_stdout)
-    ok &= fclose(f) != EOF;
+  rsync_history_index_clear(rc->rsync_history_index);
 
-  if (ok && !use_stdout)
-    ok &= rename(xmltemp.s, xmlfile) == 0;
+  while ((h = sk_rsync_history_t_pop(rc->rsync_history)) != NULL) {
+    if (h->status != rsync_status_done || !h->started) {
+      rsync_history_t_free(h);
+      continue;
+    }
+    sk_OPENSSL_STRING_pop_free(h->changes, OPENSSL_STRING_free);
+    h->changes = NULL;
+    if (!sk_rsync_history_t_push(rc->previous_rsync_history, h))
+      rsync_history_t_free(h);
+  }
 
-  if (!ok)
-    logmsg(rc, log_sys_err, "Couldn't write XML summary to %s: %s",
-	   (use_stdout ? "standard output" : xmlfile), strerror(errno));
+  sk_rsync_history_t_sort(rc->previous_rsync_history);
 
-  if (!ok && !use_stdout)
-    (void) unlink(xmltemp.s);
+  /*
+   * Per-host connection limits we learned from refusals, and whether
+   * we've already counted a failure, only apply to the run in which
+   * we learned them.
+   */
+  for (i = 0; (hh = sk_host_health_t_value(rc->host_health, i)) != NULL; i++) {
+    hh->limit = 0;
+    hh->failed = 0;
+  }
 
-  return ok;
+  rc->task_queue->ran = 0;
+  rc->task_queue->max_count = 0;
+  rc->task_queue->total_wait = 0.0;
+  rc->task_queue->max_wait = 0.0;
 }
 
-
-
 /**
  * Long options, with help.
  */
 #define OPTIONS								\
   QA('a', "authenticated",	"root of authenticated data tree")	\
   QA('c', "config",		"override default name of config file")	\
+  QA('d', "daemon-interval",	"run as daemon, validating this often")	\
   QF('h', "help",		"print this help message")		\
   QA('j', "jitter",		"set jitter value")			\
   QA('l', "log-level",		"set log level")			\
+  QA('n', "now",		"validate as of this time")		\
+  QF('r', "resume",		"resume interrupted run from journal")	\
   QA('u', "unauthenticated",	"root of unauthenticated data tree")	\
   QF('e', "use-stderr",		"log to syslog")			\
   QF('s', "use-syslog",		"log to stderr")			\
@@ -5621,12 +8819,13 @@ int main(int argc, char *argv[])
   int opt_jitter = 0, use_syslog = 0, use_stderr = 0, syslog_facility = 0;
   int opt_syslog = 0, opt_stderr = 0, opt_level = 0, prune = 1;
   int opt_auth = 0, opt_unauth = 0, keep_lockfile = 0;
+  int opt_daemon = 0, daemon_interval = 0, opt_resume = 0, resume = 0;
   char *lockfile = NULL, *xmlfile = NULL;
   char *cfg_file = "rcynic.conf";
   int c, i, ret = 1, jitter = 600, lockfd = -1;
   STACK_OF(CONF_VALUE) *cfg_section = NULL;
   CONF *cfg_handle = NULL;
-  time_t start = 0, finish;
+  time_t start = 0, next;
   rcynic_ctx_t rc;
   unsigned delay;
   long eline = 0;
@@ -5649,6 +8848,8 @@ int main(int argc, char *argv[])
 #undef QF
 
   memset(&rc, 0, sizeof(rc));
+  rc.sigchld_fds[0] = rc.sigchld_fds[1] = -1;
+  rc.fetch_table_lock = -1;
 
   if ((rc.jane = strrchr(argv[0], '/')) == NULL)
     rc.jane = argv[0];
@@ -5665,12 +8866,19 @@ int main(int argc, char *argv[])
   rc.allow_1024_bit_ee_key = 1;
   rc.allow_wrong_cms_si_attributes = 1;
   rc.max_parallel_fetches = 1;
+  rc.max_fetches_per_host = 2;
   rc.max_retries = 3;
   rc.retry_wait_min = 30;
   rc.run_rsync = 1;
   rc.rsync_timeout = 300;
   rc.max_select_time = 30;
   rc.rsync_early = 1;
+  rc.rsync_prefetch = 1;
+  rc.host_failure_threshold = 3;
+  rc.host_retry_interval = 3600;
+  rc.hash_batch_size = 64;
+  rc.key_cache_size = 1024;
+  rc.journal_max_age = 24 * 60 * 60;
 
 #define QQ(x,y)   rc.priority[x] = y;
   LOG_LEVELS;
@@ -5702,11 +8910,23 @@ int main(int argc, char *argv[])
     case 'c':
       cfg_file = optarg;
       break;
+    case 'd':
+      if (!configure_integer(&rc, &daemon_interval, optarg))
+	goto done;
+      opt_daemon = 1;
+      break;
+    case 'r':
+      resume = opt_resume = 1;
+      break;
     case 'l':
       opt_level = 1;
       if (!configure_logmsg(&rc, optarg))
 	goto done;
       break;
+    case 'n':
+      if (!configure_now(&rc, optarg))
+	goto done;
+      break;
     case 's':
       use_syslog = opt_syslog = 1;
       break;
@@ -5741,7 +8961,6 @@ int main(int argc, char *argv[])
   }
 
   if (!(asn1_zero          = s2i_ASN1_INTEGER(NULL, "0x0")) ||
-      !(asn1_four_octets   = s2i_ASN1_INTEGER(NULL, "0xFFFFFFFF")) ||
       !(asn1_twenty_octets = s2i_ASN1_INTEGER(NULL, "0x7FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF")) ||
       !(NID_binary_signing_time = OBJ_create("1.2.840.113549.1.9.16.2.46",
 					    "id-aa-binarySigningTime",
@@ -5800,6 +9019,10 @@ int main(int argc, char *argv[])
 	     !configure_integer(&rc, &rc.max_parallel_fetches, val->value))
       goto done;
 
+    else if (!name_cmp(val->name, "max-parallel-fetches-per-host") &&
+	     !configure_integer(&rc, &rc.max_fetches_per_host, val->value))
+      goto done;
+
     else if (!name_cmp(val->name, "max-select-time") &&
 	     !configure_unsigned_integer(&rc, &rc.max_select_time, val->value))
       goto done;
@@ -5814,6 +9037,11 @@ int main(int argc, char *argv[])
 	     !configure_boolean(&rc, &keep_lockfile, val->value))
       goto done;
 
+    else if (!opt_daemon &&
+	     !name_cmp(val->name, "daemon-interval") &&
+	     !configure_integer(&rc, &daemon_interval, val->value))
+      goto done;
+
     else if (!opt_jitter &&
 	     !name_cmp(val->name, "jitter") &&
 	     !configure_integer(&rc, &jitter, val->value))
@@ -5904,6 +9132,49 @@ int main(int argc, char *argv[])
 	     !configure_boolean(&rc, &rc.rsync_early, val->value))
       goto done;
 
+    else if (!name_cmp(val->name, "reuse-unchanged-objects") &&
+	     !configure_boolean(&rc, &rc.reuse_unchanged, val->value))
+      goto done;
+
+    else if (!name_cmp(val->name, "rsync-prefetch") &&
+	     !configure_boolean(&rc, &rc.rsync_prefetch, val->value))
+      goto done;
+
+    else if (!name_cmp(val->name, "hash-batch-size") &&
+	     !configure_integer(&rc, &rc.hash_batch_size, val->value))
+      goto done;
+
+    else if (!name_cmp(val->name, "issuer-key-cache-size") &&
+	     !configure_integer(&rc, &rc.key_cache_size, val->value))
+      goto done;
+
+    else if (!name_cmp(val->name, "host-database"))
+      rc.host_database = strdup(val->value);
+
+    else if (!name_cmp(val->name, "journal"))
+      rc.journal_file = strdup(val->value);
+
+    else if (!name_cmp(val->name, "journal-max-age") &&
+	     !configure_integer(&rc, &rc.journal_max_age, val->value))
+      goto done;
+
+    else if (!name_cmp(val->name, "trust-anchor-workers") &&
+	     !configure_integer(&rc, &rc.ta_workers, val->value))
+      goto done;
+
+    else if (!opt_resume &&
+	     !name_cmp(val->name, "resume") &&
+	     !configure_boolean(&rc, &resume, val->value))
+      goto done;
+
+    else if (!name_cmp(val->name, "host-failure-threshold") &&
+	     !configure_integer(&rc, &rc.host_failure_threshold, val->value))
+      goto done;
+
+    else if (!name_cmp(val->name, "host-retry-interval") &&
+	     !configure_integer(&rc, &rc.host_retry_interval, val->value))
+      goto done;
+
     /*
      * Ugly, but the easiest way to handle all these strings.
      */
@@ -5925,6 +9196,21 @@ int main(int argc, char *argv[])
     goto done;
   }
 
+  if ((rc.rsync_history_index = rsync_history_index_new(RSYNC_HISTORY_INDEX_INITIAL_SIZE)) == NULL) {
+    logmsg(&rc, log_sys_err, "Couldn't allocate rsync_history index");
+    goto done;
+  }
+
+  if ((rc.previous_rsync_history = sk_rsync_history_t_new(rsync_history_cmp)) == NULL) {
+    logmsg(&rc, log_sys_err, "Couldn't allocate previous rsync_history stack");
+    goto done;
+  }
+
+  if ((rc.host_health = sk_host_health_t_new(host_health_cmp)) == NULL) {
+    logmsg(&rc, log_sys_err, "Couldn't allocate host_health stack");
+    goto done;
+  }
+
   if ((rc.validation_status = sk_validation_status_t_new_null()) == NULL) {
     logmsg(&rc, log_sys_err, "Couldn't allocate validation_status stack");
     goto done;
@@ -5935,16 +9221,29 @@ int main(int argc, char *argv[])
     goto done;
   }
 
+  if ((rc.presigned_index = X509_get_ex_new_index(0, NULL, NULL, NULL, NULL)) < 0) {
+    logmsg(&rc, log_sys_err, "Couldn't allocate X509 ex_data index");
+    goto done;
+  }
+
+  if (rc.key_cache_size > 0 && (rc.key_cache = key_cache_new(rc.key_cache_size)) == NULL) {
+    logmsg(&rc, log_sys_err, "Couldn't allocate issuer key cache");
+    goto done;
+  }
+
   if ((rc.rsync_queue = sk_rsync_ctx_t_new_null()) == NULL) {
     logmsg(&rc, log_sys_err, "Couldn't allocate rsync_queue");
     goto done;
   }
 
-  if ((rc.task_queue = sk_task_t_new_null()) == NULL) {
+  if ((rc.task_queue = task_queue_new(TASK_QUEUE_INITIAL_SIZE)) == NULL) {
     logmsg(&rc, log_sys_err, "Couldn't allocate task_queue");
     goto done;
   }
 
+  if (!sigchld_setup(&rc))
+    goto done;
+
   rc.use_syslog = use_syslog;
 
   if (use_syslog)
@@ -5974,65 +9273,73 @@ int main(int argc, char *argv[])
     goto done;
   }
 
-  start = time(0);
-  logmsg(&rc, log_telemetry, "Starting");
-
-  if (!construct_directory_names(&rc))
-    goto done;
-
-  if (!access(rc.new_authenticated.s, F_OK)) {
-    logmsg(&rc, log_sys_err,
-	   "Timestamped output directory %s already exists!  Clock went backwards?",
-	   rc.new_authenticated.s);
-    goto done;
+  if (daemon_interval > 0) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = daemon_stop_handler;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGTERM, &sa, NULL) < 0 ||
+	sigaction(SIGINT,  &sa, NULL) < 0 ||
+	sigaction(SIGHUP,  &sa, NULL) < 0) {
+      logmsg(&rc, log_sys_err, "sigaction() failed: %s", strerror(errno));
+      goto done;
+    }
+    logmsg(&rc, log_telemetry, "Running as daemon, validating every %d seconds", daemon_interval);
   }
 
-  if (!mkdir_maybe(&rc, &rc.new_authenticated)) {
-    logmsg(&rc, log_sys_err, "Couldn't prepare directory %s: %s",
-	   rc.new_authenticated.s, strerror(errno));
+  if (!read_host_database(&rc))
     goto done;
-  }
 
-  for (i = 0; i < sk_CONF_VALUE_num(cfg_section); i++) {
-    CONF_VALUE *val = sk_CONF_VALUE_value(cfg_section, i);
+  /*
+   * In daemon mode we loop here, keeping everything we set up above
+   * resident between cycles.  A cycle which fails ends the daemon
+   * the same way it would end a one-shot run, since we can't trust
+   * what it left behind.  A stop signal lets the current cycle
+   * finish first.
+   */
 
-    assert(val && val->name && val->value);
+  if (rc.hash_batch_size > 0)
+    logmsg(&rc, log_verbose, "Batch hashing up to %d objects at a time using %s SHA-256",
+	   rc.hash_batch_size, sha256_mb_implementation());
 
-    if (!name_cmp(val->name, "trust-anchor-uri-with-key") ||
-	!name_cmp(val->name, "indirect-trust-anchor")) {
-      logmsg(&rc, log_usage_err,
-	     "Directive \"%s\" is obsolete -- please use \"trust-anchor-locator\" instead",
-	     val->name);
-      goto done;
-    }
+  for (;;) {
+    start = time(0);
+    logmsg(&rc, log_telemetry, "Starting");
 
-    if ((!name_cmp(val->name, "trust-anchor")         && !check_ta_cer(&rc, val->value)) ||
-	(!name_cmp(val->name, "trust-anchor-locator") && !check_ta_tal(&rc, val->value)))
+    if (!run_cycle(&rc, cfg_section, &ta_dir, prune, resume, xmlfile))
       goto done;
-  }
 
-  if (*ta_dir.s != '\0' && !check_ta_dir(&rc, ta_dir.s))
-    goto done;
+    resume = 0;
 
-  while (sk_task_t_num(rc.task_queue) > 0 || sk_rsync_ctx_t_num(rc.rsync_queue) > 0) {
-    task_run_q(&rc);
-    rsync_mgr(&rc);
-  }
+    log_openssl_errors(&rc);
 
-  logmsg(&rc, log_telemetry, "Event loop done, beginning final output and cleanup");
+    if (daemon_interval <= 0 || daemon_stop)
+      break;
 
-  if (!finalize_directories(&rc))
-    goto done;
+    log_elapsed_time(&rc, "Cycle finished", start);
 
-  if (prune && rc.run_rsync &&
-      !prune_unauthenticated(&rc, &rc.unauthenticated,
-			     strlen(rc.unauthenticated.s))) {
-    logmsg(&rc, log_sys_err, "Trouble pruning old unauthenticated data");
-    goto done;
+    /*
+     * Schedule from when this cycle started, before we forget that.
+     */
+    if ((next = start + daemon_interval) <= time(0))
+      next = time(0) + 1;
+
+    start = 0;
+
+    cycle_reset(&rc);
+
+    logmsg(&rc, log_telemetry, "Sleeping %u seconds until next cycle",
+	   (unsigned) (next - time(0)));
+
+    while (!daemon_stop && time(0) < next)
+      (void) sleep(next - time(0));
+
+    if (daemon_stop)
+      break;
   }
 
-  if (!write_xml_file(&rc, xmlfile))
-    goto done;
+  if (daemon_stop)
+    logmsg(&rc, log_telemetry, "Caught signal, exiting");
 
   ret = 0;
 
@@ -6043,15 +9350,26 @@ int main(int argc, char *argv[])
    * Do NOT free cfg_section, NCONF_free() takes care of that
    */
   sk_validation_status_t_pop_free(rc.validation_status, validation_status_t_free);
+  rsync_history_index_free(rc.rsync_history_index);
   sk_rsync_history_t_pop_free(rc.rsync_history, rsync_history_t_free);
+  sk_rsync_history_t_pop_free(rc.previous_rsync_history, rsync_history_t_free);
+  sk_host_health_t_pop_free(rc.host_health, host_health_t_free);
+  task_queue_free(rc.task_queue);
+  sigchld_cleanup(&rc);
+  journal_close(&rc, 0);
   validation_status_t_free(rc.validation_status_in_waiting);
   X509_STORE_free(rc.x509_store);
+  key_cache_free(rc.key_cache);
   NCONF_free(cfg_handle);
   CONF_modules_free();
   EVP_cleanup();
   ERR_free_strings();
   if (rc.rsync_program)
     free(rc.rsync_program);
+  if (rc.host_database)
+    free(rc.host_database);
+  if (rc.journal_file)
+    free(rc.journal_file);
   if (lockfile && lockfd >= 0 && !keep_lockfile)
     unlink(lockfile);
   if (lockfile)
@@ -6059,14 +9377,8 @@ int main(int argc, char *argv[])
   if (xmlfile)
     free(xmlfile);
 
-  if (start) {
-    finish = time(0);
-    logmsg(&rc, log_telemetry,
-	   "Finished, elapsed time %u:%02u:%02u",
-	   (unsigned) ((finish - start) / 3600),
-	   (unsigned) ((finish - start) / 60 % 60),
-	   (unsigned) ((finish - start) % 60));
-  }
+  if (start)
+    log_elapsed_time(&rc, "Finished", start);
 
   return ret;
 }
@@ -0,0 +1,380 @@
+/*
+ * Copyright (C) 2013-2014  Dragon Research Labs ("DRL")
+ * Portions copyright (C) 2009-2012  Internet Systems Consortium ("ISC")
+ * Portions copyright (C) 2006-2008  American Registry for Internet Numbers ("ARIN")
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notices and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND DRL, ISC, AND ARIN DISCLAIM ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS.  IN NO EVENT SHALL DRL,
+ * ISC, OR ARIN BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION
+ * WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* $Id$ */
+
+/** @file sha256_mb.c
+ *
+ * Batch SHA-256: hash many independent messages in one call.
+ *
+ * Almost everything rcynic hashes is a small file listed on a
+ * manifest, so per-message overhead and the serial dependency chain
+ * inside SHA-256 dominate.  On x86-64 CPUs with AVX2 we run eight
+ * messages side by side, one per 32-bit lane, which hides that
+ * dependency chain.  CPUs with the SHA extensions are better served
+ * by OpenSSL's one-message-at-a-time code, which already uses those
+ * instructions, as is anything that isn't x86-64.  The choice is made
+ * once, at runtime, on the first call.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <openssl/sha.h>
+
+#include "sha256_mb.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define	SHA256_MB_HAVE_AVX2	1
+#include <immintrin.h>
+#include <cpuid.h>
+#endif
+
+/**
+ * Below this many messages, the multi-buffer setup isn't worth it.
+ */
+#define	SHA256_MB_MIN_BATCH	4
+
+typedef enum {
+  sha256_mb_impl_unknown,
+  sha256_mb_impl_openssl,
+  sha256_mb_impl_openssl_shani,
+  sha256_mb_impl_avx2
+} sha256_mb_impl_t;
+
+static sha256_mb_impl_t sha256_mb_impl = sha256_mb_impl_unknown;
+
+/**
+ * One message at a time, via OpenSSL.
+ */
+static void sha256_mb_openssl(const unsigned char * const *data,
+			      const size_t *len,
+			      unsigned char * const *digest,
+			      const size_t n)
+{
+  size_t i;
+
+  for (i = 0; i < n; i++)
+    (void) SHA256(data[i], len[i], digest[i]);
+}
+
+#ifdef SHA256_MB_HAVE_AVX2
+
+static const uint32_t sha256_k[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t sha256_iv[8] = {
+  0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+#define	SHA256_MB_LANES		8
+#define	SHA256_MB_BLOCK		64
+
+/**
+ * State of one lane: where its message is, and the padded final
+ * block(s), which we build up front so the kernel never has to care
+ * about message boundaries.
+ */
+typedef struct {
+  const unsigned char *data;
+  size_t full_blocks;
+  unsigned tail_blocks, tail_next;
+  unsigned char tail[2 * SHA256_MB_BLOCK];
+  size_t job;
+  int active;
+} sha256_mb_lane_t;
+
+#define	ROTR(x, n)	_mm256_or_si256(_mm256_srli_epi32((x), (n)), _mm256_slli_epi32((x), 32 - (n)))
+#define	SHR(x, n)	_mm256_srli_epi32((x), (n))
+#define	XOR3(a, b, c)	_mm256_xor_si256(_mm256_xor_si256((a), (b)), (c))
+#define	ADD(a, b)	_mm256_add_epi32((a), (b))
+
+#define	BSIG0(x)	XOR3(ROTR(x,  2), ROTR(x, 13), ROTR(x, 22))
+#define	BSIG1(x)	XOR3(ROTR(x,  6), ROTR(x, 11), ROTR(x, 25))
+#define	SSIG0(x)	XOR3(ROTR(x,  7), ROTR(x, 18), SHR(x,  3))
+#define	SSIG1(x)	XOR3(ROTR(x, 17), ROTR(x, 19), SHR(x, 10))
+#define	CH(e, f, g)	_mm256_xor_si256(_mm256_and_si256((e), (f)), _mm256_andnot_si256((e), (g)))
+#define	MAJ(a, b, c)	XOR3(_mm256_and_si256((a), (b)), _mm256_and_si256((a), (c)), _mm256_and_si256((b), (c)))
+
+/**
+ * Load eight big-endian words from each of eight blocks and transpose
+ * them so that w[i] holds word i of every lane.
+ */
+__attribute__((target("avx2")))
+static void sha256_mb_avx2_load(__m256i *w, const unsigned char * const *blocks, const size_t offset)
+{
+  const __m256i bswap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+					 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+  __m256i r[8], t[8], u[8];
+  int i;
+
+  for (i = 0; i < 8; i++)
+    r[i] = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *) (blocks[i] + offset)), bswap);
+
+  for (i = 0; i < 8; i += 2) {
+    t[i]     = _mm256_unpacklo_epi32(r[i], r[i + 1]);
+    t[i + 1] = _mm256_unpackhi_epi32(r[i], r[i + 1]);
+  }
+
+  for (i = 0; i < 8; i += 4) {
+    u[i]     = _mm256_unpacklo_epi64(t[i],     t[i + 2]);
+    u[i + 1] = _mm256_unpackhi_epi64(t[i],     t[i + 2]);
+    u[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+    u[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+  }
+
+  for (i = 0; i < 4; i++) {
+    w[i]     = _mm256_permute2x128_si256(u[i], u[i + 4], 0x20);
+    w[i + 4] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x31);
+  }
+}
+
+/**
+ * Run the compression function over one block in each of eight lanes.
+ * state[i] holds word i of every lane's chaining value.
+ */
+__attribute__((target("avx2")))
+static void sha256_mb_avx2_block(uint32_t state[8][SHA256_MB_LANES],
+				 const unsigned char * const *blocks)
+{
+  __m256i w[16], a, b, c, d, e, f, g, h, t1, t2;
+  int i;
+
+  sha256_mb_avx2_load(w,     blocks, 0);
+  sha256_mb_avx2_load(w + 8, blocks, 32);
+
+  a = _mm256_loadu_si256((const __m256i *) state[0]);
+  b = _mm256_loadu_si256((const __m256i *) state[1]);
+  c = _mm256_loadu_si256((const __m256i *) state[2]);
+  d = _mm256_loadu_si256((const __m256i *) state[3]);
+  e = _mm256_loadu_si256((const __m256i *) state[4]);
+  f = _mm256_loadu_si256((const __m256i *) state[5]);
+  g = _mm256_loadu_si256((const __m256i *) state[6]);
+  h = _mm256_loadu_si256((const __m256i *) state[7]);
+
+  for (i = 0; i < 64; i++) {
+    if (i >= 16)
+      w[i & 15] = ADD(ADD(SSIG1(w[(i - 2) & 15]), w[(i - 7) & 15]),
+		      ADD(SSIG0(w[(i - 15) & 15]), w[i & 15]));
+    t1 = ADD(ADD(h, BSIG1(e)), ADD(CH(e, f, g), ADD(_mm256_set1_epi32((int) sha256_k[i]), w[i & 15])));
+    t2 = ADD(BSIG0(a), MAJ(a, b, c));
+    h = g;
+    g = f;
+    f = e;
+    e = ADD(d, t1);
+    d = c;
+    c = b;
+    b = a;
+    a = ADD(t1, t2);
+  }
+
+#define	SHA256_MB_STORE(i, x)						\
+  _mm256_storeu_si256((__m256i *) state[i],				\
+		      ADD(_mm256_loadu_si256((const __m256i *) state[i]), (x)))
+
+  SHA256_MB_STORE(0, a);
+  SHA256_MB_STORE(1, b);
+  SHA256_MB_STORE(2, c);
+  SHA256_MB_STORE(3, d);
+  SHA256_MB_STORE(4, e);
+  SHA256_MB_STORE(5, f);
+  SHA256_MB_STORE(6, g);
+  SHA256_MB_STORE(7, h);
+
+#undef	SHA256_MB_STORE
+}
+
+/**
+ * Start a new message in a lane.
+ */
+static void sha256_mb_lane_start(sha256_mb_lane_t *lane,
+				 uint32_t state[8][SHA256_MB_LANES],
+				 const unsigned l,
+				 const unsigned char *data,
+				 const size_t len,
+				 const size_t job)
+{
+  const size_t rest = len % SHA256_MB_BLOCK;
+  const uint64_t bits = (uint64_t) len * 8;
+  unsigned i;
+
+  lane->data = data;
+  lane->full_blocks = len / SHA256_MB_BLOCK;
+  lane->tail_blocks = rest + 9 <= SHA256_MB_BLOCK ? 1 : 2;
+  lane->tail_next = 0;
+  lane->job = job;
+  lane->active = 1;
+
+  memset(lane->tail, 0, sizeof(lane->tail));
+  if (rest > 0)
+    memcpy(lane->tail, data + len - rest, rest);
+  lane->tail[rest] = 0x80;
+  for (i = 0; i < 8; i++)
+    lane->tail[lane->tail_blocks * SHA256_MB_BLOCK - 1 - i] = (unsigned char) (bits >> (i * 8));
+
+  for (i = 0; i < 8; i++)
+    state[i][l] = sha256_iv[i];
+}
+
+/**
+ * Eight messages at a time, via AVX2.  Lanes are refilled as soon as
+ * their message finishes, so messages of different lengths don't
+ * leave lanes idle for long.
+ */
+static void sha256_mb_avx2(const unsigned char * const *data,
+			   const size_t *len,
+			   unsigned char * const *digest,
+			   const size_t n)
+{
+  static const unsigned char idle_block[SHA256_MB_BLOCK];
+  uint32_t state[8][SHA256_MB_LANES];
+  sha256_mb_lane_t lanes[SHA256_MB_LANES];
+  const unsigned char *blocks[SHA256_MB_LANES];
+  size_t next = 0;
+  unsigned l, i, active;
+
+  memset(lanes, 0, sizeof(lanes));
+
+  for (;;) {
+    for (l = 0, active = 0; l < SHA256_MB_LANES; l++) {
+      sha256_mb_lane_t *lane = &lanes[l];
+
+      if (!lane->active && next < n) {
+	sha256_mb_lane_start(lane, state, l, data[next], len[next], next);
+	next++;
+      }
+
+      if (!lane->active) {
+	blocks[l] = idle_block;
+	continue;
+      }
+
+      active++;
+
+      if (lane->full_blocks > 0)
+	blocks[l] = lane->data;
+      else
+	blocks[l] = lane->tail + lane->tail_next * SHA256_MB_BLOCK;
+    }
+
+    if (active == 0)
+      return;
+
+    sha256_mb_avx2_block(state, blocks);
+
+    for (l = 0; l < SHA256_MB_LANES; l++) {
+      sha256_mb_lane_t *lane = &lanes[l];
+
+      if (!lane->active)
+	continue;
+
+      if (lane->full_blocks > 0) {
+	lane->full_blocks--;
+	lane->data += SHA256_MB_BLOCK;
+	continue;
+      }
+
+      if (++lane->tail_next < lane->tail_blocks)
+	continue;
+
+      for (i = 0; i < 8; i++) {
+	digest[lane->job][i * 4 + 0] = (unsigned char) (state[i][l] >> 24);
+	digest[lane->job][i * 4 + 1] = (unsigned char) (state[i][l] >> 16);
+	digest[lane->job][i * 4 + 2] = (unsigned char) (state[i][l] >>  8);
+	digest[lane->job][i * 4 + 3] = (unsigned char) (state[i][l]);
+      }
+      lane->active = 0;
+    }
+  }
+}
+
+/**
+ * Does this CPU have the SHA extensions?  Leaf 7, EBX bit 29.
+ */
+static int sha256_mb_cpu_has_sha(void)
+{
+  unsigned eax, ebx, ecx, edx;
+
+  if (__get_cpuid_max(0, NULL) < 7)
+    return 0;
+  __cpuid_count(7, 0, eax, ebx, ecx, edx);
+  return (ebx & (1U << 29)) != 0;
+}
+
+#endif /* SHA256_MB_HAVE_AVX2 */
+
+/**
+ * Pick an implementation, once.
+ */
+static sha256_mb_impl_t sha256_mb_select(void)
+{
+  if (sha256_mb_impl != sha256_mb_impl_unknown)
+    return sha256_mb_impl;
+
+  sha256_mb_impl = sha256_mb_impl_openssl;
+
+#ifdef SHA256_MB_HAVE_AVX2
+  __builtin_cpu_init();
+  if (sha256_mb_cpu_has_sha())
+    sha256_mb_impl = sha256_mb_impl_openssl_shani;
+  else if (__builtin_cpu_supports("avx2"))
+    sha256_mb_impl = sha256_mb_impl_avx2;
+#endif
+
+  return sha256_mb_impl;
+}
+
+/**
+ * Name of the implementation we're using, for logging.
+ */
+const char *sha256_mb_implementation(void)
+{
+  switch (sha256_mb_select()) {
+  case sha256_mb_impl_avx2:		return "AVX2 8-way";
+  case sha256_mb_impl_openssl_shani:	return "OpenSSL (SHA extensions)";
+  default:				return "OpenSSL";
+  }
+}
+
+/**
+ * Compute SHA-256 digests of n messages.  digest[i] must have room
+ * for SHA256_MB_DIGEST_LEN octets.
+ */
+void sha256_mb(const unsigned char * const *data,
+	       const size_t *len,
+	       unsigned char * const *digest,
+	       const size_t n)
+{
+#ifdef SHA256_MB_HAVE_AVX2
+  if (n >= SHA256_MB_MIN_BATCH && sha256_mb_select() == sha256_mb_impl_avx2) {
+    sha256_mb_avx2(data, len, digest, n);
+    return;
+  }
+#endif
+
+  sha256_mb_openssl(data, len, digest, n);
+}
@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2013-2014  Dragon Research Labs ("DRL")
+ * Portions copyright (C) 2009-2012  Internet Systems Consortium ("ISC")
+ * Portions copyright (C) 2006-2008  American Registry for Internet Numbers ("ARIN")
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notices and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND DRL, ISC, AND ARIN DISCLAIM ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS.  IN NO EVENT SHALL DRL,
+ * ISC, OR ARIN BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION
+ * WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* $Id$ */
+
+#ifndef __SHA256_MB__
+#define __SHA256_MB__
+
+#include <stddef.h>
+
+#define	SHA256_MB_DIGEST_LEN	32
+
+void sha256_mb(const unsigned char * const *data,
+	       const size_t *len,
+	       unsigned char * const *digest,
+	       const size_t n);
+
+const char *sha256_mb_implementation(void);
+
+#endif /* __SHA256_MB__ */
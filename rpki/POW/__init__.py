@@ -212,3 +212,51 @@ validation_status = StatusCodeDB(
         VALIDATION_OK                        = "OK"),
 
     verification_errors = _POW.getVerificationErrors())
+
+
+# Tornado glue for SigningPool.  Tornado is imported lazily so that
+# programs which don't use this don't need it.
+
+class AsyncSigningPool(object):
+    """
+    Wrap a SigningPool so that each submission method returns a
+    Tornado Future, suitable for yielding from a coroutine.  Results
+    are collected whenever the pool's descriptor becomes readable.
+    """
+
+    def __init__(self, threads = 0, ioloop = None):
+        import tornado.ioloop
+        import tornado.concurrent
+        self._future = tornado.concurrent.Future
+        self.pool = SigningPool(threads = threads)
+        self.ioloop = ioloop or tornado.ioloop.IOLoop.current()
+        self.futures = {}
+        self.ioloop.add_handler(self.pool.fileno(), self._collect, self.ioloop.READ)
+
+    def _submit(self, handle):
+        future = self._future()
+        self.futures[handle] = future
+        return future
+
+    def _collect(self, fd, events):
+        for handle, result, error in self.pool.completed():
+            future = self.futures.pop(handle)
+            if error is None:
+                future.set_result(result)
+            else:
+                future.set_exception(error)
+
+    def generateRSA(self, key_size = 2048):
+        return self._submit(self.pool.generateRSA(key_size = key_size))
+
+    def signX509(self, cert, key, digest = SHA256_DIGEST):
+        return self._submit(self.pool.signX509(cert, key, digest))
+
+    def signCRL(self, crl, key, digest = SHA256_DIGEST):
+        return self._submit(self.pool.signCRL(crl, key, digest))
+
+    def signCMS(self, cms, signcert, key, **kwargs):
+        return self._submit(self.pool.signCMS(cms, signcert, key, **kwargs))
+
+    def close(self):
+        self.ioloop.remove_handler(self.pool.fileno())
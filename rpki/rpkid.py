@@ -25,6 +25,7 @@ RPKI CA engine.
 import os
 import time
 import random
+import signal
 import logging
 import weakref
 import argparse
@@ -45,6 +46,7 @@ import rpki.resource_set
 import rpki.up_down
 import rpki.left_right
 import rpki.x509
+import rpki.POW
 import rpki.config
 import rpki.exceptions
 import rpki.relaxng
@@ -154,6 +156,33 @@ class main(object):
 
         self.cron_period = self.cfg.getint("cron-period", 1800)
 
+        self.rsa_key_pool = None
+        self.rsa_key_pool_file = self.cfg.get("rsa-key-pool-file", "")
+        self.rsa_key_pool_passphrase = self.cfg.get("rsa-key-pool-passphrase", "")
+
+        rsa_key_pool_size = self.cfg.getint("rsa-key-pool-size", 0)
+
+        if rsa_key_pool_size > 0:
+            self.rsa_key_pool = rpki.POW.RSAKeyPool(
+                size = rsa_key_pool_size,
+                threads = self.cfg.getint("rsa-key-pool-threads", 1))
+            if self.rsa_key_pool_file and self.rsa_key_pool_passphrase and os.path.exists(self.rsa_key_pool_file):
+                try:
+                    logger.debug("Loaded %d RSA keys from %s",
+                                 self.rsa_key_pool.load(self.rsa_key_pool_file, self.rsa_key_pool_passphrase),
+                                 self.rsa_key_pool_file)
+                except:
+                    logger.exception("Couldn't load RSA keys from %s, generating new ones instead",
+                                     self.rsa_key_pool_file)
+            rpki.POW.setRSAKeyPool(self.rsa_key_pool)
+            signal.signal(signal.SIGTERM, self.sigterm_handler)
+
+        self.signing_pool = None
+
+        if self.cfg.getboolean("use-signing-pool", True):
+            self.signing_pool = rpki.POW.AsyncSigningPool(
+                threads = self.cfg.getint("signing-pool-threads", 0))
+
         if self.use_internal_cron:
             logger.debug("Scheduling initial cron pass in %s seconds", self.initial_delay)
             tornado.ioloop.IOLoop.current().spawn_callback(self.cron_loop)
@@ -189,6 +218,20 @@ class main(object):
 
         tornado.ioloop.IOLoop.current().start()
 
+        if self.rsa_key_pool is not None and self.rsa_key_pool_file and self.rsa_key_pool_passphrase:
+            logger.debug("Saved %d RSA keys to %s",
+                         self.rsa_key_pool.save(self.rsa_key_pool_file, self.rsa_key_pool_passphrase),
+                         self.rsa_key_pool_file)
+
+    def sigterm_handler(self, signum, frame):
+        """
+        Stop the event loop cleanly on SIGTERM, so that main() gets a
+        chance to save pre-generated keys before we exit.
+        """
+
+        ioloop = tornado.ioloop.IOLoop.current()
+        ioloop.add_callback_from_signal(ioloop.stop)
+
     def task_add(self, *tasks):
         """
         Add tasks to the task queue.
@@ -34,6 +34,7 @@ import tornado.httpclient
 import tornado.httpserver
 
 import rpki.log
+import rpki.x509
 import rpki.rpkid
 import rpki.up_down
 import rpki.sundial
@@ -338,6 +339,7 @@ class UpdateChildrenTask(AbstractTask):
                     publisher.queue(uri = child_cert.uri,
                                     old_obj = child_cert.cert,
                                     repository = ca_detail.ca.parent.repository)
+                    ca_detail.manifest_remove(child_cert.uri_tail)
                     ca_detail.generate_crl_and_manifest(publisher = publisher)
 
             except:
@@ -389,6 +391,7 @@ class UpdateROAsTask(AbstractTask):
         creates = []
         updates = []
         publisher = rpki.rpkid.publication_queue(self.rpkid)
+        signer = rpki.x509.SigningQueue(self.rpkid.signing_pool)
         ca_details = set()
 
         for roa in self.tenant.roas.all():
@@ -430,7 +433,7 @@ class UpdateROAsTask(AbstractTask):
                 break
             roa = roas.pop(0)
             try:
-                roa.update(publisher = publisher)
+                roa.update(publisher = publisher, signer = signer)
                 ca_details.add(roa.ca_detail.pk)
             except rpki.exceptions.NoCoveringCertForROA:
                 logger.warning("%r: No covering certificate for %r, skipping", self, roa)
@@ -445,10 +448,16 @@ class UpdateROAsTask(AbstractTask):
                 except:
                     logger.exception("%r: Could not revoke %r", self, roa)
 
+        # New ROAs are only saved and queued for publication once signed,
+        # and the manifests need them, so drain the signing queue first.
+
+        yield signer.run()
+
         if not publisher.empty():
             for ca_detail in rpki.rpkidb.models.CADetail.objects.filter(pk__in = ca_details):
                 logger.debug("%r: Generating new CRL and manifest for %r", self, ca_detail)
-                ca_detail.generate_crl_and_manifest(publisher = publisher)
+                ca_detail.generate_crl_and_manifest(publisher = publisher, signer = signer)
+            yield signer.run()
             yield publisher.call_pubd()
 
         if postponing:
@@ -601,6 +610,7 @@ class UpdateEECertificatesTask(AbstractTask):
                         new_obj    = cert,
                         repository = ca_detail.ca.parent.repository,
                         handler    = ee.published_callback)
+                    ca_detail.manifest_add(ee.uri_tail, cert)
 
             # Anything left is an orphan
             for ees in existing.values():
@@ -636,6 +646,7 @@ class RegenerateCRLsAndManifestsTask(AbstractTask):
 
         try:
             publisher = rpki.rpkid.publication_queue(self.rpkid)
+            signer = rpki.x509.SigningQueue(self.rpkid.signing_pool)
             now = rpki.sundial.now()
 
             ca_details = rpki.rpkidb.models.CADetail.objects.filter(ca__parent__tenant = self.tenant,
@@ -649,8 +660,9 @@ class RegenerateCRLsAndManifestsTask(AbstractTask):
                                                next_crl_manifest_update__lt = now + max(
                                                    rpki.sundial.timedelta(seconds = self.tenant.crl_interval) / 4,
                                                    rpki.sundial.timedelta(seconds = self.rpkid.cron_period  ) * 2)):
-                ca_detail.generate_crl_and_manifest(publisher = publisher)
+                ca_detail.generate_crl_and_manifest(publisher = publisher, signer = signer)
 
+            yield signer.run()
             yield publisher.call_pubd()
 
         except:
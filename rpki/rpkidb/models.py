@@ -30,6 +30,7 @@ import tornado.httpserver
 
 from django.db import models
 
+import rpki.POW
 import rpki.left_right
 import rpki.sundial
 
@@ -42,6 +43,14 @@ from lxml.etree import Element, SubElement, tostring as ElementToString
 
 logger = logging.getLogger(__name__)
 
+# Incremental manifest builders, indexed by CADetail primary key.  These
+# live as long as this rpkid process does, so that each regeneration
+# of a manifest only re-encodes the entries which actually changed.
+# CADetail.manifest_add() and .manifest_remove() keep them current as
+# objects are published and withdrawn; CADetail.destroy() drops them.
+
+manifest_builders = {}
+
 # pylint: disable=W5101
 
 
@@ -1275,6 +1284,7 @@ class CADetail(models.Model):
             logger.debug("Deleting %r", cert)
             cert.delete()
         logger.debug("Deleting %r", self)
+        manifest_builders.pop(self.pk, None)
         self.delete()
 
 
@@ -1380,12 +1390,15 @@ class CADetail(models.Model):
             logger.debug("Created new child_cert %r", child_cert)
         else:
             old_cert = child_cert.cert
+            if child_cert.ca_detail != self:
+                child_cert.ca_detail.manifest_remove(child_cert.uri_tail)
             child_cert.cert = cert
             child_cert.ca_detail = self
             logger.debug("Reusing existing child_cert %r", child_cert)
         child_cert.gski = cert.gSKI()
         child_cert.published = rpki.sundial.now()
         child_cert.save()
+        self.manifest_add(child_cert.uri_tail, child_cert.cert)
         publisher.queue(
             uri        = child_cert.uri,
             old_obj    = old_cert,
@@ -1396,7 +1409,7 @@ class CADetail(models.Model):
         return child_cert
 
 
-    def generate_crl_and_manifest(self, publisher, nextUpdate = None):
+    def generate_crl_and_manifest(self, publisher, nextUpdate = None, signer = None):
         """
         Generate a new CRL and a new manifest for this ca_detail.
 
@@ -1405,6 +1418,10 @@ class CADetail(models.Model):
 
         We used to handle CRL and manifest as two separate operations,
         but there's no real point, and it's simpler to do them at once.
+
+        If a rpki.x509.SigningQueue is supplied, signing is left to the
+        queue, and nothing is saved or published until the caller runs
+        the queue.
         """
 
         trace_call_chain()
@@ -1438,33 +1455,115 @@ class CADetail(models.Model):
                 certlist.append((revoked_cert.serial, revoked_cert.revoked))
         certlist.sort()
 
-        self.latest_crl = rpki.x509.CRL.generate(
+        if signer is None:
+            signer = rpki.x509.SigningQueue()
+
+        def crl_signed(crl):
+            self.latest_crl = crl
+            self._generate_manifest(publisher, now, nextUpdate, crl_manifest_number, manifest_cert,
+                                    old_crl, old_manifest, crl_uri, manifest_uri, signer)
+
+        rpki.x509.CRL.generate(
             keypair             = self.private_key_id,
             issuer              = self.latest_ca_cert,
             serial              = crl_manifest_number,
             thisUpdate          = now,
             nextUpdate          = nextUpdate,
-            revokedCertificates = certlist)
+            revokedCertificates = certlist,
+            signer              = signer,
+            callback            = crl_signed)
 
-        # XXX
-        logger.debug("%r Generating manifest, child_certs_all(): %r", self, self.child_certs.all())
 
-        objs = [(self.crl_uri_tail, self.latest_crl)]
-        objs.extend((c.uri_tail, c.cert)        for c in self.child_certs.all())
-        objs.extend((r.uri_tail, r.roa)         for r in self.roas.filter(roa__isnull = False))
-        objs.extend((g.uri_tail, g.ghostbuster) for g in self.ghostbusters.all())
-        objs.extend((e.uri_tail, e.cert)        for e in self.ee_certificates.all())
+    def _generate_manifest(self, publisher, now, nextUpdate, crl_manifest_number, manifest_cert,
+                           old_crl, old_manifest, crl_uri, manifest_uri, signer):
+        """
+        Second half of generate_crl_and_manifest(), run once the new CRL
+        has been signed, since the manifest lists the CRL's hash.
+        """
 
-        # XXX
-        logger.debug("%r Generating manifest, objs: %r", self, objs)
+        trace_call_chain()
 
-        self.latest_manifest = rpki.x509.SignedManifest.build(
+        try:
+            builder = manifest_builders[self.pk]
+        except KeyError:
+            builder = manifest_builders[self.pk] = self._load_manifest_builder()
+
+        builder.addObject(self.crl_uri_tail, self.latest_crl.get_DER())
+
+        def manifest_signed(manifest):
+            self.latest_manifest = manifest
+            self._publish_crl_and_manifest(publisher, now, nextUpdate,
+                                           old_crl, old_manifest, crl_uri, manifest_uri)
+
+        rpki.x509.SignedManifest.build(
             serial         = crl_manifest_number,
             thisUpdate     = now,
             nextUpdate     = nextUpdate,
-            names_and_objs = objs,
+            names_and_objs = None,
             keypair        = self.manifest_private_key_id,
-            certs          = manifest_cert)
+            certs          = manifest_cert,
+            builder        = builder,
+            signer         = signer,
+            callback       = manifest_signed)
+
+
+    def _load_manifest_builder(self):
+        """
+        Create a manifest builder for this ca_detail and load it with
+        everything we currently publish.  This happens the first time
+        this rpkid process generates a manifest for this ca_detail; after
+        that, manifest_add() and manifest_remove() keep it current.
+        """
+
+        trace_call_chain()
+
+        builder = rpki.POW.ManifestBuilder()
+
+        # XXX
+        logger.debug("%r Loading manifest builder, child_certs_all(): %r", self, self.child_certs.all())
+
+        for c in self.child_certs.all():
+            builder.addObject(c.uri_tail, c.cert.get_DER())
+        for r in self.roas.filter(roa__isnull = False):
+            builder.addObject(r.uri_tail, r.roa.get_DER())
+        for g in self.ghostbusters.all():
+            builder.addObject(g.uri_tail, g.ghostbuster.get_DER())
+        for e in self.ee_certificates.all():
+            builder.addObject(e.uri_tail, e.cert.get_DER())
+
+        return builder
+
+
+    def manifest_add(self, uri_tail, obj):
+        """
+        Record a newly published or replaced object in this ca_detail's
+        manifest builder, if it has one yet.
+        """
+
+        builder = manifest_builders.get(self.pk)
+        if builder is not None:
+            builder.addObject(uri_tail, obj.get_DER())
+
+
+    def manifest_remove(self, uri_tail):
+        """
+        Drop a withdrawn object from this ca_detail's manifest builder,
+        if it has one yet.
+        """
+
+        builder = manifest_builders.get(self.pk)
+        if builder is not None:
+            builder.remove(uri_tail)
+
+
+    def _publish_crl_and_manifest(self, publisher, now, nextUpdate,
+                                  old_crl, old_manifest, crl_uri, manifest_uri):
+        """
+        Last step of generate_crl_and_manifest(): save and publish the
+        signed CRL and manifest.
+        """
+
+        trace_call_chain()
 
         self.crl_published      = now
         self.manifest_published = now
@@ -1861,6 +1960,7 @@ class ChildCert(models.Model):
         logger.debug("Revoking %r", self)
         RevokedCert.revoke(cert = self.cert, ca_detail = ca_detail)
         publisher.queue(uri = self.uri, old_obj = self.cert, repository = ca_detail.ca.parent.repository)
+        ca_detail.manifest_remove(self.uri_tail)
         self.delete()
 
 
@@ -1989,6 +2089,7 @@ class EECertificate(models.Model):
         logger.debug("Revoking %r", self)
         RevokedCert.revoke(cert = self.cert, ca_detail = ca_detail)
         publisher.queue(uri = self.uri, old_obj = self.cert, repository = ca_detail.ca.parent.repository)
+        ca_detail.manifest_remove(self.uri_tail)
         self.delete()
 
 
@@ -2046,6 +2147,9 @@ class EECertificate(models.Model):
             cn          = cn,
             sn          = sn)
         self.save()
+        if ca_detail != old_ca_detail:
+            old_ca_detail.manifest_remove(self.uri_tail)
+        ca_detail.manifest_add(self.uri_tail, self.cert)
         publisher.queue(
             uri        = self.uri,
             old_obj    = old_cert,
@@ -2133,6 +2237,7 @@ class Ghostbuster(models.Model):
         self.ghostbuster = rpki.x509.Ghostbuster.build(self.vcard, keypair, (self.cert,))
         self.published = rpki.sundial.now()
         self.save()
+        self.ca_detail.manifest_add(self.uri_tail, self.ghostbuster)
         logger.debug("Generating %r", self)
         publisher.queue(
             uri        = self.uri,
@@ -2170,6 +2275,7 @@ class Ghostbuster(models.Model):
         old_obj = self.ghostbuster
         old_cer = self.cert
         old_uri = self.uri
+        old_tail = self.uri_tail
         if regenerate:
             self.generate(publisher = publisher)
         logger.debug("Withdrawing %r and revoking its EE cert", self)
@@ -2179,6 +2285,7 @@ class Ghostbuster(models.Model):
             old_obj    = old_obj,
             repository = old_ca_detail.ca.parent.repository,
             handler    = False if allow_failure else None)
+        old_ca_detail.manifest_remove(old_tail)
         if not regenerate:
             self.delete()
 
@@ -2282,31 +2389,34 @@ class ROA(models.Model):
             return "<ROA: ROA object>"
 
 
-    def update(self, publisher):
+    def update(self, publisher, signer = None):
         """
         Bring ROA up to date if necesssary.
+
+        If a rpki.x509.SigningQueue is supplied, any new ROA is signed,
+        saved, and published when the caller runs the queue.
         """
 
         trace_call_chain()
 
         if self.roa is None:
             logger.debug("%r doesn't exist, generating", self)
-            return self.generate(publisher = publisher)
+            return self.generate(publisher = publisher, signer = signer)
 
         if self.ca_detail is None:
             logger.debug("%r has no associated ca_detail, generating", self)
-            return self.generate(publisher = publisher)
+            return self.generate(publisher = publisher, signer = signer)
 
         if self.ca_detail.state != "active":
             logger.debug("ca_detail associated with %r not active (state %s), regenerating", self, self.ca_detail.state)
-            return self.regenerate(publisher = publisher)
+            return self.regenerate(publisher = publisher, signer = signer)
 
         now = rpki.sundial.now()
         regen_time = self.cert.getNotAfter() - rpki.sundial.timedelta(seconds = self.tenant.regen_margin)
 
         if now > regen_time and self.cert.getNotAfter() < self.ca_detail.latest_ca_cert.getNotAfter():
             logger.debug("%r past threshold %s, regenerating", self, regen_time)
-            return self.regenerate(publisher = publisher)
+            return self.regenerate(publisher = publisher, signer = signer)
 
         if now > regen_time:
             logger.warning("%r is past threshold %s but so is issuer %r, can't regenerate", self, regen_time, self.ca_detail)
@@ -2316,21 +2426,21 @@ class ROA(models.Model):
 
         if ee_resources.oversized(ca_resources):
             logger.debug("%r oversized with respect to CA, regenerating", self)
-            return self.regenerate(publisher = publisher)
+            return self.regenerate(publisher = publisher, signer = signer)
 
         v4 = rpki.resource_set.roa_prefix_set_ipv4(self.ipv4).to_resource_set()
         v6 = rpki.resource_set.roa_prefix_set_ipv6(self.ipv6).to_resource_set()
 
         if ee_resources.v4 != v4 or ee_resources.v6 != v6:
             logger.debug("%r resources do not match EE, regenerating", self)
-            return self.regenerate(publisher = publisher)
+            return self.regenerate(publisher = publisher, signer = signer)
 
         if self.cert.get_AIA()[0] != self.ca_detail.ca_cert_uri:
             logger.debug("%r AIA changed, regenerating", self)
-            return self.regenerate(publisher = publisher)
+            return self.regenerate(publisher = publisher, signer = signer)
 
 
-    def generate(self, publisher):
+    def generate(self, publisher, signer = None, then = None):
         """
         Generate a ROA.
 
@@ -2346,6 +2456,10 @@ class ROA(models.Model):
         private key for the EE cert, all per the ROA specification.  This
         implies that generating a lot of ROAs will tend to thrash
         /dev/random, but there is not much we can do about that.
+
+        The ROA itself is signed by signer, if supplied; the rest of the
+        work, and then the optional "then" callback, happens once the
+        signature is done.
         """
 
         trace_call_chain()
@@ -2385,18 +2499,29 @@ class ROA(models.Model):
             subject_key = keypair.get_public(),
             sia         = (None, None, self.uri_from_key(keypair),
                            self.ca_detail.ca.parent.repository.rrdp_notification_uri))
-        self.roa = rpki.x509.ROA.build(self.asn,
-                                       rpki.resource_set.roa_prefix_set_ipv4(self.ipv4),
-                                       rpki.resource_set.roa_prefix_set_ipv6(self.ipv6),
-                                       keypair,
-                                       (self.cert,))
-        self.published = rpki.sundial.now()
-        self.save()
 
-        logger.debug("Generating %r", self)
-        publisher.queue(uri = self.uri, new_obj = self.roa,
-                        repository = self.ca_detail.ca.parent.repository,
-                        handler = self.published_callback)
+        def signed(roa):
+            self.roa = roa
+            self.published = rpki.sundial.now()
+            self.save()
+            self.ca_detail.manifest_add(self.uri_tail, self.roa)
+            logger.debug("Generating %r", self)
+            publisher.queue(uri = self.uri, new_obj = self.roa,
+                            repository = self.ca_detail.ca.parent.repository,
+                            handler = self.published_callback)
+            if then is not None:
+                then()
+
+        if signer is None:
+            signer = rpki.x509.SigningQueue()
+
+        rpki.x509.ROA.build(self.asn,
+                            rpki.resource_set.roa_prefix_set_ipv4(self.ipv4),
+                            rpki.resource_set.roa_prefix_set_ipv6(self.ipv6),
+                            keypair,
+                            (self.cert,),
+                            signer = signer,
+                            callback = signed)
 
 
     def published_callback(self, pdu):
@@ -2410,13 +2535,15 @@ class ROA(models.Model):
         self.save()
 
 
-    def revoke(self, publisher, regenerate = False, allow_failure = False):
+    def revoke(self, publisher, regenerate = False, allow_failure = False, signer = None):
         """
         Withdraw this ROA.
 
         In order to preserve make-before-break properties without
         duplicating code, this method also handles generating a
-        replacement ROA when requested.
+        replacement ROA when requested.  When the replacement is signed
+        by a rpki.x509.SigningQueue, the withdrawal waits until the
+        replacement has been signed and queued for publication.
 
         If allow_failure is set, failing to withdraw the ROA will not be
         considered an error.
@@ -2428,29 +2555,36 @@ class ROA(models.Model):
         old_obj = self.roa
         old_cer = self.cert
         old_uri = self.uri
+        old_tail = self.uri_tail
+
+        def withdraw():
+            logger.debug("Withdrawing %r and revoking its EE cert", self)
+            RevokedCert.revoke(cert = old_cer, ca_detail = old_ca_detail)
+            publisher.queue(
+                uri        = old_uri,
+                old_obj    = old_obj,
+                repository = old_ca_detail.ca.parent.repository,
+                handler    = False if allow_failure else None)
+            old_ca_detail.manifest_remove(old_tail)
+            if not regenerate:
+                self.delete()
+
         if regenerate:
-            self.generate(publisher = publisher)
-        logger.debug("Withdrawing %r and revoking its EE cert", self)
-        RevokedCert.revoke(cert = old_cer, ca_detail = old_ca_detail)
-        publisher.queue(
-            uri        = old_uri,
-            old_obj    = old_obj,
-            repository = old_ca_detail.ca.parent.repository,
-            handler    = False if allow_failure else None)
-        if not regenerate:
-            self.delete()
+            self.generate(publisher = publisher, signer = signer, then = withdraw)
+        else:
+            withdraw()
 
 
-    def regenerate(self, publisher):
+    def regenerate(self, publisher, signer = None):
         """
         Reissue this ROA.
         """
 
         trace_call_chain()
         if self.ca_detail is None:
-            self.generate(publisher = publisher)
+            self.generate(publisher = publisher, signer = signer)
         else:
-            self.revoke(publisher = publisher, regenerate = True)
+            self.revoke(publisher = publisher, regenerate = True, signer = signer)
 
 
     def uri_from_key(self, key):
@@ -1672,6 +1672,14 @@ class CMS_object(DER_object):
         Sign and wrap inner content.
         """
 
+        self._sign(*self._signing_args(keypair, certs, crls, no_certs))
+
+    def _signing_args(self, keypair, certs, crls = None, no_certs = False):
+        """
+        Convert .sign() arguments to the form POW wants: signing
+        certificate, key, other certificates, CRLs, and CMS flags.
+        """
+
         if isinstance(certs, X509):
             cert = certs
             certs = ()
@@ -1691,11 +1699,11 @@ class CMS_object(DER_object):
                 logger.debug("Additional cert %d issuer %s subject %s SKI %s",
                              i, c.getIssuer(), c.getSubject(), c.hSKI())
 
-        self._sign(cert.get_POW(),
-                   keypair.get_POW(),
-                   [x.get_POW() for x in certs],
-                   [c.get_POW() for c in crls],
-                   rpki.POW.CMS_NOCERTS if no_certs else 0)
+        return (cert.get_POW(),
+                keypair.get_POW(),
+                [x.get_POW() for x in certs],
+                [c.get_POW() for c in crls],
+                rpki.POW.CMS_NOCERTS if no_certs else 0)
 
     def _sign(self, cert, keypair, certs, crls, flags):
         raise NotImplementedError
@@ -1823,6 +1831,8 @@ class SignedManifest(DER_CMS_object):
     econtent_oid = rpki.oids.id_ct_rpkiManifest
     POW_class = rpki.POW.Manifest
 
+    _builder = None
+
     def getThisUpdate(self):
         """
         Get thisUpdate value from this manifest.
@@ -1837,16 +1847,27 @@ class SignedManifest(DER_CMS_object):
 
         return self.get_POW().getNextUpdate()
 
+    def _sign(self, cert, keypair, certs, crls, flags):
+        if self._builder is None:
+            DER_CMS_object._sign(self, cert, keypair, certs, crls, flags)
+        else:
+            self._builder.sign(self.get_POW(), cert, keypair, certs, crls, self.econtent_oid, flags)
+
     @classmethod
-    def build(cls, serial, thisUpdate, nextUpdate, names_and_objs, keypair, certs, version = 0):
+    def build(cls, serial, thisUpdate, nextUpdate, names_and_objs, keypair, certs, version = 0, builder = None,
+              signer = None, callback = None):
         """
         Build a signed manifest.
-        """
 
-        filelist = []
-        for name, obj in names_and_objs:
-            filelist.append((name.rpartition("/")[2], sha256(obj.get_DER())))
-        filelist.sort(key = lambda x: x[0])
+        If a SigningQueue is supplied, the manifest is signed by the
+        queue, which calls callback with the result.
+
+        If a rpki.POW.ManifestBuilder is supplied, its current entries are
+        the fileList and names_and_objs is ignored.  Keeping the builder
+        up to date as objects are published and withdrawn is the caller's
+        job; in exchange, nothing which did not change is hashed or
+        encoded again.
+        """
 
         obj = cls.POW_class()
         obj.setVersion(version)
@@ -1854,10 +1875,23 @@ class SignedManifest(DER_CMS_object):
         obj.setThisUpdate(thisUpdate)
         obj.setNextUpdate(nextUpdate)
         obj.setAlgorithm(rpki.oids.id_sha256)
-        obj.addFiles(filelist)
+
+        if builder is None:
+            filelist = []
+            for name, o in names_and_objs:
+                filelist.append((name.rpartition("/")[2], sha256(o.get_DER())))
+            filelist.sort(key = lambda x: x[0])
+            obj.addFiles(filelist)
 
         self = cls(POW = obj)
-        self.sign(keypair, certs)
+        self._builder = builder
+        try:
+            if signer is None:
+                self.sign(keypair, certs)
+            else:
+                signer.sign_cms(self, keypair, certs, callback)
+        finally:
+            del self._builder
         return self
 
 class ROA(DER_CMS_object):
@@ -1869,9 +1903,12 @@ class ROA(DER_CMS_object):
     POW_class = rpki.POW.ROA
 
     @classmethod
-    def build(cls, asn, ipv4, ipv6, keypair, certs, version = 0):
+    def build(cls, asn, ipv4, ipv6, keypair, certs, version = 0, signer = None, callback = None):
         """
         Build a ROA.
+
+        If a SigningQueue is supplied, the ROA is signed by the queue,
+        which calls callback with the result.
         """
 
         ipv4 = ipv4.to_POW_roa_tuple() if ipv4 else None
@@ -1881,7 +1918,10 @@ class ROA(DER_CMS_object):
         obj.setASID(asn)
         obj.setPrefixes(ipv4 = ipv4, ipv6 = ipv6)
         self = cls(POW = obj)
-        self.sign(keypair, certs)
+        if signer is None:
+            self.sign(keypair, certs)
+        else:
+            signer.sign_cms(self, keypair, certs, callback)
         return self
 
     def tracking_data(self, uri):
@@ -2173,9 +2213,13 @@ class CRL(DER_object):
         return self.get_POW().getCRLNumber()
 
     @classmethod
-    def generate(cls, keypair, issuer, serial, thisUpdate, nextUpdate, revokedCertificates, version = 1):
+    def generate(cls, keypair, issuer, serial, thisUpdate, nextUpdate, revokedCertificates, version = 1,
+                 signer = None, callback = None):
         """
         Generate a new CRL.
+
+        If a SigningQueue is supplied, the CRL is signed by the queue,
+        which calls callback with the result.
         """
 
         crl = rpki.POW.CRL()
@@ -2186,8 +2230,12 @@ class CRL(DER_object):
         crl.setAKI(issuer.get_SKI())
         crl.setCRLNumber(serial)
         crl.addRevocations(revokedCertificates)
-        crl.sign(keypair.get_POW())
-        return cls(POW = crl)
+        self = cls(POW = crl)
+        if signer is None:
+            crl.sign(keypair.get_POW())
+        else:
+            signer.sign_crl(self, keypair, callback)
+        return self
 
     @property
     def creation_timestamp(self):
@@ -2197,6 +2245,85 @@ class CRL(DER_object):
 
         return self.getThisUpdate()
 
+class SigningQueue(object):
+    """
+    Queue of signing operations to run on a rpki.POW.AsyncSigningPool.
+
+    Callers hand objects to the queue along with a callback, then yield
+    .run(), which waits for the pool without blocking the event loop
+    and calls each callback, in the event loop's thread, with the
+    signed object as its job completes.  Callbacks may queue more work,
+    eg, a manifest which can't be built until its CRL has been signed.
+
+    Without a pool, each object is signed and its callback called
+    immediately, exactly as if the caller had signed it directly.
+    """
+
+    def __init__(self, pool = None):
+        self.pool = pool
+        self.jobs = []
+
+    def sign_cms(self, obj, keypair, certs, callback, crls = None):
+        """
+        Sign a DER_CMS_object (manifest or ROA).
+        """
+
+        if self.pool is None:
+            obj.sign(keypair, certs, crls)
+            callback(obj)
+            return
+
+        cert, key, certs, crls, flags = obj._signing_args(keypair, certs, crls)
+
+        # A manifest's builder goes to the pool too, so that the pool
+        # splices in the fileList just as ManifestBuilder.sign() would.
+
+        future = self.pool.signCMS(obj.get_POW(), cert, key, certs = certs, crls = crls,
+                                   eContentType = obj.econtent_oid, flags = flags,
+                                   builder = getattr(obj, "_builder", None))
+        self.jobs.append((future, obj, callback))
+
+    def sign_crl(self, obj, keypair, callback):
+        """
+        Sign a CRL.
+        """
+
+        if self.pool is None:
+            obj.get_POW().sign(keypair.get_POW())
+            callback(obj)
+            return
+
+        future = self.pool.signCRL(obj.get_POW(), keypair.get_POW())
+        self.jobs.append((future, obj, callback))
+
+    def run(self):
+        """
+        Wait for all queued signing operations, including any queued by
+        callbacks, and call their callbacks.  A failure is logged and
+        affects only the object concerned, as with the per-object
+        exception handlers in rpkid's update tasks.
+
+        Returns a Tornado Future.  Tornado is imported here rather than
+        at the top of this module, as in rpki.POW.AsyncSigningPool, so
+        that programs which never sign through a pool don't need it.
+        """
+
+        import tornado.gen
+        return tornado.gen.coroutine(self._run)()
+
+    def _run(self):
+        while self.jobs:
+            future, obj, callback = self.jobs.pop(0)
+            try:
+                yield future
+            except Exception as e:
+                logger.error("Could not sign %r: %s", obj, e)
+                continue
+            try:
+                callback(obj)
+            except:
+                logger.exception("Could not finish signing %r", obj)
+
 ## @var uri_dispatch_map
 # Map of known URI filename extensions and corresponding classes.
 